@@ -0,0 +1,182 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Several sources play at once through the mixer. Each one opens a stream in
+ * its own format, the mixer converts it to the output format, applies the
+ * stream gain and ducks streams while one of higher priority plays. A single
+ * task writes the mix to the codec, paced by its DMA.
+ *
+ * From bsp_mixer_start to bsp_mixer_stop the mixer owns the play direction:
+ * the codec stays in the output format, and nothing else may call
+ * bsp_i2s_write, bsp_codec_set_play_fs, bsp_codec_set_fs or
+ * bsp_i2s_set_mode(BSP_I2S_DIR_PLAY). A second writer would interleave its
+ * blocks with the mix, and a format change would play the mix at the wrong
+ * rate. Recording is not affected, pick an output rate the recorder can
+ * share since both directions use the same I2S clock.
+ */
+
+#define BSP_MIXER_MAX_RATE          (48000)     /*!< Highest rate of a stream or of the output */
+
+typedef struct {
+    uint32_t sample_rate;           /*!< Output rate */
+    uint8_t channels;               /*!< Output channels, 1 or 2, the output is 16 bit */
+    float duck_db;                  /*!< Gain of a stream while one of higher priority plays */
+    uint32_t ramp_ms;               /*!< Time for a gain change to take full effect */
+    uint8_t task_priority;          /*!< Priority of the mixer task */
+    int task_core;                  /*!< Core of the mixer task, or tskNO_AFFINITY */
+} bsp_mixer_config_t;
+
+#define BSP_MIXER_DEFAULT_CONFIG() \
+    {                               \
+        .sample_rate = 16000,       \
+        .channels = 2,              \
+        .duck_db = -12.0f,          \
+        .ramp_ms = 50,              \
+        .task_priority = 10,        \
+        .task_core = 1,             \
+    }
+
+typedef struct {
+    uint32_t sample_rate;           /*!< Up to BSP_MIXER_MAX_RATE */
+    uint8_t bits;                   /*!< 8 (unsigned), 16, 24 (packed) or 32 */
+    uint8_t channels;               /*!< 1 or 2 */
+    uint8_t priority;               /*!< Streams of lower priority are ducked while this one plays */
+    size_t buffer_size;             /*!< Bytes queued ahead of the mixer, 0 for 100 ms */
+} bsp_mixer_stream_config_t;
+
+typedef struct {
+    uint32_t blocks;                /*!< Blocks written to the codec */
+    uint32_t underruns;             /*!< Blocks in which a playing stream ran short */
+    uint32_t clipped;               /*!< Output samples saturated */
+    uint32_t last_mix_us;           /*!< Time to mix the last block */
+    uint32_t max_mix_us;            /*!< Longest time to mix a block */
+    uint8_t streams;                /*!< Open streams */
+} bsp_mixer_stats_t;
+
+typedef struct bsp_mixer_stream_t *bsp_mixer_stream_handle_t;
+
+/**
+ * @brief Set the codec to the output format and start the mixer task.
+ *
+ * @note The mixer owns the play direction until bsp_mixer_stop.
+ *
+ * @param config: Mixer configuration
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ *    - ESP_ERR_INVALID_STATE: Already started
+ *    - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t bsp_mixer_start(const bsp_mixer_config_t *config);
+
+/**
+ * @brief Stop the mixer task.
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_STATE: Not started or streams still open
+ */
+esp_err_t bsp_mixer_stop(void);
+
+/**
+ * @brief Open a stream, it starts playing once a block is queued.
+ *
+ * @param config: Stream configuration
+ * @param ret_stream: Returned stream
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ *    - ESP_ERR_INVALID_STATE: Mixer not started
+ *    - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t bsp_mixer_stream_open(const bsp_mixer_stream_config_t *config, bsp_mixer_stream_handle_t *ret_stream);
+
+/**
+ * @brief Play what is queued, then close the stream.
+ *
+ * @param stream: Stream to close
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t bsp_mixer_stream_close(bsp_mixer_stream_handle_t stream);
+
+/**
+ * @brief Queue data, same arguments as bsp_i2s_write.
+ *
+ * @note One task writes to a stream at a time.
+ *
+ * @param stream: Stream
+ * @param data: PCM in the format of the stream
+ * @param len: Bytes of data
+ * @param bytes_written: Bytes queued, can be NULL if not needed
+ * @param timeout_ms: Max block time, portMAX_DELAY to wait until all is queued
+ *
+ * @return
+ *    - ESP_OK: len bytes queued
+ *    - ESP_ERR_TIMEOUT: Timeout, bytes_written tells what was queued
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t bsp_mixer_stream_write(bsp_mixer_stream_handle_t stream, const void *data, size_t len,
+                                 size_t *bytes_written, uint32_t timeout_ms);
+
+/**
+ * @brief Change the format of a stream, after what was queued has played.
+ *
+ * @param stream: Stream
+ * @param rate: Sample rate
+ * @param bits: Bits per sample
+ * @param channels: Channels
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ *    - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t bsp_mixer_stream_set_format(bsp_mixer_stream_handle_t stream, uint32_t rate, uint8_t bits,
+                                      uint8_t channels);
+
+/**
+ * @brief Set the gain of a stream, ramped over ramp_ms.
+ *
+ * @param stream: Stream
+ * @param gain_db: Gain, up to +6 dB, -INFINITY mutes
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t bsp_mixer_stream_set_gain(bsp_mixer_stream_handle_t stream, float gain_db);
+
+/**
+ * @brief Get the counters of the mixer.
+ *
+ * @param stats: Output counters
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t bsp_mixer_get_stats(bsp_mixer_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -33,6 +33,75 @@ typedef enum {
     BOTTOM_ID_LOST,     /*!< bottom ESP32-S3-BOX-3-SENSOR is connect when poweron, and lost */
 } bottom_id_t;
 
+typedef enum {
+    BSP_SENSOR_HUMITURE,    /*!< value[0]: temperature, value[1]: humidity */
+    BSP_SENSOR_RADAR,       /*!< value[0]: 1 on presence enter, 0 on leave */
+    BSP_SENSOR_MAX,
+} bsp_sensor_id_t;
+
+typedef enum {
+    BSP_SENSOR_EVENT_ATTACHED,  /*!< Sensor answered after being absent, no value yet */
+    BSP_SENSOR_EVENT_DETACHED,  /*!< Sensor stopped answering */
+    BSP_SENSOR_EVENT_CHANGED,   /*!< New value, first one or beyond the threshold of the last notified */
+} bsp_sensor_event_t;
+
+#define BSP_SENSOR_VALUE_NUM        (2)
+
+typedef struct {
+    float value[BSP_SENSOR_VALUE_NUM];
+    int64_t timestamp_us;   /*!< esp_timer time of the read */
+} bsp_sensor_value_t;
+
+typedef struct {
+    uint32_t reads;         /*!< Sensor reads */
+    uint32_t failures;      /*!< Reads that failed */
+    uint32_t probes;        /*!< Bus probes of absent sensors */
+    uint32_t wakeups;       /*!< Times the sensor task ran */
+} bsp_sensor_stats_t;
+
+/**
+ * @brief Sensor event callback, runs in the sensor task
+ *
+ * @param id: Sensor
+ * @param event: Event
+ * @param value: Last value, only valid for BSP_SENSOR_EVENT_CHANGED
+ * @param user_data: User data
+ */
+typedef void (*bsp_sensor_cb_t)(bsp_sensor_id_t id, bsp_sensor_event_t event, const bsp_sensor_value_t *value,
+                                void *user_data);
+
+#define BSP_I2S_CHUNK_MS            (10)    /*!< Audio moved per codec transfer */
+#define BSP_I2S_DEFAULT_BUFFER_MS   (100)   /*!< Ring of the buffered mode */
+
+typedef enum {
+    BSP_I2S_DIR_RECORD,     /*!< bsp_i2s_read */
+    BSP_I2S_DIR_PLAY,       /*!< bsp_i2s_write */
+} bsp_i2s_dir_t;
+
+typedef enum {
+    BSP_I2S_MODE_DIRECT,    /*!< The calling task transfers with the codec, default */
+    BSP_I2S_MODE_BUFFERED,  /*!< A task transfers with the codec through a ring */
+} bsp_i2s_mode_t;
+
+typedef struct {
+    uint32_t bytes;         /*!< Bytes read or written */
+    uint32_t timeouts;      /*!< Calls that returned ESP_ERR_TIMEOUT */
+    uint32_t errors;        /*!< Codec transfers that failed */
+    uint32_t underruns;     /*!< Buffered mode, play: chunks padded with silence */
+    uint32_t overruns;      /*!< Buffered mode, record: chunks dropped on a full ring */
+} bsp_i2s_stats_t;
+
+typedef struct {
+    uint32_t requests;          /*!< Format requests */
+    uint32_t skipped;           /*!< Requests that found the devices open with that format */
+    uint32_t play_reopens;      /*!< Times the speaker was reopened */
+    uint32_t record_reopens;    /*!< Times the microphone was reopened */
+    uint32_t last_us;           /*!< Duration of the last reconfiguration */
+    uint32_t max_us;            /*!< Longest reconfiguration */
+    uint32_t last_gap_us;       /*!< Time the microphone was closed by the last reconfiguration that reopened it */
+    uint32_t max_gap_us;        /*!< Longest microphone gap */
+} bsp_codec_stats_t;
+
 typedef struct {
     gpio_num_t row1[4]; /*!< first row */
     gpio_num_t row2[4]; /*!< second row */
@@ -135,6 +204,67 @@ typedef bottom_id_t (*bsp_sys_get_bottom_id)();
  */
 typedef esp_err_t (*bsp_bottom_get_humiture)(float *temperature, float *humidity);
 
+/**
+ * @brief Get the last value read from a sensor
+ *
+ * @param id: Sensor
+ * @param value: Output value and its timestamp
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ *    - ESP_ERR_INVALID_STATE: Sensor absent or not read yet
+ */
+typedef esp_err_t (*bsp_bottom_get_sensor_value)(bsp_sensor_id_t id, bsp_sensor_value_t *value);
+
+/**
+ * @brief Set how often a sensor is read
+ *
+ * @param id: Sensor
+ * @param period_ms: Read period, 0 stops periodic reads
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+typedef esp_err_t (*bsp_bottom_set_sensor_period)(bsp_sensor_id_t id, uint32_t period_ms);
+
+/**
+ * @brief Subscribe to the events of a sensor
+ *
+ * @note Events already being delivered when unsubscribing may still reach the callback.
+ *
+ * @param id: Sensor
+ * @param cb: Callback
+ * @param user_data: User data passed to the callback
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ *    - ESP_ERR_NO_MEM: Too many subscriptions
+ */
+typedef esp_err_t (*bsp_bottom_sensor_subscribe)(bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data);
+
+/**
+ * @brief Remove a subscription made with the same arguments
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_NOT_FOUND: No such subscription
+ */
+typedef esp_err_t (*bsp_bottom_sensor_unsubscribe)(bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data);
+
+/**
+ * @brief Get the counters of the sensor task
+ *
+ * @param stats: Output counters
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+typedef esp_err_t (*bsp_bottom_get_sensor_stats)(bsp_sensor_stats_t *stats);
+
 /**
  * @brief Player set mute.
  *
@@ -179,6 +309,9 @@ esp_err_t bsp_codec_dev_resume(void);
 /**
  * @brief Set I2S format to codec.
  *
+ * @note Devices already open with this format are not reopened.
+ * @note Not while bsp_mixer runs, it owns the player format.
+ *
  * @param rate: Sample rate of sample
  * @param bits_cfg: Bit lengths of one channel data
  * @param ch: Channels of sample
@@ -189,33 +322,99 @@ esp_err_t bsp_codec_dev_resume(void);
  */
 esp_err_t bsp_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch);
 
+/**
+ * @brief Set I2S format of the player only.
+ *
+ * @note The recorder keeps streaming unless the rate or bit width changes,
+ *       both directions share the I2S clock. It keeps its channels then.
+ * @note Not while bsp_mixer runs, it owns the player format.
+ *
+ * @param rate: Sample rate of sample
+ * @param bits_cfg: Bit lengths of one channel data
+ * @param ch: Channels of sample
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - Others: Fail
+ */
+esp_err_t bsp_codec_set_play_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch);
+
+/**
+ * @brief Get the counters of codec reconfiguration.
+ *
+ * @param stats: Output counters
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t bsp_codec_get_stats(bsp_codec_stats_t *stats);
+
 /**
  * @brief Read data from recoder.
  *
+ * @note In BSP_I2S_MODE_DIRECT the codec is read in chunks of BSP_I2S_CHUNK_MS
+ *       and the timeout is checked between chunks, so a call may return up to
+ *       one chunk late and always reads at least one chunk. In BSP_I2S_MODE_BUFFERED
+ *       data is taken from the ring without waiting for longer than the timeout,
+ *       a timeout of 0 never blocks.
+ *
  * @param audio_buffer: The pointer of receiving data buffer
  * @param len: Max data buffer length
  * @param bytes_read: Byte number that actually be read, can be NULL if not needed
- * @param timeout_ms: Max block time
+ * @param timeout_ms: Max block time, portMAX_DELAY to wait until len bytes are read
  *
  * @return
- *    - ESP_OK: Success
- *    - Others: Fail
+ *    - ESP_OK: len bytes read
+ *    - ESP_ERR_TIMEOUT: Timeout, bytes_read tells what was read before
+ *    - ESP_ERR_INVALID_STATE: Codec stopped
+ *    - ESP_FAIL: Codec error, bytes_read tells what was read before
  */
 esp_err_t bsp_i2s_read(void *audio_buffer, size_t len, size_t *bytes_read, uint32_t timeout_ms);
 
 /**
  * @brief Write data to player.
  *
+ * @note Timeouts are handled as in bsp_i2s_read.
+ * @note Not while bsp_mixer runs, play through a mixer stream instead.
+ *
  * @param audio_buffer: The pointer of sent data buffer
  * @param len: Max data buffer length
  * @param bytes_written: Byte number that actually be sent, can be NULL if not needed
- * @param timeout_ms: Max block time
+ * @param timeout_ms: Max block time, portMAX_DELAY to wait until len bytes are written
+ *
+ * @return
+ *    - ESP_OK: len bytes written
+ *    - ESP_ERR_TIMEOUT: Timeout, bytes_written tells what was written before
+ *    - ESP_ERR_INVALID_STATE: Codec stopped
+ *    - ESP_FAIL: Codec error, bytes_written tells what was written before
+ */
+esp_err_t bsp_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms);
+
+/**
+ * @brief Select how bsp_i2s_read or bsp_i2s_write move data.
+ *
+ * @param dir: Record or play
+ * @param mode: Direct or buffered
+ * @param buffer_size: Bytes of the ring in buffered mode, 0 for BSP_I2S_DEFAULT_BUFFER_MS of audio
  *
  * @return
  *    - ESP_OK: Success
  *    - Others: Fail
  */
-esp_err_t bsp_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms);
+esp_err_t bsp_i2s_set_mode(bsp_i2s_dir_t dir, bsp_i2s_mode_t mode, size_t buffer_size);
+
+/**
+ * @brief Get the counters of bsp_i2s_read or bsp_i2s_write.
+ *
+ * @param dir: Record or play
+ * @param stats: Output counters
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t bsp_i2s_get_stats(bsp_i2s_dir_t dir, bsp_i2s_stats_t *stats);
 
 typedef struct {
     bsp_sys_get_sleep_mode get_sleep_mode;
@@ -224,6 +423,12 @@ typedef struct {
     bsp_bottom_set_radar_enable set_radar_enable;
     bsp_bottom_get_radar_status get_radar_status;
     bsp_bottom_get_humiture get_humiture;
+
+    bsp_bottom_get_sensor_value get_sensor_value;
+    bsp_bottom_set_sensor_period set_sensor_period;
+    bsp_bottom_sensor_subscribe subscribe;
+    bsp_bottom_sensor_unsubscribe unsubscribe;
+    bsp_bottom_get_sensor_stats get_sensor_stats;
 } bsp_bottom_property_t;
 
 typedef struct {
@@ -0,0 +1,73 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Gains are Q14, unity is 1 << 14 and the largest is about +6 dB */
+#define MIXER_GAIN_SHIFT    (14)
+#define MIXER_GAIN_UNITY    (1 << MIXER_GAIN_SHIFT)
+#define MIXER_GAIN_MAX      (INT16_MAX)
+
+/**
+ * Linear interpolation between consecutive frames. The output lags the input
+ * by one frame, the last frame consumed is kept for the next call.
+ */
+typedef struct {
+    uint32_t step;          /*!< Input frames per output frame, Q16 */
+    uint32_t phase;         /*!< Position after hist, Q16 */
+    int16_t hist[2];        /*!< Last frame consumed */
+    uint8_t channels;
+} mixer_resampler_t;
+
+void mixer_resampler_init(mixer_resampler_t *rs, uint32_t in_rate, uint32_t out_rate, uint8_t channels);
+
+/**
+ * @brief Input frames to have at hand to produce out_frames
+ */
+size_t mixer_resampler_need(const mixer_resampler_t *rs, size_t out_frames);
+
+/**
+ * @brief Produce out_frames from mixer_resampler_need(out_frames) input frames
+ *
+ * @return Input frames consumed, the rest starts the next call
+ */
+size_t mixer_resample(mixer_resampler_t *rs, const int16_t *in, int16_t *out, size_t out_frames);
+
+/**
+ * @brief Convert PCM to 16 bit with out_ch channels, stereo to mono averages
+ *
+ * @param bits: 8 (unsigned), 16, 24 (packed) or 32, little endian
+ */
+void mixer_convert(const void *in, uint8_t bits, uint8_t in_ch, int16_t *out, uint8_t out_ch, size_t frames);
+
+/**
+ * @brief Add in times a gain ramping linearly from gain_from to gain_to over the frames
+ */
+void mixer_accumulate(int32_t *acc, const int16_t *in, size_t frames, uint8_t channels,
+                      int32_t gain_from, int32_t gain_to);
+
+/**
+ * @brief Saturate the sums to 16 bit
+ *
+ * @return Samples clipped
+ */
+size_t mixer_saturate(const int32_t *acc, int16_t *out, size_t samples);
+
+/**
+ * @brief Q14 gain of a level in dB, clamped to MIXER_GAIN_MAX
+ */
+int32_t mixer_gain_from_db(float db);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,74 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_codec_dev.h"
+#include "bsp_board.h"
+#include "bsp_i2s_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BSP_CODEC_SESSION_PLAY      (1 << BSP_I2S_DIR_PLAY)
+#define BSP_CODEC_SESSION_RECORD    (1 << BSP_I2S_DIR_RECORD)
+#define BSP_CODEC_SESSION_BOTH      (BSP_CODEC_SESSION_PLAY | BSP_CODEC_SESSION_RECORD)
+
+typedef struct {
+    esp_codec_dev_handle_t play_dev;
+    esp_codec_dev_handle_t record_dev;
+    bsp_i2s_stream_handle_t play_stream;    /*!< Locked while play_dev is reopened */
+    bsp_i2s_stream_handle_t record_stream;  /*!< Locked while record_dev is reopened */
+    float in_gain;                          /*!< Microphone gain, set again on each reopen */
+    bool shared_clock;                      /*!< Both directions run at the same rate and bit width, full duplex I2S */
+} bsp_codec_session_config_t;
+
+/**
+ * @brief Start the session with both devices closed
+ *
+ * @param config: Devices and streams
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t bsp_codec_session_init(const bsp_codec_session_config_t *config);
+
+/**
+ * @brief Open the devices in `dirs` with `fs`
+ *
+ * Devices already open with that format are left running. With a shared
+ * clock the other device follows a change of rate or bit width and keeps
+ * its channels, otherwise it is left alone. A closed device not in `dirs`
+ * stays closed.
+ *
+ * @param dirs: BSP_CODEC_SESSION_PLAY, BSP_CODEC_SESSION_RECORD or both
+ * @param fs: Format
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - Others: Fail, the device that failed to open is left closed
+ */
+esp_err_t bsp_codec_session_set_fs(uint32_t dirs, const esp_codec_dev_sample_info_t *fs);
+
+/**
+ * @brief Close both devices
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - Others: Fail
+ */
+esp_err_t bsp_codec_session_stop(void);
+
+void bsp_codec_session_get_stats(bsp_codec_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "bsp_board.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Blocking transfer of a whole chunk with the codec
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE when the codec is closed, or ESP_FAIL
+ */
+typedef esp_err_t (*bsp_i2s_stream_io_t)(void *data, size_t len, void *ctx);
+
+typedef struct {
+    bsp_i2s_stream_io_t io;     /*!< Codec transfer */
+    void *ctx;                  /*!< Passed to io */
+    bool playback;              /*!< Data goes to the codec */
+    const char *task_name;      /*!< Name of the buffered mode task */
+    uint8_t task_priority;      /*!< Priority of the buffered mode task */
+} bsp_i2s_stream_config_t;
+
+typedef struct bsp_i2s_stream_t *bsp_i2s_stream_handle_t;
+
+/**
+ * @brief Create a stream in direct mode
+ *
+ * @param config: Stream configuration
+ * @param ret_stream: Returned stream
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ *    - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t bsp_i2s_stream_create(const bsp_i2s_stream_config_t *config, bsp_i2s_stream_handle_t *ret_stream);
+
+/**
+ * @brief Set the format, transfers are cut in chunks of BSP_I2S_CHUNK_MS
+ *
+ * @param stream: Stream
+ * @param sample_rate: Frames per second
+ * @param frame_bytes: Bytes per frame, all channels
+ */
+void bsp_i2s_stream_set_format(bsp_i2s_stream_handle_t stream, uint32_t sample_rate, uint32_t frame_bytes);
+
+/**
+ * @brief Switch between direct and buffered mode
+ *
+ * Leaving buffered mode plays what is left in the ring, or drops what was
+ * recorded and not read.
+ *
+ * @param stream: Stream
+ * @param mode: New mode
+ * @param buffer_size: Bytes of the ring in buffered mode, 0 for BSP_I2S_DEFAULT_BUFFER_MS of audio
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t bsp_i2s_stream_set_mode(bsp_i2s_stream_handle_t stream, bsp_i2s_mode_t mode, size_t buffer_size);
+
+/**
+ * @brief Read or write, with the semantics of bsp_i2s_read and bsp_i2s_write
+ */
+esp_err_t bsp_i2s_stream_transfer(bsp_i2s_stream_handle_t stream, void *data, size_t len, size_t *done,
+                                  uint32_t timeout_ms);
+
+/**
+ * @brief Keep the codec to the caller, waits for the chunk in progress
+ *
+ * Held while the codec is reconfigured, transfers wait meanwhile.
+ */
+void bsp_i2s_stream_lock(bsp_i2s_stream_handle_t stream);
+
+void bsp_i2s_stream_unlock(bsp_i2s_stream_handle_t stream);
+
+void bsp_i2s_stream_get_stats(bsp_i2s_stream_handle_t stream, bsp_i2s_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Presence from the radar output. The output counts once it has held a level
+ * for debounce_ms. Presence starts when it goes high and ends hold_ms after
+ * it went low. power_off_delay_ms after it went low the box is told to
+ * sleep, and the next debounced rise wakes it. Nothing here blocks or keeps
+ * time, the caller feeds the edges and runs the engine at presence_next().
+ */
+
+#define PRESENCE_NEVER              (INT64_MAX)
+
+#define PRESENCE_EVENT_ENTER        (1 << 0)
+#define PRESENCE_EVENT_LEAVE        (1 << 1)
+#define PRESENCE_EVENT_POWER_OFF    (1 << 2)
+#define PRESENCE_EVENT_WAKE         (1 << 3)
+
+typedef struct {
+    uint32_t debounce_ms;           /*!< Time the output holds a level before it counts */
+    uint32_t hold_ms;               /*!< Presence kept after the output went low */
+    uint32_t power_off_delay_ms;    /*!< Absence before PRESENCE_EVENT_POWER_OFF */
+} presence_config_t;
+
+typedef struct {
+    presence_config_t config;
+    bool enabled;                   /*!< Disabled, the output only wakes the box */
+    bool level;                     /*!< Last level fed */
+    int64_t level_us;               /*!< Time of the last level change */
+    bool stable;                    /*!< Debounced level */
+    bool present;
+    bool asleep;                    /*!< PRESENCE_EVENT_POWER_OFF sent, no wake yet */
+    int64_t absent_us;              /*!< Time the output went low, PRESENCE_NEVER while present or never seen */
+} presence_t;
+
+/**
+ * @brief Start absent with the output low, feed the current level next
+ */
+void presence_init(presence_t *p, const presence_config_t *config, bool enabled, int64_t now_us);
+
+/**
+ * @brief Feed the level of the output after an edge
+ *
+ * @return PRESENCE_EVENT_* mask
+ */
+uint32_t presence_input(presence_t *p, bool level, int64_t now_us);
+
+/**
+ * @brief Apply the timers that are due
+ *
+ * @return PRESENCE_EVENT_* mask
+ */
+uint32_t presence_run(presence_t *p, int64_t now_us);
+
+/**
+ * @brief Enable or disable detection, enabling counts as a presence that starts the timers
+ *
+ * @return PRESENCE_EVENT_* mask
+ */
+uint32_t presence_set_enable(presence_t *p, bool enable, int64_t now_us);
+
+/**
+ * @brief Time presence_run has work to do, PRESENCE_NEVER if only an edge can change the state
+ */
+int64_t presence_next(const presence_t *p);
+
+#ifdef __cplusplus
+}
+#endif
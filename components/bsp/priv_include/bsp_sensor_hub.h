@@ -0,0 +1,110 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "bsp_board.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Reads each sensor at its own period and keeps the last value. A sensor that
+ * stops answering is detached and probed at probe_period_ms until it answers
+ * again, present sensors are never probed. Nothing here blocks or keeps time,
+ * the caller runs the hub at the deadline it returns and passes the time in.
+ */
+
+#define SENSOR_HUB_MAX_SUBSCRIBERS  (8)
+#define SENSOR_HUB_NEVER            (INT64_MAX)
+
+typedef struct {
+    esp_err_t (*probe)(void *ctx);                  /*!< ESP_OK when the device answers, NULL if always present */
+    esp_err_t (*attach)(void *ctx);                 /*!< Set the device up once it answers, can be NULL */
+    esp_err_t (*read)(void *ctx, float value[BSP_SENSOR_VALUE_NUM]);
+    void *ctx;
+    uint32_t period_ms;                             /*!< Read period, 0 to read only when attached */
+    uint32_t probe_period_ms;                       /*!< Probe period while absent */
+    float threshold;                                /*!< Smallest change notified */
+    uint8_t max_failures;                           /*!< Consecutive failed reads that detach, at least 1 */
+    int parent;                                     /*!< Lower id this one is wired behind, -1 for none */
+} sensor_hub_desc_t;
+
+typedef struct {
+    sensor_hub_desc_t desc;
+    bool used;
+    bool present;
+    bool has_value;
+    uint8_t failures;
+    int64_t due_us;
+    bsp_sensor_value_t value;
+    float notified[BSP_SENSOR_VALUE_NUM];           /*!< Value of the last BSP_SENSOR_EVENT_CHANGED */
+} sensor_hub_slot_t;
+
+typedef struct {
+    bsp_sensor_id_t id;
+    bsp_sensor_cb_t cb;
+    void *user_data;
+} sensor_hub_sub_t;
+
+typedef struct {
+    void (*lock)(void *arg);                        /*!< Guards the hub against other callers, can be NULL */
+    void (*unlock)(void *arg);
+    void *lock_arg;
+} sensor_hub_config_t;
+
+typedef struct {
+    sensor_hub_config_t config;
+    sensor_hub_slot_t slot[BSP_SENSOR_MAX];
+    sensor_hub_sub_t sub[SENSOR_HUB_MAX_SUBSCRIBERS];
+    bsp_sensor_stats_t stats;
+} sensor_hub_t;
+
+void sensor_hub_init(sensor_hub_t *hub, const sensor_hub_config_t *config);
+
+/**
+ * @brief Add a sensor, absent until the first run probes it
+ */
+esp_err_t sensor_hub_add(sensor_hub_t *hub, bsp_sensor_id_t id, const sensor_hub_desc_t *desc, int64_t now_us);
+
+/**
+ * @brief Probe, attach and read what is due, then deliver the events
+ *
+ * @note Device operations and callbacks run without the lock held.
+ *
+ * @return Time of the next deadline, SENSOR_HUB_NEVER if none
+ */
+int64_t sensor_hub_run(sensor_hub_t *hub, int64_t now_us);
+
+/**
+ * @brief Store a value that did not come from a read, such as one driven by an interrupt
+ *
+ * @return
+ *    - ESP_OK: Stored, BSP_SENSOR_EVENT_CHANGED delivered if beyond the threshold
+ *    - ESP_ERR_INVALID_STATE: Sensor absent
+ */
+esp_err_t sensor_hub_publish(sensor_hub_t *hub, bsp_sensor_id_t id, const float value[BSP_SENSOR_VALUE_NUM],
+                             int64_t now_us);
+
+esp_err_t sensor_hub_set_period(sensor_hub_t *hub, bsp_sensor_id_t id, uint32_t period_ms, int64_t now_us);
+
+esp_err_t sensor_hub_get_value(sensor_hub_t *hub, bsp_sensor_id_t id, bsp_sensor_value_t *value);
+
+bool sensor_hub_is_present(sensor_hub_t *hub, bsp_sensor_id_t id);
+
+esp_err_t sensor_hub_subscribe(sensor_hub_t *hub, bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data);
+
+esp_err_t sensor_hub_unsubscribe(sensor_hub_t *hub, bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data);
+
+void sensor_hub_get_stats(sensor_hub_t *hub, bsp_sensor_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,425 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+
+#include "bsp_board.h"
+#include "bsp_audio_mixer.h"
+#include "bsp_audio_mixer_dsp.h"
+
+#define MIXER_BLOCK_MS              (BSP_I2S_CHUNK_MS)
+#define MIXER_MAX_IN_FRAMES         (BSP_MIXER_MAX_RATE * MIXER_BLOCK_MS / 1000 + 2)
+#define MIXER_DEFAULT_BUFFER_MS     (100)
+#define MIXER_IDLE_WAIT_MS          (100)
+#define MIXER_TASK_STACK            (4 * 1024)
+
+struct bsp_mixer_stream_t {
+    bsp_mixer_stream_config_t config;
+    StreamBufferHandle_t ring;
+    size_t frame_bytes;
+    mixer_resampler_t rs;
+    int16_t *stage;                 /*!< Frames converted to the output channels, not resampled yet */
+    size_t staged;
+    size_t stage_frames;
+    volatile int32_t gain;          /*!< Set by the user, Q14 */
+    int32_t applied;                /*!< Gain at the end of the last block, Q14 */
+    bool playing;
+    volatile bool draining;         /*!< Play a partial block instead of waiting for more */
+    volatile bool closing;
+    SemaphoreHandle_t closed;
+    struct bsp_mixer_stream_t *next;
+};
+
+static struct {
+    bsp_mixer_config_t config;
+    SemaphoreHandle_t lock;         /*!< Stream list and stream formats */
+    bsp_mixer_stream_handle_t streams;
+    TaskHandle_t task;
+    SemaphoreHandle_t stopped;
+    volatile bool stop;
+    size_t out_frames;
+    int32_t duck;                   /*!< Q14 */
+    int32_t ramp_step;              /*!< Largest gain change per block, Q14 */
+    int top_priority;               /*!< Highest priority playing in the last block, -1 for none */
+    uint8_t *raw;                   /*!< Input read from a ring */
+    int16_t *mix;                   /*!< One stream in the output format */
+    int32_t *acc;
+    int16_t *out;
+    bsp_mixer_stats_t stats;
+} s_mixer;
+
+static const char *TAG = "bsp_mixer";
+
+static size_t mixer_stage_frames(uint32_t rate)
+{
+    return rate * MIXER_BLOCK_MS / 1000 + 2;
+}
+
+static bool mixer_format_valid(uint32_t rate, uint8_t bits, uint8_t channels)
+{
+    return rate > 0 && rate <= BSP_MIXER_MAX_RATE && (bits == 8 || bits == 16 || bits == 24 || bits == 32) &&
+           (channels == 1 || channels == 2);
+}
+
+/* Move frames from the ring to the stage and produce one block in s_mixer.mix, false when silent */
+static bool mixer_pull(bsp_mixer_stream_handle_t s)
+{
+    const uint8_t out_ch = s_mixer.config.channels;
+    const bool identity = (s->rs.step == (1 << 16));
+    const size_t need = identity ? s_mixer.out_frames : mixer_resampler_need(&s->rs, s_mixer.out_frames);
+    const size_t queued = xStreamBufferBytesAvailable(s->ring) / s->frame_bytes;
+    const bool flush = s->draining || s->closing;
+
+    if (flush && queued == 0 && !xStreamBufferIsEmpty(s->ring)) {
+        /* A partial frame left by a short write would never play */
+        xStreamBufferReceive(s->ring, s_mixer.raw, s->frame_bytes, 0);
+    }
+    if (!s->playing) {
+        /* Start on a whole block so a stream does not open with an underrun */
+        if (s->staged + queued == 0 || (s->staged + queued < need && !flush)) {
+            return false;
+        }
+        s->playing = true;
+    }
+
+    size_t take = need - s->staged;
+    if (take > queued) {
+        take = queued;
+    }
+    if (take) {
+        xStreamBufferReceive(s->ring, s_mixer.raw, take * s->frame_bytes, 0);
+        mixer_convert(s_mixer.raw, s->config.bits, s->config.channels, s->stage + s->staged * out_ch, out_ch, take);
+        s->staged += take;
+    }
+
+    bool ended = false;
+    if (s->staged < need) {
+        if (s->staged == 0) {
+            /* Ran dry on a block boundary, the source paused or ended */
+            s->playing = false;
+            return false;
+        }
+        if (!flush) {
+            s_mixer.stats.underruns++;
+        }
+        memset(s->stage + s->staged * out_ch, 0, (need - s->staged) * out_ch * sizeof(int16_t));
+        s->staged = need;
+        ended = true;
+    }
+
+    size_t consumed = s_mixer.out_frames;
+    if (identity) {
+        memcpy(s_mixer.mix, s->stage, s_mixer.out_frames * out_ch * sizeof(int16_t));
+    } else {
+        consumed = mixer_resample(&s->rs, s->stage, s_mixer.mix, s_mixer.out_frames);
+    }
+    s->staged -= consumed;
+    memmove(s->stage, s->stage + consumed * out_ch, s->staged * out_ch * sizeof(int16_t));
+
+    if (ended) {
+        s->playing = false;
+        s->staged = 0;
+        mixer_resampler_init(&s->rs, s->config.sample_rate, s_mixer.config.sample_rate, out_ch);
+    }
+    return true;
+}
+
+static int32_t mixer_next_gain(bsp_mixer_stream_handle_t s, bool started)
+{
+    int32_t target = s->gain;
+    if (s->config.priority < s_mixer.top_priority) {
+        target = (target * s_mixer.duck) >> MIXER_GAIN_SHIFT;
+    }
+    if (started || s_mixer.ramp_step == 0) {
+        return target;
+    }
+    if (target > s->applied + s_mixer.ramp_step) {
+        return s->applied + s_mixer.ramp_step;
+    }
+    if (target < s->applied - s_mixer.ramp_step) {
+        return s->applied - s_mixer.ramp_step;
+    }
+    return target;
+}
+
+static void mixer_task(void *arg)
+{
+    const size_t samples = s_mixer.out_frames * s_mixer.config.channels;
+
+    while (!s_mixer.stop) {
+        const int64_t start = esp_timer_get_time();
+        int top_priority = -1;
+        int mixed = 0;
+
+        memset(s_mixer.acc, 0, samples * sizeof(int32_t));
+        xSemaphoreTake(s_mixer.lock, portMAX_DELAY);
+        for (bsp_mixer_stream_handle_t *link = &s_mixer.streams; *link;) {
+            bsp_mixer_stream_handle_t s = *link;
+            const bool was_playing = s->playing;
+            if (!mixer_pull(s)) {
+                if (s->closing && xStreamBufferIsEmpty(s->ring)) {
+                    *link = s->next;
+                    s_mixer.stats.streams--;
+                    xSemaphoreGive(s->closed);
+                    continue;
+                }
+                link = &s->next;
+                continue;
+            }
+            const int32_t gain = mixer_next_gain(s, !was_playing);
+            mixer_accumulate(s_mixer.acc, s_mixer.mix, s_mixer.out_frames, s_mixer.config.channels,
+                             was_playing ? s->applied : gain, gain);
+            s->applied = gain;
+            if (s->config.priority > top_priority) {
+                top_priority = s->config.priority;
+            }
+            mixed++;
+            link = &s->next;
+        }
+        s_mixer.top_priority = top_priority;
+        xSemaphoreGive(s_mixer.lock);
+
+        if (!mixed) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MIXER_IDLE_WAIT_MS));
+            continue;
+        }
+        s_mixer.stats.clipped += mixer_saturate(s_mixer.acc, s_mixer.out, samples);
+        s_mixer.stats.last_mix_us = (uint32_t)(esp_timer_get_time() - start);
+        if (s_mixer.stats.last_mix_us > s_mixer.stats.max_mix_us) {
+            s_mixer.stats.max_mix_us = s_mixer.stats.last_mix_us;
+        }
+        s_mixer.stats.blocks++;
+        /* Blocks until the DMA takes the block, which paces the task */
+        bsp_i2s_write(s_mixer.out, samples * sizeof(int16_t), NULL, portMAX_DELAY);
+    }
+    xSemaphoreGive(s_mixer.stopped);
+    vTaskDelete(NULL);
+}
+
+static void mixer_free_buffers(void)
+{
+    free(s_mixer.raw);
+    free(s_mixer.mix);
+    free(s_mixer.acc);
+    free(s_mixer.out);
+    s_mixer.raw = NULL;
+    s_mixer.mix = NULL;
+    s_mixer.acc = NULL;
+    s_mixer.out = NULL;
+}
+
+esp_err_t bsp_mixer_start(const bsp_mixer_config_t *config)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(config && mixer_format_valid(config->sample_rate, 16, config->channels), ESP_ERR_INVALID_ARG,
+                        TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(!s_mixer.task, ESP_ERR_INVALID_STATE, TAG, "mixer already started");
+
+    if (!s_mixer.lock) {
+        s_mixer.lock = xSemaphoreCreateMutex();
+        s_mixer.stopped = xSemaphoreCreateBinary();
+        ESP_RETURN_ON_FALSE(s_mixer.lock && s_mixer.stopped, ESP_ERR_NO_MEM, TAG, "no mem for mixer locks");
+    }
+    s_mixer.config = *config;
+    s_mixer.out_frames = config->sample_rate * MIXER_BLOCK_MS / 1000;
+    s_mixer.duck = mixer_gain_from_db(config->duck_db);
+    s_mixer.ramp_step = config->ramp_ms > MIXER_BLOCK_MS ? MIXER_GAIN_UNITY * MIXER_BLOCK_MS / config->ramp_ms : 0;
+    s_mixer.top_priority = -1;
+    memset(&s_mixer.stats, 0, sizeof(s_mixer.stats));
+
+    const size_t samples = s_mixer.out_frames * config->channels;
+    s_mixer.raw = malloc(MIXER_MAX_IN_FRAMES * 2 * sizeof(int32_t));
+    s_mixer.mix = malloc(samples * sizeof(int16_t));
+    s_mixer.acc = malloc(samples * sizeof(int32_t));
+    s_mixer.out = malloc(samples * sizeof(int16_t));
+    ESP_GOTO_ON_FALSE(s_mixer.raw && s_mixer.mix && s_mixer.acc && s_mixer.out, ESP_ERR_NO_MEM, err, TAG,
+                      "no mem for mixer buffers");
+
+    ESP_GOTO_ON_ERROR(bsp_codec_set_play_fs(config->sample_rate, 16, config->channels), err, TAG,
+                      "set codec format failed");
+
+    s_mixer.stop = false;
+    BaseType_t task_ret = xTaskCreatePinnedToCore(mixer_task, "bsp_mixer", MIXER_TASK_STACK, NULL,
+                                                  config->task_priority, &s_mixer.task, config->task_core);
+    ESP_GOTO_ON_FALSE(pdPASS == task_ret, ESP_ERR_NO_MEM, err, TAG, "create mixer task failed");
+    return ESP_OK;
+
+err:
+    s_mixer.task = NULL;
+    mixer_free_buffers();
+    return ret;
+}
+
+esp_err_t bsp_mixer_stop(void)
+{
+    ESP_RETURN_ON_FALSE(s_mixer.task, ESP_ERR_INVALID_STATE, TAG, "mixer not started");
+    ESP_RETURN_ON_FALSE(!s_mixer.streams, ESP_ERR_INVALID_STATE, TAG, "streams still open");
+
+    s_mixer.stop = true;
+    xTaskNotifyGive(s_mixer.task);
+    xSemaphoreTake(s_mixer.stopped, portMAX_DELAY);
+    s_mixer.task = NULL;
+    mixer_free_buffers();
+    return ESP_OK;
+}
+
+static esp_err_t mixer_stream_alloc_stage(bsp_mixer_stream_handle_t s, uint32_t rate)
+{
+    const size_t frames = mixer_stage_frames(rate);
+    if (frames <= s->stage_frames) {
+        return ESP_OK;
+    }
+    int16_t *stage = realloc(s->stage, frames * s_mixer.config.channels * sizeof(int16_t));
+    ESP_RETURN_ON_FALSE(stage, ESP_ERR_NO_MEM, TAG, "no mem for stream stage");
+    s->stage = stage;
+    s->stage_frames = frames;
+    return ESP_OK;
+}
+
+static void mixer_stream_free(bsp_mixer_stream_handle_t s)
+{
+    if (s->ring) {
+        vStreamBufferDelete(s->ring);
+    }
+    if (s->closed) {
+        vSemaphoreDelete(s->closed);
+    }
+    free(s->stage);
+    free(s);
+}
+
+esp_err_t bsp_mixer_stream_open(const bsp_mixer_stream_config_t *config, bsp_mixer_stream_handle_t *ret_stream)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(config && ret_stream, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(mixer_format_valid(config->sample_rate, config->bits, config->channels), ESP_ERR_INVALID_ARG,
+                        TAG, "unsupported format");
+    ESP_RETURN_ON_FALSE(s_mixer.task, ESP_ERR_INVALID_STATE, TAG, "mixer not started");
+
+    bsp_mixer_stream_handle_t s = calloc(1, sizeof(struct bsp_mixer_stream_t));
+    ESP_RETURN_ON_FALSE(s, ESP_ERR_NO_MEM, TAG, "no mem for stream");
+
+    s->config = *config;
+    s->frame_bytes = config->bits / 8 * config->channels;
+    size_t buffer_size = config->buffer_size;
+    if (buffer_size == 0) {
+        buffer_size = config->sample_rate * s->frame_bytes / 1000 * MIXER_DEFAULT_BUFFER_MS;
+    }
+    /* Room for a block of the largest format, set_format may switch to it */
+    if (buffer_size < MIXER_MAX_IN_FRAMES * 2 * sizeof(int32_t)) {
+        buffer_size = MIXER_MAX_IN_FRAMES * 2 * sizeof(int32_t);
+    }
+    s->ring = xStreamBufferCreate(buffer_size, 1);
+    s->closed = xSemaphoreCreateBinary();
+    ESP_GOTO_ON_FALSE(s->ring && s->closed, ESP_ERR_NO_MEM, err, TAG, "no mem for stream ring");
+    ESP_GOTO_ON_ERROR(mixer_stream_alloc_stage(s, config->sample_rate), err, TAG, "no mem for stream stage");
+    mixer_resampler_init(&s->rs, config->sample_rate, s_mixer.config.sample_rate, s_mixer.config.channels);
+    s->gain = MIXER_GAIN_UNITY;
+    s->applied = MIXER_GAIN_UNITY;
+
+    xSemaphoreTake(s_mixer.lock, portMAX_DELAY);
+    s->next = s_mixer.streams;
+    s_mixer.streams = s;
+    s_mixer.stats.streams++;
+    xSemaphoreGive(s_mixer.lock);
+    *ret_stream = s;
+    return ESP_OK;
+
+err:
+    mixer_stream_free(s);
+    return ret;
+}
+
+esp_err_t bsp_mixer_stream_close(bsp_mixer_stream_handle_t stream)
+{
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    stream->closing = true;
+    xTaskNotifyGive(s_mixer.task);
+    xSemaphoreTake(stream->closed, portMAX_DELAY);
+    mixer_stream_free(stream);
+    return ESP_OK;
+}
+
+esp_err_t bsp_mixer_stream_write(bsp_mixer_stream_handle_t stream, const void *data, size_t len,
+                                 size_t *bytes_written, uint32_t timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(stream && data, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    TimeOut_t time_out;
+    TickType_t wait = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    size_t done = 0;
+
+    vTaskSetTimeOutState(&time_out);
+    do {
+        done += xStreamBufferSend(stream->ring, (const uint8_t *)data + done, len - done, wait);
+        if (!stream->playing) {
+            xTaskNotifyGive(s_mixer.task);
+        }
+    } while (done < len && xTaskCheckForTimeOut(&time_out, &wait) == pdFALSE);
+
+    if (bytes_written) {
+        *bytes_written = done;
+    }
+    return done < len ? ESP_ERR_TIMEOUT : ESP_OK;
+}
+
+esp_err_t bsp_mixer_stream_set_format(bsp_mixer_stream_handle_t stream, uint32_t rate, uint8_t bits,
+                                      uint8_t channels)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(stream && mixer_format_valid(rate, bits, channels), ESP_ERR_INVALID_ARG, TAG,
+                        "invalid argument");
+    if (rate == stream->config.sample_rate && bits == stream->config.bits && channels == stream->config.channels) {
+        return ESP_OK;
+    }
+
+    /* What is queued was written in the old format */
+    stream->draining = true;
+    xTaskNotifyGive(s_mixer.task);
+    while (!xStreamBufferIsEmpty(stream->ring) || stream->staged) {
+        vTaskDelay(pdMS_TO_TICKS(MIXER_BLOCK_MS));
+    }
+
+    xSemaphoreTake(s_mixer.lock, portMAX_DELAY);
+    ret = mixer_stream_alloc_stage(stream, rate);
+    if (ret == ESP_OK) {
+        stream->config.sample_rate = rate;
+        stream->config.bits = bits;
+        stream->config.channels = channels;
+        stream->frame_bytes = bits / 8 * channels;
+        mixer_resampler_init(&stream->rs, rate, s_mixer.config.sample_rate, s_mixer.config.channels);
+    }
+    stream->draining = false;
+    xSemaphoreGive(s_mixer.lock);
+    return ret;
+}
+
+esp_err_t bsp_mixer_stream_set_gain(bsp_mixer_stream_handle_t stream, float gain_db)
+{
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    stream->gain = mixer_gain_from_db(gain_db);
+    return ESP_OK;
+}
+
+esp_err_t bsp_mixer_get_stats(bsp_mixer_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    *stats = s_mixer.stats;
+    return ESP_OK;
+}
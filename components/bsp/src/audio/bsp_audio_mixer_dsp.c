@@ -0,0 +1,143 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "bsp_audio_mixer_dsp.h"
+
+void mixer_resampler_init(mixer_resampler_t *rs, uint32_t in_rate, uint32_t out_rate, uint8_t channels)
+{
+    memset(rs, 0, sizeof(*rs));
+    rs->step = (uint32_t)((((uint64_t)in_rate << 16) + out_rate / 2) / out_rate);
+    rs->channels = channels;
+}
+
+size_t mixer_resampler_need(const mixer_resampler_t *rs, size_t out_frames)
+{
+    if (out_frames == 0) {
+        return 0;
+    }
+    /* The last output reads frame need - 1, consumption may run past it when decimating */
+    size_t need = ((rs->phase + (out_frames - 1) * rs->step) >> 16) + 1;
+    size_t consumed = (rs->phase + out_frames * rs->step) >> 16;
+    return need > consumed ? need : consumed;
+}
+
+size_t mixer_resample(mixer_resampler_t *rs, const int16_t *in, int16_t *out, size_t out_frames)
+{
+    const uint8_t ch = rs->channels;
+    uint32_t t = rs->phase;
+
+    for (size_t k = 0; k < out_frames; k++, t += rs->step) {
+        const size_t i = t >> 16;
+        /* Q15 fraction keeps the product of a 17 bit difference in 32 bits */
+        const int32_t frac = (t & 0xffff) >> 1;
+        for (uint8_t c = 0; c < ch; c++) {
+            const int32_t a = i ? in[(i - 1) * ch + c] : rs->hist[c];
+            const int32_t b = in[i * ch + c];
+            out[k * ch + c] = (int16_t)(a + (((b - a) * frac) >> 15));
+        }
+    }
+
+    const size_t consumed = t >> 16;
+    rs->phase = t & 0xffff;
+    if (consumed) {
+        for (uint8_t c = 0; c < ch; c++) {
+            rs->hist[c] = in[(consumed - 1) * ch + c];
+        }
+    }
+    return consumed;
+}
+
+static inline int16_t mixer_sample(const uint8_t *p, uint8_t bits)
+{
+    switch (bits) {
+    case 8:
+        return (int16_t)((p[0] - 128) * 256);
+    case 24:
+        return (int16_t)(p[1] | (p[2] << 8));
+    case 32:
+        return (int16_t)(p[2] | (p[3] << 8));
+    default:
+        return (int16_t)(p[0] | (p[1] << 8));
+    }
+}
+
+void mixer_convert(const void *in, uint8_t bits, uint8_t in_ch, int16_t *out, uint8_t out_ch, size_t frames)
+{
+    const uint8_t *p = in;
+    const size_t sample_bytes = bits / 8;
+
+    if (bits == 16 && in_ch == out_ch) {
+        memcpy(out, in, frames * in_ch * sizeof(int16_t));
+        return;
+    }
+    for (size_t i = 0; i < frames; i++) {
+        int16_t l = mixer_sample(p, bits);
+        int16_t r = (in_ch == 2) ? mixer_sample(p + sample_bytes, bits) : l;
+        p += sample_bytes * in_ch;
+        if (out_ch == 2) {
+            *out++ = l;
+            *out++ = r;
+        } else {
+            *out++ = (int16_t)(((int32_t)l + r) >> 1);
+        }
+    }
+}
+
+void mixer_accumulate(int32_t *acc, const int16_t *in, size_t frames, uint8_t channels,
+                      int32_t gain_from, int32_t gain_to)
+{
+    const size_t samples = frames * channels;
+
+    if (gain_from == gain_to) {
+        if (gain_to == MIXER_GAIN_UNITY) {
+            for (size_t i = 0; i < samples; i++) {
+                acc[i] += in[i];
+            }
+        } else if (gain_to != 0) {
+            for (size_t i = 0; i < samples; i++) {
+                acc[i] += (in[i] * gain_to) >> MIXER_GAIN_SHIFT;
+            }
+        }
+        return;
+    }
+
+    /* Eight more bits of gain while ramping so short ramps still move every frame */
+    int32_t g = gain_from * 256;
+    const int32_t inc = (gain_to - gain_from) * 256 / (int32_t)frames;
+    for (size_t i = 0; i < frames; i++, g += inc) {
+        const int32_t gain = g >> 8;
+        for (uint8_t c = 0; c < channels; c++) {
+            acc[i * channels + c] += (in[i * channels + c] * gain) >> MIXER_GAIN_SHIFT;
+        }
+    }
+}
+
+size_t mixer_saturate(const int32_t *acc, int16_t *out, size_t samples)
+{
+    size_t clipped = 0;
+
+    for (size_t i = 0; i < samples; i++) {
+        int32_t s = acc[i];
+        if (s > INT16_MAX) {
+            s = INT16_MAX;
+            clipped++;
+        } else if (s < INT16_MIN) {
+            s = INT16_MIN;
+            clipped++;
+        }
+        out[i] = (int16_t)s;
+    }
+    return clipped;
+}
+
+int32_t mixer_gain_from_db(float db)
+{
+    float gain = MIXER_GAIN_UNITY * powf(10.0f, db / 20.0f);
+    return gain >= MIXER_GAIN_MAX ? MIXER_GAIN_MAX : (int32_t)(gain + 0.5f);
+}
@@ -0,0 +1,196 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+
+#include "bsp_codec_session.h"
+
+typedef struct {
+    bool open;
+    esp_codec_dev_sample_info_t fs;     /*!< Format of the open device */
+} session_dir_t;
+
+static struct {
+    bsp_codec_session_config_t config;
+    SemaphoreHandle_t lock;
+    session_dir_t dir[2];               /*!< Indexed by bsp_i2s_dir_t */
+    bsp_codec_stats_t stats;
+} s_session;
+
+static const char *TAG = "bsp_codec_session";
+
+static esp_codec_dev_handle_t session_dev(bsp_i2s_dir_t dir)
+{
+    return (BSP_I2S_DIR_PLAY == dir) ? s_session.config.play_dev : s_session.config.record_dev;
+}
+
+static bsp_i2s_stream_handle_t session_stream(bsp_i2s_dir_t dir)
+{
+    return (BSP_I2S_DIR_PLAY == dir) ? s_session.config.play_stream : s_session.config.record_stream;
+}
+
+static bool session_fs_equal(const esp_codec_dev_sample_info_t *a, const esp_codec_dev_sample_info_t *b)
+{
+    return a->sample_rate == b->sample_rate && a->bits_per_sample == b->bits_per_sample &&
+           a->channel == b->channel && a->channel_mask == b->channel_mask;
+}
+
+static void session_stats_time(uint32_t *last, uint32_t *max, int64_t start)
+{
+    *last = (uint32_t)(esp_timer_get_time() - start);
+    if (*last > *max) {
+        *max = *last;
+    }
+}
+
+esp_err_t bsp_codec_session_init(const bsp_codec_session_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->play_stream && config->record_stream, ESP_ERR_INVALID_ARG, TAG,
+                        "invalid argument");
+    if (!s_session.lock) {
+        s_session.lock = xSemaphoreCreateMutex();
+        ESP_RETURN_ON_FALSE(s_session.lock, ESP_ERR_NO_MEM, TAG, "no mem for session lock");
+    }
+    s_session.config = *config;
+    memset(s_session.dir, 0, sizeof(s_session.dir));
+    memset(&s_session.stats, 0, sizeof(s_session.stats));
+    return ESP_OK;
+}
+
+esp_err_t bsp_codec_session_set_fs(uint32_t dirs, const esp_codec_dev_sample_info_t *fs)
+{
+    esp_codec_dev_sample_info_t target[2];
+    uint32_t reopen = 0;
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(fs && s_session.lock, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    xSemaphoreTake(s_session.lock, portMAX_DELAY);
+    s_session.stats.requests++;
+    for (int dir = 0; dir < 2; dir++) {
+        session_dir_t *cur = &s_session.dir[dir];
+        if (!session_dev(dir)) {
+            continue;
+        }
+        if (dirs & (1 << dir)) {
+            target[dir] = *fs;
+        } else if (cur->open && s_session.config.shared_clock) {
+            /* The other device follows the clock and keeps its channels */
+            target[dir] = cur->fs;
+            target[dir].sample_rate = fs->sample_rate;
+            target[dir].bits_per_sample = fs->bits_per_sample;
+        } else {
+            continue;
+        }
+        if (!cur->open || !session_fs_equal(&cur->fs, &target[dir])) {
+            reopen |= 1 << dir;
+        }
+    }
+    if (!reopen) {
+        s_session.stats.skipped++;
+        xSemaphoreGive(s_session.lock);
+        return ESP_OK;
+    }
+
+    const int64_t start = esp_timer_get_time();
+    int64_t record_closed = start;
+    for (int dir = 0; dir < 2; dir++) {
+        if (reopen & (1 << dir)) {
+            bsp_i2s_stream_lock(session_stream(dir));
+        }
+    }
+
+    /*
+     * Close both before opening either, the I2S driver refuses a clock the other
+     * direction does not run at. The microphone is closed last and opened first.
+     */
+    for (int dir = 1; dir >= 0; dir--) {
+        if ((reopen & (1 << dir)) && s_session.dir[dir].open) {
+            if (BSP_I2S_DIR_RECORD == dir) {
+                record_closed = esp_timer_get_time();
+            }
+            if (esp_codec_dev_close(session_dev(dir)) != ESP_CODEC_DEV_OK) {
+                ret = ESP_FAIL;
+            }
+            s_session.dir[dir].open = false;
+        }
+    }
+    if (reopen & BSP_CODEC_SESSION_RECORD) {
+        if (esp_codec_dev_set_in_gain(s_session.config.record_dev, s_session.config.in_gain) != ESP_CODEC_DEV_OK) {
+            ret = ESP_FAIL;
+        }
+    }
+
+    for (int dir = 0; dir < 2; dir++) {
+        if (!(reopen & (1 << dir))) {
+            continue;
+        }
+        if (esp_codec_dev_open(session_dev(dir), &target[dir]) != ESP_CODEC_DEV_OK) {
+            ESP_LOGE(TAG, "open %s at %u Hz %u bit %u ch failed", BSP_I2S_DIR_PLAY == dir ? "speaker" : "microphone",
+                     (unsigned)target[dir].sample_rate, target[dir].bits_per_sample, target[dir].channel);
+            ret = ESP_FAIL;
+            continue;
+        }
+        s_session.dir[dir].open = true;
+        s_session.dir[dir].fs = target[dir];
+        bsp_i2s_stream_set_format(session_stream(dir), target[dir].sample_rate,
+                                  target[dir].bits_per_sample * target[dir].channel / 8);
+        if (BSP_I2S_DIR_PLAY == dir) {
+            s_session.stats.play_reopens++;
+        } else {
+            s_session.stats.record_reopens++;
+            session_stats_time(&s_session.stats.last_gap_us, &s_session.stats.max_gap_us, record_closed);
+        }
+    }
+
+    for (int dir = 0; dir < 2; dir++) {
+        if (reopen & (1 << dir)) {
+            bsp_i2s_stream_unlock(session_stream(dir));
+        }
+    }
+    session_stats_time(&s_session.stats.last_us, &s_session.stats.max_us, start);
+    xSemaphoreGive(s_session.lock);
+    return ret;
+}
+
+esp_err_t bsp_codec_session_stop(void)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(s_session.lock, ESP_ERR_INVALID_STATE, TAG, "session not initialized");
+
+    xSemaphoreTake(s_session.lock, portMAX_DELAY);
+    for (int dir = 1; dir >= 0; dir--) {
+        if (!s_session.dir[dir].open) {
+            continue;
+        }
+        bsp_i2s_stream_lock(session_stream(dir));
+        if (esp_codec_dev_close(session_dev(dir)) != ESP_CODEC_DEV_OK) {
+            ret = ESP_FAIL;
+        }
+        s_session.dir[dir].open = false;
+        bsp_i2s_stream_unlock(session_stream(dir));
+    }
+    xSemaphoreGive(s_session.lock);
+    return ret;
+}
+
+void bsp_codec_session_get_stats(bsp_codec_stats_t *stats)
+{
+    if (s_session.lock) {
+        xSemaphoreTake(s_session.lock, portMAX_DELAY);
+        *stats = s_session.stats;
+        xSemaphoreGive(s_session.lock);
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
@@ -0,0 +1,321 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "esp_log.h"
+#include "esp_check.h"
+
+#include "bsp_i2s_stream.h"
+
+/* Largest chunk, 10 ms of 48 kHz stereo 32 bit, longer formats get shorter chunks */
+#define STREAM_MAX_CHUNK        (3840)
+#define STREAM_IDLE_WAIT_MS     (100)
+#define STREAM_TASK_STACK       (3 * 1024)
+
+struct bsp_i2s_stream_t {
+    bsp_i2s_stream_config_t config;
+    SemaphoreHandle_t io_lock;          /*!< Held around each codec transfer */
+    SemaphoreHandle_t gate;             /*!< Held by bsp_i2s_stream_lock, so it wins over the next chunk */
+    SemaphoreHandle_t caller_lock;      /*!< One caller at a time, mode changes wait for it */
+    bsp_i2s_mode_t mode;
+    size_t chunk_size;
+    uint32_t bytes_per_second;
+
+    /* Buffered mode */
+    StreamBufferHandle_t ring;
+    uint8_t *chunk;
+    TaskHandle_t task;
+    SemaphoreHandle_t task_done;
+    atomic_bool task_stop;
+    atomic_int task_error;              /*!< Result of the last codec transfer of the task */
+
+    bsp_i2s_stats_t stats;
+    portMUX_TYPE stats_lock;            /*!< Counters are updated by the task and read by anyone */
+};
+
+static const char *TAG = "bsp_i2s_stream";
+
+esp_err_t bsp_i2s_stream_create(const bsp_i2s_stream_config_t *config, bsp_i2s_stream_handle_t *ret_stream)
+{
+    ESP_RETURN_ON_FALSE(config && config->io && ret_stream, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    bsp_i2s_stream_handle_t stream = calloc(1, sizeof(struct bsp_i2s_stream_t));
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_NO_MEM, TAG, "no mem for stream");
+
+    stream->config = *config;
+    stream->io_lock = xSemaphoreCreateMutex();
+    stream->gate = xSemaphoreCreateMutex();
+    stream->caller_lock = xSemaphoreCreateMutex();
+    stream->task_done = xSemaphoreCreateBinary();
+    if (!stream->io_lock || !stream->gate || !stream->caller_lock || !stream->task_done) {
+        if (stream->io_lock) {
+            vSemaphoreDelete(stream->io_lock);
+        }
+        if (stream->gate) {
+            vSemaphoreDelete(stream->gate);
+        }
+        if (stream->caller_lock) {
+            vSemaphoreDelete(stream->caller_lock);
+        }
+        if (stream->task_done) {
+            vSemaphoreDelete(stream->task_done);
+        }
+        free(stream);
+        ESP_LOGE(TAG, "no mem for stream locks");
+        return ESP_ERR_NO_MEM;
+    }
+    portMUX_INITIALIZE(&stream->stats_lock);
+    stream->mode = BSP_I2S_MODE_DIRECT;
+    bsp_i2s_stream_set_format(stream, 16000, 4);
+    *ret_stream = stream;
+    return ESP_OK;
+}
+
+void bsp_i2s_stream_set_format(bsp_i2s_stream_handle_t stream, uint32_t sample_rate, uint32_t frame_bytes)
+{
+    size_t frames = sample_rate * BSP_I2S_CHUNK_MS / 1000;
+    if (frames * frame_bytes > STREAM_MAX_CHUNK) {
+        frames = STREAM_MAX_CHUNK / frame_bytes;
+    }
+    stream->chunk_size = (frames ? frames : 1) * frame_bytes;
+    stream->bytes_per_second = sample_rate * frame_bytes;
+}
+
+void bsp_i2s_stream_lock(bsp_i2s_stream_handle_t stream)
+{
+    xSemaphoreTake(stream->gate, portMAX_DELAY);
+    xSemaphoreTake(stream->io_lock, portMAX_DELAY);
+}
+
+void bsp_i2s_stream_unlock(bsp_i2s_stream_handle_t stream)
+{
+    xSemaphoreGive(stream->io_lock);
+    xSemaphoreGive(stream->gate);
+}
+
+void bsp_i2s_stream_get_stats(bsp_i2s_stream_handle_t stream, bsp_i2s_stats_t *stats)
+{
+    portENTER_CRITICAL(&stream->stats_lock);
+    *stats = stream->stats;
+    portEXIT_CRITICAL(&stream->stats_lock);
+}
+
+static esp_err_t stream_io(bsp_i2s_stream_handle_t stream, uint8_t *data, size_t len)
+{
+    /* A task streaming back to back would take io_lock again before the waiter runs */
+    xSemaphoreTake(stream->gate, portMAX_DELAY);
+    xSemaphoreGive(stream->gate);
+    xSemaphoreTake(stream->io_lock, portMAX_DELAY);
+    esp_err_t ret = stream->config.io(data, len, stream->config.ctx);
+    xSemaphoreGive(stream->io_lock);
+    if (ret != ESP_OK) {
+        portENTER_CRITICAL(&stream->stats_lock);
+        stream->stats.errors++;
+        portEXIT_CRITICAL(&stream->stats_lock);
+    }
+    return ret;
+}
+
+static void stream_record_task(void *arg)
+{
+    bsp_i2s_stream_handle_t stream = arg;
+
+    while (!atomic_load(&stream->task_stop)) {
+        size_t len = stream->chunk_size;
+        esp_err_t ret = stream_io(stream, stream->chunk, len);
+        atomic_store(&stream->task_error, ret);
+        if (ret != ESP_OK) {
+            vTaskDelay(pdMS_TO_TICKS(BSP_I2S_CHUNK_MS));
+            continue;
+        }
+        /* Drop whole chunks, a partial one would shift the frames */
+        if (xStreamBufferSpacesAvailable(stream->ring) < len) {
+            portENTER_CRITICAL(&stream->stats_lock);
+            stream->stats.overruns++;
+            portEXIT_CRITICAL(&stream->stats_lock);
+            continue;
+        }
+        xStreamBufferSend(stream->ring, stream->chunk, len, 0);
+    }
+    xSemaphoreGive(stream->task_done);
+    vTaskDelete(NULL);
+}
+
+static void stream_play_task(void *arg)
+{
+    bsp_i2s_stream_handle_t stream = arg;
+    bool playing = false;
+
+    while (true) {
+        size_t len = stream->chunk_size;
+        xStreamBufferSetTriggerLevel(stream->ring, len);
+        TickType_t wait = pdMS_TO_TICKS(playing ? BSP_I2S_CHUNK_MS : STREAM_IDLE_WAIT_MS);
+        size_t got = xStreamBufferReceive(stream->ring, stream->chunk, len, wait);
+        if (got == 0) {
+            /* Nothing queued is a pause in the sound, not an underrun */
+            playing = false;
+            if (atomic_load(&stream->task_stop)) {
+                break;
+            }
+            continue;
+        }
+        if (got < len) {
+            if (!atomic_load(&stream->task_stop)) {
+                portENTER_CRITICAL(&stream->stats_lock);
+                stream->stats.underruns++;
+                portEXIT_CRITICAL(&stream->stats_lock);
+            }
+            memset(stream->chunk + got, 0, len - got);
+        }
+        playing = true;
+        atomic_store(&stream->task_error, stream_io(stream, stream->chunk, len));
+    }
+    xSemaphoreGive(stream->task_done);
+    vTaskDelete(NULL);
+}
+
+static void stream_stop_buffered(bsp_i2s_stream_handle_t stream)
+{
+    if (stream->task) {
+        atomic_store(&stream->task_stop, true);
+        xSemaphoreTake(stream->task_done, portMAX_DELAY);
+        stream->task = NULL;
+    }
+    if (stream->ring) {
+        vStreamBufferDelete(stream->ring);
+        stream->ring = NULL;
+    }
+    free(stream->chunk);
+    stream->chunk = NULL;
+}
+
+static esp_err_t stream_start_buffered(bsp_i2s_stream_handle_t stream, size_t buffer_size)
+{
+    if (buffer_size == 0) {
+        buffer_size = stream->bytes_per_second * BSP_I2S_DEFAULT_BUFFER_MS / 1000;
+    }
+    if (buffer_size < STREAM_MAX_CHUNK) {
+        buffer_size = STREAM_MAX_CHUNK;
+    }
+    stream->chunk = malloc(STREAM_MAX_CHUNK);
+    stream->ring = xStreamBufferCreate(buffer_size, 1);
+    if (!stream->chunk || !stream->ring) {
+        stream_stop_buffered(stream);
+        ESP_LOGE(TAG, "no mem for a %u bytes ring", (unsigned)buffer_size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    atomic_store(&stream->task_stop, false);
+    atomic_store(&stream->task_error, ESP_OK);
+    BaseType_t ret = xTaskCreate(stream->config.playback ? stream_play_task : stream_record_task,
+                                 stream->config.task_name, STREAM_TASK_STACK, stream,
+                                 stream->config.task_priority, &stream->task);
+    if (ret != pdPASS) {
+        stream->task = NULL;
+        stream_stop_buffered(stream);
+        ESP_LOGE(TAG, "failed to create the %s task", stream->config.task_name);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bsp_i2s_stream_set_mode(bsp_i2s_stream_handle_t stream, bsp_i2s_mode_t mode, size_t buffer_size)
+{
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(stream->caller_lock, portMAX_DELAY);
+    stream_stop_buffered(stream);
+    stream->mode = BSP_I2S_MODE_DIRECT;
+    if (mode == BSP_I2S_MODE_BUFFERED) {
+        ret = stream_start_buffered(stream, buffer_size);
+        if (ret == ESP_OK) {
+            stream->mode = BSP_I2S_MODE_BUFFERED;
+        }
+    }
+    xSemaphoreGive(stream->caller_lock);
+    return ret;
+}
+
+static esp_err_t stream_transfer_direct(bsp_i2s_stream_handle_t stream, uint8_t *data, size_t len, size_t *done,
+                                        TimeOut_t *time_out, TickType_t *wait)
+{
+    const size_t chunk_size = stream->chunk_size;
+
+    while (*done < len) {
+        size_t n = len - *done;
+        if (n > chunk_size) {
+            n = chunk_size;
+        }
+        esp_err_t ret = stream_io(stream, data + *done, n);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        *done += n;
+        if (*done < len && xTaskCheckForTimeOut(time_out, wait) == pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t stream_transfer_buffered(bsp_i2s_stream_handle_t stream, uint8_t *data, size_t len, size_t *done,
+                                          TimeOut_t *time_out, TickType_t *wait)
+{
+    do {
+        if (stream->config.playback) {
+            *done += xStreamBufferSend(stream->ring, data + *done, len - *done, *wait);
+        } else {
+            *done += xStreamBufferReceive(stream->ring, data + *done, len - *done, *wait);
+        }
+    } while (*done < len && xTaskCheckForTimeOut(time_out, wait) == pdFALSE);
+
+    if (*done < len) {
+        /* Report why the ring ran dry rather than a plain timeout */
+        esp_err_t task_error = atomic_load(&stream->task_error);
+        return task_error != ESP_OK ? task_error : ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bsp_i2s_stream_transfer(bsp_i2s_stream_handle_t stream, void *data, size_t len, size_t *done,
+                                  uint32_t timeout_ms)
+{
+    TimeOut_t time_out;
+    TickType_t wait = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    size_t moved = 0;
+    esp_err_t ret;
+
+    vTaskSetTimeOutState(&time_out);
+    if (xSemaphoreTake(stream->caller_lock, wait) != pdTRUE) {
+        ret = ESP_ERR_TIMEOUT;
+    } else {
+        xTaskCheckForTimeOut(&time_out, &wait);
+        if (stream->mode == BSP_I2S_MODE_BUFFERED) {
+            ret = stream_transfer_buffered(stream, data, len, &moved, &time_out, &wait);
+        } else {
+            ret = stream_transfer_direct(stream, data, len, &moved, &time_out, &wait);
+        }
+        xSemaphoreGive(stream->caller_lock);
+    }
+
+    portENTER_CRITICAL(&stream->stats_lock);
+    stream->stats.bytes += moved;
+    if (ret == ESP_ERR_TIMEOUT) {
+        stream->stats.timeouts++;
+    }
+    portEXIT_CRITICAL(&stream->stats_lock);
+    if (done) {
+        *done = moved;
+    }
+    return ret;
+}
@@ -13,11 +13,14 @@
 #include "bsp/esp-bsp.h"
 #include "bsp_board.h"
 #include "bsp_board_priv.h"
+#include "bsp_i2s_stream.h"
+#include "bsp_codec_session.h"
 
 #define CODEC_DEFAULT_SAMPLE_RATE          (16000)
 #define CODEC_DEFAULT_BIT_WIDTH            (16)
 #define CODEC_DEFAULT_ADC_VOLUME           (24.0)
 #define CODEC_DEFAULT_CHANNEL              (2)
+#define CODEC_STREAM_TASK_PRIORITY         (10)
 
 static const pmod_pins_t g_pmod[2] = {
     {
@@ -65,6 +68,8 @@ static const board_res_desc_t g_board_box_res = {
 
 static esp_codec_dev_handle_t play_dev_handle;
 static esp_codec_dev_handle_t record_dev_handle;
+static bsp_i2s_stream_handle_t play_stream;
+static bsp_i2s_stream_handle_t record_stream;
 
 static button_handle_t *g_btn_handle = NULL;
 static bsp_bottom_property_t g_bottom_handle;
@@ -123,47 +128,81 @@ esp_err_t bsp_btn_rm_event_callback(bsp_button_t btn, size_t event)
     return ESP_OK;
 }
 
+static esp_err_t bsp_codec_io_result(int ret)
+{
+    if (ESP_CODEC_DEV_OK == ret) {
+        return ESP_OK;
+    }
+    return (ESP_CODEC_DEV_WRONG_STATE == ret) ? ESP_ERR_INVALID_STATE : ESP_FAIL;
+}
+
+static esp_err_t bsp_codec_read_chunk(void *data, size_t len, void *ctx)
+{
+    return bsp_codec_io_result(esp_codec_dev_read(record_dev_handle, data, len));
+}
+
+static esp_err_t bsp_codec_write_chunk(void *data, size_t len, void *ctx)
+{
+    return bsp_codec_io_result(esp_codec_dev_write(play_dev_handle, data, len));
+}
+
+static bsp_i2s_stream_handle_t bsp_i2s_get_stream(bsp_i2s_dir_t dir)
+{
+    return (BSP_I2S_DIR_PLAY == dir) ? play_stream : record_stream;
+}
+
 esp_err_t bsp_i2s_read(void *audio_buffer, size_t len, size_t *bytes_read, uint32_t timeout_ms)
 {
-    esp_err_t ret = ESP_OK;
-    ret = esp_codec_dev_read(record_dev_handle, audio_buffer, len);
-    *bytes_read = len;
-    return ret;
+    ESP_RETURN_ON_FALSE(record_stream, ESP_ERR_INVALID_STATE, TAG, "codec not initialized");
+    return bsp_i2s_stream_transfer(record_stream, audio_buffer, len, bytes_read, timeout_ms);
 }
 
 esp_err_t bsp_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
 {
-    esp_err_t ret = ESP_OK;
-    ret = esp_codec_dev_write(play_dev_handle, audio_buffer, len);
-    *bytes_written = len;
-    return ret;
+    ESP_RETURN_ON_FALSE(play_stream, ESP_ERR_INVALID_STATE, TAG, "codec not initialized");
+    return bsp_i2s_stream_transfer(play_stream, audio_buffer, len, bytes_written, timeout_ms);
 }
 
-esp_err_t bsp_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+esp_err_t bsp_i2s_set_mode(bsp_i2s_dir_t dir, bsp_i2s_mode_t mode, size_t buffer_size)
 {
-    esp_err_t ret = ESP_OK;
+    bsp_i2s_stream_handle_t stream = bsp_i2s_get_stream(dir);
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_INVALID_STATE, TAG, "codec not initialized");
+    return bsp_i2s_stream_set_mode(stream, mode, buffer_size);
+}
 
+esp_err_t bsp_i2s_get_stats(bsp_i2s_dir_t dir, bsp_i2s_stats_t *stats)
+{
+    bsp_i2s_stream_handle_t stream = bsp_i2s_get_stream(dir);
+    ESP_RETURN_ON_FALSE(stream && stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    bsp_i2s_stream_get_stats(stream, stats);
+    return ESP_OK;
+}
+
+esp_err_t bsp_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+{
     esp_codec_dev_sample_info_t fs = {
         .sample_rate = rate,
         .channel = ch,
         .bits_per_sample = bits_cfg,
     };
+    return bsp_codec_session_set_fs(BSP_CODEC_SESSION_BOTH, &fs);
+}
 
-    if (play_dev_handle) {
-        ret = esp_codec_dev_close(play_dev_handle);
-    }
-    if (record_dev_handle) {
-        ret |= esp_codec_dev_close(record_dev_handle);
-        ret |= esp_codec_dev_set_in_gain(record_dev_handle, CODEC_DEFAULT_ADC_VOLUME);
-    }
+esp_err_t bsp_codec_set_play_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+{
+    esp_codec_dev_sample_info_t fs = {
+        .sample_rate = rate,
+        .channel = ch,
+        .bits_per_sample = bits_cfg,
+    };
+    return bsp_codec_session_set_fs(BSP_CODEC_SESSION_PLAY, &fs);
+}
 
-    if (play_dev_handle) {
-        ret |= esp_codec_dev_open(play_dev_handle, &fs);
-    }
-    if (record_dev_handle) {
-        ret |= esp_codec_dev_open(record_dev_handle, &fs);
-    }
-    return ret;
+esp_err_t bsp_codec_get_stats(bsp_codec_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    bsp_codec_session_get_stats(stats);
+    return ESP_OK;
 }
 
 esp_err_t bsp_codec_volume_set(int volume, int *volume_set)
@@ -183,16 +222,7 @@ esp_err_t bsp_codec_mute_set(bool enable)
 
 esp_err_t bsp_codec_dev_stop(void)
 {
-    esp_err_t ret = ESP_OK;
-
-    if (play_dev_handle) {
-        ret = esp_codec_dev_close(play_dev_handle);
-    }
-
-    if (record_dev_handle) {
-        ret = esp_codec_dev_close(record_dev_handle);
-    }
-    return ret;
+    return bsp_codec_session_stop();
 }
 
 esp_err_t bsp_codec_dev_resume(void)
@@ -208,6 +238,33 @@ static esp_err_t bsp_codec_init()
     record_dev_handle = bsp_audio_codec_microphone_init();
     assert((record_dev_handle) && "record_dev_handle not initialized");
 
+    const bsp_i2s_stream_config_t play_config = {
+        .io = bsp_codec_write_chunk,
+        .playback = true,
+        .task_name = "i2s_play",
+        .task_priority = CODEC_STREAM_TASK_PRIORITY,
+    };
+    ESP_RETURN_ON_ERROR(bsp_i2s_stream_create(&play_config, &play_stream), TAG, "create play stream failed");
+
+    const bsp_i2s_stream_config_t record_config = {
+        .io = bsp_codec_read_chunk,
+        .playback = false,
+        .task_name = "i2s_record",
+        .task_priority = CODEC_STREAM_TASK_PRIORITY,
+    };
+    ESP_RETURN_ON_ERROR(bsp_i2s_stream_create(&record_config, &record_stream), TAG, "create record stream failed");
+
+    /* Speaker and microphone share one full duplex I2S port */
+    const bsp_codec_session_config_t session_config = {
+        .play_dev = play_dev_handle,
+        .record_dev = record_dev_handle,
+        .play_stream = play_stream,
+        .record_stream = record_stream,
+        .in_gain = CODEC_DEFAULT_ADC_VOLUME,
+        .shared_clock = true,
+    };
+    ESP_RETURN_ON_ERROR(bsp_codec_session_init(&session_config), TAG, "init codec session failed");
+
     bsp_codec_set_fs(CODEC_DEFAULT_SAMPLE_RATE, CODEC_DEFAULT_BIT_WIDTH, CODEC_DEFAULT_CHANNEL);
     return ESP_OK;
 }
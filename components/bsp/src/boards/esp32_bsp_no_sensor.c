@@ -35,6 +35,31 @@ static esp_err_t bsp_sensor_get_humiture(float *temperature, float *humidity)
     return ESP_FAIL;
 }
 
+static esp_err_t bsp_sensor_get_value(bsp_sensor_id_t id, bsp_sensor_value_t *value)
+{
+    return ESP_ERR_INVALID_STATE;
+}
+
+static esp_err_t bsp_sensor_set_period(bsp_sensor_id_t id, uint32_t period_ms)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t bsp_sensor_subscribe(bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t bsp_sensor_unsubscribe(bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data)
+{
+    return ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t bsp_sensor_get_stats(bsp_sensor_stats_t *stats)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
 esp_err_t bsp_sensor_init(bsp_bottom_property_t *handle)
 {
     ESP_LOGW(TAG, "This example don't support Sensor!!");
@@ -45,5 +70,11 @@ esp_err_t bsp_sensor_init(bsp_bottom_property_t *handle)
     handle->set_radar_enable = bsp_sensor_set_radar_enable;
     handle->get_humiture = bsp_sensor_get_humiture;
 
+    handle->get_sensor_value = bsp_sensor_get_value;
+    handle->set_sensor_period = bsp_sensor_set_period;
+    handle->subscribe = bsp_sensor_subscribe;
+    handle->unsubscribe = bsp_sensor_unsubscribe;
+    handle->get_sensor_stats = bsp_sensor_get_stats;
+
     return ESP_ERR_NOT_SUPPORTED;
 }
@@ -4,38 +4,61 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_check.h"
 #include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
 
 #include "bsp_board.h"
+#include "bsp_sensor_hub.h"
+#include "bsp_presence.h"
 #include "aht20.h"
 #include "at581x.h"
 
 #define BSP_I2C_EXPAND_NUM              ((1 == BSP_I2C_NUM) ? (0):(1))
 #define BSP_I2C_EXPAND_CLK_SPEED_HZ     CONFIG_BSP_I2C_CLK_SPEED_HZ
 
-#define RADAE_POWER_DELAY               (60 * 2) // 2min
-#define RADAE_FUNC_STOP                 (RADAE_POWER_DELAY + 1)
+#define RADAR_DEBOUNCE_MS               (50)
+#define RADAR_HOLD_MS                   (60 * 1000)     // 1min
+#define RADAR_POWER_OFF_DELAY_MS        (60 * 2 * 1000) // 2min
+
+#define SENSOR_HUMITURE_PERIOD_MS       (2000)
+#define SENSOR_PROBE_PERIOD_MS          (3000)  // hot-plug detection while the bottom is away
+#define SENSOR_MAX_FAILURES             (3)
+#define SENSOR_PROBE_TIMEOUT_MS         (50)
 
 static bool sys_sleep_entered = false;
 static bottom_id_t sys_bottom_id;
 
-static float sys_temp_result;
-static float sys_RH_result;
-static uint16_t power_off_delay;
+static presence_t radar_presence;
+static bool radar_attached = false;
+static volatile bool radar_enable = true;
+static volatile bool radar_enable_changed = false;
+static volatile bool radar_edge = false;
 
 static aht20_dev_handle_t aht20 = NULL;
+static at581x_dev_handle_t at581x = NULL;
 static esp_pm_lock_handle_t g_pm_apb_lock = NULL;
 static esp_pm_lock_handle_t g_pm_light_lock = NULL;
 static esp_pm_lock_handle_t g_pm_cpu_lock = NULL;
 
+static sensor_hub_t sensor_hub;
+static SemaphoreHandle_t sensor_hub_lock = NULL;
+static TaskHandle_t sensor_hub_task = NULL;
+
 static const char *TAG = "bsp_sensor";
 
 static esp_err_t bsp_pm_init();
 static esp_err_t bsp_pm_exit_sleep();
 static esp_err_t bsp_pm_enter_sleep();
 
+static esp_err_t bsp_init_temp_humudity();
+static esp_err_t bsp_init_radar();
+
 static bool bsp_i2c_device_probe(i2c_port_t i2c_num, uint8_t addr);
 
 static bool bsp_get_sleep_mode()
@@ -51,7 +74,7 @@ static bottom_id_t bsp_get_bottom_id()
 static bool bsp_sensor_get_radar_status()
 {
     if (BOTTOM_ID_SENSOR == sys_bottom_id) {
-        return ((power_off_delay > RADAE_POWER_DELAY / 2) ? (true) : (false));
+        return radar_presence.present;
     } else {
         return false;
     }
@@ -59,86 +82,295 @@ static bool bsp_sensor_get_radar_status()
 
 static void bsp_sensor_set_radar_onoff(bool enable)
 {
-    if (enable) {
-        power_off_delay = RADAE_POWER_DELAY;
-    } else {
-        power_off_delay = RADAE_FUNC_STOP;
+    /* Applied by the sensor task, which owns the presence engine */
+    radar_enable = enable;
+    radar_enable_changed = true;
+    if (sensor_hub_task) {
+        xTaskNotifyGive(sensor_hub_task);
     }
 }
 
 static esp_err_t bsp_sensor_get_humiture(float *temperature, float *humidity)
 {
-    if (BOTTOM_ID_SENSOR == sys_bottom_id) {
-        *temperature = sys_temp_result;
-        *humidity = sys_RH_result;
+    bsp_sensor_value_t value;
+
+    if (ESP_OK == sensor_hub_get_value(&sensor_hub, BSP_SENSOR_HUMITURE, &value)) {
+        *temperature = value.value[0];
+        *humidity = value.value[1];
         return ESP_OK;
     } else {
         return ESP_FAIL;
     }
 }
 
-static void low_power_monitor_task(void *arg)
+static esp_err_t bsp_sensor_get_value(bsp_sensor_id_t id, bsp_sensor_value_t *value)
+{
+    return sensor_hub_get_value(&sensor_hub, id, value);
+}
+
+static esp_err_t bsp_sensor_set_period(bsp_sensor_id_t id, uint32_t period_ms)
+{
+    ESP_RETURN_ON_ERROR(sensor_hub_set_period(&sensor_hub, id, period_ms, esp_timer_get_time()), TAG,
+                        "invalid argument");
+    xTaskNotifyGive(sensor_hub_task);
+    return ESP_OK;
+}
+
+static esp_err_t bsp_sensor_subscribe(bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data)
+{
+    return sensor_hub_subscribe(&sensor_hub, id, cb, user_data);
+}
+
+static esp_err_t bsp_sensor_unsubscribe(bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data)
+{
+    return sensor_hub_unsubscribe(&sensor_hub, id, cb, user_data);
+}
+
+static esp_err_t bsp_sensor_get_stats(bsp_sensor_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    sensor_hub_get_stats(&sensor_hub, stats);
+    return ESP_OK;
+}
+
+static void bsp_sensor_exit_sleep(void)
+{
+    bsp_pm_exit_sleep();
+
+    ESP_LOGD(TAG, "power on");
+    bsp_display_exit_sleep();
+
+    lvgl_port_resume();
+    iot_button_resume();
+    bsp_codec_dev_resume();
+    sys_sleep_entered = false;
+}
+
+static void bsp_sensor_enter_sleep(void)
+{
+    ESP_LOGD(TAG, "power off");
+    sys_sleep_entered = true;
+    bsp_display_enter_sleep();
+
+    lvgl_port_stop();
+    iot_button_stop();
+    bsp_codec_dev_stop();
+    bsp_pm_enter_sleep();
+}
+
+static esp_err_t humiture_probe(void *ctx)
+{
+    return bsp_i2c_device_probe(BSP_I2C_EXPAND_NUM, AHT20_ADDRRES_0) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t humiture_attach(void *ctx)
+{
+    if (aht20) {
+        aht20_del_sensor(aht20);
+        aht20 = NULL;
+    }
+    return bsp_init_temp_humudity();
+}
+
+static esp_err_t humiture_read(void *ctx, float value[BSP_SENSOR_VALUE_NUM])
 {
-    static uint8_t gpio_level_prev = 1;
     uint32_t temp_raw, RH_raw;
-    uint8_t gpio_level;
 
-    gpio_config_t io_conf = {};
-    io_conf.intr_type = GPIO_INTR_POSEDGE;
-    io_conf.pin_bit_mask = (1ULL << BSP_RADAR_OUT_IO);
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pull_up_en = 1;
-    gpio_config(&io_conf);
-    vTaskDelay(pdMS_TO_TICKS(1500));
+    return aht20_read_temperature_humidity(aht20, &temp_raw, &value[0], &RH_raw, &value[1]);
+}
 
-    while (1) {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+static esp_err_t radar_probe(void *ctx)
+{
+    return bsp_i2c_device_probe(BSP_I2C_EXPAND_NUM, AT581X_ADDRRES_0) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
 
-        if (sys_bottom_id != BOTTOM_ID_UNKNOW) {
-            sys_bottom_id = (bsp_i2c_device_probe(BSP_I2C_EXPAND_NUM, AT581X_ADDRRES_0)) ? BOTTOM_ID_SENSOR : BOTTOM_ID_LOST;
-        }
+static esp_err_t radar_attach(void *ctx)
+{
+    const presence_config_t presence_config = {
+        .debounce_ms = RADAR_DEBOUNCE_MS,
+        .hold_ms = RADAR_HOLD_MS,
+        .power_off_delay_ms = RADAR_POWER_OFF_DELAY_MS,
+    };
+
+    if (at581x) {
+        at581x_del_sensor(at581x);
+        at581x = NULL;
+    }
+    ESP_RETURN_ON_ERROR(bsp_init_radar(), TAG, "radar init failed");
+
+    presence_init(&radar_presence, &presence_config, radar_enable, esp_timer_get_time());
+    radar_enable_changed = false;
+    radar_attached = true;
+    /* The sensor task samples the output and arms the interrupt */
+    radar_edge = true;
+    return ESP_OK;
+}
+
+/* Presence is driven by the output interrupt, this only fills the value on attach */
+static esp_err_t radar_read(void *ctx, float value[BSP_SENSOR_VALUE_NUM])
+{
+    value[0] = radar_presence.present ? 1 : 0;
+    return ESP_OK;
+}
+
+static void radar_isr_handler(void *arg)
+{
+    BaseType_t task_woken = pdFALSE;
 
-        if (BOTTOM_ID_SENSOR == sys_bottom_id) {
-            gpio_level = gpio_get_level(BSP_RADAR_OUT_IO);
-            if ((RADAE_FUNC_STOP != power_off_delay) && power_off_delay) {
-                power_off_delay--;
-            }
-            aht20_read_temperature_humidity(aht20, &temp_raw, &sys_temp_result, &RH_raw, &sys_RH_result);
-        } else {
-            gpio_level = 1;
+    if (!sensor_hub_task) {
+        return;
+    }
+    /* Level triggered, stays off until the task has read the level and re-armed it */
+    gpio_intr_disable(BSP_RADAR_OUT_IO);
+    radar_edge = true;
+    vTaskNotifyGiveFromISR(sensor_hub_task, &task_woken);
+    if (task_woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static int64_t bsp_radar_run(int64_t now)
+{
+    uint32_t events = 0;
+
+    if (!radar_attached) {
+        return PRESENCE_NEVER;
+    }
+
+    if (radar_enable_changed) {
+        radar_enable_changed = false;
+        events |= presence_set_enable(&radar_presence, radar_enable, now);
+    }
+    if (radar_edge) {
+        radar_edge = false;
+        int level = gpio_get_level(BSP_RADAR_OUT_IO);
+        events |= presence_input(&radar_presence, level, now);
+        /* Wait for the other level, which also wakes the chip from light sleep */
+        gpio_wakeup_enable(BSP_RADAR_OUT_IO, level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+        gpio_intr_enable(BSP_RADAR_OUT_IO);
+    }
+    events |= presence_run(&radar_presence, now);
+
+    if ((events & PRESENCE_EVENT_WAKE) && (true == sys_sleep_entered)) {
+        bsp_sensor_exit_sleep();
+    }
+    if (events & (PRESENCE_EVENT_ENTER | PRESENCE_EVENT_LEAVE)) {
+        const float value[BSP_SENSOR_VALUE_NUM] = { radar_presence.present ? 1 : 0 };
+        ESP_LOGD(TAG, "Radar: %s", radar_presence.present ? "active" : "passive");
+        sensor_hub_publish(&sensor_hub, BSP_SENSOR_RADAR, value, now);
+    }
+    if ((events & PRESENCE_EVENT_POWER_OFF) && (false == sys_sleep_entered)) {
+        bsp_sensor_enter_sleep();
+    }
+    return presence_next(&radar_presence);
+}
+
+static void bsp_sensor_radar_event(bsp_sensor_id_t id, bsp_sensor_event_t event, const bsp_sensor_value_t *value,
+                                   void *user_data)
+{
+    if (BSP_SENSOR_EVENT_DETACHED == event) {
+        radar_attached = false;
+        gpio_intr_disable(BSP_RADAR_OUT_IO);
+    }
+}
+
+static void bsp_sensor_bottom_event(bsp_sensor_id_t id, bsp_sensor_event_t event, const bsp_sensor_value_t *value,
+                                    void *user_data)
+{
+    if (BSP_SENSOR_EVENT_ATTACHED == event) {
+        ESP_LOGW(TAG, "Sensor bottom connected");
+        sys_bottom_id = BOTTOM_ID_SENSOR;
+    } else if (BSP_SENSOR_EVENT_DETACHED == event) {
+        ESP_LOGW(TAG, "Sensor bottom lost");
+        sys_bottom_id = BOTTOM_ID_LOST;
+        /* Without the radar nothing would wake the box up */
+        if (sys_sleep_entered) {
+            bsp_sensor_exit_sleep();
         }
+    }
+}
+
+static void sensor_hub_take(void *arg)
+{
+    xSemaphoreTake((SemaphoreHandle_t)arg, portMAX_DELAY);
+}
+
+static void sensor_hub_give(void *arg)
+{
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+}
+
+static void bsp_sensor_hub_task(void *arg)
+{
+    while (1) {
+        const int64_t now = esp_timer_get_time();
+        int64_t next = sensor_hub_run(&sensor_hub, now);
+        int64_t radar_next = bsp_radar_run(now);
+        TickType_t wait = portMAX_DELAY;
 
-        if (gpio_level_prev ^ gpio_level) {
-            gpio_level_prev = gpio_level;
-            if (gpio_level && (RADAE_FUNC_STOP != power_off_delay)) {
-                power_off_delay = RADAE_POWER_DELAY;
-                ESP_LOGD(TAG, "Radar: %s", "active");
-            }
+        if (radar_next < next) {
+            next = radar_next;
         }
 
-        if ((gpio_level) && (true == sys_sleep_entered)) {
-            bsp_pm_exit_sleep();
-
-            ESP_LOGD(TAG, "power on");
-            bsp_display_exit_sleep();
-
-            lvgl_port_resume();
-            iot_button_resume();
-            bsp_codec_dev_resume();
-            sys_sleep_entered = false;
-        } else if ((1 == power_off_delay) && (BOTTOM_ID_SENSOR == sys_bottom_id)) {
-            ESP_LOGD(TAG, "power off");
-            sys_sleep_entered = true;
-            bsp_display_enter_sleep();
-
-            lvgl_port_stop();
-            iot_button_stop();
-            bsp_codec_dev_stop();
-            bsp_pm_enter_sleep();
+        if (SENSOR_HUB_NEVER != next) {
+            int64_t wait_ms = (next - esp_timer_get_time() + 999) / 1000;
+            wait = (wait_ms > 0) ? pdMS_TO_TICKS(wait_ms + portTICK_PERIOD_MS - 1) : 0;
         }
+        /* Woken early by the radar interrupt, bsp_sensor_set_period or set_radar_enable */
+        ulTaskNotifyTake(pdTRUE, wait);
     }
 }
 
+static esp_err_t bsp_sensor_hub_init(void)
+{
+    const int64_t now = esp_timer_get_time();
+
+    sensor_hub_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(sensor_hub_lock, ESP_ERR_NO_MEM, TAG, "create sensor hub lock failed");
+
+    const sensor_hub_config_t hub_config = {
+        .lock = sensor_hub_take,
+        .unlock = sensor_hub_give,
+        .lock_arg = sensor_hub_lock,
+    };
+    sensor_hub_init(&sensor_hub, &hub_config);
+
+    const sensor_hub_desc_t humiture = {
+        .probe = humiture_probe,
+        .attach = humiture_attach,
+        .read = humiture_read,
+        .period_ms = SENSOR_HUMITURE_PERIOD_MS,
+        .probe_period_ms = SENSOR_PROBE_PERIOD_MS,
+        .threshold = 0.1f,
+        .max_failures = SENSOR_MAX_FAILURES,
+        .parent = -1,
+    };
+    const sensor_hub_desc_t radar = {
+        .probe = radar_probe,
+        .attach = radar_attach,
+        .read = radar_read,
+        .period_ms = 0,                 // presence comes from the output interrupt
+        .probe_period_ms = SENSOR_PROBE_PERIOD_MS,
+        .threshold = 0.5f,
+        .max_failures = SENSOR_MAX_FAILURES,
+        .parent = BSP_SENSOR_HUMITURE,  // both sit on the sensor bottom
+    };
+    ESP_RETURN_ON_ERROR(sensor_hub_add(&sensor_hub, BSP_SENSOR_HUMITURE, &humiture, now), TAG, "add humiture failed");
+    ESP_RETURN_ON_ERROR(sensor_hub_add(&sensor_hub, BSP_SENSOR_RADAR, &radar, now), TAG, "add radar failed");
+    ESP_RETURN_ON_ERROR(sensor_hub_subscribe(&sensor_hub, BSP_SENSOR_HUMITURE, bsp_sensor_bottom_event, NULL), TAG,
+                        "subscribe bottom failed");
+    ESP_RETURN_ON_ERROR(sensor_hub_subscribe(&sensor_hub, BSP_SENSOR_RADAR, bsp_sensor_radar_event, NULL), TAG,
+                        "subscribe radar failed");
+
+    /* Attach what is there before returning, the task takes over from the next deadline */
+    sensor_hub_run(&sensor_hub, now);
+
+    BaseType_t ret = xTaskCreatePinnedToCore(&bsp_sensor_hub_task, "Sensor Task", 4 * 1024, NULL, 5,
+                                             &sensor_hub_task, 1);
+    ESP_RETURN_ON_FALSE(pdPASS == ret, ESP_FAIL, TAG, "create sensor task failed");
+    return ESP_OK;
+}
+
 static esp_err_t bsp_init_temp_humudity()
 {
     esp_err_t ret = ESP_OK;
@@ -158,7 +390,6 @@ static esp_err_t bsp_init_temp_humudity()
 static esp_err_t bsp_init_radar()
 {
     esp_err_t ret = ESP_OK;
-    at581x_dev_handle_t at581x = NULL;
 
     at581x_default_cfg_t def_cfg = ATH581X_INITIALIZATION_CONFIG();
 
@@ -223,9 +454,6 @@ static esp_err_t bsp_pm_init()
                             TAG, "create l_cpu pm lock failed");
     }
     bsp_pm_exit_sleep();
-
-    ret = xTaskCreatePinnedToCore(&low_power_monitor_task, "Lowpower Task", 4 * 1024, NULL, 5, NULL, 1);
-    ESP_RETURN_ON_ERROR(pdPASS != ret, TAG,  "create Lowpower task failed");
     return ret;
 }
 
@@ -236,7 +464,7 @@ static bool bsp_i2c_device_probe(i2c_port_t i2c_num, uint8_t addr)
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, addr | I2C_MASTER_WRITE, true);
     i2c_master_stop(cmd);
-    if (i2c_master_cmd_begin(i2c_num, cmd, 2000) == ESP_OK) {
+    if (i2c_master_cmd_begin(i2c_num, cmd, pdMS_TO_TICKS(SENSOR_PROBE_TIMEOUT_MS)) == ESP_OK) {
         probe_result = true;
     }
     i2c_cmd_link_delete(cmd);
@@ -273,13 +501,6 @@ static esp_err_t bsp_i2c_expand_init(void)
     return ESP_OK;
 }
 
-static esp_err_t bsp_i2c_expand_deinit(void)
-{
-    ESP_RETURN_ON_ERROR(i2c_driver_delete(BSP_I2C_EXPAND_NUM),
-                        TAG, "uninstall expand i2c failed");
-    return ESP_OK;
-}
-
 esp_err_t bsp_sensor_init(bsp_bottom_property_t *handle)
 {
     esp_err_t ret = ESP_OK;
@@ -287,15 +508,26 @@ esp_err_t bsp_sensor_init(bsp_bottom_property_t *handle)
     ret |= bsp_pm_init();
     ret |= bsp_i2c_expand_init();
 
-    if (bsp_i2c_device_probe(BSP_I2C_EXPAND_NUM, AT581X_ADDRRES_0)) {
-        ESP_LOGW(TAG, "Sensor bottom connected");
-        ret |= bsp_init_radar();
-        ret |= bsp_init_temp_humudity();
-        sys_bottom_id = BOTTOM_ID_SENSOR;
-    } else {
+    gpio_config_t io_conf = {};
+    io_conf.intr_type = GPIO_INTR_DISABLE;
+    io_conf.pin_bit_mask = (1ULL << BSP_RADAR_OUT_IO);
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pull_up_en = 1;
+    ret |= gpio_config(&io_conf);
+
+    /* The service may already be installed by another driver */
+    esp_err_t isr_ret = gpio_install_isr_service(0);
+    if (ESP_OK != isr_ret && ESP_ERR_INVALID_STATE != isr_ret) {
+        ret |= isr_ret;
+    }
+    ret |= gpio_isr_handler_add(BSP_RADAR_OUT_IO, radar_isr_handler, NULL);
+    ret |= esp_sleep_enable_gpio_wakeup();
+
+    /* Stays unknown until the bottom shows up, the hub probes it now and on hot-plug */
+    sys_bottom_id = BOTTOM_ID_UNKNOW;
+    ret |= bsp_sensor_hub_init();
+    if (BOTTOM_ID_UNKNOW == sys_bottom_id) {
         ESP_LOGW(TAG, "Sensor bottom lost");
-        sys_bottom_id = BOTTOM_ID_UNKNOW;
-        bsp_i2c_expand_deinit();
     }
 
     handle->get_sleep_mode = bsp_get_sleep_mode;
@@ -304,5 +536,11 @@ esp_err_t bsp_sensor_init(bsp_bottom_property_t *handle)
     handle->set_radar_enable = bsp_sensor_set_radar_onoff;
     handle->get_humiture = bsp_sensor_get_humiture;
 
+    handle->get_sensor_value = bsp_sensor_get_value;
+    handle->set_sensor_period = bsp_sensor_set_period;
+    handle->subscribe = bsp_sensor_subscribe;
+    handle->unsubscribe = bsp_sensor_unsubscribe;
+    handle->get_sensor_stats = bsp_sensor_get_stats;
+
     return ret;
 }
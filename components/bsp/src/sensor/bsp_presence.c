@@ -0,0 +1,109 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "bsp_presence.h"
+
+static int64_t presence_at(int64_t since_us, uint32_t ms)
+{
+    return since_us + (int64_t)ms * 1000;
+}
+
+void presence_init(presence_t *p, const presence_config_t *config, bool enabled, int64_t now_us)
+{
+    memset(p, 0, sizeof(*p));
+    p->config = *config;
+    p->enabled = enabled;
+    p->level_us = now_us;
+    p->absent_us = PRESENCE_NEVER;
+}
+
+uint32_t presence_input(presence_t *p, bool level, int64_t now_us)
+{
+    if (level != p->level) {
+        p->level = level;
+        p->level_us = now_us;
+    }
+    return presence_run(p, now_us);
+}
+
+uint32_t presence_run(presence_t *p, int64_t now_us)
+{
+    uint32_t events = 0;
+
+    if (p->level != p->stable && now_us >= presence_at(p->level_us, p->config.debounce_ms)) {
+        p->stable = p->level;
+        if (p->stable) {
+            if (p->asleep) {
+                p->asleep = false;
+                events |= PRESENCE_EVENT_WAKE;
+            }
+            if (p->enabled && !p->present) {
+                p->present = true;
+                events |= PRESENCE_EVENT_ENTER;
+            }
+            p->absent_us = PRESENCE_NEVER;
+        } else if (p->enabled) {
+            /* Timers run from the edge, not from the end of the debounce */
+            p->absent_us = p->level_us;
+        }
+    }
+
+    if (!p->stable && PRESENCE_NEVER != p->absent_us) {
+        if (p->present && now_us >= presence_at(p->absent_us, p->config.hold_ms)) {
+            p->present = false;
+            events |= PRESENCE_EVENT_LEAVE;
+        }
+        if (!p->asleep && now_us >= presence_at(p->absent_us, p->config.power_off_delay_ms)) {
+            p->asleep = true;
+            events |= PRESENCE_EVENT_POWER_OFF;
+        }
+    }
+    return events;
+}
+
+uint32_t presence_set_enable(presence_t *p, bool enable, int64_t now_us)
+{
+    /* Settle a pending edge under the old setting first */
+    uint32_t events = presence_run(p, now_us);
+
+    p->enabled = enable;
+    if (enable) {
+        if (!p->present) {
+            p->present = true;
+            events |= PRESENCE_EVENT_ENTER;
+        }
+        if (!p->stable) {
+            p->absent_us = now_us;
+        }
+    } else {
+        if (p->present) {
+            p->present = false;
+            events |= PRESENCE_EVENT_LEAVE;
+        }
+        p->absent_us = PRESENCE_NEVER;
+    }
+    return events;
+}
+
+int64_t presence_next(const presence_t *p)
+{
+    int64_t next = PRESENCE_NEVER;
+
+    if (p->level != p->stable) {
+        next = presence_at(p->level_us, p->config.debounce_ms);
+    }
+    if (!p->stable && PRESENCE_NEVER != p->absent_us) {
+        if (p->present && presence_at(p->absent_us, p->config.hold_ms) < next) {
+            next = presence_at(p->absent_us, p->config.hold_ms);
+        }
+        if (!p->asleep && presence_at(p->absent_us, p->config.power_off_delay_ms) < next) {
+            next = presence_at(p->absent_us, p->config.power_off_delay_ms);
+        }
+    }
+    return next;
+}
@@ -0,0 +1,347 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "bsp_sensor_hub.h"
+
+/* Per run, a sensor reports at most two events of its own and one as a child */
+#define SENSOR_HUB_MAX_EVENTS       (3 * BSP_SENSOR_MAX)
+
+typedef struct {
+    bsp_sensor_id_t id;
+    bsp_sensor_event_t event;
+    bsp_sensor_value_t value;
+} sensor_hub_event_t;
+
+typedef struct {
+    sensor_hub_event_t event[SENSOR_HUB_MAX_EVENTS];
+    int count;
+} sensor_hub_events_t;
+
+static void hub_lock(sensor_hub_t *hub)
+{
+    if (hub->config.lock) {
+        hub->config.lock(hub->config.lock_arg);
+    }
+}
+
+static void hub_unlock(sensor_hub_t *hub)
+{
+    if (hub->config.unlock) {
+        hub->config.unlock(hub->config.lock_arg);
+    }
+}
+
+static void hub_post(sensor_hub_t *hub, sensor_hub_events_t *events, bsp_sensor_id_t id, bsp_sensor_event_t event)
+{
+    if (events->count < SENSOR_HUB_MAX_EVENTS) {
+        sensor_hub_event_t *e = &events->event[events->count++];
+        e->id = id;
+        e->event = event;
+        e->value = hub->slot[id].value;
+    }
+}
+
+static void hub_dispatch(sensor_hub_t *hub, const sensor_hub_events_t *events)
+{
+    for (int i = 0; i < events->count; i++) {
+        const sensor_hub_event_t *e = &events->event[i];
+        sensor_hub_sub_t sub[SENSOR_HUB_MAX_SUBSCRIBERS];
+        int n = 0;
+
+        hub_lock(hub);
+        for (int j = 0; j < SENSOR_HUB_MAX_SUBSCRIBERS; j++) {
+            if (hub->sub[j].cb && hub->sub[j].id == e->id) {
+                sub[n++] = hub->sub[j];
+            }
+        }
+        hub_unlock(hub);
+        for (int j = 0; j < n; j++) {
+            sub[j].cb(e->id, e->event, &e->value, sub[j].user_data);
+        }
+    }
+}
+
+static int64_t hub_after(int64_t now_us, uint32_t period_ms)
+{
+    return period_ms ? now_us + (int64_t)period_ms * 1000 : SENSOR_HUB_NEVER;
+}
+
+/* Detach a sensor and what is wired behind it, called with the lock held */
+static void hub_detach(sensor_hub_t *hub, bsp_sensor_id_t id, int64_t now_us, sensor_hub_events_t *events)
+{
+    sensor_hub_slot_t *s = &hub->slot[id];
+
+    s->present = false;
+    s->has_value = false;
+    s->failures = 0;
+    hub_post(hub, events, id, BSP_SENSOR_EVENT_DETACHED);
+    for (int child = 0; child < BSP_SENSOR_MAX; child++) {
+        sensor_hub_slot_t *c = &hub->slot[child];
+        if (c->used && c->desc.parent == (int)id) {
+            if (c->present) {
+                hub_detach(hub, child, now_us, events);
+            }
+            /* Not probed again until the parent is back */
+            c->due_us = SENSOR_HUB_NEVER;
+        }
+    }
+    if (s->desc.parent < 0 || hub->slot[s->desc.parent].present) {
+        s->due_us = hub_after(now_us, s->desc.probe_period_ms);
+    }
+}
+
+static bool hub_changed(const sensor_hub_slot_t *s, const float value[BSP_SENSOR_VALUE_NUM])
+{
+    if (!s->has_value) {
+        return true;
+    }
+    for (int i = 0; i < BSP_SENSOR_VALUE_NUM; i++) {
+        if (fabsf(value[i] - s->notified[i]) >= s->desc.threshold) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Store a value, called with the lock held */
+static void hub_store(sensor_hub_t *hub, bsp_sensor_id_t id, const float value[BSP_SENSOR_VALUE_NUM], int64_t now_us,
+                      sensor_hub_events_t *events)
+{
+    sensor_hub_slot_t *s = &hub->slot[id];
+
+    memcpy(s->value.value, value, sizeof(s->value.value));
+    s->value.timestamp_us = now_us;
+    if (hub_changed(s, value)) {
+        memcpy(s->notified, value, sizeof(s->notified));
+        s->has_value = true;
+        hub_post(hub, events, id, BSP_SENSOR_EVENT_CHANGED);
+    }
+}
+
+static void hub_step(sensor_hub_t *hub, bsp_sensor_id_t id, int64_t now_us, sensor_hub_events_t *events)
+{
+    sensor_hub_slot_t *s = &hub->slot[id];
+
+    hub_lock(hub);
+    if (!s->used || s->due_us > now_us) {
+        hub_unlock(hub);
+        return;
+    }
+    const sensor_hub_desc_t desc = s->desc;
+    bool present = s->present;
+    hub_unlock(hub);
+
+    if (!present) {
+        bool ok = (!desc.probe || ESP_OK == desc.probe(desc.ctx)) && (!desc.attach || ESP_OK == desc.attach(desc.ctx));
+        hub_lock(hub);
+        hub->stats.probes++;
+        if (!ok) {
+            s->due_us = hub_after(now_us, desc.probe_period_ms);
+            hub_unlock(hub);
+            return;
+        }
+        s->present = true;
+        s->failures = 0;
+        hub_post(hub, events, id, BSP_SENSOR_EVENT_ATTACHED);
+        for (int child = 0; child < BSP_SENSOR_MAX; child++) {
+            if (hub->slot[child].used && hub->slot[child].desc.parent == (int)id && !hub->slot[child].present) {
+                hub->slot[child].due_us = now_us;
+            }
+        }
+        hub_unlock(hub);
+    }
+
+    float value[BSP_SENSOR_VALUE_NUM] = { 0 };
+    esp_err_t ret = desc.read ? desc.read(desc.ctx, value) : ESP_OK;
+
+    hub_lock(hub);
+    hub->stats.reads++;
+    if (!s->present) {
+        /* Detached behind a parent while reading */
+    } else if (ESP_OK == ret) {
+        s->failures = 0;
+        hub_store(hub, id, value, now_us, events);
+        s->due_us = hub_after(now_us, s->desc.period_ms);
+    } else {
+        hub->stats.failures++;
+        if (++s->failures >= (desc.max_failures ? desc.max_failures : 1)) {
+            hub_detach(hub, id, now_us, events);
+        } else {
+            s->due_us = hub_after(now_us, s->desc.period_ms ? s->desc.period_ms : desc.probe_period_ms);
+        }
+    }
+    hub_unlock(hub);
+}
+
+void sensor_hub_init(sensor_hub_t *hub, const sensor_hub_config_t *config)
+{
+    memset(hub, 0, sizeof(*hub));
+    if (config) {
+        hub->config = *config;
+    }
+}
+
+esp_err_t sensor_hub_add(sensor_hub_t *hub, bsp_sensor_id_t id, const sensor_hub_desc_t *desc, int64_t now_us)
+{
+    if (id >= BSP_SENSOR_MAX || !desc || desc->parent >= (int)id) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    hub_lock(hub);
+    sensor_hub_slot_t *s = &hub->slot[id];
+    memset(s, 0, sizeof(*s));
+    s->desc = *desc;
+    s->used = true;
+    s->due_us = (desc->parent < 0 || hub->slot[desc->parent].present) ? now_us : SENSOR_HUB_NEVER;
+    hub_unlock(hub);
+    return ESP_OK;
+}
+
+int64_t sensor_hub_run(sensor_hub_t *hub, int64_t now_us)
+{
+    sensor_hub_events_t events = { .count = 0 };
+    int64_t next = SENSOR_HUB_NEVER;
+
+    hub_lock(hub);
+    hub->stats.wakeups++;
+    hub_unlock(hub);
+
+    /* A parent has a lower id than what is wired behind it, so one pass attaches both */
+    for (int id = 0; id < BSP_SENSOR_MAX; id++) {
+        hub_step(hub, id, now_us, &events);
+    }
+    hub_dispatch(hub, &events);
+
+    hub_lock(hub);
+    for (int id = 0; id < BSP_SENSOR_MAX; id++) {
+        if (hub->slot[id].used && hub->slot[id].due_us < next) {
+            next = hub->slot[id].due_us;
+        }
+    }
+    hub_unlock(hub);
+    return next;
+}
+
+esp_err_t sensor_hub_publish(sensor_hub_t *hub, bsp_sensor_id_t id, const float value[BSP_SENSOR_VALUE_NUM],
+                             int64_t now_us)
+{
+    sensor_hub_events_t events = { .count = 0 };
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    if (id >= BSP_SENSOR_MAX || !value) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    hub_lock(hub);
+    if (hub->slot[id].present) {
+        hub_store(hub, id, value, now_us, &events);
+        ret = ESP_OK;
+    }
+    hub_unlock(hub);
+    hub_dispatch(hub, &events);
+    return ret;
+}
+
+esp_err_t sensor_hub_set_period(sensor_hub_t *hub, bsp_sensor_id_t id, uint32_t period_ms, int64_t now_us)
+{
+    if (id >= BSP_SENSOR_MAX || !hub->slot[id].used) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    hub_lock(hub);
+    sensor_hub_slot_t *s = &hub->slot[id];
+    s->desc.period_ms = period_ms;
+    if (s->present) {
+        /* A shorter period takes effect now rather than at the old deadline */
+        int64_t due = hub_after(now_us, period_ms);
+        if (due < s->due_us || !period_ms) {
+            s->due_us = due;
+        }
+    }
+    hub_unlock(hub);
+    return ESP_OK;
+}
+
+esp_err_t sensor_hub_get_value(sensor_hub_t *hub, bsp_sensor_id_t id, bsp_sensor_value_t *value)
+{
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    if (id >= BSP_SENSOR_MAX || !value) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    hub_lock(hub);
+    if (hub->slot[id].present && hub->slot[id].has_value) {
+        *value = hub->slot[id].value;
+        ret = ESP_OK;
+    }
+    hub_unlock(hub);
+    return ret;
+}
+
+bool sensor_hub_is_present(sensor_hub_t *hub, bsp_sensor_id_t id)
+{
+    bool present = false;
+
+    if (id < BSP_SENSOR_MAX) {
+        hub_lock(hub);
+        present = hub->slot[id].present;
+        hub_unlock(hub);
+    }
+    return present;
+}
+
+esp_err_t sensor_hub_subscribe(sensor_hub_t *hub, bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data)
+{
+    esp_err_t ret = ESP_ERR_NO_MEM;
+
+    if (id >= BSP_SENSOR_MAX || !cb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    hub_lock(hub);
+    for (int i = 0; i < SENSOR_HUB_MAX_SUBSCRIBERS; i++) {
+        if (!hub->sub[i].cb) {
+            hub->sub[i] = (sensor_hub_sub_t) {
+                .id = id, .cb = cb, .user_data = user_data,
+            };
+            ret = ESP_OK;
+            break;
+        }
+    }
+    hub_unlock(hub);
+    return ret;
+}
+
+esp_err_t sensor_hub_unsubscribe(sensor_hub_t *hub, bsp_sensor_id_t id, bsp_sensor_cb_t cb, void *user_data)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    if (!cb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    hub_lock(hub);
+    for (int i = 0; i < SENSOR_HUB_MAX_SUBSCRIBERS; i++) {
+        if (hub->sub[i].cb == cb && hub->sub[i].id == id && hub->sub[i].user_data == user_data) {
+            memset(&hub->sub[i], 0, sizeof(hub->sub[i]));
+            ret = ESP_OK;
+            break;
+        }
+    }
+    hub_unlock(hub);
+    return ret;
+}
+
+void sensor_hub_get_stats(sensor_hub_t *hub, bsp_sensor_stats_t *stats)
+{
+    hub_lock(hub);
+    *stats = hub->stats;
+    hub_unlock(hub);
+}
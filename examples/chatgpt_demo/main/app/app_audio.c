@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: CC0-1.0
  */
 
+#include <math.h>
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
@@ -20,6 +21,7 @@
 #include "app_sr.h"
 #include "app_audio.h"
 #include "bsp_board.h"
+#include "bsp_audio_mixer.h"
 #include "bsp/esp-bsp.h"
 #include "audio_player.h"
 #include "file_iterator.h"
@@ -37,6 +39,9 @@ uint32_t file_total_len = 0;
 static uint8_t *record_audio_buffer = NULL;
 uint8_t *audio_rx_buffer = NULL;
 audio_play_finish_cb_t audio_play_finish_cb = NULL;
+/* The mixer owns the codec, the prompts duck the answer of the player */
+static bsp_mixer_stream_handle_t s_player_stream = NULL;
+static bsp_mixer_stream_handle_t s_prompt_stream = NULL;
 
 extern sr_data_t *g_sr_data;
 extern esp_err_t start_openai(uint8_t *audio, int audio_len);
@@ -60,25 +65,18 @@ void mute_btn_handler(void *handle, void *arg)
 
 static esp_err_t audio_mute_function(AUDIO_PLAYER_MUTE_SETTING setting)
 {
-    bsp_codec_mute_set(setting == AUDIO_PLAYER_MUTE ? true : false);
-    // restore the voice volume upon unmuting
-    if (setting == AUDIO_PLAYER_UNMUTE) {
-        bsp_codec_volume_set(CONFIG_VOLUME_LEVEL, NULL);
-    }
-    return ESP_OK;
+    // mute the player stream only, a prompt may be playing
+    return bsp_mixer_stream_set_gain(s_player_stream, setting == AUDIO_PLAYER_MUTE ? -INFINITY : 0);
 }
 
-static esp_err_t audio_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+static esp_err_t audio_player_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
 {
-    esp_err_t ret = ESP_OK;
-    ret = bsp_codec_set_fs(rate, bits_cfg, ch);
-
-    bsp_codec_mute_set(true);
-    bsp_codec_mute_set(false);
-    bsp_codec_volume_set(CONFIG_VOLUME_LEVEL, NULL);
-    vTaskDelay(pdMS_TO_TICKS(50));
+    return bsp_mixer_stream_write(s_player_stream, audio_buffer, len, bytes_written, timeout_ms);
+}
 
-    return ret;
+static esp_err_t audio_player_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+{
+    return bsp_mixer_stream_set_format(s_player_stream, rate, bits_cfg, ch == I2S_SLOT_MODE_MONO ? 1 : 2);
 }
 
 static void audio_player_cb(audio_player_cb_ctx_t *ctx)
@@ -86,7 +84,6 @@ static void audio_player_cb(audio_player_cb_ctx_t *ctx)
     switch (ctx->audio_event) {
     case AUDIO_PLAYER_CALLBACK_EVENT_IDLE:
         ESP_LOGI(TAG, "Player IDLE");
-        bsp_codec_set_fs(16000, 16, 2);
         if (audio_play_finish_cb) {
             audio_play_finish_cb();
         }
@@ -128,9 +125,25 @@ void audio_record_init()
     file_iterator_instance_t *file_iterator = file_iterator_new(BSP_SPIFFS_MOUNT_POINT);
     assert(file_iterator != NULL);
 
+    /* The recorder stays at 16 kHz, the mixer keeps the player at the same rate */
+    bsp_mixer_config_t mixer_config = BSP_MIXER_DEFAULT_CONFIG();
+    ESP_ERROR_CHECK(bsp_mixer_start(&mixer_config));
+    bsp_codec_mute_set(false);
+    bsp_codec_volume_set(CONFIG_VOLUME_LEVEL, NULL);
+
+    bsp_mixer_stream_config_t stream_config = {
+        .sample_rate = 16000,
+        .bits = 16,
+        .channels = 2,
+        .priority = 0,
+    };
+    ESP_ERROR_CHECK(bsp_mixer_stream_open(&stream_config, &s_player_stream));
+    stream_config.priority = 1;
+    ESP_ERROR_CHECK(bsp_mixer_stream_open(&stream_config, &s_prompt_stream));
+
     audio_player_config_t config = { .mute_fn = audio_mute_function,
-                                     .write_fn = bsp_i2s_write,
-                                     .clk_set_fn = audio_codec_set_fs,
+                                     .write_fn = audio_player_write,
+                                     .clk_set_fn = audio_player_set_fs,
                                      .priority = 5
                                    };
     ESP_ERROR_CHECK(audio_player_new(config));
@@ -229,6 +242,8 @@ esp_err_t audio_play_task(void *filepath)
     struct stat file_stat;
     esp_err_t ret = ESP_OK;
 
+    ESP_RETURN_ON_FALSE(NULL != s_prompt_stream, ESP_ERR_INVALID_STATE, TAG, "audio not initialized");
+
     const size_t chunk_size = 4096;
     uint8_t *buffer = malloc(chunk_size);
     ESP_GOTO_ON_FALSE(NULL != buffer, ESP_FAIL, EXIT, TAG, "buffer malloc failed");
@@ -252,11 +267,9 @@ esp_err_t audio_play_task(void *filepath)
     }
 
     ESP_LOGI(TAG, "frame_rate= %" PRIi32 ", ch=%d, width=%d", wav_head.SampleRate, wav_head.NumChannels, wav_head.BitsPerSample);
-    bsp_codec_set_fs(wav_head.SampleRate, wav_head.BitsPerSample, I2S_SLOT_MODE_STEREO);
-
-    bsp_codec_mute_set(true);
-    bsp_codec_mute_set(false);
-    bsp_codec_volume_set(CONFIG_VOLUME_LEVEL, NULL);
+    ret = bsp_mixer_stream_set_format(s_prompt_stream, wav_head.SampleRate, wav_head.BitsPerSample,
+                                      wav_head.NumChannels);
+    ESP_GOTO_ON_FALSE(ESP_OK == ret, ret, EXIT, TAG, "Unsupported wav format");
 
     size_t cnt, total_cnt = 0;
     do {
@@ -265,7 +278,7 @@ esp_err_t audio_play_task(void *filepath)
         if (len <= 0) {
             break;
         } else if (len > 0) {
-            bsp_i2s_write(buffer, len, &cnt, portMAX_DELAY);
+            bsp_mixer_stream_write(s_prompt_stream, buffer, len, &cnt, portMAX_DELAY);
             total_cnt += cnt;
         }
     } while (1);
@@ -283,7 +296,6 @@ EXIT:
 void sr_handler_task(void *pvParam)
 {
 #if !CONFIG_BSP_BOARD_ESP32_S3_BOX_Lite
-    static bool mute_state = false;
     mute_flag = gpio_get_level(BSP_BUTTON_MUTE_IO);
     printf("sr handle task, mute:%d\n", mute_flag);
 #endif
@@ -301,14 +313,6 @@ void sr_handler_task(void *pvParam)
 
         app_sr_get_result(&result, pdMS_TO_TICKS(1 * 1000));
 
-#if !CONFIG_BSP_BOARD_ESP32_S3_BOX_Lite
-        if (mute_state != mute_flag) {
-            mute_state = mute_flag;
-            if (false == mute_state) {
-                bsp_codec_set_fs(16000, 16, 2);
-            }
-        }
-#endif
         if (ESP_MN_STATE_TIMEOUT == result.state) {
             ESP_LOGI(TAG, "ESP_MN_STATE_TIMEOUT");
             audio_record_stop();
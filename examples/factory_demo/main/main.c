@@ -130,7 +130,7 @@ void app_main(void)
     assert(file_iterator != NULL);
     audio_player_config_t config = { .mute_fn = audio_mute_function,
                                      .write_fn = bsp_i2s_write,
-                                     .clk_set_fn = bsp_codec_set_fs,
+                                     .clk_set_fn = bsp_codec_set_play_fs,
                                      .priority = 5
                                    };
     ESP_ERROR_CHECK(audio_player_new(config));
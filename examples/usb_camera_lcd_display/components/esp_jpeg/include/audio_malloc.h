@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Allocator of the codec library. `audio_calloc_inner` serves the internal
+ * pool, `audio_calloc` the default one. By default that pool is internal
+ * memory too and only takes the sizes calloc keeps there, below
+ * CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL, larger ones still go to calloc and
+ * PSRAM, so the codec finds its buffers where it did before the pools.
+ *
+ * A pool is a region reserved once and cut into blocks of size classes,
+ * four per power of two. A freed block goes back to the free list of its
+ * class and serves the next allocation of that class, so the allocations
+ * the codec repeats at every frame stop reaching the heap once the first
+ * frames are through, and cannot fragment it. Allocations larger than
+ * AUDIO_MEM_MAX_CLASS_SIZE, or that find their pool spent, come from the
+ * heap as before. Without audio_mem_init everything comes from the heap,
+ * still accounted.
+ */
+#define AUDIO_MEM_MAX_CLASS_SIZE    (256 * 1024)    /*!< Largest allocation served by a pool */
+#define AUDIO_MEM_MAX_BLOCKS        256             /*!< Live allocations accounted, more are served by the heap untracked */
+
+typedef enum
+{
+    AUDIO_MEM_POOL_INNER = 0,       /*!< Internal memory, `audio_calloc_inner` */
+    AUDIO_MEM_POOL_DEFAULT,         /*!< Memory of `default_caps`, `audio_calloc` */
+    AUDIO_MEM_POOL_MAX,
+} audio_mem_pool_t;
+
+typedef struct
+{
+    size_t inner_size;              /*!< Bytes of the internal pool, 0 for none */
+    size_t default_size;            /*!< Bytes of the default pool, 0 for none */
+    uint32_t default_caps;          /*!< Heap caps of the default pool, 0 for internal memory holding what calloc
+                                         would place there, otherwise the pool serves every size it can */
+} audio_mem_config_t;
+
+typedef struct
+{
+    size_t pool_size;               /*!< Bytes reserved for the pool, 0 without a pool */
+    size_t pool_carved;             /*!< Bytes of the pool given to size classes so far */
+    size_t in_use;                  /*!< Bytes requested and not freed, pool and heap */
+    size_t high_water;              /*!< Largest `in_use` seen */
+    uint32_t allocs;                /*!< Allocations */
+    uint32_t frees;                 /*!< Frees */
+    uint32_t live;                  /*!< Allocations not freed yet */
+    uint32_t heap_allocs;           /*!< Allocations served by the heap, too large or the pool spent */
+    uint32_t untracked;             /*!< Allocations served by the heap without accounting, too many live */
+    uint32_t failures;              /*!< Allocations that failed */
+} audio_mem_stats_t;
+
+void *audio_calloc_inner(size_t n, size_t size);
+void *audio_calloc(size_t n, size_t size);
+void audio_free(void *ptr);
+
+/**
+ * @brief Reserve the pools
+ *
+ * To be called once, before the codec is opened. Allocations made before
+ * stay on the heap until freed.
+ *
+ * @param config pool sizes
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_INVALID_STATE Pools already reserved
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t audio_mem_init(const audio_mem_config_t *config);
+
+/**
+ * @brief Get the counters of a pool
+ *
+ * @param pool pool
+ * @param stats returned counters
+ */
+void audio_mem_get_stats(audio_mem_pool_t pool, audio_mem_stats_t *stats);
+
+/**
+ * @brief Start tagging the allocations with a new session
+ *
+ * One session is tagged at a time, starting one ends the tagging of the
+ * previous one, which can still be checked with audio_mem_session_end.
+ *
+ * @return session number, never 0
+ */
+uint16_t audio_mem_session_begin(void);
+
+/**
+ * @brief Stop tagging a session and log its allocations not freed yet
+ *
+ * @param session session number from audio_mem_session_begin
+ * @return number of allocations of the session not freed yet
+ */
+size_t audio_mem_session_end(uint16_t session);
+
+#ifdef __cplusplus
+}
+#endif
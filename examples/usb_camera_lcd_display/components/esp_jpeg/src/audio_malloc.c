@@ -1,7 +1,11 @@
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "audio_malloc.h"
 
 // #define audio_malloc  malloc
 // #define audio_free    free
@@ -9,14 +13,238 @@
 // #define audio_calloc  calloc
 // #define audio_realloc realloc
 
-void *audio_calloc_inner(size_t n, size_t size)
+#define AUDIO_MEM_ALIGN         16      /* Pool blocks are aligned for the codec SIMD loads */
+#define AUDIO_MEM_SMALL_CLASSES 4       /* 16, 32, 48 and 64 bytes */
+#define AUDIO_MEM_LARGE_SHIFT   6       /* Above 64 bytes, four classes per power of two */
+#define AUDIO_MEM_CLASSES       (AUDIO_MEM_SMALL_CLASSES + 4 * (17 - AUDIO_MEM_LARGE_SHIFT + 1))
+#define AUDIO_MEM_SPARE_CLASSES 4       /* A spent pool may serve a class with a free block up to twice as large */
+#define AUDIO_MEM_HEAP_CLASS    0xFF    /* Class of the blocks from the heap */
+#define AUDIO_MEM_MAX_LEAKS     16      /* Leaks logged by audio_mem_session_end, the others are only counted */
+#define AUDIO_MEM_MAX_LIVE      (AUDIO_MEM_MAX_BLOCKS * 3 / 4)
+#ifdef CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL
+#define AUDIO_MEM_CALLOC_INTERNAL_MAX   CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL     /* calloc puts larger blocks in PSRAM */
+#else
+#define AUDIO_MEM_CALLOC_INTERNAL_MAX   AUDIO_MEM_MAX_CLASS_SIZE
+#endif
+
+static const char *TAG = "AUDIO_MEM";
+
+typedef struct
+{
+    void *ptr;                      /* NULL for an empty slot */
+    uint32_t size;                  /* Bytes requested */
+    void *caller;
+    uint16_t session;
+    uint8_t pool;
+    uint8_t cls;
+} audio_mem_block_t;
+
+typedef struct
+{
+    uint8_t *base;
+    uint8_t *end;
+    uint8_t *next;                  /* Start of the part not given to a class yet */
+    size_t max_size;                /* Largest allocation served by the pool */
+    void *free[AUDIO_MEM_CLASSES];  /* Free blocks of each class, linked through their first word */
+    audio_mem_stats_t stats;
+} audio_mem_pool_state_t;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static audio_mem_pool_state_t s_pools[AUDIO_MEM_POOL_MAX];
+static audio_mem_block_t s_blocks[AUDIO_MEM_MAX_BLOCKS];    /* Live allocations, hashed by address */
+static uint32_t s_live;
+static uint16_t s_session;                                  /* Session being tagged, 0 for none */
+static uint16_t s_last_session;                             /* Never reused until the counter wraps */
+
+static int mem_class(size_t size)
+{
+    if (size <= 16 * AUDIO_MEM_SMALL_CLASSES)
+    {
+        return (size > 0) ? (size - 1) / 16 : 0;
+    }
+    /* 2^shift < size <= 2^(shift + 1), then quarters of 2^shift */
+    const int shift = 31 - __builtin_clz((uint32_t)size - 1);
+    const size_t quarter = (size_t)1 << (shift - 2);
+    const int step = (size - ((size_t)1 << shift) + quarter - 1) / quarter;
+    return AUDIO_MEM_SMALL_CLASSES + (shift - AUDIO_MEM_LARGE_SHIFT) * 4 + step - 1;
+}
+
+static size_t mem_class_size(int cls)
+{
+    if (cls < AUDIO_MEM_SMALL_CLASSES)
+    {
+        return (cls + 1) * 16;
+    }
+    cls -= AUDIO_MEM_SMALL_CLASSES;
+    const int shift = cls / 4 + AUDIO_MEM_LARGE_SHIFT;
+    return ((size_t)1 << shift) + ((size_t)1 << (shift - 2)) * (cls % 4 + 1);
+}
+
+static inline size_t mem_hash(const void *ptr)
+{
+    return ((uint32_t)((uintptr_t)ptr >> 4) * 2654435761u) % AUDIO_MEM_MAX_BLOCKS;
+}
+
+static int mem_find(const void *ptr)
+{
+    for (size_t i = mem_hash(ptr); s_blocks[i].ptr != NULL; i = (i + 1) % AUDIO_MEM_MAX_BLOCKS)
+    {
+        if (s_blocks[i].ptr == ptr)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void mem_insert(const audio_mem_block_t *block)
+{
+    size_t i = mem_hash(block->ptr);
+    while (s_blocks[i].ptr != NULL)
+    {
+        i = (i + 1) % AUDIO_MEM_MAX_BLOCKS;
+    }
+    s_blocks[i] = *block;
+    s_live++;
+}
+
+/* Linear probing, the entries after the hole move back so lookups never need tombstones */
+static void mem_remove(size_t hole)
+{
+    size_t i = hole;
+    while (true)
+    {
+        i = (i + 1) % AUDIO_MEM_MAX_BLOCKS;
+        if (s_blocks[i].ptr == NULL)
+        {
+            break;
+        }
+        const size_t home = mem_hash(s_blocks[i].ptr);
+        /* Move it unless its home lies cyclically in (hole, i] */
+        const bool stays = (hole < i) ? (home > hole && home <= i) : (home > hole || home <= i);
+        if (!stays)
+        {
+            s_blocks[hole] = s_blocks[i];
+            hole = i;
+        }
+    }
+    s_blocks[hole].ptr = NULL;
+    s_live--;
+}
+
+static void *pool_take(audio_mem_pool_state_t *pool, int cls, int *ret_cls)
+{
+    void *block = pool->free[cls];
+    if (block == NULL && pool->end - pool->next >= (ptrdiff_t)mem_class_size(cls))
+    {
+        block = pool->next;
+        pool->next += mem_class_size(cls);
+        pool->stats.pool_carved = pool->next - pool->base;
+        *ret_cls = cls;
+        return block;
+    }
+    for (int spare = cls + 1; block == NULL && spare <= cls + AUDIO_MEM_SPARE_CLASSES && spare < AUDIO_MEM_CLASSES; spare++)
+    {
+        if (pool->free[spare] != NULL)
+        {
+            block = pool->free[spare];
+            cls = spare;
+        }
+    }
+    if (block != NULL)
+    {
+        pool->free[cls] = *(void **)block;
+        *ret_cls = cls;
+    }
+    return block;
+}
+
+static void mem_account(audio_mem_pool_state_t *pool, size_t size)
 {
-    void *data =  NULL;
+    pool->stats.allocs++;
+    pool->stats.live++;
+    pool->stats.in_use += size;
+    if (pool->stats.in_use > pool->stats.high_water)
+    {
+        pool->stats.high_water = pool->stats.in_use;
+    }
+}
+
+static void *heap_calloc(audio_mem_pool_t pool, size_t size)
+{
+    if (pool == AUDIO_MEM_POOL_DEFAULT)
+    {
+        return calloc(1, size);
+    }
 #if CONFIG_SPIRAM_BOOT_INIT
-    data = heap_caps_calloc_prefer(n, size, 2,  MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM);
+    return heap_caps_calloc_prefer(1, size, 2, MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM);
 #else
-    data = heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    return heap_caps_calloc(1, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
 #endif
+}
+
+static void *mem_calloc(audio_mem_pool_t pool, size_t n, size_t size, void *caller)
+{
+    if (size != 0 && n > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+    const size_t bytes = (n * size > 0) ? n * size : 1;
+    audio_mem_pool_state_t *state = &s_pools[pool];
+    audio_mem_block_t block = {
+        .size = bytes,
+        .caller = caller,
+        .pool = pool,
+        .cls = AUDIO_MEM_HEAP_CLASS,
+    };
+    int cls = 0;
+
+    taskENTER_CRITICAL(&s_lock);
+    const bool tracked = s_live < AUDIO_MEM_MAX_LIVE;
+    if (tracked && bytes <= state->max_size)
+    {
+        block.ptr = pool_take(state, mem_class(bytes), &cls);
+    }
+    if (block.ptr != NULL)
+    {
+        block.cls = cls;
+        block.session = s_session;
+        mem_insert(&block);
+        mem_account(state, bytes);
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (block.ptr != NULL)
+    {
+        memset(block.ptr, 0, bytes);
+        return block.ptr;
+    }
+
+    /* The heap takes its own lock, it cannot be called in the critical section */
+    block.ptr = heap_calloc(pool, bytes);
+    taskENTER_CRITICAL(&s_lock);
+    if (block.ptr == NULL)
+    {
+        state->stats.failures++;
+    }
+    else if (tracked && s_live < AUDIO_MEM_MAX_LIVE)
+    {
+        block.session = s_session;
+        mem_insert(&block);
+        mem_account(state, bytes);
+        state->stats.heap_allocs++;
+    }
+    else
+    {
+        state->stats.untracked++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return block.ptr;
+}
+
+void *audio_calloc_inner(size_t n, size_t size)
+{
+    void *data = mem_calloc(AUDIO_MEM_POOL_INNER, n, size, __builtin_return_address(0));
 
 #ifdef ENABLE_AUDIO_MEM_TRACE
     ESP_LOGI("AUIDO_MEM", "calloc_inner:%p, size:%d, called:0x%08x", data, size, (intptr_t)__builtin_return_address(0) - 2);
@@ -26,7 +254,7 @@ void *audio_calloc_inner(size_t n, size_t size)
 
 void *audio_calloc(size_t n, size_t size)
 {
-    return calloc(n, size);
+    return mem_calloc(AUDIO_MEM_POOL_DEFAULT, n, size, __builtin_return_address(0));
 }
 
 // void* realloc(void* ptr, size_t size)
@@ -36,5 +264,152 @@ void *audio_calloc(size_t n, size_t size)
 
 void audio_free(void *ptr)
 {
-    free(ptr);
+    if (ptr == NULL)
+    {
+        return;
+    }
+    bool heap = true;
+    bool invalid = false;
+
+    taskENTER_CRITICAL(&s_lock);
+    const int index = mem_find(ptr);
+    if (index >= 0)
+    {
+        const audio_mem_block_t block = s_blocks[index];
+        audio_mem_pool_state_t *pool = &s_pools[block.pool];
+        mem_remove(index);
+        pool->stats.frees++;
+        pool->stats.live--;
+        pool->stats.in_use -= block.size;
+        if (block.cls != AUDIO_MEM_HEAP_CLASS)
+        {
+            *(void **)ptr = pool->free[block.cls];
+            pool->free[block.cls] = ptr;
+            heap = false;
+        }
+    }
+    else
+    {
+        /* Not live: a pool block freed twice, or a heap block allocated untracked */
+        for (int i = 0; i < AUDIO_MEM_POOL_MAX; i++)
+        {
+            invalid |= (uint8_t *)ptr >= s_pools[i].base && (uint8_t *)ptr < s_pools[i].end;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (invalid)
+    {
+        ESP_LOGE(TAG, "free of %p not allocated, called from %p", ptr, __builtin_return_address(0));
+    }
+    else if (heap)
+    {
+        free(ptr);
+    }
+}
+
+esp_err_t audio_mem_init(const audio_mem_config_t *config)
+{
+    if (config == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_pools[AUDIO_MEM_POOL_INNER].base != NULL || s_pools[AUDIO_MEM_POOL_DEFAULT].base != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* By default the pool stands in for the internal part of calloc, the rest keeps going to calloc */
+    const uint32_t default_caps = config->default_caps ? config->default_caps : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    const size_t max_sizes[AUDIO_MEM_POOL_MAX] = {
+        [AUDIO_MEM_POOL_INNER] = AUDIO_MEM_MAX_CLASS_SIZE,
+        [AUDIO_MEM_POOL_DEFAULT] = config->default_caps ? AUDIO_MEM_MAX_CLASS_SIZE : AUDIO_MEM_CALLOC_INTERNAL_MAX,
+    };
+    const size_t sizes[AUDIO_MEM_POOL_MAX] = {
+        [AUDIO_MEM_POOL_INNER] = config->inner_size & ~(size_t)(AUDIO_MEM_ALIGN - 1),
+        [AUDIO_MEM_POOL_DEFAULT] = config->default_size & ~(size_t)(AUDIO_MEM_ALIGN - 1),
+    };
+    uint8_t *bases[AUDIO_MEM_POOL_MAX] = {
+        [AUDIO_MEM_POOL_INNER] = sizes[AUDIO_MEM_POOL_INNER] ? heap_caps_aligned_alloc(AUDIO_MEM_ALIGN, sizes[AUDIO_MEM_POOL_INNER], MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) : NULL,
+        [AUDIO_MEM_POOL_DEFAULT] = sizes[AUDIO_MEM_POOL_DEFAULT] ? heap_caps_aligned_alloc(AUDIO_MEM_ALIGN, sizes[AUDIO_MEM_POOL_DEFAULT], default_caps) : NULL,
+    };
+    for (int i = 0; i < AUDIO_MEM_POOL_MAX; i++)
+    {
+        if (sizes[i] != 0 && bases[i] == NULL)
+        {
+            heap_caps_free(bases[AUDIO_MEM_POOL_INNER]);
+            heap_caps_free(bases[AUDIO_MEM_POOL_DEFAULT]);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    taskENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < AUDIO_MEM_POOL_MAX; i++)
+    {
+        s_pools[i].base = bases[i];
+        s_pools[i].next = bases[i];
+        s_pools[i].end = bases[i] + sizes[i];
+        s_pools[i].max_size = max_sizes[i];
+        s_pools[i].stats.pool_size = sizes[i];
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "pools of %u bytes internal and %u bytes default", (unsigned)sizes[AUDIO_MEM_POOL_INNER],
+             (unsigned)sizes[AUDIO_MEM_POOL_DEFAULT]);
+    return ESP_OK;
+}
+
+void audio_mem_get_stats(audio_mem_pool_t pool, audio_mem_stats_t *stats)
+{
+    taskENTER_CRITICAL(&s_lock);
+    *stats = s_pools[pool].stats;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+uint16_t audio_mem_session_begin(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    if (++s_last_session == 0)
+    {
+        s_last_session = 1;
+    }
+    s_session = s_last_session;
+    const uint16_t session = s_session;
+    taskEXIT_CRITICAL(&s_lock);
+    return session;
+}
+
+size_t audio_mem_session_end(uint16_t session)
+{
+    audio_mem_block_t leaks[AUDIO_MEM_MAX_LEAKS];
+    size_t count = 0;
+    size_t bytes = 0;
+
+    taskENTER_CRITICAL(&s_lock);
+    if (s_session == session)
+    {
+        s_session = 0;
+    }
+    for (size_t i = 0; session != 0 && i < AUDIO_MEM_MAX_BLOCKS; i++)
+    {
+        if (s_blocks[i].ptr != NULL && s_blocks[i].session == session)
+        {
+            if (count < AUDIO_MEM_MAX_LEAKS)
+            {
+                leaks[count] = s_blocks[i];
+            }
+            count++;
+            bytes += s_blocks[i].size;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    for (size_t i = 0; i < count && i < AUDIO_MEM_MAX_LEAKS; i++)
+    {
+        ESP_LOGW(TAG, "session %u leaked %p, %u bytes %s, allocated from %p", session, leaks[i].ptr,
+                 (unsigned)leaks[i].size, (leaks[i].pool == AUDIO_MEM_POOL_INNER) ? "internal" : "default", leaks[i].caller);
+    }
+    if (count > 0)
+    {
+        ESP_LOGW(TAG, "session %u leaked %u allocations, %u bytes", session, (unsigned)count, (unsigned)bytes);
+    }
+    return count;
 }
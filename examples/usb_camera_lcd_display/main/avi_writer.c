@@ -0,0 +1,329 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "avi_writer.h"
+
+/*
+ * File layout, offsets of the fields patched on close:
+ *
+ *   0 RIFF <size> AVI
+ *  12   LIST <size> hdrl
+ *  24     avih, 32 us per frame, 36 max bytes per second, 48 total frames, 60 suggested buffer size
+ *  88     LIST <size> strl
+ * 100       strh, 128 scale, 132 rate, 140 length, 144 suggested buffer size
+ * 164       strf
+ * 212   LIST <size> movi, 220 is the base of the idx1 offsets
+ * 224     00dc <size> <jpeg> [pad] ...
+ *       idx1 <size> { 00dc, keyframe, offset, size } ...
+ */
+#define AVI_RIFF_SIZE           4
+#define AVI_AVIH_US_PER_FRAME   32
+#define AVI_AVIH_MAX_BPS        36
+#define AVI_AVIH_TOTAL_FRAMES   48
+#define AVI_AVIH_BUFFER_SIZE    60
+#define AVI_STRH_SCALE          128
+#define AVI_STRH_RATE           132
+#define AVI_STRH_LENGTH         140
+#define AVI_STRH_BUFFER_SIZE    144
+#define AVI_MOVI_LIST           212
+#define AVI_MOVI_SIZE           216
+#define AVI_MOVI_BASE           220
+#define AVI_HEADER_SIZE         224
+
+#define AVIF_HASINDEX           0x10
+#define AVIIF_KEYFRAME          0x10
+#define AVI_INDEX_ENTRY_SIZE    16
+#define AVI_INDEX_INITIAL       (30 * 60)   /* A minute at 30 fps, doubled when full */
+
+typedef struct
+{
+    uint32_t offset;
+    uint32_t size;
+} avi_index_t;
+
+struct avi_writer_t
+{
+    avi_writer_config_t config;
+    FILE *file;
+    size_t fill;                    /* Bytes waiting in the buffer */
+    uint64_t pos;                   /* Logical file size, including the buffer */
+    bool failed;
+    avi_index_t *index;
+    uint32_t index_capacity;
+    int64_t first_us;
+    int64_t last_us;
+    avi_writer_stats_t stats;
+};
+
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static inline void put_fourcc(uint8_t *p, const char *fourcc)
+{
+    memcpy(p, fourcc, 4);
+}
+
+static esp_err_t avi_flush(struct avi_writer_t *writer)
+{
+    if (writer->fill > 0 && !writer->failed)
+    {
+        if (fwrite(writer->config.buffer, 1, writer->fill, writer->file) != writer->fill)
+        {
+            writer->failed = true;
+        }
+        writer->stats.bytes += writer->fill;
+    }
+    writer->fill = 0;
+    return writer->failed ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t avi_write(struct avi_writer_t *writer, const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    writer->pos += len;
+    while (len > 0)
+    {
+        size_t n = writer->config.buffer_size - writer->fill;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(writer->config.buffer + writer->fill, src, n);
+        writer->fill += n;
+        src += n;
+        len -= n;
+        if (writer->fill == writer->config.buffer_size && avi_flush(writer) != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+    }
+    return writer->failed ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t avi_patch_u32(struct avi_writer_t *writer, long offset, uint32_t value)
+{
+    uint8_t bytes[4];
+    put_u32(bytes, value);
+    if (fseek(writer->file, offset, SEEK_SET) != 0 || fwrite(bytes, 1, sizeof(bytes), writer->file) != sizeof(bytes))
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void avi_build_header(const avi_writer_config_t *config, uint8_t *h)
+{
+    const uint32_t us_per_frame = 1000000 / config->fps;
+
+    memset(h, 0, AVI_HEADER_SIZE);
+    put_fourcc(h + 0, "RIFF");
+    put_fourcc(h + 8, "AVI ");
+    put_fourcc(h + 12, "LIST");
+    put_u32(h + 16, AVI_MOVI_LIST - 20);
+    put_fourcc(h + 20, "hdrl");
+
+    put_fourcc(h + 24, "avih");
+    put_u32(h + 28, 56);
+    put_u32(h + AVI_AVIH_US_PER_FRAME, us_per_frame);
+    put_u32(h + 44, AVIF_HASINDEX);
+    put_u32(h + 56, 1);                         // streams
+    put_u32(h + 64, config->width);
+    put_u32(h + 68, config->height);
+
+    put_fourcc(h + 88, "LIST");
+    put_u32(h + 92, AVI_MOVI_LIST - 96);
+    put_fourcc(h + 96, "strl");
+    put_fourcc(h + 100, "strh");
+    put_u32(h + 104, 56);
+    put_fourcc(h + 108, "vids");
+    put_fourcc(h + 112, "MJPG");
+    put_u32(h + AVI_STRH_SCALE, us_per_frame);
+    put_u32(h + AVI_STRH_RATE, 1000000);
+    put_u32(h + 148, UINT32_MAX);               // default quality
+    put_u16(h + 160, config->width);            // rcFrame right, bottom
+    put_u16(h + 162, config->height);
+
+    put_fourcc(h + 164, "strf");
+    put_u32(h + 168, 40);
+    put_u32(h + 172, 40);                       // BITMAPINFOHEADER
+    put_u32(h + 176, config->width);
+    put_u32(h + 180, config->height);
+    put_u16(h + 184, 1);                        // planes
+    put_u16(h + 186, 24);                       // bits per pixel once decoded
+    put_fourcc(h + 188, "MJPG");
+    put_u32(h + 192, config->width * config->height * 3);
+
+    put_fourcc(h + AVI_MOVI_LIST, "LIST");
+    put_fourcc(h + AVI_MOVI_BASE, "movi");
+}
+
+esp_err_t avi_writer_open(const avi_writer_config_t *config, FILE *file, avi_writer_handle_t *ret_handle)
+{
+    if (config == NULL || file == NULL || ret_handle == NULL || config->width == 0 || config->height == 0 ||
+        config->fps == 0 || config->buffer == NULL || config->buffer_size == 0 || config->buffer_size % AVI_WRITER_ALIGN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct avi_writer_t *writer = calloc(1, sizeof(struct avi_writer_t));
+    if (writer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    writer->index = malloc(AVI_INDEX_INITIAL * sizeof(avi_index_t));
+    if (writer->index == NULL)
+    {
+        free(writer);
+        return ESP_ERR_NO_MEM;
+    }
+    writer->index_capacity = AVI_INDEX_INITIAL;
+    writer->config = *config;
+    writer->file = file;
+
+    uint8_t header[AVI_HEADER_SIZE];
+    avi_build_header(config, header);
+    if (avi_write(writer, header, sizeof(header)) != ESP_OK)
+    {
+        free(writer->index);
+        free(writer);
+        return ESP_FAIL;
+    }
+
+    *ret_handle = writer;
+    return ESP_OK;
+}
+
+esp_err_t avi_writer_add_frame(avi_writer_handle_t handle, const uint8_t *data, size_t len, int64_t timestamp_us)
+{
+    if (handle == NULL || data == NULL || len == 0 || len > UINT32_MAX - 1)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const size_t padded = len + (len & 1);
+    const uint64_t index_size = (uint64_t)(handle->stats.frames + 1) * AVI_INDEX_ENTRY_SIZE + 8;
+    if (handle->pos + 8 + padded + index_size > AVI_WRITER_MAX_BYTES)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (handle->stats.frames == handle->index_capacity)
+    {
+        avi_index_t *index = realloc(handle->index, handle->index_capacity * 2 * sizeof(avi_index_t));
+        if (index == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        handle->index = index;
+        handle->index_capacity *= 2;
+    }
+
+    handle->index[handle->stats.frames].offset = handle->pos - AVI_MOVI_BASE;
+    handle->index[handle->stats.frames].size = len;
+    uint8_t chunk[8];
+    put_fourcc(chunk, "00dc");
+    put_u32(chunk + 4, len);
+    const uint8_t pad = 0;
+    if (avi_write(handle, chunk, sizeof(chunk)) != ESP_OK || avi_write(handle, data, len) != ESP_OK ||
+        (padded != len && avi_write(handle, &pad, 1) != ESP_OK))
+    {
+        return ESP_FAIL;
+    }
+
+    if (handle->stats.frames == 0)
+    {
+        handle->first_us = timestamp_us;
+    }
+    handle->last_us = timestamp_us;
+    handle->stats.frames++;
+    if (len > handle->stats.max_frame)
+    {
+        handle->stats.max_frame = len;
+    }
+    return ESP_OK;
+}
+
+void avi_writer_get_stats(avi_writer_handle_t handle, avi_writer_stats_t *stats)
+{
+    *stats = handle->stats;
+    stats->us_per_frame = (handle->stats.frames > 1) ? (handle->last_us - handle->first_us) / (handle->stats.frames - 1) : 0;
+}
+
+esp_err_t avi_writer_close(avi_writer_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const uint32_t frames = handle->stats.frames;
+    const uint32_t movi_size = handle->pos - AVI_MOVI_BASE;
+    uint8_t entry[AVI_INDEX_ENTRY_SIZE];
+    put_fourcc(entry, "idx1");
+    put_u32(entry + 4, frames * AVI_INDEX_ENTRY_SIZE);
+    esp_err_t ret = avi_write(handle, entry, 8);
+    for (uint32_t i = 0; i < frames && ret == ESP_OK; i++)
+    {
+        put_fourcc(entry, "00dc");
+        put_u32(entry + 4, AVIIF_KEYFRAME);
+        put_u32(entry + 8, handle->index[i].offset);
+        put_u32(entry + 12, handle->index[i].size);
+        ret = avi_write(handle, entry, sizeof(entry));
+    }
+    if (ret == ESP_OK)
+    {
+        ret = avi_flush(handle);
+    }
+
+    /* The file is complete, now fill in what was not known at the start */
+    avi_writer_stats_t stats;
+    avi_writer_get_stats(handle, &stats);
+    const uint32_t us_per_frame = stats.us_per_frame ? stats.us_per_frame : 1000000 / handle->config.fps;
+    const uint32_t buffer_size = stats.max_frame + 8;
+    const uint64_t max_bps = (uint64_t)buffer_size * 1000000 / us_per_frame;
+    if (ret == ESP_OK)
+    {
+        const struct
+        {
+            long offset;
+            uint32_t value;
+        } patches[] = {
+            {AVI_RIFF_SIZE, handle->pos - 8},
+            {AVI_AVIH_US_PER_FRAME, us_per_frame},
+            {AVI_AVIH_MAX_BPS, (max_bps > UINT32_MAX) ? UINT32_MAX : (uint32_t)max_bps},
+            {AVI_AVIH_TOTAL_FRAMES, frames},
+            {AVI_AVIH_BUFFER_SIZE, buffer_size},
+            {AVI_STRH_SCALE, us_per_frame},
+            {AVI_STRH_LENGTH, frames},
+            {AVI_STRH_BUFFER_SIZE, buffer_size},
+            {AVI_MOVI_SIZE, movi_size},
+        };
+        for (size_t i = 0; i < sizeof(patches) / sizeof(patches[0]) && ret == ESP_OK; i++)
+        {
+            ret = avi_patch_u32(handle, patches[i].offset, patches[i].value);
+        }
+        if (fseek(handle->file, 0, SEEK_END) != 0 || fflush(handle->file) != 0)
+        {
+            ret = ESP_FAIL;
+        }
+    }
+
+    free(handle->index);
+    free(handle);
+    return ret;
+}
@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+#define AVI_WRITER_MAX_BYTES    (1024UL * 1024 * 1024)  /*!< Largest file, AVI 1.0 players stop at 1 GB */
+#define AVI_WRITER_ALIGN        512                     /*!< Writes to the file are whole multiples of this */
+
+/**
+ * An AVI 1.0 writer for a single MJPEG video stream. Frames are stored as
+ * they come from the camera, without decoding. All writes go through a
+ * caller provided buffer and reach the file in whole buffers, so they stay
+ * sector aligned. The frame rate and the idx1 index are written on close.
+ */
+typedef struct
+{
+    uint16_t width;             /*!< Frame width */
+    uint16_t height;            /*!< Frame height */
+    uint32_t fps;               /*!< Nominal frame rate, replaced by the measured one on close */
+    uint8_t *buffer;            /*!< Write buffer, best in DMA capable memory */
+    size_t buffer_size;         /*!< Size of `buffer`, a multiple of AVI_WRITER_ALIGN */
+} avi_writer_config_t;
+
+typedef struct
+{
+    uint32_t frames;            /*!< Frames written */
+    uint64_t bytes;             /*!< Bytes written to the file */
+    uint32_t max_frame;         /*!< Largest frame */
+    uint32_t us_per_frame;      /*!< Measured frame period */
+} avi_writer_stats_t;
+
+typedef struct avi_writer_t *avi_writer_handle_t;
+
+/**
+ * @brief Start an AVI file
+ *
+ * @param config writer configuration
+ * @param file file open for writing at offset 0, stays owned by the caller
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ *         ESP_FAIL              Write failed
+ */
+esp_err_t avi_writer_open(const avi_writer_config_t *config, FILE *file, avi_writer_handle_t *ret_handle);
+
+/**
+ * @brief Append one JPEG frame
+ *
+ * @param handle writer handle
+ * @param data JPEG data
+ * @param len JPEG data length
+ * @param timestamp_us capture time, used for the frame rate
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_INVALID_SIZE  The file is full, close it and start another one
+ *         ESP_ERR_NO_MEM        Out of memory for the index
+ *         ESP_FAIL              Write failed
+ */
+esp_err_t avi_writer_add_frame(avi_writer_handle_t handle, const uint8_t *data, size_t len, int64_t timestamp_us);
+
+/**
+ * @brief Get the writer counters
+ *
+ * @param handle writer handle
+ * @param stats returned counters
+ */
+void avi_writer_get_stats(avi_writer_handle_t handle, avi_writer_stats_t *stats);
+
+/**
+ * @brief Write the index, complete the headers and free the writer
+ *
+ * The file is left open at its end.
+ *
+ * @param handle writer handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_FAIL              Write failed, the file may not play
+ */
+esp_err_t avi_writer_close(avi_writer_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
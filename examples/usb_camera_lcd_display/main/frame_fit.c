@@ -0,0 +1,238 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "frame_fit.h"
+
+/*
+ * The three RGB565 fields spread over 32 bits with gaps above each one,
+ * so 32 pixels can be summed with one addition per pixel:
+ * B in bits 0-10, R in bits 11-20, G in bits 21-31.
+ */
+#define RGB565_SPREAD_MASK  0x07E0F81F
+#define RGB565_SPREAD_MAX   32
+
+static inline uint32_t rgb565_spread(uint16_t pixel)
+{
+    return (pixel | ((uint32_t)pixel << 16)) & RGB565_SPREAD_MASK;
+}
+
+static inline uint16_t rgb565_load(const uint16_t *pixel, bool big_endian)
+{
+    return big_endian ? (uint16_t)((*pixel >> 8) | (*pixel << 8)) : *pixel;
+}
+
+static inline void rgb565_store(uint16_t *pixel, uint16_t value, bool big_endian)
+{
+    *pixel = big_endian ? (uint16_t)((value >> 8) | (value << 8)) : value;
+}
+
+/* Round a * b / c to the nearest integer, at least 1 */
+static inline int scale_round(int a, int b, int c)
+{
+    const int v = (int)(((int64_t)a * b + c / 2) / c);
+    return (v > 0) ? v : 1;
+}
+
+esp_err_t frame_fit_plan(int src_width, int src_height, int panel_width, int panel_height,
+                         frame_fit_mode_t mode, frame_fit_plan_t *plan)
+{
+    if (src_width <= 0 || src_height <= 0 || panel_width <= 0 || panel_height <= 0 || plan == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Size the frame is scaled to before anything is cut */
+    int target_width = src_width;
+    int target_height = src_height;
+    if (mode == FRAME_FIT_LETTERBOX)
+    {
+        if (src_width > panel_width || src_height > panel_height)
+        {
+            if ((int64_t)src_width * panel_height >= (int64_t)src_height * panel_width)
+            {
+                target_width = panel_width;
+                target_height = scale_round(src_height, panel_width, src_width);
+            }
+            else
+            {
+                target_width = scale_round(src_width, panel_height, src_height);
+                target_height = panel_height;
+            }
+        }
+    }
+    else if (src_width > panel_width && src_height > panel_height)
+    {
+        if ((int64_t)src_width * panel_height >= (int64_t)src_height * panel_width)
+        {
+            target_width = scale_round(src_width, panel_height, src_height);
+            target_height = panel_height;
+        }
+        else
+        {
+            target_width = panel_width;
+            target_height = scale_round(src_height, panel_width, src_width);
+        }
+    }
+
+    /* The power of two step goes as far as it can without going below the target */
+    uint8_t shift = 0;
+    while (shift < FRAME_FIT_MAX_SHIFT && (src_width >> (shift + 1)) >= target_width && (src_height >> (shift + 1)) >= target_height)
+    {
+        shift++;
+    }
+    const int scaled_width = src_width >> shift;
+    const int scaled_height = src_height >> shift;
+
+    /* Whatever still overflows the panel is cut evenly on both sides, the window keeps the panel aspect */
+    plan->shift = shift;
+    plan->fit_width = (target_width < panel_width) ? target_width : panel_width;
+    plan->fit_height = (target_height < panel_height) ? target_height : panel_height;
+    if (target_width == scaled_width && target_height == scaled_height)
+    {
+        plan->out_width = plan->fit_width;
+        plan->out_height = plan->fit_height;
+    }
+    else
+    {
+        plan->out_width = scale_round(plan->fit_width, scaled_width, target_width);
+        plan->out_height = scale_round(plan->fit_height, scaled_height, target_height);
+        plan->out_width = (plan->out_width < scaled_width) ? plan->out_width : scaled_width;
+        plan->out_height = (plan->out_height < scaled_height) ? plan->out_height : scaled_height;
+    }
+    plan->crop_x = (scaled_width - plan->out_width) / 2;
+    plan->crop_y = (scaled_height - plan->out_height) / 2;
+    return ESP_OK;
+}
+
+/* Sums of the R, G and B fields over a (1 << shift) square block */
+static inline void box_sum(const uint16_t *block_start, int src_width, int shift, bool big_endian,
+                           uint32_t *r, uint32_t *g, uint32_t *b)
+{
+    const int block = 1 << shift;
+    const int group_rows = (block * block <= RGB565_SPREAD_MAX) ? block : RGB565_SPREAD_MAX / block;
+
+    *r = *g = *b = 0;
+    for (int by = 0; by < block; by += group_rows)
+    {
+        uint32_t sum = 0;
+        for (int gy = by; gy < by + group_rows; gy++)
+        {
+            const uint16_t *pixel = block_start + gy * src_width;
+            for (int bx = 0; bx < block; bx++)
+            {
+                sum += rgb565_spread(rgb565_load(pixel + bx, big_endian));
+            }
+        }
+        *b += sum & 0x7FF;
+        *r += (sum >> 11) & 0x3FF;
+        *g += sum >> 21;
+    }
+}
+
+static void downscale_box(const uint16_t *src, int src_width, bool big_endian, const frame_fit_plan_t *plan, uint16_t *dst)
+{
+    const int shift = plan->shift;
+    const int out_width = plan->out_width;
+    if (shift == 0)
+    {
+        for (int y = 0; y < plan->out_height; y++)
+        {
+            memcpy(dst + y * out_width, src + (plan->crop_y + y) * src_width + plan->crop_x, out_width * sizeof(uint16_t));
+        }
+        return;
+    }
+
+    const int area_shift = 2 * shift;
+    const uint32_t round = 1 << (area_shift - 1);
+    for (int y = 0; y < plan->out_height; y++)
+    {
+        const uint16_t *row = src + ((plan->crop_y + y) << shift) * src_width + (plan->crop_x << shift);
+        uint16_t *out = dst + y * out_width;
+        for (int x = 0; x < out_width; x++)
+        {
+            uint32_t r, g, b;
+            box_sum(row + (x << shift), src_width, shift, big_endian, &r, &g, &b);
+            r = (r + round) >> area_shift;
+            g = (g + round) >> area_shift;
+            b = (b + round) >> area_shift;
+            rgb565_store(out + x, (uint16_t)((r << 11) | (g << 5) | b), big_endian);
+        }
+    }
+}
+
+/* Window coordinate of the centre of output pixel `i`, 8 fractional bits, clamped to the window */
+static inline int resample_pos(int i, int window, int fit)
+{
+    const int pos = (int)((((int64_t)(2 * i + 1) * window << 8) / fit - (1 << 8)) / 2);
+    return (pos < 0) ? 0 : ((pos > (window - 1) << 8) ? (window - 1) << 8 : pos);
+}
+
+static void downscale_resample(const uint16_t *src, int src_width, bool big_endian, const frame_fit_plan_t *plan, uint16_t *dst)
+{
+    const int shift = plan->shift;
+    /* Box sums carry 2 * shift extra bits, the bilinear weights 16 more */
+    const int norm_shift = 2 * shift + 16;
+    const uint32_t round = 1u << (norm_shift - 1);
+    const uint16_t *window = src + (plan->crop_y << shift) * src_width + (plan->crop_x << shift);
+
+    for (int y = 0; y < plan->fit_height; y++)
+    {
+        const int pos_y = resample_pos(y, plan->out_height, plan->fit_height);
+        const int y0 = pos_y >> 8;
+        const int y1 = (y0 + 1 < plan->out_height) ? y0 + 1 : y0;
+        const uint32_t fy = pos_y & 0xFF;
+        const uint16_t *row0 = window + (y0 << shift) * src_width;
+        const uint16_t *row1 = window + (y1 << shift) * src_width;
+        uint16_t *out = dst + y * plan->fit_width;
+        for (int x = 0; x < plan->fit_width; x++)
+        {
+            const int pos_x = resample_pos(x, plan->out_width, plan->fit_width);
+            const int x0 = pos_x >> 8;
+            const int x1 = (x0 + 1 < plan->out_width) ? x0 + 1 : x0;
+            const uint32_t fx = pos_x & 0xFF;
+            const uint32_t w[4] = {(256 - fx) * (256 - fy), fx * (256 - fy), (256 - fx) * fy, fx * fy};
+            const uint16_t *corner[4] = {row0 + (x0 << shift), row0 + (x1 << shift), row1 + (x0 << shift), row1 + (x1 << shift)};
+            uint32_t r = round, g = round, b = round;
+            for (int k = 0; k < 4; k++)
+            {
+                uint32_t cr, cg, cb;
+                if (w[k] == 0)
+                {
+                    continue;
+                }
+                box_sum(corner[k], src_width, shift, big_endian, &cr, &cg, &cb);
+                r += cr * w[k];
+                g += cg * w[k];
+                b += cb * w[k];
+            }
+            rgb565_store(out + x, (uint16_t)(((r >> norm_shift) << 11) | ((g >> norm_shift) << 5) | (b >> norm_shift)), big_endian);
+        }
+    }
+}
+
+esp_err_t frame_fit_downscale_rgb565(const uint16_t *src, int src_width, int src_height, bool big_endian,
+                                     const frame_fit_plan_t *plan, uint16_t *dst)
+{
+    if (src == NULL || dst == NULL || plan == NULL || plan->shift > FRAME_FIT_MAX_SHIFT ||
+        plan->fit_width == 0 || plan->fit_height == 0 ||
+        plan->fit_width > plan->out_width || plan->fit_height > plan->out_height ||
+        ((plan->crop_x + plan->out_width) << plan->shift) > src_width ||
+        ((plan->crop_y + plan->out_height) << plan->shift) > src_height)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (plan->fit_width == plan->out_width && plan->fit_height == plan->out_height)
+    {
+        downscale_box(src, src_width, big_endian, plan, dst);
+    }
+    else
+    {
+        downscale_resample(src, src_width, big_endian, plan, dst);
+    }
+    return ESP_OK;
+}
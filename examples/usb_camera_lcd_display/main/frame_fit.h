@@ -0,0 +1,85 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define FRAME_FIT_MAX_SHIFT 3   /*!< Largest scaling is 1/8 */
+
+/**
+ * Fit a camera frame to the panel. Most of the scaling is a 1/2, 1/4 or
+ * 1/8 step, which a decoder may do in the DCT domain; what is left is a
+ * ratio between 1/2 and 1 that brings the window to the exact fit, so a
+ * 680x480 frame letterboxes to 320x226 instead of 170x120.
+ * The plan gives the scale, the window of the scaled frame to show and
+ * its final size; frame_fit_downscale_rgb565() produces it from a full
+ * frame with a box filter followed, when the window is larger than the
+ * fit, by a bilinear resample.
+ */
+typedef enum
+{
+    FRAME_FIT_CROP = 0,         /*!< Scale as little as needed to cover the panel, cut the overflow */
+    FRAME_FIT_LETTERBOX,        /*!< Scale until the whole frame fits, leave borders around it */
+} frame_fit_mode_t;
+
+typedef struct
+{
+    uint8_t shift;              /*!< Scaling is 1 / (1 << shift) */
+    uint16_t crop_x;            /*!< Window origin, in scaled pixels */
+    uint16_t crop_y;
+    uint16_t out_width;         /*!< Window size, in scaled pixels */
+    uint16_t out_height;
+    uint16_t fit_width;         /*!< Output size, at most the window size, the window is resampled when smaller */
+    uint16_t fit_height;
+} frame_fit_plan_t;
+
+/**
+ * @brief Work out the scaling and the output window for a frame
+ *
+ * @param src_width frame width
+ * @param src_height frame height
+ * @param panel_width panel width
+ * @param panel_height panel height
+ * @param mode crop or letterbox
+ * @param plan returned plan
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ */
+esp_err_t frame_fit_plan(int src_width, int src_height, int panel_width, int panel_height,
+                         frame_fit_mode_t mode, frame_fit_plan_t *plan);
+
+/**
+ * @brief Produce the planned window of an RGB565 frame
+ *
+ * Each window pixel is the rounded average of a (1 << shift) square block.
+ * When the fit is smaller than the window, each output pixel is a
+ * bilinear blend of the four window pixels around its centre, computed
+ * from the blocks without rounding in between. `dst` may not overlap `src`.
+ *
+ * @param src full resolution frame
+ * @param src_width frame width
+ * @param src_height frame height
+ * @param big_endian pixels are byte swapped, as JPEG_RAW_TYPE_RGB565_BE
+ * @param plan plan from frame_fit_plan, a shift already applied by the decoder must be taken out of it
+ * @param dst output, plan->fit_width * plan->fit_height pixels
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   The plan does not fit in the frame
+ */
+esp_err_t frame_fit_downscale_rgb565(const uint16_t *src, int src_width, int src_height, bool big_endian,
+                                     const frame_fit_plan_t *plan, uint16_t *dst);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,214 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "frame_queue.h"
+
+#define FRAME_QUEUE_ALIGN 16
+
+typedef enum
+{
+    SLOT_FREE = 0,
+    SLOT_WRITING,
+    SLOT_QUEUED,
+    SLOT_READING,
+} slot_state_t;
+
+struct frame_queue_t
+{
+    int depth;
+    uint32_t caps;
+    frame_slot_t *slots;
+    slot_state_t *states;
+    int *fifo;                      /* Queued slot indexes, oldest first */
+    int fifo_head;
+    int fifo_count;
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t ready;        /* Given on every commit */
+    frame_queue_stats_t stats;
+};
+
+esp_err_t frame_queue_create(int depth, size_t slot_capacity, uint32_t caps, frame_queue_handle_t *ret_handle)
+{
+    if (depth < 2 || ret_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct frame_queue_t *queue = calloc(1, sizeof(struct frame_queue_t));
+    if (queue == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    queue->depth = depth;
+    queue->caps = caps;
+    queue->slots = calloc(depth, sizeof(frame_slot_t));
+    queue->states = calloc(depth, sizeof(slot_state_t));
+    queue->fifo = calloc(depth, sizeof(int));
+    queue->lock = xSemaphoreCreateMutex();
+    queue->ready = xSemaphoreCreateBinary();
+    if (queue->slots == NULL || queue->states == NULL || queue->fifo == NULL || queue->lock == NULL || queue->ready == NULL)
+    {
+        frame_queue_delete(queue);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < depth && slot_capacity; i++)
+    {
+        if (frame_queue_reserve(queue, &queue->slots[i], slot_capacity) != ESP_OK)
+        {
+            frame_queue_delete(queue);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    *ret_handle = queue;
+    return ESP_OK;
+}
+
+static inline int slot_index(struct frame_queue_t *queue, frame_slot_t *slot)
+{
+    return slot - queue->slots;
+}
+
+frame_slot_t *frame_queue_acquire_write(frame_queue_handle_t handle)
+{
+    frame_slot_t *slot = NULL;
+
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    for (int i = 0; i < handle->depth; i++)
+    {
+        if (handle->states[i] == SLOT_FREE)
+        {
+            slot = &handle->slots[i];
+            break;
+        }
+    }
+    if (slot == NULL && handle->fifo_count > 0)
+    {
+        /* Drop the oldest queued frame, the consumer is behind */
+        slot = &handle->slots[handle->fifo[handle->fifo_head]];
+        handle->fifo_head = (handle->fifo_head + 1) % handle->depth;
+        handle->fifo_count--;
+        handle->stats.dropped++;
+    }
+    if (slot != NULL)
+    {
+        handle->states[slot_index(handle, slot)] = SLOT_WRITING;
+        slot->len = 0;
+    }
+    else
+    {
+        handle->stats.rejected++;
+    }
+    xSemaphoreGive(handle->lock);
+    return slot;
+}
+
+esp_err_t frame_queue_reserve(frame_queue_handle_t handle, frame_slot_t *slot, size_t size)
+{
+    if (size <= slot->capacity)
+    {
+        return ESP_OK;
+    }
+    heap_caps_free(slot->data);
+    slot->capacity = 0;
+    slot->data = heap_caps_aligned_alloc(FRAME_QUEUE_ALIGN, size, handle->caps);
+    if (slot->data == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    slot->capacity = size;
+    return ESP_OK;
+}
+
+void frame_queue_commit(frame_queue_handle_t handle, frame_slot_t *slot)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    const int index = slot_index(handle, slot);
+    handle->states[index] = SLOT_QUEUED;
+    handle->fifo[(handle->fifo_head + handle->fifo_count) % handle->depth] = index;
+    handle->fifo_count++;
+    handle->stats.pushed++;
+    xSemaphoreGive(handle->lock);
+    xSemaphoreGive(handle->ready);
+}
+
+void frame_queue_cancel(frame_queue_handle_t handle, frame_slot_t *slot)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    handle->states[slot_index(handle, slot)] = SLOT_FREE;
+    xSemaphoreGive(handle->lock);
+}
+
+frame_slot_t *frame_queue_acquire_read(frame_queue_handle_t handle, TickType_t ticks_to_wait)
+{
+    const TickType_t start = xTaskGetTickCount();
+
+    while (1)
+    {
+        xSemaphoreTake(handle->lock, portMAX_DELAY);
+        if (handle->fifo_count > 0)
+        {
+            const int index = handle->fifo[handle->fifo_head];
+            handle->fifo_head = (handle->fifo_head + 1) % handle->depth;
+            handle->fifo_count--;
+            handle->states[index] = SLOT_READING;
+            handle->stats.popped++;
+            xSemaphoreGive(handle->lock);
+            return &handle->slots[index];
+        }
+        xSemaphoreGive(handle->lock);
+
+        /* A commit may have been consumed already, so recheck the FIFO after every wake up */
+        const TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= ticks_to_wait || xSemaphoreTake(handle->ready, ticks_to_wait - elapsed) != pdTRUE)
+        {
+            return NULL;
+        }
+    }
+}
+
+void frame_queue_release(frame_queue_handle_t handle, frame_slot_t *slot)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    handle->states[slot_index(handle, slot)] = SLOT_FREE;
+    xSemaphoreGive(handle->lock);
+}
+
+void frame_queue_get_stats(frame_queue_handle_t handle, frame_queue_stats_t *stats)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    *stats = handle->stats;
+    xSemaphoreGive(handle->lock);
+}
+
+void frame_queue_delete(frame_queue_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return;
+    }
+    for (int i = 0; handle->slots != NULL && i < handle->depth; i++)
+    {
+        heap_caps_free(handle->slots[i].data);
+    }
+    if (handle->lock != NULL)
+    {
+        vSemaphoreDelete(handle->lock);
+    }
+    if (handle->ready != NULL)
+    {
+        vSemaphoreDelete(handle->ready);
+    }
+    free(handle->slots);
+    free(handle->states);
+    free(handle->fifo);
+    free(handle);
+}
@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+/**
+ * A bounded queue of preallocated frame slots between one producer and one
+ * consumer. The producer never waits: when no slot is free it takes back
+ * the oldest queued frame, which is counted as dropped. The consumer gets
+ * frames oldest first and owns a slot until it releases it.
+ */
+typedef struct
+{
+    uint8_t *data;              /*!< Slot buffer */
+    size_t capacity;            /*!< Size of `data` */
+    size_t len;                 /*!< Bytes used */
+    uint16_t width;             /*!< Frame width */
+    uint16_t height;            /*!< Frame height */
+    uint32_t seq;               /*!< Frame sequence number */
+    int64_t timestamp_us;       /*!< Time the frame entered the pipeline */
+} frame_slot_t;
+
+typedef struct
+{
+    uint32_t pushed;            /*!< Frames committed by the producer */
+    uint32_t popped;            /*!< Frames handed to the consumer */
+    uint32_t dropped;           /*!< Queued frames overwritten before the consumer got them */
+    uint32_t rejected;          /*!< Frames the producer could not store at all */
+} frame_queue_stats_t;
+
+typedef struct frame_queue_t *frame_queue_handle_t;
+
+/**
+ * @brief Create a frame queue
+ *
+ * @param depth number of slots, at least 2: one for each side
+ * @param slot_capacity bytes allocated per slot, 0 to allocate with frame_queue_reserve
+ * @param caps heap capabilities of the slot buffers
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t frame_queue_create(int depth, size_t slot_capacity, uint32_t caps, frame_queue_handle_t *ret_handle);
+
+/**
+ * @brief Producer: get a slot to fill, never blocks
+ *
+ * @param handle queue handle
+ * @return slot, or NULL when every slot is owned by the producer or the consumer
+ */
+frame_slot_t *frame_queue_acquire_write(frame_queue_handle_t handle);
+
+/**
+ * @brief Producer: make sure a slot holds at least `size` bytes
+ *
+ * @param handle queue handle
+ * @param slot slot from frame_queue_acquire_write
+ * @param size bytes needed
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_NO_MEM        Out of memory, the slot buffer is then gone
+ */
+esp_err_t frame_queue_reserve(frame_queue_handle_t handle, frame_slot_t *slot, size_t size);
+
+/**
+ * @brief Producer: queue a filled slot and wake the consumer
+ *
+ * @param handle queue handle
+ * @param slot slot from frame_queue_acquire_write
+ */
+void frame_queue_commit(frame_queue_handle_t handle, frame_slot_t *slot);
+
+/**
+ * @brief Producer: give back a slot without queueing it
+ *
+ * @param handle queue handle
+ * @param slot slot from frame_queue_acquire_write
+ */
+void frame_queue_cancel(frame_queue_handle_t handle, frame_slot_t *slot);
+
+/**
+ * @brief Consumer: get the oldest queued frame
+ *
+ * @param handle queue handle
+ * @param ticks_to_wait time to wait for a frame
+ * @return slot, or NULL on timeout
+ */
+frame_slot_t *frame_queue_acquire_read(frame_queue_handle_t handle, TickType_t ticks_to_wait);
+
+/**
+ * @brief Consumer: give a slot back to the producer
+ *
+ * @param handle queue handle
+ * @param slot slot from frame_queue_acquire_read
+ */
+void frame_queue_release(frame_queue_handle_t handle, frame_slot_t *slot);
+
+/**
+ * @brief Get the queue counters
+ *
+ * @param handle queue handle
+ * @param stats returned counters
+ */
+void frame_queue_get_stats(frame_queue_handle_t handle, frame_queue_stats_t *stats);
+
+/**
+ * @brief Delete a frame queue, no slot may be in use
+ *
+ * @param handle queue handle
+ */
+void frame_queue_delete(frame_queue_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,154 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "frame_stats.h"
+
+typedef struct
+{
+    uint32_t duration_us;
+    int64_t end_us;
+} frame_sample_t;
+
+struct frame_stats_t
+{
+    frame_stats_config_t config;
+    frame_sample_t *samples;        /* Ring of the last `window` frames */
+    uint32_t *sorted;               /* Scratch for the percentile, only touched by frame_stats_get */
+    size_t next;
+    uint32_t total;
+    uint32_t drops;
+};
+
+static void stats_lock(frame_stats_handle_t handle)
+{
+    if (handle->config.lock)
+    {
+        handle->config.lock(handle->config.lock_arg);
+    }
+}
+
+static void stats_unlock(frame_stats_handle_t handle)
+{
+    if (handle->config.unlock)
+    {
+        handle->config.unlock(handle->config.lock_arg);
+    }
+}
+
+esp_err_t frame_stats_create(const frame_stats_config_t *config, frame_stats_handle_t *ret_handle)
+{
+    if (config == NULL || config->name == NULL || config->window < 2 || ret_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct frame_stats_t *stats = calloc(1, sizeof(struct frame_stats_t));
+    if (stats == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    stats->config = *config;
+    stats->samples = calloc(config->window, sizeof(frame_sample_t));
+    stats->sorted = calloc(config->window, sizeof(uint32_t));
+    if (stats->samples == NULL || stats->sorted == NULL)
+    {
+        frame_stats_delete(stats);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *ret_handle = stats;
+    return ESP_OK;
+}
+
+void frame_stats_add(frame_stats_handle_t handle, int64_t start_us, int64_t end_us)
+{
+    const int64_t duration = end_us - start_us;
+
+    stats_lock(handle);
+    frame_sample_t *sample = &handle->samples[handle->next];
+    sample->duration_us = (duration < 0) ? 0 : (duration > UINT32_MAX) ? UINT32_MAX : (uint32_t)duration;
+    sample->end_us = end_us;
+    handle->next = (handle->next + 1) % handle->config.window;
+    handle->total++;
+    stats_unlock(handle);
+}
+
+void frame_stats_drop(frame_stats_handle_t handle, uint32_t count)
+{
+    stats_lock(handle);
+    handle->drops += count;
+    stats_unlock(handle);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+void frame_stats_get(frame_stats_handle_t handle, frame_stats_summary_t *summary)
+{
+    memset(summary, 0, sizeof(frame_stats_summary_t));
+
+    stats_lock(handle);
+    const size_t count = (handle->total < handle->config.window) ? handle->total : handle->config.window;
+    const size_t oldest = (handle->next + handle->config.window - count) % handle->config.window;
+    const size_t newest = (handle->next + handle->config.window - 1) % handle->config.window;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint32_t duration = handle->samples[(oldest + i) % handle->config.window].duration_us;
+        handle->sorted[i] = duration;
+        sum += duration;
+    }
+    const int64_t span_us = (count > 1) ? handle->samples[newest].end_us - handle->samples[oldest].end_us : 0;
+    summary->count = count;
+    summary->total = handle->total;
+    summary->drops = handle->drops;
+    stats_unlock(handle);
+
+    /* The window is copied, writers need not wait for the sort */
+    if (count > 0)
+    {
+        qsort(handle->sorted, count, sizeof(uint32_t), compare_u32);
+        summary->min_us = handle->sorted[0];
+        summary->max_us = handle->sorted[count - 1];
+        summary->avg_us = sum / count;
+        summary->p99_us = handle->sorted[(count * 99 + 99) / 100 - 1];
+    }
+    if (span_us > 0)
+    {
+        summary->fps_x10 = (uint32_t)(((uint64_t)(count - 1) * 10000000ULL + span_us / 2) / span_us);
+    }
+}
+
+const char *frame_stats_name(frame_stats_handle_t handle)
+{
+    return handle->config.name;
+}
+
+void frame_stats_reset(frame_stats_handle_t handle)
+{
+    stats_lock(handle);
+    handle->next = 0;
+    handle->total = 0;
+    handle->drops = 0;
+    stats_unlock(handle);
+}
+
+void frame_stats_delete(frame_stats_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return;
+    }
+    free(handle->samples);
+    free(handle->sorted);
+    free(handle);
+}
@@ -0,0 +1,108 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Rolling statistics of one pipeline stage: the durations of the last
+ * `window` frames give min/avg/p99/max, their end times give the rate.
+ */
+typedef struct
+{
+    uint32_t count;             /*!< Samples in the window */
+    uint32_t total;             /*!< Samples since the last reset */
+    uint32_t drops;             /*!< Frames dropped at this stage since the last reset */
+    uint32_t min_us;            /*!< Shortest duration in the window */
+    uint32_t avg_us;            /*!< Average duration in the window */
+    uint32_t p99_us;            /*!< 99th percentile duration in the window */
+    uint32_t max_us;            /*!< Longest duration in the window */
+    uint32_t fps_x10;           /*!< Frames per second over the window, times 10 */
+} frame_stats_summary_t;
+
+typedef struct
+{
+    const char *name;           /*!< Stage name, must stay valid */
+    size_t window;              /*!< Number of frames kept, at least 2 */
+    void (*lock)(void *arg);    /*!< Guards the stage when several tasks use it, can be NULL */
+    void (*unlock)(void *arg);
+    void *lock_arg;
+} frame_stats_config_t;
+
+typedef struct frame_stats_t *frame_stats_handle_t;
+
+/**
+ * @brief Create the statistics of a stage
+ *
+ * @param config stage configuration
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t frame_stats_create(const frame_stats_config_t *config, frame_stats_handle_t *ret_handle);
+
+/**
+ * @brief Add the duration of one frame
+ *
+ * @param handle stage handle
+ * @param start_us time the frame entered the stage
+ * @param end_us time the frame left the stage
+ */
+void frame_stats_add(frame_stats_handle_t handle, int64_t start_us, int64_t end_us);
+
+/**
+ * @brief Count frames dropped at this stage
+ *
+ * @param handle stage handle
+ * @param count frames dropped
+ */
+void frame_stats_drop(frame_stats_handle_t handle, uint32_t count);
+
+/**
+ * @brief Compute the statistics of the current window
+ *
+ * @note The lock is only held to copy the window, the sort runs after it is
+ *       released. Calls on one handle must not overlap, writers may run.
+ *
+ * @param handle stage handle
+ * @param summary returned statistics
+ */
+void frame_stats_get(frame_stats_handle_t handle, frame_stats_summary_t *summary);
+
+/**
+ * @brief Get the stage name
+ *
+ * @param handle stage handle
+ * @return name given to frame_stats_create
+ */
+const char *frame_stats_name(frame_stats_handle_t handle);
+
+/**
+ * @brief Clear the window and the counters
+ *
+ * @param handle stage handle
+ */
+void frame_stats_reset(frame_stats_handle_t handle);
+
+/**
+ * @brief Delete the statistics of a stage
+ *
+ * @param handle stage handle
+ */
+void frame_stats_delete(frame_stats_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,167 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+#include "freertos/semphr.h"
+#include "frame_swap.h"
+
+#define FRAME_SWAP_ALIGN 16
+#define FRAME_SWAP_NONE  (-1)
+
+struct frame_swap_t
+{
+    frame_slot_t slots[2];
+    int on_screen;                  /* Buffer owned by the display */
+    int latest;                     /* Finished buffer not taken yet */
+    bool pinned;                    /* The display keeps `on_screen` */
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t ready;        /* Given on every publish */
+    frame_swap_stats_t stats;
+};
+
+esp_err_t frame_swap_create(size_t buffer_size, uint32_t caps, frame_swap_handle_t *ret_handle)
+{
+    if (buffer_size == 0 || ret_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct frame_swap_t *swap = calloc(1, sizeof(struct frame_swap_t));
+    if (swap == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    swap->on_screen = FRAME_SWAP_NONE;
+    swap->latest = FRAME_SWAP_NONE;
+    swap->lock = xSemaphoreCreateMutex();
+    swap->ready = xSemaphoreCreateBinary();
+    for (int i = 0; i < 2; i++)
+    {
+        swap->slots[i].data = heap_caps_aligned_alloc(FRAME_SWAP_ALIGN, buffer_size, caps);
+        swap->slots[i].capacity = buffer_size;
+    }
+    if (swap->lock == NULL || swap->ready == NULL || swap->slots[0].data == NULL || swap->slots[1].data == NULL)
+    {
+        frame_swap_delete(swap);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *ret_handle = swap;
+    return ESP_OK;
+}
+
+frame_slot_t *frame_swap_begin_write(frame_swap_handle_t handle)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    int index = (handle->on_screen == FRAME_SWAP_NONE) ? (handle->latest == 0) : !handle->on_screen;
+    if (index == handle->latest)
+    {
+        /* The display is behind, the newer frame replaces this one */
+        handle->latest = FRAME_SWAP_NONE;
+        handle->stats.dropped++;
+    }
+    handle->slots[index].len = 0;
+    xSemaphoreGive(handle->lock);
+    return &handle->slots[index];
+}
+
+void frame_swap_publish(frame_swap_handle_t handle, frame_slot_t *slot)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    if (handle->latest != FRAME_SWAP_NONE)
+    {
+        /* Only before the first frame is shown, both buffers are then free */
+        handle->stats.dropped++;
+    }
+    handle->latest = slot - handle->slots;
+    handle->stats.published++;
+    xSemaphoreGive(handle->lock);
+    xSemaphoreGive(handle->ready);
+}
+
+void frame_swap_abort(frame_swap_handle_t handle, frame_slot_t *slot)
+{
+    /* Nothing to undo, a buffer that was not published is never shown */
+    slot->len = 0;
+}
+
+bool frame_swap_wait(frame_swap_handle_t handle, TickType_t ticks_to_wait)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    const bool pending = handle->latest != FRAME_SWAP_NONE && !handle->pinned;
+    xSemaphoreGive(handle->lock);
+    return pending || xSemaphoreTake(handle->ready, ticks_to_wait) == pdTRUE;
+}
+
+frame_slot_t *frame_swap_acquire_latest(frame_swap_handle_t handle)
+{
+    frame_slot_t *slot = NULL;
+
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    if (handle->latest != FRAME_SWAP_NONE && !handle->pinned)
+    {
+        handle->on_screen = handle->latest;
+        handle->latest = FRAME_SWAP_NONE;
+        handle->stats.displayed++;
+        slot = &handle->slots[handle->on_screen];
+    }
+    xSemaphoreGive(handle->lock);
+    return slot;
+}
+
+frame_slot_t *frame_swap_pin(frame_swap_handle_t handle)
+{
+    frame_slot_t *slot = NULL;
+
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    if (handle->on_screen != FRAME_SWAP_NONE)
+    {
+        handle->pinned = true;
+        slot = &handle->slots[handle->on_screen];
+    }
+    xSemaphoreGive(handle->lock);
+    return slot;
+}
+
+void frame_swap_unpin(frame_swap_handle_t handle)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    handle->pinned = false;
+    const bool pending = handle->latest != FRAME_SWAP_NONE;
+    xSemaphoreGive(handle->lock);
+    if (pending)
+    {
+        /* The display may have gone back to waiting while the frame was pinned */
+        xSemaphoreGive(handle->ready);
+    }
+}
+
+void frame_swap_get_stats(frame_swap_handle_t handle, frame_swap_stats_t *stats)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    *stats = handle->stats;
+    xSemaphoreGive(handle->lock);
+}
+
+void frame_swap_delete(frame_swap_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return;
+    }
+    heap_caps_free(handle->slots[0].data);
+    heap_caps_free(handle->slots[1].data);
+    if (handle->lock != NULL)
+    {
+        vSemaphoreDelete(handle->lock);
+    }
+    if (handle->ready != NULL)
+    {
+        vSemaphoreDelete(handle->ready);
+    }
+    free(handle);
+}
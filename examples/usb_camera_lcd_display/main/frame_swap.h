@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "frame_queue.h"
+
+/**
+ * Two preallocated frame buffers between a writer and the display. The
+ * writer always gets the buffer that is not on screen, so it never waits
+ * and never draws over a frame being shown. If that buffer holds a
+ * finished frame the display has not taken yet, the frame is dropped in
+ * favour of the newer one. The display only ever takes the latest
+ * finished frame. A reader such as a snapshot can pin the frame on screen
+ * to read it without a copy, the display keeps showing it until unpinned.
+ */
+typedef struct
+{
+    uint32_t published;         /*!< Frames finished by the writer */
+    uint32_t displayed;         /*!< Frames taken by the display */
+    uint32_t dropped;           /*!< Finished frames overwritten before the display took them */
+} frame_swap_stats_t;
+
+typedef struct frame_swap_t *frame_swap_handle_t;
+
+/**
+ * @brief Create the buffer pair
+ *
+ * @param buffer_size bytes per buffer, the largest frame to show
+ * @param caps heap capabilities of the buffers
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t frame_swap_create(size_t buffer_size, uint32_t caps, frame_swap_handle_t *ret_handle);
+
+/**
+ * @brief Writer: get the buffer that is not on screen, never blocks
+ *
+ * @param handle buffer pair handle
+ * @return buffer to fill
+ */
+frame_slot_t *frame_swap_begin_write(frame_swap_handle_t handle);
+
+/**
+ * @brief Writer: make the filled buffer the latest frame
+ *
+ * @param handle buffer pair handle
+ * @param slot buffer from frame_swap_begin_write
+ */
+void frame_swap_publish(frame_swap_handle_t handle, frame_slot_t *slot);
+
+/**
+ * @brief Writer: give back a buffer without publishing it
+ *
+ * @param handle buffer pair handle
+ * @param slot buffer from frame_swap_begin_write
+ */
+void frame_swap_abort(frame_swap_handle_t handle, frame_slot_t *slot);
+
+/**
+ * @brief Display: wait for a frame to be published
+ *
+ * @param handle buffer pair handle
+ * @param ticks_to_wait time to wait
+ * @return true if a frame may be ready, frame_swap_acquire_latest tells for sure
+ */
+bool frame_swap_wait(frame_swap_handle_t handle, TickType_t ticks_to_wait);
+
+/**
+ * @brief Display: take the latest frame, never blocks
+ *
+ * The returned buffer is on screen from now on and the previous one goes
+ * back to the writer, so call it while the display can not read the
+ * previous buffer, e.g. with the display lock held.
+ *
+ * @param handle buffer pair handle
+ * @return latest frame, or NULL when nothing new was published
+ */
+frame_slot_t *frame_swap_acquire_latest(frame_swap_handle_t handle);
+
+/**
+ * @brief Reader: keep the frame on screen until frame_swap_unpin
+ *
+ * While pinned frame_swap_acquire_latest returns NULL, the writer goes on
+ * filling the other buffer and newer frames replace each other there.
+ *
+ * @param handle buffer pair handle
+ * @return frame on screen, or NULL when none was shown yet, then nothing is pinned
+ */
+frame_slot_t *frame_swap_pin(frame_swap_handle_t handle);
+
+/**
+ * @brief Reader: let the display take newer frames again
+ *
+ * @param handle buffer pair handle
+ */
+void frame_swap_unpin(frame_swap_handle_t handle);
+
+/**
+ * @brief Get the buffer pair counters
+ *
+ * @param handle buffer pair handle
+ * @param stats returned counters
+ */
+void frame_swap_get_stats(frame_swap_handle_t handle, frame_swap_stats_t *stats);
+
+/**
+ * @brief Free the buffer pair
+ *
+ * @param handle buffer pair handle
+ */
+void frame_swap_delete(frame_swap_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,89 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_jpeg_dec.h"
+
+/**
+ * A JPEG decoder behind a jpeg_session. A decoder is opened for one output
+ * format, then fed frames in two steps: the headers are parsed first, so
+ * the session can size the output buffer, then the frame is decoded into
+ * it. The session reopens the decoder when the image size changes.
+ * Decoders allocate with audio_calloc and audio_free like the esp_jpeg
+ * codec does, so the session sees their allocations in the audio_mem
+ * counters.
+ */
+typedef struct
+{
+    jpeg_raw_type_t output_type;    /*!< JPEG_RAW_TYPE_RGB565_LE, JPEG_RAW_TYPE_RGB565_BE or JPEG_RAW_TYPE_RGB888 */
+    jpeg_rotate_t rotate;           /*!< Clockwise rotation */
+    uint8_t scale_shift;            /*!< Output is 1 / (1 << scale_shift) of the image, up to max_scale_shift */
+} jpeg_backend_config_t;
+
+typedef struct
+{
+    int width;                      /*!< Width of the image */
+    int height;                     /*!< Height of the image */
+    int out_width;                  /*!< Width of the output, scaled, before rotation */
+    int out_height;                 /*!< Height of the output, scaled, before rotation */
+} jpeg_backend_info_t;
+
+typedef struct
+{
+    const char *name;
+    uint8_t max_scale_shift;        /*!< Largest scaling done while decoding, 0 when the decoder can not scale */
+
+    /**
+     * Open a decoder
+     * ESP_OK, ESP_ERR_NO_MEM, or ESP_ERR_NOT_SUPPORTED for the configuration
+     */
+    esp_err_t (*open)(const jpeg_backend_config_t *config, void **ret_decoder);
+
+    /**
+     * Parse the headers of a frame, `data` must stay valid until decode
+     * ESP_OK, ESP_FAIL for a corrupted frame, or ESP_ERR_NOT_SUPPORTED
+     */
+    esp_err_t (*parse)(void *decoder, const uint8_t *data, size_t len, jpeg_backend_info_t *info);
+
+    /**
+     * Decode the frame last parsed into a 16 byte aligned buffer sized from its info
+     * ESP_OK or ESP_FAIL for a corrupted frame
+     */
+    esp_err_t (*decode)(void *decoder, uint8_t *out_buf);
+
+    /**
+     * Bytes of memory held by the decoder, may be NULL when unknown
+     */
+    size_t (*get_memory)(void *decoder);
+
+    void (*close)(void *decoder);
+} jpeg_backend_t;
+
+/**
+ * The esp_jpeg library, optimized for the target, without scaling
+ */
+extern const jpeg_backend_t jpeg_backend_esp;
+
+/**
+ * A portable baseline decoder in plain C, slower than esp_jpeg but also
+ * built on a host, with scaling by 1/2, 1/4 and 1/8 while decoding and
+ * rotation at any size. It handles Huffman coded baseline frames in
+ * grayscale or YCbCr with 1x1 or 2x2 sampling in each direction, and the
+ * frames without Huffman tables UVC cameras send. RGB888 is written R, G, B.
+ */
+extern const jpeg_backend_t jpeg_backend_soft;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,88 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include "audio_malloc.h"
+#include "jpeg_backend.h"
+
+typedef struct
+{
+    jpeg_dec_handle_t *dec;
+    jpeg_dec_io_t io;
+    jpeg_dec_header_info_t header;
+} esp_decoder_t;
+
+static void esp_decoder_close(void *decoder)
+{
+    esp_decoder_t *esp = decoder;
+    if (esp->dec != NULL)
+    {
+        jpeg_dec_close(esp->dec);
+    }
+    audio_free(esp);
+}
+
+static esp_err_t esp_decoder_open(const jpeg_backend_config_t *config, void **ret_decoder)
+{
+    if (config->scale_shift != 0)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    esp_decoder_t *esp = audio_calloc(1, sizeof(esp_decoder_t));
+    if (esp == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    jpeg_dec_config_t dec_config = DEFAULT_JPEG_DEC_CONFIG();
+    dec_config.output_type = config->output_type;
+    dec_config.rotate = config->rotate;
+    esp->dec = jpeg_dec_open(&dec_config);
+    if (esp->dec == NULL)
+    {
+        esp_decoder_close(esp);
+        return ESP_ERR_NO_MEM;
+    }
+    *ret_decoder = esp;
+    return ESP_OK;
+}
+
+static esp_err_t esp_decoder_parse(void *decoder, const uint8_t *data, size_t len, jpeg_backend_info_t *info)
+{
+    esp_decoder_t *esp = decoder;
+    esp->io.inbuf = (unsigned char *)data;
+    esp->io.inbuf_len = len;
+    esp->io.inbuf_remain = 0;
+    if (jpeg_dec_parse_header(esp->dec, &esp->io, &esp->header) < 0)
+    {
+        return ESP_FAIL;
+    }
+    info->width = esp->header.width;
+    info->height = esp->header.height;
+    info->out_width = esp->header.width;
+    info->out_height = esp->header.height;
+    return ESP_OK;
+}
+
+static esp_err_t esp_decoder_decode(void *decoder, uint8_t *out_buf)
+{
+    esp_decoder_t *esp = decoder;
+    const int consumed = esp->io.inbuf_len - esp->io.inbuf_remain;
+    esp->io.inbuf += consumed;
+    esp->io.inbuf_len = esp->io.inbuf_remain;
+    esp->io.outbuf = out_buf;
+    return (jpeg_dec_process(esp->dec, &esp->io) < 0) ? ESP_FAIL : ESP_OK;
+}
+
+const jpeg_backend_t jpeg_backend_esp = {
+    .name = "esp_jpeg",
+    .max_scale_shift = 0,           // jpeg_dec_config_t has no scaled output, frame_fit does all the scaling after the decode
+    .open = esp_decoder_open,
+    .parse = esp_decoder_parse,
+    .decode = esp_decoder_decode,
+    .get_memory = NULL,
+    .close = esp_decoder_close,
+};
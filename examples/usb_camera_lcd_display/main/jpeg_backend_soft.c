@@ -0,0 +1,876 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio_malloc.h"
+#include "jpeg_backend.h"
+
+#define SOFT_MAX_COMPONENTS 3
+#define SOFT_MAX_SAMPLING   2       /* Blocks per MCU of a component, each way */
+#define SOFT_FAST_BITS      9       /* Huffman codes up to this length are decoded with one lookup */
+#define SOFT_MAX_SCALE      3
+#define SOFT_COEF_LIMIT     16383   /* Far beyond valid data, keeps corrupted frames from overflowing the IDCT */
+
+typedef struct
+{
+    uint16_t fast[1 << SOFT_FAST_BITS]; /* Length << 8 | symbol, 0 for longer codes */
+    int32_t maxcode[17];                /* Largest code of each length, -1 if none */
+    uint16_t mincode[17];
+    uint8_t valptr[17];                 /* Index in `symbols` of the first code of each length */
+    uint8_t symbols[256];
+} soft_huffman_t;
+
+typedef struct
+{
+    uint8_t id;
+    uint8_t h;                          /* Blocks per MCU horizontally */
+    uint8_t v;                          /* Blocks per MCU vertically */
+    uint8_t tq;                         /* Quantization table */
+    uint8_t td;                         /* DC Huffman table */
+    uint8_t ta;                         /* AC Huffman table */
+    uint8_t hshift;                     /* Samples are 1 << shift pixels wide */
+    uint8_t vshift;
+    int dc_pred;
+} soft_component_t;
+
+typedef struct
+{
+    jpeg_backend_config_t config;
+    int width;
+    int height;
+    int out_width;
+    int out_height;
+    uint8_t ncomp;
+    soft_component_t comp[SOFT_MAX_COMPONENTS];
+    uint8_t hmax;
+    uint8_t vmax;
+    uint16_t restart_interval;
+    uint8_t qt_defined;                 /* Bit per quantization table */
+    uint8_t huffman_custom;             /* Bit per table holding a DHT instead of the standard table */
+    uint16_t qt[4][64];                 /* Zigzag order */
+    soft_huffman_t dc[4];
+    soft_huffman_t ac[4];
+
+    /* Entropy coded data of the frame last parsed */
+    const uint8_t *scan;
+    const uint8_t *scan_end;
+    const uint8_t *pos;
+    uint32_t acc;                       /* Bits not consumed yet, MSB first */
+    int count;
+    bool marker;                        /* A marker was reached, zeros are fed from there */
+
+    /* Samples of one MCU, scaled, per component */
+    uint8_t planes[SOFT_MAX_COMPONENTS][SOFT_MAX_SAMPLING * SOFT_MAX_SAMPLING * 64];
+} soft_decoder_t;
+
+/* Natural order of the zigzag index */
+static const uint8_t s_dezigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+/* Standard tables of ITU T.81 annex K.3, MJPEG frames from UVC cameras omit their DHT */
+static const uint8_t s_dc_luma_bits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t s_dc_chroma_bits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t s_dc_symbols[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t s_ac_luma_bits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t s_ac_luma_symbols[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+static const uint8_t s_ac_chroma_bits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t s_ac_chroma_symbols[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+static inline uint8_t clamp_u8(int v)
+{
+    return (v < 0) ? 0 : (v > 255) ? 255 : v;
+}
+
+static inline int clamp_coef(int v)
+{
+    return (v < -SOFT_COEF_LIMIT) ? -SOFT_COEF_LIMIT : (v > SOFT_COEF_LIMIT) ? SOFT_COEF_LIMIT : v;
+}
+
+static inline uint16_t read_be16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static esp_err_t huffman_build(soft_huffman_t *huff, const uint8_t bits[16], const uint8_t *symbols)
+{
+    int total = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        total += bits[i];
+    }
+    if (total > 256)
+    {
+        return ESP_FAIL;
+    }
+    memcpy(huff->symbols, symbols, total);
+    memset(huff->fast, 0, sizeof(huff->fast));
+
+    uint32_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++)
+    {
+        huff->valptr[len] = k;
+        huff->mincode[len] = code;
+        if (code + bits[len - 1] > (1U << len))
+        {
+            /* More codes than the length allows */
+            return ESP_FAIL;
+        }
+        for (int i = 0; i < bits[len - 1]; i++, k++, code++)
+        {
+            if (len <= SOFT_FAST_BITS)
+            {
+                /* Every lookup starting with this code */
+                const int fill = 1 << (SOFT_FAST_BITS - len);
+                for (int j = 0; j < fill; j++)
+                {
+                    huff->fast[(code << (SOFT_FAST_BITS - len)) + j] = (len << 8) | huff->symbols[k];
+                }
+            }
+        }
+        huff->maxcode[len] = bits[len - 1] ? (int32_t)code - 1 : -1;
+        code <<= 1;
+    }
+    return ESP_OK;
+}
+
+static void huffman_defaults(soft_decoder_t *soft)
+{
+    huffman_build(&soft->dc[0], s_dc_luma_bits, s_dc_symbols);
+    huffman_build(&soft->dc[1], s_dc_chroma_bits, s_dc_symbols);
+    huffman_build(&soft->ac[0], s_ac_luma_bits, s_ac_luma_symbols);
+    huffman_build(&soft->ac[1], s_ac_chroma_bits, s_ac_chroma_symbols);
+    soft->huffman_custom = 0;
+}
+
+static void bits_reset(soft_decoder_t *soft, const uint8_t *pos)
+{
+    soft->pos = pos;
+    soft->acc = 0;
+    soft->count = 0;
+    soft->marker = false;
+}
+
+static void bits_fill(soft_decoder_t *soft)
+{
+    while (soft->count <= 24)
+    {
+        uint32_t byte = 0;
+        if (!soft->marker && soft->pos < soft->scan_end)
+        {
+            byte = *soft->pos;
+            if (byte == 0xFF)
+            {
+                const uint8_t next = (soft->pos + 1 < soft->scan_end) ? soft->pos[1] : 0xD9;
+                if (next == 0x00)
+                {
+                    soft->pos += 2;
+                }
+                else
+                {
+                    /* Stay on the marker, the rest of the scan reads zeros */
+                    soft->marker = true;
+                    byte = 0;
+                }
+            }
+            else
+            {
+                soft->pos++;
+            }
+        }
+        soft->acc |= byte << (24 - soft->count);
+        soft->count += 8;
+    }
+}
+
+static inline int bits_get(soft_decoder_t *soft, int n)
+{
+    const int value = soft->acc >> (32 - n);
+    soft->acc <<= n;
+    soft->count -= n;
+    return value;
+}
+
+/* A coefficient of `n` bits, the negative values have a leading 0 */
+static inline int bits_extend(soft_decoder_t *soft, int n)
+{
+    if (n == 0)
+    {
+        return 0;
+    }
+    bits_fill(soft);
+    const int value = bits_get(soft, n);
+    return (value < (1 << (n - 1))) ? value - (1 << n) + 1 : value;
+}
+
+static int huffman_decode(soft_decoder_t *soft, const soft_huffman_t *huff)
+{
+    bits_fill(soft);
+    const uint16_t fast = huff->fast[soft->acc >> (32 - SOFT_FAST_BITS)];
+    if (fast != 0)
+    {
+        bits_get(soft, fast >> 8);
+        return fast & 0xFF;
+    }
+    for (int len = SOFT_FAST_BITS + 1; len <= 16; len++)
+    {
+        const int32_t code = soft->acc >> (32 - len);
+        if (code <= huff->maxcode[len])
+        {
+            bits_get(soft, len);
+            return huff->symbols[huff->valptr[len] + code - huff->mincode[len]];
+        }
+    }
+    return -1;
+}
+
+#define F2F(x)  ((int)((x) * 4096 + 0.5))
+
+/* Integer IDCT of jidctint, the even and odd halves of one row or column */
+#define IDCT_1D(s0, s1, s2, s3, s4, s5, s6, s7)                         \
+    int t0, t1, t2, t3, p1, p2, p3, p4, p5, x0, x1, x2, x3;              \
+    p2 = s2;                                                             \
+    p3 = s6;                                                             \
+    p1 = (p2 + p3) * F2F(0.5411961f);                                    \
+    t2 = p1 + p3 * F2F(-1.847759065f);                                   \
+    t3 = p1 + p2 * F2F(0.765366865f);                                    \
+    t0 = (s0 + s4) * 4096;                                               \
+    t1 = (s0 - s4) * 4096;                                               \
+    x0 = t0 + t3;                                                        \
+    x3 = t0 - t3;                                                        \
+    x1 = t1 + t2;                                                        \
+    x2 = t1 - t2;                                                        \
+    t0 = s7;                                                             \
+    t1 = s5;                                                             \
+    t2 = s3;                                                             \
+    t3 = s1;                                                             \
+    p3 = t0 + t2;                                                        \
+    p4 = t1 + t3;                                                        \
+    p1 = t0 + t3;                                                        \
+    p2 = t1 + t2;                                                        \
+    p5 = (p3 + p4) * F2F(1.175875602f);                                  \
+    t0 = t0 * F2F(0.298631336f);                                         \
+    t1 = t1 * F2F(2.053119869f);                                         \
+    t2 = t2 * F2F(3.072711026f);                                         \
+    t3 = t3 * F2F(1.501321110f);                                         \
+    p1 = p5 + p1 * F2F(-0.899976223f);                                   \
+    p2 = p5 + p2 * F2F(-2.562915447f);                                   \
+    p3 = p3 * F2F(-1.961570560f);                                        \
+    p4 = p4 * F2F(-0.390180644f);                                        \
+    t3 += p1 + p4;                                                       \
+    t2 += p2 + p3;                                                       \
+    t1 += p2 + p4;                                                       \
+    t0 += p1 + p3;
+
+static void idct_block(const int *in, uint8_t *out, int stride)
+{
+    int tmp[64];
+    for (int i = 0; i < 8; i++)
+    {
+        const int *d = in + i;
+        int *v = tmp + i;
+        if (d[8] == 0 && d[16] == 0 && d[24] == 0 && d[32] == 0 && d[40] == 0 && d[48] == 0 && d[56] == 0)
+        {
+            const int dc = clamp_coef(d[0] * 4);
+            for (int j = 0; j < 8; j++)
+            {
+                v[j * 8] = dc;
+            }
+            continue;
+        }
+        IDCT_1D(d[0], d[8], d[16], d[24], d[32], d[40], d[48], d[56]);
+        /* Columns keep 2 more bits than the input */
+        x0 += 512;
+        x1 += 512;
+        x2 += 512;
+        x3 += 512;
+        v[0] = clamp_coef((x0 + t3) >> 10);
+        v[56] = clamp_coef((x0 - t3) >> 10);
+        v[8] = clamp_coef((x1 + t2) >> 10);
+        v[48] = clamp_coef((x1 - t2) >> 10);
+        v[16] = clamp_coef((x2 + t1) >> 10);
+        v[40] = clamp_coef((x2 - t1) >> 10);
+        v[24] = clamp_coef((x3 + t0) >> 10);
+        v[32] = clamp_coef((x3 - t0) >> 10);
+    }
+    for (int i = 0; i < 8; i++, out += stride)
+    {
+        const int *v = tmp + i * 8;
+        IDCT_1D(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+        /* Rounding and the level shift of 128 at once */
+        x0 += 65536 + (128 << 17);
+        x1 += 65536 + (128 << 17);
+        x2 += 65536 + (128 << 17);
+        x3 += 65536 + (128 << 17);
+        out[0] = clamp_u8((x0 + t3) >> 17);
+        out[7] = clamp_u8((x0 - t3) >> 17);
+        out[1] = clamp_u8((x1 + t2) >> 17);
+        out[6] = clamp_u8((x1 - t2) >> 17);
+        out[2] = clamp_u8((x2 + t1) >> 17);
+        out[5] = clamp_u8((x2 - t1) >> 17);
+        out[3] = clamp_u8((x3 + t0) >> 17);
+        out[4] = clamp_u8((x3 - t0) >> 17);
+    }
+}
+
+/* Decode one block into `out`, 8 >> scale_shift samples each way */
+static esp_err_t decode_block(soft_decoder_t *soft, soft_component_t *comp, uint8_t *out, int stride)
+{
+    const uint16_t *qt = soft->qt[comp->tq];
+    const uint8_t shift = soft->config.scale_shift;
+    int coef[64];
+    bool ac = false;
+
+    const int t = huffman_decode(soft, &soft->dc[comp->td]);
+    if (t < 0 || t > 11)
+    {
+        return ESP_FAIL;
+    }
+    comp->dc_pred = clamp_coef(comp->dc_pred + bits_extend(soft, t));
+    if (shift < SOFT_MAX_SCALE)
+    {
+        memset(coef, 0, sizeof(coef));
+    }
+    coef[0] = clamp_coef(comp->dc_pred * qt[0]);
+
+    for (int k = 1; k < 64;)
+    {
+        const int rs = huffman_decode(soft, &soft->ac[comp->ta]);
+        if (rs < 0)
+        {
+            return ESP_FAIL;
+        }
+        const int run = rs >> 4;
+        const int size = rs & 0x0F;
+        if (size == 0)
+        {
+            if (run != 15)
+            {
+                break;
+            }
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63)
+        {
+            return ESP_FAIL;
+        }
+        const int value = bits_extend(soft, size);
+        if (shift < SOFT_MAX_SCALE)
+        {
+            /* The coefficients are still decoded at 1/8, only the DC is used */
+            coef[s_dezigzag[k]] = clamp_coef(value * qt[k]);
+            ac = true;
+        }
+        k++;
+    }
+
+    const int n = 8 >> shift;
+    if (!ac)
+    {
+        /* Flat block, most of them at low quality */
+        const uint8_t value = clamp_u8(((coef[0] + 4) >> 3) + 128);
+        for (int y = 0; y < n; y++)
+        {
+            memset(out + y * stride, value, n);
+        }
+        return ESP_OK;
+    }
+    if (shift == 0)
+    {
+        idct_block(coef, out, stride);
+        return ESP_OK;
+    }
+    uint8_t full[64];
+    idct_block(coef, full, 8);
+    const int area = 1 << (2 * shift);
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            int sum = area / 2;
+            for (int j = 0; j < (1 << shift); j++)
+            {
+                for (int i = 0; i < (1 << shift); i++)
+                {
+                    sum += full[((y << shift) + j) * 8 + (x << shift) + i];
+                }
+            }
+            out[y * stride + x] = sum >> (2 * shift);
+        }
+    }
+    return ESP_OK;
+}
+
+/* Convert the pixels of one MCU and write them at their rotated place */
+static void emit_mcu(soft_decoder_t *soft, uint8_t *out_buf, int px0, int py0)
+{
+    const int n = 8 >> soft->config.scale_shift;
+    const int mcu_w = soft->hmax * n;
+    const int mcu_h = soft->vmax * n;
+    const int cols = (soft->out_width - px0 < mcu_w) ? soft->out_width - px0 : mcu_w;
+    const int rows = (soft->out_height - py0 < mcu_h) ? soft->out_height - py0 : mcu_h;
+    const int bpp = (soft->config.output_type == JPEG_RAW_TYPE_RGB888) ? 3 : 2;
+    const int w = soft->out_width;
+    const int h = soft->out_height;
+    const soft_component_t *c = soft->comp;
+    const int stride0 = c[0].h * n;
+    const int stride1 = c[1].h * n;
+    const int stride2 = c[2].h * n;
+
+    for (int y = 0; y < rows; y++)
+    {
+        const int py = py0 + y;
+        int dx, dy, step;
+        switch (soft->config.rotate)
+        {
+        case JPEG_ROTATE_90D:
+            dx = h - 1 - py;
+            dy = px0;
+            step = h * bpp;
+            break;
+        case JPEG_ROTATE_180D:
+            dx = w - 1 - px0;
+            dy = h - 1 - py;
+            step = -bpp;
+            break;
+        case JPEG_ROTATE_270D:
+            dx = py;
+            dy = w - 1 - px0;
+            step = -h * bpp;
+            break;
+        default:
+            dx = px0;
+            dy = py;
+            step = bpp;
+            break;
+        }
+        const bool swapped = soft->config.rotate == JPEG_ROTATE_90D || soft->config.rotate == JPEG_ROTATE_270D;
+        uint8_t *dst = out_buf + ((size_t)dy * (swapped ? h : w) + dx) * bpp;
+
+        const uint8_t *row0 = soft->planes[0] + (y >> c[0].vshift) * stride0;
+        const uint8_t *row1 = soft->planes[1] + (y >> c[1].vshift) * stride1;
+        const uint8_t *row2 = soft->planes[2] + (y >> c[2].vshift) * stride2;
+        for (int x = 0; x < cols; x++, dst += step)
+        {
+            const int luma = row0[x >> c[0].hshift];
+            int r = luma, g = luma, b = luma;
+            if (soft->ncomp == 3)
+            {
+                /* BT.601 full range, 16 bit fixed point */
+                const int cb = row1[x >> c[1].hshift] - 128;
+                const int cr = row2[x >> c[2].hshift] - 128;
+                r = clamp_u8(luma + ((91881 * cr + 32768) >> 16));
+                g = clamp_u8(luma - ((22554 * cb + 46802 * cr - 32768) >> 16));
+                b = clamp_u8(luma + ((116130 * cb + 32768) >> 16));
+            }
+            if (bpp == 3)
+            {
+                dst[0] = r;
+                dst[1] = g;
+                dst[2] = b;
+                continue;
+            }
+            const uint16_t rgb565 = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+            if (soft->config.output_type == JPEG_RAW_TYPE_RGB565_BE)
+            {
+                dst[0] = rgb565 >> 8;
+                dst[1] = rgb565 & 0xFF;
+            }
+            else
+            {
+                dst[0] = rgb565 & 0xFF;
+                dst[1] = rgb565 >> 8;
+            }
+        }
+    }
+}
+
+static esp_err_t parse_sof(soft_decoder_t *soft, const uint8_t *p, int len)
+{
+    if (len < 6)
+    {
+        return ESP_FAIL;
+    }
+    if (p[0] != 8)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    soft->height = read_be16(p + 1);
+    soft->width = read_be16(p + 3);
+    soft->ncomp = p[5];
+    if (soft->width == 0 || soft->height == 0 || (soft->ncomp != 1 && soft->ncomp != 3))
+    {
+        /* No height in the frame header needs a DNL marker */
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (len < 6 + soft->ncomp * 3)
+    {
+        return ESP_FAIL;
+    }
+    soft->hmax = 1;
+    soft->vmax = 1;
+    for (int i = 0; i < soft->ncomp; i++)
+    {
+        soft_component_t *comp = &soft->comp[i];
+        comp->id = p[6 + i * 3];
+        comp->h = p[7 + i * 3] >> 4;
+        comp->v = p[7 + i * 3] & 0x0F;
+        comp->tq = p[8 + i * 3];
+        if (comp->h < 1 || comp->h > SOFT_MAX_SAMPLING || comp->v < 1 || comp->v > SOFT_MAX_SAMPLING || comp->tq > 3)
+        {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        soft->hmax = (comp->h > soft->hmax) ? comp->h : soft->hmax;
+        soft->vmax = (comp->v > soft->vmax) ? comp->v : soft->vmax;
+    }
+    if (soft->ncomp == 1)
+    {
+        /* A single component scan has one block per MCU whatever the sampling */
+        soft->comp[0].h = soft->comp[0].v = 1;
+        soft->hmax = soft->vmax = 1;
+    }
+    for (int i = 0; i < SOFT_MAX_COMPONENTS; i++)
+    {
+        soft_component_t *comp = &soft->comp[i];
+        if (i >= soft->ncomp)
+        {
+            /* Unused, read like the luma so emit_mcu needs no test */
+            *comp = soft->comp[0];
+        }
+        comp->hshift = (comp->h < soft->hmax) ? 1 : 0;
+        comp->vshift = (comp->v < soft->vmax) ? 1 : 0;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_sos(soft_decoder_t *soft, const uint8_t *p, int len)
+{
+    if (soft->ncomp == 0 || len < 1 || len < 1 + p[0] * 2 + 3)
+    {
+        return ESP_FAIL;
+    }
+    if (p[0] != soft->ncomp)
+    {
+        /* Non interleaved scans, one per component */
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    for (int i = 0; i < p[0]; i++)
+    {
+        int j = 0;
+        while (j < soft->ncomp && soft->comp[j].id != p[1 + i * 2])
+        {
+            j++;
+        }
+        if (j == soft->ncomp)
+        {
+            return ESP_FAIL;
+        }
+        soft->comp[j].td = p[2 + i * 2] >> 4;
+        soft->comp[j].ta = p[2 + i * 2] & 0x0F;
+        if (soft->comp[j].td > 3 || soft->comp[j].ta > 3 || !(soft->qt_defined & (1 << soft->comp[j].tq)))
+        {
+            return ESP_FAIL;
+        }
+        if ((soft->comp[j].td > 1 && !(soft->huffman_custom & (1 << soft->comp[j].td))) ||
+            (soft->comp[j].ta > 1 && !(soft->huffman_custom & (0x10 << soft->comp[j].ta))))
+        {
+            /* Only tables 0 and 1 have a standard default */
+            return ESP_FAIL;
+        }
+    }
+    const uint8_t *spectral = p + 1 + p[0] * 2;
+    if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_dht(soft_decoder_t *soft, const uint8_t *p, int len)
+{
+    while (len > 17)
+    {
+        const int tc = p[0] >> 4;
+        const int th = p[0] & 0x0F;
+        int total = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            total += p[1 + i];
+        }
+        if (tc > 1 || th > 3 || total > 256 || len < 17 + total)
+        {
+            return ESP_FAIL;
+        }
+        soft_huffman_t *huff = tc ? &soft->ac[th] : &soft->dc[th];
+        if (huffman_build(huff, p + 1, p + 17) != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+        soft->huffman_custom |= (tc ? 0x10 : 0x01) << th;
+        p += 17 + total;
+        len -= 17 + total;
+    }
+    return (len == 0) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t parse_dqt(soft_decoder_t *soft, const uint8_t *p, int len)
+{
+    while (len > 0)
+    {
+        const int pq = p[0] >> 4;
+        const int tq = p[0] & 0x0F;
+        const int size = pq ? 128 : 64;
+        if (pq > 1 || tq > 3 || len < 1 + size)
+        {
+            return ESP_FAIL;
+        }
+        for (int i = 0; i < 64; i++)
+        {
+            soft->qt[tq][i] = pq ? read_be16(p + 1 + i * 2) : p[1 + i];
+        }
+        soft->qt_defined |= 1 << tq;
+        p += 1 + size;
+        len -= 1 + size;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t soft_decoder_parse(void *decoder, const uint8_t *data, size_t len, jpeg_backend_info_t *info)
+{
+    soft_decoder_t *soft = decoder;
+    if (len < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    {
+        return ESP_FAIL;
+    }
+    if (soft->huffman_custom)
+    {
+        /* The tables of a frame do not carry over to the next */
+        huffman_defaults(soft);
+    }
+    soft->qt_defined = 0;
+    soft->ncomp = 0;
+    soft->restart_interval = 0;
+
+    const uint8_t *p = data + 2;
+    const uint8_t *end = data + len;
+    while (true)
+    {
+        /* Markers may be preceded by fill bytes */
+        while (p < end && *p == 0xFF)
+        {
+            p++;
+        }
+        if (p + 3 > end || p[-1] != 0xFF)
+        {
+            return ESP_FAIL;
+        }
+        const uint8_t marker = *p++;
+        if (marker == 0xD9)
+        {
+            return ESP_FAIL;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+        {
+            continue;
+        }
+        const int seg_len = read_be16(p);
+        if (seg_len < 2 || p + seg_len > end)
+        {
+            return ESP_FAIL;
+        }
+        const uint8_t *seg = p + 2;
+        const int body = seg_len - 2;
+        p += seg_len;
+
+        esp_err_t ret = ESP_OK;
+        switch (marker)
+        {
+        case 0xC0:
+        case 0xC1:
+            ret = parse_sof(soft, seg, body);
+            break;
+        case 0xC2:
+        case 0xC3:
+        case 0xC5:
+        case 0xC6:
+        case 0xC7:
+        case 0xC9:
+        case 0xCA:
+        case 0xCB:
+        case 0xCD:
+        case 0xCE:
+        case 0xCF:
+            /* Progressive, lossless, hierarchical or arithmetic coding */
+            return ESP_ERR_NOT_SUPPORTED;
+        case 0xC4:
+            ret = parse_dht(soft, seg, body);
+            break;
+        case 0xDB:
+            ret = parse_dqt(soft, seg, body);
+            break;
+        case 0xDD:
+            ret = (body >= 2) ? ESP_OK : ESP_FAIL;
+            soft->restart_interval = (body >= 2) ? read_be16(seg) : 0;
+            break;
+        case 0xDA:
+            ret = parse_sos(soft, seg, body);
+            if (ret != ESP_OK)
+            {
+                return ret;
+            }
+            soft->scan = p;
+            soft->scan_end = end;
+            {
+                const int scale = soft->config.scale_shift;
+                soft->out_width = (soft->width + (1 << scale) - 1) >> scale;
+                soft->out_height = (soft->height + (1 << scale) - 1) >> scale;
+            }
+            info->width = soft->width;
+            info->height = soft->height;
+            info->out_width = soft->out_width;
+            info->out_height = soft->out_height;
+            return ESP_OK;
+        default:
+            /* APPn, COM and the others carry nothing needed */
+            break;
+        }
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+}
+
+static esp_err_t soft_decoder_decode(void *decoder, uint8_t *out_buf)
+{
+    soft_decoder_t *soft = decoder;
+    if (soft->scan == NULL)
+    {
+        return ESP_FAIL;
+    }
+    const int n = 8 >> soft->config.scale_shift;
+    const int mcu_w = soft->hmax * n;
+    const int mcu_h = soft->vmax * n;
+    const int mcus_x = (soft->width + soft->hmax * 8 - 1) / (soft->hmax * 8);
+    const int mcus_y = (soft->height + soft->vmax * 8 - 1) / (soft->vmax * 8);
+    int todo = soft->restart_interval;
+    esp_err_t ret = ESP_OK;
+
+    bits_reset(soft, soft->scan);
+    for (int i = 0; i < soft->ncomp; i++)
+    {
+        soft->comp[i].dc_pred = 0;
+    }
+    for (int my = 0; my < mcus_y && ret == ESP_OK; my++)
+    {
+        for (int mx = 0; mx < mcus_x; mx++)
+        {
+            if (soft->restart_interval != 0 && todo-- == 0)
+            {
+                /* Skip to the RSTn marker, the data of the interval is byte aligned */
+                const uint8_t *p = soft->pos;
+                while (p + 1 < soft->scan_end && !(p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7))
+                {
+                    p++;
+                }
+                bits_reset(soft, p + 2);
+                for (int i = 0; i < soft->ncomp; i++)
+                {
+                    soft->comp[i].dc_pred = 0;
+                }
+                todo = soft->restart_interval - 1;
+            }
+            for (int i = 0; i < soft->ncomp && ret == ESP_OK; i++)
+            {
+                soft_component_t *comp = &soft->comp[i];
+                const int stride = comp->h * n;
+                for (int by = 0; by < comp->v && ret == ESP_OK; by++)
+                {
+                    for (int bx = 0; bx < comp->h && ret == ESP_OK; bx++)
+                    {
+                        ret = decode_block(soft, comp, soft->planes[i] + by * n * stride + bx * n, stride);
+                    }
+                }
+            }
+            if (ret != ESP_OK)
+            {
+                break;
+            }
+            emit_mcu(soft, out_buf, mx * mcu_w, my * mcu_h);
+        }
+    }
+    soft->scan = NULL;
+    return ret;
+}
+
+static size_t soft_decoder_get_memory(void *decoder)
+{
+    return sizeof(soft_decoder_t);
+}
+
+static esp_err_t soft_decoder_open(const jpeg_backend_config_t *config, void **ret_decoder)
+{
+    if (config->scale_shift > SOFT_MAX_SCALE)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    soft_decoder_t *soft = audio_calloc(1, sizeof(soft_decoder_t));
+    if (soft == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    soft->config = *config;
+    huffman_defaults(soft);
+    *ret_decoder = soft;
+    return ESP_OK;
+}
+
+static void soft_decoder_close(void *decoder)
+{
+    audio_free(decoder);
+}
+
+const jpeg_backend_t jpeg_backend_soft = {
+    .name = "soft",
+    .max_scale_shift = SOFT_MAX_SCALE,
+    .open = soft_decoder_open,
+    .parse = soft_decoder_parse,
+    .decode = soft_decoder_decode,
+    .get_memory = soft_decoder_get_memory,
+    .close = soft_decoder_close,
+};
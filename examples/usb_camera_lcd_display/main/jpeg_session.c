@@ -0,0 +1,275 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "audio_malloc.h"
+#include "jpeg_session.h"
+
+#define JPEG_SESSION_OUT_ALIGN 16 // jpeg_dec_process needs a 16 byte aligned output buffer
+
+struct jpeg_session_t
+{
+    jpeg_session_config_t config;
+    const jpeg_backend_t *backend;
+    void *dec;
+    jpeg_backend_info_t info;
+    int width;                      /* Geometry the decoder was opened for */
+    int height;
+    bool reopen;                    /* Output format changed since the decoder was opened */
+    uint8_t scale_shift;            /* Scaling asked from the decoder, 1 / (1 << shift) */
+    uint8_t *out_buf;
+    size_t out_capacity;
+    jpeg_session_stats_t stats;
+};
+
+/* The decoders allocate through the codec allocator, whose counters see every allocation they make */
+static uint32_t codec_allocs(void)
+{
+    uint32_t allocs = 0;
+    for (int i = 0; i < AUDIO_MEM_POOL_MAX; i++)
+    {
+        audio_mem_stats_t stats;
+        audio_mem_get_stats(i, &stats);
+        allocs += stats.allocs + stats.untracked;
+    }
+    return allocs;
+}
+
+static bool output_type_supported(jpeg_raw_type_t type)
+{
+    return type == JPEG_RAW_TYPE_RGB565_LE || type == JPEG_RAW_TYPE_RGB565_BE || type == JPEG_RAW_TYPE_RGB888;
+}
+
+esp_err_t jpeg_session_create(const jpeg_session_config_t *config, jpeg_session_handle_t *ret_handle)
+{
+    if (config == NULL || ret_handle == NULL || !output_type_supported(config->output_type))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct jpeg_session_t *session = calloc(1, sizeof(struct jpeg_session_t));
+    if (session == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    session->config = *config;
+    session->backend = (config->backend != NULL) ? config->backend : &jpeg_backend_esp;
+
+    *ret_handle = session;
+    return ESP_OK;
+}
+
+static void jpeg_session_close(struct jpeg_session_t *session)
+{
+    if (session->dec != NULL)
+    {
+        session->backend->close(session->dec);
+        session->dec = NULL;
+    }
+}
+
+static esp_err_t jpeg_session_open(struct jpeg_session_t *session)
+{
+    const jpeg_backend_config_t config = {
+        .output_type = session->config.output_type,
+        .rotate = session->config.rotate,
+        .scale_shift = session->scale_shift,
+    };
+
+    jpeg_session_close(session);
+    esp_err_t ret = session->backend->open(&config, &session->dec);
+    if (ret != ESP_OK)
+    {
+        session->dec = NULL;
+        return ret;
+    }
+    session->reopen = false;
+    session->stats.reopens++;
+    return ESP_OK;
+}
+
+static esp_err_t jpeg_session_parse(struct jpeg_session_t *session, const uint8_t *data, size_t len)
+{
+    return session->backend->parse(session->dec, data, len, &session->info);
+}
+
+static esp_err_t jpeg_session_reserve(struct jpeg_session_t *session, size_t size)
+{
+    if (size <= session->out_capacity)
+    {
+        return ESP_OK;
+    }
+
+    heap_caps_free(session->out_buf);
+    session->out_capacity = 0;
+    session->out_buf = heap_caps_aligned_alloc(JPEG_SESSION_OUT_ALIGN, size, session->config.out_caps);
+    if (session->out_buf == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    session->out_capacity = size;
+    session->stats.allocs++;
+    return ESP_OK;
+}
+
+static esp_err_t jpeg_session_run(struct jpeg_session_t *handle, const uint8_t *data, size_t len,
+                                  uint8_t *out_buf, size_t out_capacity, jpeg_session_frame_t *frame)
+{
+    const uint32_t allocs = handle->stats.allocs;
+    const uint32_t codec = codec_allocs();
+    esp_err_t ret = ESP_OK;
+    if (handle->dec == NULL || handle->reopen)
+    {
+        ret = jpeg_session_open(handle);
+        if (ret != ESP_OK)
+        {
+            goto _exit;
+        }
+    }
+
+    ret = jpeg_session_parse(handle, data, len);
+    if (ret != ESP_OK)
+    {
+        goto _exit;
+    }
+    if (handle->info.width != handle->width || handle->info.height != handle->height)
+    {
+        if (handle->width != 0)
+        {
+            /* The decoder sizes its internal buffers from the first header it parses */
+            ret = jpeg_session_open(handle);
+            if (ret == ESP_OK)
+            {
+                ret = jpeg_session_parse(handle, data, len);
+            }
+            if (ret != ESP_OK)
+            {
+                goto _exit;
+            }
+        }
+        handle->width = handle->info.width;
+        handle->height = handle->info.height;
+    }
+
+    const int bytes_per_pixel = (handle->config.output_type == JPEG_RAW_TYPE_RGB888) ? 3 : 2;
+    const size_t size = (size_t)handle->info.out_width * handle->info.out_height * bytes_per_pixel;
+    if (out_buf == NULL)
+    {
+        ret = jpeg_session_reserve(handle, size);
+        if (ret != ESP_OK)
+        {
+            goto _exit;
+        }
+        out_buf = handle->out_buf;
+    }
+    else if (size > out_capacity)
+    {
+        ret = ESP_ERR_INVALID_SIZE;
+        goto _exit;
+    }
+
+    ret = handle->backend->decode(handle->dec, out_buf);
+    if (ret != ESP_OK)
+    {
+        goto _exit;
+    }
+
+    const bool swapped = handle->config.rotate == JPEG_ROTATE_90D || handle->config.rotate == JPEG_ROTATE_270D;
+    frame->data = out_buf;
+    frame->size = size;
+    frame->width = swapped ? handle->info.out_height : handle->info.out_width;
+    frame->height = swapped ? handle->info.out_width : handle->info.out_height;
+    frame->scale_shift = handle->scale_shift;
+    handle->stats.frames++;
+
+_exit:
+    if (ret != ESP_OK)
+    {
+        handle->stats.errors++;
+    }
+    handle->stats.allocs += codec_allocs() - codec;
+    handle->stats.allocs_last_frame = handle->stats.allocs - allocs;
+    return ret;
+}
+
+esp_err_t jpeg_session_decode(jpeg_session_handle_t handle, const uint8_t *data, size_t len, jpeg_session_frame_t *frame)
+{
+    if (handle == NULL || data == NULL || len == 0 || frame == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return jpeg_session_run(handle, data, len, NULL, 0, frame);
+}
+
+esp_err_t jpeg_session_decode_to(jpeg_session_handle_t handle, const uint8_t *data, size_t len,
+                                 uint8_t *out_buf, size_t out_capacity, jpeg_session_frame_t *frame)
+{
+    if (handle == NULL || data == NULL || len == 0 || out_buf == NULL || ((uintptr_t)out_buf % JPEG_SESSION_OUT_ALIGN) || frame == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return jpeg_session_run(handle, data, len, out_buf, out_capacity, frame);
+}
+
+esp_err_t jpeg_session_set_output(jpeg_session_handle_t handle, jpeg_raw_type_t output_type, jpeg_rotate_t rotate)
+{
+    if (handle == NULL || !output_type_supported(output_type))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (output_type != handle->config.output_type || rotate != handle->config.rotate)
+    {
+        handle->config.output_type = output_type;
+        handle->config.rotate = rotate;
+        handle->reopen = true;
+    }
+    return ESP_OK;
+}
+
+uint8_t jpeg_session_get_max_scale_shift(jpeg_session_handle_t handle)
+{
+    return (handle != NULL) ? handle->backend->max_scale_shift : 0;
+}
+
+esp_err_t jpeg_session_set_scale(jpeg_session_handle_t handle, uint8_t scale_shift)
+{
+    if (handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (scale_shift > handle->backend->max_scale_shift)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (scale_shift != handle->scale_shift)
+    {
+        handle->scale_shift = scale_shift;
+        handle->reopen = true;
+    }
+    return ESP_OK;
+}
+
+void jpeg_session_get_stats(jpeg_session_handle_t handle, jpeg_session_stats_t *stats)
+{
+    *stats = handle->stats;
+    stats->decoder_bytes = (handle->dec != NULL && handle->backend->get_memory != NULL) ?
+                           handle->backend->get_memory(handle->dec) : 0;
+    stats->out_bytes = handle->out_capacity;
+}
+
+void jpeg_session_delete(jpeg_session_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return;
+    }
+    jpeg_session_close(handle);
+    heap_caps_free(handle->out_buf);
+    free(handle);
+}
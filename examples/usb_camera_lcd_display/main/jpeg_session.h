@@ -0,0 +1,153 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_jpeg_dec.h"
+#include "jpeg_backend.h"
+
+/**
+ * A long-lived JPEG decoder session. The decoder handle, its IO and header
+ * structures and the output buffer are kept across frames; the decoder is
+ * only reopened when the stream resolution or the output format changes,
+ * and the output buffer only grows.
+ */
+typedef struct
+{
+    jpeg_raw_type_t output_type;    /*!< JPEG_RAW_TYPE_RGB565_LE, JPEG_RAW_TYPE_RGB565_BE or JPEG_RAW_TYPE_RGB888 */
+    jpeg_rotate_t rotate;           /*!< Clockwise rotation, esp_jpeg needs width and height multiple of 8 */
+    uint32_t out_caps;              /*!< Heap capabilities of the output buffer, e.g. MALLOC_CAP_SPIRAM */
+    const jpeg_backend_t *backend;  /*!< Decoder, NULL for jpeg_backend_esp */
+} jpeg_session_config_t;
+
+typedef struct
+{
+    uint8_t *data;                  /*!< Decoded pixels, owned by the session, valid until the next decode */
+    size_t size;                    /*!< Bytes of decoded pixels */
+    int width;                      /*!< Width after rotation */
+    int height;                     /*!< Height after rotation */
+    uint8_t scale_shift;            /*!< Scaling done by the decoder, 1 / (1 << shift) */
+} jpeg_session_frame_t;
+
+typedef struct
+{
+    uint32_t frames;                /*!< Frames decoded */
+    uint32_t errors;                /*!< Frames that failed to parse or decode */
+    uint32_t reopens;               /*!< Decoder (re)opens, one per resolution or format change */
+    uint32_t allocs;                /*!< Allocations made by the session and, from the audio_mem counters, its decoder */
+    uint32_t allocs_last_frame;     /*!< Allocations made while decoding the last frame, an encoder running at the
+                                         same time is counted too since the codec shares the counters */
+    size_t decoder_bytes;           /*!< Memory held by the decoder, 0 when the backend does not tell */
+    size_t out_bytes;               /*!< Size of the session output buffer */
+} jpeg_session_stats_t;
+
+typedef struct jpeg_session_t *jpeg_session_handle_t;
+
+/**
+ * @brief Create a decoder session
+ *
+ * The decoder itself is opened on the first frame.
+ *
+ * @param config session configuration
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid configuration
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t jpeg_session_create(const jpeg_session_config_t *config, jpeg_session_handle_t *ret_handle);
+
+/**
+ * @brief Decode one JPEG frame into the session output buffer
+ *
+ * @param handle session handle
+ * @param data JPEG data
+ * @param len JPEG data length
+ * @param frame returned decoded frame
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ *         ESP_FAIL              Corrupted or unsupported frame
+ */
+esp_err_t jpeg_session_decode(jpeg_session_handle_t handle, const uint8_t *data, size_t len, jpeg_session_frame_t *frame);
+
+/**
+ * @brief Decode one JPEG frame into a caller owned buffer
+ *
+ * @param handle session handle
+ * @param data JPEG data
+ * @param len JPEG data length
+ * @param out_buf output buffer, 16 byte aligned
+ * @param out_capacity size of `out_buf`
+ * @param frame returned decoded frame, `data` points to `out_buf`
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument or misaligned buffer
+ *         ESP_ERR_INVALID_SIZE  The decoded frame does not fit in `out_buf`
+ *         ESP_ERR_NO_MEM        Out of memory
+ *         ESP_FAIL              Corrupted or unsupported frame
+ */
+esp_err_t jpeg_session_decode_to(jpeg_session_handle_t handle, const uint8_t *data, size_t len,
+                                 uint8_t *out_buf, size_t out_capacity, jpeg_session_frame_t *frame);
+
+/**
+ * @brief Change the output format, the decoder is reopened on the next frame
+ *
+ * @param handle session handle
+ * @param output_type output pixel format
+ * @param rotate clockwise rotation
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Unsupported output format
+ */
+esp_err_t jpeg_session_set_output(jpeg_session_handle_t handle, jpeg_raw_type_t output_type, jpeg_rotate_t rotate);
+
+/**
+ * @brief Get the largest scaling the decoder does in the DCT domain
+ *
+ * @param handle session handle
+ * @return shift of the smallest 1 / (1 << shift) scale, 0 when the decoder can not scale
+ */
+uint8_t jpeg_session_get_max_scale_shift(jpeg_session_handle_t handle);
+
+/**
+ * @brief Ask the decoder for scaled output, applied from the next frame
+ *
+ * @param handle session handle
+ * @param scale_shift output is 1 / (1 << scale_shift) of the frame
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NOT_SUPPORTED Beyond jpeg_session_get_max_scale_shift
+ */
+esp_err_t jpeg_session_set_scale(jpeg_session_handle_t handle, uint8_t scale_shift);
+
+/**
+ * @brief Get the session counters
+ *
+ * @param handle session handle
+ * @param stats returned counters
+ */
+void jpeg_session_get_stats(jpeg_session_handle_t handle, jpeg_session_stats_t *stats);
+
+/**
+ * @brief Close the decoder and free the session
+ *
+ * @param handle session handle
+ */
+void jpeg_session_delete(jpeg_session_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
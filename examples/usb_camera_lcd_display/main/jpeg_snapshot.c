@@ -0,0 +1,247 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_jpeg_enc.h"
+#include "jpeg_snapshot.h"
+
+#define SNAPSHOT_BAND_ALIGN     16
+#define SNAPSHOT_HEADER_SIZE    1024    /* Room for the headers and tables that come out with the first band */
+
+static const char *TAG = "jpeg_snapshot";
+
+struct jpeg_snapshot_t
+{
+    jpeg_snapshot_config_t config;
+    void *encoder;
+    uint16_t width;
+    uint16_t height;
+    uint8_t *band;                  /* One block of the encoder, YCbYCr */
+    int band_size;
+    int band_rows;
+    uint8_t *out;                   /* Output of one block */
+    int out_capacity;
+    jpeg_snapshot_stats_t stats;
+};
+
+static inline uint16_t rgb565_get(const uint8_t *p, bool big_endian)
+{
+    return big_endian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+}
+
+/* BT.601 full range, the chroma of each pair of pixels is taken from their average */
+static void snapshot_convert_row(const uint8_t *src, uint8_t *dst, uint16_t width, bool big_endian)
+{
+    for (uint16_t x = 0; x < width; x += 2)
+    {
+        int r[2], g[2], b[2];
+        for (int i = 0; i < 2; i++)
+        {
+            const uint16_t v = rgb565_get(src + (x + i) * 2, big_endian);
+            r[i] = ((v >> 8) & 0xF8) | (v >> 13);
+            g[i] = ((v >> 3) & 0xFC) | ((v >> 9) & 0x03);
+            b[i] = ((v << 3) & 0xF8) | ((v >> 2) & 0x07);
+        }
+        const int r2 = r[0] + r[1];
+        const int g2 = g[0] + g[1];
+        const int b2 = b[0] + b[1];
+        dst[0] = (77 * r[0] + 150 * g[0] + 29 * b[0] + 128) >> 8;
+        dst[1] = (-43 * r2 - 85 * g2 + 128 * b2 + 65791) >> 9;
+        dst[2] = (77 * r[1] + 150 * g[1] + 29 * b[1] + 128) >> 8;
+        dst[3] = (128 * r2 - 107 * g2 - 21 * b2 + 65791) >> 9;
+        dst += 4;
+    }
+}
+
+static void snapshot_close(struct jpeg_snapshot_t *snapshot)
+{
+    if (snapshot->encoder != NULL)
+    {
+        jpeg_enc_close(snapshot->encoder);
+        snapshot->encoder = NULL;
+    }
+    if (snapshot->band != NULL)
+    {
+        jpeg_free_align(snapshot->band);
+        snapshot->band = NULL;
+    }
+    free(snapshot->out);
+    snapshot->out = NULL;
+    snapshot->width = 0;
+    snapshot->height = 0;
+}
+
+static esp_err_t snapshot_open(struct jpeg_snapshot_t *snapshot, uint16_t width, uint16_t height)
+{
+    jpeg_enc_info_t info = DEFAULT_JPEG_ENC_CONFIG();
+    info.width = width;
+    info.height = height;
+    info.quality = snapshot->config.quality;
+    snapshot->encoder = jpeg_enc_open(&info);
+    if (snapshot->encoder == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* A block is a band of whole MCU rows of the source */
+    const int stride = width * 2;
+    snapshot->band_size = jpeg_enc_get_block_size(snapshot->encoder);
+    if (snapshot->band_size <= 0 || snapshot->band_size % stride)
+    {
+        ESP_LOGE(TAG, "block of %d bytes is not made of %dx%d rows", snapshot->band_size, width, height);
+        snapshot_close(snapshot);
+        return ESP_ERR_INVALID_ARG;
+    }
+    snapshot->band_rows = snapshot->band_size / stride;
+    snapshot->out_capacity = snapshot->band_size + SNAPSHOT_HEADER_SIZE;
+    snapshot->band = jpeg_malloc_align(snapshot->band_size, SNAPSHOT_BAND_ALIGN);
+    snapshot->out = malloc(snapshot->out_capacity);
+    if (snapshot->band == NULL || snapshot->out == NULL)
+    {
+        snapshot_close(snapshot);
+        return ESP_ERR_NO_MEM;
+    }
+    snapshot->width = width;
+    snapshot->height = height;
+    snapshot->stats.band_size = snapshot->band_size;
+    return ESP_OK;
+}
+
+esp_err_t jpeg_snapshot_create(const jpeg_snapshot_config_t *config, jpeg_snapshot_handle_t *ret_handle)
+{
+    if (config == NULL || ret_handle == NULL || config->quality > 100)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct jpeg_snapshot_t *snapshot = calloc(1, sizeof(struct jpeg_snapshot_t));
+    if (snapshot == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    snapshot->config = *config;
+    if (snapshot->config.quality == 0)
+    {
+        snapshot->config.quality = JPEG_SNAPSHOT_DEFAULT_QUALITY;
+    }
+    *ret_handle = snapshot;
+    return ESP_OK;
+}
+
+esp_err_t jpeg_snapshot_set_quality(jpeg_snapshot_handle_t handle, uint8_t quality)
+{
+    if (handle == NULL || quality == 0 || quality > 100)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->encoder != NULL && jpeg_enc_set_quality(handle->encoder, quality) != JPEG_ERR_OK)
+    {
+        return ESP_FAIL;
+    }
+    handle->config.quality = quality;
+    return ESP_OK;
+}
+
+esp_err_t jpeg_snapshot_encode(jpeg_snapshot_handle_t handle, const uint8_t *rgb565, uint16_t width, uint16_t height,
+                               jpeg_snapshot_sink_t sink, void *ctx, size_t *out_size)
+{
+    if (handle == NULL || rgb565 == NULL || sink == NULL || width == 0 || height == 0 || width % 2)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (width != handle->width || height != handle->height)
+    {
+        snapshot_close(handle);
+        esp_err_t ret = snapshot_open(handle, width, height);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    const int64_t start_us = esp_timer_get_time();
+    const size_t stride = width * 2;
+    size_t total = 0;
+    uint32_t chunks = 0;
+    esp_err_t err = ESP_OK;
+    int ret = JPEG_ERR_FAIL;
+    for (uint32_t y = 0; y < height; y += handle->band_rows)
+    {
+        for (int row = 0; row < handle->band_rows; row++)
+        {
+            /* The last band is completed with copies of the last row */
+            const uint32_t src_y = (y + row < height) ? y + row : height - 1U;
+            snapshot_convert_row(rgb565 + src_y * stride, handle->band + row * stride, width, handle->config.big_endian);
+        }
+
+        int len = 0;
+        ret = jpeg_enc_process_with_block(handle->encoder, handle->band, handle->band_size,
+                                          handle->out, handle->out_capacity, &len);
+        if (ret < 0)
+        {
+            err = ESP_FAIL;
+            break;
+        }
+        if (len > 0)
+        {
+            err = sink(ctx, handle->out, len);
+            if (err != ESP_OK)
+            {
+                break;
+            }
+            total += len;
+            chunks++;
+        }
+        if (ret == JPEG_ERR_OK)
+        {
+            break;
+        }
+    }
+    if (err == ESP_OK && ret != JPEG_ERR_OK)
+    {
+        err = ESP_FAIL;
+    }
+    if (err != ESP_OK)
+    {
+        /* The encoder is in the middle of an image, start the next one from scratch */
+        ESP_LOGW(TAG, "snapshot failed after %u bytes, %s", (unsigned)total, esp_err_to_name(err));
+        snapshot_close(handle);
+        return err;
+    }
+
+    handle->stats.images++;
+    handle->stats.chunks = chunks;
+    handle->stats.bytes = total;
+    handle->stats.encode_us = esp_timer_get_time() - start_us;
+    if (out_size != NULL)
+    {
+        *out_size = total;
+    }
+    return ESP_OK;
+}
+
+esp_err_t jpeg_snapshot_file_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    return (fwrite(data, 1, len, (FILE *)ctx) == len) ? ESP_OK : ESP_FAIL;
+}
+
+void jpeg_snapshot_get_stats(jpeg_snapshot_handle_t handle, jpeg_snapshot_stats_t *stats)
+{
+    *stats = handle->stats;
+}
+
+void jpeg_snapshot_delete(jpeg_snapshot_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return;
+    }
+    snapshot_close(handle);
+    free(handle);
+}
@@ -0,0 +1,126 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define JPEG_SNAPSHOT_DEFAULT_QUALITY   80  /*!< Quality used when the config leaves it at 0 */
+
+/**
+ * Encodes an RGB565 frame to JPEG with the block mode of the encoder. The
+ * frame is converted and fed one band of MCU rows at a time, and the JPEG
+ * data of every band goes to the sink as soon as it is produced. Only one
+ * band of pixels and its output are in memory, never the whole image.
+ */
+typedef struct
+{
+    uint8_t quality;            /*!< Quality 1-100, 0 for JPEG_SNAPSHOT_DEFAULT_QUALITY */
+    bool big_endian;            /*!< Byte order of the RGB565 pixels, true for JPEG_RAW_TYPE_RGB565_BE */
+} jpeg_snapshot_config_t;
+
+typedef struct
+{
+    uint32_t images;            /*!< Images encoded */
+    uint32_t chunks;            /*!< Chunks passed to the sink in the last image */
+    size_t bytes;               /*!< Size of the last image */
+    size_t band_size;           /*!< Bytes of pixels in memory, one band of MCU rows */
+    uint32_t encode_us;         /*!< Time of the last image, sink included */
+} jpeg_snapshot_stats_t;
+
+/**
+ * @brief Receive a chunk of the JPEG data, in order
+ *
+ * @param ctx context given to jpeg_snapshot_encode
+ * @param data JPEG data, only valid during the call
+ * @param len length of `data`
+ * @return esp_err_t
+ *         ESP_OK                Continue
+ *         Others                Stop the encoding and return this error
+ */
+typedef esp_err_t (*jpeg_snapshot_sink_t)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct jpeg_snapshot_t *jpeg_snapshot_handle_t;
+
+/**
+ * @brief Create a snapshot encoder
+ *
+ * The encoder and the band buffers are allocated with the first image and
+ * kept while the frame size does not change.
+ *
+ * @param config snapshot configuration
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t jpeg_snapshot_create(const jpeg_snapshot_config_t *config, jpeg_snapshot_handle_t *ret_handle);
+
+/**
+ * @brief Change the quality of the next images
+ *
+ * @param handle snapshot handle
+ * @param quality 1-100, higher is better
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid quality
+ *         ESP_FAIL              The encoder refused it
+ */
+esp_err_t jpeg_snapshot_set_quality(jpeg_snapshot_handle_t handle, uint8_t quality);
+
+/**
+ * @brief Encode one frame and stream it to the sink
+ *
+ * The frame must not change until the call returns.
+ *
+ * @param handle snapshot handle
+ * @param rgb565 frame pixels
+ * @param width frame width, even
+ * @param height frame height
+ * @param sink receives the JPEG data
+ * @param ctx passed to `sink`
+ * @param out_size returned size of the image, may be NULL
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ *         ESP_FAIL              Encoder failed
+ *         Others                Error returned by the sink
+ */
+esp_err_t jpeg_snapshot_encode(jpeg_snapshot_handle_t handle, const uint8_t *rgb565, uint16_t width, uint16_t height,
+                               jpeg_snapshot_sink_t sink, void *ctx, size_t *out_size);
+
+/**
+ * @brief Sink writing to a file, `ctx` is the FILE pointer
+ */
+esp_err_t jpeg_snapshot_file_sink(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * @brief Get the snapshot counters
+ *
+ * @param handle snapshot handle
+ * @param stats returned counters
+ */
+void jpeg_snapshot_get_stats(jpeg_snapshot_handle_t handle, jpeg_snapshot_stats_t *stats);
+
+/**
+ * @brief Free the encoder and its buffers
+ *
+ * @param handle snapshot handle
+ */
+void jpeg_snapshot_delete(jpeg_snapshot_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
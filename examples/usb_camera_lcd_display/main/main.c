@@ -4,13 +4,30 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "bsp/esp-bsp.h"
 #include "bsp/display.h"
 #include "esp_log.h"
+#include "esp_check.h"
 #include "esp_jpeg_dec.h"
+#include "audio_malloc.h"
+#include "jpeg_session.h"
+#include "frame_queue.h"
+#include "frame_fit.h"
+#include "frame_swap.h"
+#include "pipeline_telemetry.h"
+#include "mjpeg_recorder.h"
+#include "jpeg_snapshot.h"
+#include "resolution_governor.h"
+#include "motion_detect.h"
+#include "bsp_storage.h"
+#include "esp_console.h"
 #include "esp_timer.h"
 #include "nvs.h"
 #include "nvs_flash.h"
@@ -25,9 +42,39 @@ static const char *TAG = "uvc_camera_lcd_demo";
 #define DEMO_SWITCH_BUTTON_IO     0            // The button to switch resolution
 #define DEMO_MAX_H                680          // The max width of the camera
 #define DEMO_MAX_V                480          // The max height of the camera
+#define DEMO_JPEG_QUEUE_DEPTH     3            // Compressed frames between the usb callback and the decoder
+#define DEMO_DECODE_TASK_CORE     1            // usb_stream runs on core 0, decode on the other core
+#define DEMO_DISPLAY_TASK_CORE    0
+#define DEMO_STATS_INTERVAL_MS    5000         // Period of the pipeline statistics log
+#define DEMO_OVERLAY_INTERVAL_MS  1000         // Period of the on-screen statistics refresh
+#define DEMO_STATS_OVERLAY        0            // Show the statistics on screen at start, `stats overlay on|off` in the console
+#define DEMO_RECORD_ENABLE        1            // Record the camera to the SD card with `record start|stop` in the console
+#define DEMO_SNAPSHOT_ENABLE      1            // Save the displayed frame to the SD card with `snapshot [quality]` in the console
+#define DEMO_SNAPSHOT_QUALITY     80           // JPEG quality of the snapshots, 1-100
+#define DEMO_SDCARD_DIR           "/sdcard"    // SD card mount point, the files are REC_nnnn.AVI and SNAPnnnn.JPG
+#define DEMO_RECORD_QUEUE_DEPTH   4            // Frames waiting for the card
+#define DEMO_RECORD_WRITE_SIZE    (16 * 1024)  // Bytes per card write, the FAT allocation unit of bsp_sdcard_init
+#define DEMO_GOVERNOR_ENABLE      1            // Pick the largest resolution the pipeline sustains, the boot button switches to manual
+#define DEMO_GOVERNOR_TARGET_FPS  25           // Frame rate the governor has to sustain
+#define DEMO_GOVERNOR_INTERVAL_MS 2000         // Period of the governor measurements
+#define DEMO_MOTION_ENABLE        1            // Outline the moving parts of the picture, `motion on|off|<sensitivity>` in the console
+#define DEMO_MOTION_SENSITIVITY   60           // 1-100, higher reports smaller changes
+#define DEMO_MOTION_HOLD_MS       500          // Time an outline stays after the motion stops
+#define DEMO_CODEC_INNER_POOL     (32 * 1024)  // Internal memory reserved for the codec, `mem` in the console
+#define DEMO_CODEC_DEFAULT_POOL   (32 * 1024)  // Internal memory for the small codec allocations, the large ones stay in PSRAM
+#define DEMO_DECODE_TO_FIT        1            // Scale frames larger than the panel down before display
+#define DEMO_SOFT_DECODER         0            // Decode with the portable decoder, slower but it scales while decoding, esp_jpeg can not (see README)
+#define DEMO_FIT_MODE             FRAME_FIT_CROP // FRAME_FIT_CROP or FRAME_FIT_LETTERBOX
+
+#if DEMO_DECODE_TO_FIT
+#define DEMO_RGB_BUFFER_SIZE      (BSP_LCD_H_RES * BSP_LCD_V_RES * 2)
+#else
+#define DEMO_RGB_BUFFER_SIZE      (DEMO_MAX_H * DEMO_MAX_V * 2)
+#endif
 
 #define BIT0_FRAME_START (0x01 << 0)
 static EventGroupHandle_t s_evt_handle;
+static SemaphoreHandle_t s_resolution_lock;
 
 typedef struct
 {
@@ -44,7 +91,17 @@ typedef struct
 } camera_resolution_info_t;
 
 static camera_resolution_info_t camera_resolution_info = {0};
-static uint8_t *jpg_frame_buf  = NULL;
+static jpeg_session_handle_t jpeg_session = NULL;
+static frame_queue_handle_t jpeg_queue     = NULL;
+static frame_swap_handle_t rgb_buffers     = NULL;
+static mjpeg_recorder_handle_t recorder    = NULL;
+static jpeg_snapshot_handle_t snapshot     = NULL;
+static resolution_governor_handle_t governor = NULL;
+#if DEMO_GOVERNOR_ENABLE
+static volatile bool governor_auto = true;
+#endif
+static volatile uint32_t decoded_frames = 0;   // Written by the decode task only
+static volatile uint32_t decode_time_us = 0;
 static uint8_t *xfer_buffer_a  = NULL;
 static uint8_t *xfer_buffer_b  = NULL;
 static uint8_t *frame_buffer   = NULL;
@@ -52,98 +109,486 @@ static uint16_t current_width  = 0;
 static uint16_t current_height = 0;
 static lv_obj_t *camera_canvas = NULL;
 static lv_obj_t *label         = NULL;
+static lv_obj_t *stats_label   = NULL;
+static lv_obj_t *motion_outline = NULL;
+static motion_detect_handle_t motion = NULL;
+static volatile bool motion_enabled = DEMO_MOTION_ENABLE;
+static SemaphoreHandle_t motion_lock = NULL;
+static motion_box_t motion_box;              // Largest box of the last frame with motion
+static int64_t motion_box_us = 0;
 
-static jpeg_error_t esp_jpeg_decoder_one_picture(uint8_t *input_buf, int len, uint8_t *output_buf)
+#if DEMO_MOTION_ENABLE
+static void _motion_cb(const motion_box_t *boxes, size_t count, void *ctx)
 {
-    esp_err_t ret = ESP_OK;
-    // Generate default configuration
-    jpeg_dec_config_t config = DEFAULT_JPEG_DEC_CONFIG();
-    config.output_type = JPEG_RAW_TYPE_RGB565_BE;
-    // Empty handle to jpeg_decoder
-    jpeg_dec_handle_t jpeg_dec = NULL;
+    xSemaphoreTake(motion_lock, portMAX_DELAY);
+    motion_box = boxes[0];
+    motion_box_us = esp_timer_get_time();
+    xSemaphoreGive(motion_lock);
+}
+#endif
 
-    // Create jpeg_dec
-    jpeg_dec = jpeg_dec_open(&config);
+/* Called with the display lock held, the outline is in frame coordinates inside the canvas */
+static void _motion_show(void)
+{
+    if (motion_outline == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(motion_lock, portMAX_DELAY);
+    const motion_box_t box = motion_box;
+    const bool recent = motion_enabled && motion_box_us != 0 &&
+                        esp_timer_get_time() - motion_box_us < DEMO_MOTION_HOLD_MS * 1000LL;
+    xSemaphoreGive(motion_lock);
+    if (!recent)
+    {
+        lv_obj_add_flag(motion_outline, LV_OBJ_FLAG_HIDDEN);
+        return;
+    }
+    lv_obj_set_pos(motion_outline, box.x, box.y);
+    lv_obj_set_size(motion_outline, box.width, box.height);
+    lv_obj_clear_flag(motion_outline, LV_OBJ_FLAG_HIDDEN);
+}
 
-    // Create io_callback handle
-    jpeg_dec_io_t *jpeg_io = calloc(1, sizeof(jpeg_dec_io_t));
-    if (jpeg_io == NULL)
+static void _camera_display(void)
+{
+    const int64_t start_us = esp_timer_get_time();
+    bsp_display_lock(0);
+    /* LVGL can not read the previous buffer while the lock is held, so the decoder may reuse it right away */
+    frame_slot_t *rgb = frame_swap_acquire_latest(rgb_buffers);
+    if (rgb != NULL)
     {
-        return ESP_FAIL;
+        current_width = rgb->width;
+        current_height = rgb->height;
+        lv_canvas_set_buffer(camera_canvas, rgb->data, current_width, current_height, LV_IMG_CF_TRUE_COLOR);
+        lv_label_set_text_fmt(label, "#FF0000 %d*%d#", current_width, current_height);
+        _motion_show();
     }
+    bsp_display_unlock();
+    if (rgb != NULL)
+    {
+        const int64_t end_us = esp_timer_get_time();
+        telemetry_record(TELEMETRY_CANVAS, start_us, end_us);
+        telemetry_record(TELEMETRY_LATENCY, rgb->timestamp_us, end_us);
+    }
+}
 
-    // Create out_info handle
-    jpeg_dec_header_info_t *out_info = calloc(1, sizeof(jpeg_dec_header_info_t));
-    if (out_info == NULL)
+static void camera_frame_cb(uvc_frame_t *frame, void *ptr)
+{
+    ESP_LOGD(TAG, "uvc callback! frame_format = %d, seq = %" PRIu32 ", width = %" PRIu32 ", height = %" PRIu32 ", length = %u, ptr = %d",
+             frame->frame_format, frame->sequence, frame->width, frame->height, frame->data_bytes, (int)ptr);
+    /* Only copy the frame here, the usb task must not wait for the decoder or the display */
+    const int64_t start_us = esp_timer_get_time();
+    frame_slot_t *slot = frame_queue_acquire_write(jpeg_queue);
+    if (slot == NULL)
     {
-        return ESP_FAIL;
+        telemetry_drop(TELEMETRY_USB, 1);
+        return;
+    }
+    if (frame->data_bytes > slot->capacity)
+    {
+        ESP_LOGW(TAG, "jpeg frame too large, seq = %" PRIu32 ", length = %u", frame->sequence, frame->data_bytes);
+        frame_queue_cancel(jpeg_queue, slot);
+        telemetry_drop(TELEMETRY_USB, 1);
+        return;
     }
-    // Set input buffer and buffer len to io_callback
-    jpeg_io->inbuf = input_buf;
-    jpeg_io->inbuf_len = len;
+    memcpy(slot->data, frame->data, frame->data_bytes);
+    slot->len = frame->data_bytes;
+    slot->width = frame->width;
+    slot->height = frame->height;
+    slot->seq = frame->sequence;
+    slot->timestamp_us = start_us;
+    frame_queue_commit(jpeg_queue, slot);
+    mjpeg_recorder_push(recorder, frame->data, frame->data_bytes, frame->width, frame->height, start_us);
+    telemetry_record(TELEMETRY_USB, start_us, esp_timer_get_time());
+}
 
-    // Parse jpeg picture header and get picture for user and decoder
-    ret = jpeg_dec_parse_header(jpeg_dec, jpeg_io, out_info);
-    if (ret < 0)
+#if DEMO_DECODE_TO_FIT
+static esp_err_t _decode_frame(frame_slot_t *jpeg, frame_slot_t *rgb)
+{
+    jpeg_session_frame_t decoded;
+    const int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = jpeg_session_decode(jpeg_session, jpeg->data, jpeg->len, &decoded);
+    if (ret != ESP_OK)
     {
-        goto _exit;
+        return ret;
     }
+    const int64_t decoded_us = esp_timer_get_time();
+    telemetry_record(TELEMETRY_DECODE, start_us, decoded_us);
 
-    jpeg_io->outbuf = output_buf;
-    int inbuf_consumed = jpeg_io->inbuf_len - jpeg_io->inbuf_remain;
-    jpeg_io->inbuf = input_buf + inbuf_consumed;
-    jpeg_io->inbuf_len = jpeg_io->inbuf_remain;
+    /* Leave as much of the scaling as the decoder can do to the next frames */
+    frame_fit_plan_t plan;
+    ESP_RETURN_ON_ERROR(frame_fit_plan(decoded.width << decoded.scale_shift, decoded.height << decoded.scale_shift,
+                                       BSP_LCD_H_RES, BSP_LCD_V_RES, DEMO_FIT_MODE, &plan), TAG, "frame fit plan failed");
+    const uint8_t max_shift = jpeg_session_get_max_scale_shift(jpeg_session);
+    jpeg_session_set_scale(jpeg_session, (plan.shift < max_shift) ? plan.shift : max_shift);
 
-    // Start decode jpeg raw data
-    ret = jpeg_dec_process(jpeg_dec, jpeg_io);
-    if (ret < 0)
+    /* The rest is done on the decoded pixels */
+    ESP_RETURN_ON_ERROR(frame_fit_plan(decoded.width, decoded.height, BSP_LCD_H_RES, BSP_LCD_V_RES, DEMO_FIT_MODE, &plan),
+                        TAG, "frame fit plan failed");
+    ESP_RETURN_ON_ERROR(frame_fit_downscale_rgb565((const uint16_t *)decoded.data, decoded.width, decoded.height, true,
+                                                   &plan, (uint16_t *)rgb->data), TAG, "frame downscale failed");
+    telemetry_record(TELEMETRY_SCALE, decoded_us, esp_timer_get_time());
+    rgb->len = plan.fit_width * plan.fit_height * 2;
+    rgb->width = plan.fit_width;
+    rgb->height = plan.fit_height;
+    return ESP_OK;
+}
+#else
+static esp_err_t _decode_frame(frame_slot_t *jpeg, frame_slot_t *rgb)
+{
+    jpeg_session_frame_t decoded;
+    const int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = jpeg_session_decode_to(jpeg_session, jpeg->data, jpeg->len, rgb->data, rgb->capacity, &decoded);
+    if (ret == ESP_OK)
     {
-        goto _exit;
+        telemetry_record(TELEMETRY_DECODE, start_us, esp_timer_get_time());
+        rgb->len = decoded.size;
+        rgb->width = decoded.width;
+        rgb->height = decoded.height;
     }
-
-_exit:
-    // Decoder deinitialize
-    jpeg_dec_close(jpeg_dec);
-    free(out_info);
-    free(jpeg_io);
     return ret;
 }
+#endif
 
-static void adaptive_jpg_frame_buffer(size_t length)
+static void decode_task(void *arg)
 {
-    if (jpg_frame_buf != NULL)
+    while (1)
     {
-        free(jpg_frame_buf);
-    }
+        frame_slot_t *jpeg = frame_queue_acquire_read(jpeg_queue, portMAX_DELAY);
+        if (jpeg == NULL)
+        {
+            continue;
+        }
+        telemetry_record(TELEMETRY_QUEUE, jpeg->timestamp_us, esp_timer_get_time());
+        frame_slot_t *rgb = frame_swap_begin_write(rgb_buffers);
 
-    jpg_frame_buf = (uint8_t *)heap_caps_aligned_alloc(16, length, MALLOC_CAP_SPIRAM);
-    assert(jpg_frame_buf != NULL);
+        const int64_t start_us = esp_timer_get_time();
+        if (_decode_frame(jpeg, rgb) == ESP_OK)
+        {
+            decode_time_us += esp_timer_get_time() - start_us;
+            decoded_frames++;
+            rgb->seq = jpeg->seq;
+            rgb->timestamp_us = jpeg->timestamp_us;
+            frame_swap_publish(rgb_buffers, rgb);
+            /* The display only reads the frame, and this task is the only one to write it again */
+            if (motion != NULL && motion_enabled)
+            {
+                const int64_t motion_start_us = esp_timer_get_time();
+                motion_detect_process(motion, rgb->data, rgb->width, rgb->height, NULL);
+                telemetry_record(TELEMETRY_MOTION, motion_start_us, esp_timer_get_time());
+            }
+        }
+        else
+        {
+            ESP_LOGW(TAG, "jpeg decode failed, seq = %" PRIu32, jpeg->seq);
+            frame_swap_abort(rgb_buffers, rgb);
+            telemetry_drop(TELEMETRY_DECODE, 1);
+        }
+        frame_queue_release(jpeg_queue, jpeg);
+    }
 }
 
-static void _camera_display(uint8_t *lcd_buffer)
+static void _pipeline_update_stats(void)
 {
+    /* Frames overwritten in the queue and the display buffers are only known to them */
+    static uint32_t queue_dropped = 0;
+    static uint32_t canvas_dropped = 0;
+    frame_queue_stats_t jpeg_stats;
+    frame_swap_stats_t rgb_stats;
+    frame_queue_get_stats(jpeg_queue, &jpeg_stats);
+    frame_swap_get_stats(rgb_buffers, &rgb_stats);
+    telemetry_drop(TELEMETRY_QUEUE, jpeg_stats.dropped - queue_dropped);
+    telemetry_drop(TELEMETRY_CANVAS, rgb_stats.dropped - canvas_dropped);
+    queue_dropped = jpeg_stats.dropped;
+    canvas_dropped = rgb_stats.dropped;
+
+    const bool overlay = telemetry_overlay_enabled();
+    static char text[384];
+    if (overlay)
+    {
+        telemetry_format(text, sizeof(text), true);
+    }
     bsp_display_lock(0);
-    lv_canvas_set_buffer(camera_canvas, lcd_buffer, current_width, current_height, LV_IMG_CF_TRUE_COLOR);
-    lv_label_set_text_fmt(label, "#FF0000 %d*%d#", current_width, current_height);
+    if (overlay)
+    {
+        lv_label_set_text_static(stats_label, text);
+        lv_obj_clear_flag(stats_label, LV_OBJ_FLAG_HIDDEN);
+    }
+    else
+    {
+        lv_obj_add_flag(stats_label, LV_OBJ_FLAG_HIDDEN);
+    }
     bsp_display_unlock();
 }
 
-static void camera_frame_cb(uvc_frame_t *frame, void *ptr)
+static esp_err_t _camera_set_resolution(size_t index, bool persist);
+
+#if DEMO_GOVERNOR_ENABLE
+static void _governor_update(int64_t interval_us)
 {
-    ESP_LOGI(TAG, "uvc callback! frame_format = %d, seq = %" PRIu32 ", width = %" PRIu32 ", height = %" PRIu32 ", length = %u, ptr = %d",
-             frame->frame_format, frame->sequence, frame->width, frame->height, frame->data_bytes, (int)ptr);
-    if (current_width != frame->width || current_height != frame->height)
+    static uint32_t last_decoded = 0;
+    static uint32_t last_decode_us = 0;
+    static uint32_t last_displayed = 0;
+    static uint32_t last_dropped = 0;
+    frame_queue_stats_t jpeg_stats;
+    frame_swap_stats_t rgb_stats;
+    frame_queue_get_stats(jpeg_queue, &jpeg_stats);
+    frame_swap_get_stats(rgb_buffers, &rgb_stats);
+    const uint32_t dropped = jpeg_stats.dropped + jpeg_stats.rejected + rgb_stats.dropped;
+    const uint32_t decoded = decoded_frames;
+    const uint32_t decode_us = decode_time_us;
+    const resolution_governor_sample_t sample = {
+        .interval_us = interval_us,
+        .frames = rgb_stats.displayed - last_displayed,
+        .dropped = dropped - last_dropped,
+        .decoded = decoded - last_decoded,
+        .decode_us = decode_us - last_decode_us,
+    };
+    last_decoded = decoded;
+    last_decode_us = decode_us;
+    last_displayed = rgb_stats.displayed;
+    last_dropped = dropped;
+
+    /* The frame list is only stable while the camera is streaming */
+    if (!governor_auto || !(xEventGroupGetBits(s_evt_handle) & BIT0_FRAME_START))
+    {
+        return;
+    }
+    xSemaphoreTake(s_resolution_lock, portMAX_DELAY);
+    const size_t current = camera_resolution_info.camera_currect_frame_index;
+    const size_t index = (governor != NULL) ? resolution_governor_update(governor, &sample) : current;
+    if (index != current)
+    {
+        ESP_LOGI(TAG, "governor: %ux%u -> %ux%u, %" PRIu32 " displayed, %" PRIu32 " dropped",
+                 camera_resolution_info.camera_frame_list[current].width, camera_resolution_info.camera_frame_list[current].height,
+                 camera_resolution_info.camera_frame_list[index].width, camera_resolution_info.camera_frame_list[index].height,
+                 sample.frames, sample.dropped);
+    }
+    xSemaphoreGive(s_resolution_lock);
+    if (index != current)
+    {
+        /* Automatic switches are not saved, the flash would wear with every change of load. A failed one is logged
+           and tried again at a later update, if the camera is still there */
+        _camera_set_resolution(index, false);
+    }
+}
+#endif
+
+static void display_task(void *arg)
+{
+    int64_t last_update_us = esp_timer_get_time();
+    int64_t last_log_us = last_update_us;
+#if DEMO_GOVERNOR_ENABLE
+    int64_t last_governor_us = last_update_us;
+#endif
+
+    while (1)
+    {
+        if (frame_swap_wait(rgb_buffers, pdMS_TO_TICKS(DEMO_OVERLAY_INTERVAL_MS)))
+        {
+            _camera_display();
+        }
+
+        const int64_t now_us = esp_timer_get_time();
+        if (now_us - last_update_us >= DEMO_OVERLAY_INTERVAL_MS * 1000LL)
+        {
+            last_update_us = now_us;
+            _pipeline_update_stats();
+        }
+        if (now_us - last_log_us >= DEMO_STATS_INTERVAL_MS * 1000LL)
+        {
+            last_log_us = now_us;
+            telemetry_log();
+        }
+#if DEMO_GOVERNOR_ENABLE
+        if (now_us - last_governor_us >= DEMO_GOVERNOR_INTERVAL_MS * 1000LL)
+        {
+            _governor_update(now_us - last_governor_us);
+            last_governor_us = now_us;
+        }
+#endif
+    }
+}
+
+static esp_err_t _pipeline_init(void)
+{
+    /* The decoder keeps its state across frames */
+    jpeg_session_config_t jpeg_config = {
+        .output_type = JPEG_RAW_TYPE_RGB565_BE,
+        .rotate = JPEG_ROTATE_0D,
+        .out_caps = MALLOC_CAP_SPIRAM,
+        .backend = DEMO_SOFT_DECODER ? &jpeg_backend_soft : &jpeg_backend_esp,
+    };
+    ESP_ERROR_CHECK(jpeg_session_create(&jpeg_config, &jpeg_session));
+    ESP_ERROR_CHECK(telemetry_init());
+    telemetry_set_overlay(DEMO_STATS_OVERLAY);
+    ESP_ERROR_CHECK(frame_queue_create(DEMO_JPEG_QUEUE_DEPTH, DEMO_UVC_XFER_BUFFER_SIZE, MALLOC_CAP_SPIRAM, &jpeg_queue));
+    /* Both display buffers are sized for the largest frame once, resolution changes never reallocate them */
+    ESP_ERROR_CHECK(frame_swap_create(DEMO_RGB_BUFFER_SIZE, MALLOC_CAP_SPIRAM, &rgb_buffers));
+    motion_lock = xSemaphoreCreateMutex();
+    assert(motion_lock != NULL);
+#if DEMO_MOTION_ENABLE
+    motion_detect_config_t motion_config = MOTION_DETECT_DEFAULT_CONFIG();
+    motion_config.sensitivity = DEMO_MOTION_SENSITIVITY;
+    motion_config.big_endian = true;
+    motion_config.callback = _motion_cb;
+    ESP_ERROR_CHECK(motion_detect_create(&motion_config, &motion));
+#endif
+
+    BaseType_t ret = xTaskCreatePinnedToCore(decode_task, "jpeg_decode", 4 * 1024, NULL, 5, NULL, DEMO_DECODE_TASK_CORE);
+    if (ret != pdPASS)
+    {
+        ESP_LOGE(TAG, "decode task create failed");
+        return ESP_FAIL;
+    }
+    ret = xTaskCreatePinnedToCore(display_task, "camera_display", 4 * 1024, NULL, 4, NULL, DEMO_DISPLAY_TASK_CORE);
+    if (ret != pdPASS)
+    {
+        ESP_LOGE(TAG, "display task create failed");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void _display_monitor_cb(lv_disp_drv_t *disp_drv, uint32_t time_ms, uint32_t px)
+{
+    const int64_t now_us = esp_timer_get_time();
+    telemetry_record(TELEMETRY_FLUSH, now_us - time_ms * 1000LL, now_us);
+}
+
+#if DEMO_RECORD_ENABLE
+static int _record_cmd(int argc, char **argv)
+{
+    esp_err_t ret = ESP_OK;
+    if (argc > 1 && strcmp(argv[1], "start") == 0)
+    {
+        ret = mjpeg_recorder_start(recorder, 30);
+    }
+    else if (argc > 1 && strcmp(argv[1], "stop") == 0)
+    {
+        ret = mjpeg_recorder_stop(recorder, pdMS_TO_TICKS(5000));
+    }
+    mjpeg_recorder_stats_t stats;
+    mjpeg_recorder_get_stats(recorder, &stats);
+    printf("%s, %" PRIu32 " files, %" PRIu32 " frames, %" PRIu32 " dropped, %" PRIu32 " errors%s%s\n",
+           mjpeg_recorder_is_recording(recorder) ? "recording" : "stopped",
+           stats.files, stats.frames, stats.dropped, stats.errors,
+           (ret != ESP_OK) ? ", " : "", (ret != ESP_OK) ? esp_err_to_name(ret) : "");
+    return (ret == ESP_OK) ? 0 : 1;
+}
+
+static esp_err_t _recorder_init(void)
+{
+    const mjpeg_recorder_config_t config = {
+        .dir = DEMO_SDCARD_DIR,
+        .queue_depth = DEMO_RECORD_QUEUE_DEPTH,
+        .frame_capacity = DEMO_UVC_XFER_BUFFER_SIZE,
+        .write_buffer_size = DEMO_RECORD_WRITE_SIZE,
+        .task_priority = 3,
+        .task_core = DEMO_DISPLAY_TASK_CORE,
+    };
+    ESP_RETURN_ON_ERROR(mjpeg_recorder_create(&config, &recorder), TAG, "recorder create failed");
+
+    const esp_console_cmd_t cmd = {
+        .command = "record",
+        .help = "Record the camera stream to the SD card without decoding it",
+        .hint = "[start|stop]",
+        .func = &_record_cmd,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+#endif
+
+#if DEMO_SNAPSHOT_ENABLE
+static int _snapshot_cmd(int argc, char **argv)
+{
+    static uint32_t number = 0;
+    if (argc > 1)
+    {
+        const int quality = atoi(argv[1]);
+        if (quality < 1 || quality > 100 || jpeg_snapshot_set_quality(snapshot, quality) != ESP_OK)
+        {
+            printf("quality must be 1-100\n");
+            return 1;
+        }
+    }
+
+    char path[64];
+    struct stat st;
+    do
     {
-        current_width = frame->width;
-        current_height = frame->height;
-        adaptive_jpg_frame_buffer(current_width * current_height * 2);
+        snprintf(path, sizeof(path), "%s/SNAP%04" PRIu32 ".JPG", DEMO_SDCARD_DIR, number++);
+    } while (stat(path, &st) == 0 && number < 10000);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("open %s failed\n", path);
+        return 1;
     }
 
-    esp_jpeg_decoder_one_picture((uint8_t *)frame->data, frame->data_bytes, jpg_frame_buf);
-    _camera_display(jpg_frame_buf);
-    vTaskDelay(pdMS_TO_TICKS(1));
+    /* Encoded band by band straight from the buffer on screen, which stays on screen until it is done */
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    size_t size = 0;
+    const frame_slot_t *rgb = frame_swap_pin(rgb_buffers);
+    if (rgb != NULL)
+    {
+        ret = jpeg_snapshot_encode(snapshot, rgb->data, rgb->width, rgb->height, jpeg_snapshot_file_sink, file, &size);
+        frame_swap_unpin(rgb_buffers);
+    }
+    if (fclose(file) != 0 && ret == ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+    if (ret != ESP_OK)
+    {
+        remove(path);
+        printf("snapshot failed, %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+
+    jpeg_snapshot_stats_t stats;
+    jpeg_snapshot_get_stats(snapshot, &stats);
+    printf("%s, %u bytes in %" PRIu32 " chunks, %" PRIu32 " ms, %u bytes of pixels buffered\n",
+           path, (unsigned)size, stats.chunks, stats.encode_us / 1000, (unsigned)stats.band_size);
+    return 0;
 }
 
+static esp_err_t _snapshot_init(void)
+{
+    const jpeg_snapshot_config_t config = {
+        .quality = DEMO_SNAPSHOT_QUALITY,
+        .big_endian = true,
+    };
+    ESP_RETURN_ON_ERROR(jpeg_snapshot_create(&config, &snapshot), TAG, "snapshot create failed");
+
+    const esp_console_cmd_t cmd = {
+        .command = "snapshot",
+        .help = "Save the displayed frame to the SD card as JPEG",
+        .hint = "[quality]",
+        .func = &_snapshot_cmd,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+#endif
+
+#if DEMO_RECORD_ENABLE || DEMO_SNAPSHOT_ENABLE
+static esp_err_t _storage_init(void)
+{
+    esp_err_t ret = bsp_sdcard_init((char *)DEMO_SDCARD_DIR, 2);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "no SD card, recording and snapshots disabled");
+        return ret;
+    }
+#if DEMO_RECORD_ENABLE
+    ESP_RETURN_ON_ERROR(_recorder_init(), TAG, "recorder init failed");
+#endif
+#if DEMO_SNAPSHOT_ENABLE
+    ESP_RETURN_ON_ERROR(_snapshot_init(), TAG, "snapshot init failed");
+#endif
+    return ESP_OK;
+}
+#endif
 
 static esp_err_t _display_init(void)
 {
@@ -157,6 +602,22 @@ static esp_err_t _display_init(void)
     lv_label_set_recolor(label, true);
     lv_obj_set_pos(label, 0, 0);
     lv_label_set_text(label, "Insert a camera, press boot for resolution.");
+    stats_label = lv_label_create(lv_scr_act());
+    lv_obj_set_style_bg_color(stats_label, lv_color_black(), 0);
+    lv_obj_set_style_bg_opa(stats_label, LV_OPA_50, 0);
+    lv_obj_set_style_text_color(stats_label, lv_color_white(), 0);
+    lv_obj_align(stats_label, LV_ALIGN_BOTTOM_LEFT, 0, 0);
+    lv_obj_add_flag(stats_label, LV_OBJ_FLAG_HIDDEN);
+#if DEMO_MOTION_ENABLE
+    motion_outline = lv_obj_create(camera_canvas);
+    lv_obj_remove_style_all(motion_outline);
+    lv_obj_set_style_border_color(motion_outline, lv_palette_main(LV_PALETTE_RED), 0);
+    lv_obj_set_style_border_width(motion_outline, 2, 0);
+    lv_obj_clear_flag(motion_outline, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_add_flag(motion_outline, LV_OBJ_FLAG_HIDDEN);
+#endif
+    /* Called by LVGL after every refresh with the time it took to render and flush */
+    lv_disp_get_default()->driver->monitor_cb = _display_monitor_cb;
     bsp_display_unlock();
     return ESP_OK;
 }
@@ -270,6 +731,62 @@ static size_t _find_current_resolution(camera_frame_size_t *camera_frame_size)
     return i;
 }
 
+static void _camera_save_resolution(void)
+{
+    xSemaphoreTake(s_resolution_lock, portMAX_DELAY);
+    camera_frame_size_t size = camera_resolution_info.camera_frame_size;
+    xSemaphoreGive(s_resolution_lock);
+    ESP_ERROR_CHECK(_set_value_to_nvs(DEMO_KEY_RESOLUTION, &size, sizeof(camera_frame_size_t)));
+}
+
+/*
+ * Only a resolution chosen by hand is saved to nvs and used again at the next boot.
+ * The camera can be unplugged at any point, the errors are returned and nothing changes.
+ */
+static esp_err_t _camera_set_resolution(size_t index, bool persist)
+{
+    xSemaphoreTake(s_resolution_lock, portMAX_DELAY);
+    if (!(xEventGroupGetBits(s_evt_handle) & BIT0_FRAME_START) || index >= camera_resolution_info.camera_frame_list_num)
+    {
+        xSemaphoreGive(s_resolution_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    const uint16_t width = camera_resolution_info.camera_frame_list[index].width;
+    const uint16_t height = camera_resolution_info.camera_frame_list[index].height;
+    ESP_LOGI(TAG, "old resolution is %d*%d", camera_resolution_info.camera_frame_size.width, camera_resolution_info.camera_frame_size.height);
+
+    esp_err_t ret = usb_streaming_control(STREAM_UVC, CTRL_SUSPEND, NULL);
+    if (ret == ESP_OK)
+    {
+        ret = uvc_frame_size_reset(width, height, FPS2INTERVAL(30));
+        if (ret == ESP_OK)
+        {
+            camera_resolution_info.camera_currect_frame_index = index;
+            camera_resolution_info.camera_frame_size.width = width;
+            camera_resolution_info.camera_frame_size.height = height;
+            ESP_LOGI(TAG, "currect resolution is %d*%d", width, height);
+            if (governor != NULL)
+            {
+                resolution_governor_set_current(governor, index);
+            }
+        }
+        /* Resume also after a failed reset, the camera keeps streaming the old size */
+        const esp_err_t resume = usb_streaming_control(STREAM_UVC, CTRL_RESUME, NULL);
+        ret = (ret == ESP_OK) ? resume : ret;
+    }
+    xSemaphoreGive(s_resolution_lock);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "resolution %ux%u not set: %s", width, height, esp_err_to_name(ret));
+        return ret;
+    }
+    if (persist)
+    {
+        _camera_save_resolution();
+    }
+    return ESP_OK;
+}
+
 static void switch_button_press_down_cb(void *arg, void *data)
 {
     if (camera_resolution_info.camera_frame_list == NULL || xEventGroupWaitBits(s_evt_handle, BIT0_FRAME_START, false, false, pdMS_TO_TICKS(10)) != pdTRUE)
@@ -277,22 +794,20 @@ static void switch_button_press_down_cb(void *arg, void *data)
         return;
     }
 
-    ESP_LOGI(TAG, "old resolution is %d*%d", camera_resolution_info.camera_frame_size.width, camera_resolution_info.camera_frame_size.height);
-    if (++camera_resolution_info.camera_currect_frame_index >= camera_resolution_info.camera_frame_list_num)
+#if DEMO_GOVERNOR_ENABLE
+    /* A resolution chosen by hand is kept until `resolution auto` */
+    if (governor_auto)
     {
-        camera_resolution_info.camera_currect_frame_index = 0;
+        governor_auto = false;
+        ESP_LOGI(TAG, "resolution governor off, `resolution auto` to turn it back on");
     }
-    camera_resolution_info.camera_frame_size.width = camera_resolution_info.camera_frame_list[camera_resolution_info.camera_currect_frame_index].width;
-    camera_resolution_info.camera_frame_size.height = camera_resolution_info.camera_frame_list[camera_resolution_info.camera_currect_frame_index].height;
-    ESP_LOGI(TAG, "currect resolution is %d*%d", camera_resolution_info.camera_frame_size.width, camera_resolution_info.camera_frame_size.height);
-
-    /* Save the new camera resolution to nsv */
-    usb_streaming_control(STREAM_UVC, CTRL_SUSPEND, NULL);
-    ESP_ERROR_CHECK(uvc_frame_size_reset(camera_resolution_info.camera_frame_size.width,
-                                         camera_resolution_info.camera_frame_size.height,
-                                         FPS2INTERVAL(30)));
-    ESP_ERROR_CHECK(_set_value_to_nvs(DEMO_KEY_RESOLUTION, &camera_resolution_info.camera_frame_size, sizeof(camera_frame_size_t)));
-    usb_streaming_control(STREAM_UVC, CTRL_RESUME, NULL);
+#endif
+    size_t index = camera_resolution_info.camera_currect_frame_index + 1;
+    if (index >= camera_resolution_info.camera_frame_list_num)
+    {
+        index = 0;
+    }
+    _camera_set_resolution(index, true);
 }
 
 static esp_err_t _switch_button_init(void)
@@ -315,6 +830,159 @@ static esp_err_t _switch_button_init(void)
     return ret;
 }
 
+#if DEMO_GOVERNOR_ENABLE
+static void _governor_create(void)
+{
+    const size_t count = camera_resolution_info.camera_frame_list_num;
+    resolution_governor_size_t *sizes = malloc(count * sizeof(resolution_governor_size_t));
+    if (sizes == NULL)
+    {
+        ESP_LOGW(TAG, "no memory for the resolution governor");
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        sizes[i].width = camera_resolution_info.camera_frame_list[i].width;
+        sizes[i].height = camera_resolution_info.camera_frame_list[i].height;
+    }
+    resolution_governor_config_t config = RESOLUTION_GOVERNOR_DEFAULT_CONFIG();
+    config.target_fps_x10 = DEMO_GOVERNOR_TARGET_FPS * 10;
+
+    /* Another camera may have other resolutions, start over */
+    xSemaphoreTake(s_resolution_lock, portMAX_DELAY);
+    resolution_governor_delete(governor);
+    governor = NULL;
+    if (resolution_governor_create(&config, sizes, count, camera_resolution_info.camera_currect_frame_index, &governor) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "resolution governor create failed");
+    }
+    xSemaphoreGive(s_resolution_lock);
+    free(sizes);
+}
+
+static int _resolution_cmd(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "auto") == 0)
+    {
+        governor_auto = true;
+    }
+    else if (argc > 1 && strcmp(argv[1], "manual") == 0)
+    {
+        /* The resolution the governor left is the one kept from now on, also after a reboot */
+        governor_auto = false;
+        if (xEventGroupGetBits(s_evt_handle) & BIT0_FRAME_START)
+        {
+            _camera_save_resolution();
+        }
+    }
+    printf("governor %s, target %d fps\n", governor_auto ? "auto" : "manual", DEMO_GOVERNOR_TARGET_FPS);
+
+    xSemaphoreTake(s_resolution_lock, portMAX_DELAY);
+    for (size_t i = 0; governor != NULL && i < camera_resolution_info.camera_frame_list_num; i++)
+    {
+        resolution_governor_info_t info;
+        resolution_governor_get_info(governor, i, &info);
+        printf("%c %4ux%-4u %4" PRIu32 ".%" PRIu32 " fps %-9s %u failures, retry in %" PRIu32 "\n",
+               (i == camera_resolution_info.camera_currect_frame_index) ? '*' : ' ',
+               camera_resolution_info.camera_frame_list[i].width, camera_resolution_info.camera_frame_list[i].height,
+               info.capacity_fps_x10 / 10, info.capacity_fps_x10 % 10, info.measured ? "measured" : "predicted",
+               info.failures, info.retry_in);
+    }
+    xSemaphoreGive(s_resolution_lock);
+    return 0;
+}
+
+static esp_err_t _governor_init(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "resolution",
+        .help = "Show the decode capacity per resolution, or let the governor pick the resolution again",
+        .hint = "[auto|manual]",
+        .func = &_resolution_cmd,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+#endif
+
+#if DEMO_MOTION_ENABLE
+static int _motion_cmd(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "on") == 0)
+    {
+        /* The scene may have changed while off */
+        motion_detect_reset(motion);
+        motion_enabled = true;
+    }
+    else if (argc > 1 && strcmp(argv[1], "off") == 0)
+    {
+        motion_enabled = false;
+    }
+    else if (argc > 1)
+    {
+        const int sensitivity = atoi(argv[1]);
+        if (sensitivity < 1 || sensitivity > 100 || motion_detect_set_sensitivity(motion, sensitivity) != ESP_OK)
+        {
+            printf("usage: motion [on|off|<sensitivity 1-100>]\n");
+            return 1;
+        }
+    }
+
+    motion_detect_stats_t stats;
+    motion_detect_get_stats(motion, &stats);
+    printf("motion %s, %" PRIu32 " frames, %" PRIu32 " with motion, %" PRIu32 " lighting changes, %u of %u cells active\n",
+           motion_enabled ? "on" : "off", stats.frames, stats.motion_frames, stats.relearned,
+           stats.active_cells, stats.total_cells);
+    return 0;
+}
+
+static esp_err_t _motion_init(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "motion",
+        .help = "Turn the motion detection on or off, or set its sensitivity",
+        .hint = "[on|off|<sensitivity>]",
+        .func = &_motion_cmd,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+#endif
+
+static int _mem_cmd(int argc, char **argv)
+{
+    static uint16_t session = 0;
+    if (argc > 1 && strcmp(argv[1], "begin") == 0)
+    {
+        session = audio_mem_session_begin();
+        printf("session %u started\n", session);
+    }
+    else if (argc > 1 && strcmp(argv[1], "end") == 0)
+    {
+        printf("session %u, %u allocations not freed\n", session, (unsigned)audio_mem_session_end(session));
+    }
+
+    static const char *const names[AUDIO_MEM_POOL_MAX] = {"internal", "default"};
+    for (int i = 0; i < AUDIO_MEM_POOL_MAX; i++)
+    {
+        audio_mem_stats_t stats;
+        audio_mem_get_stats(i, &stats);
+        printf("%-8s pool %u/%u, in use %u, high water %u, %" PRIu32 " allocs, %" PRIu32 " live, %" PRIu32 " from heap, %" PRIu32 " failed\n",
+               names[i], (unsigned)stats.pool_carved, (unsigned)stats.pool_size, (unsigned)stats.in_use,
+               (unsigned)stats.high_water, stats.allocs, stats.live, stats.heap_allocs + stats.untracked, stats.failures);
+    }
+    return 0;
+}
+
+static esp_err_t _mem_init(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "mem",
+        .help = "Show the codec memory pools, or check the allocations of a session for leaks",
+        .hint = "[begin|end]",
+        .func = &_mem_cmd,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
 static void _stream_state_changed_cb(usb_stream_state_t event, void *arg)
 {
     switch (event)
@@ -325,19 +993,27 @@ static void _stream_state_changed_cb(usb_stream_state_t event, void *arg)
         size_t size = sizeof(camera_frame_size_t);
         _get_value_from_nvs(DEMO_KEY_RESOLUTION, &camera_resolution_info.camera_frame_size, &size);
         size_t frame_index = 0;
-        uvc_frame_size_list_get(NULL, &camera_resolution_info.camera_frame_list_num, NULL);
-        if (camera_resolution_info.camera_frame_list_num)
+        size_t frame_num = 0;
+        uvc_frame_size_list_get(NULL, &frame_num, NULL);
+        if (frame_num)
         {
-            ESP_LOGI(TAG, "UVC: get frame list size = %u, current = %u", camera_resolution_info.camera_frame_list_num, frame_index);
-            uvc_frame_size_t *_frame_list = (uvc_frame_size_t *)malloc(camera_resolution_info.camera_frame_list_num * sizeof(uvc_frame_size_t));
+            ESP_LOGI(TAG, "UVC: get frame list size = %u, current = %u", frame_num, frame_index);
+            uvc_frame_size_t *_frame_list = (uvc_frame_size_t *)malloc(frame_num * sizeof(uvc_frame_size_t));
 
-            camera_resolution_info.camera_frame_list = (uvc_frame_size_t *)realloc(camera_resolution_info.camera_frame_list, camera_resolution_info.camera_frame_list_num * sizeof(uvc_frame_size_t));
-            if (NULL == camera_resolution_info.camera_frame_list)
+            /* The console and the display task walk the list and the index under the lock */
+            xSemaphoreTake(s_resolution_lock, portMAX_DELAY);
+            uvc_frame_size_t *frame_list = (uvc_frame_size_t *)realloc(camera_resolution_info.camera_frame_list, frame_num * sizeof(uvc_frame_size_t));
+            if (NULL == frame_list || NULL == _frame_list)
             {
                 ESP_LOGE(TAG, "camera_resolution_info.camera_frame_list");
+                camera_resolution_info.camera_frame_list_num = 0;
+                xSemaphoreGive(s_resolution_lock);
+                free(_frame_list);
+                break;
             }
+            camera_resolution_info.camera_frame_list = frame_list;
             uvc_frame_size_list_get(_frame_list, NULL, NULL);
-            for (size_t i = 0; i < camera_resolution_info.camera_frame_list_num; i++)
+            for (size_t i = 0; i < frame_num; i++)
             {
                 if (_frame_list[i].width <= DEMO_MAX_H && _frame_list[i].height <= DEMO_MAX_V)
                 {
@@ -359,9 +1035,12 @@ static void _stream_state_changed_cb(usb_stream_state_t event, void *arg)
                 camera_resolution_info.camera_currect_frame_index = 0;
             }
 
+            xSemaphoreGive(s_resolution_lock);
+
             if (-1 == camera_resolution_info.camera_currect_frame_index)
             {
                 ESP_LOGE(TAG, "fine current resolution fail");
+                free(_frame_list);
                 break;
             }
             ESP_ERROR_CHECK(uvc_frame_size_reset(camera_resolution_info.camera_frame_list[camera_resolution_info.camera_currect_frame_index].width,
@@ -371,6 +1050,9 @@ static void _stream_state_changed_cb(usb_stream_state_t event, void *arg)
                 .height = camera_resolution_info.camera_frame_list[camera_resolution_info.camera_currect_frame_index].height,
             };
             ESP_ERROR_CHECK(_set_value_to_nvs(DEMO_KEY_RESOLUTION, &camera_frame_size, sizeof(camera_frame_size_t)));
+#if DEMO_GOVERNOR_ENABLE
+            _governor_create();
+#endif
 
             if (_frame_list != NULL)
             {
@@ -382,7 +1064,7 @@ static void _stream_state_changed_cb(usb_stream_state_t event, void *arg)
         }
         else
         {
-            ESP_LOGW(TAG, "UVC: get frame list size = %u", camera_resolution_info.camera_frame_list_num);
+            ESP_LOGW(TAG, "UVC: get frame list size = %u", frame_num);
         }
         ESP_LOGI(TAG, "Device connected");
         break;
@@ -418,6 +1100,8 @@ void app_main(void)
         ESP_LOGE(TAG, "line-%u event group create failed", __LINE__);
         assert(0);
     }
+    s_resolution_lock = xSemaphoreCreateMutex();
+    assert(s_resolution_lock != NULL);
 
     /* malloc double buffer for usb payload, xfer_buffer_size >= frame_buffer_size*/
     // xfer_buffer_a = (uint8_t *)heap_caps_calloc(1, DEMO_UVC_XFER_BUFFER_SIZE, MALLOC_CAP_SPIRAM);
@@ -433,6 +1117,32 @@ void app_main(void)
     /* Initialize the screen */
     ESP_ERROR_CHECK(_display_init());
 
+    /* The codec allocations repeated at every frame are served by pools instead of the heap */
+    const audio_mem_config_t mem_config = {
+        .inner_size = DEMO_CODEC_INNER_POOL,
+        .default_size = DEMO_CODEC_DEFAULT_POOL,
+    };
+    ESP_ERROR_CHECK(audio_mem_init(&mem_config));
+
+    /* Start the decode and display stages */
+    ESP_ERROR_CHECK(_pipeline_init());
+
+    /* Per stage statistics on the console */
+    if (telemetry_console_start() != ESP_OK)
+    {
+        ESP_LOGW(TAG, "telemetry console start failed");
+    }
+#if DEMO_RECORD_ENABLE || DEMO_SNAPSHOT_ENABLE
+    _storage_init();
+#endif
+#if DEMO_GOVERNOR_ENABLE
+    _governor_init();
+#endif
+#if DEMO_MOTION_ENABLE
+    _motion_init();
+#endif
+    _mem_init();
+
     /* Initialize the button to switch resolution */
     ESP_ERROR_CHECK(_switch_button_init());
 
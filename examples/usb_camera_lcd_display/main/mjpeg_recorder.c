@@ -0,0 +1,275 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "avi_writer.h"
+#include "frame_queue.h"
+#include "mjpeg_recorder.h"
+
+#define RECORDER_BUFFER_ALIGN   32
+#define RECORDER_POLL_MS        100
+#define RECORDER_MAX_FILES      10000
+
+static const char *TAG = "mjpeg_recorder";
+
+struct mjpeg_recorder_t
+{
+    mjpeg_recorder_config_t config;
+    frame_queue_handle_t queue;
+    uint8_t *buffer;                /* Write buffer, internal DMA capable memory */
+    volatile bool recording;        /* Frames are accepted */
+    volatile bool active;           /* The writer task owns a recording, until the stop is done */
+    volatile bool stop_request;
+    SemaphoreHandle_t done;
+    uint32_t fps;
+    uint32_t file_number;
+    FILE *file;
+    avi_writer_handle_t writer;
+    uint16_t width;
+    uint16_t height;
+    mjpeg_recorder_stats_t stats;
+};
+
+static esp_err_t recorder_open_file(struct mjpeg_recorder_t *rec, uint16_t width, uint16_t height)
+{
+    char path[64];
+    struct stat st;
+    do
+    {
+        snprintf(path, sizeof(path), "%s/REC_%04" PRIu32 ".AVI", rec->config.dir, rec->file_number++);
+    } while (stat(path, &st) == 0 && rec->file_number < RECORDER_MAX_FILES);
+
+    rec->file = fopen(path, "wb");
+    if (rec->file == NULL)
+    {
+        ESP_LOGE(TAG, "open %s failed", path);
+        return ESP_FAIL;
+    }
+    /* The writer already hands whole buffers to the file system */
+    setvbuf(rec->file, NULL, _IONBF, 0);
+
+    const avi_writer_config_t config = {
+        .width = width,
+        .height = height,
+        .fps = rec->fps,
+        .buffer = rec->buffer,
+        .buffer_size = rec->config.write_buffer_size,
+    };
+    esp_err_t ret = avi_writer_open(&config, rec->file, &rec->writer);
+    if (ret != ESP_OK)
+    {
+        fclose(rec->file);
+        rec->file = NULL;
+        return ret;
+    }
+    rec->width = width;
+    rec->height = height;
+    rec->stats.files++;
+    ESP_LOGI(TAG, "recording %dx%d to %s", width, height, path);
+    return ESP_OK;
+}
+
+static void recorder_close_file(struct mjpeg_recorder_t *rec)
+{
+    if (rec->writer == NULL)
+    {
+        return;
+    }
+    avi_writer_stats_t stats;
+    avi_writer_get_stats(rec->writer, &stats);
+    if (avi_writer_close(rec->writer) != ESP_OK)
+    {
+        rec->stats.errors++;
+        ESP_LOGE(TAG, "file completion failed");
+    }
+    const long size = ftell(rec->file);
+    fclose(rec->file);
+    rec->writer = NULL;
+    rec->file = NULL;
+    ESP_LOGI(TAG, "file done: %" PRIu32 " frames, %ld bytes, %" PRIu32 " us per frame",
+             stats.frames, size, stats.us_per_frame);
+}
+
+/* Every way out of a recording ends here, a pending stop is told it is done */
+static void recorder_finish(struct mjpeg_recorder_t *rec)
+{
+    recorder_close_file(rec);
+    rec->recording = false;
+    rec->active = false;
+    if (rec->stop_request)
+    {
+        rec->stop_request = false;
+        xSemaphoreGive(rec->done);
+    }
+}
+
+static void recorder_write(struct mjpeg_recorder_t *rec, const frame_slot_t *slot)
+{
+    if (!rec->active)
+    {
+        return;
+    }
+    if (rec->writer != NULL && (slot->width != rec->width || slot->height != rec->height))
+    {
+        recorder_close_file(rec);
+    }
+    if (rec->writer == NULL && recorder_open_file(rec, slot->width, slot->height) != ESP_OK)
+    {
+        /* No card or no space, give up instead of failing on every frame */
+        rec->stats.errors++;
+        recorder_finish(rec);
+        return;
+    }
+
+    esp_err_t ret = avi_writer_add_frame(rec->writer, slot->data, slot->len, slot->timestamp_us);
+    if (ret == ESP_ERR_INVALID_SIZE)
+    {
+        recorder_close_file(rec);
+        ret = recorder_open_file(rec, slot->width, slot->height);
+        if (ret == ESP_OK)
+        {
+            ret = avi_writer_add_frame(rec->writer, slot->data, slot->len, slot->timestamp_us);
+        }
+    }
+    if (ret != ESP_OK)
+    {
+        rec->stats.errors++;
+        return;
+    }
+    rec->stats.frames++;
+}
+
+static void recorder_task(void *arg)
+{
+    struct mjpeg_recorder_t *rec = arg;
+
+    while (1)
+    {
+        frame_slot_t *slot = frame_queue_acquire_read(rec->queue, pdMS_TO_TICKS(RECORDER_POLL_MS));
+        if (slot != NULL)
+        {
+            recorder_write(rec, slot);
+            frame_queue_release(rec->queue, slot);
+            continue;
+        }
+        /* The queue is empty, every frame pushed before the stop is in the file */
+        if (rec->stop_request)
+        {
+            recorder_finish(rec);
+        }
+    }
+}
+
+esp_err_t mjpeg_recorder_create(const mjpeg_recorder_config_t *config, mjpeg_recorder_handle_t *ret_handle)
+{
+    if (config == NULL || config->dir == NULL || ret_handle == NULL || config->queue_depth < 2 ||
+        config->write_buffer_size == 0 || config->write_buffer_size % AVI_WRITER_ALIGN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct mjpeg_recorder_t *rec = calloc(1, sizeof(struct mjpeg_recorder_t));
+    if (rec == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    rec->config = *config;
+    rec->done = xSemaphoreCreateBinary();
+    rec->buffer = heap_caps_aligned_alloc(RECORDER_BUFFER_ALIGN, config->write_buffer_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+    if (rec->done == NULL || rec->buffer == NULL ||
+        frame_queue_create(config->queue_depth, config->frame_capacity, MALLOC_CAP_SPIRAM, &rec->queue) != ESP_OK)
+    {
+        goto _err;
+    }
+    if (xTaskCreatePinnedToCore(recorder_task, "mjpeg_recorder", 4 * 1024, rec, config->task_priority, NULL, config->task_core) != pdPASS)
+    {
+        frame_queue_delete(rec->queue);
+        goto _err;
+    }
+
+    *ret_handle = rec;
+    return ESP_OK;
+
+_err:
+    if (rec->done != NULL)
+    {
+        vSemaphoreDelete(rec->done);
+    }
+    heap_caps_free(rec->buffer);
+    free(rec);
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t mjpeg_recorder_start(mjpeg_recorder_handle_t handle, uint32_t fps)
+{
+    if (handle->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* The file is opened with the first frame, whose size it takes */
+    handle->fps = fps ? fps : 30;
+    handle->active = true;
+    handle->recording = true;
+    return ESP_OK;
+}
+
+void mjpeg_recorder_push(mjpeg_recorder_handle_t handle, const uint8_t *data, size_t len,
+                         uint16_t width, uint16_t height, int64_t timestamp_us)
+{
+    if (handle == NULL || !handle->recording)
+    {
+        return;
+    }
+    frame_slot_t *slot = frame_queue_acquire_write(handle->queue);
+    if (slot == NULL)
+    {
+        return;
+    }
+    if (len > slot->capacity)
+    {
+        frame_queue_cancel(handle->queue, slot);
+        return;
+    }
+    memcpy(slot->data, data, len);
+    slot->len = len;
+    slot->width = width;
+    slot->height = height;
+    slot->timestamp_us = timestamp_us;
+    frame_queue_commit(handle->queue, slot);
+}
+
+esp_err_t mjpeg_recorder_stop(mjpeg_recorder_handle_t handle, TickType_t ticks_to_wait)
+{
+    if (!handle->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(handle->done, 0);
+    handle->recording = false;
+    handle->stop_request = true;
+    return (xSemaphoreTake(handle->done, ticks_to_wait) == pdTRUE) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+bool mjpeg_recorder_is_recording(mjpeg_recorder_handle_t handle)
+{
+    return handle->recording;
+}
+
+void mjpeg_recorder_get_stats(mjpeg_recorder_handle_t handle, mjpeg_recorder_stats_t *stats)
+{
+    frame_queue_stats_t queue_stats;
+    frame_queue_get_stats(handle->queue, &queue_stats);
+    *stats = handle->stats;
+    stats->dropped = queue_stats.dropped + queue_stats.rejected;
+}
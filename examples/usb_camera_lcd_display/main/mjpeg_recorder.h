@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+/**
+ * Records the MJPEG frames of the camera to AVI files, as they come from
+ * the camera. Frames are copied into a queue of their own and written by
+ * a background task, so a slow card drops recorded frames, never the
+ * displayed ones. A file that reaches AVI_WRITER_MAX_BYTES, or a change
+ * of resolution, continues in the next file.
+ */
+typedef struct
+{
+    const char *dir;            /*!< Directory of the files, e.g. the SD card mount point */
+    int queue_depth;            /*!< Frames waiting to be written */
+    size_t frame_capacity;      /*!< Largest JPEG frame */
+    size_t write_buffer_size;   /*!< Bytes per write to the card, a multiple of 512 */
+    UBaseType_t task_priority;  /*!< Writer task priority */
+    BaseType_t task_core;       /*!< Writer task core */
+} mjpeg_recorder_config_t;
+
+typedef struct
+{
+    uint32_t files;             /*!< Files started */
+    uint32_t frames;            /*!< Frames written */
+    uint32_t dropped;           /*!< Frames dropped because the card was too slow */
+    uint32_t errors;            /*!< Write errors */
+} mjpeg_recorder_stats_t;
+
+typedef struct mjpeg_recorder_t *mjpeg_recorder_handle_t;
+
+/**
+ * @brief Create the recorder and its writer task
+ *
+ * @param config recorder configuration
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t mjpeg_recorder_create(const mjpeg_recorder_config_t *config, mjpeg_recorder_handle_t *ret_handle);
+
+/**
+ * @brief Start recording into a new file
+ *
+ * @param handle recorder handle
+ * @param fps nominal frame rate, the measured one is written on stop
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_STATE Already recording
+ */
+esp_err_t mjpeg_recorder_start(mjpeg_recorder_handle_t handle, uint32_t fps);
+
+/**
+ * @brief Queue a frame, never blocks, does nothing unless recording
+ *
+ * @param handle recorder handle
+ * @param data JPEG data
+ * @param len JPEG data length
+ * @param width frame width
+ * @param height frame height
+ * @param timestamp_us capture time
+ */
+void mjpeg_recorder_push(mjpeg_recorder_handle_t handle, const uint8_t *data, size_t len,
+                         uint16_t width, uint16_t height, int64_t timestamp_us);
+
+/**
+ * @brief Write the queued frames, complete the file and stop
+ *
+ * @param handle recorder handle
+ * @param ticks_to_wait time to wait for the file to be complete
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_STATE Not recording
+ *         ESP_ERR_TIMEOUT       The file is still being completed
+ */
+esp_err_t mjpeg_recorder_stop(mjpeg_recorder_handle_t handle, TickType_t ticks_to_wait);
+
+/**
+ * @brief Tell if recording
+ *
+ * @param handle recorder handle
+ * @return true if recording
+ */
+bool mjpeg_recorder_is_recording(mjpeg_recorder_handle_t handle);
+
+/**
+ * @brief Get the recorder counters
+ *
+ * @param handle recorder handle
+ * @param stats returned counters
+ */
+void mjpeg_recorder_get_stats(mjpeg_recorder_handle_t handle, mjpeg_recorder_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
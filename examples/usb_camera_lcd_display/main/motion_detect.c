@@ -0,0 +1,441 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "motion_detect.h"
+
+#define MOTION_THRESHOLD_MIN    4       /* Mean luma difference of a cell at sensitivity 100 */
+#define MOTION_THRESHOLD_MAX    48      /* Mean luma difference of a cell at sensitivity 1 */
+#define MOTION_ACTIVE_SLOWDOWN  2       /* Active cells learn 2^n times slower, a stopped object fades in */
+
+typedef struct
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+} motion_mask_t;
+
+struct motion_detect_t
+{
+    motion_detect_config_t config;
+    uint16_t width;
+    uint16_t height;
+    uint16_t luma_width;
+    uint16_t luma_height;
+    uint16_t cells_width;
+    uint16_t cells_height;
+    uint8_t sample_shift;           /* log2 of the samples per luma pixel */
+    uint8_t threshold;
+    uint8_t *luma;                  /* Current frame */
+    uint16_t *background;           /* Learnt scene, 8 fractional bits */
+    uint16_t *row_sum;              /* Sums of the luma row being reduced */
+    uint8_t *level;                 /* Mean difference of the active cells, 0 elsewhere */
+    uint8_t *masked;                /* Cells to ignore */
+    uint16_t *stack;                /* Cells waiting in the box search */
+    uint32_t learnt;                /* Frames learnt since the last reset */
+    motion_mask_t masks[MOTION_DETECT_MAX_MASKS];
+    motion_box_t boxes[MOTION_DETECT_MAX_BOXES];
+    motion_detect_stats_t stats;
+};
+
+static inline uint8_t rgb565_luma(const uint8_t *p, bool big_endian)
+{
+    const uint16_t v = big_endian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+    /* BT.601 weights on the 5/6/5 bit fields, close enough for differences */
+    return (616 * (v >> 11) + 600 * ((v >> 5) & 0x3F) + 232 * (v & 0x1F)) >> 8;
+}
+
+static uint8_t motion_threshold(uint8_t sensitivity)
+{
+    return MOTION_THRESHOLD_MIN + (100 - sensitivity) * (MOTION_THRESHOLD_MAX - MOTION_THRESHOLD_MIN) / 99;
+}
+
+static void motion_free_planes(struct motion_detect_t *motion)
+{
+    free(motion->luma);
+    free(motion->background);
+    free(motion->row_sum);
+    free(motion->level);
+    free(motion->masked);
+    free(motion->stack);
+    motion->luma = NULL;
+    motion->background = NULL;
+    motion->row_sum = NULL;
+    motion->level = NULL;
+    motion->masked = NULL;
+    motion->stack = NULL;
+    motion->width = 0;
+    motion->height = 0;
+}
+
+static void motion_update_masks(struct motion_detect_t *motion)
+{
+    if (motion->masked == NULL)
+    {
+        return;
+    }
+    /* A cell is ignored when its centre is inside a mask */
+    for (uint16_t cy = 0; cy < motion->cells_height; cy++)
+    {
+        const uint32_t center_y = (2 * cy + 1) * MOTION_DETECT_MASK_SCALE / (2 * motion->cells_height);
+        for (uint16_t cx = 0; cx < motion->cells_width; cx++)
+        {
+            const uint32_t center_x = (2 * cx + 1) * MOTION_DETECT_MASK_SCALE / (2 * motion->cells_width);
+            uint8_t masked = 0;
+            for (int i = 0; i < MOTION_DETECT_MAX_MASKS && !masked; i++)
+            {
+                const motion_mask_t *mask = &motion->masks[i];
+                masked = mask->width > 0 && center_x >= mask->x && center_x < (uint32_t)mask->x + mask->width &&
+                         center_y >= mask->y && center_y < (uint32_t)mask->y + mask->height;
+            }
+            motion->masked[cy * motion->cells_width + cx] = masked;
+        }
+    }
+}
+
+static esp_err_t motion_alloc_planes(struct motion_detect_t *motion, uint16_t width, uint16_t height)
+{
+    const uint8_t scale = motion->config.scale;
+    const uint16_t luma_width = width / scale;
+    const uint16_t luma_height = height / scale;
+    const uint16_t cells_width = luma_width / motion->config.cell;
+    const uint16_t cells_height = luma_height / motion->config.cell;
+    if (cells_width == 0 || cells_height == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const size_t pixels = luma_width * luma_height;
+    const size_t cells = cells_width * cells_height;
+    motion->luma = malloc(pixels);
+    motion->background = malloc(pixels * sizeof(uint16_t));
+    motion->row_sum = malloc(luma_width * sizeof(uint16_t));
+    motion->level = malloc(cells);
+    motion->masked = malloc(cells);
+    motion->stack = malloc(cells * sizeof(uint16_t));
+    if (motion->luma == NULL || motion->background == NULL || motion->row_sum == NULL ||
+        motion->level == NULL || motion->masked == NULL || motion->stack == NULL)
+    {
+        motion_free_planes(motion);
+        return ESP_ERR_NO_MEM;
+    }
+    motion->width = width;
+    motion->height = height;
+    motion->luma_width = luma_width;
+    motion->luma_height = luma_height;
+    motion->cells_width = cells_width;
+    motion->cells_height = cells_height;
+    motion->learnt = 0;
+    motion->stats.total_cells = cells;
+    motion_update_masks(motion);
+    return ESP_OK;
+}
+
+/* Reduce the frame to the luma plane, from every other pixel of every other row */
+static void motion_reduce(struct motion_detect_t *motion, const uint8_t *rgb565)
+{
+    const uint8_t scale = motion->config.scale;
+    const bool big_endian = motion->config.big_endian;
+    const size_t stride = motion->width * 2;
+    for (uint16_t ly = 0; ly < motion->luma_height; ly++)
+    {
+        memset(motion->row_sum, 0, motion->luma_width * sizeof(uint16_t));
+        for (uint8_t sy = 0; sy < scale; sy += 2)
+        {
+            const uint8_t *row = rgb565 + (ly * scale + sy) * stride;
+            for (uint16_t lx = 0; lx < motion->luma_width; lx++)
+            {
+                const uint8_t *p = row + lx * scale * 2;
+                for (uint8_t sx = 0; sx < scale; sx += 2)
+                {
+                    motion->row_sum[lx] += rgb565_luma(p + sx * 2, big_endian);
+                }
+            }
+        }
+        uint8_t *luma = motion->luma + ly * motion->luma_width;
+        for (uint16_t lx = 0; lx < motion->luma_width; lx++)
+        {
+            luma[lx] = motion->row_sum[lx] >> motion->sample_shift;
+        }
+    }
+}
+
+/* Compare each cell with the background, then let the background learn it */
+static uint16_t motion_compare(struct motion_detect_t *motion, bool report)
+{
+    const uint8_t cell = motion->config.cell;
+    const uint16_t cell_area = cell * cell;
+    uint16_t active = 0;
+    for (uint16_t cy = 0; cy < motion->cells_height; cy++)
+    {
+        for (uint16_t cx = 0; cx < motion->cells_width; cx++)
+        {
+            const size_t first = (size_t)cy * cell * motion->luma_width + cx * cell;
+            uint32_t sum = 0;
+            for (uint8_t y = 0; y < cell; y++)
+            {
+                const uint8_t *luma = motion->luma + first + y * motion->luma_width;
+                const uint16_t *background = motion->background + first + y * motion->luma_width;
+                for (uint8_t x = 0; x < cell; x++)
+                {
+                    const int diff = luma[x] - (background[x] >> 8);
+                    sum += (diff < 0) ? -diff : diff;
+                }
+            }
+
+            const size_t index = cy * motion->cells_width + cx;
+            const uint8_t level = sum / cell_area;
+            const bool is_active = report && !motion->masked[index] && level >= motion->threshold;
+            motion->level[index] = is_active ? level : 0;
+            active += is_active;
+
+            const uint8_t shift = motion->config.learn_shift + (is_active ? MOTION_ACTIVE_SLOWDOWN : 0);
+            for (uint8_t y = 0; y < cell; y++)
+            {
+                const uint8_t *luma = motion->luma + first + y * motion->luma_width;
+                uint16_t *background = motion->background + first + y * motion->luma_width;
+                for (uint8_t x = 0; x < cell; x++)
+                {
+                    background[x] += (((int32_t)luma[x] << 8) - background[x]) >> shift;
+                }
+            }
+        }
+    }
+    return active;
+}
+
+static void motion_add_box(struct motion_detect_t *motion, size_t *count, const motion_box_t *box)
+{
+    /* Keep the largest boxes, sorted */
+    size_t i = *count;
+    if (i == MOTION_DETECT_MAX_BOXES)
+    {
+        if (box->cells <= motion->boxes[i - 1].cells)
+        {
+            return;
+        }
+        i--;
+    }
+    else
+    {
+        (*count)++;
+    }
+    while (i > 0 && motion->boxes[i - 1].cells < box->cells)
+    {
+        motion->boxes[i] = motion->boxes[i - 1];
+        i--;
+    }
+    motion->boxes[i] = *box;
+}
+
+/* Merge touching active cells, the levels are cleared on the way */
+static size_t motion_find_boxes(struct motion_detect_t *motion)
+{
+    const uint16_t cells_width = motion->cells_width;
+    const uint16_t cells_height = motion->cells_height;
+    const uint16_t cell_pixels = motion->config.cell * motion->config.scale;
+    size_t count = 0;
+    for (size_t start = 0; start < (size_t)cells_width * cells_height; start++)
+    {
+        if (motion->level[start] == 0)
+        {
+            continue;
+        }
+        uint16_t x0 = start % cells_width, x1 = x0;
+        uint16_t y0 = start / cells_width, y1 = y0;
+        uint16_t cells = 0;
+        uint8_t level = 0;
+        size_t depth = 0;
+        motion->stack[depth++] = start;
+        if (motion->level[start] > level)
+        {
+            level = motion->level[start];
+        }
+        motion->level[start] = 0;
+        while (depth > 0)
+        {
+            const uint16_t index = motion->stack[--depth];
+            const uint16_t cx = index % cells_width;
+            const uint16_t cy = index / cells_width;
+            cells++;
+            x0 = (cx < x0) ? cx : x0;
+            x1 = (cx > x1) ? cx : x1;
+            y0 = (cy < y0) ? cy : y0;
+            y1 = (cy > y1) ? cy : y1;
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    const int nx = cx + dx;
+                    const int ny = cy + dy;
+                    if (nx < 0 || ny < 0 || nx >= cells_width || ny >= cells_height)
+                    {
+                        continue;
+                    }
+                    const uint16_t next = ny * cells_width + nx;
+                    if (motion->level[next] != 0)
+                    {
+                        level = (motion->level[next] > level) ? motion->level[next] : level;
+                        motion->level[next] = 0;
+                        motion->stack[depth++] = next;
+                    }
+                }
+            }
+        }
+        if (cells < motion->config.min_cells)
+        {
+            continue;
+        }
+        const motion_box_t box = {
+            .x = x0 * cell_pixels,
+            .y = y0 * cell_pixels,
+            .width = (x1 - x0 + 1) * cell_pixels,
+            .height = (y1 - y0 + 1) * cell_pixels,
+            .cells = cells,
+            .level = level,
+        };
+        motion_add_box(motion, &count, &box);
+    }
+    return count;
+}
+
+esp_err_t motion_detect_create(const motion_detect_config_t *config, motion_detect_handle_t *ret_handle)
+{
+    if (config == NULL || ret_handle == NULL || (config->scale != 2 && config->scale != 4 && config->scale != 8) ||
+        config->cell == 0 || config->cell > 15 || config->sensitivity == 0 || config->sensitivity > 100 ||
+        config->learn_shift == 0 || config->learn_shift > 8 || config->global_pct > 100)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct motion_detect_t *motion = calloc(1, sizeof(struct motion_detect_t));
+    if (motion == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    motion->config = *config;
+    motion->threshold = motion_threshold(config->sensitivity);
+    /* (scale / 2)^2 samples per luma pixel */
+    motion->sample_shift = (config->scale == 2) ? 0 : (config->scale == 4) ? 2 : 4;
+    *ret_handle = motion;
+    return ESP_OK;
+}
+
+esp_err_t motion_detect_process(motion_detect_handle_t handle, const uint8_t *rgb565, uint16_t width, uint16_t height,
+                                size_t *ret_count)
+{
+    if (handle == NULL || rgb565 == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ret_count != NULL)
+    {
+        *ret_count = 0;
+    }
+    if (width != handle->width || height != handle->height)
+    {
+        motion_free_planes(handle);
+        esp_err_t ret = motion_alloc_planes(handle, width, height);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    motion_reduce(handle, rgb565);
+    handle->stats.frames++;
+    if (handle->learnt == 0)
+    {
+        for (size_t i = 0; i < (size_t)handle->luma_width * handle->luma_height; i++)
+        {
+            handle->background[i] = handle->luma[i] << 8;
+        }
+    }
+
+    const bool report = handle->learnt >= handle->config.warmup_frames;
+    handle->learnt++;
+    const uint16_t active = motion_compare(handle, report);
+    handle->stats.active_cells = active;
+    if (active == 0)
+    {
+        return ESP_OK;
+    }
+    if (handle->config.global_pct && active * 100U >= (uint32_t)handle->config.global_pct * handle->stats.total_cells)
+    {
+        /* The whole scene changed, take it as the new background */
+        for (size_t i = 0; i < (size_t)handle->luma_width * handle->luma_height; i++)
+        {
+            handle->background[i] = handle->luma[i] << 8;
+        }
+        handle->stats.relearned++;
+        return ESP_OK;
+    }
+
+    const size_t count = motion_find_boxes(handle);
+    if (count > 0)
+    {
+        handle->stats.motion_frames++;
+        if (handle->config.callback != NULL)
+        {
+            handle->config.callback(handle->boxes, count, handle->config.ctx);
+        }
+    }
+    if (ret_count != NULL)
+    {
+        *ret_count = count;
+    }
+    return ESP_OK;
+}
+
+esp_err_t motion_detect_set_mask(motion_detect_handle_t handle, size_t index, uint16_t x, uint16_t y,
+                                 uint16_t width, uint16_t height)
+{
+    if (handle == NULL || index >= MOTION_DETECT_MAX_MASKS || x > MOTION_DETECT_MASK_SCALE || y > MOTION_DETECT_MASK_SCALE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->masks[index] = (motion_mask_t) {
+        .x = x,
+        .y = y,
+        .width = width,
+        .height = height,
+    };
+    motion_update_masks(handle);
+    return ESP_OK;
+}
+
+esp_err_t motion_detect_set_sensitivity(motion_detect_handle_t handle, uint8_t sensitivity)
+{
+    if (handle == NULL || sensitivity == 0 || sensitivity > 100)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->config.sensitivity = sensitivity;
+    handle->threshold = motion_threshold(sensitivity);
+    return ESP_OK;
+}
+
+void motion_detect_reset(motion_detect_handle_t handle)
+{
+    handle->learnt = 0;
+}
+
+void motion_detect_get_stats(motion_detect_handle_t handle, motion_detect_stats_t *stats)
+{
+    *stats = handle->stats;
+}
+
+void motion_detect_delete(motion_detect_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return;
+    }
+    motion_free_planes(handle);
+    free(handle);
+}
@@ -0,0 +1,173 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define MOTION_DETECT_MAX_BOXES     8       /*!< Boxes reported per frame, the largest ones */
+#define MOTION_DETECT_MAX_MASKS     4       /*!< Regions that can be ignored */
+#define MOTION_DETECT_MASK_SCALE    1000    /*!< Mask coordinates are in thousandths of the frame */
+
+/**
+ * Detects motion in RGB565 frames. Each frame is reduced to a small luma
+ * plane, `scale` times smaller each way, compared with a background that
+ * slowly learns the scene, and the difference is judged per cell of
+ * `cell` x `cell` luma pixels. Touching active cells are merged into
+ * boxes, reported in frame pixels through the callback. A change of most
+ * of the cells, like a light switched on, is learnt as the new background
+ * instead of being reported.
+ *
+ * The detector is plain C without OS dependency, one instance per stream.
+ */
+typedef struct
+{
+    uint16_t x;                 /*!< Left edge, frame pixels */
+    uint16_t y;                 /*!< Top edge, frame pixels */
+    uint16_t width;             /*!< Width, frame pixels */
+    uint16_t height;            /*!< Height, frame pixels */
+    uint16_t cells;             /*!< Active cells in the box */
+    uint8_t level;              /*!< Strongest mean luma difference of its cells */
+} motion_box_t;
+
+/**
+ * @brief Called after each frame with motion, from the caller of motion_detect_process
+ *
+ * @param boxes moving regions, largest first, only valid during the call
+ * @param count number of boxes
+ * @param ctx context given in the config
+ */
+typedef void (*motion_detect_cb_t)(const motion_box_t *boxes, size_t count, void *ctx);
+
+typedef struct
+{
+    uint8_t scale;              /*!< Frame pixels per luma pixel each way, 2, 4 or 8 */
+    uint8_t cell;               /*!< Luma pixels per cell each way */
+    uint8_t sensitivity;        /*!< 1-100, higher reports smaller changes */
+    uint8_t learn_shift;        /*!< The background moves 1/2^n of the way to each frame */
+    uint8_t warmup_frames;      /*!< Frames learnt before reporting */
+    uint8_t global_pct;         /*!< Share of active cells taken as a lighting change, 0 to never */
+    uint16_t min_cells;         /*!< Smallest box reported */
+    bool big_endian;            /*!< Byte order of the RGB565 pixels */
+    motion_detect_cb_t callback;/*!< Motion callback, may be NULL */
+    void *ctx;                  /*!< Passed to the callback */
+} motion_detect_config_t;
+
+#define MOTION_DETECT_DEFAULT_CONFIG() \
+    {                                  \
+        .scale = 4,                    \
+        .cell = 4,                     \
+        .sensitivity = 60,             \
+        .learn_shift = 4,              \
+        .warmup_frames = 16,           \
+        .global_pct = 60,              \
+        .min_cells = 2,                \
+        .big_endian = true,            \
+        .callback = NULL,              \
+        .ctx = NULL,                   \
+    }
+
+typedef struct
+{
+    uint32_t frames;            /*!< Frames processed */
+    uint32_t motion_frames;     /*!< Frames with at least one box */
+    uint32_t relearned;         /*!< Lighting changes learnt at once */
+    uint16_t active_cells;      /*!< Active cells in the last frame */
+    uint16_t total_cells;       /*!< Cells per frame */
+} motion_detect_stats_t;
+
+typedef struct motion_detect_t *motion_detect_handle_t;
+
+/**
+ * @brief Create a detector
+ *
+ * The planes are allocated with the first frame, and again whenever the
+ * frame size changes, which also restarts the learning.
+ *
+ * @param config detector configuration
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t motion_detect_create(const motion_detect_config_t *config, motion_detect_handle_t *ret_handle);
+
+/**
+ * @brief Analyse one frame
+ *
+ * @param handle detector handle
+ * @param rgb565 frame pixels
+ * @param width frame width
+ * @param height frame height
+ * @param ret_count returned number of boxes, may be NULL
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument, or a frame smaller than one cell
+ *         ESP_ERR_NO_MEM        Out of memory for a new frame size
+ */
+esp_err_t motion_detect_process(motion_detect_handle_t handle, const uint8_t *rgb565, uint16_t width, uint16_t height,
+                                size_t *ret_count);
+
+/**
+ * @brief Ignore, or stop ignoring, a region of the frame
+ *
+ * @param handle detector handle
+ * @param index mask slot, below MOTION_DETECT_MAX_MASKS
+ * @param x left edge, thousandths of the frame width
+ * @param y top edge, thousandths of the frame height
+ * @param width width, thousandths of the frame width, 0 clears the slot
+ * @param height height, thousandths of the frame height
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ */
+esp_err_t motion_detect_set_mask(motion_detect_handle_t handle, size_t index, uint16_t x, uint16_t y,
+                                 uint16_t width, uint16_t height);
+
+/**
+ * @brief Change the sensitivity
+ *
+ * @param handle detector handle
+ * @param sensitivity 1-100, higher reports smaller changes
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid sensitivity
+ */
+esp_err_t motion_detect_set_sensitivity(motion_detect_handle_t handle, uint8_t sensitivity);
+
+/**
+ * @brief Forget the background and learn it again
+ *
+ * @param handle detector handle
+ */
+void motion_detect_reset(motion_detect_handle_t handle);
+
+/**
+ * @brief Get the detector counters
+ *
+ * @param handle detector handle
+ * @param stats returned counters
+ */
+void motion_detect_get_stats(motion_detect_handle_t handle, motion_detect_stats_t *stats);
+
+/**
+ * @brief Delete the detector
+ *
+ * @param handle detector handle
+ */
+void motion_detect_delete(motion_detect_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,197 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_console.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "frame_stats.h"
+#include "pipeline_telemetry.h"
+
+static const char *TAG = "telemetry";
+
+static const char *stage_names[TELEMETRY_MAX] = {
+    [TELEMETRY_USB] = "usb",
+    [TELEMETRY_QUEUE] = "queue",
+    [TELEMETRY_DECODE] = "decode",
+    [TELEMETRY_SCALE] = "scale",
+    [TELEMETRY_MOTION] = "motion",
+    [TELEMETRY_CANVAS] = "canvas",
+    [TELEMETRY_FLUSH] = "flush",
+    [TELEMETRY_LATENCY] = "latency",
+};
+
+static frame_stats_handle_t stages[TELEMETRY_MAX] = {0};
+static SemaphoreHandle_t stage_locks[TELEMETRY_MAX] = {0};
+static SemaphoreHandle_t readers_lock = NULL;
+static volatile bool overlay_enabled = false;
+
+static void stages_take(void *arg)
+{
+    xSemaphoreTake((SemaphoreHandle_t)arg, portMAX_DELAY);
+}
+
+static void stages_give(void *arg)
+{
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+}
+
+esp_err_t telemetry_init(void)
+{
+    /*
+     * The stages are written by the usb, decode and display tasks and read by
+     * the console and the overlay. Each has its own lock so the usb callback
+     * only ever waits for a copy of its own stage, readers take turns on
+     * readers_lock since frame_stats_get sorts outside the stage lock.
+     */
+    readers_lock = xSemaphoreCreateMutex();
+    if (readers_lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < TELEMETRY_MAX; i++)
+    {
+        stage_locks[i] = xSemaphoreCreateMutex();
+        if (stage_locks[i] == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        const frame_stats_config_t config = {
+            .name = stage_names[i],
+            .window = TELEMETRY_WINDOW,
+            .lock = stages_take,
+            .unlock = stages_give,
+            .lock_arg = stage_locks[i],
+        };
+        esp_err_t ret = frame_stats_create(&config, &stages[i]);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+void telemetry_record(telemetry_stage_t stage, int64_t start_us, int64_t end_us)
+{
+    if (stages[stage] != NULL)
+    {
+        frame_stats_add(stages[stage], start_us, end_us);
+    }
+}
+
+void telemetry_drop(telemetry_stage_t stage, uint32_t count)
+{
+    if (stages[stage] != NULL && count > 0)
+    {
+        frame_stats_drop(stages[stage], count);
+    }
+}
+
+void telemetry_format(char *buf, size_t size, bool compact)
+{
+    size_t len = 0;
+    buf[0] = '\0';
+    if (!compact)
+    {
+        len += snprintf(buf, size, "%-8s %8s %8s %8s %8s %7s %7s\n", "stage", "min_us", "avg_us", "p99_us", "max_us", "fps", "drops");
+    }
+    for (int i = 0; i < TELEMETRY_MAX && len < size && stages[i] != NULL; i++)
+    {
+        frame_stats_summary_t summary;
+        xSemaphoreTake(readers_lock, portMAX_DELAY);
+        frame_stats_get(stages[i], &summary);
+        xSemaphoreGive(readers_lock);
+        if (compact)
+        {
+            len += snprintf(buf + len, size - len, "%-7s %3" PRIu32 ".%" PRIu32 "/%3" PRIu32 ".%" PRIu32 "ms %2" PRIu32 ".%" PRIu32 "fps %" PRIu32 "\n",
+                            stage_names[i], summary.avg_us / 1000, summary.avg_us % 1000 / 100,
+                            summary.p99_us / 1000, summary.p99_us % 1000 / 100,
+                            summary.fps_x10 / 10, summary.fps_x10 % 10, summary.drops);
+        }
+        else
+        {
+            len += snprintf(buf + len, size - len, "%-8s %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %5" PRIu32 ".%" PRIu32 " %7" PRIu32 "\n",
+                            stage_names[i], summary.min_us, summary.avg_us, summary.p99_us, summary.max_us,
+                            summary.fps_x10 / 10, summary.fps_x10 % 10, summary.drops);
+        }
+    }
+}
+
+void telemetry_log(void)
+{
+    char buf[640];
+    telemetry_format(buf, sizeof(buf), false);
+    ESP_LOGI(TAG, "last %d frames per stage\n%s", TELEMETRY_WINDOW, buf);
+}
+
+void telemetry_reset(void)
+{
+    for (int i = 0; i < TELEMETRY_MAX && stages[i] != NULL; i++)
+    {
+        frame_stats_reset(stages[i]);
+    }
+}
+
+void telemetry_set_overlay(bool enable)
+{
+    overlay_enabled = enable;
+}
+
+bool telemetry_overlay_enabled(void)
+{
+    return overlay_enabled;
+}
+
+static int stats_cmd(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+        telemetry_reset();
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[1], "overlay") == 0)
+    {
+        telemetry_set_overlay(strcmp(argv[2], "on") == 0);
+        return 0;
+    }
+    if (argc > 1)
+    {
+        printf("usage: stats [reset|overlay on|overlay off]\n");
+        return 1;
+    }
+
+    char buf[640];
+    telemetry_format(buf, sizeof(buf), false);
+    printf("%s", buf);
+    return 0;
+}
+
+esp_err_t telemetry_console_start(void)
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    repl_config.prompt = "camera>";
+
+    esp_err_t ret = esp_console_new_repl_uart(&uart_config, &repl_config, &repl);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    const esp_console_cmd_t cmd = {
+        .command = "stats",
+        .help = "Print the per stage frame statistics, clear them, or show them on screen",
+        .hint = "[reset|overlay on|overlay off]",
+        .func = &stats_cmd,
+    };
+    esp_console_cmd_register(&cmd);
+    esp_console_register_help_command();
+    return esp_console_start_repl(repl);
+}
@@ -0,0 +1,103 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define TELEMETRY_WINDOW 128    /*!< Frames kept per stage */
+
+typedef enum
+{
+    TELEMETRY_USB = 0,          /*!< Frame copy in the usb callback, rate is the camera frame rate */
+    TELEMETRY_QUEUE,            /*!< From the usb callback to the decoder taking the frame */
+    TELEMETRY_DECODE,           /*!< JPEG decode */
+    TELEMETRY_SCALE,            /*!< Fit to the panel */
+    TELEMETRY_MOTION,           /*!< Motion detection on the decoded frame */
+    TELEMETRY_CANVAS,           /*!< Canvas update, including the wait for the display lock */
+    TELEMETRY_FLUSH,            /*!< LVGL refresh and panel flush, millisecond resolution */
+    TELEMETRY_LATENCY,          /*!< From the usb callback to the canvas, rate is the displayed frame rate */
+    TELEMETRY_MAX,
+} telemetry_stage_t;
+
+/**
+ * @brief Create the statistics of every stage
+ *
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t telemetry_init(void);
+
+/**
+ * @brief Add the duration of one frame in a stage
+ *
+ * @param stage pipeline stage
+ * @param start_us time the frame entered the stage
+ * @param end_us time the frame left the stage
+ */
+void telemetry_record(telemetry_stage_t stage, int64_t start_us, int64_t end_us);
+
+/**
+ * @brief Count frames dropped at a stage
+ *
+ * @param stage pipeline stage
+ * @param count frames dropped
+ */
+void telemetry_drop(telemetry_stage_t stage, uint32_t count);
+
+/**
+ * @brief Print the statistics of every stage into a buffer
+ *
+ * @param buf output buffer
+ * @param size size of `buf`
+ * @param compact one short line per stage for the overlay, otherwise a table
+ */
+void telemetry_format(char *buf, size_t size, bool compact);
+
+/**
+ * @brief Log the statistics of every stage
+ */
+void telemetry_log(void);
+
+/**
+ * @brief Clear the statistics of every stage
+ */
+void telemetry_reset(void);
+
+/**
+ * @brief Show or hide the on-screen statistics
+ *
+ * @param enable true to show
+ */
+void telemetry_set_overlay(bool enable);
+
+/**
+ * @brief Tell if the on-screen statistics are shown
+ *
+ * @return true if shown
+ */
+bool telemetry_overlay_enabled(void);
+
+/**
+ * @brief Start a UART console with the `stats` command
+ *
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         Others                Console init failed
+ */
+esp_err_t telemetry_console_start(void);
+
+#ifdef __cplusplus
+}
+#endif
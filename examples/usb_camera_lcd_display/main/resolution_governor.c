@@ -0,0 +1,228 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include "resolution_governor.h"
+
+#define GOVERNOR_MAX_BACKOFF_SHIFT  6   /* The retry delay stops doubling at 64 times backoff_periods */
+
+typedef struct
+{
+    uint32_t pixels;
+    uint32_t capacity_fps_x10;      /* Averaged decode capacity measured at this resolution */
+    bool measured;
+    uint8_t failures;
+    uint32_t retry_at;              /* First period it may be tried again */
+} governor_size_state_t;
+
+struct resolution_governor_t
+{
+    resolution_governor_config_t config;
+    size_t count;
+    size_t current;
+    size_t *order;                  /* Indexes sorted by pixel count, smallest first */
+    size_t *rank;                   /* Position of each index in `order` */
+    governor_size_state_t *sizes;
+    uint64_t pixel_rate;            /* Decode capacity in pixels per second, from the last measured resolution */
+    uint32_t period;
+    uint8_t settle;
+    uint8_t bad;
+    uint8_t good;
+};
+
+static uint32_t governor_predict(const struct resolution_governor_t *gov, size_t index)
+{
+    const governor_size_state_t *size = &gov->sizes[index];
+    if (index == gov->current && size->measured)
+    {
+        return size->capacity_fps_x10;
+    }
+    /*
+     * Another resolution is predicted from the pixel rate measured now, so a
+     * load that comes or goes is seen everywhere. Its own older measurement
+     * is kept if better, the prediction ignores the cost per frame.
+     */
+    const uint32_t predicted = (gov->pixel_rate && size->pixels) ? gov->pixel_rate * 10 / size->pixels : 0;
+    return (size->measured && size->capacity_fps_x10 > predicted) ? size->capacity_fps_x10 : predicted;
+}
+
+static size_t governor_switch(struct resolution_governor_t *gov, size_t index)
+{
+    gov->current = index;
+    gov->settle = gov->config.settle_periods;
+    gov->bad = 0;
+    gov->good = 0;
+    return index;
+}
+
+static size_t governor_step_down(struct resolution_governor_t *gov, uint32_t capacity_fps_x10)
+{
+    governor_size_state_t *size = &gov->sizes[gov->current];
+    /* The average still holds better times, remember what made it fail */
+    if (capacity_fps_x10 < size->capacity_fps_x10)
+    {
+        size->capacity_fps_x10 = capacity_fps_x10;
+    }
+    if (size->failures < UINT8_MAX)
+    {
+        size->failures++;
+    }
+    const uint8_t shift = (size->failures - 1 < GOVERNOR_MAX_BACKOFF_SHIFT) ? size->failures - 1 : GOVERNOR_MAX_BACKOFF_SHIFT;
+    size->retry_at = gov->period + ((uint32_t)gov->config.backoff_periods << shift);
+
+    /* Go straight to the largest smaller resolution expected to keep up, or to the smallest */
+    size_t rank = gov->rank[gov->current];
+    while (rank > 0)
+    {
+        rank--;
+        if (governor_predict(gov, gov->order[rank]) >= gov->config.target_fps_x10)
+        {
+            break;
+        }
+    }
+    return governor_switch(gov, gov->order[rank]);
+}
+
+esp_err_t resolution_governor_create(const resolution_governor_config_t *config, const resolution_governor_size_t *sizes,
+                                     size_t count, size_t current, resolution_governor_handle_t *ret_handle)
+{
+    if (config == NULL || sizes == NULL || ret_handle == NULL || count == 0 || current >= count ||
+        config->target_fps_x10 == 0 || config->max_drop_pct > 100)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct resolution_governor_t *gov = calloc(1, sizeof(struct resolution_governor_t));
+    if (gov == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    gov->order = calloc(count, sizeof(size_t));
+    gov->rank = calloc(count, sizeof(size_t));
+    gov->sizes = calloc(count, sizeof(governor_size_state_t));
+    if (gov->order == NULL || gov->rank == NULL || gov->sizes == NULL)
+    {
+        resolution_governor_delete(gov);
+        return ESP_ERR_NO_MEM;
+    }
+    gov->config = *config;
+    gov->count = count;
+    gov->current = current;
+
+    /* Insertion sort, camera lists are short */
+    for (size_t i = 0; i < count; i++)
+    {
+        gov->sizes[i].pixels = (uint32_t)sizes[i].width * sizes[i].height;
+        size_t j = i;
+        while (j > 0 && gov->sizes[gov->order[j - 1]].pixels > gov->sizes[i].pixels)
+        {
+            gov->order[j] = gov->order[j - 1];
+            j--;
+        }
+        gov->order[j] = i;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        gov->rank[gov->order[i]] = i;
+    }
+    gov->settle = config->settle_periods;
+
+    *ret_handle = gov;
+    return ESP_OK;
+}
+
+size_t resolution_governor_update(resolution_governor_handle_t handle, const resolution_governor_sample_t *sample)
+{
+    struct resolution_governor_t *gov = handle;
+    governor_size_state_t *size = &gov->sizes[gov->current];
+    gov->period++;
+    if (gov->settle > 0)
+    {
+        gov->settle--;
+        return gov->current;
+    }
+
+    uint32_t value = UINT32_MAX;
+    if (sample->decoded > 0 && sample->decode_us > 0)
+    {
+        const uint64_t capacity = (uint64_t)sample->decoded * 10000000 / sample->decode_us;
+        value = (capacity > UINT32_MAX) ? UINT32_MAX : capacity;
+        size->capacity_fps_x10 = size->measured ? size->capacity_fps_x10 - size->capacity_fps_x10 / 4 + value / 4 : value;
+        size->measured = true;
+        gov->pixel_rate = (uint64_t)size->capacity_fps_x10 * size->pixels / 10;
+    }
+
+    const uint32_t total = sample->frames + sample->dropped;
+    if (total == 0)
+    {
+        /* No camera, nothing to judge */
+        gov->bad = 0;
+        gov->good = 0;
+        return gov->current;
+    }
+
+    /*
+     * Dropped frames or a decoder slower than the target are bad. A low frame
+     * rate alone is not, the camera may simply send fewer frames in the dark.
+     */
+    const bool bad = (uint64_t)sample->dropped * 100 > (uint64_t)gov->config.max_drop_pct * total ||
+                     (size->measured && size->capacity_fps_x10 < gov->config.target_fps_x10);
+    if (bad)
+    {
+        gov->good = 0;
+        if (++gov->bad >= gov->config.down_periods && gov->rank[gov->current] > 0)
+        {
+            return governor_step_down(gov, value);
+        }
+        return gov->current;
+    }
+
+    gov->bad = 0;
+    if (gov->good < UINT8_MAX)
+    {
+        gov->good++;
+    }
+    const size_t rank = gov->rank[gov->current];
+    if (gov->good >= gov->config.up_periods && rank + 1 < gov->count)
+    {
+        const size_t next = gov->order[rank + 1];
+        const uint64_t needed = (uint64_t)gov->config.target_fps_x10 * (100 + gov->config.up_margin_pct) / 100;
+        if (gov->period >= gov->sizes[next].retry_at && governor_predict(gov, next) >= needed)
+        {
+            return governor_switch(gov, next);
+        }
+    }
+    return gov->current;
+}
+
+void resolution_governor_set_current(resolution_governor_handle_t handle, size_t current)
+{
+    if (current < handle->count)
+    {
+        governor_switch(handle, current);
+    }
+}
+
+void resolution_governor_get_info(resolution_governor_handle_t handle, size_t index, resolution_governor_info_t *info)
+{
+    const governor_size_state_t *size = &handle->sizes[index];
+    info->capacity_fps_x10 = governor_predict(handle, index);
+    info->measured = size->measured;
+    info->failures = size->failures;
+    info->retry_in = (size->retry_at > handle->period) ? size->retry_at - handle->period : 0;
+}
+
+void resolution_governor_delete(resolution_governor_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return;
+    }
+    free(handle->order);
+    free(handle->rank);
+    free(handle->sizes);
+    free(handle);
+}
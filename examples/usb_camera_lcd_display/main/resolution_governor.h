@@ -0,0 +1,128 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Picks the largest camera resolution the pipeline sustains at a target
+ * frame rate. It is fed one sample per period with the frames displayed,
+ * the frames dropped and the time the decoder spent, and answers with the
+ * resolution to use. The decode capacity measured at each resolution, or
+ * predicted from its pixel count, tells whether a larger one would keep
+ * up. Steps down need consecutive bad periods, steps up need consecutive
+ * good ones and some headroom, and a resolution that failed is retried
+ * after a delay that doubles at every failure.
+ *
+ * The policy has no OS dependency, it only sees the samples.
+ */
+typedef struct
+{
+    uint32_t target_fps_x10;    /*!< Frame rate to sustain, times 10 */
+    uint8_t up_margin_pct;      /*!< Headroom over the target a larger resolution must be predicted to have */
+    uint8_t max_drop_pct;       /*!< Share of dropped frames above which a period is bad */
+    uint8_t down_periods;       /*!< Consecutive bad periods before stepping down */
+    uint8_t up_periods;         /*!< Consecutive good periods before stepping up */
+    uint8_t settle_periods;     /*!< Periods ignored after a change, while the camera restarts */
+    uint16_t backoff_periods;   /*!< Periods before retrying a resolution that failed, doubled at each failure */
+} resolution_governor_config_t;
+
+#define RESOLUTION_GOVERNOR_DEFAULT_CONFIG() \
+    {                                        \
+        .target_fps_x10 = 250,               \
+        .up_margin_pct = 20,                 \
+        .max_drop_pct = 5,                   \
+        .down_periods = 2,                   \
+        .up_periods = 5,                     \
+        .settle_periods = 1,                 \
+        .backoff_periods = 15,               \
+    }
+
+typedef struct
+{
+    uint16_t width;
+    uint16_t height;
+} resolution_governor_size_t;
+
+typedef struct
+{
+    uint32_t interval_us;       /*!< Length of the period */
+    uint32_t frames;            /*!< Frames displayed */
+    uint32_t dropped;           /*!< Frames dropped anywhere in the pipeline */
+    uint32_t decoded;           /*!< Frames through the decoder */
+    uint32_t decode_us;         /*!< Time the decoder spent on them, scaling included */
+} resolution_governor_sample_t;
+
+typedef struct
+{
+    uint32_t capacity_fps_x10;  /*!< Decode capacity, measured or predicted, 0 if unknown */
+    bool measured;              /*!< The capacity was measured at this resolution */
+    uint8_t failures;           /*!< Times the governor had to leave this resolution */
+    uint32_t retry_in;          /*!< Periods before it may be tried again */
+} resolution_governor_info_t;
+
+typedef struct resolution_governor_t *resolution_governor_handle_t;
+
+/**
+ * @brief Create a governor for a list of resolutions
+ *
+ * @param config governor configuration
+ * @param sizes resolutions of the camera, in any order, copied
+ * @param count number of resolutions
+ * @param current index in `sizes` of the resolution in use
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t resolution_governor_create(const resolution_governor_config_t *config, const resolution_governor_size_t *sizes,
+                                     size_t count, size_t current, resolution_governor_handle_t *ret_handle);
+
+/**
+ * @brief Feed the measurements of one period
+ *
+ * @param handle governor handle
+ * @param sample measurements of the period
+ * @return index in `sizes` of the resolution to use, the current one or a new one
+ */
+size_t resolution_governor_update(resolution_governor_handle_t handle, const resolution_governor_sample_t *sample);
+
+/**
+ * @brief Tell the governor the resolution was changed by someone else
+ *
+ * @param handle governor handle
+ * @param current index in `sizes` of the resolution in use
+ */
+void resolution_governor_set_current(resolution_governor_handle_t handle, size_t current);
+
+/**
+ * @brief Get what the governor knows about a resolution
+ *
+ * @param handle governor handle
+ * @param index index in `sizes`
+ * @param info returned information
+ */
+void resolution_governor_get_info(resolution_governor_handle_t handle, size_t index, resolution_governor_info_t *info);
+
+/**
+ * @brief Delete the governor
+ *
+ * @param handle governor handle
+ */
+void resolution_governor_delete(resolution_governor_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,128 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define AUDIO_CONVERT_MAX_CHANNELS  (2)
+#define AUDIO_CONVERT_MAX_RATIO     (3)     /* 16 kHz <-> 48 kHz */
+
+/**
+ * PCM format of one side of a conversion. Samples are signed little endian
+ * and interleaved; 24-bit samples are packed in 3 bytes, as in the UAC
+ * 3-byte subslot.
+ */
+typedef struct {
+    uint32_t sample_rate;       /*!< 16000, 32000, 44100 or 48000 */
+    uint8_t bits;               /*!< 16, 24 or 32 */
+    uint8_t channels;           /*!< 1 or 2 */
+} audio_format_t;
+
+/**
+ * @brief Bytes per interleaved frame of a format
+ */
+static inline size_t audio_format_frame_bytes(const audio_format_t *format)
+{
+    return (size_t)format->channels * (format->bits / 8);
+}
+
+typedef struct audio_convert_t *audio_convert_handle_t;
+
+/**
+ * @brief Create a converter between two formats
+ *
+ * Samples are widened to 32 bits, mono is duplicated to both channels and
+ * stereo is averaged to mono, the rate is changed by linear interpolation
+ * with an exact rational step, then samples are rounded and saturated to
+ * the output width. The output is a deterministic function of the input.
+ *
+ * @param in input format
+ * @param out output format
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                  Success
+ *         ESP_ERR_INVALID_ARG     Invalid argument
+ *         ESP_ERR_NOT_SUPPORTED   Unsupported rate, width or channel count
+ *         ESP_ERR_NO_MEM          Out of memory
+ */
+esp_err_t audio_convert_create(const audio_format_t *in, const audio_format_t *out, audio_convert_handle_t *ret_handle);
+
+/**
+ * @brief Convert a block of frames
+ *
+ * All input is consumed, the rate converter keeps its state across calls.
+ * `in` and `out` may be the same buffer when the output stream is not
+ * larger than the input one, i.e. out frame bytes * out rate <= in frame bytes * in rate.
+ *
+ * @param handle converter handle
+ * @param in input frames
+ * @param in_frames number of input frames
+ * @param out output frames
+ * @param out_capacity capacity of `out` in frames, see audio_convert_max_out_frames
+ * @return number of output frames produced
+ */
+size_t audio_convert_process(audio_convert_handle_t handle, const void *in, size_t in_frames, void *out, size_t out_capacity);
+
+/**
+ * @brief Number of input frames the next call needs to produce exactly `out_frames`
+ *
+ * @param handle converter handle
+ * @param out_frames wanted output frames
+ * @return input frames
+ */
+size_t audio_convert_in_frames(audio_convert_handle_t handle, size_t out_frames);
+
+/**
+ * @brief Number of output frames the next call produces for `in_frames`
+ *
+ * @param handle converter handle
+ * @param in_frames input frames
+ * @return output frames
+ */
+size_t audio_convert_out_frames(audio_convert_handle_t handle, size_t in_frames);
+
+/**
+ * @brief Whether input and output formats are identical
+ *
+ * @param handle converter handle
+ * @return true when audio_convert_process is a plain copy
+ */
+bool audio_convert_is_passthrough(audio_convert_handle_t handle);
+
+/**
+ * @brief Get the formats a converter was created for
+ *
+ * @param handle converter handle
+ * @param in returned input format, may be NULL
+ * @param out returned output format, may be NULL
+ */
+void audio_convert_get_formats(audio_convert_handle_t handle, audio_format_t *in, audio_format_t *out);
+
+/**
+ * @brief Drop the rate converter history, e.g. after the stream stopped
+ *
+ * @param handle converter handle
+ */
+void audio_convert_reset(audio_convert_handle_t handle);
+
+/**
+ * @brief Delete a converter
+ *
+ * @param handle converter handle
+ */
+void audio_convert_delete(audio_convert_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
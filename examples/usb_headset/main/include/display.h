@@ -10,17 +10,29 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 /**
- * @brief
+ * @brief Draw one spectrum frame
  *
- * @param data FFT data
+ * @param data log-magnitude bins in the spectrum.h fixed-point format, NULL to let the bars decay
  * @return esp_err_t
  *         ESP_OK   Success
  *         ESP_FAIL Failed
  */
-esp_err_t display_draw(float *data);
+esp_err_t display_draw(const int16_t *data);
+
+/**
+ * @brief Whether the panel has sent every frame handed to it
+ *
+ * A frame drawn while the previous one is still on its way to the panel
+ * only queues behind it, the caller should rather skip it.
+ *
+ * @return true when no color transfer is pending
+ */
+bool display_is_ready(void);
 
 /**
  * @brief Init lcd
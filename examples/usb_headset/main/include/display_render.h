@@ -0,0 +1,133 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DISPLAY_RENDER_MAX_STRIPS       (64)
+#define DISPLAY_RENDER_SQUARE_COLOR     (0xFFFF)
+#define DISPLAY_RENDER_BG_COLOR         (0x0000)
+
+/**
+ * Fixed geometry of the spectrum bars. Strip `i` covers the columns
+ * [first_x + i * group_width, first_x + i * group_width + strip_width).
+ */
+typedef struct {
+    int width;                  /*!< Frame width in pixels */
+    int height;                 /*!< Frame height in pixels */
+    int first_x;                /*!< X of the first strip */
+    int group_width;            /*!< Distance between two strips */
+    int strip_width;            /*!< Width of one strip, also the height of the peak square */
+    int strip_num;              /*!< Number of strips, up to DISPLAY_RENDER_MAX_STRIPS */
+    uint16_t strip_color[DISPLAY_RENDER_MAX_STRIPS]; /*!< Bar color of every strip, panel byte order */
+} display_render_layout_t;
+
+/**
+ * Everything needed to rebuild one frame. A strip is bar colored on rows
+ * >= bar_top, peak colored on rows [square_top - strip_width, square_top]
+ * and background elsewhere.
+ */
+typedef struct {
+    int16_t bar_top[DISPLAY_RENDER_MAX_STRIPS];
+    int16_t square_top[DISPLAY_RENDER_MAX_STRIPS];
+} display_render_state_t;
+
+typedef struct {
+    int x_start;                /*!< Inclusive */
+    int y_start;                /*!< Inclusive */
+    int x_end;                  /*!< Exclusive */
+    int y_end;                  /*!< Exclusive */
+} display_render_rect_t;
+
+/**
+ * @brief Render a rectangle of the frame into a packed buffer
+ *
+ * @param layout bar geometry
+ * @param state frame to render
+ * @param rect area to render
+ * @param out (x_end - x_start) * (y_end - y_start) pixels, row-major
+ */
+void display_render_rect(const display_render_layout_t *layout, const display_render_state_t *state,
+                         const display_render_rect_t *rect, uint16_t *out);
+
+/**
+ * @brief Collect the rectangles that differ between two frames
+ *
+ * One rectangle is produced per changed strip, spanning only the changed
+ * rows. Neighbouring rectangles are merged when the extra pixels cost less
+ * than `merge_cost_px`, the estimated overhead of one more panel transfer.
+ *
+ * @param layout bar geometry
+ * @param prev frame currently on the panel
+ * @param cur frame to show
+ * @param merge_cost_px merge threshold in pixels, 0 disables merging
+ * @param rects output rectangles, at least layout->strip_num entries
+ * @return number of rectangles written
+ */
+int display_render_diff(const display_render_layout_t *layout, const display_render_state_t *prev,
+                        const display_render_state_t *cur, int merge_cost_px, display_render_rect_t *rects);
+
+/**
+ * @brief Number of pixels covered by a rectangle
+ */
+static inline size_t display_render_rect_area(const display_render_rect_t *rect)
+{
+    return (size_t)(rect->x_end - rect->x_start) * (size_t)(rect->y_end - rect->y_start);
+}
+
+/**
+ * @brief Number of rows of a rectangle that fit in a band buffer
+ *
+ * Rectangles taller than this are rendered and flushed band by band.
+ *
+ * @param rect rectangle to split
+ * @param band_pixels capacity of the band buffer in pixels
+ * @return rows per band, at least 1
+ */
+static inline int display_render_band_rows(const display_render_rect_t *rect, size_t band_pixels)
+{
+    const size_t rows = band_pixels / (size_t)(rect->x_end - rect->x_start);
+    return rows > 0 ? (int)rows : 1;
+}
+
+/**
+ * @brief Receives a band once it is rendered
+ *
+ * @param band area of the panel the pixels belong to
+ * @param pixels rendered band, rewritten two bands later
+ * @param user_ctx user context
+ */
+typedef void (*display_render_flush_cb_t)(const display_render_rect_t *band, const uint16_t *pixels, void *user_ctx);
+
+/**
+ * @brief Render a rectangle band by band, alternating between two buffers
+ *
+ * Each band is rendered into the buffer the previous band did not use and
+ * handed to `flush`, so one band can be rendered while the other is sent.
+ *
+ * @param layout bar geometry
+ * @param state frame to render
+ * @param rect area to render
+ * @param band_buf two band buffers of `band_pixels` pixels each
+ * @param band_pixels capacity of one band buffer in pixels, at least the rectangle width
+ * @param band_index buffer to use next, updated so that ping-pong carries on across calls
+ * @param flush called with every rendered band
+ * @param user_ctx passed to `flush`
+ * @return number of bands
+ */
+int display_render_bands(const display_render_layout_t *layout, const display_render_state_t *state,
+                         const display_render_rect_t *rect, uint16_t *const band_buf[2], size_t band_pixels,
+                         int *band_index, display_render_flush_cb_t flush, void *user_ctx);
+
+#ifdef __cplusplus
+}
+#endif
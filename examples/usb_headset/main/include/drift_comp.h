@@ -0,0 +1,113 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define DRIFT_COMP_MAX_CHANNELS     (2)
+
+/**
+ * Asynchronous clock-drift compensation: a fractional resampler whose ratio
+ * is steered by a PI loop so that the FIFO between two clock domains stays
+ * at its target fill level.
+ *
+ * The ratio is input frames per output frame. A FIFO that fills up means
+ * its producer clock runs fast, so the ratio goes above 1.
+ */
+typedef struct {
+    int channels;               /*!< Interleaved channels, up to DRIFT_COMP_MAX_CHANNELS */
+    uint32_t target_fill;       /*!< FIFO fill level to hold, in frames */
+    float kp_ppm;               /*!< Correction in ppm for a fill error of one full target */
+    float ki_ppm;               /*!< Integral gain in ppm per update for a fill error of one full target */
+    float max_ppm;              /*!< Correction limit in ppm */
+} drift_comp_config_t;
+
+#define DRIFT_COMP_DEFAULT_CONFIG(_channels, _target_fill) { \
+    .channels = (_channels),                                  \
+    .target_fill = (_target_fill),                            \
+    .kp_ppm = 1000,                                           \
+    .ki_ppm = 0.2f,                                           \
+    .max_ppm = 2000,                                          \
+}
+
+typedef struct {
+    float drift_ppm;            /*!< Estimated clock offset of producer vs consumer, integral term */
+    float correction_ppm;       /*!< Correction currently applied */
+    double ratio;               /*!< Current input / output ratio */
+    float fill_avg;             /*!< Smoothed FIFO fill level in frames */
+} drift_comp_status_t;
+
+typedef struct drift_comp_t *drift_comp_handle_t;
+
+/**
+ * @brief Create a drift compensator
+ *
+ * @param config configuration
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid configuration
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t drift_comp_create(const drift_comp_config_t *config, drift_comp_handle_t *ret_handle);
+
+/**
+ * @brief Feed the control loop with the current FIFO fill level
+ *
+ * @param handle compensator handle
+ * @param fill FIFO fill level in frames
+ */
+void drift_comp_update(drift_comp_handle_t handle, size_t fill);
+
+/**
+ * @brief Resample a block at the current ratio
+ *
+ * All input is consumed; the history needed for interpolation is kept
+ * across calls. `out_capacity` should be at least `in_frames * (1 + max_ppm / 1e6) + 2`.
+ *
+ * @param handle compensator handle
+ * @param in interleaved input frames
+ * @param in_frames number of input frames
+ * @param out interleaved output frames
+ * @param out_capacity capacity of `out` in frames
+ * @return number of output frames produced
+ */
+size_t drift_comp_process(drift_comp_handle_t handle, const int16_t *in, size_t in_frames, int16_t *out, size_t out_capacity);
+
+/**
+ * @brief Restart the loop from a neutral ratio, keeping the drift estimate
+ *
+ * Used after the stream stopped, e.g. on an underrun.
+ *
+ * @param handle compensator handle
+ */
+void drift_comp_reset(drift_comp_handle_t handle);
+
+/**
+ * @brief Get the drift estimate and correction ratio
+ *
+ * @param handle compensator handle
+ * @param status returned status
+ */
+void drift_comp_get_status(drift_comp_handle_t handle, drift_comp_status_t *status);
+
+/**
+ * @brief Delete the drift compensator
+ *
+ * @param handle compensator handle
+ */
+void drift_comp_delete(drift_comp_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,148 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define LATENCY_TRACE_EVENTS        (256)   /* Timestamped events kept, oldest overwritten */
+#define LATENCY_TAG_QUEUE_LEN       (64)
+
+typedef enum {
+    LATENCY_STAGE_USB_OUT_INTERVAL = 0,     /*!< Time between two USB speaker packets */
+    LATENCY_STAGE_I2S_WRITE,                /*!< Time blocked in the I2S write */
+    LATENCY_STAGE_SPK_USB_TO_I2S,           /*!< USB packet arrival to I2S write completion */
+    LATENCY_STAGE_I2S_READ,                 /*!< Time blocked in the I2S read */
+    LATENCY_STAGE_USB_IN_INTERVAL,          /*!< Time between two USB microphone requests */
+    LATENCY_STAGE_MIC_I2S_TO_USB,           /*!< I2S read return to USB input delivery */
+    LATENCY_STAGE_MAX,
+} latency_stage_t;
+
+typedef struct {
+    uint64_t timestamp_us;
+    uint32_t latency_us;
+    latency_stage_t stage;
+} latency_event_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+} latency_summary_t;
+
+/**
+ * @brief Microsecond clock, esp_timer_get_time on target, a mock on the host
+ */
+typedef uint64_t (*latency_clock_t)(void);
+
+/**
+ * Tags samples entering a FIFO with their arrival time, so the latency can
+ * be measured when the consumer gets past them. One producer, one consumer.
+ * Positions are free-running sample counters, e.g. from sample_ring_get_stats.
+ */
+typedef struct {
+    struct {
+        uint32_t position;      /* FIFO write position after the tagged block */
+        uint64_t timestamp_us;
+    } tags[LATENCY_TAG_QUEUE_LEN];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+} latency_tag_queue_t;
+
+/**
+ * @brief Set the clock and clear all histograms and events
+ *
+ * @param clock microsecond clock
+ */
+void latency_trace_init(latency_clock_t clock);
+
+/**
+ * @brief Current time of the trace clock
+ *
+ * @return time in microseconds
+ */
+uint64_t latency_trace_now(void);
+
+/**
+ * @brief Record one latency sample for a stage
+ *
+ * Safe to call from several tasks, each stage should have a single writer.
+ *
+ * @param stage stage
+ * @param latency_us latency in microseconds
+ */
+void latency_trace_record(latency_stage_t stage, uint32_t latency_us);
+
+/**
+ * @brief Record the time elapsed since `start_us` for a stage
+ *
+ * @param stage stage
+ * @param start_us start time from latency_trace_now
+ */
+void latency_trace_record_since(latency_stage_t stage, uint64_t start_us);
+
+/**
+ * @brief Producer side: tag the block ending at `position` with the current time
+ *
+ * @param queue tag queue
+ * @param position FIFO write position after the block
+ */
+void latency_tag_push(latency_tag_queue_t *queue, uint32_t position);
+
+/**
+ * @brief Consumer side: record the latency of every tag the consumer got past
+ *
+ * @param queue tag queue
+ * @param position FIFO read position
+ * @param stage stage to record into
+ */
+void latency_tag_consume(latency_tag_queue_t *queue, uint32_t position, latency_stage_t stage);
+
+/**
+ * @brief Compute the percentile summary of a stage
+ *
+ * Percentiles are resolved to the histogram bucket, within 1/8 of an octave.
+ *
+ * @param stage stage
+ * @param summary returned summary
+ */
+void latency_trace_get_summary(latency_stage_t stage, latency_summary_t *summary);
+
+/**
+ * @brief Copy the most recent events, oldest first
+ *
+ * @param events output array
+ * @param max_events capacity of `events`
+ * @return number of events copied
+ */
+int latency_trace_get_events(latency_event_t *events, int max_events);
+
+/**
+ * @brief Name of a stage
+ */
+const char *latency_trace_stage_name(latency_stage_t stage);
+
+/**
+ * @brief Print the summary of every stage to stdout
+ */
+void latency_trace_dump(void);
+
+/**
+ * @brief Clear all histograms and events
+ */
+void latency_trace_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,135 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define MIC_DSP_MAX_CHANNELS        (2)
+
+/**
+ * @brief Free-running cycle counter, e.g. esp_cpu_get_cycle_count
+ */
+typedef uint32_t (*mic_dsp_cycles_t)(void);
+
+/**
+ * Fixed-point capture chain, run in place on blocks of interleaved 16-bit
+ * frames: DC removal -> high-pass -> noise gate -> AGC -> limiter.
+ * Gate, AGC and limiter share one gain across channels.
+ */
+typedef struct {
+    uint32_t sample_rate;       /*!< Input sample rate */
+    int channels;               /*!< Interleaved channels, up to MIC_DSP_MAX_CHANNELS */
+    bool dc_remove;             /*!< First order DC blocker, corner around 10 Hz at 16 kHz */
+    uint16_t hpf_cutoff_hz;     /*!< Second order Butterworth high-pass, 0 disables */
+    bool noise_gate;            /*!< Attenuate while the input stays below `gate_threshold_dbfs` */
+    int8_t gate_threshold_dbfs; /*!< Gate opening level */
+    uint16_t gate_hold_ms;      /*!< Time below the threshold before the gate closes */
+    uint8_t gate_floor_db;      /*!< Attenuation of a closed gate */
+    bool agc;                   /*!< Automatic gain control */
+    int8_t agc_target_dbfs;     /*!< Average level the AGC aims for */
+    uint8_t agc_max_gain_db;    /*!< Gain limit, also the gain of a silent input */
+    uint16_t agc_attack_ms;     /*!< Time constant of gain reductions */
+    uint16_t agc_release_ms;    /*!< Time constant of gain increases */
+    int8_t limiter_dbfs;        /*!< Output ceiling, the limiter is always on unless bypassed */
+    uint32_t cycle_budget;      /*!< Cycles allowed per block, 0 for no budget */
+    mic_dsp_cycles_t get_cycles;    /*!< Cycle counter, required with a budget */
+} mic_dsp_config_t;
+
+#define MIC_DSP_DEFAULT_CONFIG(_sample_rate, _channels) { \
+    .sample_rate = (_sample_rate),                          \
+    .channels = (_channels),                                \
+    .dc_remove = true,                                      \
+    .hpf_cutoff_hz = 100,                                   \
+    .noise_gate = false,                                    \
+    .gate_threshold_dbfs = -60,                             \
+    .gate_hold_ms = 200,                                    \
+    .gate_floor_db = 20,                                    \
+    .agc = true,                                            \
+    .agc_target_dbfs = -24,                                 \
+    .agc_max_gain_db = 24,                                  \
+    .agc_attack_ms = 20,                                    \
+    .agc_release_ms = 500,                                  \
+    .limiter_dbfs = -1,                                     \
+    .cycle_budget = 0,                                      \
+    .get_cycles = NULL,                                     \
+}
+
+typedef struct {
+    uint32_t blocks;            /*!< Blocks processed */
+    uint32_t cycles_last;       /*!< Cycles of the last block, 0 without a counter */
+    uint32_t cycles_max;        /*!< Worst block since creation */
+    uint32_t over_budget;       /*!< Blocks that exceeded the cycle budget */
+    int shed_stages;            /*!< Optional stages currently skipped to meet the budget */
+    float agc_gain_db;          /*!< Current AGC gain */
+    bool gate_open;             /*!< Noise gate state */
+} mic_dsp_stats_t;
+
+typedef struct mic_dsp_t *mic_dsp_handle_t;
+
+/**
+ * @brief Create a capture chain
+ *
+ * @param config configuration
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid configuration
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t mic_dsp_create(const mic_dsp_config_t *config, mic_dsp_handle_t *ret_handle);
+
+/**
+ * @brief Process a block in place
+ *
+ * The cost is linear in the block size. When a block exceeds the cycle
+ * budget, the noise gate and then the high-pass filter are skipped for the
+ * following blocks, and put back once the chain has been well within the
+ * budget for a while.
+ *
+ * @param handle chain handle
+ * @param samples interleaved frames
+ * @param frames number of frames
+ */
+void mic_dsp_process(mic_dsp_handle_t handle, int16_t *samples, size_t frames);
+
+/**
+ * @brief Pass the input through untouched
+ *
+ * Safe from any task: the request is picked up by the next
+ * mic_dsp_process() call, never in the middle of a block. The filters
+ * restart from a clean state when the bypass is turned off.
+ *
+ * @param handle chain handle
+ * @param bypass true to bypass the chain
+ */
+void mic_dsp_set_bypass(mic_dsp_handle_t handle, bool bypass);
+
+/**
+ * @brief Get the chain counters and state
+ *
+ * @param handle chain handle
+ * @param stats returned counters
+ */
+void mic_dsp_get_stats(mic_dsp_handle_t handle, mic_dsp_stats_t *stats);
+
+/**
+ * @brief Delete a capture chain
+ *
+ * @param handle chain handle
+ */
+void mic_dsp_delete(mic_dsp_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
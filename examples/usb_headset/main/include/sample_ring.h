@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Single-producer / single-consumer lock-free ring of 16-bit samples.
+ *
+ * Exactly one context may write and exactly one context may read. Neither
+ * side ever blocks or takes a lock; the producer reports when a full frame
+ * became available so the caller can wake the consumer.
+ */
+typedef struct sample_ring_t *sample_ring_handle_t;
+
+typedef struct {
+    uint32_t written;           /*!< Samples accepted by the producer */
+    uint32_t read;              /*!< Samples handed to the consumer */
+    uint32_t overrun;           /*!< Samples dropped because the ring was full */
+    uint32_t underrun;          /*!< Reads that found less than the requested samples */
+} sample_ring_stats_t;
+
+/**
+ * @brief Create a sample ring
+ *
+ * @param capacity ring size in samples, power of two
+ * @param frame_size samples that make one consumer frame, at most capacity
+ * @param ret_ring returned ring handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid capacity or frame size
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t sample_ring_create(size_t capacity, size_t frame_size, sample_ring_handle_t *ret_ring);
+
+/**
+ * @brief Producer side: append samples
+ *
+ * Samples that do not fit are dropped and counted as overrun.
+ *
+ * @param ring ring handle
+ * @param samples samples to append
+ * @param count number of samples
+ * @param frame_ready set to true when this write made a full frame available
+ * @return number of samples written
+ */
+size_t sample_ring_write(sample_ring_handle_t ring, const int16_t *samples, size_t count, bool *frame_ready);
+
+/**
+ * @brief Consumer side: take exactly `count` samples
+ *
+ * @param ring ring handle
+ * @param out destination buffer
+ * @param count number of samples
+ * @return true if `count` samples were copied, false (and counted as underrun) otherwise
+ */
+bool sample_ring_read(sample_ring_handle_t ring, int16_t *out, size_t count);
+
+/**
+ * @brief Consumer side: drop the oldest samples
+ *
+ * @param ring ring handle
+ * @param count number of samples to drop, clamped to what is available
+ * @return number of samples dropped
+ */
+size_t sample_ring_skip(sample_ring_handle_t ring, size_t count);
+
+/**
+ * @brief Number of samples ready for the consumer
+ *
+ * @param ring ring handle
+ * @return available samples
+ */
+size_t sample_ring_available(sample_ring_handle_t ring);
+
+/**
+ * @brief Get the ring counters
+ *
+ * @param ring ring handle
+ * @param stats returned counters
+ */
+void sample_ring_get_stats(sample_ring_handle_t ring, sample_ring_stats_t *stats);
+
+/**
+ * @brief Delete the ring
+ *
+ * @param ring ring handle
+ */
+void sample_ring_delete(sample_ring_handle_t ring);
+
+#ifdef __cplusplus
+}
+#endif
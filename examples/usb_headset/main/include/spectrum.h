@@ -0,0 +1,81 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Log-magnitude output format: dB in Q(SPECTRUM_DB_FRAC_BITS), shifted up by
+ * SPECTRUM_DB_OFFSET so that the silence floor lands at 0.
+ */
+#define SPECTRUM_DB_FRAC_BITS       (6)
+#define SPECTRUM_DB_OFFSET          (130)
+#define SPECTRUM_DB_TO_INT(db)      ((db) >> SPECTRUM_DB_FRAC_BITS)
+
+typedef enum {
+    SPECTRUM_WINDOW_RECT = 0,           /*!< No windowing */
+    SPECTRUM_WINDOW_HANN,               /*!< Hann window */
+    SPECTRUM_WINDOW_BLACKMAN_HARRIS,    /*!< 4-term Blackman-Harris window */
+} spectrum_window_t;
+
+typedef struct {
+    int fft_size;                       /*!< Number of real input samples, power of two */
+    spectrum_window_t window;           /*!< Window applied before the transform */
+} spectrum_config_t;
+
+typedef struct spectrum_engine_t *spectrum_handle_t;
+
+/**
+ * @brief Create a real-input spectrum engine
+ *
+ * On target the half-size complex transform runs on the optimized esp-dsp
+ * kernels; on the linux target a portable scalar transform is used instead.
+ *
+ * @param config engine configuration
+ * @param ret_handle returned engine handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   fft_size is not a power of two
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t spectrum_create(const spectrum_config_t *config, spectrum_handle_t *ret_handle);
+
+/**
+ * @brief Transform one frame of PCM samples into log-magnitude bins
+ *
+ * @param handle engine handle
+ * @param samples `fft_size` signed 16-bit samples
+ * @param out_db `fft_size / 2` bins in the SPECTRUM_DB_FRAC_BITS fixed-point format
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid argument
+ */
+esp_err_t spectrum_process(spectrum_handle_t handle, const int16_t *samples, int16_t *out_db);
+
+/**
+ * @brief Get the number of output bins produced by spectrum_process
+ *
+ * @param handle engine handle
+ * @return number of bins
+ */
+int spectrum_get_bins(spectrum_handle_t handle);
+
+/**
+ * @brief Delete the spectrum engine
+ *
+ * @param handle engine handle
+ */
+void spectrum_delete(spectrum_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,94 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "spectrum.h"
+
+/**
+ * @brief Hop size for a given overlap in percent, e.g. 75 -> frame_size / 4
+ */
+#define STFT_HOP_FROM_OVERLAP(frame_size, overlap_percent)  ((frame_size) * (100 - (overlap_percent)) / 100)
+
+typedef enum {
+    STFT_AVG_NONE = 0,          /*!< Show the latest frame as is */
+    STFT_AVG_EXPONENTIAL,       /*!< Exponential moving average of every analysed frame */
+    STFT_AVG_PEAK_HOLD,         /*!< Hold peaks, release them by `peak_decay` per analysed frame */
+} stft_avg_mode_t;
+
+typedef struct {
+    int frame_size;             /*!< Samples per transform, power of two */
+    int hop_size;               /*!< New samples between two transforms, 1..frame_size */
+    spectrum_window_t window;   /*!< Analysis window */
+    stft_avg_mode_t avg_mode;   /*!< Spectral averaging */
+    uint16_t avg_alpha;         /*!< Weight of the new frame for STFT_AVG_EXPONENTIAL, Q15 */
+    int16_t peak_decay;         /*!< Release per analysed frame for STFT_AVG_PEAK_HOLD, spectrum.h dB format */
+    uint32_t sample_rate;       /*!< Input samples per second */
+    uint32_t output_rate;       /*!< Frames per second the display consumes */
+} stft_config_t;
+
+typedef struct {
+    uint32_t hops;              /*!< Hops pushed */
+    uint32_t analysed;          /*!< Transforms computed */
+    uint32_t output;            /*!< Frames handed to the display */
+    uint32_t skipped;           /*!< Frames due while the display was busy */
+} stft_stats_t;
+
+typedef struct stft_t *stft_handle_t;
+
+/**
+ * @brief Create a STFT front end
+ *
+ * @param config STFT configuration
+ * @param ret_handle returned handle
+ * @return esp_err_t
+ *         ESP_OK                Success
+ *         ESP_ERR_INVALID_ARG   Invalid configuration
+ *         ESP_ERR_NO_MEM        Out of memory
+ */
+esp_err_t stft_create(const stft_config_t *config, stft_handle_t *ret_handle);
+
+/**
+ * @brief Push one hop of new samples
+ *
+ * A transform is only computed when its result is needed: for the next
+ * displayed frame, or for every hop when averaging is enabled. Frames that
+ * fall due while the display is not ready are skipped, without a transform
+ * when no averaging is done.
+ *
+ * @param handle STFT handle
+ * @param samples `hop_size` new samples
+ * @param sink_ready whether the display can take a frame now
+ * @param out_db `frame_size / 2` bins, written only when true is returned
+ * @return true when `out_db` holds a new frame to display
+ */
+bool stft_push(stft_handle_t handle, const int16_t *samples, bool sink_ready, int16_t *out_db);
+
+/**
+ * @brief Get the STFT counters
+ *
+ * @param handle STFT handle
+ * @param stats returned counters
+ */
+void stft_get_stats(stft_handle_t handle, stft_stats_t *stats);
+
+/**
+ * @brief Delete the STFT front end
+ *
+ * @param handle STFT handle
+ */
+void stft_delete(stft_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
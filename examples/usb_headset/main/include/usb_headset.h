@@ -10,6 +10,8 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 #define DEFAULT_UAC_SAMPLE_RATE     (CONFIG_UAC_SAMPLE_RATE)
@@ -19,8 +21,16 @@ extern "C" {
 #define DEFAULT_RECORDER_WIDTH      (16)
 #define DEFAULT_PLAYER_CHANNEL      (CONFIG_UAC_SPEAKER_CHANNEL_NUM)
 #define DEFAULT_PLAYER_WIDTH        (16)
+// Format the codec and the audio FIFOs run at, USB streams in other formats are converted
+#define DEFAULT_CODEC_SAMPLE_RATE   (DEFAULT_UAC_SAMPLE_RATE)
+#define DEFAULT_CODEC_CHANNEL       (DEFAULT_PLAYER_CHANNEL)
+#define DEFAULT_CODEC_WIDTH         (16)
+#define DEFAULT_MIC_PROCESSING      (1)     // DC removal, high-pass, AGC and limiter on the microphone
+#define DEFAULT_MIC_NOISE_GATE      (0)
+#define DEFAULT_CONSOLE             (1)     // UART console, `mic on|off` toggles the microphone processing
 #define DEBUG_USB_HEADSET           (0)
 #define DEBUG_SYSTEM_VIEW           (0)
+#define DEBUG_LATENCY_TRACE         (0)     // Per-stage latency histograms, dumped by the `latency` console command
 /**
  * @brief Initialize the usb headset function
  *
@@ -30,6 +40,35 @@ extern "C" {
  */
 esp_err_t usb_headset_init(void);
 
+/**
+ * @brief Set the format of a USB stream, called when the host selects an alternate setting
+ *
+ * The codec keeps its own format, the stream is converted to and from it
+ * so no codec reconfiguration is needed. Safe from any task: the stream
+ * callback switches to the new converter between two packets and frees
+ * the old one.
+ *
+ * @param speaker true for the speaker (OUT) stream, false for the microphone (IN) stream
+ * @param sample_rate 16000, 32000, 44100 or 48000
+ * @param bits 16, 24 (3-byte subslot) or 32
+ * @param channels 1 or 2
+ * @return esp_err_t
+ *         ESP_OK                  Success
+ *         ESP_ERR_NOT_SUPPORTED   Unsupported format
+ *         ESP_ERR_NO_MEM          Out of memory
+ */
+esp_err_t usb_headset_set_stream_format(bool speaker, uint32_t sample_rate, uint8_t bits, uint8_t channels);
+
+/**
+ * @brief Bypass the microphone processing chain, e.g. when the host does its own
+ *
+ * Safe from any task, mic_task applies it before its next block. Bound to
+ * the `mic on|off` console command.
+ *
+ * @param bypass true to send the codec samples untouched
+ */
+void usb_headset_set_mic_bypass(bool bypass);
+
 #ifdef __cplusplus
 }
 #endif
@@ -42,7 +42,7 @@ esp_err_t bsp_i2s_read_debug(void *buf, size_t size, size_t *bytes_read, TickTyp
 {
     static uint64_t last_time = 0;
     uint64_t current_time = esp_timer_get_time();
-    size_t data_read_size = (current_time - last_time) / 1000 * DEFAULT_UAC_SAMPLE_RATE * DEFAULT_RECORDER_WIDTH / 8;
+    size_t data_read_size = (current_time - last_time) / 1000 * DEFAULT_CODEC_SAMPLE_RATE * DEFAULT_RECORDER_WIDTH / 8;
     if (data_read_size > size) {
         data_read_size = size;
     }
@@ -50,14 +50,14 @@ esp_err_t bsp_i2s_read_debug(void *buf, size_t size, size_t *bytes_read, TickTyp
 #if DEFAULT_RECORDER_CHANNEL == 1
     int16_t *data_buf = (int16_t *)buf;
     for (int i = 0; i < data_read_size / 2; i++) {
-        data_buf[i] = (int16_t)(32767 * sin(2 * M_PI * 1000 * i / DEFAULT_UAC_SAMPLE_RATE));
+        data_buf[i] = (int16_t)(32767 * sin(2 * M_PI * 1000 * i / DEFAULT_CODEC_SAMPLE_RATE));
     }
     *bytes_read = data_read_size;
 #elif DEFAULT_RECORDER_CHANNEL == 2
     int16_t *data_buf = (int16_t *)buf;
     for (int i = 0; i < data_read_size / 4; i++) {
-        data_buf[2 * i] = (int16_t)(32767 * sin(2 * M_PI * 1000 * i / DEFAULT_UAC_SAMPLE_RATE));
-        data_buf[2 * i + 1] = (int16_t)(32767 * sin(2 * M_PI * 1000 * i / DEFAULT_UAC_SAMPLE_RATE));
+        data_buf[2 * i] = (int16_t)(32767 * sin(2 * M_PI * 1000 * i / DEFAULT_CODEC_SAMPLE_RATE));
+        data_buf[2 * i + 1] = (int16_t)(32767 * sin(2 * M_PI * 1000 * i / DEFAULT_CODEC_SAMPLE_RATE));
     }
     *bytes_read = data_read_size;
 #else
@@ -105,3 +105,35 @@ esp_err_t bsp_i2s_write_debug(void *buf, size_t size, size_t *bytes_written, Tic
 #define SYSVIEW_MIC_READ_EVENT_START()
 #define SYSVIEW_MIC_READ_EVENT_END()
 #endif
+
+#if DEBUG_LATENCY_TRACE
+#include "esp_timer.h"
+#include "latency_trace.h"
+#include "sample_ring.h"
+/* Sample positions of a FIFO, used to follow a block from producer to consumer */
+static inline uint32_t latency_ring_pos(sample_ring_handle_t ring, bool write)
+{
+    sample_ring_stats_t stats;
+    sample_ring_get_stats(ring, &stats);
+    return write ? stats.written : stats.read;
+}
+
+#define LATENCY_TRACE_START(name)               const uint64_t name = latency_trace_now()
+#define LATENCY_TRACE_END(stage, name)          latency_trace_record_since(stage, name)
+#define LATENCY_TRACE_INTERVAL(stage)           do { \
+        static uint64_t _last = 0; \
+        const uint64_t _now = latency_trace_now(); \
+        if (_last) { \
+            latency_trace_record(stage, (uint32_t)(_now - _last)); \
+        } \
+        _last = _now; \
+    } while (0)
+#define LATENCY_TRACE_TAG(queue, ring)          latency_tag_push(queue, latency_ring_pos(ring, true))
+#define LATENCY_TRACE_CONSUME(queue, ring, stage) latency_tag_consume(queue, latency_ring_pos(ring, false), stage)
+#else
+#define LATENCY_TRACE_START(name)
+#define LATENCY_TRACE_END(stage, name)
+#define LATENCY_TRACE_INTERVAL(stage)
+#define LATENCY_TRACE_TAG(queue, ring)
+#define LATENCY_TRACE_CONSUME(queue, ring, stage)
+#endif
@@ -56,7 +56,7 @@ void app_main(void)
     fft_convert_init();
 
     /* Initialize audio i2s */
-    i2s_std_config_t i2s_config = BSP_I2S_DUPLEX_MONO_CFG(DEFAULT_UAC_SAMPLE_RATE);
+    i2s_std_config_t i2s_config = BSP_I2S_DUPLEX_MONO_CFG(DEFAULT_CODEC_SAMPLE_RATE);
     i2s_config.clk_cfg.mclk_multiple = I2S_MCLK_MULTIPLE_384;
     bsp_audio_init(&i2s_config);
 
@@ -64,7 +64,7 @@ void app_main(void)
     bsp_board_init();
 
     /* Initialize codec with defaults */
-    bsp_codec_set_fs(DEFAULT_UAC_SAMPLE_RATE, DEFAULT_PLAYER_WIDTH, DEFAULT_PLAYER_CHANNEL);
+    bsp_codec_set_fs(DEFAULT_CODEC_SAMPLE_RATE, DEFAULT_CODEC_WIDTH, DEFAULT_CODEC_CHANNEL);
     bsp_codec_volume_set(DEFAULT_VOLUME, NULL);
     bsp_codec_mute_set(false);
 #endif
@@ -0,0 +1,251 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "audio_convert.h"
+
+#define CONVERT_CHUNK_FRAMES    (64)    /* Frames widened to 32 bits at a time */
+
+struct audio_convert_t {
+    audio_format_t in;
+    audio_format_t out;
+    bool passthrough;
+    /* Rate conversion: the next output frame is at input position idx + phase / out rate */
+    int32_t prev[AUDIO_CONVERT_MAX_CHANNELS];   /* Last input frame of the previous block */
+    uint32_t idx;               /* 0 is `prev`, 1 the first frame of the next block */
+    uint32_t phase;             /* 0 .. out rate - 1 */
+    int32_t work[CONVERT_CHUNK_FRAMES * AUDIO_CONVERT_MAX_CHANNELS];
+    int32_t resampled[(CONVERT_CHUNK_FRAMES * AUDIO_CONVERT_MAX_RATIO + 1) * AUDIO_CONVERT_MAX_CHANNELS];
+};
+
+static bool format_supported(const audio_format_t *format)
+{
+    const bool rate_ok = format->sample_rate == 16000 || format->sample_rate == 32000
+                         || format->sample_rate == 44100 || format->sample_rate == 48000;
+    const bool bits_ok = format->bits == 16 || format->bits == 24 || format->bits == 32;
+    return rate_ok && bits_ok && format->channels >= 1 && format->channels <= AUDIO_CONVERT_MAX_CHANNELS;
+}
+
+esp_err_t audio_convert_create(const audio_format_t *in, const audio_format_t *out, audio_convert_handle_t *ret_handle)
+{
+    if (in == NULL || out == NULL || ret_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!format_supported(in) || !format_supported(out)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    struct audio_convert_t *convert = calloc(1, sizeof(struct audio_convert_t));
+    if (convert == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    convert->in = *in;
+    convert->out = *out;
+    convert->passthrough = in->sample_rate == out->sample_rate && in->bits == out->bits && in->channels == out->channels;
+    audio_convert_reset(convert);
+
+    *ret_handle = convert;
+    return ESP_OK;
+}
+
+void audio_convert_reset(audio_convert_handle_t handle)
+{
+    memset(handle->prev, 0, sizeof(handle->prev));
+    /* The first output frame is the first input frame, no leading silence */
+    handle->idx = 1;
+    handle->phase = 0;
+}
+
+/* Widen `frames` frames to left-justified 32-bit samples, keeping the channel count */
+static void convert_decode(const audio_format_t *format, const uint8_t *in, size_t frames, int32_t *out)
+{
+    const size_t n = frames * format->channels;
+
+    switch (format->bits) {
+    case 16: {
+        const int16_t *src = (const int16_t *)in;
+        for (size_t i = 0; i < n; i++) {
+            out[i] = (int32_t)((uint32_t)src[i] << 16);
+        }
+        break;
+    }
+    case 24:
+        for (size_t i = 0; i < n; i++, in += 3) {
+            out[i] = (int32_t)(((uint32_t)in[0] << 8) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 24));
+        }
+        break;
+    default:
+        memcpy(out, in, n * sizeof(int32_t));
+        break;
+    }
+}
+
+/* Round and saturate 32-bit samples to the output width */
+static void convert_encode(const audio_format_t *format, const int32_t *in, size_t frames, uint8_t *out)
+{
+    const size_t n = frames * format->channels;
+
+    switch (format->bits) {
+    case 16: {
+        int16_t *dst = (int16_t *)out;
+        for (size_t i = 0; i < n; i++) {
+            const int32_t v = in[i] > INT32_MAX - 0x8000 ? INT32_MAX : in[i] + 0x8000;
+            dst[i] = (int16_t)(v >> 16);
+        }
+        break;
+    }
+    case 24:
+        for (size_t i = 0; i < n; i++, out += 3) {
+            const int32_t v = (in[i] > INT32_MAX - 0x80 ? INT32_MAX : in[i] + 0x80) >> 8;
+            out[0] = (uint8_t)v;
+            out[1] = (uint8_t)(v >> 8);
+            out[2] = (uint8_t)(v >> 16);
+        }
+        break;
+    default:
+        memmove(out, in, n * sizeof(int32_t));
+        break;
+    }
+}
+
+/* Map channels in place, `work` has room for the larger of the two layouts */
+static void convert_channels(int in_channels, int out_channels, int32_t *work, size_t frames)
+{
+    if (in_channels == 2 && out_channels == 1) {
+        for (size_t i = 0; i < frames; i++) {
+            work[i] = (work[2 * i] >> 1) + (work[2 * i + 1] >> 1);
+        }
+    } else if (in_channels == 1 && out_channels == 2) {
+        /* Backwards, so nothing is overwritten before it is read */
+        for (size_t i = frames; i-- > 0;) {
+            work[2 * i + 1] = work[i];
+            work[2 * i] = work[i];
+        }
+    }
+}
+
+static inline int32_t convert_sample(const struct audio_convert_t *convert, const int32_t *block, int ch, uint32_t idx)
+{
+    return idx == 0 ? convert->prev[ch] : block[(idx - 1) * convert->out.channels + ch];
+}
+
+/* Rate-convert one block of `frames` frames, returns the frames written to `out` */
+static size_t convert_rate(struct audio_convert_t *convert, const int32_t *block, size_t frames, int32_t *out)
+{
+    const int channels = convert->out.channels;
+    const uint32_t in_rate = convert->in.sample_rate;
+    const uint32_t out_rate = convert->out.sample_rate;
+    size_t produced = 0;
+
+    /* Interpolating between idx and idx + 1 needs frame idx + 1 of the block */
+    while (convert->idx < frames) {
+        /* Q16 weight of the next input frame */
+        const int64_t weight = ((uint64_t)convert->phase << 16) / out_rate;
+        for (int ch = 0; ch < channels; ch++) {
+            const int64_t x0 = convert_sample(convert, block, ch, convert->idx);
+            const int64_t x1 = convert_sample(convert, block, ch, convert->idx + 1);
+            out[produced * channels + ch] = (int32_t)(x0 + (((x1 - x0) * weight) >> 16));
+        }
+        produced++;
+        convert->phase += in_rate;
+        convert->idx += convert->phase / out_rate;
+        convert->phase %= out_rate;
+    }
+
+    if (frames > 0) {
+        for (int ch = 0; ch < channels; ch++) {
+            convert->prev[ch] = block[(frames - 1) * channels + ch];
+        }
+        convert->idx -= frames;
+    }
+    return produced;
+}
+
+size_t audio_convert_in_frames(audio_convert_handle_t handle, size_t out_frames)
+{
+    if (handle->in.sample_rate == handle->out.sample_rate || out_frames == 0) {
+        return out_frames;
+    }
+    /* Output frame m sits at idx + (phase + m * in rate) / out rate and needs the frame after it */
+    const uint64_t last = handle->idx + (handle->phase + (uint64_t)(out_frames - 1) * handle->in.sample_rate) / handle->out.sample_rate;
+    return last + 1;
+}
+
+size_t audio_convert_out_frames(audio_convert_handle_t handle, size_t in_frames)
+{
+    if (handle->in.sample_rate == handle->out.sample_rate) {
+        return in_frames;
+    }
+    if (in_frames <= handle->idx) {
+        return 0;
+    }
+    /* Number of m with idx + (phase + m * in rate) / out rate < in_frames */
+    const uint64_t span = (uint64_t)(in_frames - handle->idx) * handle->out.sample_rate - handle->phase;
+    return (span + handle->in.sample_rate - 1) / handle->in.sample_rate;
+}
+
+size_t audio_convert_process(audio_convert_handle_t handle, const void *in, size_t in_frames, void *out, size_t out_capacity)
+{
+    const size_t in_frame_bytes = audio_format_frame_bytes(&handle->in);
+    const size_t out_frame_bytes = audio_format_frame_bytes(&handle->out);
+    const bool same_rate = handle->in.sample_rate == handle->out.sample_rate;
+    const uint8_t *src = in;
+    uint8_t *dst = out;
+    size_t produced = 0;
+
+    if (handle->passthrough) {
+        const size_t n = in_frames < out_capacity ? in_frames : out_capacity;
+        if (in != out) {
+            memmove(out, in, n * in_frame_bytes);
+        }
+        return n;
+    }
+
+    while (in_frames > 0) {
+        const size_t chunk = in_frames < CONVERT_CHUNK_FRAMES ? in_frames : CONVERT_CHUNK_FRAMES;
+        convert_decode(&handle->in, src, chunk, handle->work);
+        convert_channels(handle->in.channels, handle->out.channels, handle->work, chunk);
+
+        const int32_t *result = handle->work;
+        size_t frames = chunk;
+        if (!same_rate) {
+            frames = convert_rate(handle, handle->work, chunk, handle->resampled);
+            result = handle->resampled;
+        }
+        if (frames > out_capacity - produced) {
+            /* Too small an output buffer, the rest is dropped */
+            frames = out_capacity - produced;
+        }
+        convert_encode(&handle->out, result, frames, dst);
+
+        produced += frames;
+        dst += frames * out_frame_bytes;
+        src += chunk * in_frame_bytes;
+        in_frames -= chunk;
+    }
+    return produced;
+}
+
+bool audio_convert_is_passthrough(audio_convert_handle_t handle)
+{
+    return handle->passthrough;
+}
+
+void audio_convert_get_formats(audio_convert_handle_t handle, audio_format_t *in, audio_format_t *out)
+{
+    if (in) {
+        *in = handle->in;
+    }
+    if (out) {
+        *out = handle->out;
+    }
+}
+
+void audio_convert_delete(audio_convert_handle_t handle)
+{
+    free(handle);
+}
@@ -5,6 +5,7 @@
  */
 
 #include <math.h>
+#include <stdatomic.h>
 #include "bsp/esp-bsp.h"
 #include "bsp/display.h"
 #include "display.h"
@@ -15,13 +16,18 @@
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_vendor.h"
 #include "esp_lcd_panel_ops.h"
+#include "display_render.h"
 #include "fft_convert.h"
+#include "spectrum.h"
 
 static const char *TAG = "display";
 /****************** LCD Configuration ************************************************/
 #define LCD_WIDTH              BSP_LCD_H_RES
 #define LCD_HEIGHT             BSP_LCD_V_RES
 #define LCD_BUFFER_SIZE        320*240*2
+#define BAND_MODE              1                           /* 1: Compose in two small DMA bands 0: Keep a full-screen buffer */
+#define BAND_HEIGHT            40                          /* Rows of a full-width band */
+#define BAND_BUFFER_SIZE       (LCD_WIDTH * BAND_HEIGHT * 2)
 
 /****************** configure the example working mode *******************************/
 #define BASIC_HIGH             40                          /* Subtract the height of the column height */
@@ -30,6 +36,8 @@ static const char *TAG = "display";
 #define STRIP_DROP_SPEED       4                           /* The speed of the cube's fall */
 #define COLOR_MODE             4                           /* 4: Customer mode 3: Tri-color gradient 2: Two-color gradient 1: One_color gradient */
 #define SQUARE_MODE            2                           /* 1: Even fall mode 2: Gravity simulation mode */
+#define DIRTY_REGION_MODE      1                           /* 1: Only repaint and flush what changed 0: Repaint and flush the whole frame */
+#define RECT_MERGE_COST        256                         /* Pixels one extra panel transfer is worth, used to merge dirty regions */
 
 #if SQUARE_MODE == 2
 #define ACCELERATION           1.5
@@ -64,8 +72,21 @@ static const char *TAG = "display";
 #endif
 
 static esp_lcd_panel_handle_t panel_handle = NULL;
+static atomic_int color_trans_pending = 0;                 /* Color transfers queued to the panel io and not sent yet */
 static int16_t fre_point[STRIP_NUM] = {0};
+#if BAND_MODE
+static uint16_t *band_buffer[2] = {NULL};
+static int band_index = 0;
+#else
 static uint16_t *display_buffer = NULL;
+static size_t flush_offset = 0;
+#endif
+static display_render_layout_t render_layout = {0};
+static display_render_state_t render_state = {0};
+#if DIRTY_REGION_MODE
+static display_render_state_t shown_state = {0};           /* What the panel holds right now */
+static display_render_rect_t dirty_rects[DISPLAY_RENDER_MAX_STRIPS];
+#endif
 
 typedef struct {
     float speed[STRIP_NUM];
@@ -155,15 +176,62 @@ static int draw_square(int y, int point_i)
     return display_square.square_high[point_i];
 }
 
-esp_err_t display_draw(float *data)
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+static bool display_color_trans_done(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx)
+{
+    atomic_fetch_sub(&color_trans_pending, 1);
+    return false;
+}
+#endif
+
+static void display_panel_draw(const display_render_rect_t *rect, const void *pixels)
+{
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    /* Counted before queueing, the done callback may run before draw_bitmap returns */
+    atomic_fetch_add(&color_trans_pending, 1);
+#endif
+    esp_lcd_panel_draw_bitmap(panel_handle, rect->x_start, rect->y_start, rect->x_end, rect->y_end, pixels);
+}
+
+#if BAND_MODE
+static void display_flush_band(const display_render_rect_t *band, const uint16_t *pixels, void *user_ctx)
+{
+    display_panel_draw(band, pixels);
+}
+
+static void display_flush_rect(const display_render_rect_t *rect)
+{
+    /**
+     * Ping-pong between the two bands: the panel io waits for the queued color
+     * transfer before sending the next window commands, so the band that is
+     * rendered next has always been fully sent by the time we touch it.
+     */
+    display_render_bands(&render_layout, &render_state, rect, band_buffer, BAND_BUFFER_SIZE / sizeof(uint16_t),
+                         &band_index, display_flush_band, NULL);
+}
+#else
+static void display_flush_rect(const display_render_rect_t *rect)
+{
+    /* Regions are packed one after another, the full frame buffer is the worst case */
+    uint16_t *buf = display_buffer + flush_offset;
+    display_render_rect(&render_layout, &render_state, rect, buf);
+    display_panel_draw(rect, buf);
+    flush_offset += display_render_rect_area(rect);
+}
+#endif
+
+bool display_is_ready(void)
+{
+    return atomic_load(&color_trans_pending) == 0;
+}
+
+esp_err_t display_draw(const int16_t *data)
 {
     int fre_point_i = 0;
-    uint16_t line_color = 0;
-    uint16_t color = 0;
     int correct_y = 0;
     for (int x = 1; x < LCD_WIDTH; x += GROUP_WIDTH) {
         if (data != NULL) {
-            correct_y = data[fre_point[fre_point_i]] - BASIC_HIGH;
+            correct_y = SPECTRUM_DB_TO_INT(data[fre_point[fre_point_i]]) - BASIC_HIGH;
             if ( x <= 40 ) {
                 correct_y = adjust_height(correct_y, 1.15);
             } else if (x > 40 || x < 100) {
@@ -172,29 +240,47 @@ esp_err_t display_draw(float *data)
                 correct_y = adjust_height(correct_y, 1);
             }
         }
-        int square_high = LCD_HEIGHT - draw_square(correct_y, fre_point_i);
-        correct_y = LCD_HEIGHT - correct_y;
-        line_color = fade_color(x, COLOR_RANGE);
-        for (int y = 0; y < LCD_HEIGHT; y++) {
-            if (correct_y <= y) {
-                color = line_color;
-            } else if (square_high - STRIP_WIDTH <= y && square_high >= y) {
-                color = 0xFFFF;
-            } else {
-                color = 0x0000;
-            }
-
-            for (int z = 0; z < STRIP_WIDTH; z++) {
-                display_buffer[y * LCD_WIDTH + x + z] = color;
-            }
-        }
+        render_state.square_top[fre_point_i] = LCD_HEIGHT - draw_square(correct_y, fre_point_i);
+        render_state.bar_top[fre_point_i] = LCD_HEIGHT - correct_y;
         fre_point_i++;
         correct_y = 0;
     }
-    esp_lcd_panel_draw_bitmap(panel_handle, 0, 0, LCD_WIDTH, LCD_HEIGHT, (void *)display_buffer);
+
+#if !BAND_MODE
+    flush_offset = 0;
+#endif
+#if DIRTY_REGION_MODE
+    int rect_num = display_render_diff(&render_layout, &shown_state, &render_state, RECT_MERGE_COST, dirty_rects);
+    for (int i = 0; i < rect_num; i++) {
+        display_flush_rect(&dirty_rects[i]);
+    }
+    shown_state = render_state;
+#else
+    const display_render_rect_t full = {0, 0, LCD_WIDTH, LCD_HEIGHT};
+    display_flush_rect(&full);
+#endif
     return ESP_OK;
 }
 
+static void display_render_layout_init(void)
+{
+    render_layout.width = LCD_WIDTH;
+    render_layout.height = LCD_HEIGHT;
+    render_layout.first_x = 1;
+    render_layout.group_width = GROUP_WIDTH;
+    render_layout.strip_width = STRIP_WIDTH;
+    render_layout.strip_num = STRIP_NUM;
+    for (int i = 0; i < STRIP_NUM; i++) {
+        render_layout.strip_color[i] = fade_color(render_layout.first_x + i * GROUP_WIDTH, COLOR_RANGE);
+        /* Blank frame: no bar rows, square above the top edge */
+        render_state.bar_top[i] = LCD_HEIGHT;
+        render_state.square_top[i] = -1;
+    }
+#if DIRTY_REGION_MODE
+    shown_state = render_state;
+#endif
+}
+
 esp_err_t display_lcd_init(void)
 {
     esp_lcd_panel_io_handle_t io_handle = NULL;
@@ -202,6 +288,12 @@ esp_err_t display_lcd_init(void)
         .max_transfer_sz = (LCD_SPI_MAX_DATA_SIZE),
     };
     bsp_display_new(&bsp_disp_cfg, &panel_handle, &io_handle);
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    const esp_lcd_panel_io_callbacks_t io_cbs = {
+        .on_color_trans_done = display_color_trans_done,
+    };
+    esp_lcd_panel_io_register_event_callbacks(io_handle, &io_cbs, NULL);
+#endif
 
     esp_lcd_panel_disp_on_off(panel_handle, true);
     bsp_display_backlight_on();
@@ -211,10 +303,24 @@ esp_err_t display_lcd_init(void)
         display_square.speed[i] = 0;
     }
 
+#if BAND_MODE
+    for (int i = 0; i < 2; i++) {
+        band_buffer[i] = (uint16_t *)heap_caps_malloc(BAND_BUFFER_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        assert(band_buffer[i] != NULL);
+    }
+#else
     display_buffer = (uint16_t *)heap_caps_calloc(1, LCD_BUFFER_SIZE, MALLOC_CAP_INTERNAL);
     assert(display_buffer != NULL);
-    esp_lcd_panel_draw_bitmap(panel_handle, 0, 0, LCD_WIDTH, LCD_HEIGHT, (void *)display_buffer);
+#endif
     frequency_multiplier_calculation();
+    display_render_layout_init();
+
+    /* Clear the panel with the blank frame */
+    const display_render_rect_t full = {0, 0, LCD_WIDTH, LCD_HEIGHT};
+#if !BAND_MODE
+    flush_offset = 0;
+#endif
+    display_flush_rect(&full);
 
     return ESP_OK;
 }
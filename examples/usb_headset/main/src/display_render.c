@@ -0,0 +1,126 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "display_render.h"
+
+#define RENDER_MIN(a, b)    ((a) < (b) ? (a) : (b))
+#define RENDER_MAX(a, b)    ((a) > (b) ? (a) : (b))
+
+static inline uint16_t render_strip_pixel(const display_render_layout_t *layout, const display_render_state_t *state,
+                                          int strip, int y)
+{
+    if (y >= state->bar_top[strip]) {
+        return layout->strip_color[strip];
+    }
+    if (y >= state->square_top[strip] - layout->strip_width && y <= state->square_top[strip]) {
+        return DISPLAY_RENDER_SQUARE_COLOR;
+    }
+    return DISPLAY_RENDER_BG_COLOR;
+}
+
+void display_render_rect(const display_render_layout_t *layout, const display_render_state_t *state,
+                         const display_render_rect_t *rect, uint16_t *out)
+{
+    int first_strip = 0;
+    if (rect->x_start > layout->first_x) {
+        first_strip = (rect->x_start - layout->first_x) / layout->group_width;
+    }
+
+    for (int y = rect->y_start; y < rect->y_end; y++) {
+        int x = rect->x_start;
+        for (int i = first_strip; i < layout->strip_num && x < rect->x_end; i++) {
+            const int xs = layout->first_x + i * layout->group_width;
+            const int xe = xs + layout->strip_width;
+            if (xe <= x) {
+                continue;
+            }
+            for (; x < xs && x < rect->x_end; x++) {
+                *out++ = DISPLAY_RENDER_BG_COLOR;
+            }
+            const uint16_t color = render_strip_pixel(layout, state, i, y);
+            for (; x < xe && x < rect->x_end; x++) {
+                *out++ = color;
+            }
+        }
+        for (; x < rect->x_end; x++) {
+            *out++ = DISPLAY_RENDER_BG_COLOR;
+        }
+    }
+}
+
+int display_render_diff(const display_render_layout_t *layout, const display_render_state_t *prev,
+                        const display_render_state_t *cur, int merge_cost_px, display_render_rect_t *rects)
+{
+    int num = 0;
+
+    for (int i = 0; i < layout->strip_num; i++) {
+        const int b0 = prev->bar_top[i], b1 = cur->bar_top[i];
+        const int s0 = prev->square_top[i], s1 = cur->square_top[i];
+        int y_min = layout->height;
+        int y_max = -1;
+
+        if (b0 != b1) {
+            /* Rows between the two bar tops switch between bar and not-bar */
+            y_min = RENDER_MIN(b0, b1);
+            y_max = RENDER_MAX(b0, b1) - 1;
+        }
+        if (s0 != s1) {
+            /* Old square is erased, new one is drawn */
+            y_min = RENDER_MIN(y_min, RENDER_MIN(s0, s1) - layout->strip_width);
+            y_max = RENDER_MAX(y_max, RENDER_MAX(s0, s1));
+        }
+        y_min = RENDER_MAX(y_min, 0);
+        y_max = RENDER_MIN(y_max, layout->height - 1);
+        if (y_min > y_max) {
+            continue;
+        }
+
+        const int xs = layout->first_x + i * layout->group_width;
+        display_render_rect_t rect = {
+            .x_start = xs,
+            .y_start = y_min,
+            .x_end = RENDER_MIN(xs + layout->strip_width, layout->width),
+            .y_end = y_max + 1,
+        };
+
+        if (num > 0 && merge_cost_px > 0) {
+            display_render_rect_t *last = &rects[num - 1];
+            display_render_rect_t merged = {
+                .x_start = RENDER_MIN(last->x_start, rect.x_start),
+                .y_start = RENDER_MIN(last->y_start, rect.y_start),
+                .x_end = RENDER_MAX(last->x_end, rect.x_end),
+                .y_end = RENDER_MAX(last->y_end, rect.y_end),
+            };
+            size_t separate = display_render_rect_area(last) + display_render_rect_area(&rect);
+            if (display_render_rect_area(&merged) <= separate + (size_t)merge_cost_px) {
+                *last = merged;
+                continue;
+            }
+        }
+        rects[num++] = rect;
+    }
+
+    return num;
+}
+
+int display_render_bands(const display_render_layout_t *layout, const display_render_state_t *state,
+                         const display_render_rect_t *rect, uint16_t *const band_buf[2], size_t band_pixels,
+                         int *band_index, display_render_flush_cb_t flush, void *user_ctx)
+{
+    const int rows = display_render_band_rows(rect, band_pixels);
+    display_render_rect_t band = *rect;
+    int num = 0;
+
+    for (band.y_start = rect->y_start; band.y_start < rect->y_end; band.y_start = band.y_end) {
+        band.y_end = RENDER_MIN(band.y_start + rows, rect->y_end);
+        uint16_t *buf = band_buf[*band_index];
+        *band_index ^= 1;
+        display_render_rect(layout, state, &band, buf);
+        flush(&band, buf, user_ctx);
+        num++;
+    }
+    return num;
+}
@@ -0,0 +1,158 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include "drift_comp.h"
+
+#define DRIFT_HISTORY           (3)     /* Input frames kept for the 4-point interpolation */
+#define DRIFT_FILL_SMOOTH       (1.0f / 32)
+#define DRIFT_PHASE_ONE         (1ULL << 32)
+
+struct drift_comp_t {
+    drift_comp_config_t config;
+    float history[DRIFT_COMP_MAX_CHANNELS][DRIFT_HISTORY];
+    uint64_t pos;               /* Q32 position of the next output frame, history included */
+    uint64_t step;              /* Q32 ratio */
+    float fill_avg;
+    float integral_ppm;
+    float correction_ppm;
+    bool fill_valid;
+};
+
+esp_err_t drift_comp_create(const drift_comp_config_t *config, drift_comp_handle_t *ret_handle)
+{
+    if (config == NULL || ret_handle == NULL || config->channels <= 0 || config->channels > DRIFT_COMP_MAX_CHANNELS
+            || config->target_fill == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct drift_comp_t *drift = calloc(1, sizeof(struct drift_comp_t));
+    if (drift == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    drift->config = *config;
+    drift_comp_reset(drift);
+
+    *ret_handle = drift;
+    return ESP_OK;
+}
+
+void drift_comp_reset(drift_comp_handle_t handle)
+{
+    handle->pos = DRIFT_PHASE_ONE;
+    handle->fill_valid = false;
+    /* Start from the last drift estimate so a restart does not relearn it */
+    handle->correction_ppm = handle->integral_ppm;
+    handle->step = (uint64_t)((double)DRIFT_PHASE_ONE * (1.0 + handle->correction_ppm * 1e-6));
+}
+
+void drift_comp_update(drift_comp_handle_t handle, size_t fill)
+{
+    const drift_comp_config_t *cfg = &handle->config;
+
+    if (!handle->fill_valid) {
+        handle->fill_avg = fill;
+        handle->fill_valid = true;
+    } else {
+        handle->fill_avg += ((float)fill - handle->fill_avg) * DRIFT_FILL_SMOOTH;
+    }
+
+    const float error = (handle->fill_avg - cfg->target_fill) / cfg->target_fill;
+    handle->integral_ppm += cfg->ki_ppm * error;
+    if (handle->integral_ppm > cfg->max_ppm) {
+        handle->integral_ppm = cfg->max_ppm;
+    } else if (handle->integral_ppm < -cfg->max_ppm) {
+        handle->integral_ppm = -cfg->max_ppm;
+    }
+
+    float correction = cfg->kp_ppm * error + handle->integral_ppm;
+    if (correction > cfg->max_ppm) {
+        correction = cfg->max_ppm;
+    } else if (correction < -cfg->max_ppm) {
+        correction = -cfg->max_ppm;
+    }
+    handle->correction_ppm = correction;
+    handle->step = (uint64_t)((double)DRIFT_PHASE_ONE * (1.0 + correction * 1e-6));
+}
+
+/* Sample `idx` of the virtual stream [history, in] for channel `ch` */
+static inline float drift_sample(const struct drift_comp_t *drift, const int16_t *in, int ch, size_t idx)
+{
+    if (idx < DRIFT_HISTORY) {
+        return drift->history[ch][idx];
+    }
+    return in[(idx - DRIFT_HISTORY) * drift->config.channels + ch];
+}
+
+static inline int16_t drift_saturate(float v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    } else if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)(v + (v >= 0 ? 0.5f : -0.5f));
+}
+
+size_t drift_comp_process(drift_comp_handle_t handle, const int16_t *in, size_t in_frames, int16_t *out, size_t out_capacity)
+{
+    const int channels = handle->config.channels;
+    size_t produced = 0;
+
+    /**
+     * The virtual stream has DRIFT_HISTORY + in_frames frames. Interpolating
+     * between i and i + 1 needs i - 1 .. i + 2, so i runs up to in_frames.
+     */
+    while (produced < out_capacity && (handle->pos >> 32) <= in_frames) {
+        const size_t i = handle->pos >> 32;
+        const float t = (uint32_t)handle->pos * (1.0f / 4294967296.0f);
+        for (int ch = 0; ch < channels; ch++) {
+            const float xm1 = drift_sample(handle, in, ch, i - 1);
+            const float x0 = drift_sample(handle, in, ch, i);
+            const float x1 = drift_sample(handle, in, ch, i + 1);
+            const float x2 = drift_sample(handle, in, ch, i + 2);
+            /* 4-point, 3rd order Hermite */
+            const float c1 = 0.5f * (x1 - xm1);
+            const float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+            const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+            out[produced * channels + ch] = drift_saturate(((c3 * t + c2) * t + c1) * t + x0);
+        }
+        produced++;
+        handle->pos += handle->step;
+    }
+
+    if (handle->pos < ((uint64_t)(in_frames + 1) << 32)) {
+        /* Ran out of output space: the rest of this block is dropped */
+        handle->pos = (uint64_t)(in_frames + 1) << 32;
+    }
+
+    /* Keep the last DRIFT_HISTORY frames of the virtual stream and rebase the position */
+    for (int ch = 0; ch < channels; ch++) {
+        float tail[DRIFT_HISTORY];
+        for (int k = 0; k < DRIFT_HISTORY; k++) {
+            tail[k] = drift_sample(handle, in, ch, in_frames + k);
+        }
+        for (int k = 0; k < DRIFT_HISTORY; k++) {
+            handle->history[ch][k] = tail[k];
+        }
+    }
+    handle->pos -= (uint64_t)in_frames << 32;
+    return produced;
+}
+
+void drift_comp_get_status(drift_comp_handle_t handle, drift_comp_status_t *status)
+{
+    status->drift_ppm = handle->integral_ppm;
+    status->correction_ppm = handle->correction_ppm;
+    status->ratio = (double)handle->step / DRIFT_PHASE_ONE;
+    status->fill_avg = handle->fill_avg;
+}
+
+void drift_comp_delete(drift_comp_handle_t handle)
+{
+    free(handle);
+}
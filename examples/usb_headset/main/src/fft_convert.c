@@ -4,43 +4,55 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 
-#include <math.h>
+#include <inttypes.h>
 #include "display.h"
-#include "esp_dsp.h"
+#include "esp_log.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/ringbuf.h"
+#include "freertos/task.h"
 #include "fft_convert.h"
+#include "sample_ring.h"
+#include "stft.h"
+#include "usb_headset.h"
 
-#define RB_LENGTH N_SAMPLES * 12
+#define FRAME_SAMPLES       (N_SAMPLES * 2)
+#define RING_SAMPLES        (N_SAMPLES * 8)
+#define IDLE_REDRAW_MS      (40)                /* Let the bars decay when no audio arrives */
 
-static const char *TAG = "FFT_CONVERT";
-static RingbufHandle_t rb_handle = {0};
-static int N = N_SAMPLES;
-static float *fft_buff;
-
-static void fft_process(int16_t *data, float *out_buff)
-{
-    dsps_fft2r_sc16_ansi(data, N);
-    dsps_bit_rev_sc16_ansi(data, N);
-    for (int i = 0 ; i < (N_SAMPLES * 2) ; i++) {
-        out_buff[i] = data[i];
-        out_buff[i] = out_buff[i] / INT16_MAX;
-    }
+/****************** configure the spectrum analysis **********************************/
+#define STFT_OVERLAP        (50)                                    /* Overlap of two frames in percent */
+#define STFT_HOP_SAMPLES    STFT_HOP_FROM_OVERLAP(FRAME_SAMPLES, STFT_OVERLAP)
+#define STFT_WINDOW         SPECTRUM_WINDOW_HANN
+#define STFT_AVG_MODE       STFT_AVG_NONE                           /* STFT_AVG_NONE / STFT_AVG_EXPONENTIAL / STFT_AVG_PEAK_HOLD, averaging transforms every hop */
+#define STFT_AVG_ALPHA      (0.6 * 32768)                           /* Weight of the newest frame */
+#define STFT_PEAK_DECAY     (2 << SPECTRUM_DB_FRAC_BITS)            /* dB released per analysed frame */
+#define DISPLAY_FPS         (30)                                    /* Frames the panel is fed per second */
 
-    for (int i = 0 ; i < N_SAMPLES; i++) {
-        out_buff[i] = 10 * log10f(0.0000000000001 + out_buff[i * 2 + 0] * out_buff[i * 2 + 0] + out_buff[i * 2 + 1] * out_buff[i * 2 + 1]);
-        out_buff[i] += 130;
-    }
-}
+static const char *TAG = "FFT_CONVERT";
+static sample_ring_handle_t ring = NULL;
+static TaskHandle_t fft_task_handle = NULL;
+static stft_handle_t stft = NULL;
+static int16_t *hop_buff;
+static int16_t *fft_buff;
 
 esp_err_t fft_init(void)
 {
-    fft_buff = (float *)calloc(1, N_SAMPLES * 2 * sizeof(float));
+    fft_buff = (int16_t *)calloc(1, N_SAMPLES * sizeof(int16_t));
+    hop_buff = (int16_t *)calloc(1, STFT_HOP_SAMPLES * sizeof(int16_t));
 
-    assert(fft_buff != NULL);
-    esp_err_t ret;
-    ret = dsps_fft2r_init_sc16(NULL, CONFIG_DSP_MAX_FFT_SIZE);
-    if (ret  != ESP_OK) {
+    assert(fft_buff != NULL && hop_buff != NULL);
+    /* N_SAMPLES * 2 real samples in, N_SAMPLES log-magnitude bins out */
+    const stft_config_t config = {
+        .frame_size = FRAME_SAMPLES,
+        .hop_size = STFT_HOP_SAMPLES,
+        .window = STFT_WINDOW,
+        .avg_mode = STFT_AVG_MODE,
+        .avg_alpha = STFT_AVG_ALPHA,
+        .peak_decay = STFT_PEAK_DECAY,
+        .sample_rate = DEFAULT_CODEC_SAMPLE_RATE * DEFAULT_CODEC_CHANNEL,
+        .output_rate = DISPLAY_FPS,
+    };
+    esp_err_t ret = stft_create(&config, &stft);
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Not possible to initialize FFT. Error = %i", ret);
         return ret;
     }
@@ -49,60 +61,63 @@ esp_err_t fft_init(void)
 
 void rb_write(int16_t *buf, size_t size)
 {
-    if (buf == NULL) {
+    if (buf == NULL || ring == NULL) {
         return;
     }
-    xRingbufferSend(rb_handle, (void *)buf, size, 0);
+    bool frame_ready = false;
+    sample_ring_write(ring, buf, size / sizeof(int16_t), &frame_ready);
+    if (frame_ready && fft_task_handle != NULL) {
+        xTaskNotifyGive(fft_task_handle);
+    }
 }
 
-static void rb_init(void)
+static esp_err_t rb_init(void)
 {
-    rb_handle = xRingbufferCreate(RB_LENGTH, RINGBUF_TYPE_BYTEBUF);
-    if (rb_handle == NULL) {
+    esp_err_t ret = sample_ring_create(RING_SAMPLES, STFT_HOP_SAMPLES, &ring);
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create ring buffer");
     }
+    return ret;
 }
 
 static void fft_convert_task(void *pvParameter)
 {
-    int16_t *data = NULL;
-    size_t item_size = 0;
-    size_t display_wtd = 0;
-    /**
-     * The total length of DMA buffer of I2S is:
-     * `dma_frame_num * dma_desc_num * i2s_channel_num * i2s_data_bit_width / 8`.
-     * Transmit `dma_frame_num * dma_desc_num` bytes to DMA is trade-off.
-     */
-    const size_t item_size_upto = N_SAMPLES * 2 * sizeof(int16_t);
-    UBaseType_t items_waiting;
+    sample_ring_stats_t stats;
+    stft_stats_t stft_stats;
 
     while (1) {
-        vRingbufferGetInfo(rb_handle, NULL, NULL, NULL, NULL, &items_waiting);
-        if (items_waiting >= item_size_upto) {
-            item_size = 0;
-            /* receive data from ringbuffer and write it to I2S DMA transmit buffer */
-            data = (int16_t *)xRingbufferReceiveUpTo(rb_handle, &item_size, (TickType_t)pdMS_TO_TICKS(20), item_size_upto);
-            if (item_size > 0) {
-                fft_process(data, fft_buff);
-                vRingbufferReturnItem(rb_handle, (void *)data);
+        /* Woken by the producer only once a full hop is buffered, a timeout with a hop waiting is drained as well */
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDLE_REDRAW_MS)) == 0
+                && sample_ring_available(ring) < STFT_HOP_SAMPLES) {
+            display_draw(NULL);
+            continue;
+        }
+
+        /* More than a frame behind: the oldest audio would never be shown anyway */
+        size_t available = sample_ring_available(ring);
+        if (available >= 2 * FRAME_SAMPLES) {
+            sample_ring_skip(ring, available - available % STFT_HOP_SAMPLES - FRAME_SAMPLES);
+        }
+        while (sample_ring_available(ring) >= STFT_HOP_SAMPLES && sample_ring_read(ring, hop_buff, STFT_HOP_SAMPLES)) {
+            /* A frame due while the panel is still busy with the previous one is skipped */
+            if (stft_push(stft, hop_buff, display_is_ready(), fft_buff)) {
                 display_draw(fft_buff);
-                display_wtd = 0;
-            }
-        } else {
-            if (display_wtd > 40) {
-                display_draw(NULL);
-                display_wtd = 0;
             }
-            vTaskDelay((TickType_t)pdMS_TO_TICKS(1));
-            display_wtd++;
         }
+
+        sample_ring_get_stats(ring, &stats);
+        stft_get_stats(stft, &stft_stats);
+        ESP_LOGD(TAG, "ring: written %" PRIu32 ", read %" PRIu32 ", overrun %" PRIu32 ", underrun %" PRIu32
+                 ", stft: analysed %" PRIu32 ", output %" PRIu32 ", skipped %" PRIu32,
+                 stats.written, stats.read, stats.overrun, stats.underrun,
+                 stft_stats.analysed, stft_stats.output, stft_stats.skipped);
     }
 }
 
 esp_err_t fft_convert_init(void)
 {
-    rb_init();
+    ESP_ERROR_CHECK(rb_init());
     fft_init();
-    xTaskCreate(fft_convert_task, "fft_convert_task", 1024 * 8, NULL, 1, NULL);
+    xTaskCreate(fft_convert_task, "fft_convert_task", 1024 * 8, NULL, 1, &fft_task_handle);
     return ESP_OK;
 }
@@ -0,0 +1,195 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "latency_trace.h"
+
+/**
+ * Log-linear histogram: values below 16 us get a bucket each, above that
+ * every octave is split in 8 buckets, so any percentile is within 12.5 %.
+ */
+#define HIST_LINEAR         (16)
+#define HIST_SUB_BITS       (3)
+#define HIST_SUB            (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS        (HIST_LINEAR + (32 - 4) * HIST_SUB)
+
+typedef struct {
+    uint32_t buckets[HIST_BUCKETS];
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+} latency_hist_t;
+
+static const char *const stage_names[LATENCY_STAGE_MAX] = {
+    [LATENCY_STAGE_USB_OUT_INTERVAL] = "usb_out_interval",
+    [LATENCY_STAGE_I2S_WRITE] = "i2s_write",
+    [LATENCY_STAGE_SPK_USB_TO_I2S] = "spk_usb_to_i2s",
+    [LATENCY_STAGE_I2S_READ] = "i2s_read",
+    [LATENCY_STAGE_USB_IN_INTERVAL] = "usb_in_interval",
+    [LATENCY_STAGE_MIC_I2S_TO_USB] = "mic_i2s_to_usb",
+};
+
+static latency_clock_t s_clock;
+static latency_hist_t s_hist[LATENCY_STAGE_MAX];
+static latency_event_t s_events[LATENCY_TRACE_EVENTS];
+static _Atomic uint32_t s_event_index;
+
+static inline int hist_bucket(uint32_t v)
+{
+    if (v < HIST_LINEAR) {
+        return v;
+    }
+    const int msb = 31 - __builtin_clz(v);
+    const int sub = (v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return HIST_LINEAR + (msb - 4) * HIST_SUB + sub;
+}
+
+/* Largest value that falls in bucket `b` */
+static inline uint32_t hist_bucket_upper(int b)
+{
+    if (b < HIST_LINEAR) {
+        return b;
+    }
+    const int msb = 4 + (b - HIST_LINEAR) / HIST_SUB;
+    const uint32_t sub = (b - HIST_LINEAR) % HIST_SUB;
+    const uint32_t width = 1UL << (msb - HIST_SUB_BITS);
+    return ((HIST_SUB + sub) << (msb - HIST_SUB_BITS)) + (width - 1);
+}
+
+void latency_trace_reset(void)
+{
+    memset(s_hist, 0, sizeof(s_hist));
+    memset(s_events, 0, sizeof(s_events));
+    atomic_store(&s_event_index, 0);
+}
+
+void latency_trace_init(latency_clock_t clock)
+{
+    s_clock = clock;
+    latency_trace_reset();
+}
+
+uint64_t latency_trace_now(void)
+{
+    return s_clock ? s_clock() : 0;
+}
+
+void latency_trace_record(latency_stage_t stage, uint32_t latency_us)
+{
+    latency_hist_t *hist = &s_hist[stage];
+
+    hist->buckets[hist_bucket(latency_us)]++;
+    if (hist->count == 0 || latency_us < hist->min) {
+        hist->min = latency_us;
+    }
+    if (latency_us > hist->max) {
+        hist->max = latency_us;
+    }
+    hist->count++;
+
+    const uint32_t index = atomic_fetch_add(&s_event_index, 1) % LATENCY_TRACE_EVENTS;
+    s_events[index].timestamp_us = latency_trace_now();
+    s_events[index].latency_us = latency_us;
+    s_events[index].stage = stage;
+}
+
+void latency_trace_record_since(latency_stage_t stage, uint64_t start_us)
+{
+    const uint64_t elapsed = latency_trace_now() - start_us;
+    latency_trace_record(stage, elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed);
+}
+
+void latency_tag_push(latency_tag_queue_t *queue, uint32_t position)
+{
+    const uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head - tail >= LATENCY_TAG_QUEUE_LEN) {
+        /* The consumer stalled, this block is simply not measured */
+        return;
+    }
+    queue->tags[head % LATENCY_TAG_QUEUE_LEN].position = position;
+    queue->tags[head % LATENCY_TAG_QUEUE_LEN].timestamp_us = latency_trace_now();
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+void latency_tag_consume(latency_tag_queue_t *queue, uint32_t position, latency_stage_t stage)
+{
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    while (tail != head) {
+        const uint32_t tagged = queue->tags[tail % LATENCY_TAG_QUEUE_LEN].position;
+        /* Free-running counters, compare through the signed distance */
+        if ((int32_t)(tagged - position) > 0) {
+            break;
+        }
+        latency_trace_record_since(stage, queue->tags[tail % LATENCY_TAG_QUEUE_LEN].timestamp_us);
+        tail++;
+    }
+    atomic_store_explicit(&queue->tail, tail, memory_order_release);
+}
+
+void latency_trace_get_summary(latency_stage_t stage, latency_summary_t *summary)
+{
+    const latency_hist_t *hist = &s_hist[stage];
+    const uint32_t count = hist->count;
+    /* Ranks of p50, p90 and p99, rounded up so that p99 of 100 samples is the 99th */
+    const uint32_t ranks[3] = {(count * 50 + 99) / 100, (count * 90 + 99) / 100, (count * 99 + 99) / 100};
+    uint32_t values[3] = {0};
+    uint32_t seen = 0;
+    int r = 0;
+
+    memset(summary, 0, sizeof(latency_summary_t));
+    if (count == 0) {
+        return;
+    }
+    for (int b = 0; b < HIST_BUCKETS && r < 3; b++) {
+        seen += hist->buckets[b];
+        while (r < 3 && seen >= ranks[r] && ranks[r] > 0) {
+            const uint32_t upper = hist_bucket_upper(b);
+            values[r++] = upper > hist->max ? hist->max : upper;
+        }
+    }
+
+    summary->count = count;
+    summary->min_us = hist->min;
+    summary->max_us = hist->max;
+    summary->p50_us = values[0];
+    summary->p90_us = values[1];
+    summary->p99_us = values[2];
+}
+
+int latency_trace_get_events(latency_event_t *events, int max_events)
+{
+    const uint32_t end = atomic_load(&s_event_index);
+    uint32_t n = end < LATENCY_TRACE_EVENTS ? end : LATENCY_TRACE_EVENTS;
+    if (n > (uint32_t)max_events) {
+        n = max_events;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        events[i] = s_events[(end - n + i) % LATENCY_TRACE_EVENTS];
+    }
+    return n;
+}
+
+const char *latency_trace_stage_name(latency_stage_t stage)
+{
+    return (stage < LATENCY_STAGE_MAX) ? stage_names[stage] : "unknown";
+}
+
+void latency_trace_dump(void)
+{
+    latency_summary_t summary;
+
+    printf("%-18s %10s %8s %8s %8s %8s %8s\n", "stage (us)", "count", "min", "p50", "p90", "p99", "max");
+    for (int i = 0; i < LATENCY_STAGE_MAX; i++) {
+        latency_trace_get_summary(i, &summary);
+        printf("%-18s %10lu %8lu %8lu %8lu %8lu %8lu\n", stage_names[i], (unsigned long)summary.count,
+               (unsigned long)summary.min_us, (unsigned long)summary.p50_us, (unsigned long)summary.p90_us,
+               (unsigned long)summary.p99_us, (unsigned long)summary.max_us);
+    }
+}
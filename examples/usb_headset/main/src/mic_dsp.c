@@ -0,0 +1,324 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mic_dsp.h"
+
+#define Q15_ONE             (1 << 15)
+#define AGC_GAIN_BITS       (12)
+#define AGC_MIN_GAIN        (1 << (AGC_GAIN_BITS - 2))  /* -12 dB, the limiter handles the rest */
+#define HPF_COEF_BITS       (28)
+#define DC_SHIFT            (8)
+#define GATE_RAMP_MS        (5)
+#define LIMITER_RELEASE_MS  (50)
+#define BUDGET_RECOVER_BLOCKS   (256)   /* Blocks well within budget before a shed stage comes back */
+
+enum {
+    SHED_NONE = 0,
+    SHED_GATE,          /* Noise gate skipped */
+    SHED_GATE_HPF,      /* Noise gate and high-pass skipped */
+};
+
+typedef struct {
+    int32_t b0, b1, b2, a1, a2;     /* Q28 */
+} hpf_coef_t;
+
+typedef struct {
+    int32_t x1, x2, y1, y2;
+    int64_t err;                    /* Rounding error fed back into the next output */
+} hpf_state_t;
+
+struct mic_dsp_t {
+    mic_dsp_config_t config;
+    atomic_bool bypass_request;     /* Written by mic_dsp_set_bypass from any task */
+    bool bypass;                    /* Owned by the processing task */
+    hpf_coef_t hpf;
+    /* Per channel filter state */
+    int32_t dc_acc[MIC_DSP_MAX_CHANNELS];
+    int32_t dc_x1[MIC_DSP_MAX_CHANNELS];
+    hpf_state_t hpf_state[MIC_DSP_MAX_CHANNELS];
+    /* Noise gate */
+    int32_t gate_threshold;
+    int32_t gate_floor;             /* Q15 */
+    int32_t gate_gain;              /* Q15 */
+    int32_t gate_step;              /* Q15 per sample */
+    uint32_t gate_hold_samples;
+    uint32_t gate_hold;
+    /* AGC */
+    int32_t agc_target;             /* Mean absolute level */
+    int32_t agc_max_gain;           /* Q12 */
+    int32_t agc_gain;               /* Q12 */
+    uint32_t agc_attack_samples;
+    uint32_t agc_release_samples;
+    /* Limiter */
+    int32_t limiter_threshold;
+    int32_t limiter_gain;           /* Q15 */
+    int limiter_release_shift;
+    /* Budget */
+    int shed;
+    uint32_t blocks_within_budget;
+    mic_dsp_stats_t stats;
+};
+
+static int32_t dbfs_to_level(float dbfs)
+{
+    return (int32_t)(INT16_MAX * powf(10.0f, dbfs / 20.0f));
+}
+
+static void hpf_design(hpf_coef_t *coef, uint32_t sample_rate, uint16_t cutoff)
+{
+    /* RBJ cookbook high-pass, Q = 1/sqrt(2) */
+    const double w0 = 2 * M_PI * cutoff / sample_rate;
+    const double alpha = sin(w0) / (2 * M_SQRT1_2);
+    const double cw = cos(w0);
+    const double a0 = 1 + alpha;
+    const double scale = (double)(1 << HPF_COEF_BITS) / a0;
+
+    coef->b0 = (int32_t)lround((1 + cw) / 2 * scale);
+    coef->b1 = (int32_t)lround(-(1 + cw) * scale);
+    coef->b2 = coef->b0;
+    coef->a1 = (int32_t)lround(-2 * cw * scale);
+    coef->a2 = (int32_t)lround((1 - alpha) * scale);
+}
+
+static void mic_dsp_reset(struct mic_dsp_t *dsp)
+{
+    memset(dsp->dc_acc, 0, sizeof(dsp->dc_acc));
+    memset(dsp->dc_x1, 0, sizeof(dsp->dc_x1));
+    memset(dsp->hpf_state, 0, sizeof(dsp->hpf_state));
+    dsp->gate_gain = Q15_ONE;
+    dsp->gate_hold = dsp->gate_hold_samples;
+    dsp->limiter_gain = Q15_ONE;
+}
+
+esp_err_t mic_dsp_create(const mic_dsp_config_t *config, mic_dsp_handle_t *ret_handle)
+{
+    if (config == NULL || ret_handle == NULL || config->sample_rate == 0 || config->channels <= 0
+            || config->channels > MIC_DSP_MAX_CHANNELS || config->hpf_cutoff_hz * 4 >= config->sample_rate
+            || (config->cycle_budget && config->get_cycles == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct mic_dsp_t *dsp = calloc(1, sizeof(struct mic_dsp_t));
+    if (dsp == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    dsp->config = *config;
+    const uint32_t samples_per_ms = config->sample_rate / 1000;
+
+    if (config->hpf_cutoff_hz) {
+        hpf_design(&dsp->hpf, config->sample_rate, config->hpf_cutoff_hz);
+    }
+
+    dsp->gate_threshold = dbfs_to_level(config->gate_threshold_dbfs);
+    dsp->gate_floor = (int32_t)(Q15_ONE * powf(10.0f, -config->gate_floor_db / 20.0f));
+    dsp->gate_step = (Q15_ONE - dsp->gate_floor) / (GATE_RAMP_MS * samples_per_ms) + 1;
+    dsp->gate_hold_samples = config->gate_hold_ms * samples_per_ms;
+
+    /* Mean absolute value of a sine is 2 / pi of its peak */
+    dsp->agc_target = (int32_t)(dbfs_to_level(config->agc_target_dbfs) * 0.6366f);
+    dsp->agc_max_gain = (int32_t)((1 << AGC_GAIN_BITS) * powf(10.0f, config->agc_max_gain_db / 20.0f));
+    dsp->agc_gain = 1 << AGC_GAIN_BITS;
+    dsp->agc_attack_samples = config->agc_attack_ms * samples_per_ms + 1;
+    dsp->agc_release_samples = config->agc_release_ms * samples_per_ms + 1;
+
+    dsp->limiter_threshold = dbfs_to_level(config->limiter_dbfs);
+    dsp->limiter_release_shift = (int)log2f((float)(LIMITER_RELEASE_MS * samples_per_ms) + 1);
+
+    mic_dsp_reset(dsp);
+    *ret_handle = dsp;
+    return ESP_OK;
+}
+
+static inline int32_t dc_block(struct mic_dsp_t *dsp, int ch, int32_t x)
+{
+    /* y = x - x[-1] + (1 - 2^-8) y[-1], y kept with 8 fractional bits */
+    dsp->dc_acc[ch] += (x - dsp->dc_x1[ch]) * (1 << DC_SHIFT) - (dsp->dc_acc[ch] >> DC_SHIFT);
+    dsp->dc_x1[ch] = x;
+    return dsp->dc_acc[ch] >> DC_SHIFT;
+}
+
+static inline int32_t hpf_run(const hpf_coef_t *c, hpf_state_t *s, int32_t x)
+{
+    int64_t acc = (int64_t)c->b0 * x + (int64_t)c->b1 * s->x1 + (int64_t)c->b2 * s->x2
+                  - (int64_t)c->a1 * s->y1 - (int64_t)c->a2 * s->y2 + s->err;
+    const int32_t y = (int32_t)(acc >> HPF_COEF_BITS);
+    s->err = acc - (int64_t)y * (1 << HPF_COEF_BITS);
+    s->x2 = s->x1;
+    s->x1 = x;
+    s->y2 = s->y1;
+    s->y1 = y;
+    return y;
+}
+
+/* Gate gain of the next sample, from the frame peak */
+static inline int32_t gate_run(struct mic_dsp_t *dsp, int32_t peak)
+{
+    if (peak >= dsp->gate_threshold) {
+        dsp->gate_hold = dsp->gate_hold_samples;
+    } else if (dsp->gate_hold > 0) {
+        dsp->gate_hold--;
+    }
+    if (dsp->gate_hold > 0) {
+        dsp->gate_gain = dsp->gate_gain + dsp->gate_step > Q15_ONE ? Q15_ONE : dsp->gate_gain + dsp->gate_step;
+    } else {
+        dsp->gate_gain = dsp->gate_gain - dsp->gate_step < dsp->gate_floor ? dsp->gate_floor : dsp->gate_gain - dsp->gate_step;
+    }
+    return dsp->gate_gain;
+}
+
+/* Block AGC: move the gain towards target / level by frames / time constant */
+static int32_t agc_update(struct mic_dsp_t *dsp, int64_t abs_sum, size_t samples, size_t frames)
+{
+    const int32_t level = (int32_t)(abs_sum / samples);
+    int32_t desired = dsp->agc_max_gain;
+    if (level > 0 && ((int64_t)dsp->agc_target << AGC_GAIN_BITS) / level < desired) {
+        desired = (int32_t)(((int64_t)dsp->agc_target << AGC_GAIN_BITS) / level);
+    }
+    if (desired < AGC_MIN_GAIN) {
+        desired = AGC_MIN_GAIN;
+    }
+    if (desired > dsp->agc_gain && dsp->config.noise_gate && dsp->shed < SHED_GATE && dsp->gate_hold == 0) {
+        /* Do not pull the noise floor up while the gate is closed */
+        return dsp->agc_gain;
+    }
+
+    const uint32_t tau = desired < dsp->agc_gain ? dsp->agc_attack_samples : dsp->agc_release_samples;
+    if (frames >= tau) {
+        return desired;
+    }
+    return dsp->agc_gain + (int32_t)((int64_t)(desired - dsp->agc_gain) * (int64_t)frames / tau);
+}
+
+static inline int16_t saturate16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+static void mic_dsp_run(struct mic_dsp_t *dsp, int16_t *samples, size_t frames)
+{
+    const mic_dsp_config_t *cfg = &dsp->config;
+    const int channels = cfg->channels;
+    const bool use_hpf = cfg->hpf_cutoff_hz && dsp->shed < SHED_GATE_HPF;
+    const bool use_gate = cfg->noise_gate && dsp->shed < SHED_GATE;
+    int64_t abs_sum = 0;
+
+    /* Pass 1: filters, in place, and the level the AGC reacts to */
+    for (size_t i = 0; i < frames * channels; i++) {
+        int32_t v = samples[i];
+        const int ch = i % channels;
+        if (cfg->dc_remove) {
+            v = dc_block(dsp, ch, v);
+        }
+        if (use_hpf) {
+            v = hpf_run(&dsp->hpf, &dsp->hpf_state[ch], v);
+        }
+        samples[i] = saturate16(v);
+        abs_sum += v < 0 ? -v : v;
+    }
+
+    /* Pass 2: shared gain, interpolated over the block to avoid zipper noise */
+    const int32_t gain_to = cfg->agc ? agc_update(dsp, abs_sum, frames * channels, frames) : dsp->agc_gain;
+    const int64_t gain_step = ((int64_t)(gain_to - dsp->agc_gain) * (1 << 16)) / (int64_t)frames;
+    int64_t agc_acc = (int64_t)dsp->agc_gain * (1 << 16);        /* Q12 gain with 16 more fractional bits */
+    for (size_t f = 0; f < frames; f++) {
+        int16_t *frame = samples + f * channels;
+        agc_acc += gain_step;
+        const int32_t agc_gain = (int32_t)(agc_acc >> 16);
+        int32_t peak = 0;
+        for (int ch = 0; ch < channels; ch++) {
+            const int32_t a = frame[ch] < 0 ? -frame[ch] : frame[ch];
+            peak = a > peak ? a : peak;
+        }
+        int32_t gain = agc_gain << (15 - AGC_GAIN_BITS);               /* Q15 */
+        if (use_gate) {
+            gain = (int32_t)(((int64_t)gain * gate_run(dsp, peak)) >> 15);
+        }
+
+        /* Limiter: instant attack on the frame peak, exponential release */
+        int32_t out_peak = (int32_t)(((int64_t)peak * gain) >> 15);
+        int32_t limited = (int32_t)(((int64_t)gain * dsp->limiter_gain) >> 15);
+        if ((((int64_t)out_peak * dsp->limiter_gain) >> 15) > dsp->limiter_threshold) {
+            dsp->limiter_gain = (int32_t)(((int64_t)dsp->limiter_threshold << 15) / out_peak);
+            limited = (int32_t)(((int64_t)gain * dsp->limiter_gain) >> 15);
+        }
+        dsp->limiter_gain += (Q15_ONE - dsp->limiter_gain) >> dsp->limiter_release_shift;
+
+        for (int ch = 0; ch < channels; ch++) {
+            frame[ch] = saturate16((int32_t)(((int64_t)frame[ch] * limited) >> 15));
+        }
+    }
+    dsp->agc_gain = gain_to;
+}
+
+static void mic_dsp_check_budget(struct mic_dsp_t *dsp, uint32_t cycles)
+{
+    const uint32_t budget = dsp->config.cycle_budget;
+
+    if (cycles > budget) {
+        dsp->stats.over_budget++;
+        dsp->blocks_within_budget = 0;
+        if (dsp->shed < SHED_GATE_HPF) {
+            dsp->shed++;
+        }
+    } else if (dsp->shed > SHED_NONE && cycles < budget / 4 * 3 && ++dsp->blocks_within_budget >= BUDGET_RECOVER_BLOCKS) {
+        dsp->blocks_within_budget = 0;
+        dsp->shed--;
+    }
+}
+
+void mic_dsp_process(mic_dsp_handle_t handle, int16_t *samples, size_t frames)
+{
+    if (frames == 0) {
+        return;
+    }
+    handle->stats.blocks++;
+    /* A bypass change only lands between blocks, in the task that owns the state */
+    const bool bypass = atomic_load_explicit(&handle->bypass_request, memory_order_relaxed);
+    if (bypass != handle->bypass) {
+        if (!bypass) {
+            mic_dsp_reset(handle);
+        }
+        handle->bypass = bypass;
+    }
+    if (bypass) {
+        return;
+    }
+
+    const uint32_t start = handle->config.get_cycles ? handle->config.get_cycles() : 0;
+    mic_dsp_run(handle, samples, frames);
+    if (handle->config.get_cycles) {
+        const uint32_t cycles = handle->config.get_cycles() - start;
+        handle->stats.cycles_last = cycles;
+        if (cycles > handle->stats.cycles_max) {
+            handle->stats.cycles_max = cycles;
+        }
+        if (handle->config.cycle_budget) {
+            mic_dsp_check_budget(handle, cycles);
+        }
+    }
+}
+
+void mic_dsp_set_bypass(mic_dsp_handle_t handle, bool bypass)
+{
+    atomic_store_explicit(&handle->bypass_request, bypass, memory_order_relaxed);
+}
+
+void mic_dsp_get_stats(mic_dsp_handle_t handle, mic_dsp_stats_t *stats)
+{
+    *stats = handle->stats;
+    stats->shed_stages = handle->shed;
+    stats->agc_gain_db = 20.0f * log10f((float)handle->agc_gain / (1 << AGC_GAIN_BITS));
+    stats->gate_open = !handle->config.noise_gate || handle->gate_hold > 0;
+}
+
+void mic_dsp_delete(mic_dsp_handle_t handle)
+{
+    free(handle);
+}
@@ -0,0 +1,148 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sample_ring.h"
+
+/**
+ * head and tail are free-running sample counters: the producer only stores
+ * head, the consumer only stores tail, and head - tail is the fill level.
+ *
+ * The frame_ready edge is decided on a tail loaded after head is published.
+ * Both sides store their counter and load the other one sequentially
+ * consistent, so a consumer that found less than a frame and went to sleep
+ * has its tail seen by the write that completes the next frame.
+ */
+struct sample_ring_t {
+    int16_t *buf;
+    uint32_t capacity;
+    uint32_t mask;
+    uint32_t frame_size;
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t overrun;
+    _Atomic uint32_t underrun;
+};
+
+esp_err_t sample_ring_create(size_t capacity, size_t frame_size, sample_ring_handle_t *ret_ring)
+{
+    if (ret_ring == NULL || capacity == 0 || (capacity & (capacity - 1)) || frame_size == 0 || frame_size > capacity) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct sample_ring_t *ring = calloc(1, sizeof(struct sample_ring_t));
+    if (ring == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ring->buf = calloc(capacity, sizeof(int16_t));
+    if (ring->buf == NULL) {
+        free(ring);
+        return ESP_ERR_NO_MEM;
+    }
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+    ring->frame_size = frame_size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->overrun, 0);
+    atomic_init(&ring->underrun, 0);
+
+    *ret_ring = ring;
+    return ESP_OK;
+}
+
+/* Copy between the linear buffer and the ring, handling the wrap at most once */
+static void ring_copy_in(struct sample_ring_t *ring, uint32_t pos, const int16_t *src, uint32_t count)
+{
+    const uint32_t offset = pos & ring->mask;
+    const uint32_t first = (count < ring->capacity - offset) ? count : ring->capacity - offset;
+    memcpy(&ring->buf[offset], src, first * sizeof(int16_t));
+    memcpy(ring->buf, src + first, (count - first) * sizeof(int16_t));
+}
+
+static void ring_copy_out(const struct sample_ring_t *ring, uint32_t pos, int16_t *dst, uint32_t count)
+{
+    const uint32_t offset = pos & ring->mask;
+    const uint32_t first = (count < ring->capacity - offset) ? count : ring->capacity - offset;
+    memcpy(dst, &ring->buf[offset], first * sizeof(int16_t));
+    memcpy(dst + first, ring->buf, (count - first) * sizeof(int16_t));
+}
+
+size_t sample_ring_write(sample_ring_handle_t ring, const int16_t *samples, size_t count, bool *frame_ready)
+{
+    const uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    const uint32_t space = ring->capacity - (head - tail);
+    const uint32_t n = (count < space) ? count : space;
+
+    if (n < count) {
+        atomic_fetch_add_explicit(&ring->overrun, count - n, memory_order_relaxed);
+    }
+    if (n) {
+        ring_copy_in(ring, head, samples, n);
+        atomic_store_explicit(&ring->head, head + n, memory_order_seq_cst);
+    }
+    if (frame_ready) {
+        /* The tail loaded above may predate a read that took the ring below a frame */
+        const uint32_t now_tail = atomic_load_explicit(&ring->tail, memory_order_seq_cst);
+        *frame_ready = (head - now_tail < ring->frame_size) && (head + n - now_tail >= ring->frame_size);
+    }
+    return n;
+}
+
+bool sample_ring_read(sample_ring_handle_t ring, int16_t *out, size_t count)
+{
+    const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_seq_cst);
+
+    if (head - tail < count) {
+        /* The producer may have published between the caller's check and our load, look again before counting */
+        head = atomic_load_explicit(&ring->head, memory_order_seq_cst);
+        if (head - tail < count) {
+            atomic_fetch_add_explicit(&ring->underrun, 1, memory_order_relaxed);
+            return false;
+        }
+    }
+    ring_copy_out(ring, tail, out, count);
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_seq_cst);
+    return true;
+}
+
+size_t sample_ring_skip(sample_ring_handle_t ring, size_t count)
+{
+    const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&ring->head, memory_order_seq_cst);
+    const uint32_t n = (count < head - tail) ? count : head - tail;
+
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_seq_cst);
+    return n;
+}
+
+size_t sample_ring_available(sample_ring_handle_t ring)
+{
+    const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&ring->head, memory_order_seq_cst);
+    return head - tail;
+}
+
+void sample_ring_get_stats(sample_ring_handle_t ring, sample_ring_stats_t *stats)
+{
+    stats->written = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    stats->read = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    stats->overrun = atomic_load_explicit(&ring->overrun, memory_order_relaxed);
+    stats->underrun = atomic_load_explicit(&ring->underrun, memory_order_relaxed);
+}
+
+void sample_ring_delete(sample_ring_handle_t ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+    free(ring->buf);
+    free(ring);
+}
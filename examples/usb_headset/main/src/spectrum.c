@@ -0,0 +1,234 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "spectrum.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_dsp.h"
+#include "esp_heap_caps.h"
+#define SPECTRUM_USE_ESP_DSP    (1)
+#define spectrum_alloc(size)    heap_caps_aligned_calloc(16, 1, size, MALLOC_CAP_DEFAULT)
+#define spectrum_free(ptr)      heap_caps_free(ptr)
+#else
+#define SPECTRUM_USE_ESP_DSP    (0)
+#define spectrum_alloc(size)    calloc(1, size)
+#define spectrum_free(ptr)      free(ptr)
+#endif
+
+#define SPECTRUM_POWER_FLOOR    (1e-13f)
+#define SPECTRUM_DB_PER_LOG2    (3.01029996f)   /* 10 * log10(2) */
+
+static const char *TAG = "spectrum";
+
+struct spectrum_engine_t {
+    int fft_size;               /* real input samples (N) */
+    int half_size;              /* complex points of the inner transform (N / 2) */
+    float *window;              /* N coefficients, normalisation folded in */
+    float *twiddle;             /* N / 2 complex exp(-2*pi*j*k/N) */
+    float *work;                /* N floats, N / 2 interleaved complex points */
+};
+
+static float spectrum_window_coef(spectrum_window_t window, int i, int n)
+{
+    const float phase = 2.0f * (float)M_PI * i / n;
+    switch (window) {
+    case SPECTRUM_WINDOW_HANN:
+        return 0.5f - 0.5f * cosf(phase);
+    case SPECTRUM_WINDOW_BLACKMAN_HARRIS:
+        return 0.35875f - 0.48829f * cosf(phase) + 0.14128f * cosf(2 * phase) - 0.01168f * cosf(3 * phase);
+    case SPECTRUM_WINDOW_RECT:
+    default:
+        return 1.0f;
+    }
+}
+
+#if !SPECTRUM_USE_ESP_DSP
+/* Portable in-place radix-2 complex transform, same ordering as fft2r + bit_rev */
+static void spectrum_fft_scalar(const struct spectrum_engine_t *engine, float *data)
+{
+    const int m = engine->half_size;
+
+    for (int i = 1, j = 0; i < m; i++) {
+        int bit = m >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            float re = data[2 * i];
+            float im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    for (int len = 2; len <= m; len <<= 1) {
+        const int half = len >> 1;
+        /* exp(-2*pi*j*k/len) == twiddle[k * 2 * m / len] */
+        const int step = 2 * m / len;
+        for (int i = 0; i < m; i += len) {
+            for (int k = 0; k < half; k++) {
+                const float wr = engine->twiddle[2 * k * step];
+                const float wi = engine->twiddle[2 * k * step + 1];
+                float *a = &data[2 * (i + k)];
+                float *b = &data[2 * (i + k + half)];
+                const float vr = b[0] * wr - b[1] * wi;
+                const float vi = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - vr;
+                b[1] = a[1] - vi;
+                a[0] += vr;
+                a[1] += vi;
+            }
+        }
+    }
+}
+#endif
+
+static inline int16_t spectrum_power_to_db(float power)
+{
+    uint32_t bits;
+
+    if (!(power > SPECTRUM_POWER_FLOOR)) {
+        power = SPECTRUM_POWER_FLOOR;
+    }
+    memcpy(&bits, &power, sizeof(bits));
+
+    /* power = 2^e * x, x in [1, 2); log2(x) by a 2nd order polynomial (|err| < 5e-3) */
+    const int e = (int)((bits >> 23) & 0xFF) - 127;
+    bits = (bits & 0x007FFFFF) | 0x3F800000;
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    const float log2_power = e + (-0.34484843f * x + 2.02466578f) * x - 1.67487759f;
+
+    int32_t db = lrintf((log2_power * SPECTRUM_DB_PER_LOG2 + SPECTRUM_DB_OFFSET) * (1 << SPECTRUM_DB_FRAC_BITS));
+    if (db < 0) {
+        db = 0;
+    } else if (db > INT16_MAX) {
+        db = INT16_MAX;
+    }
+    return (int16_t)db;
+}
+
+esp_err_t spectrum_create(const spectrum_config_t *config, spectrum_handle_t *ret_handle)
+{
+    if (config == NULL || ret_handle == NULL || config->fft_size < 4 || (config->fft_size & (config->fft_size - 1))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct spectrum_engine_t *engine = calloc(1, sizeof(struct spectrum_engine_t));
+    if (engine == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    const int n = config->fft_size;
+    engine->fft_size = n;
+    engine->half_size = n / 2;
+    engine->window = spectrum_alloc(n * sizeof(float));
+    engine->twiddle = spectrum_alloc(n * sizeof(float));
+    engine->work = spectrum_alloc(n * sizeof(float));
+    if (engine->window == NULL || engine->twiddle == NULL || engine->work == NULL) {
+        spectrum_delete(engine);
+        return ESP_ERR_NO_MEM;
+    }
+
+#if SPECTRUM_USE_ESP_DSP
+    esp_err_t ret = dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+    if (ret != ESP_OK || engine->half_size > CONFIG_DSP_MAX_FFT_SIZE) {
+        ESP_LOGE(TAG, "Not possible to initialize FFT. Error = %i", ret);
+        spectrum_delete(engine);
+        return ESP_ERR_INVALID_ARG;
+    }
+#endif
+
+    /**
+     * Normalise so that a full scale sine reads the same level as the former
+     * complex sc16 path: divide by N, the window coherent gain and INT16_MAX.
+     */
+    float gain = 0;
+    for (int i = 0; i < n; i++) {
+        engine->window[i] = spectrum_window_coef(config->window, i, n);
+        gain += engine->window[i];
+    }
+    const float scale = 1.0f / (gain * INT16_MAX);
+    for (int i = 0; i < n; i++) {
+        engine->window[i] *= scale;
+    }
+
+    for (int k = 0; k < engine->half_size; k++) {
+        engine->twiddle[2 * k] = cosf(2.0f * (float)M_PI * k / n);
+        engine->twiddle[2 * k + 1] = -sinf(2.0f * (float)M_PI * k / n);
+    }
+
+    ESP_LOGD(TAG, "created: %d points, window %d", n, config->window);
+    *ret_handle = engine;
+    return ESP_OK;
+}
+
+esp_err_t spectrum_process(spectrum_handle_t handle, const int16_t *samples, int16_t *out_db)
+{
+    if (handle == NULL || samples == NULL || out_db == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const int n = handle->fft_size;
+    const int m = handle->half_size;
+    float *z = handle->work;
+
+    /* Pack the real frame as N/2 complex points: z[k] = x[2k] + j * x[2k + 1] */
+    for (int i = 0; i < n; i++) {
+        z[i] = samples[i] * handle->window[i];
+    }
+
+#if SPECTRUM_USE_ESP_DSP
+    dsps_fft2r_fc32(z, m);
+    dsps_bit_rev_fc32(z, m);
+#else
+    spectrum_fft_scalar(handle, z);
+#endif
+
+    /**
+     * Split the half-size transform into the real spectrum:
+     * X[k] = (Z[k] + Z*[m-k]) / 2 - j * W^k * (Z[k] - Z*[m-k]) / 2
+     */
+    for (int k = 0; k < m; k++) {
+        const int c = (m - k) & (m - 1);
+        const float zr = z[2 * k], zi = z[2 * k + 1];
+        const float cr = z[2 * c], ci = -z[2 * c + 1];
+        const float er = 0.5f * (zr + cr);
+        const float ei = 0.5f * (zi + ci);
+        const float or_ = 0.5f * (zi - ci);
+        const float oi = -0.5f * (zr - cr);
+        const float wr = handle->twiddle[2 * k];
+        const float wi = handle->twiddle[2 * k + 1];
+        const float xr = er + or_ * wr - oi * wi;
+        const float xi = ei + or_ * wi + oi * wr;
+        out_db[k] = spectrum_power_to_db(xr * xr + xi * xi);
+    }
+
+    return ESP_OK;
+}
+
+int spectrum_get_bins(spectrum_handle_t handle)
+{
+    return handle ? handle->half_size : 0;
+}
+
+void spectrum_delete(spectrum_handle_t handle)
+{
+    if (handle == NULL) {
+        return;
+    }
+    spectrum_free(handle->window);
+    spectrum_free(handle->twiddle);
+    spectrum_free(handle->work);
+    free(handle);
+}
@@ -0,0 +1,149 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "stft.h"
+
+struct stft_t {
+    stft_config_t config;
+    spectrum_handle_t spectrum;
+    int bins;
+    int16_t *history;           /* Last frame_size samples, oldest first */
+    int16_t *spectrum_db;       /* Latest transform */
+    int16_t *avg_db;            /* Averaged spectrum */
+    bool avg_valid;
+    uint32_t samples_per_output;
+    uint32_t samples_since_output;
+    stft_stats_t stats;
+};
+
+esp_err_t stft_create(const stft_config_t *config, stft_handle_t *ret_handle)
+{
+    if (config == NULL || ret_handle == NULL || config->hop_size <= 0 || config->hop_size > config->frame_size
+            || config->sample_rate == 0 || config->output_rate == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct stft_t *stft = calloc(1, sizeof(struct stft_t));
+    if (stft == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    stft->config = *config;
+
+    const spectrum_config_t spectrum_config = {
+        .fft_size = config->frame_size,
+        .window = config->window,
+    };
+    esp_err_t ret = spectrum_create(&spectrum_config, &stft->spectrum);
+    if (ret != ESP_OK) {
+        free(stft);
+        return ret;
+    }
+    stft->bins = spectrum_get_bins(stft->spectrum);
+    stft->history = calloc(config->frame_size, sizeof(int16_t));
+    stft->spectrum_db = calloc(stft->bins, sizeof(int16_t));
+    stft->avg_db = calloc(stft->bins, sizeof(int16_t));
+    if (stft->history == NULL || stft->spectrum_db == NULL || stft->avg_db == NULL) {
+        stft_delete(stft);
+        return ESP_ERR_NO_MEM;
+    }
+
+    stft->samples_per_output = config->sample_rate / config->output_rate;
+    if (stft->samples_per_output == 0) {
+        stft->samples_per_output = 1;
+    }
+
+    *ret_handle = stft;
+    return ESP_OK;
+}
+
+static void stft_analyse(struct stft_t *stft, int16_t *out_db)
+{
+    spectrum_process(stft->spectrum, stft->history, out_db);
+    stft->stats.analysed++;
+}
+
+static void stft_average(struct stft_t *stft)
+{
+    const int16_t *cur = stft->spectrum_db;
+    int16_t *avg = stft->avg_db;
+
+    if (!stft->avg_valid) {
+        memcpy(avg, cur, stft->bins * sizeof(int16_t));
+        stft->avg_valid = true;
+        return;
+    }
+
+    if (stft->config.avg_mode == STFT_AVG_EXPONENTIAL) {
+        const int32_t alpha = stft->config.avg_alpha;
+        for (int i = 0; i < stft->bins; i++) {
+            avg[i] += (int16_t)(((int32_t)(cur[i] - avg[i]) * alpha) >> 15);
+        }
+    } else {
+        const int16_t decay = stft->config.peak_decay;
+        for (int i = 0; i < stft->bins; i++) {
+            int32_t held = avg[i] - decay;
+            if (held < 0) {
+                held = 0;
+            }
+            avg[i] = (cur[i] > held) ? cur[i] : (int16_t)held;
+        }
+    }
+}
+
+bool stft_push(stft_handle_t handle, const int16_t *samples, bool sink_ready, int16_t *out_db)
+{
+    const int frame = handle->config.frame_size;
+    const int hop = handle->config.hop_size;
+
+    memmove(handle->history, handle->history + hop, (frame - hop) * sizeof(int16_t));
+    memcpy(handle->history + frame - hop, samples, hop * sizeof(int16_t));
+    handle->stats.hops++;
+    handle->samples_since_output += hop;
+
+    /* Averaging needs every hop, otherwise only the frame that gets displayed is transformed */
+    if (handle->config.avg_mode != STFT_AVG_NONE) {
+        stft_analyse(handle, handle->spectrum_db);
+        stft_average(handle);
+    }
+
+    if (handle->samples_since_output < handle->samples_per_output) {
+        return false;
+    }
+    /* Never try to catch up with a burst of frames, just keep the cadence */
+    handle->samples_since_output %= handle->samples_per_output;
+
+    if (!sink_ready) {
+        handle->stats.skipped++;
+        return false;
+    }
+
+    if (handle->config.avg_mode == STFT_AVG_NONE) {
+        stft_analyse(handle, out_db);
+    } else {
+        memcpy(out_db, handle->avg_db, handle->bins * sizeof(int16_t));
+    }
+    handle->stats.output++;
+    return true;
+}
+
+void stft_get_stats(stft_handle_t handle, stft_stats_t *stats)
+{
+    *stats = handle->stats;
+}
+
+void stft_delete(stft_handle_t handle)
+{
+    if (handle == NULL) {
+        return;
+    }
+    spectrum_delete(handle->spectrum);
+    free(handle->history);
+    free(handle->spectrum_db);
+    free(handle->avg_db);
+    free(handle);
+}
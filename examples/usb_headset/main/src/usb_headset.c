@@ -6,10 +6,20 @@
 
 #include <inttypes.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "audio_convert.h"
+#include "esp_console.h"
+#include "esp_cpu.h"
 #include "esp_log.h"
 #include "bsp/esp-bsp.h"
 #include "bsp_board.h"
+#include "drift_comp.h"
 #include "fft_convert.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mic_dsp.h"
+#include "sample_ring.h"
 #include "usb_headset.h"
 #include "usb_device_uac.h"
 
@@ -18,30 +28,494 @@
 
 const static char *TAG = "usb_headset";
 
-static esp_err_t uac_device_output_cb(uint8_t *buf, size_t len, void *arg)
+/**
+ * The USB host (SOF) clock and the codec (I2S) clock are never exactly equal.
+ * Each direction goes through a FIFO whose fill level steers a fractional
+ * resampler, so the FIFO neither drains nor overflows over long sessions.
+ */
+#define CHUNK_FRAMES            (DEFAULT_CODEC_SAMPLE_RATE / 1000)  /* 1 ms of audio */
+#define FIFO_TARGET_FRAMES      (CHUNK_FRAMES * 4)                  /* Latency each FIFO adds */
+#define FIFO_SAMPLES            (2048 * 2)                          /* Power of two, > 4 targets of stereo */
+#define RESAMPLE_CAPACITY       (CHUNK_FRAMES + CHUNK_FRAMES / 8)   /* Output frames per chunk, with margin */
+#define DRIFT_LOG_INTERVAL_MS   (10 * 1000)
+/* USB packets are converted to and from the codec format in pieces of at most 1 ms at 48 kHz */
+#define CONVERT_PIECE_FRAMES    (48)
+#define CONVERT_SCRATCH_FRAMES  ((CONVERT_PIECE_FRAMES + 1) * AUDIO_CONVERT_MAX_RATIO + 1)
+/* The capture chain may use a quarter of the CPU time of each 1 ms block */
+#define MIC_DSP_CYCLE_BUDGET    (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000 / 4)
+
+typedef struct {
+    const char *name;
+    int channels;               /* Codec channels, the FIFO holds codec format frames */
+    audio_format_t usb_format;
+    audio_format_t host_format; /* Last format the host selected, only touched from the UAC control callbacks */
+    audio_convert_handle_t convert;             /* Only touched by the UAC stream callback of the path */
+    _Atomic(audio_convert_handle_t) pending;    /* Next converter, taken at the start of a packet */
+    int16_t *scratch;           /* CONVERT_SCRATCH_FRAMES codec frames */
+    sample_ring_handle_t fifo;
+    drift_comp_handle_t drift;
+    TaskHandle_t task;
+    volatile bool primed;       /* FIFO reached its target since the last underrun */
+    atomic_bool reset_pending;  /* The drift state is reset by the task that runs it, before its next block */
+#if DEBUG_LATENCY_TRACE
+    latency_tag_queue_t tags;   /* Arrival time of the blocks in the FIFO */
+#endif
+} audio_path_t;
+
+static audio_path_t spk_path = {
+    .name = "spk",
+    .channels = DEFAULT_CODEC_CHANNEL,
+    .usb_format = {DEFAULT_UAC_SAMPLE_RATE, DEFAULT_PLAYER_WIDTH, DEFAULT_PLAYER_CHANNEL},
+    .host_format = {DEFAULT_UAC_SAMPLE_RATE, DEFAULT_PLAYER_WIDTH, DEFAULT_PLAYER_CHANNEL},
+};
+static audio_path_t mic_path = {
+    .name = "mic",
+    .channels = DEFAULT_CODEC_CHANNEL,
+    .usb_format = {DEFAULT_UAC_SAMPLE_RATE, DEFAULT_RECORDER_WIDTH, DEFAULT_RECORDER_CHANNEL},
+    .host_format = {DEFAULT_UAC_SAMPLE_RATE, DEFAULT_RECORDER_WIDTH, DEFAULT_RECORDER_CHANNEL},
+};
+/* Sampling frequency the host last set on the clock source, both streams run from it */
+static uint32_t s_clock_rate = DEFAULT_UAC_SAMPLE_RATE;
+static mic_dsp_handle_t mic_dsp;
+static const audio_format_t codec_format = {DEFAULT_CODEC_SAMPLE_RATE, DEFAULT_CODEC_WIDTH, DEFAULT_CODEC_CHANNEL};
+
+static size_t audio_path_fill(const audio_path_t *path)
 {
-    size_t bytes_written = 0;
-    esp_err_t ret = bsp_i2s_write(buf, len, &bytes_written, 0);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "i2s write failed");
-        return ESP_FAIL;
+    return sample_ring_available(path->fifo) / path->channels;
+}
+
+/**
+ * Switch to the converter usb_headset_set_stream_format left for this path.
+ * Called by the stream callback between two packets, so no packet is ever
+ * converted by a converter that is being freed.
+ */
+static void audio_path_apply_format(audio_path_t *path)
+{
+    audio_convert_handle_t convert = atomic_exchange(&path->pending, NULL);
+    if (convert == NULL) {
+        return;
+    }
+    audio_convert_handle_t old = path->convert;
+    if (path == &spk_path) {
+        audio_convert_get_formats(convert, &path->usb_format, NULL);
+    } else {
+        audio_convert_get_formats(convert, NULL, &path->usb_format);
+    }
+    path->convert = convert;
+    if (old != NULL) {
+        audio_convert_delete(old);
+    }
+}
+
+/* Queue codec format frames for the speaker */
+static void spk_enqueue(int16_t *samples, size_t frames)
+{
+    bool chunk_ready = false;
+    sample_ring_write(spk_path.fifo, samples, frames * spk_path.channels, &chunk_ready);
+    if (chunk_ready) {
+        xTaskNotifyGive(spk_path.task);
     }
 
 #if !DEBUG_USB_HEADSET
-    rb_write((int16_t *)buf, bytes_written);
+    rb_write(samples, frames * spk_path.channels * sizeof(int16_t));
 #endif
+}
+
+static esp_err_t uac_device_output_cb(uint8_t *buf, size_t len, void *arg)
+{
+    audio_path_apply_format(&spk_path);
+    const size_t frame_bytes = audio_format_frame_bytes(&spk_path.usb_format);
+    size_t frames = len / frame_bytes;
+
+    LATENCY_TRACE_INTERVAL(LATENCY_STAGE_USB_OUT_INTERVAL);
+    if (audio_convert_is_passthrough(spk_path.convert)) {
+        spk_enqueue((int16_t *)buf, frames);
+    } else {
+        while (frames > 0) {
+            const size_t piece = frames < CONVERT_PIECE_FRAMES ? frames : CONVERT_PIECE_FRAMES;
+            size_t n = audio_convert_process(spk_path.convert, buf, piece, spk_path.scratch, CONVERT_SCRATCH_FRAMES);
+            spk_enqueue(spk_path.scratch, n);
+            buf += piece * frame_bytes;
+            frames -= piece;
+        }
+    }
+    LATENCY_TRACE_TAG(&spk_path.tags, spk_path.fifo);
 
     return ESP_OK;
 }
 
+/* Dequeue up to `frames` USB format frames for the host, returns the frames delivered */
+static size_t mic_dequeue(uint8_t *buf, size_t frames)
+{
+    const size_t frame_bytes = audio_format_frame_bytes(&mic_path.usb_format);
+    const bool passthrough = audio_convert_is_passthrough(mic_path.convert);
+    size_t done = 0;
+
+    while (done < frames) {
+        const size_t piece = (frames - done) < CONVERT_PIECE_FRAMES ? (frames - done) : CONVERT_PIECE_FRAMES;
+        const size_t need = audio_convert_in_frames(mic_path.convert, piece);
+        const size_t fill = audio_path_fill(&mic_path);
+        const size_t in = need <= fill ? need : fill;
+        uint8_t *dst = buf + done * frame_bytes;
+        /* Same format: read straight into the USB buffer, the conversion is then a no-op */
+        int16_t *src = passthrough ? (int16_t *)dst : mic_path.scratch;
+
+        sample_ring_read(mic_path.fifo, src, in * mic_path.channels);
+        done += audio_convert_process(mic_path.convert, src, in, dst, piece);
+        if (in < need) {
+            break;
+        }
+    }
+    return done;
+}
+
 static esp_err_t uac_device_input_cb(uint8_t *buf, size_t len, size_t *bytes_read, void *arg)
 {
-    esp_err_t ret = bsp_i2s_read(buf, len, bytes_read, 10);
+    audio_path_apply_format(&mic_path);
+    const size_t frame_bytes = audio_format_frame_bytes(&mic_path.usb_format);
+    const size_t want = len / frame_bytes;
+    size_t n = 0;
+
+    LATENCY_TRACE_INTERVAL(LATENCY_STAGE_USB_IN_INTERVAL);
+    if (mic_path.primed) {
+        n = mic_dequeue(buf, want);
+        LATENCY_TRACE_CONSUME(&mic_path.tags, mic_path.fifo, LATENCY_STAGE_MIC_I2S_TO_USB);
+        if (n < want) {
+            /* Underrun: wait for the FIFO to refill to its target before delivering again */
+            mic_path.primed = false;
+            atomic_store(&mic_path.reset_pending, true);
+            audio_convert_reset(mic_path.convert);
+        }
+    } else if (audio_path_fill(&mic_path) >= FIFO_TARGET_FRAMES) {
+        /* Whatever piled up while the host was not reading is stale, restart at the target latency */
+        sample_ring_skip(mic_path.fifo, (audio_path_fill(&mic_path) - FIFO_TARGET_FRAMES) * mic_path.channels);
+        mic_path.primed = true;
+    }
+    memset(buf + n * frame_bytes, 0, len - n * frame_bytes);
+    *bytes_read = len;
+
+    return ESP_OK;
+}
+
+static void spk_task(void *arg)
+{
+    int16_t *in = malloc(CHUNK_FRAMES * spk_path.channels * sizeof(int16_t));
+    int16_t *out = malloc(RESAMPLE_CAPACITY * spk_path.channels * sizeof(int16_t));
+    assert(in != NULL && out != NULL);
+
+    while (1) {
+        if (!spk_path.primed) {
+            /* Start (or restart after an underrun) with the FIFO at its target level */
+            if (audio_path_fill(&spk_path) < FIFO_TARGET_FRAMES) {
+                SYSVIEW_SPK_WAIT_EVENT_START();
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+                SYSVIEW_SPK_WAIT_EVENT_END();
+                continue;
+            }
+            spk_path.primed = true;
+        }
+        if (!sample_ring_read(spk_path.fifo, in, CHUNK_FRAMES * spk_path.channels)) {
+            spk_path.primed = false;
+            drift_comp_reset(spk_path.drift);
+            continue;
+        }
+
+        drift_comp_update(spk_path.drift, audio_path_fill(&spk_path));
+        size_t frames = drift_comp_process(spk_path.drift, in, CHUNK_FRAMES, out, RESAMPLE_CAPACITY);
+        size_t bytes_written = 0;
+        /* Blocks at the codec clock, which is what paces this loop */
+        SYSVIEW_SPK_SEND_EVENT_START();
+        LATENCY_TRACE_START(write_start);
+        esp_err_t ret = bsp_i2s_write(out, frames * spk_path.channels * sizeof(int16_t), &bytes_written, portMAX_DELAY);
+        LATENCY_TRACE_END(LATENCY_STAGE_I2S_WRITE, write_start);
+        SYSVIEW_SPK_SEND_EVENT_END();
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "i2s write failed");
+        }
+        /* The chunk just written left the FIFO before the write, it is now in the DMA buffers */
+        LATENCY_TRACE_CONSUME(&spk_path.tags, spk_path.fifo, LATENCY_STAGE_SPK_USB_TO_I2S);
+    }
+}
+
+static void mic_task(void *arg)
+{
+    int16_t *in = malloc(CHUNK_FRAMES * mic_path.channels * sizeof(int16_t));
+    int16_t *out = malloc(RESAMPLE_CAPACITY * mic_path.channels * sizeof(int16_t));
+    assert(in != NULL && out != NULL);
+
+    while (1) {
+        size_t bytes_read = 0;
+        SYSVIEW_MIC_READ_EVENT_START();
+        LATENCY_TRACE_START(read_start);
+        esp_err_t ret = bsp_i2s_read(in, CHUNK_FRAMES * mic_path.channels * sizeof(int16_t), &bytes_read, portMAX_DELAY);
+        LATENCY_TRACE_END(LATENCY_STAGE_I2S_READ, read_start);
+        SYSVIEW_MIC_READ_EVENT_END();
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "i2s read failed");
+            vTaskDelay(pdMS_TO_TICKS(1));
+            continue;
+        }
+        if (bytes_read == 0) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+            continue;
+        }
+
+        size_t frames = bytes_read / (mic_path.channels * sizeof(int16_t));
+        mic_dsp_process(mic_dsp, in, frames);
+
+        /* The USB side saw an underrun: drift_comp is only ever touched from here */
+        if (atomic_exchange(&mic_path.reset_pending, false)) {
+            drift_comp_reset(mic_path.drift);
+        }
+        /* Only steer while the host is consuming, an idle FIFO just overflows */
+        size_t fill = audio_path_fill(&mic_path);
+        if (mic_path.primed) {
+            drift_comp_update(mic_path.drift, fill);
+        }
+        frames = drift_comp_process(mic_path.drift, in, frames, out, RESAMPLE_CAPACITY);
+        sample_ring_write(mic_path.fifo, out, frames * mic_path.channels, NULL);
+        LATENCY_TRACE_TAG(&mic_path.tags, mic_path.fifo);
+    }
+}
+
+static void drift_log_task(void *arg)
+{
+    drift_comp_status_t spk, mic;
+    mic_dsp_stats_t dsp;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(DRIFT_LOG_INTERVAL_MS));
+        drift_comp_get_status(spk_path.drift, &spk);
+        drift_comp_get_status(mic_path.drift, &mic);
+        mic_dsp_get_stats(mic_dsp, &dsp);
+        ESP_LOGD(TAG, "spk: drift %.1f ppm, ratio %.6f, fill %.1f | mic: drift %.1f ppm, ratio %.6f, fill %.1f",
+                 spk.drift_ppm, spk.ratio, spk.fill_avg, mic.drift_ppm, mic.ratio, mic.fill_avg);
+        ESP_LOGD(TAG, "mic dsp: gain %.1f dB, gate %s, %" PRIu32 " cycles/block (max %" PRIu32 "), %" PRIu32 " over budget",
+                 dsp.agc_gain_db, dsp.gate_open ? "open" : "closed", dsp.cycles_last, dsp.cycles_max, dsp.over_budget);
+    }
+}
+
+#if DEBUG_LATENCY_TRACE
+#define LATENCY_EVENTS_SHOWN    (32)
+
+static uint64_t latency_clock(void)
+{
+    return esp_timer_get_time();
+}
+
+static int latency_cmd(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        latency_trace_reset();
+    } else if (argc > 1 && strcmp(argv[1], "events") == 0) {
+        static latency_event_t events[LATENCY_EVENTS_SHOWN];
+        int n = latency_trace_get_events(events, LATENCY_EVENTS_SHOWN);
+        for (int i = 0; i < n; i++) {
+            printf("%12" PRIu64 " %-18s %8" PRIu32 "\n", events[i].timestamp_us,
+                   latency_trace_stage_name(events[i].stage), events[i].latency_us);
+        }
+    } else {
+        latency_trace_dump();
+    }
+    return 0;
+}
+#endif
+
+#if DEFAULT_CONSOLE
+static int mic_cmd(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "on") == 0) {
+        usb_headset_set_mic_bypass(false);
+    } else if (argc > 1 && strcmp(argv[1], "off") == 0) {
+        usb_headset_set_mic_bypass(true);
+    } else {
+        mic_dsp_stats_t dsp;
+        mic_dsp_get_stats(mic_dsp, &dsp);
+        printf("gain %.1f dB, gate %s, %" PRIu32 " cycles/block (max %" PRIu32 "), %" PRIu32 " over budget\n",
+               dsp.agc_gain_db, dsp.gate_open ? "open" : "closed", dsp.cycles_last, dsp.cycles_max, dsp.over_budget);
+    }
+    return 0;
+}
+
+static esp_err_t headset_console_init(void)
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    repl_config.prompt = "headset>";
+
+    esp_err_t ret = esp_console_new_repl_uart(&uart_config, &repl_config, &repl);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "i2s read failed");
-        return ESP_FAIL;
+        return ret;
+    }
+    const esp_console_cmd_t mic = {
+        .command = "mic",
+        .help = "Turn the microphone processing chain on or off, or print its state",
+        .hint = "[on|off]",
+        .func = &mic_cmd,
+    };
+    esp_console_cmd_register(&mic);
+#if DEBUG_LATENCY_TRACE
+    const esp_console_cmd_t latency = {
+        .command = "latency",
+        .help = "Print the audio path latency percentiles, the latest trace events, or clear them",
+        .hint = "[events|reset]",
+        .func = &latency_cmd,
+    };
+    esp_console_cmd_register(&latency);
+#endif
+    esp_console_register_help_command();
+    return esp_console_start_repl(repl);
+}
+#endif
+
+esp_err_t usb_headset_set_stream_format(bool speaker, uint32_t sample_rate, uint8_t bits, uint8_t channels)
+{
+    audio_path_t *path = speaker ? &spk_path : &mic_path;
+    const audio_format_t usb_format = {sample_rate, bits, channels};
+    audio_convert_handle_t convert = NULL;
+
+    esp_err_t ret = speaker ? audio_convert_create(&usb_format, &codec_format, &convert)
+                    : audio_convert_create(&codec_format, &usb_format, &convert);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: unsupported format %" PRIu32 " Hz, %d bit, %d ch", path->name, sample_rate, bits, channels);
+        return ret;
+    }
+
+    /* A converter the stream never picked up is not in use, nobody else can free it */
+    audio_convert_handle_t stale = atomic_exchange(&path->pending, convert);
+    if (stale != NULL) {
+        audio_convert_delete(stale);
+    }
+    ESP_LOGI(TAG, "%s: %" PRIu32 " Hz, %d bit, %d ch%s", path->name, sample_rate, bits, channels,
+             audio_convert_is_passthrough(convert) ? "" : ", converted");
+    return ESP_OK;
+}
+
+/**
+ * Format of alternate setting `alt` of streaming interface `itf`, read from
+ * the configuration descriptor: channels from the AS general descriptor,
+ * the sample container from the type I format descriptor, the direction
+ * from the endpoint. UAC2 format descriptors carry no sampling frequency,
+ * the rate is the one the host last set on the clock source.
+ */
+static bool uac_alt_format(uint8_t itf, uint8_t alt, bool *speaker, audio_format_t *format)
+{
+    const uint8_t *desc = tud_descriptor_configuration_cb(0);
+    const uint8_t *end = desc + tu_le16toh(((const tusb_desc_configuration_t *)desc)->wTotalLength);
+    bool in_alt = false;
+    bool have_ep = false;
+
+    format->sample_rate = s_clock_rate;
+    format->bits = 0;
+    format->channels = 0;
+    for (desc = tu_desc_next(desc); desc < end; desc = tu_desc_next(desc)) {
+        if (tu_desc_type(desc) == TUSB_DESC_INTERFACE) {
+            const tusb_desc_interface_t *d = (const tusb_desc_interface_t *)desc;
+            if (in_alt) {
+                break;
+            }
+            in_alt = d->bInterfaceNumber == itf && d->bAlternateSetting == alt;
+        } else if (!in_alt) {
+            continue;
+        } else if (tu_desc_type(desc) == TUSB_DESC_CS_INTERFACE && tu_desc_subtype(desc) == AUDIO_CS_AS_INTERFACE_AS_GENERAL) {
+            format->channels = ((const audio_desc_cs_as_interface_t *)desc)->bNrChannels;
+        } else if (tu_desc_type(desc) == TUSB_DESC_CS_INTERFACE && tu_desc_subtype(desc) == AUDIO_CS_AS_INTERFACE_FORMAT_TYPE) {
+            /* Samples are left-justified in their subslot, e.g. 24-bit resolution in 4 bytes converts as 32 bits */
+            format->bits = ((const audio_desc_type_I_format_t *)desc)->bSubslotSize * 8;
+        } else if (tu_desc_type(desc) == TUSB_DESC_ENDPOINT && !have_ep) {
+            *speaker = tu_edpt_dir(((const tusb_desc_endpoint_t *)desc)->bEndpointAddress) == TUSB_DIR_OUT;
+            have_ep = true;
+        }
+    }
+    return have_ep && format->bits != 0 && format->channels != 0;
+}
+
+/**
+ * The UAC device component implements tud_audio_set_itf_cb itself. It is
+ * wrapped at link time (see CMakeLists.txt) so that the format of the
+ * alternate setting the host selects also switches the stream converter.
+ */
+bool __real_tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const *p_request);
+
+bool __wrap_tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const *p_request)
+{
+    const uint8_t itf = tu_u16_low(tu_le16toh(p_request->wIndex));
+    const uint8_t alt = tu_u16_low(tu_le16toh(p_request->wValue));
+    audio_format_t format;
+    bool speaker = false;
+
+    /* Alternate setting 0 only closes the stream, the format stays */
+    if (alt != 0 && uac_alt_format(itf, alt, &speaker, &format)) {
+        (speaker ? &spk_path : &mic_path)->host_format = format;
+        usb_headset_set_stream_format(speaker, format.sample_rate, format.bits, format.channels);
+    }
+    return __real_tud_audio_set_itf_cb(rhport, p_request);
+}
+
+/* Whether `entity` is a clock source of the audio function */
+static bool uac_is_clock_source(uint8_t entity)
+{
+    const uint8_t *desc = tud_descriptor_configuration_cb(0);
+    const uint8_t *end = desc + tu_le16toh(((const tusb_desc_configuration_t *)desc)->wTotalLength);
+
+    for (desc = tu_desc_next(desc); desc < end; desc = tu_desc_next(desc)) {
+        if (tu_desc_type(desc) == TUSB_DESC_CS_INTERFACE && tu_desc_subtype(desc) == AUDIO_CS_AC_INTERFACE_CLOCK_SOURCE &&
+                ((const audio_desc_clock_source_t *)desc)->bClockID == entity) {
+            return true;
+        }
     }
+    return false;
+}
+
+/**
+ * Wrapped like tud_audio_set_itf_cb: a sampling frequency the host sets on
+ * the clock source switches the converters of both streams to the new rate,
+ * keeping the container and channels of the alternate setting each selected.
+ */
+bool __real_tud_audio_set_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p_request, uint8_t *pBuff);
+
+bool __wrap_tud_audio_set_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p_request, uint8_t *pBuff)
+{
+    const uint8_t entity = tu_u16_high(tu_le16toh(p_request->wIndex));
+    const uint8_t ctrl = tu_u16_high(tu_le16toh(p_request->wValue));
+
+    if (p_request->bRequest == AUDIO_CS_REQ_CUR && ctrl == AUDIO_CS_CTRL_SAM_FREQ && uac_is_clock_source(entity)) {
+        const uint32_t rate = tu_le32toh(((const audio_control_cur_4_t *)pBuff)->bCur);
+        if (rate != s_clock_rate) {
+            s_clock_rate = rate;
+            spk_path.host_format.sample_rate = rate;
+            mic_path.host_format.sample_rate = rate;
+            usb_headset_set_stream_format(true, rate, spk_path.host_format.bits, spk_path.host_format.channels);
+            usb_headset_set_stream_format(false, rate, mic_path.host_format.bits, mic_path.host_format.channels);
+        }
+    }
+    return __real_tud_audio_set_req_entity_cb(rhport, p_request, pBuff);
+}
 
+static esp_err_t audio_path_init(audio_path_t *path, TaskFunction_t task)
+{
+    const drift_comp_config_t drift_config = DRIFT_COMP_DEFAULT_CONFIG(path->channels, FIFO_TARGET_FRAMES);
+    esp_err_t ret = sample_ring_create(FIFO_SAMPLES, CHUNK_FRAMES * path->channels, &path->fifo);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    path->scratch = malloc(CONVERT_SCRATCH_FRAMES * path->channels * sizeof(int16_t));
+    if (path->scratch == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ret = usb_headset_set_stream_format(path == &spk_path, path->usb_format.sample_rate, path->usb_format.bits,
+                                        path->usb_format.channels);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = drift_comp_create(&drift_config, &path->drift);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (xTaskCreate(task, path->name, 4 * 1024, NULL, 5, &path->task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
     return ESP_OK;
 }
 
@@ -57,8 +531,43 @@ static void uac_device_set_volume_cb(uint32_t volume, void *arg)
     ESP_LOGI(TAG, "set uac-device volume to: %"PRIu32"", volume);
 }
 
+static uint32_t mic_dsp_cycles(void)
+{
+    return esp_cpu_get_cycle_count();
+}
+
+void usb_headset_set_mic_bypass(bool bypass)
+{
+    mic_dsp_set_bypass(mic_dsp, bypass);
+    ESP_LOGI(TAG, "mic processing %s", bypass ? "bypassed" : "enabled");
+}
+
 esp_err_t usb_headset_init(void)
 {
+#if DEBUG_LATENCY_TRACE
+    latency_trace_init(latency_clock);
+#endif
+    mic_dsp_config_t dsp_config = MIC_DSP_DEFAULT_CONFIG(DEFAULT_CODEC_SAMPLE_RATE, DEFAULT_CODEC_CHANNEL);
+    dsp_config.noise_gate = DEFAULT_MIC_NOISE_GATE;
+    dsp_config.cycle_budget = MIC_DSP_CYCLE_BUDGET;
+    dsp_config.get_cycles = mic_dsp_cycles;
+    if (mic_dsp_create(&dsp_config, &mic_dsp) != ESP_OK) {
+        ESP_LOGE(TAG, "mic dsp init failed");
+        return ESP_FAIL;
+    }
+    mic_dsp_set_bypass(mic_dsp, !DEFAULT_MIC_PROCESSING);
+#if DEFAULT_CONSOLE
+    if (headset_console_init() != ESP_OK) {
+        ESP_LOGW(TAG, "console init failed");
+    }
+#endif
+
+    if (audio_path_init(&spk_path, spk_task) != ESP_OK || audio_path_init(&mic_path, mic_task) != ESP_OK) {
+        ESP_LOGE(TAG, "audio path init failed");
+        return ESP_FAIL;
+    }
+    xTaskCreate(drift_log_task, "drift_log", 3 * 1024, NULL, 1, NULL);
+
     uac_device_config_t config = {
         .output_cb = uac_device_output_cb,
         .input_cb = uac_device_input_cb,
@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Time the mixer task spends on one 10 ms block of 48 kHz stereo output,
+ * for 1 to 8 streams. Streams alternate mono and stereo and cycle through
+ * 44.1, 16, 48 and 22.05 kHz, so all but every fourth one is resampled,
+ * and each goes through conversion, resampling and a ramped gain like
+ * mixer_task does it.
+ *
+ * usage: bench_mixer [seconds of audio per stream count]
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "bsp_audio_mixer_dsp.h"
+
+#define OUT_RATE        (48000)
+#define OUT_FRAMES      (OUT_RATE / 100)
+#define MAX_STREAMS     (8)
+
+static const uint32_t rates[] = { 44100, 16000, 48000, 22050 };
+
+static int16_t raw[(OUT_FRAMES + 4) * 2];
+static int16_t stage[(OUT_FRAMES + 4) * 2];
+static int16_t mix[OUT_FRAMES * 2];
+static int32_t acc[OUT_FRAMES * 2];
+static int16_t out[OUT_FRAMES * 2];
+
+int main(int argc, char **argv)
+{
+    const int seconds = host_bench_iterations(argc, argv, 20);
+    const int blocks = seconds * 100;
+    uint32_t seed = 1;
+
+    for (size_t i = 0; i < sizeof(raw) / sizeof(raw[0]); i++) {
+        raw[i] = (int16_t)(host_rand(&seed) % 40000 - 20000);
+    }
+    printf("%d s of 48 kHz stereo output per stream count, 10 ms blocks\n", seconds);
+    printf("%8s %12s %10s %10s\n", "streams", "us/block", "cpu/rt", "clipped");
+    for (int n = 1; n <= MAX_STREAMS; n *= 2) {
+        mixer_resampler_t rs[MAX_STREAMS];
+        uint64_t clipped = 0;
+
+        for (int s = 0; s < n; s++) {
+            mixer_resampler_init(&rs[s], rates[s % 4], OUT_RATE, 2);
+        }
+        const int64_t start = host_cpu_ns();
+        for (int b = 0; b < blocks; b++) {
+            memset(acc, 0, sizeof(acc));
+            for (int s = 0; s < n; s++) {
+                const bool identity = (rs[s].step == (1 << 16));
+                const size_t need = identity ? OUT_FRAMES : mixer_resampler_need(&rs[s], OUT_FRAMES);
+                mixer_convert(raw, 16, (s & 1) ? 1 : 2, stage, 2, need);
+                if (identity) {
+                    memcpy(mix, stage, sizeof(mix));
+                } else {
+                    mixer_resample(&rs[s], stage, mix, OUT_FRAMES);
+                }
+                /* Gains about -3 dB, a small ramp on every other stream */
+                mixer_accumulate(acc, mix, OUT_FRAMES, 2, 11600 + (s & 1) * 100, 11600);
+            }
+            clipped += mixer_saturate(acc, out, OUT_FRAMES * 2);
+        }
+        const int64_t elapsed = host_cpu_ns() - start;
+        printf("%8d %12.2f %9.4f%% %10" PRIu64 "\n", n, elapsed / 1e3 / blocks, 100.0 * elapsed / (seconds * 1e9),
+               clipped);
+        /* Sanity: a single stream at -3 dB never clips */
+        if (n == 1 && clipped) {
+            fprintf(stderr, "one stream clipped %" PRIu64 " samples\n", clipped);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The part of esp_codec_dev the BSP calls, the devices are mocked by each test */
+#define ESP_CODEC_DEV_OK            (0)
+#define ESP_CODEC_DEV_DRV_ERR       (-1)
+#define ESP_CODEC_DEV_INVALID_ARG   (-2)
+#define ESP_CODEC_DEV_NOT_FOUND     (-3)
+#define ESP_CODEC_DEV_NOT_SUPPORT   (-4)
+#define ESP_CODEC_DEV_NO_MEM        (-5)
+#define ESP_CODEC_DEV_WRONG_STATE   (-6)
+
+typedef struct {
+    uint8_t bits_per_sample;
+    uint8_t channel;
+    uint16_t channel_mask;
+    uint32_t sample_rate;
+    int mclk_multiple;
+} esp_codec_dev_sample_info_t;
+
+typedef struct codec_dev_mock *esp_codec_dev_handle_t;
+
+int esp_codec_dev_open(esp_codec_dev_handle_t dev, esp_codec_dev_sample_info_t *fs);
+int esp_codec_dev_close(esp_codec_dev_handle_t dev);
+int esp_codec_dev_set_in_gain(esp_codec_dev_handle_t dev, float db);
+int esp_codec_dev_read(esp_codec_dev_handle_t dev, void *data, int len);
+int esp_codec_dev_write(esp_codec_dev_handle_t dev, void *data, int len);
+
+#ifdef __cplusplus
+}
+#endif
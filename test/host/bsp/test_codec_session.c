@@ -0,0 +1,334 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * The codec session state machine against a mock esp_codec_dev shaped
+ * like the box: a speaker and a microphone on one full duplex I2S port,
+ * so opening one at a clock the other does not run at fails, and an open
+ * takes 15 ms. Requests with the running format are skipped, a channel
+ * change reopens one device, a clock change pulls the other along with its
+ * own channels, failed opens leave the device closed, and a microphone
+ * reader running throughout never sees a transfer during a reopen.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "bsp_codec_session.h"
+
+#define OPEN_US     (15000)
+#define CLOSE_US    (3000)
+
+struct codec_dev_mock {
+    const char *name;
+    struct codec_dev_mock *peer;        /* The other direction of the I2S port */
+    bool open;
+    esp_codec_dev_sample_info_t fs;
+    int opens;
+    int closes;
+    int gain_sets;
+    float gain;
+    int fail_opens;                     /* Next opens to fail */
+    atomic_int transfers;               /* In flight, opens and closes must find none */
+    atomic_int overlaps;                /* Opens or closes with a transfer in flight */
+};
+
+static struct codec_dev_mock s_speaker = { .name = "speaker" };
+static struct codec_dev_mock s_mic = { .name = "mic" };
+static pthread_mutex_t s_mock_lock = PTHREAD_MUTEX_INITIALIZER;
+static char s_log[256];                 /* "o" and "c" per open and close, "s" / "m" for the device */
+
+static bsp_i2s_stream_handle_t s_play;
+static bsp_i2s_stream_handle_t s_record;
+
+static void mock_log(struct codec_dev_mock *dev, char what)
+{
+    const size_t len = strlen(s_log);
+    if (len + 2 < sizeof(s_log)) {
+        s_log[len] = what;
+        s_log[len + 1] = (dev == &s_speaker) ? 's' : 'm';
+        s_log[len + 2] = '\0';
+    }
+}
+
+int esp_codec_dev_open(esp_codec_dev_handle_t dev, esp_codec_dev_sample_info_t *fs)
+{
+    int ret = ESP_CODEC_DEV_OK;
+
+    atomic_fetch_add(&dev->overlaps, atomic_load(&dev->transfers) != 0);
+    pthread_mutex_lock(&s_mock_lock);
+    if (dev->open) {
+        ret = ESP_CODEC_DEV_WRONG_STATE;
+    } else if (dev->fail_opens > 0) {
+        dev->fail_opens--;
+        ret = ESP_CODEC_DEV_DRV_ERR;
+    } else if (dev->peer->open && (dev->peer->fs.sample_rate != fs->sample_rate ||
+                                   dev->peer->fs.bits_per_sample != fs->bits_per_sample)) {
+        /* Full duplex: one clock for both directions */
+        ret = ESP_CODEC_DEV_NOT_SUPPORT;
+    }
+    pthread_mutex_unlock(&s_mock_lock);
+    if (ret != ESP_CODEC_DEV_OK) {
+        return ret;
+    }
+    usleep(OPEN_US);
+    pthread_mutex_lock(&s_mock_lock);
+    dev->open = true;
+    dev->fs = *fs;
+    dev->opens++;
+    mock_log(dev, 'o');
+    pthread_mutex_unlock(&s_mock_lock);
+    return ESP_CODEC_DEV_OK;
+}
+
+int esp_codec_dev_close(esp_codec_dev_handle_t dev)
+{
+    atomic_fetch_add(&dev->overlaps, atomic_load(&dev->transfers) != 0);
+    pthread_mutex_lock(&s_mock_lock);
+    const bool was_open = dev->open;
+    dev->open = false;
+    dev->closes++;
+    mock_log(dev, 'c');
+    pthread_mutex_unlock(&s_mock_lock);
+    if (was_open) {
+        usleep(CLOSE_US);
+    }
+    return ESP_CODEC_DEV_OK;
+}
+
+int esp_codec_dev_set_in_gain(esp_codec_dev_handle_t dev, float db)
+{
+    pthread_mutex_lock(&s_mock_lock);
+    dev->gain = db;
+    dev->gain_sets++;
+    pthread_mutex_unlock(&s_mock_lock);
+    return ESP_CODEC_DEV_OK;
+}
+
+static int mock_transfer(esp_codec_dev_handle_t dev, void *data, int len)
+{
+    pthread_mutex_lock(&s_mock_lock);
+    const bool open = dev->open;
+    const uint32_t bytes_per_second = dev->fs.sample_rate * dev->fs.channel * dev->fs.bits_per_sample / 8;
+    pthread_mutex_unlock(&s_mock_lock);
+    if (!open) {
+        return ESP_CODEC_DEV_WRONG_STATE;
+    }
+    atomic_fetch_add(&dev->transfers, 1);
+    usleep((int64_t)len * 1000000 / bytes_per_second);
+    atomic_fetch_sub(&dev->transfers, 1);
+    return ESP_CODEC_DEV_OK;
+}
+
+int esp_codec_dev_read(esp_codec_dev_handle_t dev, void *data, int len)
+{
+    memset(data, 1, len);
+    return mock_transfer(dev, data, len);
+}
+
+int esp_codec_dev_write(esp_codec_dev_handle_t dev, void *data, int len)
+{
+    return mock_transfer(dev, data, len);
+}
+
+/* The chunk transfers of the board code */
+static esp_err_t io_result(int ret)
+{
+    if (ESP_CODEC_DEV_OK == ret) {
+        return ESP_OK;
+    }
+    return (ESP_CODEC_DEV_WRONG_STATE == ret) ? ESP_ERR_INVALID_STATE : ESP_FAIL;
+}
+
+static esp_err_t read_chunk(void *data, size_t len, void *ctx)
+{
+    return io_result(esp_codec_dev_read(&s_mic, data, len));
+}
+
+static esp_err_t write_chunk(void *data, size_t len, void *ctx)
+{
+    return io_result(esp_codec_dev_write(&s_speaker, data, len));
+}
+
+static esp_codec_dev_sample_info_t format(uint32_t rate, uint8_t bits, uint8_t channels)
+{
+    const esp_codec_dev_sample_info_t fs = {
+        .sample_rate = rate,
+        .bits_per_sample = bits,
+        .channel = channels,
+        .channel_mask = 0,
+    };
+    return fs;
+}
+
+static void test_init(void)
+{
+    const esp_codec_dev_sample_info_t fs = format(16000, 16, 2);
+    const bsp_i2s_stream_config_t record = { .io = read_chunk, .task_name = "mic", .task_priority = 5 };
+    const bsp_i2s_stream_config_t play = { .io = write_chunk, .playback = true, .task_name = "speaker", .task_priority = 5 };
+
+    s_speaker.peer = &s_mic;
+    s_mic.peer = &s_speaker;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, bsp_codec_session_set_fs(BSP_CODEC_SESSION_BOTH, &fs));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, bsp_codec_session_stop());
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_create(&record, &s_record));
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_create(&play, &s_play));
+
+    const bsp_codec_session_config_t config = {
+        .play_dev = &s_speaker,
+        .record_dev = &s_mic,
+        .play_stream = s_play,
+        .record_stream = s_record,
+        .in_gain = 27,
+        .shared_clock = true,
+    };
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, bsp_codec_session_init(NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_init(&config));
+}
+
+static void test_skip_and_partial_reopen(void)
+{
+    esp_codec_dev_sample_info_t fs = format(16000, 16, 2);
+    bsp_codec_stats_t stats;
+
+    /* The first request opens both, the microphone first */
+    s_log[0] = '\0';
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_set_fs(BSP_CODEC_SESSION_BOTH, &fs));
+    TEST_ASSERT(strcmp(s_log, "omos") == 0);
+    TEST_ASSERT_EQUAL(1, s_mic.gain_sets);
+    TEST_ASSERT_EQUAL(27, (int)s_mic.gain);
+
+    /* The same format again: nothing touched */
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_set_fs(BSP_CODEC_SESSION_BOTH, &fs));
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_set_fs(BSP_CODEC_SESSION_PLAY, &fs));
+    TEST_ASSERT_EQUAL(1, s_speaker.opens);
+    TEST_ASSERT_EQUAL(1, s_mic.opens);
+
+    /* Mono playback at the same clock: the speaker alone */
+    fs = format(16000, 16, 1);
+    s_log[0] = '\0';
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_set_fs(BSP_CODEC_SESSION_PLAY, &fs));
+    TEST_ASSERT(strcmp(s_log, "csos") == 0);
+    TEST_ASSERT_EQUAL(2, s_mic.fs.channel);
+    TEST_ASSERT_EQUAL(1, s_speaker.fs.channel);
+
+    /* A new rate for playback: the microphone follows and keeps two channels, closed last, opened first */
+    fs = format(44100, 16, 1);
+    s_log[0] = '\0';
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_set_fs(BSP_CODEC_SESSION_PLAY, &fs));
+    TEST_ASSERT(strcmp(s_log, "cscmomos") == 0);
+    TEST_ASSERT_EQUAL(44100, s_mic.fs.sample_rate);
+    TEST_ASSERT_EQUAL(2, s_mic.fs.channel);
+    TEST_ASSERT_EQUAL(2, s_mic.gain_sets);
+
+    bsp_codec_session_get_stats(&stats);
+    TEST_ASSERT_EQUAL(5, stats.requests);
+    TEST_ASSERT_EQUAL(2, stats.skipped);
+    TEST_ASSERT_EQUAL(3, stats.play_reopens);
+    TEST_ASSERT_EQUAL(2, stats.record_reopens);
+    /* The microphone was closed for one close and one open */
+    TEST_ASSERT_GREATER_OR_EQUAL(OPEN_US, stats.last_gap_us);
+    TEST_ASSERT_LESS_OR_EQUAL(OPEN_US + CLOSE_US + 40000, stats.last_gap_us);
+}
+
+static void test_stop_and_failures(void)
+{
+    const esp_codec_dev_sample_info_t fs = format(16000, 16, 2);
+    size_t done = 0;
+    uint8_t buf[640];
+
+    /* Stopped: both closed, the microphone last, transfers report it */
+    s_log[0] = '\0';
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_stop());
+    TEST_ASSERT(strcmp(s_log, "cscm") == 0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, bsp_i2s_stream_transfer(s_record, buf, sizeof(buf), &done, 100));
+    TEST_ASSERT_EQUAL(0, done);
+
+    /* Playback alone does not open the microphone */
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_set_fs(BSP_CODEC_SESSION_PLAY, &fs));
+    TEST_ASSERT_TRUE(s_speaker.open);
+    TEST_ASSERT_FALSE(s_mic.open);
+
+    /* The speaker fails to open: reported, left closed, the microphone opened anyway */
+    s_speaker.fail_opens = 1;
+    const esp_codec_dev_sample_info_t other = format(48000, 16, 2);
+    TEST_ASSERT_EQUAL(ESP_FAIL, bsp_codec_session_set_fs(BSP_CODEC_SESSION_BOTH, &other));
+    TEST_ASSERT_FALSE(s_speaker.open);
+    TEST_ASSERT_TRUE(s_mic.open);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, bsp_i2s_stream_transfer(s_play, buf, sizeof(buf), &done, 100));
+
+    /* The same request again only opens what is missing */
+    const int mic_opens = s_mic.opens;
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_set_fs(BSP_CODEC_SESSION_BOTH, &other));
+    TEST_ASSERT_TRUE(s_speaker.open);
+    TEST_ASSERT_EQUAL(mic_opens, s_mic.opens);
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_transfer(s_play, buf, sizeof(buf), &done, 100));
+    TEST_ASSERT_EQUAL(sizeof(buf), done);
+}
+
+typedef struct {
+    atomic_bool stop;
+    uint32_t reads;
+    uint32_t errors;
+} reader_t;
+
+static void *mic_reader(void *arg)
+{
+    reader_t *reader = arg;
+    uint8_t buf[1920];
+    size_t done = 0;
+
+    while (!atomic_load(&reader->stop)) {
+        if (bsp_i2s_stream_transfer(s_record, buf, sizeof(buf), &done, portMAX_DELAY) != ESP_OK) {
+            reader->errors++;
+        }
+        reader->reads++;
+    }
+    return NULL;
+}
+
+static void test_reader_through_reconfigurations(void)
+{
+    static const uint32_t rates[] = { 16000, 44100, 48000, 16000 };
+    reader_t reader = { 0 };
+    bsp_codec_stats_t stats;
+    pthread_t thread;
+
+    /* The microphone keeps its channels through every clock change */
+    esp_codec_dev_sample_info_t fs = format(16000, 16, 2);
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_set_fs(BSP_CODEC_SESSION_BOTH, &fs));
+    pthread_create(&thread, NULL, mic_reader, &reader);
+    for (int i = 0; i < 24; i++) {
+        fs = format(rates[i % 4], 16, 1 + i % 2);
+        TEST_ASSERT_EQUAL(ESP_OK, bsp_codec_session_set_fs(BSP_CODEC_SESSION_PLAY, &fs));
+        TEST_ASSERT_EQUAL(2, s_mic.fs.channel);
+        usleep(5000);
+    }
+    atomic_store(&reader.stop, true);
+    pthread_join(thread, NULL);
+
+    bsp_codec_session_get_stats(&stats);
+    printf("%" PRIu32 " reads, microphone gap up to %" PRIu32 " us, reconfiguration up to %" PRIu32 " us\n",
+           reader.reads, stats.max_gap_us, stats.max_us);
+    TEST_ASSERT(reader.reads > 0);
+    TEST_ASSERT_EQUAL(0, reader.errors);
+    TEST_ASSERT_LESS_OR_EQUAL(OPEN_US + CLOSE_US + 40000, stats.max_gap_us);
+    TEST_ASSERT_EQUAL(0, atomic_load(&s_mic.overlaps));
+    TEST_ASSERT_EQUAL(0, atomic_load(&s_speaker.overlaps));
+}
+
+int main(void)
+{
+    RUN_TEST(test_init);
+    RUN_TEST(test_skip_and_partial_reopen);
+    RUN_TEST(test_stop_and_failures);
+    RUN_TEST(test_reader_through_reconfigurations);
+    return HOST_TEST_END();
+}
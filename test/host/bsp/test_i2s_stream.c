@@ -0,0 +1,280 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * bsp_i2s_stream against a simulated codec that moves audio in real time
+ * and can be made to stall, fail or stop: timeouts are honoured with the
+ * bytes already moved reported, buffered mode never blocks a zero timeout,
+ * overruns and underruns drop or pad whole chunks without reordering the
+ * audio, leaving buffered mode drains the ring, and the lock holds off
+ * transfers while the codec is reconfigured.
+ *
+ * 16 kHz, stereo, 16 bit: 64 bytes per millisecond, 640 byte chunks.
+ * Recorded samples count up, played samples are checked to keep counting.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "bsp_i2s_stream.h"
+
+#define BYTES_PER_MS    (64)
+#define CHUNK_BYTES     (BSP_I2S_CHUNK_MS * BYTES_PER_MS)
+
+typedef struct {
+    atomic_int stall_ms;        /* Added to each transfer */
+    atomic_int error;           /* Returned instead of transferring */
+    uint16_t next;              /* Record: next sample, play: sample expected */
+    atomic_uint bytes;          /* Play: bytes received */
+    atomic_uint silence;        /* Play: zero samples received */
+    atomic_uint gaps;           /* Play: samples out of sequence */
+} codec_sim_t;
+
+static codec_sim_t s_mic = { .next = 1 };
+static codec_sim_t s_speaker = { .next = 1 };
+/* Streams have no delete, they live for the whole run like on the board */
+static bsp_i2s_stream_handle_t s_record;
+static bsp_i2s_stream_handle_t s_play;
+static uint16_t s_buf[16000];
+
+static esp_err_t codec_wait(codec_sim_t *sim, size_t len)
+{
+    const esp_err_t error = atomic_load(&sim->error);
+    if (error != ESP_OK) {
+        usleep(1000);
+        return error;
+    }
+    usleep(len * 1000 / BYTES_PER_MS + atomic_load(&sim->stall_ms) * 1000);
+    return ESP_OK;
+}
+
+static esp_err_t mic_io(void *data, size_t len, void *ctx)
+{
+    codec_sim_t *sim = ctx;
+    const esp_err_t ret = codec_wait(sim, len);
+    if (ret == ESP_OK) {
+        uint16_t *samples = data;
+        for (size_t i = 0; i < len / 2; i++) {
+            samples[i] = sim->next++;
+        }
+    }
+    return ret;
+}
+
+static esp_err_t speaker_io(void *data, size_t len, void *ctx)
+{
+    codec_sim_t *sim = ctx;
+    const esp_err_t ret = codec_wait(sim, len);
+    if (ret == ESP_OK) {
+        const uint16_t *samples = data;
+        for (size_t i = 0; i < len / 2; i++) {
+            if (samples[i] == 0) {
+                atomic_fetch_add(&sim->silence, 1);
+                continue;
+            }
+            if (samples[i] != sim->next) {
+                atomic_fetch_add(&sim->gaps, 1);
+            }
+            sim->next = samples[i] + 1;
+        }
+        atomic_fetch_add(&sim->bytes, len);
+    }
+    return ret;
+}
+
+static uint32_t elapsed_ms(TickType_t since)
+{
+    return xTaskGetTickCount() - since;
+}
+
+static void test_direct_mode(void)
+{
+    const bsp_i2s_stream_config_t mic = { .io = mic_io, .ctx = &s_mic, .task_name = "mic", .task_priority = 5 };
+    const bsp_i2s_stream_config_t speaker = { .io = speaker_io, .ctx = &s_speaker, .playback = true,
+                                              .task_name = "speaker", .task_priority = 5 };
+    size_t done = 0;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, bsp_i2s_stream_create(NULL, &s_record));
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_create(&mic, &s_record));
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_create(&speaker, &s_play));
+    bsp_i2s_stream_set_format(s_record, 16000, 4);
+    bsp_i2s_stream_set_format(s_play, 16000, 4);
+
+    /* 100 ms, blocking */
+    TickType_t start = xTaskGetTickCount();
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_transfer(s_record, s_buf, 6400, &done, portMAX_DELAY));
+    TEST_ASSERT_EQUAL(6400, done);
+    TEST_ASSERT_GREATER_OR_EQUAL(95, elapsed_ms(start));
+    for (int i = 0; i < 3200; i++) {
+        if (s_buf[i] != i + 1) {
+            HOST_TEST_FAIL("sample %d is %u", i, s_buf[i]);
+        }
+    }
+
+    /* The codec stalls 300 ms per chunk: one chunk in, then the 100 ms timeout */
+    atomic_store(&s_mic.stall_ms, 300);
+    start = xTaskGetTickCount();
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, bsp_i2s_stream_transfer(s_record, s_buf, 6400, &done, 100));
+    TEST_ASSERT_EQUAL(CHUNK_BYTES, done);
+    TEST_ASSERT_LESS_OR_EQUAL(600, elapsed_ms(start));
+    atomic_store(&s_mic.stall_ms, 0);
+
+    /* A codec error ends the call with what was moved, a NULL count is fine */
+    atomic_store(&s_mic.error, ESP_FAIL);
+    TEST_ASSERT_EQUAL(ESP_FAIL, bsp_i2s_stream_transfer(s_record, s_buf, 6400, &done, portMAX_DELAY));
+    TEST_ASSERT_EQUAL(0, done);
+    atomic_store(&s_mic.error, ESP_ERR_INVALID_STATE);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, bsp_i2s_stream_transfer(s_record, s_buf, 6400, &done, portMAX_DELAY));
+    atomic_store(&s_mic.error, ESP_OK);
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_transfer(s_record, s_buf, 64, NULL, portMAX_DELAY));
+
+    bsp_i2s_stats_t stats;
+    bsp_i2s_stream_get_stats(s_record, &stats);
+    TEST_ASSERT_EQUAL(1, stats.timeouts);
+    TEST_ASSERT_EQUAL(2, stats.errors);
+    TEST_ASSERT_EQUAL(6400 + CHUNK_BYTES + 64, stats.bytes);
+}
+
+static void test_buffered_record(void)
+{
+    bsp_i2s_stats_t stats;
+    size_t done = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_set_mode(s_record, BSP_I2S_MODE_BUFFERED, 0));
+
+    /* A zero timeout never blocks, whatever the ring holds */
+    TickType_t start = xTaskGetTickCount();
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, bsp_i2s_stream_transfer(s_record, s_buf, 6400, &done, 0));
+    TEST_ASSERT_LESS_OR_EQUAL(5, elapsed_ms(start));
+    const size_t first = done;
+    usleep(60000);
+    bsp_i2s_stream_transfer(s_record, (uint8_t *)s_buf + first, 6400, &done, 0);
+    TEST_ASSERT_GREATER_OR_EQUAL(4 * CHUNK_BYTES, done);
+    TEST_ASSERT_EQUAL(0, done % CHUNK_BYTES);
+    for (size_t i = 1; i < (first + done) / 2; i++) {
+        if (s_buf[i] != (uint16_t)(s_buf[i - 1] + 1)) {
+            HOST_TEST_FAIL("sample %zu jumps from %u to %u", i, s_buf[i - 1], s_buf[i]);
+        }
+    }
+
+    /* A short timeout returns near it */
+    start = xTaskGetTickCount();
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, bsp_i2s_stream_transfer(s_record, s_buf, 6400, &done, 30));
+    TEST_ASSERT_GREATER_OR_EQUAL(25, elapsed_ms(start));
+    TEST_ASSERT_LESS_OR_EQUAL(80, elapsed_ms(start));
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_transfer(s_record, s_buf, 3200, &done, portMAX_DELAY));
+
+    /* 300 ms without reading on a 100 ms ring: whole chunks dropped, one jump in the audio */
+    bsp_i2s_stream_get_stats(s_record, &stats);
+    const uint32_t overruns = stats.overruns;
+    usleep(300000);
+    bsp_i2s_stream_get_stats(s_record, &stats);
+    TEST_ASSERT_GREATER_OR_EQUAL(overruns + 15, stats.overruns);
+    TEST_ASSERT_EQUAL(0, stats.underruns);
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_transfer(s_record, s_buf, 12800, &done, portMAX_DELAY));
+    int jumps = 0;
+    for (size_t i = 1; i < 6400; i++) {
+        if (s_buf[i] != (uint16_t)(s_buf[i - 1] + 1)) {
+            jumps++;
+            TEST_ASSERT_EQUAL(0, i % (CHUNK_BYTES / 2));
+        }
+    }
+    TEST_ASSERT_EQUAL(1, jumps);
+
+    /* The codec stopped under the task: the callers hear about it */
+    bsp_i2s_stream_lock(s_record);
+    atomic_store(&s_mic.error, ESP_ERR_INVALID_STATE);
+    bsp_i2s_stream_unlock(s_record);
+    usleep(150000);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, bsp_i2s_stream_transfer(s_record, s_buf, 40 * CHUNK_BYTES, &done, 50));
+    atomic_store(&s_mic.error, ESP_OK);
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_set_mode(s_record, BSP_I2S_MODE_DIRECT, 0));
+}
+
+static void test_buffered_play(void)
+{
+    bsp_i2s_stats_t stats;
+    uint16_t next = s_speaker.next;
+    size_t done = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_set_mode(s_play, BSP_I2S_MODE_BUFFERED, 6400));
+    for (int i = 0; i < 8000; i++) {
+        s_buf[i] = next++;
+    }
+
+    /* The ring takes 6400 bytes at once, the rest waits for the codec */
+    TickType_t start = xTaskGetTickCount();
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, bsp_i2s_stream_transfer(s_play, s_buf, 16000, &done, 0));
+    TEST_ASSERT_EQUAL(6400, done);
+    TEST_ASSERT_LESS_OR_EQUAL(5, elapsed_ms(start));
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_transfer(s_play, (uint8_t *)s_buf + done, 16000 - done, &done, portMAX_DELAY));
+    usleep(200000);
+    bsp_i2s_stream_get_stats(s_play, &stats);
+    TEST_ASSERT_EQUAL(16000, s_speaker.bytes);
+    TEST_ASSERT_EQUAL(0, s_speaker.gaps);
+    TEST_ASSERT_EQUAL(0, stats.underruns);
+
+    /* The writer stalls mid-chunk: the chunk goes out padded with silence, counted once */
+    for (int i = 0; i < 100; i++) {
+        s_buf[i] = next++;
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_transfer(s_play, s_buf, 200, &done, portMAX_DELAY));
+    usleep(150000);
+    bsp_i2s_stream_get_stats(s_play, &stats);
+    TEST_ASSERT_EQUAL(1, stats.underruns);
+    TEST_ASSERT_EQUAL(0, stats.overruns);
+    TEST_ASSERT_EQUAL(16000 + CHUNK_BYTES, s_speaker.bytes);
+    TEST_ASSERT_EQUAL((CHUNK_BYTES - 200) / 2, s_speaker.silence);
+
+    /* Leaving buffered mode plays what is left */
+    for (int i = 0; i < 1600; i++) {
+        s_buf[i] = next++;
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_transfer(s_play, s_buf, 3200, &done, portMAX_DELAY));
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_set_mode(s_play, BSP_I2S_MODE_DIRECT, 0));
+    TEST_ASSERT_EQUAL(16000 + CHUNK_BYTES + 3200, s_speaker.bytes);
+    TEST_ASSERT_EQUAL(0, s_speaker.gaps);
+}
+
+static void *unlock_later(void *arg)
+{
+    usleep(50000);
+    bsp_i2s_stream_unlock(s_play);
+    return NULL;
+}
+
+static void test_lock_holds_off_transfers(void)
+{
+    pthread_t thread;
+    size_t done = 0;
+    uint16_t next = s_speaker.next;
+
+    /* Held while the codec is reconfigured: the write waits for the unlock */
+    bsp_i2s_stream_lock(s_play);
+    const TickType_t start = xTaskGetTickCount();
+    pthread_create(&thread, NULL, unlock_later, NULL);
+    for (int i = 0; i < CHUNK_BYTES / 2; i++) {
+        s_buf[i] = next++;
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, bsp_i2s_stream_transfer(s_play, s_buf, CHUNK_BYTES, &done, portMAX_DELAY));
+    TEST_ASSERT_GREATER_OR_EQUAL(50, elapsed_ms(start));
+    pthread_join(thread, NULL);
+    TEST_ASSERT_EQUAL(0, s_speaker.gaps);
+}
+
+int main(void)
+{
+    RUN_TEST(test_direct_mode);
+    RUN_TEST(test_buffered_record);
+    RUN_TEST(test_buffered_play);
+    RUN_TEST(test_lock_holds_off_transfers);
+    return HOST_TEST_END();
+}
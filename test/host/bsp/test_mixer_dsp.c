@@ -0,0 +1,199 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * The fixed-point kernels of the mixer: PCM conversion of every input
+ * width and channel count, the Q14 gain table, accumulation with a ramped
+ * gain and saturation, then the resampler on 10 ms blocks as the mixer
+ * task feeds it, checked against the ideal sine.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "bsp_audio_mixer_dsp.h"
+
+#define BLOCK_MS        (10)
+#define MAX_BLOCK       (48000 * BLOCK_MS / 1000 + 4)
+
+static void test_convert(void)
+{
+    int16_t out[8];
+
+    /* 8 bit is unsigned, mono is copied to both channels */
+    const uint8_t u8[4] = { 0, 128, 255, 64 };
+    mixer_convert(u8, 8, 1, out, 2, 4);
+    TEST_ASSERT_EQUAL(-32768, out[0]);
+    TEST_ASSERT_EQUAL(-32768, out[1]);
+    TEST_ASSERT_EQUAL(0, out[2]);
+    TEST_ASSERT_EQUAL(32512, out[5]);
+    TEST_ASSERT_EQUAL(-16384, out[6]);
+
+    /* Stereo to mono averages, stereo to stereo copies */
+    const int16_t s16[4] = { 1000, -1000, 30000, 20000 };
+    mixer_convert(s16, 16, 2, out, 1, 2);
+    TEST_ASSERT_EQUAL(0, out[0]);
+    TEST_ASSERT_EQUAL(25000, out[1]);
+    mixer_convert(s16, 16, 2, out, 2, 2);
+    TEST_ASSERT_EQUAL(0, memcmp(out, s16, sizeof(s16)));
+
+    /* Wider samples keep their top 16 bits */
+    const int32_t s32[2] = { 0x12345678, -0x10000000 };
+    mixer_convert(s32, 32, 2, out, 2, 1);
+    TEST_ASSERT_EQUAL(0x1234, out[0]);
+    TEST_ASSERT_EQUAL(-0x1000, out[1]);
+    const uint8_t s24[6] = { 0x11, 0x22, 0x33, 0x00, 0x00, 0x80 };
+    mixer_convert(s24, 24, 1, out, 1, 2);
+    TEST_ASSERT_EQUAL(0x3322, out[0]);
+    TEST_ASSERT_EQUAL(-32768, out[1]);
+}
+
+static void test_gain_from_db(void)
+{
+    TEST_ASSERT_EQUAL(MIXER_GAIN_UNITY, mixer_gain_from_db(0));
+    TEST_ASSERT_LESS_OR_EQUAL(1, abs(mixer_gain_from_db(-6) - 8211));
+    TEST_ASSERT_LESS_OR_EQUAL(1, abs(mixer_gain_from_db(-12) - 4115));
+    TEST_ASSERT_EQUAL(MIXER_GAIN_MAX, mixer_gain_from_db(10));
+    TEST_ASSERT_EQUAL(0, mixer_gain_from_db(-INFINITY));
+}
+
+static void test_accumulate_and_saturate(void)
+{
+    const int16_t in[8] = { 10000, -10000, 32767, -32768, 100, 200, 300, 400 };
+    int32_t acc[8] = { 0 };
+    int16_t out[8];
+
+    /* Unity plus half: sums go past 16 bit, saturation clips them */
+    mixer_accumulate(acc, in, 4, 2, MIXER_GAIN_UNITY, MIXER_GAIN_UNITY);
+    mixer_accumulate(acc, in, 4, 2, MIXER_GAIN_UNITY / 2, MIXER_GAIN_UNITY / 2);
+    TEST_ASSERT_EQUAL(15000, acc[0]);
+    TEST_ASSERT_EQUAL(-15000, acc[1]);
+    TEST_ASSERT_EQUAL(32767 + 16383, acc[2]);
+    TEST_ASSERT_EQUAL(-49152, acc[3]);
+    TEST_ASSERT_EQUAL(2, mixer_saturate(acc, out, 8));
+    TEST_ASSERT_EQUAL(15000, out[0]);
+    TEST_ASSERT_EQUAL(32767, out[2]);
+    TEST_ASSERT_EQUAL(-32768, out[3]);
+    TEST_ASSERT_EQUAL(600, out[7]);
+}
+
+static void test_gain_ramp(void)
+{
+    int16_t in[200];
+    int32_t acc[200] = { 0 };
+
+    for (int i = 0; i < 200; i++) {
+        in[i] = 16384;
+    }
+    /* A fade in over one block: from silence, never down, channels together */
+    mixer_accumulate(acc, in, 100, 2, 0, MIXER_GAIN_UNITY);
+    TEST_ASSERT_EQUAL(0, acc[0]);
+    for (int f = 1; f < 100; f++) {
+        TEST_ASSERT(acc[2 * f] >= acc[2 * f - 2]);
+        TEST_ASSERT_EQUAL(acc[2 * f], acc[2 * f + 1]);
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(16000, acc[198]);
+    TEST_ASSERT_LESS_OR_EQUAL(16384, acc[198]);
+}
+
+/* SNR of a sine through the resampler in 10 ms output blocks, its one frame of lag taken out */
+static double resample_snr(uint32_t in_rate, uint32_t out_rate, uint8_t channels, double freq)
+{
+    const size_t out_frames = out_rate * BLOCK_MS / 1000;
+    int16_t stage[MAX_BLOCK * 2], out[MAX_BLOCK * 2];
+    mixer_resampler_t rs;
+    size_t staged = 0;
+    uint64_t fed = 0, produced = 0;
+    double signal = 0, noise = 0;
+
+    mixer_resampler_init(&rs, in_rate, out_rate, channels);
+    for (int block = 0; block < 200; block++) {
+        const size_t need = mixer_resampler_need(&rs, out_frames);
+        if (need > in_rate * BLOCK_MS / 1000 + 2) {
+            return -1;
+        }
+        for (; staged < need; staged++, fed++) {
+            for (int c = 0; c < channels; c++) {
+                stage[staged * channels + c] = (int16_t)lrint(20000 * sin(2 * M_PI * freq * fed / in_rate + c));
+            }
+        }
+        const size_t used = mixer_resample(&rs, stage, out, out_frames);
+        staged -= used;
+        memmove(stage, stage + used * channels, staged * channels * sizeof(int16_t));
+        for (size_t f = 0; f < out_frames; f++, produced++) {
+            const double t = (double)produced * rs.step / 65536.0 - 1;
+            if (block < 2) {
+                continue;
+            }
+            for (int c = 0; c < channels; c++) {
+                const double ref = 20000 * sin(2 * M_PI * freq * t / in_rate + c);
+                signal += ref * ref;
+                noise += (out[f * channels + c] - ref) * (out[f * channels + c] - ref);
+            }
+        }
+    }
+    return noise > 0 ? 10 * log10(signal / noise) : 200;
+}
+
+static void test_resample_quality(void)
+{
+    static const struct {
+        uint32_t in_rate;
+        uint32_t out_rate;
+        uint8_t channels;
+        double freq;
+    } cases[] = {
+        { 44100, 16000, 2, 1000 },
+        { 48000, 16000, 1, 1000 },
+        { 22050, 16000, 2, 500 },
+        { 11025, 16000, 2, 1000 },
+        { 8000, 48000, 1, 300 },
+        { 16000, 44100, 2, 440 },
+        { 16000, 16000, 2, 1000 },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const double snr = resample_snr(cases[i].in_rate, cases[i].out_rate, cases[i].channels, cases[i].freq);
+        printf("%5" PRIu32 " -> %5" PRIu32 " Hz, %d ch, %4.0f Hz tone: SNR %.1f dB\n", cases[i].in_rate,
+               cases[i].out_rate, cases[i].channels, cases[i].freq, snr);
+        if (snr < 28) {
+            HOST_TEST_FAIL("%" PRIu32 " -> %" PRIu32 ": SNR %.1f dB", cases[i].in_rate, cases[i].out_rate, snr);
+        }
+    }
+}
+
+static void test_resample_need_matches_use(void)
+{
+    static const uint32_t rates[] = { 8000, 11025, 16000, 22050, 44100, 48000 };
+    int16_t stage[MAX_BLOCK * 2] = { 0 }, out[MAX_BLOCK * 2];
+
+    /* Over 10 s the frames used track the rate ratio, the need never runs past one block */
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        mixer_resampler_t rs;
+        uint64_t used = 0;
+
+        mixer_resampler_init(&rs, rates[i], 16000, 2);
+        for (int block = 0; block < 1000; block++) {
+            const size_t need = mixer_resampler_need(&rs, 160);
+            TEST_ASSERT_LESS_OR_EQUAL(rates[i] * BLOCK_MS / 1000 + 2, need);
+            const size_t n = mixer_resample(&rs, stage, out, 160);
+            TEST_ASSERT_LESS_OR_EQUAL(need, n);
+            used += n;
+        }
+        TEST_ASSERT_LESS_OR_EQUAL(2, llabs((long long)used - (long long)rates[i] * 10));
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(test_convert);
+    RUN_TEST(test_gain_from_db);
+    RUN_TEST(test_accumulate_and_saturate);
+    RUN_TEST(test_gain_ramp);
+    RUN_TEST(test_resample_quality);
+    RUN_TEST(test_resample_need_matches_use);
+    return HOST_TEST_END();
+}
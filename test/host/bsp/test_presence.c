@@ -0,0 +1,318 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * presence on scripted radar edge sequences, run only at the deadlines it
+ * asks for as the presence timer does: glitches, the debounced rise, a
+ * bouncing fall, sleep and wake, enable and disable. Then hours of random
+ * edges, where the engine run at its deadlines has to give the same events
+ * at the same millisecond as one polled every millisecond.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "bsp_presence.h"
+
+#define MS(ms)          ((int64_t)(ms) * 1000)
+
+static const presence_config_t s_config = {
+    .debounce_ms = 50,
+    .hold_ms = 60000,
+    .power_off_delay_ms = 120000,
+};
+
+static presence_t s_p;
+static int64_t s_now;
+static uint32_t s_events;
+static uint32_t s_runs;
+
+/* Advance the clock, running the engine at each deadline it asks for */
+static void run_until(int64_t t_us)
+{
+    for (int64_t next = presence_next(&s_p); next <= t_us; next = presence_next(&s_p)) {
+        if (next < s_now) {
+            HOST_TEST_FAIL("deadline %" PRId64 " in the past at %" PRId64, next, s_now);
+        }
+        s_now = next;
+        s_events |= presence_run(&s_p, s_now);
+        s_runs++;
+    }
+    s_now = t_us;
+}
+
+static void edge(int64_t t_us, bool level)
+{
+    run_until(t_us);
+    s_events |= presence_input(&s_p, level, s_now);
+}
+
+static uint32_t take_events(void)
+{
+    const uint32_t events = s_events;
+    s_events = 0;
+    return events;
+}
+
+static void setup(const presence_config_t *config)
+{
+    presence_init(&s_p, config, true, 0);
+    s_now = 0;
+    s_events = presence_input(&s_p, false, 0);
+    s_runs = 0;
+}
+
+static void test_glitches_and_debounce(void)
+{
+    setup(&s_config);
+    TEST_ASSERT(presence_next(&s_p) == PRESENCE_NEVER);
+
+    /* Nothing seen yet, no power off however long */
+    run_until(MS(600000));
+    TEST_ASSERT_EQUAL(0, take_events());
+    TEST_ASSERT_EQUAL(0, s_runs);
+
+    /* Glitches shorter than the debounce are ignored */
+    edge(MS(600000), true);
+    edge(MS(600020), false);
+    edge(MS(600030), true);
+    edge(MS(600040), false);
+    run_until(MS(700000));
+    TEST_ASSERT_EQUAL(0, take_events());
+    TEST_ASSERT_FALSE(s_p.present);
+
+    /* A rise held for the debounce enters at the end of it */
+    edge(MS(700000), true);
+    run_until(MS(700049));
+    TEST_ASSERT_EQUAL(0, take_events());
+    run_until(MS(700050));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_ENTER, take_events());
+    TEST_ASSERT_TRUE(s_p.present);
+
+    /* Sitting still with the output high keeps the box on, without a run */
+    const uint32_t runs = s_runs;
+    run_until(MS(1300000));
+    TEST_ASSERT_EQUAL(0, take_events());
+    TEST_ASSERT_EQUAL(runs, s_runs);
+}
+
+static void test_bouncing_fall_sleep_and_wake(void)
+{
+    setup(&s_config);
+    edge(0, true);
+    run_until(MS(1000));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_ENTER, take_events());
+
+    /* The timers run from the last edge of the bounce */
+    edge(MS(100000), false);
+    edge(MS(100010), true);
+    edge(MS(100030), false);
+    run_until(MS(100030 + 59999));
+    TEST_ASSERT_EQUAL(0, take_events());
+    TEST_ASSERT_TRUE(s_p.present);
+    run_until(MS(100030 + 60000));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_LEAVE, take_events());
+    run_until(MS(100030 + 119999));
+    TEST_ASSERT_EQUAL(0, take_events());
+    run_until(MS(100030 + 120000));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_POWER_OFF, take_events());
+    TEST_ASSERT_TRUE(s_p.asleep);
+    TEST_ASSERT(presence_next(&s_p) == PRESENCE_NEVER);
+
+    /* Asleep nothing runs, a glitch does not wake, a held rise does */
+    const uint32_t runs = s_runs;
+    run_until(MS(1000000));
+    TEST_ASSERT_EQUAL(runs, s_runs);
+    edge(MS(1000000), true);
+    edge(MS(1000030), false);
+    run_until(MS(1000500));
+    TEST_ASSERT_EQUAL(0, take_events());
+    edge(MS(1001000), true);
+    run_until(MS(1001050));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_WAKE | PRESENCE_EVENT_ENTER, take_events());
+    TEST_ASSERT_FALSE(s_p.asleep);
+
+    /* Back within the hold time: no leave */
+    edge(MS(1100000), false);
+    edge(MS(1130000), true);
+    run_until(MS(1400000));
+    TEST_ASSERT_EQUAL(0, take_events());
+    TEST_ASSERT_TRUE(s_p.present);
+}
+
+static void test_enable_and_disable(void)
+{
+    setup(&s_config);
+    edge(0, true);
+    run_until(MS(1000));
+    take_events();
+
+    /* Disabled: leave at once, no power off, a rise only wakes */
+    edge(MS(10000), false);
+    s_events |= presence_set_enable(&s_p, false, MS(10001));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_LEAVE, take_events());
+    run_until(MS(600000));
+    TEST_ASSERT_EQUAL(0, take_events());
+    edge(MS(600000), true);
+    run_until(MS(600100));
+    TEST_ASSERT_EQUAL(0, take_events());
+    TEST_ASSERT_FALSE(s_p.present);
+    edge(MS(600200), false);
+
+    /* Enabling counts as a presence and starts the timers */
+    s_events |= presence_set_enable(&s_p, true, MS(700000));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_ENTER, take_events());
+    run_until(MS(760000));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_LEAVE, take_events());
+    run_until(MS(820000));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_POWER_OFF, take_events());
+
+    /* A pending edge is settled under the old setting */
+    edge(MS(900000), true);
+    s_events |= presence_set_enable(&s_p, false, MS(900050));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_WAKE | PRESENCE_EVENT_ENTER | PRESENCE_EVENT_LEAVE, take_events());
+}
+
+static void test_hold_longer_than_power_off(void)
+{
+    const presence_config_t config = {
+        .debounce_ms = 0,
+        .hold_ms = 200000,
+        .power_off_delay_ms = 100000,
+    };
+
+    /* Each timer fires at its own time, the box sleeps while still present */
+    setup(&config);
+    edge(0, true);
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_ENTER, take_events());
+    edge(MS(1000), false);
+    run_until(MS(101000));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_POWER_OFF, take_events());
+    TEST_ASSERT_TRUE(s_p.present);
+    run_until(MS(201000));
+    TEST_ASSERT_EQUAL(PRESENCE_EVENT_LEAVE, take_events());
+}
+
+typedef struct {
+    bool present;
+    bool asleep;
+    uint32_t enters;
+    uint32_t power_offs;
+} tracker_t;
+
+/* ENTER and LEAVE alternate, so do POWER_OFF and WAKE */
+static bool track(tracker_t *t, uint32_t events)
+{
+    if (events & PRESENCE_EVENT_WAKE) {
+        if (!t->asleep) {
+            return false;
+        }
+        t->asleep = false;
+    }
+    if (events & PRESENCE_EVENT_ENTER) {
+        if (t->present) {
+            return false;
+        }
+        t->present = true;
+        t->enters++;
+    }
+    if (events & PRESENCE_EVENT_LEAVE) {
+        if (!t->present) {
+            return false;
+        }
+        t->present = false;
+    }
+    if (events & PRESENCE_EVENT_POWER_OFF) {
+        if (t->asleep) {
+            return false;
+        }
+        t->asleep = true;
+        t->power_offs++;
+    }
+    return true;
+}
+
+static void test_random_edges_match_polling(void)
+{
+    const int64_t end_ms = 4 * 3600 * 1000;
+    presence_t polled;
+    tracker_t tracker = { 0 };
+    uint32_t seed = 1;
+    uint64_t edges = 0, polled_runs = 0;
+    int64_t next_edge_ms = 1000;
+    bool level = false;
+
+    setup(&s_config);
+    presence_init(&polled, &s_config, true, 0);
+    presence_input(&polled, false, 0);
+
+    for (int64_t t = 0; t < end_ms; t++) {
+        const int64_t now = MS(t);
+        uint32_t driven_events = 0;
+        uint32_t polled_events = presence_run(&polled, now);
+        polled_runs++;
+
+        /* The deadlines fall on whole milliseconds since edges and timers do */
+        while (presence_next(&s_p) <= now) {
+            const uint32_t events = presence_run(&s_p, presence_next(&s_p));
+            if (!track(&tracker, events)) {
+                HOST_TEST_FAIL("events 0x%" PRIx32 " out of order at %" PRId64 " ms", events, t);
+            }
+            driven_events |= events;
+            s_runs++;
+        }
+
+        if (t == next_edge_ms) {
+            const uint32_t pick = host_rand(&seed) % 100;
+            level = !level;
+            edges++;
+            if (pick < 60) {
+                /* A glitch or a bounce */
+                next_edge_ms = t + 1 + host_rand(&seed) % 49;
+            } else if (pick < 85) {
+                next_edge_ms = t + 50 + host_rand(&seed) % 5000;
+            } else {
+                next_edge_ms = t + 10000 + host_rand(&seed) % 190000;
+            }
+            const uint32_t events = presence_input(&s_p, level, now);
+            if (!track(&tracker, events)) {
+                HOST_TEST_FAIL("events 0x%" PRIx32 " out of order at %" PRId64 " ms", events, t);
+            }
+            driven_events |= events;
+            polled_events |= presence_input(&polled, level, now);
+
+            if (host_rand(&seed) % 200 == 0) {
+                const bool enable = !s_p.enabled;
+                const uint32_t toggled = presence_set_enable(&s_p, enable, now);
+                if (!track(&tracker, toggled)) {
+                    HOST_TEST_FAIL("events 0x%" PRIx32 " out of order at %" PRId64 " ms", toggled, t);
+                }
+                driven_events |= toggled;
+                polled_events |= presence_set_enable(&polled, enable, now);
+            }
+        }
+
+        if (driven_events != polled_events) {
+            HOST_TEST_FAIL("at %" PRId64 " ms: 0x%" PRIx32 " at the deadlines, 0x%" PRIx32 " polled", t,
+                           driven_events, polled_events);
+        }
+    }
+    printf("%" PRIu64 " edges in 4 h: %" PRIu32 " enters, %" PRIu32 " power offs, %" PRIu32
+           " runs at the deadlines against %" PRIu64 " polled\n", edges, tracker.enters, tracker.power_offs, s_runs,
+           polled_runs);
+    TEST_ASSERT(tracker.enters > 10 && tracker.power_offs > 2);
+    TEST_ASSERT(s_runs < edges);
+}
+
+int main(void)
+{
+    RUN_TEST(test_glitches_and_debounce);
+    RUN_TEST(test_bouncing_fall_sleep_and_wake);
+    RUN_TEST(test_enable_and_disable);
+    RUN_TEST(test_hold_longer_than_power_off);
+    RUN_TEST(test_random_edges_match_polling);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,399 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * sensor_hub against a simulated sensor bottom on a virtual clock, wired as
+ * the board does it: the humidity sensor on the bus, the radar behind it.
+ * The bottom is attached for ten minutes, unplugged, plugged back, then the
+ * periods, subscriptions and published values are checked, and last other
+ * threads use the hub while it runs.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "bsp_sensor_hub.h"
+
+#define SEC(s)          ((int64_t)(s) * 1000000)
+
+typedef struct {
+    bool plugged;
+    float temperature;
+    float radar;
+    uint32_t bus_ops;               /*!< Probes of either sensor and humidity reads, the radar read is a GPIO */
+    uint32_t attaches[BSP_SENSOR_MAX];
+} sim_bottom_t;
+
+typedef struct {
+    uint32_t count[BSP_SENSOR_MAX][BSP_SENSOR_EVENT_CHANGED + 1];
+    int64_t last_us[BSP_SENSOR_MAX][BSP_SENSOR_EVENT_CHANGED + 1];
+} sim_events_t;
+
+static sim_bottom_t s_bottom;
+static sim_events_t s_events;
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static sensor_hub_t s_hub;
+static int64_t s_now;
+static int64_t s_next;
+
+static esp_err_t sim_probe(void *ctx)
+{
+    s_bottom.bus_ops++;
+    return s_bottom.plugged ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t sim_attach(void *ctx)
+{
+    s_bottom.attaches[(intptr_t)ctx]++;
+    return ESP_OK;
+}
+
+static esp_err_t sim_read_humiture(void *ctx, float value[BSP_SENSOR_VALUE_NUM])
+{
+    s_bottom.bus_ops++;
+    if (!s_bottom.plugged) {
+        return ESP_FAIL;
+    }
+    value[0] = s_bottom.temperature;
+    value[1] = 40.0f;
+    return ESP_OK;
+}
+
+static esp_err_t sim_read_radar(void *ctx, float value[BSP_SENSOR_VALUE_NUM])
+{
+    value[0] = s_bottom.radar;
+    return ESP_OK;
+}
+
+static void sim_lock(void *arg)
+{
+    pthread_mutex_lock(arg);
+}
+
+static void sim_unlock(void *arg)
+{
+    pthread_mutex_unlock(arg);
+}
+
+static void on_event(bsp_sensor_id_t id, bsp_sensor_event_t event, const bsp_sensor_value_t *value, void *user_data)
+{
+    s_events.count[id][event]++;
+    s_events.last_us[id][event] = s_now;
+    if (event == BSP_SENSOR_EVENT_CHANGED && value->timestamp_us != s_now) {
+        printf("event of sensor %d stamped %" PRId64 " at %" PRId64 "\n", id, value->timestamp_us, s_now);
+        abort();
+    }
+}
+
+/* Run the hub at every deadline it asks for up to t_us, as the hub task does */
+static void run_until(int64_t t_us)
+{
+    while (s_next <= t_us) {
+        s_now = s_next;
+        s_next = sensor_hub_run(&s_hub, s_now);
+    }
+    s_now = t_us;
+}
+
+/* Hub and bottom as on the board: humidity every 2 s, radar every 1 s behind it */
+static void setup(void)
+{
+    const sensor_hub_config_t config = {
+        .lock = sim_lock,
+        .unlock = sim_unlock,
+        .lock_arg = &s_mutex,
+    };
+    const sensor_hub_desc_t humiture = {
+        .probe = sim_probe,
+        .attach = sim_attach,
+        .read = sim_read_humiture,
+        .ctx = (void *)BSP_SENSOR_HUMITURE,
+        .period_ms = 2000,
+        .probe_period_ms = 3000,
+        .threshold = 0.1f,
+        .max_failures = 3,
+        .parent = -1,
+    };
+    sensor_hub_desc_t radar = {
+        .probe = sim_probe,
+        .attach = sim_attach,
+        .read = sim_read_radar,
+        .ctx = (void *)BSP_SENSOR_RADAR,
+        .period_ms = 1000,
+        .probe_period_ms = 3000,
+        .threshold = 0.5f,
+        .max_failures = 1,
+        .parent = BSP_SENSOR_RADAR,
+    };
+
+    memset(&s_bottom, 0, sizeof(s_bottom));
+    memset(&s_events, 0, sizeof(s_events));
+    s_bottom.plugged = true;
+    s_bottom.temperature = 25.0f;
+    s_now = 0;
+    s_next = 0;
+
+    sensor_hub_init(&s_hub, &config);
+    /* A sensor can only be wired behind a lower id */
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sensor_hub_add(&s_hub, BSP_SENSOR_RADAR, &radar, 0));
+    radar.parent = BSP_SENSOR_HUMITURE;
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_add(&s_hub, BSP_SENSOR_HUMITURE, &humiture, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_add(&s_hub, BSP_SENSOR_RADAR, &radar, 0));
+    for (int id = 0; id < BSP_SENSOR_MAX; id++) {
+        TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_subscribe(&s_hub, id, on_event, NULL));
+    }
+}
+
+static void test_attached_bottom(void)
+{
+    bsp_sensor_value_t value;
+    bsp_sensor_stats_t stats;
+
+    setup();
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sensor_hub_get_value(&s_hub, BSP_SENSOR_HUMITURE, &value));
+
+    /* The first run attaches both sensors and reads them */
+    run_until(0);
+    for (int id = 0; id < BSP_SENSOR_MAX; id++) {
+        TEST_ASSERT_EQUAL(1, s_events.count[id][BSP_SENSOR_EVENT_ATTACHED]);
+        TEST_ASSERT_EQUAL(1, s_events.count[id][BSP_SENSOR_EVENT_CHANGED]);
+        TEST_ASSERT_TRUE(sensor_hub_is_present(&s_hub, id));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_get_value(&s_hub, BSP_SENSOR_HUMITURE, &value));
+    TEST_ASSERT(value.value[0] == 25.0f);
+
+    /* Ten minutes with the temperature drifting: no probes, one read per period */
+    for (int s = 1; s <= 600; s++) {
+        s_bottom.temperature = 25.0f + 0.003f * s;
+        run_until(SEC(s));
+    }
+    sensor_hub_get_stats(&s_hub, &stats);
+    printf("10 min: %" PRIu32 " bus operations (the 1 s poll made 1200), %" PRIu32 " wakeups, %" PRIu32
+           " temperature events\n", s_bottom.bus_ops, stats.wakeups, s_events.count[0][BSP_SENSOR_EVENT_CHANGED]);
+    TEST_ASSERT_EQUAL(2 + 301, s_bottom.bus_ops);
+    TEST_ASSERT_EQUAL(2, stats.probes);
+    TEST_ASSERT_EQUAL(0, stats.failures);
+    /* 1.8 degrees past a 0.1 threshold */
+    TEST_ASSERT_GREATER_OR_EQUAL(17, s_events.count[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_CHANGED]);
+    TEST_ASSERT_LESS_OR_EQUAL(20, s_events.count[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_CHANGED]);
+    TEST_ASSERT_EQUAL(1, s_events.count[BSP_SENSOR_RADAR][BSP_SENSOR_EVENT_CHANGED]);
+
+    /* The radar is noticed on its next read */
+    s_bottom.radar = 1;
+    run_until(SEC(601.5));
+    TEST_ASSERT_EQUAL(2, s_events.count[BSP_SENSOR_RADAR][BSP_SENSOR_EVENT_CHANGED]);
+    TEST_ASSERT_EQUAL(SEC(601), s_events.last_us[BSP_SENSOR_RADAR][BSP_SENSOR_EVENT_CHANGED]);
+}
+
+static void test_unplug_and_replug(void)
+{
+    bsp_sensor_value_t value;
+
+    setup();
+    run_until(SEC(100.5));
+
+    /* Three failed reads detach the humidity sensor, the radar goes with it */
+    uint32_t ops = s_bottom.bus_ops;
+    s_bottom.plugged = false;
+    run_until(SEC(200));
+    printf("unplugged at 100.5 s: detached at %.1f s, %" PRIu32 " bus operations in 99.5 s\n",
+           s_events.last_us[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_DETACHED] / 1e6, s_bottom.bus_ops - ops);
+    for (int id = 0; id < BSP_SENSOR_MAX; id++) {
+        TEST_ASSERT_EQUAL(1, s_events.count[id][BSP_SENSOR_EVENT_DETACHED]);
+        TEST_ASSERT_EQUAL(SEC(106), s_events.last_us[id][BSP_SENSOR_EVENT_DETACHED]);
+        TEST_ASSERT_FALSE(sensor_hub_is_present(&s_hub, id));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sensor_hub_get_value(&s_hub, BSP_SENSOR_HUMITURE, &value));
+    /* Three reads, then a probe every 3 s, the radar is not probed while the bottom is away */
+    TEST_ASSERT_EQUAL(3 + 31, s_bottom.bus_ops - ops);
+
+    /* Both come back on the next probe and are set up again */
+    s_bottom.plugged = true;
+    s_bottom.temperature = 30.0f;
+    run_until(SEC(210));
+    for (int id = 0; id < BSP_SENSOR_MAX; id++) {
+        TEST_ASSERT_EQUAL(2, s_events.count[id][BSP_SENSOR_EVENT_ATTACHED]);
+        TEST_ASSERT_EQUAL(2, s_bottom.attaches[id]);
+    }
+    TEST_ASSERT_EQUAL(s_events.last_us[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_ATTACHED],
+                      s_events.last_us[BSP_SENSOR_RADAR][BSP_SENSOR_EVENT_ATTACHED]);
+    TEST_ASSERT_LESS_OR_EQUAL(SEC(203), s_events.last_us[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_ATTACHED]);
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_get_value(&s_hub, BSP_SENSOR_HUMITURE, &value));
+    TEST_ASSERT(value.value[0] == 30.0f);
+}
+
+static void test_transient_failure(void)
+{
+    bsp_sensor_stats_t stats;
+
+    setup();
+    run_until(SEC(10));
+    /* One failed read is retried a period later and does not detach */
+    s_bottom.plugged = false;
+    run_until(SEC(12.5));
+    s_bottom.plugged = true;
+    run_until(SEC(30));
+    TEST_ASSERT_EQUAL(0, s_events.count[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_DETACHED]);
+    TEST_ASSERT_TRUE(sensor_hub_is_present(&s_hub, BSP_SENSOR_RADAR));
+    sensor_hub_get_stats(&s_hub, &stats);
+    TEST_ASSERT_EQUAL(1, stats.failures);
+}
+
+static void test_periods(void)
+{
+    setup();
+    run_until(SEC(10));
+
+    /* A shorter period takes effect at once */
+    uint32_t ops = s_bottom.bus_ops;
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_set_period(&s_hub, BSP_SENSOR_HUMITURE, 500, s_now));
+    s_next = s_now;
+    run_until(SEC(20));
+    TEST_ASSERT_EQUAL(20, s_bottom.bus_ops - ops);
+
+    /* Period 0 stops the reads and the hub has nothing left to do */
+    ops = s_bottom.bus_ops;
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_set_period(&s_hub, BSP_SENSOR_HUMITURE, 0, s_now));
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_set_period(&s_hub, BSP_SENSOR_RADAR, 0, s_now));
+    TEST_ASSERT(sensor_hub_run(&s_hub, s_now) == SENSOR_HUB_NEVER);
+    TEST_ASSERT_EQUAL(ops, s_bottom.bus_ops);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sensor_hub_set_period(&s_hub, BSP_SENSOR_MAX, 1000, s_now));
+}
+
+static void test_subscribers_and_publish(void)
+{
+    const float enter[BSP_SENSOR_VALUE_NUM] = { 1, 0 };
+
+    setup();
+    run_until(SEC(4));
+
+    /* Unsubscribed events are not delivered */
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_unsubscribe(&s_hub, BSP_SENSOR_HUMITURE, on_event, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, sensor_hub_unsubscribe(&s_hub, BSP_SENSOR_HUMITURE, on_event, NULL));
+    const uint32_t changes = s_events.count[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_CHANGED];
+    s_bottom.temperature = 50.0f;
+    run_until(SEC(8));
+    TEST_ASSERT_EQUAL(changes, s_events.count[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_CHANGED]);
+
+    /* One subscriber left, then the table is full */
+    for (int i = 0; i < SENSOR_HUB_MAX_SUBSCRIBERS - 1; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_subscribe(&s_hub, BSP_SENSOR_HUMITURE, on_event, (void *)(intptr_t)i));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, sensor_hub_subscribe(&s_hub, BSP_SENSOR_HUMITURE, on_event, NULL));
+
+    /* A published value goes through the threshold like a read one */
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_publish(&s_hub, BSP_SENSOR_RADAR, enter, s_now));
+    TEST_ASSERT_EQUAL(2, s_events.count[BSP_SENSOR_RADAR][BSP_SENSOR_EVENT_CHANGED]);
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_publish(&s_hub, BSP_SENSOR_RADAR, enter, s_now));
+    TEST_ASSERT_EQUAL(2, s_events.count[BSP_SENSOR_RADAR][BSP_SENSOR_EVENT_CHANGED]);
+    s_bottom.plugged = false;
+    run_until(SEC(30));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sensor_hub_publish(&s_hub, BSP_SENSOR_RADAR, enter, s_now));
+}
+
+typedef struct {
+    atomic_bool stop;
+    uint32_t calls;
+} caller_t;
+
+static void on_event_reentrant(bsp_sensor_id_t id, bsp_sensor_event_t event, const bsp_sensor_value_t *value,
+                               void *user_data)
+{
+    bsp_sensor_value_t latest;
+
+    /* Callbacks run without the lock, so they may call back into the hub */
+    sensor_hub_get_value(&s_hub, id, &latest);
+    sensor_hub_is_present(&s_hub, id);
+}
+
+static void *caller(void *arg)
+{
+    caller_t *c = arg;
+    uint32_t seed = 7;
+    bsp_sensor_value_t value;
+    bsp_sensor_stats_t stats;
+
+    while (!atomic_load(&c->stop)) {
+        const bsp_sensor_id_t id = host_rand(&seed) % BSP_SENSOR_MAX;
+        switch (host_rand(&seed) % 4) {
+        case 0:
+            sensor_hub_get_value(&s_hub, id, &value);
+            break;
+        case 1:
+            sensor_hub_set_period(&s_hub, id, 100 + host_rand(&seed) % 2000, 0);
+            break;
+        case 2:
+            if (sensor_hub_subscribe(&s_hub, id, on_event_reentrant, c) == ESP_OK) {
+                sensor_hub_unsubscribe(&s_hub, id, on_event_reentrant, c);
+            }
+            break;
+        default:
+            sensor_hub_get_stats(&s_hub, &stats);
+            break;
+        }
+        c->calls++;
+    }
+    return NULL;
+}
+
+static void *plugger(void *arg)
+{
+    caller_t *c = arg;
+    uint32_t seed = 9;
+
+    while (!atomic_load(&c->stop)) {
+        const float level[BSP_SENSOR_VALUE_NUM] = { host_rand(&seed) % 2, 0 };
+        sensor_hub_publish(&s_hub, BSP_SENSOR_RADAR, level, 0);
+        c->calls++;
+    }
+    return NULL;
+}
+
+static void test_other_threads(void)
+{
+    caller_t callers[2] = { 0 };
+    pthread_t threads[2];
+    bsp_sensor_stats_t stats;
+
+    setup();
+    /* The radar is published from another thread, only the hub thread counts events */
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_unsubscribe(&s_hub, BSP_SENSOR_RADAR, on_event, NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_hub_subscribe(&s_hub, BSP_SENSOR_RADAR, on_event_reentrant, NULL));
+    pthread_create(&threads[0], NULL, caller, &callers[0]);
+    pthread_create(&threads[1], NULL, plugger, &callers[1]);
+    /* An hour of hub time, the bottom away one minute in five */
+    for (s_now = 0; s_now < SEC(3600); s_now += 100000) {
+        s_bottom.plugged = (s_now / SEC(60)) % 5 != 4;
+        s_bottom.temperature = 20.0f + (s_now / SEC(1)) % 10;
+        sensor_hub_run(&s_hub, s_now);
+    }
+    atomic_store(&callers[0].stop, true);
+    atomic_store(&callers[1].stop, true);
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+
+    sensor_hub_get_stats(&s_hub, &stats);
+    printf("%" PRIu32 " + %" PRIu32 " calls from other threads, %" PRIu32 " reads, %" PRIu32 " probes\n",
+           callers[0].calls, callers[1].calls, stats.reads, stats.probes);
+    TEST_ASSERT_EQUAL(36000, stats.wakeups);
+    TEST_ASSERT(stats.reads > 0 && stats.probes > 2);
+    /* Twelve times away and back, whatever periods the other thread set */
+    TEST_ASSERT_EQUAL(12, s_events.count[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_DETACHED]);
+    TEST_ASSERT_EQUAL(12, s_events.count[BSP_SENSOR_HUMITURE][BSP_SENSOR_EVENT_ATTACHED]);
+}
+
+int main(void)
+{
+    RUN_TEST(test_attached_bottom);
+    RUN_TEST(test_unplug_and_replug);
+    RUN_TEST(test_transient_failure);
+    RUN_TEST(test_periods);
+    RUN_TEST(test_subscribers_and_publish);
+    RUN_TEST(test_other_threads);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,136 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/**
+ * Test audio for the headset benches. The built-in clip is synthesised so
+ * that every host gets the same samples: a chord that changes every half
+ * second, a kick on every beat and a noise hat on the off-beats. A raw
+ * 16-bit little-endian mono recording can be used instead.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static inline float host_audio_noise(size_t i)
+{
+    uint32_t x = (uint32_t)i * 2654435761u;
+    x ^= x >> 15;
+    x *= 2246822519u;
+    x ^= x >> 13;
+    return (float)(x & 0xFFFF) / 32768.0f - 1.0f;
+}
+
+/**
+ * @brief Sample `index` of the built-in music clip
+ */
+static inline int16_t host_audio_music_sample(size_t index, uint32_t rate)
+{
+    static const float chord[4][3] = {
+        { 220.00f, 277.18f, 329.63f },
+        { 196.00f, 246.94f, 293.66f },
+        { 174.61f, 220.00f, 261.63f },
+        { 164.81f, 207.65f, 246.94f },
+    };
+    const float t = (float)index / rate;
+    const int bar = (int)(t * 2) & 3;
+    const float beat = fmodf(t, 0.5f);
+    const float off = fmodf(t + 0.25f, 0.5f);
+    float v = 0;
+
+    for (int i = 0; i < 3; i++) {
+        /* A few harmonics per note so the spectrum is not just three lines */
+        for (int h = 1; h <= 4; h++) {
+            v += 0.08f / h * sinf(2 * (float)M_PI * chord[bar][i] * h * t);
+        }
+    }
+    v += 0.35f * expf(-beat * 30) * sinf(2 * (float)M_PI * (60 + 80 * expf(-beat * 40)) * beat);
+    v += 0.06f * expf(-off * 80) * host_audio_noise(index);
+    return (int16_t)lrintf(v * 32767 * 0.8f);
+}
+
+/**
+ * @brief Fill `count` samples of the built-in clip starting at `offset`
+ */
+static inline void host_audio_music(int16_t *out, size_t count, uint32_t rate, size_t offset)
+{
+    for (size_t i = 0; i < count; i++) {
+        out[i] = host_audio_music_sample(offset + i, rate);
+    }
+}
+
+/**
+ * @brief Read a raw s16le mono recording
+ *
+ * @return malloc'd samples, NULL if the file cannot be read
+ */
+static inline int16_t *host_audio_load(const char *path, size_t *count)
+{
+    FILE *f = fopen(path, "rb");
+    int16_t *samples = NULL;
+    long size;
+
+    if (f == NULL) {
+        return NULL;
+    }
+    if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0) {
+        samples = malloc(size);
+        *count = samples ? fread(samples, sizeof(int16_t), size / sizeof(int16_t), f) : 0;
+    }
+    fclose(f);
+    return samples;
+}
+
+/**
+ * @brief Read the first channel of a 16-bit PCM WAV file, such as the prompts in the examples' spiffs
+ *
+ * @return malloc'd samples, NULL if the file cannot be read or is not 16-bit PCM
+ */
+static inline int16_t *host_audio_load_wav(const char *path, size_t *count, uint32_t *rate)
+{
+    size_t bytes = 0;
+    uint8_t *file = (uint8_t *)host_audio_load(path, &bytes);
+    int16_t *samples = NULL;
+    uint16_t channels = 0, bits = 0;
+
+    bytes *= sizeof(int16_t);
+    if (file == NULL || bytes < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0) {
+        free(file);
+        return NULL;
+    }
+    /* Walk the chunks: fmt gives the layout, data the samples */
+    for (size_t pos = 12; pos + 8 <= bytes;) {
+        const uint8_t *chunk = file + pos;
+        const size_t len = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (size_t)chunk[7] << 24;
+        const size_t avail = len < bytes - pos - 8 ? len : bytes - pos - 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && avail >= 16) {
+            channels = chunk[10] | chunk[11] << 8;
+            *rate = chunk[12] | chunk[13] << 8 | chunk[14] << 16 | (uint32_t)chunk[15] << 24;
+            bits = chunk[22] | chunk[23] << 8;
+        } else if (memcmp(chunk, "data", 4) == 0 && channels && bits == 16) {
+            *count = avail / (2 * channels);
+            samples = malloc(*count * sizeof(int16_t) + 1);
+            for (size_t i = 0; samples && i < *count; i++) {
+                const uint8_t *frame = chunk + 8 + i * 2 * channels;
+                samples[i] = (int16_t)(frame[0] | frame[1] << 8);
+            }
+            break;
+        }
+        pos += 8 + len + (len & 1);
+    }
+    free(file);
+    return samples;
+}
@@ -0,0 +1,134 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/**
+ * A few Unity-style assertions for the host tests. A failed assertion
+ * returns from the test function, RUN_TEST reports it and HOST_TEST_END
+ * turns the failures into the exit code ctest looks at.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static int host_test_failed __attribute__((unused));
+static int host_test_failures __attribute__((unused));
+static const char *host_test_name __attribute__((unused)) = "";
+
+#define HOST_TEST_FAIL(format, ...) do {                                        \
+        fprintf(stderr, "%s:%d:%s: " format "\n", __FILE__, __LINE__, host_test_name, ##__VA_ARGS__); \
+        host_test_failed = 1;                                                   \
+        return;                                                                 \
+    } while (0)
+
+#define TEST_ASSERT_MESSAGE(cond, message) do {                                 \
+        if (!(cond)) {                                                          \
+            HOST_TEST_FAIL("%s: %s", #cond, message);                           \
+        }                                                                       \
+    } while (0)
+
+#define TEST_ASSERT(cond)           TEST_ASSERT_MESSAGE(cond, "expected true")
+#define TEST_ASSERT_TRUE(cond)      TEST_ASSERT_MESSAGE(cond, "expected true")
+#define TEST_ASSERT_FALSE(cond)     TEST_ASSERT_MESSAGE(!(cond), "expected false")
+#define TEST_ASSERT_NOT_NULL(ptr)   TEST_ASSERT_MESSAGE((ptr) != NULL, "expected non-NULL")
+#define TEST_ASSERT_NULL(ptr)       TEST_ASSERT_MESSAGE((ptr) == NULL, "expected NULL")
+
+#define TEST_ASSERT_EQUAL(expected, actual) do {                                \
+        const long long e_ = (long long)(expected), a_ = (long long)(actual);   \
+        if (e_ != a_) {                                                         \
+            HOST_TEST_FAIL("%s: expected %lld, got %lld", #actual, e_, a_);     \
+        }                                                                       \
+    } while (0)
+
+#define TEST_ASSERT_INT_WITHIN(delta, expected, actual) do {                    \
+        const long long e_ = (long long)(expected), a_ = (long long)(actual);   \
+        if (llabs(e_ - a_) > (long long)(delta)) {                              \
+            HOST_TEST_FAIL("%s: expected %lld +/- %lld, got %lld", #actual, e_, (long long)(delta), a_); \
+        }                                                                       \
+    } while (0)
+
+#define TEST_ASSERT_FLOAT_WITHIN(delta, expected, actual) do {                  \
+        const double e_ = (double)(expected), a_ = (double)(actual);            \
+        if (!(fabs(e_ - a_) <= (double)(delta))) {                              \
+            HOST_TEST_FAIL("%s: expected %g +/- %g, got %g", #actual, e_, (double)(delta), a_); \
+        }                                                                       \
+    } while (0)
+
+#define TEST_ASSERT_LESS_OR_EQUAL(limit, actual) do {                           \
+        const long long l_ = (long long)(limit), a_ = (long long)(actual);      \
+        if (a_ > l_) {                                                          \
+            HOST_TEST_FAIL("%s: expected <= %lld, got %lld", #actual, l_, a_);  \
+        }                                                                       \
+    } while (0)
+
+#define TEST_ASSERT_GREATER_OR_EQUAL(limit, actual) do {                        \
+        const long long l_ = (long long)(limit), a_ = (long long)(actual);      \
+        if (a_ < l_) {                                                          \
+            HOST_TEST_FAIL("%s: expected >= %lld, got %lld", #actual, l_, a_);  \
+        }                                                                       \
+    } while (0)
+
+#define RUN_TEST(fn) do {                                                       \
+        host_test_name = #fn;                                                   \
+        host_test_failed = 0;                                                   \
+        fn();                                                                   \
+        printf("%s: %s\n", #fn, host_test_failed ? "FAIL" : "PASS");            \
+        host_test_failures += host_test_failed;                                 \
+    } while (0)
+
+#define HOST_TEST_END() (host_test_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+/**
+ * @brief Monotonic wall time in nanoseconds
+ */
+static inline int64_t host_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief CPU time of the calling thread in nanoseconds
+ */
+static inline int64_t host_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Repetitions for a benchmark, the first argument overrides the default
+ *
+ * ctest runs the benchmarks with a small count so that they only prove they
+ * still work, run them by hand for numbers.
+ */
+static inline int host_bench_iterations(int argc, char **argv, int fallback)
+{
+    if (argc > 1 && atoi(argv[1]) > 0) {
+        return atoi(argv[1]);
+    }
+    return fallback;
+}
+
+/**
+ * @brief xorshift32, the same sequence on every host
+ */
+static inline uint32_t host_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
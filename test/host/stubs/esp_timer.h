@@ -0,0 +1,29 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Microseconds on CLOCK_MONOTONIC, or on the mock clock once host_timer_set_mock() was called
+ */
+int64_t esp_timer_get_time(void);
+
+/**
+ * @brief Drive esp_timer_get_time() from a variable instead of the system clock
+ *
+ * @param now_us: Mock clock, NULL to go back to CLOCK_MONOTONIC
+ */
+void host_timer_set_mock(const int64_t *now_us);
+
+#ifdef __cplusplus
+}
+#endif
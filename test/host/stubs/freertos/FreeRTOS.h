@@ -0,0 +1,55 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One tick is one millisecond, as with CONFIG_FREERTOS_HZ=1000 */
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdFAIL                  pdFALSE
+#define pdPASS                  pdTRUE
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS      ((TickType_t)1)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks)    ((uint32_t)(ticks))
+#define configTICK_RATE_HZ      (1000)
+
+#define portYIELD_FROM_ISR(x)   do { (void)(x); } while (0)
+
+/* Critical sections are one process-wide recursive lock */
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portMUX_INITIALIZE(mux)         do { (mux)->unused = 0; } while (0)
+
+void host_critical_enter(void);
+void host_critical_exit(void);
+
+#define portENTER_CRITICAL(mux)         ((void)(mux), host_critical_enter())
+#define portEXIT_CRITICAL(mux)          ((void)(mux), host_critical_exit())
+#define portENTER_CRITICAL_ISR(mux)     ((void)(mux), host_critical_enter())
+#define portEXIT_CRITICAL_ISR(mux)      ((void)(mux), host_critical_exit())
+#define taskENTER_CRITICAL(mux)         ((void)(mux), host_critical_enter())
+#define taskEXIT_CRITICAL(mux)          ((void)(mux), host_critical_exit())
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,28 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_stream_buffer *StreamBufferHandle_t;
+
+StreamBufferHandle_t xStreamBufferCreate(size_t size, size_t trigger_level);
+void vStreamBufferDelete(StreamBufferHandle_t sb);
+size_t xStreamBufferSend(StreamBufferHandle_t sb, const void *data, size_t len, TickType_t ticks_to_wait);
+size_t xStreamBufferReceive(StreamBufferHandle_t sb, void *data, size_t len, TickType_t ticks_to_wait);
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t sb);
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t sb);
+BaseType_t xStreamBufferSetTriggerLevel(StreamBufferHandle_t sb, size_t trigger_level);
+BaseType_t xStreamBufferIsEmpty(StreamBufferHandle_t sb);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,516 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * FreeRTOS, esp_timer, heap_caps and esp_err on top of pthreads and the C
+ * library. Every blocking object waits on one process-wide condition, which
+ * is slow but keeps the wake-up rules trivially correct.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+
+struct host_task {
+    TaskFunction_t fn;
+    void *arg;
+    uint32_t notify;
+    struct host_task *next;         /* Every task ever created, see s_tasks */
+};
+
+struct host_semaphore {
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+struct host_stream_buffer {
+    uint8_t *data;
+    size_t size;
+    size_t head;
+    size_t used;
+    size_t trigger;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t s_critical;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+static __thread struct host_task *s_self;
+/* Task handles are never freed, late notifications may still use them; listed so they are not leaks */
+static struct host_task *s_tasks;
+static const int64_t *s_mock_now;
+static uint32_t s_heap_allocs;
+static uint32_t s_heap_frees;
+
+/* esp_err */
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+void esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *expression)
+{
+    fprintf(stderr, "ESP_ERROR_CHECK failed: %s at %s:%d\n%s\n", esp_err_to_name(rc), file, line, expression);
+    abort();
+}
+
+/* esp_timer */
+
+static int64_t host_monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return s_mock_now ? *s_mock_now : host_monotonic_us();
+}
+
+void host_timer_set_mock(const int64_t *now_us)
+{
+    s_mock_now = now_us;
+}
+
+/* heap_caps */
+
+static void *host_heap_count(void *ptr)
+{
+    if (ptr) {
+        __atomic_fetch_add(&s_heap_allocs, 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return host_heap_count(malloc(size));
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    return host_heap_count(calloc(n, size));
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    return realloc(ptr, size);
+}
+
+void *heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps)
+{
+    void *ptr = NULL;
+    if (alignment < sizeof(void *)) {
+        alignment = sizeof(void *);
+    }
+    if (posix_memalign(&ptr, alignment, size ? size : 1) != 0) {
+        return NULL;
+    }
+    return host_heap_count(ptr);
+}
+
+void *heap_caps_aligned_calloc(size_t alignment, size_t n, size_t size, uint32_t caps)
+{
+    void *ptr = heap_caps_aligned_alloc(alignment, n * size, caps);
+    if (ptr) {
+        memset(ptr, 0, n * size);
+    }
+    return ptr;
+}
+
+void *heap_caps_calloc_prefer(size_t n, size_t size, size_t num, ...)
+{
+    return host_heap_count(calloc(n, size));
+}
+
+void heap_caps_free(void *ptr)
+{
+    if (ptr) {
+        __atomic_fetch_add(&s_heap_frees, 1, __ATOMIC_RELAXED);
+    }
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return (size_t)8 << 20;
+}
+
+void host_heap_caps_get_stats(host_heap_caps_stats_t *stats)
+{
+    stats->allocs = __atomic_load_n(&s_heap_allocs, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&s_heap_frees, __ATOMIC_RELAXED);
+}
+
+/* Critical sections */
+
+static void host_critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void host_critical_enter(void)
+{
+    pthread_once(&s_critical_once, host_critical_init);
+    pthread_mutex_lock(&s_critical);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+/* Blocking helpers, called with s_lock held */
+
+static void host_deadline(TickType_t ticks, struct timespec *ts)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Wait for any change, false once the deadline passed */
+static bool host_wait(TickType_t ticks, const struct timespec *deadline)
+{
+    if (ticks == 0) {
+        return false;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(&s_cond, &s_lock);
+        return true;
+    }
+    return pthread_cond_timedwait(&s_cond, &s_lock, deadline) != ETIMEDOUT;
+}
+
+/* Tasks */
+
+static void *host_task_entry(void *arg)
+{
+    s_self = arg;
+    s_self->fn(s_self->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *ret_task, BaseType_t core)
+{
+    pthread_t thread;
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    pthread_mutex_lock(&s_lock);
+    task->next = s_tasks;
+    s_tasks = task;
+    pthread_mutex_unlock(&s_lock);
+    /* Published before the thread runs, the task may look itself up at once */
+    if (ret_task) {
+        *ret_task = task;
+    }
+    if (pthread_create(&thread, NULL, host_task_entry, task) != 0) {
+        /* Left on the list, the caller may already hold the handle */
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *ret_task)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, ret_task, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    /* Only self-deletion is used, the handle stays valid for late notifications */
+    if (task == NULL || task == s_self) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec = ticks / 1000,
+        .tv_nsec = (long)(ticks % 1000) * 1000000L,
+    };
+    nanosleep(&ts, NULL);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    /* Blocking waits run on the real clock even when esp_timer is mocked */
+    return (TickType_t)(host_monotonic_us() / 1000);
+}
+
+/* The test's main thread gets a task on first use, so it can take notifications too */
+static struct host_task *host_self(void)
+{
+    if (s_self == NULL) {
+        s_self = calloc(1, sizeof(struct host_task));
+    }
+    return s_self;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return host_self();
+}
+
+void vTaskSetTimeOutState(TimeOut_t *timeout)
+{
+    timeout->start = xTaskGetTickCount();
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *timeout, TickType_t *ticks_to_wait)
+{
+    if (*ticks_to_wait == portMAX_DELAY) {
+        return pdFALSE;
+    }
+    const TickType_t now = xTaskGetTickCount();
+    const TickType_t elapsed = now - timeout->start;
+    if (elapsed < *ticks_to_wait) {
+        *ticks_to_wait -= elapsed;
+        timeout->start = now;
+        return pdFALSE;
+    }
+    *ticks_to_wait = 0;
+    return pdTRUE;
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&s_lock);
+    task->notify++;
+    pthread_cond_broadcast(&s_cond);
+    pthread_mutex_unlock(&s_lock);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken) {
+        *woken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks_to_wait)
+{
+    struct host_task *self = host_self();
+    struct timespec deadline;
+    uint32_t value;
+
+    host_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&s_lock);
+    while (self->notify == 0 && host_wait(ticks_to_wait, &deadline)) {
+    }
+    value = self->notify;
+    if (value) {
+        self->notify = clear ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return value;
+}
+
+/* Semaphores, a mutex is a binary semaphore that starts given */
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    struct host_semaphore *sem = calloc(1, sizeof(struct host_semaphore));
+    if (sem) {
+        sem->max = max;
+        sem->count = initial;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    free(sem);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    BaseType_t taken = pdFALSE;
+
+    host_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&s_lock);
+    while (sem->count == 0 && host_wait(ticks_to_wait, &deadline)) {
+    }
+    if (sem->count) {
+        sem->count--;
+        taken = pdTRUE;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t given = pdFALSE;
+
+    pthread_mutex_lock(&s_lock);
+    if (sem->count < sem->max) {
+        sem->count++;
+        given = pdTRUE;
+        pthread_cond_broadcast(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return given;
+}
+
+/* Stream buffers */
+
+StreamBufferHandle_t xStreamBufferCreate(size_t size, size_t trigger_level)
+{
+    struct host_stream_buffer *sb = calloc(1, sizeof(struct host_stream_buffer));
+    if (sb == NULL) {
+        return NULL;
+    }
+    sb->data = malloc(size);
+    if (sb->data == NULL) {
+        free(sb);
+        return NULL;
+    }
+    sb->size = size;
+    sb->trigger = trigger_level ? trigger_level : 1;
+    return sb;
+}
+
+void vStreamBufferDelete(StreamBufferHandle_t sb)
+{
+    if (sb) {
+        free(sb->data);
+        free(sb);
+    }
+}
+
+size_t xStreamBufferSend(StreamBufferHandle_t sb, const void *data, size_t len, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    const size_t want = len < sb->size ? len : sb->size;
+    size_t n;
+
+    host_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&s_lock);
+    while (sb->size - sb->used < want && host_wait(ticks_to_wait, &deadline)) {
+    }
+    n = sb->size - sb->used;
+    if (n > len) {
+        n = len;
+    }
+    for (size_t i = 0; i < n; i++) {
+        sb->data[(sb->head + sb->used + i) % sb->size] = ((const uint8_t *)data)[i];
+    }
+    sb->used += n;
+    if (n) {
+        pthread_cond_broadcast(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+size_t xStreamBufferReceive(StreamBufferHandle_t sb, void *data, size_t len, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    const size_t want = sb->trigger < len ? sb->trigger : len;
+    size_t n;
+
+    host_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&s_lock);
+    while (sb->used < want && host_wait(ticks_to_wait, &deadline)) {
+    }
+    n = sb->used < len ? sb->used : len;
+    for (size_t i = 0; i < n; i++) {
+        ((uint8_t *)data)[i] = sb->data[(sb->head + i) % sb->size];
+    }
+    sb->head = (sb->head + n) % sb->size;
+    sb->used -= n;
+    if (n) {
+        pthread_cond_broadcast(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t sb)
+{
+    pthread_mutex_lock(&s_lock);
+    const size_t n = sb->size - sb->used;
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t sb)
+{
+    pthread_mutex_lock(&s_lock);
+    const size_t n = sb->used;
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+BaseType_t xStreamBufferSetTriggerLevel(StreamBufferHandle_t sb, size_t trigger_level)
+{
+    if (trigger_level > sb->size) {
+        return pdFALSE;
+    }
+    pthread_mutex_lock(&s_lock);
+    sb->trigger = trigger_level ? trigger_level : 1;
+    pthread_mutex_unlock(&s_lock);
+    return pdTRUE;
+}
+
+BaseType_t xStreamBufferIsEmpty(StreamBufferHandle_t sb)
+{
+    return xStreamBufferBytesAvailable(sb) == 0 ? pdTRUE : pdFALSE;
+}
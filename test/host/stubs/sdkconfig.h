@@ -0,0 +1,11 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/* The host build is the linux target: portable code paths, no SPIRAM */
+#define CONFIG_IDF_TARGET_LINUX     1
+#define CONFIG_FREERTOS_HZ          1000
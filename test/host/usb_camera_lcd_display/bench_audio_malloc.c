@@ -0,0 +1,90 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Time per allocation and free of audio_calloc against the C library,
+ * for the pattern of a codec frame: a handful of buffers of the same
+ * sizes, allocated and freed every frame, plus a few random sizes. The
+ * pool column shows what the pools had to carve for it.
+ *
+ * usage: bench_audio_malloc [frames]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "audio_malloc.h"
+
+#define BUFFERS     (8)
+
+/* Decoder state, frame and scratch buffers of an AAC-like decoder */
+static const size_t frame_sizes[BUFFERS] = { 24, 96, 512, 1024, 2048, 4096, 6144, 16384 };
+
+typedef void *(*alloc_fn_t)(size_t n, size_t size);
+
+static int64_t run(alloc_fn_t alloc_fn, void (*free_fn)(void *), int frames, size_t *checksum)
+{
+    void *blocks[BUFFERS + 2];
+    uint32_t seed = 23;
+
+    const int64_t start = host_cpu_ns();
+    for (int f = 0; f < frames; f++) {
+        for (int i = 0; i < BUFFERS; i++) {
+            blocks[i] = alloc_fn(1, frame_sizes[i]);
+        }
+        blocks[BUFFERS] = alloc_fn(1, 1 + host_rand(&seed) % 4096);
+        blocks[BUFFERS + 1] = alloc_fn(4, 1 + host_rand(&seed) % 1024);
+        for (int i = 0; i < BUFFERS + 2; i++) {
+            if (blocks[i] == NULL) {
+                return -1;
+            }
+            *checksum += *(uint8_t *)blocks[i];
+        }
+        for (int i = BUFFERS + 1; i >= 0; i--) {
+            free_fn(blocks[i]);
+        }
+    }
+    return host_cpu_ns() - start;
+}
+
+int main(int argc, char **argv)
+{
+    const int frames = host_bench_iterations(argc, argv, 100000);
+    const int ops = frames * (BUFFERS + 2);
+    const audio_mem_config_t config = { .inner_size = 64 * 1024, .default_size = 256 * 1024 };
+    audio_mem_stats_t stats;
+    size_t checksum = 0;
+
+    printf("%d frames, %d buffers each\n", frames, BUFFERS + 2);
+    printf("%-20s %10s %12s %10s\n", "allocator", "ns/op", "pool bytes", "heap");
+
+    const int64_t libc_ns = run(calloc, free, frames, &checksum);
+    const int64_t heap_ns = run(audio_calloc, audio_free, frames, &checksum);
+    audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &stats);
+    printf("%-20s %10.1f %12s %10s\n", "calloc", (double)libc_ns / ops, "-", "-");
+    printf("%-20s %10.1f %12s %10" PRIu32 "\n", "audio_calloc, heap", (double)heap_ns / ops, "-", stats.heap_allocs);
+
+    if (audio_mem_init(&config) != ESP_OK) {
+        fprintf(stderr, "init failed\n");
+        return EXIT_FAILURE;
+    }
+    for (int p = 0; p < AUDIO_MEM_POOL_MAX; p++) {
+        const alloc_fn_t alloc_fn = (p == AUDIO_MEM_POOL_INNER) ? audio_calloc_inner : audio_calloc;
+        audio_mem_stats_t before;
+        audio_mem_get_stats(p, &before);
+        const int64_t ns = run(alloc_fn, audio_free, frames, &checksum);
+        audio_mem_get_stats(p, &stats);
+        if (ns < 0 || stats.live != before.live) {
+            fprintf(stderr, "pool %d: allocation failed or leaked\n", p);
+            return EXIT_FAILURE;
+        }
+        printf("%-20s %10.1f %12zu %10" PRIu32 "\n", (p == AUDIO_MEM_POOL_INNER) ? "audio_calloc_inner" : "audio_calloc, pool",
+               (double)ns / ops, stats.pool_carved, stats.heap_allocs - before.heap_allocs);
+    }
+    /* Every buffer came out zeroed */
+    return (libc_ns < 0 || heap_ns < 0 || checksum != 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
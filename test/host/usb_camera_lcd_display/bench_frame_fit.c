@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Time per frame of the fit to the 320x240 panel for the camera
+ * resolutions, in both modes and byte orders, with the kind of step the
+ * plan picked: a plain 1/2..1/8 box, or the box plus the exact-fit resample.
+ *
+ * usage: bench_frame_fit [frames per case]
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "frame_fit.h"
+
+#define PANEL_W     (320)
+#define PANEL_H     (240)
+#define MAX_W       (1280)
+#define MAX_H       (720)
+
+static const struct {
+    int w;
+    int h;
+} sizes[] = {
+    { 640, 480 },
+    { 680, 480 },
+    { 800, 600 },
+    { 1280, 720 },
+};
+
+static uint16_t frame[MAX_W * MAX_H];
+static uint16_t out[PANEL_W * PANEL_H];
+
+int main(int argc, char **argv)
+{
+    const int frames = host_bench_iterations(argc, argv, 200);
+    uint32_t seed = 7;
+
+    for (size_t i = 0; i < sizeof(frame) / sizeof(frame[0]); i++) {
+        frame[i] = (uint16_t)host_rand(&seed);
+    }
+    printf("%d frames per case\n", frames);
+    printf("%-10s %-10s %-3s %-8s %-8s %10s %8s\n", "frame", "mode", "bo", "step", "out", "us/frame", "fps");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (int mode = FRAME_FIT_CROP; mode <= FRAME_FIT_LETTERBOX; mode++) {
+            for (int big_endian = 0; big_endian <= 1; big_endian++) {
+                frame_fit_plan_t plan;
+                char size[16], fit[16];
+
+                if (frame_fit_plan(sizes[s].w, sizes[s].h, PANEL_W, PANEL_H, mode, &plan) != ESP_OK) {
+                    fprintf(stderr, "%dx%d: no plan\n", sizes[s].w, sizes[s].h);
+                    return EXIT_FAILURE;
+                }
+                const bool resample = plan.fit_width != plan.out_width || plan.fit_height != plan.out_height;
+                const int64_t start = host_cpu_ns();
+                for (int f = 0; f < frames; f++) {
+                    if (frame_fit_downscale_rgb565(frame, sizes[s].w, sizes[s].h, big_endian, &plan, out) != ESP_OK) {
+                        fprintf(stderr, "%dx%d: downscale failed\n", sizes[s].w, sizes[s].h);
+                        return EXIT_FAILURE;
+                    }
+                }
+                const double us = (double)(host_cpu_ns() - start) / frames / 1000.0;
+                snprintf(size, sizeof(size), "%dx%d", sizes[s].w, sizes[s].h);
+                snprintf(fit, sizeof(fit), "%dx%d", plan.fit_width, plan.fit_height);
+                printf("%-10s %-10s %-3s 1/%d%-5s %-8s %10.1f %8.0f\n", size,
+                       mode == FRAME_FIT_CROP ? "crop" : "letterbox", big_endian ? "BE" : "LE",
+                       1 << plan.shift, resample ? "+rs" : "", fit, us, 1e6 / us);
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
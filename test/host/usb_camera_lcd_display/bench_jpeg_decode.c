@@ -0,0 +1,107 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Frames per second and memory of jpeg_backend_soft through a jpeg_session
+ * for the usual UVC resolutions, on the generated MJPEG corpus in 4:2:2 at
+ * quality 80, into RGB565 at full size and scaled while decoding. Memory is
+ * what the decoder holds plus the session output buffer.
+ *
+ * usage: bench_jpeg_decode [decodes per frame of the corpus]
+ */
+
+#include <stdlib.h>
+
+#include "host_test.h"
+#include "jpeg_session.h"
+#include "mjpeg_corpus.h"
+
+#define CORPUS_FRAMES   (8)
+
+static const struct {
+    int width;
+    int height;
+} sizes[] = {
+    { 320, 240 },
+    { 640, 480 },
+    { 800, 600 },
+    { 1280, 720 },
+};
+
+/* The session default, target only, every session here names jpeg_backend_soft */
+const jpeg_backend_t jpeg_backend_esp = {
+    .name = "esp, not on the host",
+};
+
+int main(int argc, char **argv)
+{
+    const int repeats = host_bench_iterations(argc, argv, 30);
+    const size_t capacity = 1024 * 1024;
+    uint8_t *corpus[CORPUS_FRAMES];
+    size_t lens[CORPUS_FRAMES];
+
+    for (int f = 0; f < CORPUS_FRAMES; f++) {
+        corpus[f] = malloc(capacity);
+        if (corpus[f] == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
+    printf("%d frames in the corpus, each decoded %d times\n", CORPUS_FRAMES, repeats);
+    printf("%-10s %5s %9s %10s %8s %10s %10s\n", "frame", "scale", "KB/frame", "ms/frame", "fps", "decoder B", "output B");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const mjpeg_corpus_config_t config = MJPEG_CORPUS_DEFAULT_CONFIG(sizes[s].width, sizes[s].height);
+        size_t total = 0;
+        for (int f = 0; f < CORPUS_FRAMES; f++) {
+            lens[f] = mjpeg_corpus_frame(&config, f * 4, corpus[f], capacity);
+            if (lens[f] == 0) {
+                fprintf(stderr, "%dx%d: encoding failed\n", sizes[s].width, sizes[s].height);
+                return EXIT_FAILURE;
+            }
+            total += lens[f];
+        }
+        for (uint8_t shift = 0; shift <= 1; shift++) {
+            const jpeg_session_config_t session_config = {
+                .output_type = JPEG_RAW_TYPE_RGB565_LE,
+                .rotate = JPEG_ROTATE_0D,
+                .backend = &jpeg_backend_soft,
+            };
+            jpeg_session_handle_t session = NULL;
+            jpeg_session_frame_t frame;
+            jpeg_session_stats_t stats;
+            char size[16];
+
+            if (jpeg_session_create(&session_config, &session) != ESP_OK || jpeg_session_set_scale(session, shift) != ESP_OK) {
+                fprintf(stderr, "session failed\n");
+                return EXIT_FAILURE;
+            }
+            const int64_t start = host_cpu_ns();
+            for (int r = 0; r < repeats; r++) {
+                for (int f = 0; f < CORPUS_FRAMES; f++) {
+                    if (jpeg_session_decode(session, corpus[f], lens[f], &frame) != ESP_OK) {
+                        fprintf(stderr, "%dx%d frame %d: decode failed\n", sizes[s].width, sizes[s].height, f);
+                        return EXIT_FAILURE;
+                    }
+                }
+            }
+            const double ms = (host_cpu_ns() - start) / 1e6 / ((double)repeats * CORPUS_FRAMES);
+            jpeg_session_get_stats(session, &stats);
+            jpeg_session_delete(session);
+            /* Steady state: one open, one output buffer, nothing allocated per frame */
+            if (stats.reopens != 1 || stats.allocs_last_frame != 0) {
+                fprintf(stderr, "%dx%d: %" PRIu32 " reopens, %" PRIu32 " allocations in the last frame\n",
+                        sizes[s].width, sizes[s].height, stats.reopens, stats.allocs_last_frame);
+                return EXIT_FAILURE;
+            }
+            snprintf(size, sizeof(size), "%dx%d", sizes[s].width, sizes[s].height);
+            printf("%-10s %4s%d %9.1f %10.2f %8.1f %10zu %10zu\n", size, "1/", 1 << shift,
+                   total / 1024.0 / CORPUS_FRAMES, ms, 1000 / ms, stats.decoder_bytes, stats.out_bytes);
+        }
+    }
+    for (int f = 0; f < CORPUS_FRAMES; f++) {
+        free(corpus[f]);
+    }
+    return EXIT_SUCCESS;
+}
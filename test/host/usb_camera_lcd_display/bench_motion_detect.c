@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Time per frame of the motion detection for the panel and camera sizes
+ * and each reduction scale, on a still scene and with a moving object,
+ * which adds the box search.
+ *
+ * usage: bench_motion_detect [frames per case]
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "motion_detect.h"
+
+#define MAX_W       (640)
+#define MAX_H       (480)
+
+static const struct {
+    int w;
+    int h;
+} sizes[] = {
+    { 320, 240 },
+    { 640, 480 },
+};
+
+static const uint8_t scales[] = { 2, 4, 8 };
+
+static uint16_t still[MAX_W * MAX_H];
+static uint16_t moving[MAX_W * MAX_H];
+
+int main(int argc, char **argv)
+{
+    const int frames = host_bench_iterations(argc, argv, 200);
+    uint32_t seed = 17;
+
+    /* Noise on a flat grey, and the same with a bright square on it */
+    for (int i = 0; i < MAX_W * MAX_H; i++) {
+        const int level = 100 + (int)(host_rand(&seed) % 7) - 3;
+        still[i] = (uint16_t)(((level >> 3) << 11) | ((level >> 2) << 5) | (level >> 3));
+    }
+    printf("%d frames per case\n", frames);
+    printf("%-8s %5s %-7s %10s %8s\n", "frame", "scale", "scene", "us/frame", "fps");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const int w = sizes[s].w;
+        const int h = sizes[s].h;
+        memcpy(moving, still, sizeof(moving));
+        for (int y = h / 4; y < h / 2; y++) {
+            for (int x = w / 4; x < w / 2; x++) {
+                moving[y * w + x] = 0xffff;
+            }
+        }
+        for (size_t k = 0; k < sizeof(scales) / sizeof(scales[0]); k++) {
+            for (int with_motion = 0; with_motion <= 1; with_motion++) {
+                motion_detect_config_t config = MOTION_DETECT_DEFAULT_CONFIG();
+                motion_detect_handle_t motion = NULL;
+                motion_detect_stats_t stats;
+                char size[16];
+
+                config.scale = scales[k];
+                config.big_endian = false;
+                if (motion_detect_create(&config, &motion) != ESP_OK) {
+                    fprintf(stderr, "create failed\n");
+                    return EXIT_FAILURE;
+                }
+                /* Learn the still scene first, the timed frames alternate so the object keeps moving */
+                for (int f = 0; f < config.warmup_frames; f++) {
+                    motion_detect_process(motion, (const uint8_t *)still, w, h, NULL);
+                }
+                const int64_t start = host_cpu_ns();
+                for (int f = 0; f < frames; f++) {
+                    const uint16_t *frame = (with_motion && f % 2 == 0) ? moving : still;
+                    if (motion_detect_process(motion, (const uint8_t *)frame, w, h, NULL) != ESP_OK) {
+                        fprintf(stderr, "process failed\n");
+                        return EXIT_FAILURE;
+                    }
+                }
+                const double us = (double)(host_cpu_ns() - start) / frames / 1000.0;
+                motion_detect_get_stats(motion, &stats);
+                motion_detect_delete(motion);
+                if (with_motion ? stats.motion_frames == 0 : stats.motion_frames != 0) {
+                    fprintf(stderr, "%dx%d scale %d: %" PRIu32 " frames with motion\n", w, h, scales[k], stats.motion_frames);
+                    return EXIT_FAILURE;
+                }
+                snprintf(size, sizeof(size), "%dx%d", w, h);
+                printf("%-8s %5d %-7s %10.1f %8.0f\n", size, scales[k], with_motion ? "moving" : "still", us, 1e6 / us);
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,429 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mjpeg_corpus.h"
+
+/* Natural order of the zigzag index */
+static const uint8_t s_zigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+/* ITU T.81 annex K.1, natural order */
+static const uint8_t s_luma_qt[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99,
+};
+static const uint8_t s_chroma_qt[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+/* ITU T.81 annex K.3 */
+static const uint8_t s_dc_luma_bits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t s_dc_chroma_bits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t s_dc_symbols[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t s_ac_luma_bits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t s_ac_luma_symbols[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+static const uint8_t s_ac_chroma_bits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t s_ac_chroma_symbols[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t len[256];
+} huffman_t;
+
+typedef struct {
+    uint8_t *out;
+    size_t capacity;
+    size_t len;
+    uint32_t acc;
+    int count;
+    bool overflow;
+} writer_t;
+
+typedef struct {
+    uint8_t h;
+    uint8_t v;
+    uint8_t table;              /* 0 for luma, 1 for chroma */
+    int dc_pred;
+    const uint8_t *plane;       /* Full resolution, padded to whole MCUs */
+} component_t;
+
+static void put_byte(writer_t *w, uint8_t byte)
+{
+    if (w->len >= w->capacity) {
+        w->overflow = true;
+        return;
+    }
+    w->out[w->len++] = byte;
+}
+
+static void put_be16(writer_t *w, uint16_t value)
+{
+    put_byte(w, value >> 8);
+    put_byte(w, value & 0xFF);
+}
+
+static void put_bits(writer_t *w, uint32_t bits, int n)
+{
+    w->acc = (w->acc << n) | (bits & ((1u << n) - 1));
+    w->count += n;
+    while (w->count >= 8) {
+        const uint8_t byte = (w->acc >> (w->count - 8)) & 0xFF;
+        put_byte(w, byte);
+        if (byte == 0xFF) {
+            put_byte(w, 0);
+        }
+        w->count -= 8;
+    }
+}
+
+static void flush_bits(writer_t *w)
+{
+    /* Pad with ones up to the byte */
+    if (w->count > 0) {
+        put_bits(w, 0x7F, 8 - w->count);
+    }
+    w->acc = 0;
+}
+
+static void huffman_build(huffman_t *huff, const uint8_t bits[16], const uint8_t *symbols)
+{
+    uint16_t code = 0;
+    int k = 0;
+
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++, k++) {
+            huff->code[symbols[k]] = code++;
+            huff->len[symbols[k]] = len;
+        }
+        code <<= 1;
+    }
+}
+
+static void put_dht(writer_t *w, uint8_t class_id, const uint8_t bits[16], const uint8_t *symbols)
+{
+    int count = 0;
+    for (int i = 0; i < 16; i++) {
+        count += bits[i];
+    }
+    put_be16(w, 0xFFC4);
+    put_be16(w, 2 + 1 + 16 + count);
+    put_byte(w, class_id);
+    for (int i = 0; i < 16; i++) {
+        put_byte(w, bits[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        put_byte(w, symbols[i]);
+    }
+}
+
+static int magnitude_bits(int value)
+{
+    int n = 0;
+    for (int v = abs(value); v > 0; v >>= 1) {
+        n++;
+    }
+    return n;
+}
+
+static void forward_dct(const uint8_t *in, int stride, float out[64])
+{
+    static float cosines[8][8];
+    static bool ready;
+    float tmp[64];
+
+    if (!ready) {
+        for (int u = 0; u < 8; u++) {
+            for (int x = 0; x < 8; x++) {
+                cosines[u][x] = (u == 0 ? sqrtf(0.125f) : 0.5f) * cosf((2 * x + 1) * u * (float)M_PI / 16);
+            }
+        }
+        ready = true;
+    }
+    for (int y = 0; y < 8; y++) {
+        for (int u = 0; u < 8; u++) {
+            float sum = 0;
+            for (int x = 0; x < 8; x++) {
+                sum += (in[y * stride + x] - 128) * cosines[u][x];
+            }
+            tmp[y * 8 + u] = sum;
+        }
+    }
+    for (int u = 0; u < 8; u++) {
+        for (int v = 0; v < 8; v++) {
+            float sum = 0;
+            for (int y = 0; y < 8; y++) {
+                sum += tmp[y * 8 + u] * cosines[v][y];
+            }
+            out[v * 8 + u] = sum;
+        }
+    }
+}
+
+static void encode_block(writer_t *w, component_t *comp, const uint8_t *in, int stride, const uint8_t qt[64],
+                         const huffman_t *dc, const huffman_t *ac)
+{
+    float coef[64];
+    int zz[64];
+
+    forward_dct(in, stride, coef);
+    for (int i = 0; i < 64; i++) {
+        zz[i] = (int)lrintf(coef[s_zigzag[i]] / qt[s_zigzag[i]]);
+    }
+
+    const int diff = zz[0] - comp->dc_pred;
+    comp->dc_pred = zz[0];
+    int n = magnitude_bits(diff);
+    put_bits(w, dc->code[n], dc->len[n]);
+    put_bits(w, diff < 0 ? diff - 1 : diff, n);
+
+    int run = 0;
+    for (int i = 1; i < 64; i++) {
+        if (zz[i] == 0) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            put_bits(w, ac->code[0xF0], ac->len[0xF0]);
+            run -= 16;
+        }
+        n = magnitude_bits(zz[i]);
+        const uint8_t symbol = (run << 4) | n;
+        put_bits(w, ac->code[symbol], ac->len[symbol]);
+        put_bits(w, zz[i] < 0 ? zz[i] - 1 : zz[i], n);
+        run = 0;
+    }
+    if (run > 0) {
+        put_bits(w, ac->code[0x00], ac->len[0x00]);
+    }
+}
+
+static inline uint8_t clamp_u8(float v)
+{
+    return (v < 0) ? 0 : (v > 255) ? 255 : (uint8_t)lrintf(v);
+}
+
+void mjpeg_corpus_scene(int width, int height, int frame, uint8_t *rgb)
+{
+    const int cx = (frame * 7) % width;
+    const int cy = height / 2 + (int)(height / 5 * sinf(frame * 0.2f));
+    const int radius = height / 6 + 1;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t *px = rgb + ((size_t)y * width + x) * 3;
+            int r = x * 255 / width;
+            int g = y * 255 / height;
+            int b = 128 + (int)(60 * sinf((x + y + frame * 8) / 16.0f));
+            /* A patch of fine texture, the costly part to code */
+            if (x > width / 2 && y > height / 2) {
+                const int t = ((x / 2 + y / 2) & 1) ? 24 : -24;
+                r += t;
+                g += t;
+                b += t;
+            }
+            if ((x - cx) * (x - cx) + (y - cy) * (y - cy) < radius * radius) {
+                r = 240;
+                g = 220;
+                b = 40;
+            }
+            px[0] = clamp_u8(r);
+            px[1] = clamp_u8(g);
+            px[2] = clamp_u8(b);
+        }
+    }
+}
+
+size_t mjpeg_corpus_encode(const mjpeg_corpus_config_t *config, const uint8_t *rgb, uint8_t *out, size_t capacity)
+{
+    const int ncomp = config->grayscale ? 1 : 3;
+    const int hmax = config->grayscale ? 1 : config->h_samp;
+    const int vmax = config->grayscale ? 1 : config->v_samp;
+    const int mcu_w = 8 * hmax;
+    const int mcu_h = 8 * vmax;
+    const int mcus_x = (config->width + mcu_w - 1) / mcu_w;
+    const int mcus_y = (config->height + mcu_h - 1) / mcu_h;
+    const int pw = mcus_x * mcu_w;
+    const int ph = mcus_y * mcu_h;
+    const int quality = (config->quality < 1) ? 1 : (config->quality > 100) ? 100 : config->quality;
+    const int scale = (quality < 50) ? 5000 / quality : 200 - 2 * quality;
+    uint8_t qt[2][64];
+    huffman_t dc[2], ac[2];
+    writer_t w = { .out = out, .capacity = capacity };
+    component_t comp[3] = {
+        { .h = hmax, .v = vmax, .table = 0 },
+        { .h = 1, .v = 1, .table = 1 },
+        { .h = 1, .v = 1, .table = 1 },
+    };
+
+    /* Planes padded to whole MCUs by repeating the edges, chroma averaged over each MCU sample */
+    uint8_t *planes = malloc((size_t)pw * ph * 3);
+    if (planes == NULL) {
+        return 0;
+    }
+    for (int y = 0; y < ph; y++) {
+        for (int x = 0; x < pw; x++) {
+            const int sx = (x < config->width) ? x : config->width - 1;
+            const int sy = (y < config->height) ? y : config->height - 1;
+            const uint8_t *px = rgb + ((size_t)sy * config->width + sx) * 3;
+            const size_t i = (size_t)y * pw + x;
+            planes[i] = clamp_u8(0.299f * px[0] + 0.587f * px[1] + 0.114f * px[2]);
+            planes[(size_t)pw * ph + i] = clamp_u8(128 - 0.168736f * px[0] - 0.331264f * px[1] + 0.5f * px[2]);
+            planes[(size_t)pw * ph * 2 + i] = clamp_u8(128 + 0.5f * px[0] - 0.418688f * px[1] - 0.081312f * px[2]);
+        }
+    }
+    const int cw = pw / hmax;
+    const int ch = ph / vmax;
+    for (int c = 1; c < ncomp; c++) {
+        uint8_t *plane = planes + (size_t)pw * ph * c;
+        for (int y = 0; y < ch; y++) {
+            for (int x = 0; x < cw; x++) {
+                int sum = 0;
+                for (int dy = 0; dy < vmax; dy++) {
+                    for (int dx = 0; dx < hmax; dx++) {
+                        sum += plane[(size_t)(y * vmax + dy) * pw + x * hmax + dx];
+                    }
+                }
+                /* In place, the samples read are never before the one written */
+                plane[(size_t)y * cw + x] = (sum + hmax * vmax / 2) / (hmax * vmax);
+            }
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        comp[c].plane = planes + (size_t)pw * ph * c;
+    }
+
+    for (int i = 0; i < 64; i++) {
+        const int luma = (s_luma_qt[i] * scale + 50) / 100;
+        const int chroma = (s_chroma_qt[i] * scale + 50) / 100;
+        qt[0][i] = (luma < 1) ? 1 : (luma > 255) ? 255 : luma;
+        qt[1][i] = (chroma < 1) ? 1 : (chroma > 255) ? 255 : chroma;
+    }
+    huffman_build(&dc[0], s_dc_luma_bits, s_dc_symbols);
+    huffman_build(&dc[1], s_dc_chroma_bits, s_dc_symbols);
+    huffman_build(&ac[0], s_ac_luma_bits, s_ac_luma_symbols);
+    huffman_build(&ac[1], s_ac_chroma_bits, s_ac_chroma_symbols);
+
+    put_be16(&w, 0xFFD8);
+    for (int t = 0; t < (ncomp == 3 ? 2 : 1); t++) {
+        put_be16(&w, 0xFFDB);
+        put_be16(&w, 2 + 65);
+        put_byte(&w, t);
+        for (int i = 0; i < 64; i++) {
+            put_byte(&w, qt[t][s_zigzag[i]]);
+        }
+    }
+    put_be16(&w, 0xFFC0);
+    put_be16(&w, 8 + 3 * ncomp);
+    put_byte(&w, 8);
+    put_be16(&w, config->height);
+    put_be16(&w, config->width);
+    put_byte(&w, ncomp);
+    for (int c = 0; c < ncomp; c++) {
+        put_byte(&w, c + 1);
+        put_byte(&w, (comp[c].h << 4) | comp[c].v);
+        put_byte(&w, comp[c].table);
+    }
+    if (!config->omit_dht) {
+        put_dht(&w, 0x00, s_dc_luma_bits, s_dc_symbols);
+        put_dht(&w, 0x10, s_ac_luma_bits, s_ac_luma_symbols);
+        if (ncomp == 3) {
+            put_dht(&w, 0x01, s_dc_chroma_bits, s_dc_symbols);
+            put_dht(&w, 0x11, s_ac_chroma_bits, s_ac_chroma_symbols);
+        }
+    }
+    if (config->restart_interval != 0) {
+        put_be16(&w, 0xFFDD);
+        put_be16(&w, 4);
+        put_be16(&w, config->restart_interval);
+    }
+    put_be16(&w, 0xFFDA);
+    put_be16(&w, 6 + 2 * ncomp);
+    put_byte(&w, ncomp);
+    for (int c = 0; c < ncomp; c++) {
+        put_byte(&w, c + 1);
+        put_byte(&w, (comp[c].table << 4) | comp[c].table);
+    }
+    put_byte(&w, 0);
+    put_byte(&w, 63);
+    put_byte(&w, 0);
+
+    int mcu = 0;
+    for (int my = 0; my < mcus_y; my++) {
+        for (int mx = 0; mx < mcus_x; mx++, mcu++) {
+            if (config->restart_interval != 0 && mcu > 0 && mcu % config->restart_interval == 0) {
+                flush_bits(&w);
+                put_be16(&w, 0xFFD0 + (mcu / config->restart_interval - 1) % 8);
+                for (int c = 0; c < ncomp; c++) {
+                    comp[c].dc_pred = 0;
+                }
+            }
+            for (int c = 0; c < ncomp; c++) {
+                const int stride = (c == 0) ? pw : cw;
+                const int t = comp[c].table;
+                for (int by = 0; by < comp[c].v; by++) {
+                    for (int bx = 0; bx < comp[c].h; bx++) {
+                        const int x = (mx * comp[c].h + bx) * 8;
+                        const int y = (my * comp[c].v + by) * 8;
+                        encode_block(&w, &comp[c], comp[c].plane + (size_t)y * stride + x, stride, qt[t], &dc[t], &ac[t]);
+                    }
+                }
+            }
+        }
+    }
+    flush_bits(&w);
+    put_be16(&w, 0xFFD9);
+    free(planes);
+    return w.overflow ? 0 : w.len;
+}
+
+size_t mjpeg_corpus_frame(const mjpeg_corpus_config_t *config, int frame, uint8_t *out, size_t capacity)
+{
+    uint8_t *rgb = malloc((size_t)config->width * config->height * 3);
+    if (rgb == NULL) {
+        return 0;
+    }
+    mjpeg_corpus_scene(config->width, config->height, frame, rgb);
+    const size_t len = mjpeg_corpus_encode(config, rgb, out, capacity);
+    free(rgb);
+    return len;
+}
@@ -0,0 +1,66 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The MJPEG corpus of the decoder tests and benchmarks, generated instead
+ * of checked in: a synthetic scene, gradients, a textured patch and a disc
+ * moving with the frame number, encoded by a small baseline encoder into
+ * the kind of frames a UVC camera sends.
+ */
+typedef struct {
+    int width;
+    int height;
+    int quality;                /*!< 1 to 100, scales the standard quantization tables */
+    bool grayscale;             /*!< One component, the sampling is ignored */
+    uint8_t h_samp;             /*!< Luma blocks per MCU horizontally, 1 or 2, chroma has one */
+    uint8_t v_samp;             /*!< Luma blocks per MCU vertically, 1 or 2 */
+    bool omit_dht;              /*!< Leave out the Huffman tables like UVC frames, the standard ones are used */
+    uint16_t restart_interval;  /*!< MCUs between restart markers, 0 for none */
+} mjpeg_corpus_config_t;
+
+/* 4:2:2 at quality 80 with the tables, like most USB cameras */
+#define MJPEG_CORPUS_DEFAULT_CONFIG(w, h) { \
+    .width = (w),                           \
+    .height = (h),                          \
+    .quality = 80,                          \
+    .h_samp = 2,                            \
+    .v_samp = 1,                            \
+}
+
+/**
+ * @brief Draw frame `frame` of the scene
+ * @param width scene width
+ * @param height scene height
+ * @param frame frame number, moves the disc
+ * @param rgb returned pixels, R, G, B, width * height * 3 bytes
+ */
+void mjpeg_corpus_scene(int width, int height, int frame, uint8_t *rgb);
+
+/**
+ * @brief Encode RGB888 pixels into a baseline JPEG frame
+ * @param config frame format
+ * @param rgb pixels, R, G, B, config->width * config->height * 3 bytes
+ * @param out returned JPEG data
+ * @param capacity size of `out`
+ * @return length of the frame, 0 when it does not fit in `out`
+ */
+size_t mjpeg_corpus_encode(const mjpeg_corpus_config_t *config, const uint8_t *rgb, uint8_t *out, size_t capacity);
+
+/**
+ * @brief Draw and encode frame `frame` of the scene
+ * @param config frame format
+ * @param frame frame number
+ * @param out returned JPEG data
+ * @param capacity size of `out`
+ * @return length of the frame, 0 when it does not fit in `out` or out of memory
+ */
+size_t mjpeg_corpus_frame(const mjpeg_corpus_config_t *config, int frame, uint8_t *out, size_t capacity);
@@ -0,0 +1,295 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * The pooled allocator behind audio_calloc: heap accounting before the
+ * pools exist, the size classes, blocks going back to their class and
+ * coming out zeroed, a spent pool falling back to the heap, oversize and
+ * untracked allocations, double frees, leak sessions, and several threads
+ * allocating and freeing at once without two live blocks overlapping.
+ *
+ * The pools are reserved once per process, the tests run in order.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "audio_malloc.h"
+
+#define INNER_POOL      (64 * 1024)
+#define DEFAULT_POOL    (1024 * 1024)
+
+static bool all_zero(const uint8_t *p, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_heap_before_init(void)
+{
+    audio_mem_stats_t stats;
+
+    uint8_t *a = audio_calloc(10, 100);
+    uint8_t *b = audio_calloc_inner(1, 33);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT(all_zero(a, 1000));
+    TEST_ASSERT(all_zero(b, 33));
+    audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &stats);
+    TEST_ASSERT_EQUAL(0, stats.pool_size);
+    TEST_ASSERT_EQUAL(1, stats.allocs);
+    TEST_ASSERT_EQUAL(1, stats.heap_allocs);
+    TEST_ASSERT_EQUAL(1000, stats.in_use);
+    audio_free(a);
+    audio_free(b);
+    audio_free(NULL);
+    audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &stats);
+    TEST_ASSERT_EQUAL(0, stats.live);
+    TEST_ASSERT_EQUAL(0, stats.in_use);
+    TEST_ASSERT_EQUAL(1000, stats.high_water);
+    audio_mem_get_stats(AUDIO_MEM_POOL_INNER, &stats);
+    TEST_ASSERT_EQUAL(1, stats.frees);
+
+    /* n * size overflowing is refused */
+    TEST_ASSERT_NULL(audio_calloc(SIZE_MAX / 2, 3));
+
+    const audio_mem_config_t config = { .inner_size = INNER_POOL + 5, .default_size = DEFAULT_POOL };
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, audio_mem_init(NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_mem_init(&config));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, audio_mem_init(&config));
+    audio_mem_get_stats(AUDIO_MEM_POOL_INNER, &stats);
+    TEST_ASSERT_EQUAL(INNER_POOL, stats.pool_size);
+    TEST_ASSERT_EQUAL(0, stats.pool_carved);
+}
+
+static void test_size_classes(void)
+{
+    audio_mem_stats_t before, after;
+
+    /* Each new class carves one block: at least the size, at most a quarter more, 16 byte aligned */
+    for (size_t size = 1; size <= 64 * 1024; size += 1 + size / 5) {
+        audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &before);
+        uint8_t *p = audio_calloc(1, size);
+        audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &after);
+        TEST_ASSERT_NOT_NULL(p);
+        TEST_ASSERT_EQUAL(0, (uintptr_t)p % 16);
+        TEST_ASSERT_EQUAL(before.heap_allocs, after.heap_allocs);
+        const size_t carved = after.pool_carved - before.pool_carved;
+        /* A class already carved and freed is reused instead */
+        if (carved != 0) {
+            TEST_ASSERT_GREATER_OR_EQUAL(size, carved);
+            TEST_ASSERT_LESS_OR_EQUAL(size < 64 ? 16 + size : size + size / 4 + 16, carved);
+        }
+        memset(p, 0xa5, size);
+        audio_free(p);
+    }
+}
+
+static void test_blocks_are_reused(void)
+{
+    audio_mem_stats_t before, after;
+    void *blocks[8];
+
+    audio_mem_get_stats(AUDIO_MEM_POOL_INNER, &before);
+    /* The pattern of a codec frame: the same few sizes, every frame */
+    for (int frame = 0; frame < 1000; frame++) {
+        for (int i = 0; i < 8; i++) {
+            blocks[i] = audio_calloc_inner(1, 100 + i * 300);
+            if (blocks[i] == NULL || !all_zero(blocks[i], 100 + i * 300)) {
+                HOST_TEST_FAIL("frame %d, block %d not served or not zeroed", frame, i);
+            }
+            memset(blocks[i], 0xff, 100 + i * 300);
+        }
+        for (int i = 7; i >= 0; i--) {
+            audio_free(blocks[i]);
+        }
+    }
+    audio_mem_get_stats(AUDIO_MEM_POOL_INNER, &after);
+    TEST_ASSERT_EQUAL(before.heap_allocs, after.heap_allocs);
+    TEST_ASSERT_EQUAL(8000, after.allocs - before.allocs);
+    TEST_ASSERT_EQUAL(before.live, after.live);
+    /* Only the first frame carved, the others were served from the free lists */
+    TEST_ASSERT_LESS_OR_EQUAL(8 * 2500, after.pool_carved - before.pool_carved);
+}
+
+static void test_spent_pool_and_large_blocks(void)
+{
+    audio_mem_stats_t before, after;
+    void *blocks[64];
+    int count = 0;
+
+    /* Fill the internal pool with 4 KB blocks until the heap serves them */
+    audio_mem_get_stats(AUDIO_MEM_POOL_INNER, &before);
+    while (count < 64) {
+        blocks[count++] = audio_calloc_inner(1, 4096);
+        audio_mem_get_stats(AUDIO_MEM_POOL_INNER, &after);
+        if (after.heap_allocs > before.heap_allocs) {
+            break;
+        }
+    }
+    TEST_ASSERT_EQUAL(before.heap_allocs + 1, after.heap_allocs);
+    TEST_ASSERT_LESS_OR_EQUAL(INNER_POOL, after.pool_carved);
+    TEST_ASSERT_GREATER_OR_EQUAL(INNER_POOL - 5 * 1024, after.pool_carved);
+
+    /* A spent pool still serves a slightly smaller class from a free larger block */
+    audio_free(blocks[0]);
+    void *smaller = audio_calloc_inner(1, 3500);
+    audio_mem_get_stats(AUDIO_MEM_POOL_INNER, &before);
+    TEST_ASSERT(smaller == blocks[0]);
+    TEST_ASSERT_EQUAL(after.heap_allocs, before.heap_allocs);
+    blocks[0] = smaller;
+    for (int i = 0; i < count; i++) {
+        audio_free(blocks[i]);
+    }
+
+    /* Beyond the largest class, always the heap */
+    void *large = audio_calloc(1, AUDIO_MEM_MAX_CLASS_SIZE + 1);
+    audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &after);
+    TEST_ASSERT_NOT_NULL(large);
+    audio_free(large);
+    audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &before);
+    TEST_ASSERT_EQUAL(after.heap_allocs, before.heap_allocs);
+    TEST_ASSERT_EQUAL(after.live - 1, before.live);
+}
+
+static void test_double_free_and_untracked(void)
+{
+    audio_mem_stats_t before, after;
+    void *blocks[AUDIO_MEM_MAX_BLOCKS];
+
+    /* A pool block freed twice is refused, its class is not corrupted */
+    void *p = audio_calloc(1, 200);
+    audio_free(p);
+    audio_free(p);
+    void *q = audio_calloc(1, 200);
+    void *r = audio_calloc(1, 200);
+    TEST_ASSERT(q != r);
+    audio_free(q);
+    audio_free(r);
+
+    /* Past the live blocks that can be tracked, the heap serves without accounting */
+    audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &before);
+    for (int i = 0; i < AUDIO_MEM_MAX_BLOCKS; i++) {
+        blocks[i] = audio_calloc(1, 64);
+        TEST_ASSERT_NOT_NULL(blocks[i]);
+    }
+    audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &after);
+    TEST_ASSERT(after.untracked > before.untracked);
+    TEST_ASSERT_EQUAL(AUDIO_MEM_MAX_BLOCKS, (after.allocs - before.allocs) + (after.untracked - before.untracked));
+    for (int i = 0; i < AUDIO_MEM_MAX_BLOCKS; i++) {
+        audio_free(blocks[i]);
+    }
+    audio_mem_get_stats(AUDIO_MEM_POOL_DEFAULT, &after);
+    TEST_ASSERT_EQUAL(before.live, after.live);
+    TEST_ASSERT_EQUAL(before.in_use, after.in_use);
+}
+
+static void test_sessions(void)
+{
+    const uint16_t session = audio_mem_session_begin();
+    TEST_ASSERT(session != 0);
+    void *a = audio_calloc(1, 100);
+    void *b = audio_calloc_inner(1, 200);
+    void *c = audio_calloc(1, AUDIO_MEM_MAX_CLASS_SIZE * 2);
+    audio_free(a);
+    TEST_ASSERT_EQUAL(2, audio_mem_session_end(session));
+
+    /* After the end nothing is tagged, a newer session does not see the older one */
+    void *d = audio_calloc(1, 100);
+    const uint16_t next = audio_mem_session_begin();
+    TEST_ASSERT(next != session);
+    TEST_ASSERT_EQUAL(0, audio_mem_session_end(next));
+    TEST_ASSERT_EQUAL(2, audio_mem_session_end(session));
+    audio_free(b);
+    audio_free(c);
+    audio_free(d);
+    TEST_ASSERT_EQUAL(0, audio_mem_session_end(session));
+    TEST_ASSERT_EQUAL(0, audio_mem_session_end(0));
+}
+
+#define THREAD_OPS      (20000)
+
+static void *churn(void *arg)
+{
+    uint32_t seed = (uint32_t)(uintptr_t)arg;
+    struct {
+        uint8_t *p;
+        size_t size;
+        uint8_t tag;
+    } held[16] = { 0 };
+    intptr_t broken = 0;
+
+    for (int op = 0; op < THREAD_OPS; op++) {
+        const int i = host_rand(&seed) % 16;
+        if (held[i].p != NULL) {
+            /* Nobody else wrote into the block while this thread held it */
+            for (size_t k = 0; k < held[i].size; k++) {
+                broken += held[i].p[k] != held[i].tag;
+            }
+            audio_free(held[i].p);
+            held[i].p = NULL;
+            continue;
+        }
+        held[i].size = 1 + host_rand(&seed) % 3000;
+        held[i].tag = (uint8_t)(1 + host_rand(&seed) % 255);
+        held[i].p = (host_rand(&seed) & 1) ? audio_calloc(1, held[i].size) : audio_calloc_inner(1, held[i].size);
+        if (held[i].p == NULL || !all_zero(held[i].p, held[i].size)) {
+            broken++;
+            held[i].p = NULL;
+            continue;
+        }
+        memset(held[i].p, held[i].tag, held[i].size);
+    }
+    for (int i = 0; i < 16; i++) {
+        audio_free(held[i].p);
+    }
+    return (void *)broken;
+}
+
+static void test_threads(void)
+{
+    audio_mem_stats_t before[AUDIO_MEM_POOL_MAX], after;
+    pthread_t threads[4];
+    intptr_t broken = 0;
+
+    for (int p = 0; p < AUDIO_MEM_POOL_MAX; p++) {
+        audio_mem_get_stats(p, &before[p]);
+    }
+    for (int t = 0; t < 4; t++) {
+        pthread_create(&threads[t], NULL, churn, (void *)(uintptr_t)(t + 1));
+    }
+    for (int t = 0; t < 4; t++) {
+        void *ret;
+        pthread_join(threads[t], &ret);
+        broken += (intptr_t)ret;
+    }
+    TEST_ASSERT_EQUAL(0, broken);
+    for (int p = 0; p < AUDIO_MEM_POOL_MAX; p++) {
+        audio_mem_get_stats(p, &after);
+        TEST_ASSERT_EQUAL(before[p].live, after.live);
+        TEST_ASSERT_EQUAL(before[p].in_use, after.in_use);
+        TEST_ASSERT_EQUAL(after.allocs - before[p].allocs, after.frees - before[p].frees);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(test_heap_before_init);
+    RUN_TEST(test_size_classes);
+    RUN_TEST(test_blocks_are_reused);
+    RUN_TEST(test_spent_pool_and_large_blocks);
+    RUN_TEST(test_double_free_and_untracked);
+    RUN_TEST(test_sessions);
+    RUN_TEST(test_threads);
+    return HOST_TEST_END();
+}
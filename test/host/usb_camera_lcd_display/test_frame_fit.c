@@ -0,0 +1,351 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * frame_fit: the plans for the camera resolutions on the 320x240 panel,
+ * the box step bit-exact against a naive block average, the exact-fit
+ * resample against a double precision reference, and golden checksums of
+ * a synthetic test card so that any change in the output shows up.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "frame_fit.h"
+
+#define PANEL_W     (320)
+#define PANEL_H     (240)
+#define MAX_W       (1280)
+#define MAX_H       (960)
+
+static uint16_t card[MAX_W * MAX_H];
+static uint16_t out[MAX_W * MAX_H];
+
+static uint16_t swap16(uint16_t v)
+{
+    return (uint16_t)((v >> 8) | (v << 8));
+}
+
+/* Colour bars, a diagonal gradient, fine stripes and some noise: every kind of edge a camera sends */
+static void make_card(int width, int height, bool big_endian)
+{
+    uint32_t seed = 99;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int r, g, b;
+            if (y < height / 3) {
+                const int bar = x * 8 / width;
+                r = (bar & 1) ? 31 : 0;
+                g = (bar & 2) ? 63 : 0;
+                b = (bar & 4) ? 31 : 0;
+            } else if (y < 2 * height / 3) {
+                r = (x * 31) / (width - 1);
+                g = ((x + y) * 63) / (width + height - 2);
+                b = (y * 31) / (height - 1);
+            } else {
+                const int stripe = ((x / 2) + (y / 3)) & 1;
+                r = stripe ? 28 : 4;
+                g = (host_rand(&seed) >> 10) & 63;
+                b = stripe ? 3 : 29;
+            }
+            const uint16_t v = (uint16_t)((r << 11) | (g << 5) | b);
+            card[y * width + x] = big_endian ? swap16(v) : v;
+        }
+    }
+}
+
+static void channels(uint16_t v, bool big_endian, int *r, int *g, int *b)
+{
+    v = big_endian ? swap16(v) : v;
+    *r = v >> 11;
+    *g = (v >> 5) & 63;
+    *b = v & 31;
+}
+
+/* Mean of a (1 << shift) block of window pixel (x, y), not rounded */
+static void ref_box(int src_width, bool big_endian, const frame_fit_plan_t *plan, int x, int y, double c[3])
+{
+    const int block = 1 << plan->shift;
+    const int x0 = (plan->crop_x + x) << plan->shift;
+    const int y0 = (plan->crop_y + y) << plan->shift;
+
+    c[0] = c[1] = c[2] = 0;
+    for (int by = 0; by < block; by++) {
+        for (int bx = 0; bx < block; bx++) {
+            int r, g, b;
+            channels(card[(y0 + by) * src_width + x0 + bx], big_endian, &r, &g, &b);
+            c[0] += r;
+            c[1] += g;
+            c[2] += b;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        c[i] /= block * block;
+    }
+}
+
+static double ref_pos(int i, int window, int fit)
+{
+    const double pos = (i + 0.5) * window / fit - 0.5;
+    return pos < 0 ? 0 : (pos > window - 1 ? window - 1 : pos);
+}
+
+/* Largest channel error of `out` against the double precision box + bilinear reference */
+static double max_error(int src_width, bool big_endian, const frame_fit_plan_t *plan)
+{
+    double worst = 0;
+
+    for (int y = 0; y < plan->fit_height; y++) {
+        const double py = ref_pos(y, plan->out_height, plan->fit_height);
+        const int y0 = (int)py;
+        const int y1 = y0 + 1 < plan->out_height ? y0 + 1 : y0;
+        const double fy = py - y0;
+        for (int x = 0; x < plan->fit_width; x++) {
+            const double px = ref_pos(x, plan->out_width, plan->fit_width);
+            const int x0 = (int)px;
+            const int x1 = x0 + 1 < plan->out_width ? x0 + 1 : x0;
+            const double fx = px - x0;
+            double c00[3], c01[3], c10[3], c11[3];
+            int got[3];
+            ref_box(src_width, big_endian, plan, x0, y0, c00);
+            ref_box(src_width, big_endian, plan, x1, y0, c01);
+            ref_box(src_width, big_endian, plan, x0, y1, c10);
+            ref_box(src_width, big_endian, plan, x1, y1, c11);
+            channels(out[y * plan->fit_width + x], big_endian, &got[0], &got[1], &got[2]);
+            for (int i = 0; i < 3; i++) {
+                const double want = (c00[i] * (1 - fx) + c01[i] * fx) * (1 - fy) + (c10[i] * (1 - fx) + c11[i] * fx) * fy;
+                worst = fabs(got[i] - want) > worst ? fabs(got[i] - want) : worst;
+            }
+        }
+    }
+    return worst;
+}
+
+typedef struct {
+    int src_w, src_h;
+    frame_fit_mode_t mode;
+    frame_fit_plan_t plan;
+} plan_case_t;
+
+/* Frame sizes of common UVC cameras on the ESP32-S3-BOX-3 panel */
+static const plan_case_t plans[] = {
+    /*                                  shift crop_x crop_y out_w out_h fit_w fit_h */
+    { 320, 240,  FRAME_FIT_CROP,      { 0,   0,   0,  320, 240, 320, 240 } },
+    { 640, 480,  FRAME_FIT_CROP,      { 1,   0,   0,  320, 240, 320, 240 } },
+    { 680, 480,  FRAME_FIT_CROP,      { 1,  10,   0,  320, 240, 320, 240 } },
+    { 800, 600,  FRAME_FIT_CROP,      { 1,   0,   0,  400, 300, 320, 240 } },
+    { 1280, 720, FRAME_FIT_CROP,      { 1,  80,   0,  480, 360, 320, 240 } },
+    { 160, 120,  FRAME_FIT_CROP,      { 0,   0,   0,  160, 120, 160, 120 } },
+    { 480, 160,  FRAME_FIT_CROP,      { 0,  80,   0,  320, 160, 320, 160 } },
+    { 320, 240,  FRAME_FIT_LETTERBOX, { 0,   0,   0,  320, 240, 320, 240 } },
+    { 640, 480,  FRAME_FIT_LETTERBOX, { 1,   0,   0,  320, 240, 320, 240 } },
+    { 680, 480,  FRAME_FIT_LETTERBOX, { 1,   0,   0,  340, 240, 320, 226 } },
+    { 800, 600,  FRAME_FIT_LETTERBOX, { 1,   0,   0,  400, 300, 320, 240 } },
+    { 1280, 720, FRAME_FIT_LETTERBOX, { 2,   0,   0,  320, 180, 320, 180 } },
+    { 1280, 960, FRAME_FIT_LETTERBOX, { 2,   0,   0,  320, 240, 320, 240 } },
+    { 160, 120,  FRAME_FIT_LETTERBOX, { 0,   0,   0,  160, 120, 160, 120 } },
+};
+
+/* Field by field, the padding after `shift` is never written */
+static bool plan_equal(const frame_fit_plan_t *a, const frame_fit_plan_t *b)
+{
+    return a->shift == b->shift && a->crop_x == b->crop_x && a->crop_y == b->crop_y && a->out_width == b->out_width &&
+           a->out_height == b->out_height && a->fit_width == b->fit_width && a->fit_height == b->fit_height;
+}
+
+static void test_plans(void)
+{
+    for (size_t i = 0; i < sizeof(plans) / sizeof(plans[0]); i++) {
+        const plan_case_t *c = &plans[i];
+        frame_fit_plan_t plan;
+
+        TEST_ASSERT_EQUAL(ESP_OK, frame_fit_plan(c->src_w, c->src_h, PANEL_W, PANEL_H, c->mode, &plan));
+        if (!plan_equal(&plan, &c->plan)) {
+            HOST_TEST_FAIL("%dx%d %s: shift %d crop %d,%d window %dx%d fit %dx%d", c->src_w, c->src_h,
+                           c->mode == FRAME_FIT_CROP ? "crop" : "letterbox", plan.shift, plan.crop_x, plan.crop_y,
+                           plan.out_width, plan.out_height, plan.fit_width, plan.fit_height);
+        }
+    }
+    frame_fit_plan_t plan;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_fit_plan(0, 240, PANEL_W, PANEL_H, FRAME_FIT_CROP, &plan));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_fit_plan(320, 240, PANEL_W, PANEL_H, FRAME_FIT_CROP, NULL));
+}
+
+static void test_letterbox_keeps_aspect(void)
+{
+    /* Every size from 1/8 of the panel to four times it: the fit fills one side and keeps the aspect */
+    for (int w = 40; w <= 4 * PANEL_W; w += 7) {
+        for (int h = 30; h <= 4 * PANEL_H; h += 11) {
+            frame_fit_plan_t plan;
+            TEST_ASSERT_EQUAL(ESP_OK, frame_fit_plan(w, h, PANEL_W, PANEL_H, FRAME_FIT_LETTERBOX, &plan));
+            TEST_ASSERT_LESS_OR_EQUAL(PANEL_W, plan.fit_width);
+            TEST_ASSERT_LESS_OR_EQUAL(PANEL_H, plan.fit_height);
+            if (w > PANEL_W || h > PANEL_H) {
+                TEST_ASSERT(plan.fit_width == PANEL_W || plan.fit_height == PANEL_H);
+                /* The other side is within half a pixel of the source aspect */
+                TEST_ASSERT_LESS_OR_EQUAL(w > h ? w : h, 2 * llabs((int64_t)plan.fit_width * h - (int64_t)plan.fit_height * w));
+            } else {
+                TEST_ASSERT_EQUAL(w, plan.fit_width);
+                TEST_ASSERT_EQUAL(h, plan.fit_height);
+            }
+            /* The resample is always a reduction of at most 2 within the FRAME_FIT_MAX_SHIFT range */
+            TEST_ASSERT(plan.fit_width <= plan.out_width && plan.fit_height <= plan.out_height);
+            if (plan.shift < FRAME_FIT_MAX_SHIFT) {
+                TEST_ASSERT(plan.out_width < 2 * plan.fit_width || plan.out_height < 2 * plan.fit_height);
+            }
+            TEST_ASSERT_LESS_OR_EQUAL(w, (plan.crop_x + plan.out_width) << plan.shift);
+        }
+    }
+}
+
+static void test_box_step_is_exact(void)
+{
+    static const int sizes[][2] = { {640, 480}, {1280, 960}, {336, 248} };
+
+    for (int e = 0; e < 2; e++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (int shift = 0; shift <= FRAME_FIT_MAX_SHIFT; shift++) {
+                const int w = sizes[s][0], h = sizes[s][1];
+                const frame_fit_plan_t plan = {
+                    .shift = shift, .crop_x = 1, .crop_y = 2,
+                    .out_width = (w >> shift) - 2, .out_height = (h >> shift) - 3,
+                    .fit_width = (w >> shift) - 2, .fit_height = (h >> shift) - 3,
+                };
+                make_card(w, h, e);
+                TEST_ASSERT_EQUAL(ESP_OK, frame_fit_downscale_rgb565(card, w, h, e, &plan, out));
+                for (int y = 0; y < plan.out_height; y++) {
+                    for (int x = 0; x < plan.out_width; x++) {
+                        double c[3];
+                        int got[3];
+                        ref_box(w, e, &plan, x, y, c);
+                        channels(out[y * plan.out_width + x], e, &got[0], &got[1], &got[2]);
+                        for (int i = 0; i < 3; i++) {
+                            /* Rounded half up, like the fixed point sums */
+                            if (got[i] != (int)floor(c[i] + 0.5)) {
+                                HOST_TEST_FAIL("%dx%d shift %d %s: pixel %d,%d channel %d is %d, mean %.3f",
+                                               w, h, shift, e ? "BE" : "LE", x, y, i, got[i], c[i]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void test_resample_matches_reference(void)
+{
+    static const int sizes[][2] = { {680, 480}, {800, 600}, {1280, 720}, {352, 288}, {2592, 1944} };
+
+    for (int e = 0; e < 2; e++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (int mode = FRAME_FIT_CROP; mode <= FRAME_FIT_LETTERBOX; mode++) {
+                const int w = sizes[s][0], h = sizes[s][1];
+                frame_fit_plan_t plan;
+                if (w > MAX_W || h > MAX_H) {
+                    continue;
+                }
+                TEST_ASSERT_EQUAL(ESP_OK, frame_fit_plan(w, h, PANEL_W, PANEL_H, mode, &plan));
+                make_card(w, h, e);
+                TEST_ASSERT_EQUAL(ESP_OK, frame_fit_downscale_rgb565(card, w, h, e, &plan, out));
+                const double err = max_error(w, e, &plan);
+                if (err > 1.0) {
+                    HOST_TEST_FAIL("%dx%d %s %s: error %.3f", w, h, mode == FRAME_FIT_CROP ? "crop" : "letterbox", e ? "BE" : "LE", err);
+                }
+            }
+        }
+    }
+}
+
+static void test_flat_colour_stays_flat(void)
+{
+    static const uint16_t colours[] = { 0x0000, 0xFFFF, 0xF800, 0x07E0, 0x001F, 0x8410, 0x1234 };
+
+    for (size_t c = 0; c < sizeof(colours) / sizeof(colours[0]); c++) {
+        frame_fit_plan_t plan;
+        for (int i = 0; i < 680 * 480; i++) {
+            card[i] = colours[c];
+        }
+        TEST_ASSERT_EQUAL(ESP_OK, frame_fit_plan(680, 480, PANEL_W, PANEL_H, FRAME_FIT_LETTERBOX, &plan));
+        TEST_ASSERT_EQUAL(ESP_OK, frame_fit_downscale_rgb565(card, 680, 480, false, &plan, out));
+        for (int i = 0; i < plan.fit_width * plan.fit_height; i++) {
+            if (out[i] != colours[c]) {
+                HOST_TEST_FAIL("colour 0x%04x became 0x%04x at %d", colours[c], out[i], i);
+            }
+        }
+    }
+}
+
+static uint32_t crc32(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void test_golden_checksums(void)
+{
+    /* Checksums of the fitted test card, update them only for an intended change of the output */
+    static const struct {
+        int w, h;
+        frame_fit_mode_t mode;
+        bool big_endian;
+        uint32_t crc;
+    } golden[] = {
+        { 640, 480,  FRAME_FIT_CROP,      false, 0x6c693632 },
+        { 680, 480,  FRAME_FIT_LETTERBOX, false, 0x59592b53 },
+        { 680, 480,  FRAME_FIT_LETTERBOX, true,  0x5668f5e5 },
+        { 800, 600,  FRAME_FIT_CROP,      false, 0x96eb13bb },
+        { 1280, 720, FRAME_FIT_LETTERBOX, true,  0xdd2c0837 },
+    };
+
+    for (size_t i = 0; i < sizeof(golden) / sizeof(golden[0]); i++) {
+        frame_fit_plan_t plan;
+        make_card(golden[i].w, golden[i].h, golden[i].big_endian);
+        TEST_ASSERT_EQUAL(ESP_OK, frame_fit_plan(golden[i].w, golden[i].h, PANEL_W, PANEL_H, golden[i].mode, &plan));
+        TEST_ASSERT_EQUAL(ESP_OK, frame_fit_downscale_rgb565(card, golden[i].w, golden[i].h, golden[i].big_endian, &plan, out));
+        const uint32_t crc = crc32(out, (size_t)plan.fit_width * plan.fit_height * 2);
+        if (crc != golden[i].crc) {
+            HOST_TEST_FAIL("%dx%d %s %s: crc 0x%08" PRIx32 ", golden 0x%08" PRIx32, golden[i].w, golden[i].h,
+                           golden[i].mode == FRAME_FIT_CROP ? "crop" : "letterbox", golden[i].big_endian ? "BE" : "LE",
+                           crc, golden[i].crc);
+        }
+    }
+}
+
+static void test_invalid_plan(void)
+{
+    frame_fit_plan_t plan = { .shift = 1, .out_width = 320, .out_height = 240, .fit_width = 320, .fit_height = 240 };
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_fit_downscale_rgb565(card, 638, 480, false, &plan, out));
+    plan.fit_width = 321;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_fit_downscale_rgb565(card, 640, 480, false, &plan, out));
+    plan.fit_width = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_fit_downscale_rgb565(card, 640, 480, false, &plan, out));
+    plan.fit_width = 320;
+    plan.shift = FRAME_FIT_MAX_SHIFT + 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_fit_downscale_rgb565(card, 640, 480, false, &plan, out));
+}
+
+int main(void)
+{
+    RUN_TEST(test_plans);
+    RUN_TEST(test_letterbox_keeps_aspect);
+    RUN_TEST(test_box_step_is_exact);
+    RUN_TEST(test_resample_matches_reference);
+    RUN_TEST(test_flat_colour_stays_flat);
+    RUN_TEST(test_golden_checksums);
+    RUN_TEST(test_invalid_plan);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,237 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * frame_queue between a USB-like producer and a decoder-like consumer:
+ * the drop-oldest order on one thread, then both sides on their own
+ * threads, checking that no slot is ever written while the consumer holds
+ * it, that frames come out in order and that every frame is accounted for.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_heap_caps.h"
+#include "frame_queue.h"
+
+#define SLOT_BYTES      (4096)
+
+static void test_drops_oldest_when_consumer_is_behind(void)
+{
+    frame_queue_handle_t queue = NULL;
+    frame_queue_stats_t stats;
+
+    TEST_ASSERT_EQUAL(ESP_OK, frame_queue_create(3, SLOT_BYTES, MALLOC_CAP_SPIRAM, &queue));
+    for (uint32_t seq = 1; seq <= 5; seq++) {
+        frame_slot_t *slot = frame_queue_acquire_write(queue);
+        TEST_ASSERT_NOT_NULL(slot);
+        slot->seq = seq;
+        frame_queue_commit(queue, slot);
+    }
+    /* Three slots, all queued: 1 and 2 were taken back for 4 and 5 */
+    frame_queue_get_stats(queue, &stats);
+    TEST_ASSERT_EQUAL(5, stats.pushed);
+    TEST_ASSERT_EQUAL(2, stats.dropped);
+    for (uint32_t seq = 3; seq <= 5; seq++) {
+        frame_slot_t *slot = frame_queue_acquire_read(queue, 0);
+        TEST_ASSERT_NOT_NULL(slot);
+        TEST_ASSERT_EQUAL(seq, slot->seq);
+        frame_queue_release(queue, slot);
+    }
+    TEST_ASSERT_NULL(frame_queue_acquire_read(queue, 0));
+    frame_queue_delete(queue);
+}
+
+static void test_slots_in_use_are_never_taken(void)
+{
+    frame_queue_handle_t queue = NULL;
+    frame_queue_stats_t stats;
+
+    TEST_ASSERT_EQUAL(ESP_OK, frame_queue_create(2, SLOT_BYTES, MALLOC_CAP_SPIRAM, &queue));
+    frame_slot_t *first = frame_queue_acquire_write(queue);
+    first->seq = 1;
+    frame_queue_commit(queue, first);
+    frame_slot_t *reading = frame_queue_acquire_read(queue, 0);
+    TEST_ASSERT(reading == first);
+
+    /* One slot with the consumer, one with the producer: nothing left */
+    frame_slot_t *writing = frame_queue_acquire_write(queue);
+    TEST_ASSERT_NOT_NULL(writing);
+    TEST_ASSERT(writing != reading);
+    TEST_ASSERT_NULL(frame_queue_acquire_write(queue));
+    frame_queue_cancel(queue, writing);
+
+    /* A queued frame is taken back, the one being read is not */
+    writing = frame_queue_acquire_write(queue);
+    writing->seq = 2;
+    frame_queue_commit(queue, writing);
+    writing = frame_queue_acquire_write(queue);
+    TEST_ASSERT(writing != reading);
+    TEST_ASSERT_EQUAL(0, writing->len);
+    frame_queue_cancel(queue, writing);
+    frame_queue_release(queue, reading);
+
+    frame_queue_get_stats(queue, &stats);
+    TEST_ASSERT_EQUAL(1, stats.rejected);
+    TEST_ASSERT_EQUAL(1, stats.dropped);
+    frame_queue_delete(queue);
+}
+
+static void test_read_timeout(void)
+{
+    frame_queue_handle_t queue = NULL;
+
+    TEST_ASSERT_EQUAL(ESP_OK, frame_queue_create(2, 0, MALLOC_CAP_SPIRAM, &queue));
+    const int64_t start = host_time_ns();
+    TEST_ASSERT_NULL(frame_queue_acquire_read(queue, pdMS_TO_TICKS(20)));
+    const int64_t waited_ms = (host_time_ns() - start) / 1000000;
+    TEST_ASSERT_GREATER_OR_EQUAL(15, waited_ms);
+    TEST_ASSERT_LESS_OR_EQUAL(1000, waited_ms);
+
+    /* Slots without a buffer get one on reserve, and keep it */
+    frame_slot_t *slot = frame_queue_acquire_write(queue);
+    TEST_ASSERT_EQUAL(0, slot->capacity);
+    TEST_ASSERT_EQUAL(ESP_OK, frame_queue_reserve(queue, slot, 1000));
+    TEST_ASSERT_EQUAL(1000, slot->capacity);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)slot->data % 16);
+    TEST_ASSERT_EQUAL(ESP_OK, frame_queue_reserve(queue, slot, 500));
+    TEST_ASSERT_EQUAL(1000, slot->capacity);
+    frame_queue_cancel(queue, slot);
+    frame_queue_delete(queue);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_queue_create(1, 0, 0, &queue));
+}
+
+typedef struct {
+    frame_queue_handle_t queue;
+    uint32_t frames;
+    atomic_bool producer_done;
+    /* Consumer results */
+    uint32_t received;
+    uint32_t out_of_order;
+    uint32_t corrupted;
+} stress_t;
+
+static void fill(frame_slot_t *slot, uint32_t seq)
+{
+    slot->len = 64 + seq % (SLOT_BYTES - 64);
+    memset(slot->data, (uint8_t)seq, slot->len);
+    slot->seq = seq;
+}
+
+static bool intact(const frame_slot_t *slot)
+{
+    if (slot->len != 64 + slot->seq % (SLOT_BYTES - 64)) {
+        return false;
+    }
+    for (size_t i = 0; i < slot->len; i++) {
+        if (slot->data[i] != (uint8_t)slot->seq) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *producer(void *arg)
+{
+    stress_t *st = arg;
+    uint32_t seed = 3;
+
+    for (uint32_t seq = 1; seq <= st->frames; seq++) {
+        frame_slot_t *slot = frame_queue_acquire_write(st->queue);
+        if (slot == NULL) {
+            continue;
+        }
+        fill(slot, seq);
+        if (host_rand(&seed) % 50 == 0) {
+            /* A frame the USB side gave up on */
+            frame_queue_cancel(st->queue, slot);
+        } else {
+            frame_queue_commit(st->queue, slot);
+        }
+        if (host_rand(&seed) % 4 == 0) {
+            sched_yield();
+        }
+    }
+    atomic_store(&st->producer_done, true);
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    stress_t *st = arg;
+    uint32_t last = 0;
+    uint32_t seed = 5;
+
+    while (1) {
+        frame_slot_t *slot = frame_queue_acquire_read(st->queue, pdMS_TO_TICKS(5));
+        if (slot == NULL) {
+            if (atomic_load(&st->producer_done)) {
+                /* A last check: the final commit may have landed after the timeout */
+                slot = frame_queue_acquire_read(st->queue, 0);
+                if (slot == NULL) {
+                    break;
+                }
+            } else {
+                continue;
+            }
+        }
+        st->out_of_order += slot->seq <= last;
+        last = slot->seq;
+        st->corrupted += !intact(slot);
+        /* Hold the slot like a decode does, the producer keeps going meanwhile */
+        for (uint32_t spin = host_rand(&seed) % 20000; spin > 0; spin--) {
+            __asm__ volatile("");
+        }
+        st->corrupted += !intact(slot);
+        st->received++;
+        frame_queue_release(st->queue, slot);
+    }
+    return NULL;
+}
+
+static void test_producer_consumer_stress(void)
+{
+    static const int depths[] = { 2, 3, 4 };
+
+    for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+        stress_t st = { .frames = 50000 };
+        frame_queue_stats_t stats;
+        pthread_t threads[2];
+
+        TEST_ASSERT_EQUAL(ESP_OK, frame_queue_create(depths[d], SLOT_BYTES, MALLOC_CAP_SPIRAM, &st.queue));
+        pthread_create(&threads[0], NULL, consumer, &st);
+        pthread_create(&threads[1], NULL, producer, &st);
+        pthread_join(threads[1], NULL);
+        pthread_join(threads[0], NULL);
+        frame_queue_get_stats(st.queue, &stats);
+        frame_queue_delete(st.queue);
+
+        if (st.corrupted || st.out_of_order) {
+            HOST_TEST_FAIL("depth %d: %" PRIu32 " corrupted, %" PRIu32 " out of order",
+                           depths[d], st.corrupted, st.out_of_order);
+        }
+        /* With one slot per side the producer always finds one */
+        TEST_ASSERT_EQUAL(0, stats.rejected);
+        TEST_ASSERT_EQUAL(st.received, stats.popped);
+        TEST_ASSERT_EQUAL(stats.pushed, stats.popped + stats.dropped);
+        TEST_ASSERT(stats.popped > 0);
+        printf("depth %d: %" PRIu32 " pushed, %" PRIu32 " popped, %" PRIu32 " dropped\n",
+               depths[d], stats.pushed, stats.popped, stats.dropped);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(test_drops_oldest_when_consumer_is_behind);
+    RUN_TEST(test_slots_in_use_are_never_taken);
+    RUN_TEST(test_read_timeout);
+    RUN_TEST(test_producer_consumer_stress);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,288 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * frame_stats: the window keeping only the last frames, min/avg/p99/max
+ * against a sorted reference, the rate from the frame end times, drops and
+ * reset, the lock hooks, and writers and a reader on their own threads.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "frame_stats.h"
+
+static frame_stats_handle_t create(size_t window)
+{
+    const frame_stats_config_t config = { .name = "stage", .window = window };
+    frame_stats_handle_t stats = NULL;
+
+    return frame_stats_create(&config, &stats) == ESP_OK ? stats : NULL;
+}
+
+static void test_window_keeps_last_frames(void)
+{
+    frame_stats_handle_t stats = create(4);
+    frame_stats_summary_t summary;
+
+    TEST_ASSERT_NOT_NULL(stats);
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(0, summary.count);
+    TEST_ASSERT_EQUAL(0, summary.max_us);
+    TEST_ASSERT_EQUAL(0, summary.fps_x10);
+
+    /* Durations 100, 200 .. 600: only the last four stay */
+    for (int i = 1; i <= 6; i++) {
+        frame_stats_add(stats, i * 10000, i * 10000 + i * 100);
+    }
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(4, summary.count);
+    TEST_ASSERT_EQUAL(6, summary.total);
+    TEST_ASSERT_EQUAL(300, summary.min_us);
+    TEST_ASSERT_EQUAL(450, summary.avg_us);
+    TEST_ASSERT_EQUAL(600, summary.p99_us);
+    TEST_ASSERT_EQUAL(600, summary.max_us);
+
+    /* Clock going backwards and very long frames are clamped */
+    frame_stats_add(stats, 5000, 4000);
+    frame_stats_add(stats, 0, 10000000000LL);
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(0, summary.min_us);
+    TEST_ASSERT_EQUAL(UINT32_MAX, summary.max_us);
+    frame_stats_delete(stats);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void test_percentile(void)
+{
+    static const size_t windows[] = { 2, 10, 100, 128, 150 };
+    uint32_t seed = 21;
+
+    for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+        const size_t window = windows[w];
+        frame_stats_handle_t stats = create(window);
+        frame_stats_summary_t summary;
+        uint32_t durations[150];
+        uint64_t sum = 0;
+
+        TEST_ASSERT_NOT_NULL(stats);
+        for (size_t i = 0; i < window; i++) {
+            durations[i] = host_rand(&seed) % 50000;
+            sum += durations[i];
+            frame_stats_add(stats, 0, durations[i]);
+        }
+        frame_stats_get(stats, &summary);
+        qsort(durations, window, sizeof(uint32_t), compare_u32);
+        /* Nearest rank: the smallest value with at least 99% of the window at or below it */
+        size_t rank = 0;
+        while ((rank + 1) * 100 < window * 99) {
+            rank++;
+        }
+        TEST_ASSERT_EQUAL(window, summary.count);
+        TEST_ASSERT_EQUAL(durations[0], summary.min_us);
+        TEST_ASSERT_EQUAL(durations[window - 1], summary.max_us);
+        TEST_ASSERT_EQUAL(durations[rank], summary.p99_us);
+        TEST_ASSERT_EQUAL(sum / window, summary.avg_us);
+        frame_stats_delete(stats);
+    }
+}
+
+static void test_fps(void)
+{
+    frame_stats_handle_t stats = create(31);
+    frame_stats_summary_t summary;
+
+    TEST_ASSERT_NOT_NULL(stats);
+    /* 30 frame intervals over one second */
+    for (int i = 0; i <= 30; i++) {
+        const int64_t end = 5000000 + i * 1000000LL / 30;
+        frame_stats_add(stats, end - 1000, end);
+    }
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(300, summary.fps_x10);
+
+    /* The rate follows the window: 12.5 fps after the window turned over */
+    for (int i = 1; i <= 31; i++) {
+        frame_stats_add(stats, 0, 7000000 + i * 80000);
+    }
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(125, summary.fps_x10);
+
+    /* One frame, or all at the same time, is no rate */
+    frame_stats_reset(stats);
+    frame_stats_add(stats, 0, 1000);
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(0, summary.fps_x10);
+    frame_stats_add(stats, 0, 1000);
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(0, summary.fps_x10);
+    frame_stats_delete(stats);
+}
+
+static void test_drops_and_reset(void)
+{
+    frame_stats_handle_t stats = create(8);
+    frame_stats_summary_t summary;
+
+    TEST_ASSERT_NOT_NULL(stats);
+    TEST_ASSERT(strcmp(frame_stats_name(stats), "stage") == 0);
+    frame_stats_drop(stats, 3);
+    frame_stats_drop(stats, 2);
+    for (int i = 0; i < 10; i++) {
+        frame_stats_add(stats, 0, 500);
+    }
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(5, summary.drops);
+    TEST_ASSERT_EQUAL(10, summary.total);
+
+    frame_stats_reset(stats);
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(0, summary.count);
+    TEST_ASSERT_EQUAL(0, summary.total);
+    TEST_ASSERT_EQUAL(0, summary.drops);
+    TEST_ASSERT_EQUAL(0, summary.avg_us);
+    frame_stats_add(stats, 0, 700);
+    frame_stats_get(stats, &summary);
+    TEST_ASSERT_EQUAL(1, summary.count);
+    TEST_ASSERT_EQUAL(700, summary.min_us);
+    TEST_ASSERT_EQUAL(700, summary.p99_us);
+    frame_stats_delete(stats);
+}
+
+typedef struct {
+    pthread_mutex_t mutex;
+    int depth;
+    int calls;
+    int nested;
+} test_lock_t;
+
+static void test_lock_take(void *arg)
+{
+    test_lock_t *lock = arg;
+    pthread_mutex_lock(&lock->mutex);
+    lock->nested += lock->depth != 0;
+    lock->depth++;
+    lock->calls++;
+}
+
+static void test_lock_give(void *arg)
+{
+    test_lock_t *lock = arg;
+    lock->depth--;
+    pthread_mutex_unlock(&lock->mutex);
+}
+
+static void test_lock_hooks(void)
+{
+    test_lock_t lock = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+    const frame_stats_config_t config = {
+        .name = "locked",
+        .window = 4,
+        .lock = test_lock_take,
+        .unlock = test_lock_give,
+        .lock_arg = &lock,
+    };
+    frame_stats_handle_t stats = NULL;
+    frame_stats_summary_t summary;
+
+    TEST_ASSERT_EQUAL(ESP_OK, frame_stats_create(&config, &stats));
+    frame_stats_add(stats, 0, 100);
+    frame_stats_drop(stats, 1);
+    frame_stats_get(stats, &summary);
+    frame_stats_reset(stats);
+    TEST_ASSERT_EQUAL(4, lock.calls);
+    TEST_ASSERT_EQUAL(0, lock.depth);
+    TEST_ASSERT_EQUAL(0, lock.nested);
+    frame_stats_delete(stats);
+
+    const frame_stats_config_t bad[] = {
+        { .name = NULL, .window = 4 },
+        { .name = "stage", .window = 1 },
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_stats_create(&bad[i], &stats));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_stats_create(NULL, &stats));
+}
+
+#define WRITER_FRAMES   (20000)
+
+typedef struct {
+    frame_stats_handle_t stats;
+    int64_t base_us;
+} writer_arg_t;
+
+static void *writer(void *arg)
+{
+    writer_arg_t *w = arg;
+
+    for (int i = 0; i < WRITER_FRAMES; i++) {
+        frame_stats_add(w->stats, w->base_us + i, w->base_us + i + 1000);
+        if (i % 100 == 0) {
+            frame_stats_drop(w->stats, 1);
+        }
+    }
+    return NULL;
+}
+
+static void test_concurrent_writers_and_reader(void)
+{
+    test_lock_t lock = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+    const frame_stats_config_t config = {
+        .name = "shared",
+        .window = 128,
+        .lock = test_lock_take,
+        .unlock = test_lock_give,
+        .lock_arg = &lock,
+    };
+    writer_arg_t args[2];
+    pthread_t threads[2];
+    frame_stats_handle_t stats = NULL;
+    frame_stats_summary_t summary;
+    uint32_t odd = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, frame_stats_create(&config, &stats));
+    for (int i = 0; i < 2; i++) {
+        args[i] = (writer_arg_t) {
+            .stats = stats, .base_us = i * 1000000LL
+        };
+        pthread_create(&threads[i], NULL, writer, &args[i]);
+    }
+    /* Every frame lasts 1000 us, a reader racing the writers must never see anything else */
+    for (int i = 0; i < 2000; i++) {
+        frame_stats_get(stats, &summary);
+        odd += summary.count > 0 && (summary.min_us != 1000 || summary.max_us != 1000);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    frame_stats_get(stats, &summary);
+    frame_stats_delete(stats);
+
+    TEST_ASSERT_EQUAL(0, odd);
+    TEST_ASSERT_EQUAL(2 * WRITER_FRAMES, summary.total);
+    TEST_ASSERT_EQUAL(2 * WRITER_FRAMES / 100, summary.drops);
+    TEST_ASSERT_EQUAL(0, lock.nested);
+}
+
+int main(void)
+{
+    RUN_TEST(test_window_keeps_last_frames);
+    RUN_TEST(test_percentile);
+    RUN_TEST(test_fps);
+    RUN_TEST(test_drops_and_reset);
+    RUN_TEST(test_lock_hooks);
+    RUN_TEST(test_concurrent_writers_and_reader);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,227 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * frame_swap between a decoder-like writer and a display-like reader: the
+ * latest-frame handoff and pinning on one thread, then both sides on their own
+ * threads, checking that the writer never touches the buffer on screen,
+ * that the display only moves forward and that every frame is either
+ * displayed or counted as dropped.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_heap_caps.h"
+#include "frame_swap.h"
+
+#define BUFFER_BYTES    (8192)
+
+static void test_display_takes_latest_only(void)
+{
+    frame_swap_handle_t swap = NULL;
+    frame_swap_stats_t stats;
+
+    TEST_ASSERT_EQUAL(ESP_OK, frame_swap_create(BUFFER_BYTES, MALLOC_CAP_SPIRAM, &swap));
+    TEST_ASSERT_NULL(frame_swap_acquire_latest(swap));
+    TEST_ASSERT_FALSE(frame_swap_wait(swap, 0));
+
+    /* Three frames before the display looks: it gets the third */
+    for (uint32_t seq = 1; seq <= 3; seq++) {
+        frame_slot_t *slot = frame_swap_begin_write(swap);
+        slot->seq = seq;
+        frame_swap_publish(swap, slot);
+    }
+    TEST_ASSERT_TRUE(frame_swap_wait(swap, 0));
+    frame_slot_t *shown = frame_swap_acquire_latest(swap);
+    TEST_ASSERT_NOT_NULL(shown);
+    TEST_ASSERT_EQUAL(3, shown->seq);
+    TEST_ASSERT_NULL(frame_swap_acquire_latest(swap));
+
+    /* The writer only gets the other buffer from now on */
+    for (int i = 0; i < 4; i++) {
+        frame_slot_t *slot = frame_swap_begin_write(swap);
+        TEST_ASSERT(slot != shown);
+        TEST_ASSERT_EQUAL(0, slot->len);
+        slot->seq = 10 + i;
+        frame_swap_publish(swap, slot);
+    }
+    frame_slot_t *next = frame_swap_acquire_latest(swap);
+    TEST_ASSERT(next != shown);
+    TEST_ASSERT_EQUAL(13, next->seq);
+
+    /* An aborted frame is never shown */
+    frame_slot_t *slot = frame_swap_begin_write(swap);
+    TEST_ASSERT(slot == shown);
+    slot->seq = 20;
+    frame_swap_abort(swap, slot);
+    TEST_ASSERT_NULL(frame_swap_acquire_latest(swap));
+
+    frame_swap_get_stats(swap, &stats);
+    TEST_ASSERT_EQUAL(7, stats.published);
+    TEST_ASSERT_EQUAL(2, stats.displayed);
+    TEST_ASSERT_EQUAL(5, stats.dropped);
+    frame_swap_delete(swap);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, frame_swap_create(0, 0, &swap));
+}
+
+static void test_wait_timeout(void)
+{
+    frame_swap_handle_t swap = NULL;
+
+    TEST_ASSERT_EQUAL(ESP_OK, frame_swap_create(BUFFER_BYTES, MALLOC_CAP_SPIRAM, &swap));
+    const int64_t start = host_time_ns();
+    TEST_ASSERT_FALSE(frame_swap_wait(swap, pdMS_TO_TICKS(20)));
+    const int64_t waited_ms = (host_time_ns() - start) / 1000000;
+    TEST_ASSERT_GREATER_OR_EQUAL(15, waited_ms);
+    TEST_ASSERT_LESS_OR_EQUAL(1000, waited_ms);
+    frame_swap_delete(swap);
+}
+
+static void test_pin_holds_the_frame_on_screen(void)
+{
+    frame_swap_handle_t swap = NULL;
+
+    TEST_ASSERT_EQUAL(ESP_OK, frame_swap_create(BUFFER_BYTES, MALLOC_CAP_SPIRAM, &swap));
+    TEST_ASSERT_NULL(frame_swap_pin(swap));
+    frame_slot_t *slot = frame_swap_begin_write(swap);
+    slot->seq = 1;
+    frame_swap_publish(swap, slot);
+    frame_slot_t *shown = frame_swap_acquire_latest(swap);
+
+    /* Pinned: newer frames wait in the other buffer, the display neither takes nor waits for them */
+    TEST_ASSERT(frame_swap_pin(swap) == shown);
+    for (uint32_t seq = 2; seq <= 4; seq++) {
+        slot = frame_swap_begin_write(swap);
+        TEST_ASSERT(slot != shown);
+        slot->seq = seq;
+        frame_swap_publish(swap, slot);
+    }
+    TEST_ASSERT_NULL(frame_swap_acquire_latest(swap));
+    TEST_ASSERT_EQUAL(1, shown->seq);
+    TEST_ASSERT_TRUE(frame_swap_wait(swap, 0));
+    TEST_ASSERT_FALSE(frame_swap_wait(swap, 0));
+
+    /* Unpinned: the latest one is shown, the display is woken for it */
+    frame_swap_unpin(swap);
+    TEST_ASSERT_TRUE(frame_swap_wait(swap, 0));
+    frame_slot_t *next = frame_swap_acquire_latest(swap);
+    TEST_ASSERT_NOT_NULL(next);
+    TEST_ASSERT_EQUAL(4, next->seq);
+    frame_swap_delete(swap);
+}
+
+typedef struct {
+    frame_swap_handle_t swap;
+    uint32_t frames;
+    atomic_bool writer_done;
+    /* Display results */
+    uint32_t shown;
+    uint32_t backwards;
+    uint32_t torn;
+} stress_t;
+
+static bool intact(const frame_slot_t *slot)
+{
+    if (slot->len != BUFFER_BYTES - slot->seq % 1024) {
+        return false;
+    }
+    for (size_t i = 0; i < slot->len; i++) {
+        if (slot->data[i] != (uint8_t)slot->seq) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *writer(void *arg)
+{
+    stress_t *st = arg;
+    uint32_t seed = 11;
+
+    for (uint32_t seq = 1; seq <= st->frames; seq++) {
+        frame_slot_t *slot = frame_swap_begin_write(st->swap);
+        slot->len = BUFFER_BYTES - seq % 1024;
+        slot->seq = seq;
+        memset(slot->data, (uint8_t)seq, slot->len);
+        if (host_rand(&seed) % 50 == 0) {
+            frame_swap_abort(st->swap, slot);
+        } else {
+            frame_swap_publish(st->swap, slot);
+        }
+        if (host_rand(&seed) % 4 == 0) {
+            sched_yield();
+        }
+    }
+    atomic_store(&st->writer_done, true);
+    return NULL;
+}
+
+static void *display(void *arg)
+{
+    stress_t *st = arg;
+    const frame_slot_t *on_screen = NULL;
+    uint32_t last = 0;
+    uint32_t seed = 13;
+
+    while (!atomic_load(&st->writer_done) || frame_swap_wait(st->swap, 0)) {
+        if (!frame_swap_wait(st->swap, pdMS_TO_TICKS(5))) {
+            continue;
+        }
+        frame_slot_t *slot = frame_swap_acquire_latest(st->swap);
+        if (slot == NULL) {
+            continue;
+        }
+        on_screen = slot;
+        st->backwards += on_screen->seq <= last;
+        last = on_screen->seq;
+        st->torn += !intact(on_screen);
+        /* The panel reads the buffer for a while, the writer keeps going meanwhile */
+        for (uint32_t spin = host_rand(&seed) % 50000; spin > 0; spin--) {
+            __asm__ volatile("");
+        }
+        st->torn += !intact(on_screen);
+        st->shown++;
+    }
+    return NULL;
+}
+
+static void test_writer_display_stress(void)
+{
+    stress_t st = { .frames = 50000 };
+    frame_swap_stats_t stats;
+    pthread_t threads[2];
+
+    TEST_ASSERT_EQUAL(ESP_OK, frame_swap_create(BUFFER_BYTES, MALLOC_CAP_SPIRAM, &st.swap));
+    pthread_create(&threads[0], NULL, display, &st);
+    pthread_create(&threads[1], NULL, writer, &st);
+    pthread_join(threads[1], NULL);
+    pthread_join(threads[0], NULL);
+    frame_swap_get_stats(st.swap, &stats);
+    frame_swap_delete(st.swap);
+
+    if (st.torn || st.backwards) {
+        HOST_TEST_FAIL("%" PRIu32 " torn frames, %" PRIu32 " went backwards", st.torn, st.backwards);
+    }
+    TEST_ASSERT_EQUAL(st.shown, stats.displayed);
+    TEST_ASSERT_EQUAL(stats.published, stats.displayed + stats.dropped);
+    TEST_ASSERT(stats.displayed > 0);
+    printf("%" PRIu32 " published, %" PRIu32 " displayed, %" PRIu32 " dropped\n",
+           stats.published, stats.displayed, stats.dropped);
+}
+
+int main(void)
+{
+    RUN_TEST(test_display_takes_latest_only);
+    RUN_TEST(test_wait_timeout);
+    RUN_TEST(test_pin_holds_the_frame_on_screen);
+    RUN_TEST(test_writer_display_stress);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,329 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * jpeg_backend_soft through a jpeg_session on the generated MJPEG corpus:
+ * each sampling, with and without Huffman tables and restart markers,
+ * decodes close to the scene it was encoded from; RGB565 is RGB888 packed,
+ * rotations move the pixels and nothing else, DCT-domain scaling stays
+ * close to a box filter of the full frame, and cut or damaged frames fail
+ * or decode without reading or writing out of bounds.
+ *
+ * The corpus encoder is written alongside the decoder and could share its
+ * misreadings of T.81, so frames of the same scene encoded by libjpeg
+ * (islow DCT, standard tables, data/ passed as the first argument) have to
+ * decode as close to the scene as libjpeg decodes them itself.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "jpeg_session.h"
+#include "mjpeg_corpus.h"
+
+#define JPEG_CAPACITY   (512 * 1024)
+
+static uint8_t s_jpeg[JPEG_CAPACITY];
+static const char *s_data_dir;
+
+/* The session default, target only, every session here names jpeg_backend_soft */
+const jpeg_backend_t jpeg_backend_esp = {
+    .name = "esp, not on the host",
+};
+
+static double psnr(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    double sum = 0;
+    for (size_t i = 0; i < len; i++) {
+        const int d = a[i] - b[i];
+        sum += d * d;
+    }
+    return (sum == 0) ? 99 : 10 * log10(255.0 * 255.0 * len / sum);
+}
+
+static jpeg_session_handle_t open_session(jpeg_raw_type_t type, jpeg_rotate_t rotate)
+{
+    const jpeg_session_config_t config = {
+        .output_type = type,
+        .rotate = rotate,
+        .backend = &jpeg_backend_soft,
+    };
+    jpeg_session_handle_t session = NULL;
+    return (jpeg_session_create(&config, &session) == ESP_OK) ? session : NULL;
+}
+
+static void test_matches_scene(void)
+{
+    static const struct {
+        const char *name;
+        int width;
+        int height;
+        bool grayscale;
+        uint8_t h;
+        uint8_t v;
+        bool omit_dht;
+        uint16_t restart;
+        double min_psnr;
+    } cases[] = {
+        { "4:4:4", 320, 240, false, 1, 1, false, 0, 39 },
+        { "4:2:2 uvc", 320, 240, false, 2, 1, true, 0, 35 },
+        { "4:2:0", 320, 240, false, 2, 2, false, 0, 32 },
+        { "4:4:0", 320, 240, false, 1, 2, false, 0, 34 },
+        { "4:2:0 restarts", 320, 240, false, 2, 2, false, 7, 32 },
+        { "4:2:2 odd size", 100, 61, false, 2, 1, true, 3, 31 },
+        { "gray odd size", 99, 37, true, 1, 1, false, 5, 39 },
+    };
+    jpeg_session_handle_t session = open_session(JPEG_RAW_TYPE_RGB888, JPEG_ROTATE_0D);
+    jpeg_session_frame_t frame;
+    TEST_ASSERT_NOT_NULL(session);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const mjpeg_corpus_config_t config = {
+            .width = cases[i].width,
+            .height = cases[i].height,
+            .quality = 90,
+            .grayscale = cases[i].grayscale,
+            .h_samp = cases[i].h,
+            .v_samp = cases[i].v,
+            .omit_dht = cases[i].omit_dht,
+            .restart_interval = cases[i].restart,
+        };
+        const size_t pixels = (size_t)config.width * config.height;
+        uint8_t *scene = malloc(pixels * 3);
+        mjpeg_corpus_scene(config.width, config.height, (int)i * 5, scene);
+        const size_t len = mjpeg_corpus_encode(&config, scene, s_jpeg, sizeof(s_jpeg));
+        TEST_ASSERT(len > 0);
+
+        if (jpeg_session_decode(session, s_jpeg, len, &frame) != ESP_OK) {
+            free(scene);
+            HOST_TEST_FAIL("%s: decode failed", cases[i].name);
+        }
+        TEST_ASSERT_EQUAL(config.width, frame.width);
+        TEST_ASSERT_EQUAL(config.height, frame.height);
+        if (config.grayscale) {
+            /* Gray comes out as R = G = B = the luma of the scene */
+            for (size_t p = 0; p < pixels; p++) {
+                const uint8_t *px = scene + p * 3;
+                scene[p * 3] = scene[p * 3 + 1] = scene[p * 3 + 2] = (uint8_t)lrintf(0.299f * px[0] + 0.587f * px[1] + 0.114f * px[2]);
+            }
+        }
+        const double db = psnr(scene, frame.data, pixels * 3);
+        free(scene);
+        printf("%-16s %5zu bytes %6.1f dB\n", cases[i].name, len, db);
+        if (db < cases[i].min_psnr) {
+            HOST_TEST_FAIL("%s: %.1f dB, expected %.1f at least", cases[i].name, db, cases[i].min_psnr);
+        }
+    }
+    jpeg_session_delete(session);
+}
+
+static void test_independent_encoder(void)
+{
+    /* libjpeg's own decode gives 39.1 and 34.9 dB, its smoothed chroma upsampling makes most of the gap */
+    static const struct {
+        const char *file;
+        int width;
+        int height;
+        int frame;
+        double min_psnr;
+    } cases[] = {
+        { "libjpeg_422_rst.jpg", 320, 240, 3, 37.5 },
+        { "libjpeg_420_odd_rst.jpg", 101, 67, 8, 32.5 },
+    };
+    jpeg_session_handle_t session = open_session(JPEG_RAW_TYPE_RGB888, JPEG_ROTATE_0D);
+    jpeg_session_frame_t frame;
+    char path[256];
+    TEST_ASSERT_NOT_NULL(s_data_dir);
+    TEST_ASSERT_NOT_NULL(session);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", s_data_dir, cases[i].file);
+        FILE *file = fopen(path, "rb");
+        if (file == NULL) {
+            HOST_TEST_FAIL("%s: can not open", path);
+        }
+        const size_t len = fread(s_jpeg, 1, sizeof(s_jpeg), file);
+        fclose(file);
+        TEST_ASSERT(len > 0 && len < sizeof(s_jpeg));
+
+        if (jpeg_session_decode(session, s_jpeg, len, &frame) != ESP_OK) {
+            HOST_TEST_FAIL("%s: decode failed", cases[i].file);
+        }
+        TEST_ASSERT_EQUAL(cases[i].width, frame.width);
+        TEST_ASSERT_EQUAL(cases[i].height, frame.height);
+        const size_t pixels = (size_t)frame.width * frame.height;
+        uint8_t *scene = malloc(pixels * 3);
+        mjpeg_corpus_scene(frame.width, frame.height, cases[i].frame, scene);
+        const double db = psnr(scene, frame.data, pixels * 3);
+        free(scene);
+        printf("%-24s %5zu bytes %6.1f dB\n", cases[i].file, len, db);
+        if (db < cases[i].min_psnr) {
+            HOST_TEST_FAIL("%s: %.1f dB, expected %.1f at least", cases[i].file, db, cases[i].min_psnr);
+        }
+    }
+    jpeg_session_delete(session);
+}
+
+static void test_rgb565_and_rotations(void)
+{
+    const mjpeg_corpus_config_t config = MJPEG_CORPUS_DEFAULT_CONFIG(72, 40);
+    const size_t len = mjpeg_corpus_frame(&config, 3, s_jpeg, sizeof(s_jpeg));
+    const size_t pixels = (size_t)config.width * config.height;
+    jpeg_session_frame_t frame;
+    TEST_ASSERT(len > 0);
+
+    jpeg_session_handle_t session = open_session(JPEG_RAW_TYPE_RGB888, JPEG_ROTATE_0D);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, s_jpeg, len, &frame));
+    uint8_t *rgb = malloc(pixels * 3);
+    memcpy(rgb, frame.data, pixels * 3);
+
+    /* RGB565 is the RGB888 output truncated, in either byte order */
+    for (int big_endian = 0; big_endian <= 1; big_endian++) {
+        TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_set_output(session, big_endian ? JPEG_RAW_TYPE_RGB565_BE : JPEG_RAW_TYPE_RGB565_LE,
+                                                          JPEG_ROTATE_0D));
+        TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, s_jpeg, len, &frame));
+        TEST_ASSERT_EQUAL(pixels * 2, frame.size);
+        for (size_t p = 0; p < pixels; p++) {
+            const uint8_t *px = rgb + p * 3;
+            const uint16_t expected = ((px[0] & 0xF8) << 8) | ((px[1] & 0xFC) << 3) | (px[2] >> 3);
+            const uint16_t got = big_endian ? (frame.data[p * 2] << 8) | frame.data[p * 2 + 1]
+                                 : frame.data[p * 2] | (frame.data[p * 2 + 1] << 8);
+            if (got != expected) {
+                free(rgb);
+                HOST_TEST_FAIL("%s pixel %zu: 0x%04x, expected 0x%04x", big_endian ? "BE" : "LE", p, got, expected);
+            }
+        }
+    }
+
+    /* Rotated clockwise: the output pixel (x, y) is the source pixel found by turning back */
+    static const jpeg_rotate_t rotations[] = { JPEG_ROTATE_90D, JPEG_ROTATE_180D, JPEG_ROTATE_270D };
+    for (size_t r = 0; r < 3; r++) {
+        const int w = config.width;
+        const int h = config.height;
+        TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_set_output(session, JPEG_RAW_TYPE_RGB888, rotations[r]));
+        TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, s_jpeg, len, &frame));
+        TEST_ASSERT_EQUAL((r == 1) ? w : h, frame.width);
+        TEST_ASSERT_EQUAL((r == 1) ? h : w, frame.height);
+        for (int y = 0; y < frame.height; y++) {
+            for (int x = 0; x < frame.width; x++) {
+                const int sx = (r == 0) ? y : (r == 1) ? w - 1 - x : w - 1 - y;
+                const int sy = (r == 0) ? h - 1 - x : (r == 1) ? h - 1 - y : x;
+                if (memcmp(frame.data + ((size_t)y * frame.width + x) * 3, rgb + ((size_t)sy * w + sx) * 3, 3) != 0) {
+                    free(rgb);
+                    HOST_TEST_FAIL("rotation %zu: pixel (%d, %d) differs", r + 1, x, y);
+                }
+            }
+        }
+    }
+    free(rgb);
+    jpeg_session_delete(session);
+}
+
+static void test_scaling(void)
+{
+    const mjpeg_corpus_config_t config = MJPEG_CORPUS_DEFAULT_CONFIG(320, 240);
+    const size_t len = mjpeg_corpus_frame(&config, 9, s_jpeg, sizeof(s_jpeg));
+    jpeg_session_frame_t frame;
+    TEST_ASSERT(len > 0);
+
+    jpeg_session_handle_t session = open_session(JPEG_RAW_TYPE_RGB888, JPEG_ROTATE_0D);
+    TEST_ASSERT_EQUAL(3, jpeg_session_get_max_scale_shift(session));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, s_jpeg, len, &frame));
+    uint8_t *full = malloc(frame.size);
+    memcpy(full, frame.data, frame.size);
+
+    /* Coarser scales keep fewer coefficients of the blocks the box filter crosses */
+    static const double min_psnr[] = { 0, 34, 32, 26 };
+    for (uint8_t shift = 1; shift <= 3; shift++) {
+        const int n = 1 << shift;
+        TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_set_scale(session, shift));
+        TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, s_jpeg, len, &frame));
+        TEST_ASSERT_EQUAL(shift, frame.scale_shift);
+        TEST_ASSERT_EQUAL(config.width / n, frame.width);
+        TEST_ASSERT_EQUAL(config.height / n, frame.height);
+
+        /* Each output pixel is about the average of the n x n pixels it covers */
+        uint8_t *box = malloc(frame.size);
+        for (int y = 0; y < frame.height; y++) {
+            for (int x = 0; x < frame.width; x++) {
+                for (int c = 0; c < 3; c++) {
+                    int sum = 0;
+                    for (int dy = 0; dy < n; dy++) {
+                        for (int dx = 0; dx < n; dx++) {
+                            sum += full[((size_t)(y * n + dy) * config.width + x * n + dx) * 3 + c];
+                        }
+                    }
+                    box[((size_t)y * frame.width + x) * 3 + c] = (sum + n * n / 2) / (n * n);
+                }
+            }
+        }
+        const double db = psnr(box, frame.data, frame.size);
+        free(box);
+        printf("1/%d: %.1f dB against a box filter\n", n, db);
+        if (db < min_psnr[shift]) {
+            free(full);
+            HOST_TEST_FAIL("1/%d: %.1f dB against a box filter", n, db);
+        }
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, jpeg_session_set_scale(session, 4));
+    free(full);
+    jpeg_session_delete(session);
+}
+
+static void test_damaged_frames(void)
+{
+    mjpeg_corpus_config_t config = MJPEG_CORPUS_DEFAULT_CONFIG(96, 64);
+    config.restart_interval = 4;
+    const size_t len = mjpeg_corpus_frame(&config, 1, s_jpeg, sizeof(s_jpeg));
+    jpeg_session_stats_t stats;
+    jpeg_session_frame_t frame;
+    uint32_t seed = 29;
+    int decoded = 0;
+    TEST_ASSERT(len > 0);
+
+    /* Exact size copies, so ASan sees any read past the end */
+    jpeg_session_handle_t session = open_session(JPEG_RAW_TYPE_RGB565_LE, JPEG_ROTATE_0D);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpeg_session_decode(session, s_jpeg, 0, &frame));
+    for (size_t cut = 1; cut < len; cut += 1 + cut / 16) {
+        uint8_t *copy = malloc(cut + 1);
+        memcpy(copy, s_jpeg, cut);
+        const esp_err_t ret = jpeg_session_decode(session, copy, cut, &frame);
+        free(copy);
+        TEST_ASSERT(ret == ESP_OK || ret == ESP_FAIL);
+        decoded += ret == ESP_OK;
+    }
+    for (int round = 0; round < 500; round++) {
+        uint8_t *copy = malloc(len);
+        memcpy(copy, s_jpeg, len);
+        for (int k = 1 + round % 4; k > 0; k--) {
+            copy[host_rand(&seed) % len] = (uint8_t)host_rand(&seed);
+        }
+        const esp_err_t ret = jpeg_session_decode(session, copy, len, &frame);
+        free(copy);
+        TEST_ASSERT(ret == ESP_OK || ret == ESP_FAIL || ret == ESP_ERR_NOT_SUPPORTED);
+        decoded += ret == ESP_OK;
+    }
+
+    /* Still decodes the intact frame */
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, s_jpeg, len, &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT(stats.errors > 0);
+    printf("%d damaged frames decoded, %" PRIu32 " refused\n", decoded, stats.errors);
+    jpeg_session_delete(session);
+}
+
+int main(int argc, char **argv)
+{
+    s_data_dir = (argc > 1) ? argv[1] : NULL;
+    RUN_TEST(test_matches_scene);
+    RUN_TEST(test_independent_encoder);
+    RUN_TEST(test_rgb565_and_rotations);
+    RUN_TEST(test_scaling);
+    RUN_TEST(test_damaged_frames);
+    return HOST_TEST_END();
+}
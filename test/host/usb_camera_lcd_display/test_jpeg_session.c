@@ -0,0 +1,408 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * jpeg_session on MJPEG sequences of the corpus scene through the soft
+ * backend: a steady stream allocates nothing, counted from the audio_mem
+ * counters the decoder allocates through, and a resolution change reopens
+ * the decoder and only grows the output buffer. Then a mock backend whose
+ * "frames" carry their own size: the decoder is opened once per output
+ * format or scale, and errors leave the session usable.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_heap_caps.h"
+#include "audio_malloc.h"
+#include "jpeg_session.h"
+#include "mjpeg_corpus.h"
+
+/* A mock frame: width and height, then a flag byte */
+#define MOCK_FRAME_CORRUPT  (1 << 0)
+
+#define MJPEG_CAPACITY      (256 * 1024)
+
+typedef struct {
+    jpeg_backend_config_t config;
+    jpeg_backend_info_t info;
+    int parsed;
+} mock_decoder_t;
+
+static struct {
+    int opens;
+    int closes;
+    int open_failures;          /* Next opens to fail */
+    int live;                   /* Decoders open */
+} mock;
+
+static void mock_frame(uint8_t *frame, uint16_t width, uint16_t height, uint8_t flags)
+{
+    frame[0] = width & 0xFF;
+    frame[1] = width >> 8;
+    frame[2] = height & 0xFF;
+    frame[3] = height >> 8;
+    frame[4] = flags;
+}
+
+static esp_err_t mock_open(const jpeg_backend_config_t *config, void **ret_decoder)
+{
+    if (mock.open_failures > 0) {
+        mock.open_failures--;
+        return ESP_ERR_NO_MEM;
+    }
+    mock_decoder_t *dec = audio_calloc(1, sizeof(mock_decoder_t));
+    dec->config = *config;
+    mock.opens++;
+    mock.live++;
+    *ret_decoder = dec;
+    return ESP_OK;
+}
+
+static esp_err_t mock_parse(void *decoder, const uint8_t *data, size_t len, jpeg_backend_info_t *info)
+{
+    mock_decoder_t *dec = decoder;
+    if (len < 5 || (data[4] & MOCK_FRAME_CORRUPT)) {
+        return ESP_FAIL;
+    }
+    dec->info.width = data[0] | data[1] << 8;
+    dec->info.height = data[2] | data[3] << 8;
+    dec->info.out_width = dec->info.width >> dec->config.scale_shift;
+    dec->info.out_height = dec->info.height >> dec->config.scale_shift;
+    dec->parsed = 1;
+    *info = dec->info;
+    return ESP_OK;
+}
+
+static esp_err_t mock_decode(void *decoder, uint8_t *out_buf)
+{
+    mock_decoder_t *dec = decoder;
+    const int bpp = dec->config.output_type == JPEG_RAW_TYPE_RGB888 ? 3 : 2;
+    if (!dec->parsed) {
+        return ESP_FAIL;
+    }
+    /* Every byte of the frame, so an undersized buffer shows up under ASan */
+    memset(out_buf, 0x5A, (size_t)dec->info.out_width * dec->info.out_height * bpp);
+    return ESP_OK;
+}
+
+static size_t mock_get_memory(void *decoder)
+{
+    return sizeof(mock_decoder_t);
+}
+
+static void mock_close(void *decoder)
+{
+    mock.closes++;
+    mock.live--;
+    audio_free(decoder);
+}
+
+static const jpeg_backend_t mock_backend = {
+    .name = "mock",
+    .max_scale_shift = 3,
+    .open = mock_open,
+    .parse = mock_parse,
+    .decode = mock_decode,
+    .get_memory = mock_get_memory,
+    .close = mock_close,
+};
+
+/* The session falls back to jpeg_backend_esp, which is target only */
+const jpeg_backend_t jpeg_backend_esp = {
+    .name = "esp mock",
+    .max_scale_shift = 0,
+    .open = mock_open,
+    .parse = mock_parse,
+    .decode = mock_decode,
+    .close = mock_close,
+};
+
+static jpeg_session_handle_t create_session(const jpeg_backend_t *backend)
+{
+    const jpeg_session_config_t config = {
+        .output_type = JPEG_RAW_TYPE_RGB565_LE,
+        .rotate = JPEG_ROTATE_0D,
+        .out_caps = MALLOC_CAP_SPIRAM,
+        .backend = backend,
+    };
+    jpeg_session_handle_t session = NULL;
+
+    memset(&mock, 0, sizeof(mock));
+    if (jpeg_session_create(&config, &session) != ESP_OK) {
+        return NULL;
+    }
+    return session;
+}
+
+/* Every allocation the decoders and the session make, across the codec pools */
+static uint32_t codec_allocs(void)
+{
+    uint32_t allocs = 0;
+    for (int i = 0; i < AUDIO_MEM_POOL_MAX; i++) {
+        audio_mem_stats_t stats;
+        audio_mem_get_stats(i, &stats);
+        allocs += stats.allocs + stats.untracked;
+    }
+    return allocs;
+}
+
+/* Frame `frame` of the corpus sequence at this size, as the camera sends it, 0 fails the decode */
+static size_t mjpeg_frame(int width, int height, int frame, uint8_t *out)
+{
+    const mjpeg_corpus_config_t config = MJPEG_CORPUS_DEFAULT_CONFIG(width, height);
+    return mjpeg_corpus_frame(&config, frame, out, MJPEG_CAPACITY);
+}
+
+static void test_steady_stream_does_not_allocate(void)
+{
+    jpeg_session_handle_t session = create_session(&jpeg_backend_soft);
+    jpeg_session_frame_t frame;
+    jpeg_session_stats_t stats;
+    host_heap_caps_stats_t heap_before, heap_after;
+    uint8_t *data = malloc(MJPEG_CAPACITY);
+    size_t len;
+
+    TEST_ASSERT_NOT_NULL(session);
+    TEST_ASSERT_NOT_NULL(data);
+    len = mjpeg_frame(320, 240, 0, data);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, len, &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(1, stats.reopens);
+    TEST_ASSERT_EQUAL(2, stats.allocs_last_frame);      /* Decoder and output buffer */
+    TEST_ASSERT_EQUAL(320 * 240 * 2, stats.out_bytes);
+
+    /* The moving scene changes every frame, nothing in the decoder allocates per frame */
+    for (int i = 1; i < 60; i++) {
+        len = mjpeg_frame(320, 240, i, data);
+        host_heap_caps_get_stats(&heap_before);
+        const uint32_t codec = codec_allocs();
+        TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, len, &frame));
+        host_heap_caps_get_stats(&heap_after);
+        TEST_ASSERT_EQUAL(heap_before.allocs, heap_after.allocs);
+        TEST_ASSERT_EQUAL(codec, codec_allocs());
+        jpeg_session_get_stats(session, &stats);
+        TEST_ASSERT_EQUAL(0, stats.allocs_last_frame);
+    }
+    TEST_ASSERT_EQUAL(60, stats.frames);
+    TEST_ASSERT_EQUAL(1, stats.reopens);
+    TEST_ASSERT_EQUAL(2, stats.allocs);
+    TEST_ASSERT_EQUAL(320, frame.width);
+    TEST_ASSERT_EQUAL(240, frame.height);
+    TEST_ASSERT_EQUAL(320 * 240 * 2, frame.size);
+
+    jpeg_session_delete(session);
+    free(data);
+}
+
+static void test_resolution_change_reopens_and_regrows(void)
+{
+    jpeg_session_handle_t session = create_session(&jpeg_backend_soft);
+    jpeg_session_frame_t frame;
+    jpeg_session_stats_t stats;
+    uint8_t *data = malloc(MJPEG_CAPACITY);
+    size_t len;
+
+    TEST_ASSERT_NOT_NULL(session);
+    TEST_ASSERT_NOT_NULL(data);
+    len = mjpeg_frame(320, 240, 0, data);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, len, &frame));
+
+    /* Larger: a new decoder and a larger buffer, in the same frame */
+    len = mjpeg_frame(640, 480, 1, data);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, len, &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(2, stats.reopens);
+    TEST_ASSERT_EQUAL(2, stats.allocs_last_frame);
+    TEST_ASSERT_EQUAL(640 * 480 * 2, stats.out_bytes);
+    TEST_ASSERT_EQUAL(640, frame.width);
+
+    /* The new size streams without allocating */
+    len = mjpeg_frame(640, 480, 2, data);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, len, &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(0, stats.allocs_last_frame);
+
+    /* Smaller: a new decoder, the buffer is kept */
+    len = mjpeg_frame(160, 120, 3, data);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, len, &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(3, stats.reopens);
+    TEST_ASSERT_EQUAL(1, stats.allocs_last_frame);
+    TEST_ASSERT_EQUAL(640 * 480 * 2, stats.out_bytes);
+    TEST_ASSERT_EQUAL(160 * 120 * 2, frame.size);
+
+    /* Back up to a size the buffer holds: no new buffer */
+    len = mjpeg_frame(320, 240, 4, data);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, len, &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(4, stats.reopens);
+    TEST_ASSERT_EQUAL(1, stats.allocs_last_frame);
+    TEST_ASSERT_EQUAL(6, stats.allocs);
+    TEST_ASSERT_EQUAL(0, stats.errors);
+
+    jpeg_session_delete(session);
+    free(data);
+}
+
+static void test_output_format_change(void)
+{
+    jpeg_session_handle_t session = create_session(&mock_backend);
+    jpeg_session_frame_t frame;
+    jpeg_session_stats_t stats;
+    uint8_t data[5];
+
+    TEST_ASSERT_NOT_NULL(session);
+    mock_frame(data, 320, 240, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, sizeof(data), &frame));
+
+    /* Setting the current format again is free */
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_set_output(session, JPEG_RAW_TYPE_RGB565_LE, JPEG_ROTATE_0D));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, sizeof(data), &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(1, stats.reopens);
+
+    /* RGB888 reopens once and grows the buffer by half */
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_set_output(session, JPEG_RAW_TYPE_RGB888, JPEG_ROTATE_0D));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, sizeof(data), &frame));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, sizeof(data), &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(2, stats.reopens);
+    TEST_ASSERT_EQUAL(320 * 240 * 3, stats.out_bytes);
+    TEST_ASSERT_EQUAL(320 * 240 * 3, frame.size);
+
+    /* A quarter turn swaps the reported geometry */
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_set_output(session, JPEG_RAW_TYPE_RGB565_BE, JPEG_ROTATE_90D));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, sizeof(data), &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(3, stats.reopens);
+    TEST_ASSERT_EQUAL(240, frame.width);
+    TEST_ASSERT_EQUAL(320, frame.height);
+    TEST_ASSERT_EQUAL(320 * 240 * 3, stats.out_bytes);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpeg_session_set_output(session, JPEG_RAW_TYPE_GRAY, JPEG_ROTATE_0D));
+    jpeg_session_delete(session);
+    TEST_ASSERT_EQUAL(0, mock.live);
+}
+
+static void test_scale(void)
+{
+    jpeg_session_handle_t session = create_session(&mock_backend);
+    jpeg_session_frame_t frame;
+    jpeg_session_stats_t stats;
+    uint8_t data[5];
+
+    TEST_ASSERT_NOT_NULL(session);
+    TEST_ASSERT_EQUAL(3, jpeg_session_get_max_scale_shift(session));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, jpeg_session_set_scale(session, 4));
+
+    mock_frame(data, 640, 480, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_set_scale(session, 2));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, sizeof(data), &frame));
+    TEST_ASSERT_EQUAL(160, frame.width);
+    TEST_ASSERT_EQUAL(120, frame.height);
+    TEST_ASSERT_EQUAL(2, frame.scale_shift);
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(160 * 120 * 2, stats.out_bytes);
+
+    /* Same scale again: no reopen. Full size: reopen and regrow */
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_set_scale(session, 2));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, sizeof(data), &frame));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_set_scale(session, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, data, sizeof(data), &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(2, stats.reopens);
+    TEST_ASSERT_EQUAL(640, frame.width);
+    TEST_ASSERT_EQUAL(0, frame.scale_shift);
+    TEST_ASSERT_EQUAL(640 * 480 * 2, stats.out_bytes);
+    jpeg_session_delete(session);
+
+    /* The default backend does not scale */
+    session = create_session(NULL);
+    TEST_ASSERT_NOT_NULL(session);
+    TEST_ASSERT_EQUAL(0, jpeg_session_get_max_scale_shift(session));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, jpeg_session_set_scale(session, 1));
+    jpeg_session_delete(session);
+}
+
+static void test_decode_to_caller_buffer(void)
+{
+    jpeg_session_handle_t session = create_session(&mock_backend);
+    jpeg_session_frame_t frame;
+    jpeg_session_stats_t stats;
+    uint8_t data[5];
+    uint8_t *buf = heap_caps_aligned_alloc(16, 320 * 240 * 2 + 16, MALLOC_CAP_SPIRAM);
+
+    TEST_ASSERT_NOT_NULL(session);
+    mock_frame(data, 320, 240, 0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpeg_session_decode_to(session, data, sizeof(data), buf + 8, 320 * 240 * 2, &frame));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode_to(session, data, sizeof(data), buf, 320 * 240 * 2, &frame));
+    TEST_ASSERT(frame.data == buf);
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(0, stats.out_bytes);      /* The session buffer is never allocated */
+
+    /* A frame larger than the buffer is refused before decoding, then a fitting one goes through */
+    mock_frame(data, 640, 480, 0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, jpeg_session_decode_to(session, data, sizeof(data), buf, 320 * 240 * 2, &frame));
+    mock_frame(data, 320, 240, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode_to(session, data, sizeof(data), buf, 320 * 240 * 2, &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(1, stats.errors);
+    TEST_ASSERT_EQUAL(2, stats.frames);
+    TEST_ASSERT_EQUAL(0, stats.out_bytes);
+
+    heap_caps_free(buf);
+    jpeg_session_delete(session);
+}
+
+static void test_errors_leave_session_usable(void)
+{
+    jpeg_session_handle_t session = create_session(&mock_backend);
+    jpeg_session_frame_t frame;
+    jpeg_session_stats_t stats;
+    uint8_t good[5], bad[5];
+
+    TEST_ASSERT_NOT_NULL(session);
+    mock_frame(good, 320, 240, 0);
+    mock_frame(bad, 320, 240, MOCK_FRAME_CORRUPT);
+
+    /* The decoder fails to open: the next frame tries again */
+    mock.open_failures = 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, jpeg_session_decode(session, good, sizeof(good), &frame));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, good, sizeof(good), &frame));
+
+    /* A corrupted frame costs nothing but itself */
+    TEST_ASSERT_EQUAL(ESP_FAIL, jpeg_session_decode(session, bad, sizeof(bad), &frame));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, good, sizeof(good), &frame));
+    jpeg_session_get_stats(session, &stats);
+    TEST_ASSERT_EQUAL(2, stats.errors);
+    TEST_ASSERT_EQUAL(2, stats.frames);
+    TEST_ASSERT_EQUAL(1, stats.reopens);
+
+    /* A reopen for a new size that fails: the session recovers on the next frame */
+    mock_frame(good, 640, 480, 0);
+    mock.open_failures = 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, jpeg_session_decode(session, good, sizeof(good), &frame));
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_session_decode(session, good, sizeof(good), &frame));
+    TEST_ASSERT_EQUAL(640, frame.width);
+    TEST_ASSERT_EQUAL(1, mock.live);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpeg_session_decode(session, good, 0, &frame));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpeg_session_decode(NULL, good, sizeof(good), &frame));
+    jpeg_session_delete(session);
+    TEST_ASSERT_EQUAL(0, mock.live);
+}
+
+int main(void)
+{
+    RUN_TEST(test_steady_stream_does_not_allocate);
+    RUN_TEST(test_resolution_change_reopens_and_regrows);
+    RUN_TEST(test_output_format_change);
+    RUN_TEST(test_scale);
+    RUN_TEST(test_decode_to_caller_buffer);
+    RUN_TEST(test_errors_leave_session_usable);
+    return HOST_TEST_END();
+}
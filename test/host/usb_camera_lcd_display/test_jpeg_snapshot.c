@@ -0,0 +1,320 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * jpeg_snapshot on a stub block encoder: the frame is fed in bands of 16
+ * rows and the last one is padded with the last row, every band comes out
+ * as one chunk in order, the RGB565 to YCbYCr conversion in both byte
+ * orders, sink and encoder failures, and when the encoder is reopened.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_jpeg_enc.h"
+#include "jpeg_snapshot.h"
+
+#define MAX_W           (320)
+#define MAX_H           (240)
+#define BAND_ROWS       (16)
+#define HEADER_BYTES    (600)
+
+/* Stub block encoder: keeps every band it is given, and writes for each a chunk of its index */
+static struct {
+    int opens;
+    int closes;
+    int quality;
+    int width;
+    int height;
+    int bands;                  /* Bands of the current or last image */
+    int next;
+    int fail_at;                /* Band that fails, -1 for none */
+    uint8_t image[MAX_W * 2 * (MAX_H + BAND_ROWS)];
+} enc;
+
+static int stub_handle;
+
+void *jpeg_enc_open(jpeg_enc_info_t *info)
+{
+    enc.opens++;
+    enc.quality = info->quality;
+    enc.width = info->width;
+    enc.height = info->height;
+    enc.bands = 0;
+    enc.next = 0;
+    return &stub_handle;
+}
+
+int jpeg_enc_get_block_size(const void *handle)
+{
+    return enc.width * 2 * BAND_ROWS;
+}
+
+static size_t chunk_len(int band)
+{
+    return (band == 0 ? HEADER_BYTES : 0) + 100 + band;
+}
+
+int jpeg_enc_process_with_block(const void *handle, const uint8_t *in_buf, int inbuf_size, uint8_t *out_buf,
+                                int outbuf_size, int *out_size)
+{
+    const int band = enc.next++;
+    enc.bands = enc.next;
+    if (band == enc.fail_at || inbuf_size != jpeg_enc_get_block_size(handle) || (size_t)outbuf_size < chunk_len(band)) {
+        return JPEG_ERR_FAIL;
+    }
+    memcpy(enc.image + (size_t)band * inbuf_size, in_buf, inbuf_size);
+    *out_size = (int)chunk_len(band);
+    memset(out_buf, band, *out_size);
+    if ((band + 1) * BAND_ROWS >= enc.height) {
+        enc.next = 0;
+        return JPEG_ERR_OK;
+    }
+    return inbuf_size;
+}
+
+jpeg_error_t jpeg_enc_close(void *handle)
+{
+    enc.closes++;
+    return JPEG_ERR_OK;
+}
+
+jpeg_error_t jpeg_enc_set_quality(const void *handle, uint8_t q)
+{
+    if (q > 95) {
+        return JPEG_ERR_PAR;
+    }
+    enc.quality = q;
+    return JPEG_ERR_OK;
+}
+
+void *jpeg_malloc_align(int size, int aligned)
+{
+    return aligned_alloc(aligned, (size + aligned - 1) / aligned * aligned);
+}
+
+void jpeg_free_align(void *data)
+{
+    free(data);
+}
+
+/* Sink collecting the stream, failing at a given chunk */
+typedef struct {
+    uint8_t data[64 * 1024];
+    size_t len;
+    int chunks;
+    int fail_at;
+} sink_t;
+
+static esp_err_t test_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    sink_t *sink = ctx;
+    if (sink->chunks == sink->fail_at) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if (sink->len + len > sizeof(sink->data)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(sink->data + sink->len, data, len);
+    sink->len += len;
+    sink->chunks++;
+    return ESP_OK;
+}
+
+static uint16_t frame[MAX_W * MAX_H];
+static sink_t sink;
+
+static void reset_sink(void)
+{
+    memset(&sink, 0, sizeof(sink));
+    sink.fail_at = -1;
+}
+
+/* Row y is grey level y, so padding and band order show in the luma */
+static void make_frame(int width, int height)
+{
+    for (int y = 0; y < height; y++) {
+        const int level = y & 0xff;
+        const uint16_t v = (uint16_t)(((level >> 3) << 11) | ((level >> 2) << 5) | (level >> 3));
+        for (int x = 0; x < width; x++) {
+            frame[y * width + x] = (uint16_t)((v >> 8) | (v << 8));
+        }
+    }
+}
+
+static int luma_of_row(int width, int row)
+{
+    return enc.image[(size_t)row * width * 2];
+}
+
+static int expected_luma(int level)
+{
+    /* The 565 grey expanded back to 8 bits, through the BT.601 weights */
+    const int r = ((level >> 3) << 3) | (level >> 5);
+    const int g = ((level >> 2) << 2) | (level >> 6);
+    return (77 * r + 150 * g + 29 * r + 128) >> 8;
+}
+
+static void test_bands_and_chunks(void)
+{
+    static const struct {
+        int w;
+        int h;
+    } sizes[] = {
+        { 320, 240 }, { 320, 100 }, { 160, 17 }, { 64, 16 },
+    };
+    const jpeg_snapshot_config_t config = { .quality = 70, .big_endian = true };
+    jpeg_snapshot_handle_t snap = NULL;
+    jpeg_snapshot_stats_t stats;
+
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_create(&config, &snap));
+    enc.fail_at = -1;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        const int w = sizes[i].w;
+        const int h = sizes[i].h;
+        const int bands = (h + BAND_ROWS - 1) / BAND_ROWS;
+        size_t size = 0;
+
+        make_frame(w, h);
+        reset_sink();
+        TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_encode(snap, (const uint8_t *)frame, w, h, test_sink, &sink, &size));
+        TEST_ASSERT_EQUAL(70, enc.quality);
+        TEST_ASSERT_EQUAL(bands, enc.bands);
+        TEST_ASSERT_EQUAL(bands, sink.chunks);
+
+        /* Each band came out whole and in order */
+        size_t pos = 0;
+        for (int band = 0; band < bands; band++) {
+            for (size_t b = 0; b < chunk_len(band); b++) {
+                if (sink.data[pos + b] != (uint8_t)band) {
+                    HOST_TEST_FAIL("%dx%d: byte %zu of band %d is 0x%02x", w, h, b, band, sink.data[pos + b]);
+                }
+            }
+            pos += chunk_len(band);
+        }
+        TEST_ASSERT_EQUAL(pos, sink.len);
+        TEST_ASSERT_EQUAL(pos, size);
+
+        /* Every row reached the encoder, the rows past the end repeat the last one */
+        for (int row = 0; row < bands * BAND_ROWS; row++) {
+            const int src = row < h ? row : h - 1;
+            TEST_ASSERT_EQUAL(expected_luma(src & 0xff), luma_of_row(w, row));
+        }
+
+        jpeg_snapshot_get_stats(snap, &stats);
+        TEST_ASSERT_EQUAL(i + 1, stats.images);
+        TEST_ASSERT_EQUAL(bands, stats.chunks);
+        TEST_ASSERT_EQUAL(size, stats.bytes);
+        TEST_ASSERT_EQUAL((size_t)w * 2 * BAND_ROWS, stats.band_size);
+    }
+    jpeg_snapshot_delete(snap);
+    TEST_ASSERT_EQUAL(enc.opens, enc.closes);
+}
+
+static void test_colour_conversion(void)
+{
+    static const struct {
+        uint16_t rgb565;
+        uint8_t y;
+        uint8_t cb;
+        uint8_t cr;
+    } colours[] = {
+        { 0x0000, 0,   128, 128 },
+        { 0xffff, 255, 128, 128 },
+        { 0xf800, 76,  85,  255 },
+        { 0x07e0, 149, 43,  21  },
+        { 0x001f, 29,  255, 107 },
+    };
+    jpeg_snapshot_handle_t snap[2] = { NULL, NULL };
+
+    enc.fail_at = -1;
+    for (int big_endian = 0; big_endian <= 1; big_endian++) {
+        const jpeg_snapshot_config_t config = { .big_endian = big_endian };
+        TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_create(&config, &snap[big_endian]));
+        for (size_t c = 0; c < sizeof(colours) / sizeof(colours[0]); c++) {
+            const uint16_t v = colours[c].rgb565;
+            for (int i = 0; i < 16 * 16; i++) {
+                frame[i] = big_endian ? (uint16_t)((v >> 8) | (v << 8)) : v;
+            }
+            reset_sink();
+            TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_encode(snap[big_endian], (const uint8_t *)frame, 16, 16,
+                                                           test_sink, &sink, NULL));
+            TEST_ASSERT_EQUAL(JPEG_SNAPSHOT_DEFAULT_QUALITY, enc.quality);
+            const uint8_t *yuyv = enc.image;
+            if (abs(yuyv[0] - colours[c].y) > 1 || abs(yuyv[2] - colours[c].y) > 1 ||
+                abs(yuyv[1] - colours[c].cb) > 1 || abs(yuyv[3] - colours[c].cr) > 1) {
+                HOST_TEST_FAIL("0x%04x %s: Y %d %d Cb %d Cr %d", v, big_endian ? "BE" : "LE",
+                               yuyv[0], yuyv[2], yuyv[1], yuyv[3]);
+            }
+        }
+        jpeg_snapshot_delete(snap[big_endian]);
+    }
+}
+
+static void test_failures_restart_the_encoder(void)
+{
+    const jpeg_snapshot_config_t config = { .quality = 50 };
+    jpeg_snapshot_handle_t snap = NULL;
+    size_t size = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_create(&config, &snap));
+    make_frame(320, 240);
+    enc.fail_at = -1;
+    const int opens = enc.opens;
+
+    /* Same size twice: one encoder */
+    reset_sink();
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_encode(snap, (const uint8_t *)frame, 320, 240, test_sink, &sink, &size));
+    reset_sink();
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_encode(snap, (const uint8_t *)frame, 320, 240, test_sink, &sink, &size));
+    TEST_ASSERT_EQUAL(opens + 1, enc.opens);
+
+    /* Quality goes to the open encoder, or the next one when it refuses */
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_set_quality(snap, 90));
+    TEST_ASSERT_EQUAL(90, enc.quality);
+    TEST_ASSERT_EQUAL(ESP_FAIL, jpeg_snapshot_set_quality(snap, 99));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpeg_snapshot_set_quality(snap, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpeg_snapshot_set_quality(snap, 101));
+
+    /* A sink error stops at that chunk, the next image starts with a fresh encoder */
+    reset_sink();
+    sink.fail_at = 3;
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT,
+                      jpeg_snapshot_encode(snap, (const uint8_t *)frame, 320, 240, test_sink, &sink, &size));
+    TEST_ASSERT_EQUAL(4, enc.bands);
+    TEST_ASSERT_EQUAL(enc.opens, enc.closes);
+    reset_sink();
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_encode(snap, (const uint8_t *)frame, 320, 240, test_sink, &sink, &size));
+    TEST_ASSERT_EQUAL(opens + 2, enc.opens);
+    TEST_ASSERT_EQUAL(90, enc.quality);
+    TEST_ASSERT_EQUAL(15, sink.chunks);
+
+    /* An encoder error is ESP_FAIL, and also restarts */
+    reset_sink();
+    enc.fail_at = 5;
+    TEST_ASSERT_EQUAL(ESP_FAIL, jpeg_snapshot_encode(snap, (const uint8_t *)frame, 320, 240, test_sink, &sink, &size));
+    TEST_ASSERT_EQUAL(5, sink.chunks);
+    enc.fail_at = -1;
+    reset_sink();
+    TEST_ASSERT_EQUAL(ESP_OK, jpeg_snapshot_encode(snap, (const uint8_t *)frame, 320, 240, test_sink, &sink, &size));
+    TEST_ASSERT_EQUAL(opens + 3, enc.opens);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpeg_snapshot_encode(snap, (const uint8_t *)frame, 319, 240,
+                                                                test_sink, &sink, &size));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpeg_snapshot_encode(snap, (const uint8_t *)frame, 320, 240,
+                                                                NULL, &sink, &size));
+    jpeg_snapshot_delete(snap);
+    TEST_ASSERT_EQUAL(enc.opens, enc.closes);
+}
+
+int main(void)
+{
+    RUN_TEST(test_bands_and_chunks);
+    RUN_TEST(test_colour_conversion);
+    RUN_TEST(test_failures_restart_the_encoder);
+    return HOST_TEST_END();
+}
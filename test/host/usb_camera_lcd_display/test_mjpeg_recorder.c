@@ -0,0 +1,142 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * mjpeg_recorder with its writer task: a recording into a temporary
+ * directory, a resolution change starting the next file, and a directory
+ * that can not be written, where every stop must still complete whether
+ * the open fails before or after the stop was asked for.
+ */
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "freertos/task.h"
+#include "mjpeg_recorder.h"
+
+#define FRAME_BYTES     (3000)
+
+static uint8_t frame[FRAME_BYTES];
+
+static mjpeg_recorder_handle_t create(const char *dir)
+{
+    const mjpeg_recorder_config_t config = {
+        .dir = dir,
+        .queue_depth = 4,
+        .frame_capacity = FRAME_BYTES,
+        .write_buffer_size = 4096,
+        .task_priority = 1,
+        .task_core = 0,
+    };
+    mjpeg_recorder_handle_t rec = NULL;
+
+    return mjpeg_recorder_create(&config, &rec) == ESP_OK ? rec : NULL;
+}
+
+static int count_files(const char *dir)
+{
+    DIR *d = opendir(dir);
+    int files = 0;
+
+    for (struct dirent *e = readdir(d); e != NULL; e = readdir(d)) {
+        files += strncmp(e->d_name, "REC_", 4) == 0;
+    }
+    closedir(d);
+    return files;
+}
+
+static void remove_files(const char *dir)
+{
+    DIR *d = opendir(dir);
+    char path[300];
+
+    for (struct dirent *e = readdir(d); e != NULL; e = readdir(d)) {
+        if (strncmp(e->d_name, "REC_", 4) == 0) {
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+}
+
+static void test_record_and_change_resolution(void)
+{
+    char dir[] = "/tmp/mjpeg_recorder_XXXXXX";
+    mjpeg_recorder_stats_t stats;
+
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    mjpeg_recorder_handle_t rec = create(dir);
+    TEST_ASSERT_NOT_NULL(rec);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, mjpeg_recorder_stop(rec, 0));
+
+    memset(frame, 0x5a, sizeof(frame));
+    TEST_ASSERT_EQUAL(ESP_OK, mjpeg_recorder_start(rec, 30));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, mjpeg_recorder_start(rec, 30));
+    TEST_ASSERT_TRUE(mjpeg_recorder_is_recording(rec));
+    for (int i = 0; i < 20; i++) {
+        /* Paced so the queue never drops, the second half is another resolution */
+        const uint16_t width = i < 10 ? 640 : 320;
+        mjpeg_recorder_push(rec, frame, 1000 + i, width, width * 3 / 4, i * 33333);
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, mjpeg_recorder_stop(rec, pdMS_TO_TICKS(2000)));
+    TEST_ASSERT_FALSE(mjpeg_recorder_is_recording(rec));
+    mjpeg_recorder_get_stats(rec, &stats);
+    TEST_ASSERT_EQUAL(0, stats.errors);
+    TEST_ASSERT_EQUAL(2, stats.files);
+    TEST_ASSERT_EQUAL(20 - stats.dropped, stats.frames);
+    TEST_ASSERT_EQUAL(2, count_files(dir));
+
+    /* Frames outside a recording are ignored */
+    mjpeg_recorder_push(rec, frame, 1000, 640, 480, 0);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    mjpeg_recorder_get_stats(rec, &stats);
+    TEST_ASSERT_EQUAL(20 - stats.dropped, stats.frames);
+
+    remove_files(dir);
+    rmdir(dir);
+}
+
+static void test_stop_completes_when_open_fails(void)
+{
+    mjpeg_recorder_stats_t stats;
+    mjpeg_recorder_handle_t rec = create("/nonexistent/mjpeg_recorder");
+    int stopped = 0;
+    int already_failed = 0;
+
+    TEST_ASSERT_NOT_NULL(rec);
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, mjpeg_recorder_start(rec, 30));
+        mjpeg_recorder_push(rec, frame, 1000, 640, 480, 0);
+        if (i % 3 == 0) {
+            /* Let the writer fail first, the recording is then already over */
+            vTaskDelay(pdMS_TO_TICKS(5));
+        }
+        /* The open fails before, during or after the stop, the stop is answered every time */
+        const esp_err_t ret = mjpeg_recorder_stop(rec, pdMS_TO_TICKS(1000));
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            HOST_TEST_FAIL("round %d: stop returned 0x%x", i, ret);
+        }
+        stopped += ret == ESP_OK;
+        already_failed += ret == ESP_ERR_INVALID_STATE;
+        TEST_ASSERT_FALSE(mjpeg_recorder_is_recording(rec));
+    }
+    mjpeg_recorder_get_stats(rec, &stats);
+    TEST_ASSERT_EQUAL(0, stats.files);
+    TEST_ASSERT_EQUAL(0, stats.frames);
+    TEST_ASSERT_EQUAL(100 - stats.dropped, stats.errors);
+    printf("%d stops answered by the writer, %d after it gave up\n", stopped, already_failed);
+}
+
+int main(void)
+{
+    RUN_TEST(test_record_and_change_resolution);
+    RUN_TEST(test_stop_completes_when_open_fails);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,287 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * motion_detect on synthetic scenes: a still scene with sensor noise stays
+ * quiet, a moving square is boxed where it is, two objects give two boxes
+ * largest first, a lighting change is learnt instead of reported, and the
+ * masks, sensitivity, warm-up, byte order and frame size changes behave.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "motion_detect.h"
+
+#define W           (320)
+#define H           (240)
+#define CELL_PX     (16)    /* Default scale 4 times cell 4 */
+
+static uint16_t frame[640 * 480];
+static uint32_t noise_seed = 1;
+
+static uint16_t grey565(int level, bool big_endian)
+{
+    level = level < 0 ? 0 : level > 255 ? 255 : level;
+    const uint16_t v = (uint16_t)(((level >> 3) << 11) | ((level >> 2) << 5) | (level >> 3));
+    return big_endian ? (uint16_t)((v >> 8) | (v << 8)) : v;
+}
+
+typedef struct {
+    int x;
+    int y;
+    int size;
+    int level;
+    bool relative;              /* `level` is added to the scene instead of replacing it */
+} square_t;
+
+/* A textured scene, a few levels of noise, squares drawn over it, and a global brightness offset */
+static void draw(int width, int height, const square_t *squares, int count, int brightness, bool big_endian)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int level = 60 + ((x / 24 + y / 18) % 3) * 30 + brightness;
+            for (int i = 0; i < count; i++) {
+                const square_t *s = &squares[i];
+                if (x >= s->x && x < s->x + s->size && y >= s->y && y < s->y + s->size) {
+                    level = s->relative ? level + s->level : s->level;
+                }
+            }
+            level += (int)(host_rand(&noise_seed) % 7) - 3;
+            frame[y * width + x] = grey565(level, big_endian);
+        }
+    }
+}
+
+static motion_detect_handle_t create(void (*cb)(const motion_box_t *, size_t, void *), void *ctx)
+{
+    motion_detect_config_t config = MOTION_DETECT_DEFAULT_CONFIG();
+    motion_detect_handle_t motion = NULL;
+
+    config.callback = cb;
+    config.ctx = ctx;
+    return motion_detect_create(&config, &motion) == ESP_OK ? motion : NULL;
+}
+
+static size_t process(motion_detect_handle_t motion, int width, int height)
+{
+    size_t count = 0;
+    if (motion_detect_process(motion, (const uint8_t *)frame, width, height, &count) != ESP_OK) {
+        return SIZE_MAX;
+    }
+    return count;
+}
+
+static void warm_up(motion_detect_handle_t motion, int frames)
+{
+    for (int i = 0; i < frames; i++) {
+        draw(W, H, NULL, 0, 0, true);
+        process(motion, W, H);
+    }
+}
+
+static void test_still_scene_is_quiet(void)
+{
+    motion_detect_handle_t motion = create(NULL, NULL);
+    motion_detect_stats_t stats;
+
+    TEST_ASSERT_NOT_NULL(motion);
+    warm_up(motion, 200);
+    motion_detect_get_stats(motion, &stats);
+    TEST_ASSERT_EQUAL(200, stats.frames);
+    TEST_ASSERT_EQUAL(0, stats.motion_frames);
+    TEST_ASSERT_EQUAL(0, stats.relearned);
+    TEST_ASSERT_EQUAL((W / CELL_PX) * (H / CELL_PX), stats.total_cells);
+    motion_detect_delete(motion);
+}
+
+typedef struct {
+    int calls;
+    size_t count;
+    motion_box_t boxes[MOTION_DETECT_MAX_BOXES];
+} seen_t;
+
+static void on_motion(const motion_box_t *boxes, size_t count, void *ctx)
+{
+    seen_t *seen = ctx;
+    seen->calls++;
+    seen->count = count;
+    memcpy(seen->boxes, boxes, count * sizeof(motion_box_t));
+}
+
+/* The box covers the square, give or take the cells it only partly covers */
+static bool box_matches(const motion_box_t *box, const square_t *s)
+{
+    return box->x <= s->x + CELL_PX && box->x + box->width >= s->x + s->size - CELL_PX &&
+           box->y <= s->y + CELL_PX && box->y + box->height >= s->y + s->size - CELL_PX &&
+           box->x + CELL_PX >= s->x && box->x + box->width <= s->x + s->size + CELL_PX &&
+           box->y + CELL_PX >= s->y && box->y + box->height <= s->y + s->size + CELL_PX;
+}
+
+static void test_moving_square_is_boxed(void)
+{
+    seen_t seen = { 0 };
+    motion_detect_handle_t motion = create(on_motion, &seen);
+
+    TEST_ASSERT_NOT_NULL(motion);
+    warm_up(motion, 20);
+    for (int step = 0; step < 30; step++) {
+        const square_t square = { .x = 20 + step * 8, .y = 60 + step * 3, .size = 48, .level = 240 };
+        draw(W, H, &square, 1, 0, true);
+        const size_t count = process(motion, W, H);
+        if (count != 1 || seen.count != 1 || !box_matches(&seen.boxes[0], &square)) {
+            HOST_TEST_FAIL("step %d: %zu boxes, first at %u,%u %ux%u, square at %d,%d", step, count,
+                           seen.boxes[0].x, seen.boxes[0].y, seen.boxes[0].width, seen.boxes[0].height,
+                           square.x, square.y);
+        }
+        TEST_ASSERT_GREATER_OR_EQUAL(48, seen.boxes[0].level);
+    }
+    TEST_ASSERT_EQUAL(30, seen.calls);
+
+    /* Two objects apart, the larger first */
+    const square_t two[] = {
+        { .x = 20, .y = 20, .size = 32, .level = 250 },
+        { .x = 200, .y = 120, .size = 80, .level = 250 },
+    };
+    draw(W, H, two, 2, 0, true);
+    TEST_ASSERT_EQUAL(2, process(motion, W, H));
+    TEST_ASSERT(box_matches(&seen.boxes[0], &two[1]));
+    TEST_ASSERT(box_matches(&seen.boxes[1], &two[0]));
+    TEST_ASSERT(seen.boxes[0].cells > seen.boxes[1].cells);
+    motion_detect_delete(motion);
+}
+
+static void test_stopped_object_fades_in(void)
+{
+    motion_detect_handle_t motion = create(NULL, NULL);
+    const square_t square = { .x = 100, .y = 80, .size = 64, .level = 230 };
+    int last_motion = -1;
+
+    TEST_ASSERT_NOT_NULL(motion);
+    warm_up(motion, 20);
+    for (int i = 0; i < 400; i++) {
+        draw(W, H, &square, 1, 0, true);
+        if (process(motion, W, H) > 0) {
+            last_motion = i;
+        }
+    }
+    /* Reported for a while, then part of the scene */
+    TEST_ASSERT_GREATER_OR_EQUAL(5, last_motion);
+    TEST_ASSERT_LESS_OR_EQUAL(300, last_motion);
+    motion_detect_delete(motion);
+}
+
+static void test_lighting_change_is_learnt(void)
+{
+    seen_t seen = { 0 };
+    motion_detect_handle_t motion = create(on_motion, &seen);
+    motion_detect_stats_t stats;
+
+    TEST_ASSERT_NOT_NULL(motion);
+    warm_up(motion, 20);
+    draw(W, H, NULL, 0, 70, true);
+    TEST_ASSERT_EQUAL(0, process(motion, W, H));
+    for (int i = 0; i < 50; i++) {
+        draw(W, H, NULL, 0, 70, true);
+        TEST_ASSERT_EQUAL(0, process(motion, W, H));
+    }
+    motion_detect_get_stats(motion, &stats);
+    TEST_ASSERT_EQUAL(1, stats.relearned);
+    TEST_ASSERT_EQUAL(0, seen.calls);
+    motion_detect_delete(motion);
+}
+
+static void test_masks_and_sensitivity(void)
+{
+    motion_detect_handle_t motion = create(NULL, NULL);
+    const square_t square = { .x = 16, .y = 16, .size = 64, .level = 240 };
+    const square_t faint = { .x = 160, .y = 96, .size = 64, .level = 20, .relative = true };
+
+    TEST_ASSERT_NOT_NULL(motion);
+    warm_up(motion, 20);
+
+    /* The left third of the frame is ignored */
+    TEST_ASSERT_EQUAL(ESP_OK, motion_detect_set_mask(motion, 0, 0, 0, 333, 1000));
+    draw(W, H, &square, 1, 0, true);
+    TEST_ASSERT_EQUAL(0, process(motion, W, H));
+    TEST_ASSERT_EQUAL(ESP_OK, motion_detect_set_mask(motion, 0, 0, 0, 0, 0));
+    draw(W, H, &square, 1, 0, true);
+    TEST_ASSERT_EQUAL(1, process(motion, W, H));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, motion_detect_set_mask(motion, MOTION_DETECT_MAX_MASKS, 0, 0, 10, 10));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, motion_detect_set_mask(motion, 0, 1001, 0, 10, 10));
+
+    /* A faint change, 20 levels over the scene, needs a high sensitivity */
+    motion_detect_reset(motion);
+    warm_up(motion, 20);
+    TEST_ASSERT_EQUAL(ESP_OK, motion_detect_set_sensitivity(motion, 1));
+    draw(W, H, &faint, 1, 0, true);
+    TEST_ASSERT_EQUAL(0, process(motion, W, H));
+    warm_up(motion, 20);
+    TEST_ASSERT_EQUAL(ESP_OK, motion_detect_set_sensitivity(motion, 100));
+    draw(W, H, &faint, 1, 0, true);
+    TEST_ASSERT_EQUAL(1, process(motion, W, H));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, motion_detect_set_sensitivity(motion, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, motion_detect_set_sensitivity(motion, 101));
+    motion_detect_delete(motion);
+}
+
+static void test_warmup_byte_order_and_size(void)
+{
+    motion_detect_config_t config = MOTION_DETECT_DEFAULT_CONFIG();
+    const square_t square = { .x = 100, .y = 100, .size = 64, .level = 250 };
+    motion_detect_handle_t motion[2] = { NULL, NULL };
+
+    /* The same scene in both byte orders gives the same boxes */
+    for (int be = 0; be <= 1; be++) {
+        config.big_endian = be;
+        TEST_ASSERT_EQUAL(ESP_OK, motion_detect_create(&config, &motion[be]));
+    }
+    for (int i = 0; i < config.warmup_frames + 2; i++) {
+        const bool moving = i % 2;
+        size_t count[2];
+        for (int be = 0; be <= 1; be++) {
+            noise_seed = 1000 + i;
+            draw(W, H, &square, moving, 0, be);
+            count[be] = process(motion[be], W, H);
+        }
+        TEST_ASSERT_EQUAL(count[0], count[1]);
+        /* Nothing during the warm-up, even with the square coming and going */
+        if (i < config.warmup_frames) {
+            TEST_ASSERT_EQUAL(0, count[0]);
+        } else if (moving) {
+            TEST_ASSERT_EQUAL(1, count[0]);
+        }
+    }
+
+    /* A new frame size starts the learning over */
+    draw(640, 480, &square, 1, 0, true);
+    TEST_ASSERT_EQUAL(0, process(motion[1], 640, 480));
+    motion_detect_stats_t stats;
+    motion_detect_get_stats(motion[1], &stats);
+    TEST_ASSERT_EQUAL((640 / CELL_PX) * (480 / CELL_PX), stats.total_cells);
+    TEST_ASSERT_EQUAL(SIZE_MAX, process(motion[1], 8, 8));
+    motion_detect_delete(motion[0]);
+    motion_detect_delete(motion[1]);
+
+    config = (motion_detect_config_t)MOTION_DETECT_DEFAULT_CONFIG();
+    config.scale = 3;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, motion_detect_create(&config, &motion[0]));
+    config = (motion_detect_config_t)MOTION_DETECT_DEFAULT_CONFIG();
+    config.cell = 16;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, motion_detect_create(&config, &motion[0]));
+}
+
+int main(void)
+{
+    RUN_TEST(test_still_scene_is_quiet);
+    RUN_TEST(test_moving_square_is_boxed);
+    RUN_TEST(test_stopped_object_fades_in);
+    RUN_TEST(test_lighting_change_is_learnt);
+    RUN_TEST(test_masks_and_sensitivity);
+    RUN_TEST(test_warmup_byte_order_and_size);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,169 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * resolution_governor replaying decoder load traces against a simulated
+ * 30 fps camera: it climbs to the largest resolution that keeps up and
+ * stays there, steps down under load and comes back, does not chase a
+ * load that comes and goes, and leaves a dark scene alone. Every switch
+ * restarts the camera, the traces bound how many there are.
+ */
+
+#include "host_test.h"
+#include "resolution_governor.h"
+
+#define CAMERA_FPS      (30)
+#define PERIOD_S        (2)     /* DEMO_GOVERNOR_INTERVAL_MS */
+#define PERIODS_PER_HOUR (3600 / PERIOD_S)
+
+static const resolution_governor_size_t sizes[] = {
+    { 640, 480 }, { 160, 120 }, { 1280, 720 }, { 320, 240 }, { 800, 600 },
+};
+enum { QQVGA = 1, QVGA = 3, VGA = 0, SVGA = 4, HD = 2 };
+
+/* Decoder speed, in pixels per second, able to decode this many frames per second at a size */
+static double pixel_rate_for(size_t index, double fps)
+{
+    return (double)sizes[index].width * sizes[index].height * fps;
+}
+
+typedef double (*trace_t)(int period);
+
+typedef struct {
+    size_t current;
+    int switches;
+    int switches_last_half;
+    int periods_at[sizeof(sizes) / sizeof(sizes[0])];
+} replay_t;
+
+/* The camera sends `camera_fps`, the decoder keeps what its speed allows, the rest is dropped */
+static replay_t replay(trace_t pixel_rate, int periods, size_t start, int camera_fps)
+{
+    resolution_governor_config_t config = RESOLUTION_GOVERNOR_DEFAULT_CONFIG();
+    resolution_governor_handle_t gov = NULL;
+    replay_t r = { .current = start };
+
+    if (resolution_governor_create(&config, sizes, sizeof(sizes) / sizeof(sizes[0]), start, &gov) != ESP_OK) {
+        r.switches = -1;
+        return r;
+    }
+    for (int p = 0; p < periods; p++) {
+        const double pixels = (double)sizes[r.current].width * sizes[r.current].height;
+        const double capacity = pixel_rate(p) / pixels;
+        const double shown = capacity < camera_fps ? capacity : camera_fps;
+        const resolution_governor_sample_t sample = {
+            .interval_us = PERIOD_S * 1000000,
+            .frames = (uint32_t)(shown * PERIOD_S),
+            .dropped = (uint32_t)((camera_fps - shown) * PERIOD_S),
+            .decoded = (uint32_t)(shown * PERIOD_S),
+            .decode_us = (uint32_t)(shown * PERIOD_S * pixels / pixel_rate(p) * 1e6),
+        };
+        const size_t next = resolution_governor_update(gov, &sample);
+        if (next != r.current) {
+            r.switches++;
+            r.switches_last_half += p >= periods / 2;
+            r.current = next;
+        }
+        r.periods_at[r.current]++;
+    }
+    resolution_governor_delete(gov);
+    return r;
+}
+
+static double steady_vga_40(int period)
+{
+    return pixel_rate_for(VGA, 40);
+}
+
+static void test_climbs_and_stays(void)
+{
+    /* VGA at 40 fps has the headroom, SVGA would only do 25.6 */
+    const replay_t r = replay(steady_vga_40, PERIODS_PER_HOUR, QQVGA, CAMERA_FPS);
+    TEST_ASSERT_EQUAL(VGA, r.current);
+    TEST_ASSERT_LESS_OR_EQUAL(3, r.switches);
+    TEST_ASSERT_EQUAL(0, r.switches_last_half);
+    TEST_ASSERT_GREATER_OR_EQUAL(PERIODS_PER_HOUR - 30, r.periods_at[VGA]);
+}
+
+/* Ten minutes where something else takes half of the decoder */
+static double spike(int period)
+{
+    return (period >= 100 && period < 400) ? pixel_rate_for(VGA, 20) : pixel_rate_for(VGA, 40);
+}
+
+static void test_steps_down_under_load_and_back(void)
+{
+    const replay_t r = replay(spike, PERIODS_PER_HOUR, VGA, CAMERA_FPS);
+    TEST_ASSERT_EQUAL(VGA, r.current);
+    TEST_ASSERT_LESS_OR_EQUAL(4, r.switches);
+    TEST_ASSERT_GREATER_OR_EQUAL(250, r.periods_at[QVGA]);
+    TEST_ASSERT_LESS_OR_EQUAL(20, PERIODS_PER_HOUR - r.periods_at[VGA] - r.periods_at[QVGA]);
+}
+
+/* A load switching on and off every 20 s, for hours */
+static double flapping(int period)
+{
+    return (period / 10) % 2 ? pixel_rate_for(VGA, 20) : pixel_rate_for(VGA, 40);
+}
+
+static void test_does_not_chase_a_flapping_load(void)
+{
+    const resolution_governor_config_t config = RESOLUTION_GOVERNOR_DEFAULT_CONFIG();
+    const replay_t r = replay(flapping, 4 * PERIODS_PER_HOUR, VGA, CAMERA_FPS);
+    /*
+     * The retry delay doubles at every failure up to 64 times backoff_periods,
+     * then VGA is only tried again once per delay: one step up and one down.
+     */
+    const int max_delay = config.backoff_periods << 6;
+    const int half = 2 * PERIODS_PER_HOUR;
+    printf("flapping load: %d switches in 4 h, %d in the last 2 h\n", r.switches, r.switches_last_half);
+    TEST_ASSERT_LESS_OR_EQUAL(2 * ((half + max_delay - 1) / max_delay) + 2, r.switches_last_half);
+    TEST_ASSERT_LESS_OR_EQUAL(40, r.switches);
+}
+
+static void test_leaves_a_dark_scene_alone(void)
+{
+    /* The camera slows down to 8 fps in the dark, the decoder has plenty of time */
+    const replay_t r = replay(steady_vga_40, PERIODS_PER_HOUR, VGA, 8);
+    TEST_ASSERT_EQUAL(0, r.switches);
+}
+
+static void test_manual_change_settles(void)
+{
+    resolution_governor_config_t config = RESOLUTION_GOVERNOR_DEFAULT_CONFIG();
+    resolution_governor_handle_t gov = NULL;
+    resolution_governor_info_t info;
+
+    TEST_ASSERT_EQUAL(ESP_OK, resolution_governor_create(&config, sizes, 5, VGA, &gov));
+    /* A bad period right after a change made by hand is the camera restarting, not a reason to move */
+    resolution_governor_set_current(gov, HD);
+    const resolution_governor_sample_t restart = {
+        .interval_us = 2000000, .frames = 5, .dropped = 50, .decoded = 5, .decode_us = 1000000,
+    };
+    TEST_ASSERT_EQUAL(HD, resolution_governor_update(gov, &restart));
+    resolution_governor_get_info(gov, HD, &info);
+    TEST_ASSERT_FALSE(info.measured);
+
+    /* After that, two bad periods step down */
+    TEST_ASSERT_EQUAL(HD, resolution_governor_update(gov, &restart));
+    TEST_ASSERT(resolution_governor_update(gov, &restart) != HD);
+    resolution_governor_get_info(gov, HD, &info);
+    TEST_ASSERT_EQUAL(1, info.failures);
+    TEST_ASSERT_EQUAL(config.backoff_periods, info.retry_in);
+    resolution_governor_delete(gov);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, resolution_governor_create(&config, sizes, 5, 5, &gov));
+}
+
+int main(void)
+{
+    RUN_TEST(test_climbs_and_stays);
+    RUN_TEST(test_steps_down_under_load_and_back);
+    RUN_TEST(test_does_not_chase_a_flapping_load);
+    RUN_TEST(test_leaves_a_dark_scene_alone);
+    RUN_TEST(test_manual_change_settles);
+    return HOST_TEST_END();
+}
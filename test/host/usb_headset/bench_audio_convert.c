@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Time per frame of audio_convert, one conversion per kernel: the
+ * passthrough copy, the width decode/encode, the channel map and the rate
+ * converter, then the complete conversions a host may pick. Blocks are cut
+ * in the 48-frame pieces usb_headset.c converts.
+ *
+ * usage: bench_audio_convert [seconds of audio per conversion]
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "audio_convert.h"
+
+#define PIECE_FRAMES    (48)
+#define OUT_CAPACITY    ((PIECE_FRAMES + 1) * AUDIO_CONVERT_MAX_RATIO + 1)
+
+typedef struct {
+    const char *kernel;
+    audio_format_t in;
+    audio_format_t out;
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+    { "passthrough",    {48000, 16, 2}, {48000, 16, 2} },
+    { "decode 24",      {48000, 24, 2}, {48000, 16, 2} },
+    { "decode 32",      {48000, 32, 2}, {48000, 16, 2} },
+    { "encode 24",      {48000, 16, 2}, {48000, 24, 2} },
+    { "mono to stereo", {48000, 16, 1}, {48000, 16, 2} },
+    { "stereo to mono", {48000, 16, 2}, {48000, 16, 1} },
+    { "rate 44.1k>48k", {44100, 16, 2}, {48000, 16, 2} },
+    { "rate 16k>48k",   {16000, 16, 2}, {48000, 16, 2} },
+    { "rate 48k>16k",   {48000, 16, 2}, {16000, 16, 2} },
+    { "spk 44.1k/24/2", {44100, 24, 2}, {48000, 16, 1} },
+    { "mic 48k>16k/1",  {48000, 16, 1}, {16000, 16, 1} },
+};
+
+static uint8_t in_buf[48000 * 8];
+static uint8_t out_buf[OUT_CAPACITY * 8];
+
+int main(int argc, char **argv)
+{
+    const int seconds = host_bench_iterations(argc, argv, 20);
+    uint32_t seed = 1;
+
+    for (size_t i = 0; i < sizeof(in_buf); i++) {
+        in_buf[i] = (uint8_t)host_rand(&seed);
+    }
+    printf("%d s of audio per conversion, %d-frame pieces\n", seconds, PIECE_FRAMES);
+    printf("%-16s %-14s %-14s %10s %10s\n", "kernel", "in", "out", "ns/frame", "cpu/rt");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const bench_case_t *bc = &cases[c];
+        const size_t in_bytes = audio_format_frame_bytes(&bc->in);
+        const size_t second = bc->in.sample_rate;
+        audio_convert_handle_t convert = NULL;
+        uint64_t produced = 0;
+
+        if (audio_convert_create(&bc->in, &bc->out, &convert) != ESP_OK) {
+            fprintf(stderr, "%s: create failed\n", bc->kernel);
+            return EXIT_FAILURE;
+        }
+        const int64_t start = host_cpu_ns();
+        for (int s = 0; s < seconds; s++) {
+            /* One second of input, looping over the same random buffer */
+            for (size_t pos = 0; pos + PIECE_FRAMES <= second; pos += PIECE_FRAMES) {
+                const size_t off = (pos * in_bytes) % (sizeof(in_buf) - PIECE_FRAMES * in_bytes);
+                produced += audio_convert_process(convert, in_buf + off, PIECE_FRAMES, out_buf, OUT_CAPACITY);
+            }
+        }
+        const int64_t elapsed = host_cpu_ns() - start;
+        audio_convert_delete(convert);
+
+        char in_name[24], out_name[24];
+        snprintf(in_name, sizeof(in_name), "%" PRIu32 "/%d/%d", bc->in.sample_rate, bc->in.bits, bc->in.channels);
+        snprintf(out_name, sizeof(out_name), "%" PRIu32 "/%d/%d", bc->out.sample_rate, bc->out.bits, bc->out.channels);
+        printf("%-16s %-14s %-14s %10.2f %9.4f%%\n", bc->kernel, in_name, out_name,
+               (double)elapsed / ((double)seconds * second), 100.0 * elapsed / (seconds * 1e9));
+        /* Sanity: about as many output frames as the rates promise */
+        const double expect = (double)seconds * (second - second % PIECE_FRAMES) * bc->out.sample_rate / bc->in.sample_rate;
+        if (produced + PIECE_FRAMES < expect || produced > expect + PIECE_FRAMES) {
+            fprintf(stderr, "%s: %" PRIu64 " frames out, expected %.0f\n", bc->kernel, produced, expect);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
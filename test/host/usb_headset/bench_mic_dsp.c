@@ -0,0 +1,83 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Time per frame of the capture chain on 1 ms blocks, for each stage
+ * combination the cycle budget can shed down to, in mono and stereo.
+ *
+ * usage: bench_mic_dsp [seconds of audio per case]
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "host_audio.h"
+#include "mic_dsp.h"
+
+#define RATE            (48000)
+#define BLOCK_FRAMES    (RATE / 1000)
+
+typedef struct {
+    const char *name;
+    bool hpf;
+    bool gate;
+    bool agc;
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+    { "dc+limiter",         false, false, false },
+    { "dc+hpf+agc",         true,  false, true  },
+    { "dc+hpf+gate+agc",    true,  true,  true  },
+};
+
+static int16_t clip[RATE * MIC_DSP_MAX_CHANNELS];
+static int16_t block[BLOCK_FRAMES * MIC_DSP_MAX_CHANNELS];
+
+int main(int argc, char **argv)
+{
+    const int seconds = host_bench_iterations(argc, argv, 20);
+
+    for (size_t i = 0; i < RATE; i++) {
+        clip[i * 2] = host_audio_music_sample(i, RATE) / 4;
+        clip[i * 2 + 1] = clip[i * 2] / 2;
+    }
+    printf("%d s of audio per case, %d-frame blocks\n", seconds, BLOCK_FRAMES);
+    printf("%-18s %8s %10s %10s\n", "stages", "channels", "ns/frame", "cpu/rt");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (int channels = 1; channels <= MIC_DSP_MAX_CHANNELS; channels++) {
+            mic_dsp_config_t config = MIC_DSP_DEFAULT_CONFIG(RATE, channels);
+            mic_dsp_handle_t dsp = NULL;
+            mic_dsp_stats_t stats;
+
+            config.hpf_cutoff_hz = cases[c].hpf ? config.hpf_cutoff_hz : 0;
+            config.noise_gate = cases[c].gate;
+            config.agc = cases[c].agc;
+            if (mic_dsp_create(&config, &dsp) != ESP_OK) {
+                fprintf(stderr, "%s: create failed\n", cases[c].name);
+                return EXIT_FAILURE;
+            }
+            int64_t elapsed = 0;
+            for (int s = 0; s < seconds; s++) {
+                for (size_t pos = 0; pos < RATE; pos += BLOCK_FRAMES) {
+                    /* The clip is stereo, mono takes every other sample */
+                    memcpy(block, clip + pos * channels, BLOCK_FRAMES * channels * sizeof(int16_t));
+                    const int64_t start = host_cpu_ns();
+                    mic_dsp_process(dsp, block, BLOCK_FRAMES);
+                    elapsed += host_cpu_ns() - start;
+                }
+            }
+            mic_dsp_get_stats(dsp, &stats);
+            mic_dsp_delete(dsp);
+            printf("%-18s %8d %10.2f %9.4f%%\n", cases[c].name, channels,
+                   (double)elapsed / ((double)seconds * RATE), 100.0 * elapsed / (seconds * 1e9));
+            if (stats.blocks != (uint32_t)(seconds * RATE / BLOCK_FRAMES)) {
+                fprintf(stderr, "%s: %" PRIu32 " blocks processed\n", cases[c].name, stats.blocks);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Time per frame of the spectrum engine against the path it replaced:
+ * a Q15 complex radix-2 transform over N_SAMPLES points, a separate bit
+ * reversal and a log10f per bin, as fft_convert.c did with the esp-dsp
+ * sc16 ansi kernels.
+ *
+ * usage: bench_spectrum [frames] [recording.s16]
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "host_audio.h"
+#include "spectrum.h"
+
+#define N_SAMPLES       (1024)
+#define FRAME_SAMPLES   (N_SAMPLES * 2)
+
+static int16_t legacy_twiddle[N_SAMPLES];
+
+static void legacy_bit_rev_sc16(int16_t *data, int n)
+{
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            int16_t t = data[2 * i];
+            data[2 * i] = data[2 * j];
+            data[2 * j] = t;
+            t = data[2 * i + 1];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j + 1] = t;
+        }
+    }
+}
+
+/* Bit-reversed twiddles, as dsps_fft2r_init_sc16 lays them out */
+static void legacy_init(void)
+{
+    for (int k = 0; k < N_SAMPLES / 2; k++) {
+        legacy_twiddle[2 * k] = (int16_t)lrint(INT16_MAX * cos(2 * M_PI * k / N_SAMPLES));
+        legacy_twiddle[2 * k + 1] = (int16_t)lrint(-INT16_MAX * sin(2 * M_PI * k / N_SAMPLES));
+    }
+    legacy_bit_rev_sc16(legacy_twiddle, N_SAMPLES / 2);
+}
+
+/* In-order input, bit-reversed output, 1/2 scale per stage, like dsps_fft2r_sc16_ansi */
+static void legacy_fft_sc16(int16_t *data, int n)
+{
+    int ie = 1;
+    for (int n2 = n / 2; n2 > 0; n2 >>= 1) {
+        int ia = 0;
+        for (int j = 0; j < ie; j++) {
+            const int32_t cr = legacy_twiddle[2 * j];
+            const int32_t ci = legacy_twiddle[2 * j + 1];
+            for (int i = 0; i < n2; i++) {
+                const int m = ia + n2;
+                const int32_t mr = data[2 * m], mi = data[2 * m + 1];
+                const int32_t tr = (mr * cr - mi * ci) >> 15;
+                const int32_t ti = (mr * ci + mi * cr) >> 15;
+                const int32_t ar = data[2 * ia], ai = data[2 * ia + 1];
+                data[2 * m] = (int16_t)((ar - tr) >> 1);
+                data[2 * m + 1] = (int16_t)((ai - ti) >> 1);
+                data[2 * ia] = (int16_t)((ar + tr) >> 1);
+                data[2 * ia + 1] = (int16_t)((ai + ti) >> 1);
+                ia++;
+            }
+            ia += n2;
+        }
+        ie <<= 1;
+    }
+}
+
+static void legacy_process(int16_t *data, float *out)
+{
+    legacy_fft_sc16(data, N_SAMPLES);
+    legacy_bit_rev_sc16(data, N_SAMPLES);
+    for (int i = 0; i < N_SAMPLES; i++) {
+        const float re = (float)data[2 * i] / INT16_MAX;
+        const float im = (float)data[2 * i + 1] / INT16_MAX;
+        out[i] = 10 * log10f(0.0000000000001f + re * re + im * im) + 130;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const int frames = host_bench_iterations(argc, argv, 2000);
+    size_t count = 0;
+    int16_t *clip = argc > 2 ? host_audio_load(argv[2], &count) : NULL;
+    static int16_t work[FRAME_SAMPLES];
+    static int16_t out_db[N_SAMPLES];
+    static float out_legacy[N_SAMPLES];
+    spectrum_handle_t engine = NULL;
+    volatile float sink = 0;
+
+    if (clip == NULL || count < FRAME_SAMPLES) {
+        free(clip);
+        count = FRAME_SAMPLES * 64;
+        clip = malloc(count * sizeof(int16_t));
+        host_audio_music(clip, count, 32000, 0);
+    }
+    const size_t nframes = count / FRAME_SAMPLES;
+
+    legacy_init();
+    const spectrum_config_t config = { .fft_size = FRAME_SAMPLES, .window = SPECTRUM_WINDOW_HANN };
+    if (spectrum_create(&config, &engine) != ESP_OK) {
+        return EXIT_FAILURE;
+    }
+
+    int64_t t0 = host_cpu_ns();
+    for (int i = 0; i < frames; i++) {
+        memcpy(work, clip + (i % nframes) * FRAME_SAMPLES, sizeof(work));
+        legacy_process(work, out_legacy);
+        sink += out_legacy[i % N_SAMPLES];
+    }
+    const double legacy_ns = (double)(host_cpu_ns() - t0) / frames;
+
+    t0 = host_cpu_ns();
+    for (int i = 0; i < frames; i++) {
+        spectrum_process(engine, clip + (i % nframes) * FRAME_SAMPLES, out_db);
+        sink += out_db[i % N_SAMPLES];
+    }
+    const double engine_ns = (double)(host_cpu_ns() - t0) / frames;
+
+    printf("%d frames of %d samples\n", frames, FRAME_SAMPLES);
+    printf("legacy sc16 + bit_rev + log10f: %10.0f ns/frame\n", legacy_ns);
+    printf("spectrum engine (scalar)      : %10.0f ns/frame, %.2fx\n", engine_ns, legacy_ns / engine_ns);
+    spectrum_delete(engine);
+    free(clip);
+    return EXIT_SUCCESS;
+}
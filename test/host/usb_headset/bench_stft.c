@@ -0,0 +1,113 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * CPU time per displayed frame of the STFT front end, for several hop
+ * sizes and averaging modes. Audio arrives in real time on a simulated
+ * clock, the panel stays busy for a while after each frame it takes and
+ * frames falling due meanwhile are skipped, like fft_convert_task does
+ * with display_is_ready().
+ *
+ * usage: bench_stft [seconds of audio]
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "host_audio.h"
+#include "stft.h"
+
+#define N_SAMPLES       (1024)
+#define FRAME_SAMPLES   (N_SAMPLES * 2)
+#define SAMPLE_RATE     (48000 * 2)         /* 48 kHz stereo, interleaved like the UAC speaker stream */
+#define DISPLAY_FPS     (30)
+
+typedef struct {
+    stft_stats_t stats;
+    double cpu_ms_per_frame;
+    double cpu_percent;
+} bench_result_t;
+
+static int16_t hop_buf[FRAME_SAMPLES];
+static int16_t out_db[N_SAMPLES];
+
+static void run(int overlap, stft_avg_mode_t mode, int64_t panel_busy_us, int seconds, bench_result_t *res)
+{
+    const stft_config_t config = {
+        .frame_size = FRAME_SAMPLES,
+        .hop_size = STFT_HOP_FROM_OVERLAP(FRAME_SAMPLES, overlap),
+        .window = SPECTRUM_WINDOW_HANN,
+        .avg_mode = mode,
+        .avg_alpha = 0.6 * 32768,
+        .peak_decay = 2 << SPECTRUM_DB_FRAC_BITS,
+        .sample_rate = SAMPLE_RATE,
+        .output_rate = DISPLAY_FPS,
+    };
+    const size_t total = (size_t)seconds * SAMPLE_RATE;
+    stft_handle_t stft = NULL;
+    int64_t busy_until_us = 0;
+    int64_t cpu_ns = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, stft_create(&config, &stft));
+    for (size_t pos = 0; pos + config.hop_size <= total; pos += config.hop_size) {
+        const int64_t now_us = (int64_t)((pos + config.hop_size) * 1000000ull / SAMPLE_RATE);
+        host_audio_music(hop_buf, config.hop_size, SAMPLE_RATE, pos);
+
+        const int64_t start = host_cpu_ns();
+        const bool shown = stft_push(stft, hop_buf, now_us >= busy_until_us, out_db);
+        cpu_ns += host_cpu_ns() - start;
+        if (shown) {
+            busy_until_us = now_us + panel_busy_us;
+        }
+    }
+    stft_get_stats(stft, &res->stats);
+    stft_delete(stft);
+
+    res->cpu_ms_per_frame = res->stats.output ? cpu_ns / 1e6 / res->stats.output : 0;
+    res->cpu_percent = 100.0 * cpu_ns / (seconds * 1e9);
+}
+
+int main(int argc, char **argv)
+{
+    static const int overlaps[] = { 0, 50, 75, 87 };
+    static const struct {
+        stft_avg_mode_t mode;
+        const char *name;
+    } modes[] = {
+        { STFT_AVG_NONE, "none" },
+        { STFT_AVG_EXPONENTIAL, "exponential" },
+        { STFT_AVG_PEAK_HOLD, "peak hold" },
+    };
+    /* 320x240 RGB565 over 40 MHz SPI is ~31 ms for a full frame, dirty regions move a fraction of it */
+    static const int64_t busy_us[] = { 8000, 31000, 50000 };
+    const int seconds = host_bench_iterations(argc, argv, 60);
+    bench_result_t res;
+
+    printf("%d s of audio at %d samples/s, %d fps cadence\n", seconds, SAMPLE_RATE, DISPLAY_FPS);
+    printf("%-8s %-12s %-8s %9s %9s %9s %9s %12s %8s\n",
+           "overlap", "averaging", "panel", "hops", "analysed", "shown", "skipped", "ms/shown", "cpu");
+    for (size_t b = 0; b < sizeof(busy_us) / sizeof(busy_us[0]); b++) {
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            for (size_t o = 0; o < sizeof(overlaps) / sizeof(overlaps[0]); o++) {
+                memset(&res, 0, sizeof(res));
+                run(overlaps[o], modes[m].mode, busy_us[b], seconds, &res);
+                printf("%6d%%  %-12s %5" PRId64 "ms %9" PRIu32 " %9" PRIu32 " %9" PRIu32 " %9" PRIu32 " %12.3f %7.2f%%\n",
+                       overlaps[o], modes[m].name, busy_us[b] / 1000, res.stats.hops, res.stats.analysed,
+                       res.stats.output, res.stats.skipped, res.cpu_ms_per_frame, res.cpu_percent);
+                if (res.stats.output == 0) {
+                    fprintf(stderr, "no frame displayed\n");
+                    return EXIT_FAILURE;
+                }
+                /* Without averaging a skipped frame must not cost a transform */
+                if (modes[m].mode == STFT_AVG_NONE && res.stats.analysed != res.stats.output) {
+                    fprintf(stderr, "skipped frames were transformed\n");
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
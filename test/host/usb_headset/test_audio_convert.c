@@ -0,0 +1,300 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * audio_convert against a reference written from the documented definition,
+ * one output frame at a time over the whole signal. The converter gets the
+ * same signal in blocks of random size and has to match bit for bit, for
+ * every pair of supported formats.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "audio_convert.h"
+
+#define SIGNAL_FRAMES   (3000)
+#define MAX_FRAME_BYTES (AUDIO_CONVERT_MAX_CHANNELS * 4)
+#define MAX_OUT_FRAMES  (SIGNAL_FRAMES * AUDIO_CONVERT_MAX_RATIO + 8)
+
+static const uint32_t rates[] = {16000, 32000, 44100, 48000};
+static const uint8_t widths[] = {16, 24, 32};
+
+static uint8_t in_buf[SIGNAL_FRAMES * MAX_FRAME_BYTES];
+static uint8_t out_buf[MAX_OUT_FRAMES * MAX_FRAME_BYTES];
+static uint8_t ref_buf[MAX_OUT_FRAMES * MAX_FRAME_BYTES];
+static int32_t wide[SIGNAL_FRAMES * AUDIO_CONVERT_MAX_CHANNELS];
+
+static int32_t ref_decode(const audio_format_t *f, const uint8_t *p)
+{
+    switch (f->bits) {
+    case 16:
+        return (int32_t)((uint32_t)(p[0] | (p[1] << 8)) << 16);
+    case 24:
+        return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+    default:
+        return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+    }
+}
+
+/* Round half up to the output width, saturating at full scale */
+static void ref_encode(const audio_format_t *f, int64_t v, uint8_t *p)
+{
+    const int shift = 32 - f->bits;
+    if (shift > 0) {
+        v += (int64_t)1 << (shift - 1);
+    }
+    if (v > INT32_MAX) {
+        v = INT32_MAX;
+    }
+    const uint32_t u = (uint32_t)((int32_t)v >> shift);
+    for (int i = 0; i < f->bits / 8; i++) {
+        p[i] = (uint8_t)(u >> (8 * i));
+    }
+}
+
+/**
+ * Widen to 32 bits, map the channels (duplicate mono, average stereo with
+ * each side halved first), interpolate linearly at input position
+ * m * in_rate / out_rate with a Q16 weight, encode. Returns the frames that
+ * can be produced from `frames` input frames: each needs the frame after it.
+ */
+static size_t ref_convert(const audio_format_t *in, const audio_format_t *out, const uint8_t *src, size_t frames,
+                          uint8_t *dst)
+{
+    const size_t in_bytes = audio_format_frame_bytes(in);
+    const size_t out_bytes = audio_format_frame_bytes(out);
+    const int bytes = out->bits / 8;
+
+    for (size_t i = 0; i < frames; i++) {
+        int32_t s[AUDIO_CONVERT_MAX_CHANNELS];
+        for (int ch = 0; ch < in->channels; ch++) {
+            s[ch] = ref_decode(in, src + i * in_bytes + ch * (in->bits / 8));
+        }
+        for (int ch = 0; ch < out->channels; ch++) {
+            if (in->channels == out->channels) {
+                wide[i * out->channels + ch] = s[ch];
+            } else if (in->channels == 1) {
+                wide[i * out->channels + ch] = s[0];
+            } else {
+                wide[i * out->channels + ch] = (s[0] >> 1) + (s[1] >> 1);
+            }
+        }
+    }
+
+    if (in->sample_rate == out->sample_rate) {
+        for (size_t i = 0; i < frames; i++) {
+            for (int ch = 0; ch < out->channels; ch++) {
+                ref_encode(out, wide[i * out->channels + ch], dst + i * out_bytes + ch * bytes);
+            }
+        }
+        return frames;
+    }
+
+    size_t m = 0;
+    for (;; m++) {
+        const uint64_t pos = (uint64_t)m * in->sample_rate;
+        const size_t idx = pos / out->sample_rate;
+        const uint32_t phase = pos % out->sample_rate;
+        if (idx + 1 >= frames) {
+            break;
+        }
+        const int64_t weight = ((uint64_t)phase << 16) / out->sample_rate;
+        for (int ch = 0; ch < out->channels; ch++) {
+            const int64_t x0 = wide[idx * out->channels + ch];
+            const int64_t x1 = wide[(idx + 1) * out->channels + ch];
+            /* The interpolated value is truncated to 32 bits before rounding, as the converter stores it */
+            const int32_t y = (int32_t)(x0 + (((x1 - x0) * weight) >> 16));
+            ref_encode(out, y, dst + m * out_bytes + ch * bytes);
+        }
+    }
+    return m;
+}
+
+/* Music-like content near full scale, with a few clipped peaks to exercise saturation */
+static void make_signal(const audio_format_t *f, uint32_t seed)
+{
+    const size_t bytes = f->bits / 8;
+    for (size_t i = 0; i < SIGNAL_FRAMES; i++) {
+        for (int ch = 0; ch < f->channels; ch++) {
+            double v = 0.7 * sin(2 * M_PI * (440.0 + 220 * ch) * i / f->sample_rate)
+                       + 0.25 * sin(2 * M_PI * 3100.0 * i / f->sample_rate);
+            int64_t q = (int64_t)llround(v * 2147483647.0);
+            if (host_rand(&seed) % 97 == 0) {
+                q = (host_rand(&seed) & 1) ? INT32_MAX : INT32_MIN;
+            }
+            const uint32_t u = (uint32_t)q >> (32 - f->bits);
+            for (size_t b = 0; b < bytes; b++) {
+                in_buf[(i * f->channels + ch) * bytes + b] = (uint8_t)(u >> (8 * b));
+            }
+        }
+    }
+}
+
+static size_t run_blocks(audio_convert_handle_t convert, const audio_format_t *in, uint32_t *seed)
+{
+    const size_t in_bytes = audio_format_frame_bytes(in);
+    audio_format_t out;
+    size_t done = 0, produced = 0;
+
+    audio_convert_get_formats(convert, NULL, &out);
+    while (done < SIGNAL_FRAMES) {
+        size_t n = 1 + host_rand(seed) % 150;
+        if (n > SIGNAL_FRAMES - done) {
+            n = SIGNAL_FRAMES - done;
+        }
+        const size_t expect = audio_convert_out_frames(convert, n);
+        const size_t got = audio_convert_process(convert, in_buf + done * in_bytes, n,
+                                                 out_buf + produced * audio_format_frame_bytes(&out),
+                                                 MAX_OUT_FRAMES - produced);
+        if (got != expect) {
+            return (size_t) -1;
+        }
+        produced += got;
+        done += n;
+    }
+    return produced;
+}
+
+static int all_formats(audio_format_t *formats)
+{
+    int n = 0;
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+            for (int ch = 1; ch <= AUDIO_CONVERT_MAX_CHANNELS; ch++) {
+                formats[n++] = (audio_format_t) {
+                    rates[r], widths[w], (uint8_t)ch
+                };
+            }
+        }
+    }
+    return n;
+}
+
+static void test_all_formats_match_reference(void)
+{
+    audio_format_t formats[4 * 3 * AUDIO_CONVERT_MAX_CHANNELS];
+    const int num = all_formats(formats);
+    uint32_t seed = 11;
+
+    for (int i = 0; i < num; i++) {
+        const audio_format_t *in = &formats[i];
+        make_signal(in, seed++);
+        for (int o = 0; o < num; o++) {
+            const audio_format_t *out = &formats[o];
+            audio_convert_handle_t convert = NULL;
+
+            TEST_ASSERT_EQUAL(ESP_OK, audio_convert_create(in, out, &convert));
+            const size_t ref_frames = ref_convert(in, out, in_buf, SIGNAL_FRAMES, ref_buf);
+            const size_t got = run_blocks(convert, in, &seed);
+            audio_convert_delete(convert);
+            if (got != ref_frames || memcmp(out_buf, ref_buf, ref_frames * audio_format_frame_bytes(out)) != 0) {
+                HOST_TEST_FAIL("%" PRIu32 " Hz %d bit %d ch -> %" PRIu32 " Hz %d bit %d ch: %lld frames, reference %zu%s",
+                               in->sample_rate, in->bits, in->channels, out->sample_rate, out->bits, out->channels,
+                               (long long)got, ref_frames, got == ref_frames ? ", samples differ" : "");
+            }
+        }
+    }
+    printf("  %d format pairs bit-exact\n", num * num);
+}
+
+static void test_in_frames_gives_exact_output(void)
+{
+    const audio_format_t codec = {48000, 16, 2};
+    const audio_format_t usb = {44100, 24, 1};
+    audio_convert_handle_t convert = NULL;
+    uint32_t seed = 5;
+    size_t done = 0;
+
+    /* The microphone path asks for exactly the frames the host wants */
+    make_signal(&codec, 99);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_convert_create(&codec, &usb, &convert));
+    while (true) {
+        const size_t want = 1 + host_rand(&seed) % 48;
+        const size_t need = audio_convert_in_frames(convert, want);
+        if (done + need > SIGNAL_FRAMES) {
+            break;
+        }
+        TEST_ASSERT_EQUAL(want, audio_convert_out_frames(convert, need));
+        TEST_ASSERT_EQUAL(want, audio_convert_process(convert, in_buf + done * 4, need, out_buf, MAX_OUT_FRAMES));
+        done += need;
+    }
+    audio_convert_delete(convert);
+}
+
+static void test_in_place_when_not_larger(void)
+{
+    const audio_format_t in = {48000, 32, 2};
+    const audio_format_t out = {16000, 16, 1};
+    audio_convert_handle_t convert = NULL;
+
+    make_signal(&in, 3);
+    const size_t ref_frames = ref_convert(&in, &out, in_buf, SIGNAL_FRAMES, ref_buf);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_convert_create(&in, &out, &convert));
+    TEST_ASSERT_EQUAL(ref_frames, audio_convert_process(convert, in_buf, SIGNAL_FRAMES, in_buf, MAX_OUT_FRAMES));
+    audio_convert_delete(convert);
+    TEST_ASSERT(memcmp(in_buf, ref_buf, ref_frames * audio_format_frame_bytes(&out)) == 0);
+}
+
+static void test_passthrough_and_reset(void)
+{
+    const audio_format_t f = {48000, 16, 2};
+    const audio_format_t up = {48000, 16, 2};
+    const audio_format_t slow = {16000, 16, 2};
+    audio_convert_handle_t convert = NULL;
+    audio_format_t got_in, got_out;
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_convert_create(&f, &up, &convert));
+    TEST_ASSERT_TRUE(audio_convert_is_passthrough(convert));
+    make_signal(&f, 8);
+    TEST_ASSERT_EQUAL(100, audio_convert_process(convert, in_buf, 100, out_buf, 100));
+    TEST_ASSERT(memcmp(in_buf, out_buf, 400) == 0);
+    /* A short output buffer drops the rest */
+    TEST_ASSERT_EQUAL(10, audio_convert_process(convert, in_buf, 100, out_buf, 10));
+    audio_convert_delete(convert);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_convert_create(&slow, &f, &convert));
+    TEST_ASSERT_FALSE(audio_convert_is_passthrough(convert));
+    audio_convert_get_formats(convert, &got_in, &got_out);
+    TEST_ASSERT_EQUAL(16000, got_in.sample_rate);
+    TEST_ASSERT_EQUAL(48000, got_out.sample_rate);
+    /* After a reset the stream restarts as if the converter were new */
+    make_signal(&slow, 4);
+    const size_t first = audio_convert_process(convert, in_buf, 500, out_buf, MAX_OUT_FRAMES);
+    memcpy(ref_buf, out_buf, first * 4);
+    audio_convert_process(convert, in_buf + 2000, 77, out_buf, MAX_OUT_FRAMES);
+    audio_convert_reset(convert);
+    TEST_ASSERT_EQUAL(first, audio_convert_process(convert, in_buf, 500, out_buf, MAX_OUT_FRAMES));
+    TEST_ASSERT(memcmp(ref_buf, out_buf, first * 4) == 0);
+    audio_convert_delete(convert);
+}
+
+static void test_unsupported_formats(void)
+{
+    const audio_format_t ok = {48000, 16, 2};
+    audio_format_t bad = {22050, 16, 2};
+    audio_convert_handle_t convert = NULL;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, audio_convert_create(&ok, &bad, &convert));
+    bad.sample_rate = 48000;
+    bad.bits = 8;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, audio_convert_create(&bad, &ok, &convert));
+    bad.bits = 16;
+    bad.channels = 3;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, audio_convert_create(&ok, &bad, &convert));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, audio_convert_create(NULL, &ok, &convert));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, audio_convert_create(&ok, &ok, NULL));
+}
+
+int main(void)
+{
+    RUN_TEST(test_all_formats_match_reference);
+    RUN_TEST(test_in_frames_gives_exact_output);
+    RUN_TEST(test_in_place_when_not_larger);
+    RUN_TEST(test_passthrough_and_reset);
+    RUN_TEST(test_unsupported_formats);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,175 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * BAND_MODE of display.c: frames and dirty rectangles composed band by band
+ * in two small buffers must assemble to what the monolithic full-screen
+ * buffer holds.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "display_render.h"
+
+#define WIDTH           (320)
+#define HEIGHT          (240)
+#define GROUP_WIDTH     (10)
+#define STRIP_WIDTH     (8)
+#define STRIP_NUM       (WIDTH / GROUP_WIDTH)
+
+typedef struct {
+    uint16_t panel[WIDTH * HEIGHT];
+    const uint16_t *last_buf;
+    int bands;
+    int max_rows;
+    int next_y;             /* Bands of one rectangle come top to bottom without gaps */
+    bool reused;            /* A band was handed over in the buffer of the band before it */
+} band_sink_t;
+
+static display_render_layout_t layout;
+static uint16_t monolithic[WIDTH * HEIGHT];
+static uint16_t band_mem[2][WIDTH * 40];
+static band_sink_t sink;
+
+static void layout_init(void)
+{
+    memset(&layout, 0, sizeof(layout));
+    layout.width = WIDTH;
+    layout.height = HEIGHT;
+    layout.first_x = 1;
+    layout.group_width = GROUP_WIDTH;
+    layout.strip_width = STRIP_WIDTH;
+    layout.strip_num = STRIP_NUM;
+    for (int i = 0; i < STRIP_NUM; i++) {
+        layout.strip_color[i] = (uint16_t)(0xF800 + i * 33);
+    }
+}
+
+static void sink_flush(const display_render_rect_t *band, const uint16_t *pixels, void *user_ctx)
+{
+    band_sink_t *s = user_ctx;
+    const int w = band->x_end - band->x_start;
+    const int rows = band->y_end - band->y_start;
+
+    if (pixels == s->last_buf) {
+        s->reused = true;
+    }
+    if (band->y_start != s->next_y) {
+        s->next_y = -1;
+    } else {
+        s->next_y = band->y_end;
+    }
+    s->last_buf = pixels;
+    s->bands++;
+    s->max_rows = rows > s->max_rows ? rows : s->max_rows;
+    for (int y = 0; y < rows; y++) {
+        memcpy(&s->panel[(band->y_start + y) * WIDTH + band->x_start], &pixels[y * w], w * sizeof(uint16_t));
+    }
+}
+
+static void state_random(display_render_state_t *state, uint32_t *seed)
+{
+    for (int i = 0; i < STRIP_NUM; i++) {
+        state->bar_top[i] = (int16_t)(host_rand(seed) % (HEIGHT + 1));
+        state->square_top[i] = (int16_t)(state->bar_top[i] - 1 - host_rand(seed) % 40);
+    }
+}
+
+static int flush_banded(const display_render_state_t *state, const display_render_rect_t *rect, size_t band_pixels,
+                        int *band_index)
+{
+    uint16_t *const bufs[2] = { band_mem[0], band_mem[1] };
+    sink.next_y = rect->y_start;
+    const int num = display_render_bands(&layout, state, rect, bufs, band_pixels, band_index, sink_flush, &sink);
+    return sink.next_y == rect->y_end ? num : -1;
+}
+
+static void check_full_frame(size_t band_pixels)
+{
+    const display_render_rect_t full = { 0, 0, WIDTH, HEIGHT };
+    const int rows = (int)(band_pixels / WIDTH);
+    display_render_state_t state;
+    uint32_t seed = 1;
+    int band_index = 0;
+
+    for (int frame = 0; frame < 20; frame++) {
+        state_random(&state, &seed);
+        memset(&sink, 0, sizeof(sink));
+        display_render_rect(&layout, &state, &full, monolithic);
+        const int num = flush_banded(&state, &full, band_pixels, &band_index);
+        TEST_ASSERT_EQUAL((HEIGHT + rows - 1) / rows, num);
+        TEST_ASSERT_EQUAL(rows, sink.max_rows);
+        TEST_ASSERT_FALSE(sink.reused);
+        TEST_ASSERT(memcmp(sink.panel, monolithic, sizeof(monolithic)) == 0);
+    }
+}
+
+static void test_full_frame_in_40_row_bands(void)
+{
+    /* BAND_HEIGHT of display.c */
+    check_full_frame(WIDTH * 40);
+}
+
+static void test_full_frame_in_uneven_bands(void)
+{
+    /* 240 is not a multiple of 7, the last band is shorter */
+    check_full_frame(WIDTH * 7);
+}
+
+static void test_dirty_rects_in_bands(void)
+{
+    const display_render_rect_t full = { 0, 0, WIDTH, HEIGHT };
+    display_render_state_t prev, cur;
+    display_render_rect_t rects[DISPLAY_RENDER_MAX_STRIPS];
+    uint32_t seed = 7;
+    int band_index = 0;
+
+    state_random(&prev, &seed);
+    memset(&sink, 0, sizeof(sink));
+    display_render_rect(&layout, &prev, &full, sink.panel);
+    for (int frame = 0; frame < 200; frame++) {
+        cur = prev;
+        /* A few strips move per frame, like the spectrum does */
+        for (int n = 0; n < 6; n++) {
+            const int i = host_rand(&seed) % STRIP_NUM;
+            cur.bar_top[i] = (int16_t)(host_rand(&seed) % (HEIGHT + 1));
+            cur.square_top[i] = (int16_t)(cur.square_top[i] + 2 - host_rand(&seed) % 5);
+        }
+        const int num = display_render_diff(&layout, &prev, &cur, 256, rects);
+        for (int i = 0; i < num; i++) {
+            /* Narrow rectangles fit many rows in a band, a band is never wider than its rectangle */
+            TEST_ASSERT(flush_banded(&cur, &rects[i], WIDTH * 40, &band_index) > 0);
+            TEST_ASSERT_FALSE(sink.reused);
+        }
+        display_render_rect(&layout, &cur, &full, monolithic);
+        if (memcmp(sink.panel, monolithic, sizeof(monolithic)) != 0) {
+            HOST_TEST_FAIL("frame %d differs from the monolithic buffer", frame);
+        }
+        prev = cur;
+    }
+}
+
+static void test_band_rows(void)
+{
+    const display_render_rect_t wide = { 0, 0, WIDTH, HEIGHT };
+    const display_render_rect_t strip = { 11, 0, 11 + STRIP_WIDTH, HEIGHT };
+
+    TEST_ASSERT_EQUAL(40, display_render_band_rows(&wide, WIDTH * 40));
+    TEST_ASSERT_EQUAL(WIDTH * 40 / STRIP_WIDTH, display_render_band_rows(&strip, WIDTH * 40));
+    TEST_ASSERT_EQUAL(1, display_render_band_rows(&wide, WIDTH - 1));
+}
+
+int main(void)
+{
+    layout_init();
+    RUN_TEST(test_full_frame_in_40_row_bands);
+    RUN_TEST(test_full_frame_in_uneven_bands);
+    RUN_TEST(test_dirty_rects_in_bands);
+    RUN_TEST(test_band_rows);
+    return HOST_TEST_END();
+}
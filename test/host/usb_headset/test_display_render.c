@@ -0,0 +1,279 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Plays a sequence of spectra through display_render_diff and patches a
+ * simulated panel with the dirty rectangles only. After every frame the
+ * panel has to match a full repaint by a pixel-per-pixel reference.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "host_audio.h"
+#include "display_render.h"
+#include "spectrum.h"
+
+#define WIDTH           (320)
+#define HEIGHT          (240)
+#define GROUP_WIDTH     (10)
+#define STRIP_WIDTH     (8)
+#define STRIP_NUM       (WIDTH / GROUP_WIDTH)
+#define FRAME_SAMPLES   (2048)
+#define FRAMES          (300)
+
+static display_render_layout_t layout;
+static uint16_t panel[WIDTH * HEIGHT];
+static uint16_t expected[WIDTH * HEIGHT];
+static uint16_t scratch[WIDTH * HEIGHT];
+
+static void layout_init(void)
+{
+    memset(&layout, 0, sizeof(layout));
+    layout.width = WIDTH;
+    layout.height = HEIGHT;
+    layout.first_x = 1;
+    layout.group_width = GROUP_WIDTH;
+    layout.strip_width = STRIP_WIDTH;
+    layout.strip_num = STRIP_NUM;
+    for (int i = 0; i < STRIP_NUM; i++) {
+        layout.strip_color[i] = (uint16_t)(0x1111 * (i % 15 + 1));
+    }
+}
+
+static void state_blank(display_render_state_t *state)
+{
+    for (int i = 0; i < STRIP_NUM; i++) {
+        state->bar_top[i] = HEIGHT;
+        state->square_top[i] = -1;
+    }
+}
+
+/* The frame as display_draw painted it before the renderer existed, one pixel at a time */
+static void reference_frame(const display_render_state_t *state, uint16_t *out)
+{
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            uint16_t color = DISPLAY_RENDER_BG_COLOR;
+            const int strip = (x - layout.first_x) / GROUP_WIDTH;
+            if (x >= layout.first_x && strip < STRIP_NUM && (x - layout.first_x) % GROUP_WIDTH < STRIP_WIDTH) {
+                if (y >= state->bar_top[strip]) {
+                    color = layout.strip_color[strip];
+                } else if (y >= state->square_top[strip] - STRIP_WIDTH && y <= state->square_top[strip]) {
+                    color = DISPLAY_RENDER_SQUARE_COLOR;
+                }
+            }
+            out[y * WIDTH + x] = color;
+        }
+    }
+}
+
+static void panel_blit(const display_render_rect_t *rect, const uint16_t *pixels)
+{
+    const int w = rect->x_end - rect->x_start;
+    for (int y = rect->y_start; y < rect->y_end; y++) {
+        memcpy(&panel[y * WIDTH + rect->x_start], &pixels[(y - rect->y_start) * w], w * sizeof(uint16_t));
+    }
+}
+
+/**
+ * Bars from the spectrum of the music clip, peak squares with the gravity
+ * of SQUARE_MODE 2 in display.c
+ */
+typedef struct {
+    spectrum_handle_t spectrum;
+    int16_t bins[FRAME_SAMPLES / 2];
+    int16_t samples[FRAME_SAMPLES];
+    float square[STRIP_NUM];
+    float speed[STRIP_NUM];
+    size_t offset;
+} sequence_t;
+
+static void sequence_next(sequence_t *seq, display_render_state_t *state)
+{
+    host_audio_music(seq->samples, FRAME_SAMPLES, 32000, seq->offset);
+    seq->offset += FRAME_SAMPLES / 2;
+    spectrum_process(seq->spectrum, seq->samples, seq->bins);
+    for (int i = 0; i < STRIP_NUM; i++) {
+        const int bin = (int)(2 * pow(2, i / 3.4));
+        int y = SPECTRUM_DB_TO_INT(seq->bins[bin < 1023 ? bin : 1023]) - 40;
+        y = y < 0 ? 0 : y > HEIGHT ? HEIGHT : y;
+        if (y >= seq->square[i]) {
+            seq->square[i] = y - 1;
+            seq->speed[i] = 0.05f * y;
+        } else if (seq->square[i] <= 0) {
+            seq->square[i] = 1;
+        } else {
+            seq->square[i] += seq->speed[i];
+            seq->speed[i] -= 1.5f;
+        }
+        state->bar_top[i] = HEIGHT - y;
+        state->square_top[i] = HEIGHT - (int16_t)seq->square[i];
+    }
+}
+
+static void run_sequence(int merge_cost_px, size_t *moved_px, int *max_rects)
+{
+    const spectrum_config_t config = { .fft_size = FRAME_SAMPLES, .window = SPECTRUM_WINDOW_HANN };
+    static sequence_t seq;
+    display_render_state_t shown, cur;
+    display_render_rect_t rects[DISPLAY_RENDER_MAX_STRIPS];
+
+    memset(&seq, 0, sizeof(seq));
+    TEST_ASSERT_EQUAL(ESP_OK, spectrum_create(&config, &seq.spectrum));
+    state_blank(&shown);
+    reference_frame(&shown, panel);
+    *moved_px = 0;
+    *max_rects = 0;
+
+    for (int frame = 0; frame < FRAMES; frame++) {
+        sequence_next(&seq, &cur);
+        const int num = display_render_diff(&layout, &shown, &cur, merge_cost_px, rects);
+        TEST_ASSERT_LESS_OR_EQUAL(STRIP_NUM, num);
+        for (int i = 0; i < num; i++) {
+            const display_render_rect_t *r = &rects[i];
+            TEST_ASSERT(r->x_start >= 0 && r->x_start < r->x_end && r->x_end <= WIDTH);
+            TEST_ASSERT(r->y_start >= 0 && r->y_start < r->y_end && r->y_end <= HEIGHT);
+            display_render_rect(&layout, &cur, r, scratch);
+            panel_blit(r, scratch);
+            *moved_px += display_render_rect_area(r);
+        }
+        *max_rects = num > *max_rects ? num : *max_rects;
+        shown = cur;
+
+        reference_frame(&cur, expected);
+        if (memcmp(panel, expected, sizeof(panel)) != 0) {
+            spectrum_delete(seq.spectrum);
+            HOST_TEST_FAIL("frame %d differs from a full repaint", frame);
+        }
+    }
+    spectrum_delete(seq.spectrum);
+}
+
+static void test_full_render_matches_reference(void)
+{
+    const display_render_rect_t full = { 0, 0, WIDTH, HEIGHT };
+    display_render_state_t state;
+
+    for (int i = 0; i < STRIP_NUM; i++) {
+        state.bar_top[i] = (int16_t)(i * 7);
+        state.square_top[i] = (int16_t)(i * 7 - 3 + (i % 3) * 20);
+    }
+    display_render_rect(&layout, &state, &full, scratch);
+    reference_frame(&state, expected);
+    TEST_ASSERT(memcmp(scratch, expected, sizeof(expected)) == 0);
+}
+
+static void test_sub_rect_matches_full_render(void)
+{
+    const display_render_rect_t full = { 0, 0, WIDTH, HEIGHT };
+    /* Starts and ends inside strips and inside gaps */
+    const display_render_rect_t part = { 5, 30, 207, 171 };
+    static uint16_t sub[WIDTH * HEIGHT];
+    display_render_state_t state;
+
+    for (int i = 0; i < STRIP_NUM; i++) {
+        state.bar_top[i] = (int16_t)(HEIGHT - i * 6);
+        state.square_top[i] = (int16_t)(HEIGHT - i * 6 - 10);
+    }
+    display_render_rect(&layout, &state, &full, scratch);
+    display_render_rect(&layout, &state, &part, sub);
+    for (int y = part.y_start; y < part.y_end; y++) {
+        for (int x = part.x_start; x < part.x_end; x++) {
+            TEST_ASSERT_EQUAL(scratch[y * WIDTH + x], sub[(y - part.y_start) * (part.x_end - part.x_start) + x - part.x_start]);
+        }
+    }
+}
+
+static void test_unchanged_frame_has_no_rects(void)
+{
+    display_render_state_t state;
+    display_render_rect_t rects[DISPLAY_RENDER_MAX_STRIPS];
+
+    state_blank(&state);
+    TEST_ASSERT_EQUAL(0, display_render_diff(&layout, &state, &state, 256, rects));
+}
+
+static void test_diff_one_rect_per_strip_without_merge(void)
+{
+    display_render_state_t prev, cur;
+    display_render_rect_t rects[DISPLAY_RENDER_MAX_STRIPS];
+
+    state_blank(&prev);
+    prev.square_top[10] = 110;
+    cur = prev;
+    cur.bar_top[3] = 200;
+    cur.bar_top[4] = 190;
+    cur.square_top[10] = 100;
+
+    const int num = display_render_diff(&layout, &prev, &cur, 0, rects);
+    TEST_ASSERT_EQUAL(3, num);
+    /* Only the rows between the old and the new bar top */
+    TEST_ASSERT_EQUAL(1 + 3 * GROUP_WIDTH, rects[0].x_start);
+    TEST_ASSERT_EQUAL(1 + 3 * GROUP_WIDTH + STRIP_WIDTH, rects[0].x_end);
+    TEST_ASSERT_EQUAL(200, rects[0].y_start);
+    TEST_ASSERT_EQUAL(HEIGHT, rects[0].y_end);
+    /* From the top of the new square to the bottom of the old one */
+    TEST_ASSERT_EQUAL(100 - STRIP_WIDTH, rects[2].y_start);
+    TEST_ASSERT_EQUAL(111, rects[2].y_end);
+}
+
+static void test_diff_merges_neighbours_when_cheaper(void)
+{
+    display_render_state_t prev, cur;
+    display_render_rect_t rects[DISPLAY_RENDER_MAX_STRIPS];
+
+    state_blank(&prev);
+    cur = prev;
+    cur.bar_top[3] = 200;
+    cur.bar_top[4] = 200;
+    cur.bar_top[20] = 200;
+
+    /* Merging 3 and 4 costs only the gap between them, 20 is too far */
+    const int num = display_render_diff(&layout, &prev, &cur, 256, rects);
+    TEST_ASSERT_EQUAL(2, num);
+    TEST_ASSERT_EQUAL(1 + 3 * GROUP_WIDTH, rects[0].x_start);
+    TEST_ASSERT_EQUAL(1 + 4 * GROUP_WIDTH + STRIP_WIDTH, rects[0].x_end);
+    TEST_ASSERT_EQUAL(1 + 20 * GROUP_WIDTH, rects[1].x_start);
+
+    /* With a huge transfer overhead everything ends in one rectangle */
+    TEST_ASSERT_EQUAL(1, display_render_diff(&layout, &prev, &cur, WIDTH * HEIGHT, rects));
+}
+
+static void test_sequence_without_merge(void)
+{
+    size_t moved;
+    int max_rects;
+
+    run_sequence(0, &moved, &max_rects);
+    printf("  no merge: %.1f%% of the full frames moved, up to %d rects\n",
+           100.0 * moved / ((double)FRAMES * WIDTH * HEIGHT), max_rects);
+}
+
+static void test_sequence_with_merge(void)
+{
+    size_t moved;
+    int max_rects;
+
+    run_sequence(256, &moved, &max_rects);
+    printf("  merge 256: %.1f%% of the full frames moved, up to %d rects\n",
+           100.0 * moved / ((double)FRAMES * WIDTH * HEIGHT), max_rects);
+    /* The point of the exercise: most frames move a fraction of the panel */
+    TEST_ASSERT_LESS_OR_EQUAL((size_t)FRAMES * WIDTH * HEIGHT / 2, moved);
+}
+
+int main(void)
+{
+    layout_init();
+    RUN_TEST(test_full_render_matches_reference);
+    RUN_TEST(test_sub_rect_matches_full_render);
+    RUN_TEST(test_unchanged_frame_has_no_rects);
+    RUN_TEST(test_diff_one_rect_per_strip_without_merge);
+    RUN_TEST(test_diff_merges_neighbours_when_cheaper);
+    RUN_TEST(test_sequence_without_merge);
+    RUN_TEST(test_sequence_with_merge);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,313 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * drift_comp between two simulated clocks. The speaker and microphone loops
+ * of usb_headset.c are replayed on an event clock: one side moves 1 ms
+ * chunks at the USB rate, the other at the codec rate, each a few hundred
+ * ppm off. The FIFO between them has to stay near its target, which bounds
+ * the latency it adds, and the integral term has to find the offset.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "drift_comp.h"
+
+#define RATE                (48000)
+#define CHANNELS            (2)
+#define CHUNK_FRAMES        (RATE / 1000)
+#define FIFO_TARGET_FRAMES  (CHUNK_FRAMES * 4)
+#define RESAMPLE_CAPACITY   (CHUNK_FRAMES + CHUNK_FRAMES / 8)
+#define SIM_SECONDS         (300)
+#define SETTLE_SECONDS      (60)
+
+typedef struct {
+    double usb_ppm;             /* USB clock error against nominal */
+    double codec_ppm;           /* Codec clock error against nominal */
+    double step_at;             /* Seconds at which usb_ppm jumps by step_ppm, 0 for none */
+    double step_ppm;
+} clocks_t;
+
+typedef struct {
+    double fill_min;
+    double fill_max;
+    uint32_t underruns;
+    uint32_t overflows;
+    double drift_sum;           /* Drift estimate summed over the settled updates */
+    uint32_t drift_updates;
+    drift_comp_status_t status;
+} sim_result_t;
+
+static int16_t chunk_in[RESAMPLE_CAPACITY * CHANNELS];
+static int16_t chunk_out[RESAMPLE_CAPACITY * CHANNELS];
+
+static double clock_period(double ppm, size_t frames)
+{
+    return frames / (RATE * (1.0 + ppm * 1e-6));
+}
+
+static void track_drift(sim_result_t *res, double t, drift_comp_handle_t drift)
+{
+    /* The last quarter of the run, after any step */
+    if (t >= SIM_SECONDS * 3 / 4) {
+        drift_comp_get_status(drift, &res->status);
+        res->drift_sum += res->status.drift_ppm;
+        res->drift_updates++;
+    }
+}
+
+static void track_fill(sim_result_t *res, double t, double fill)
+{
+    if (t >= SETTLE_SECONDS) {
+        res->fill_min = fill < res->fill_min ? fill : res->fill_min;
+        res->fill_max = fill > res->fill_max ? fill : res->fill_max;
+    }
+}
+
+/**
+ * Speaker: the UAC callback enqueues a chunk per USB millisecond, spk_task
+ * takes a chunk, steers, resamples and blocks in i2s_write for as long as
+ * the codec needs to play what came out.
+ */
+static void simulate_speaker(const clocks_t *clk, sim_result_t *res)
+{
+    const drift_comp_config_t config = DRIFT_COMP_DEFAULT_CONFIG(CHANNELS, FIFO_TARGET_FRAMES);
+    drift_comp_handle_t drift = NULL;
+    double t_usb = 0, t_codec = 0;
+    double usb_ppm = clk->usb_ppm;
+    long fill = 0;
+
+    memset(res, 0, sizeof(*res));
+    res->fill_min = 1e9;
+    TEST_ASSERT_EQUAL(ESP_OK, drift_comp_create(&config, &drift));
+    /* spk_task starts once the FIFO reached its target */
+    while (fill < FIFO_TARGET_FRAMES) {
+        fill += CHUNK_FRAMES;
+        t_usb += clock_period(usb_ppm, CHUNK_FRAMES);
+    }
+    t_codec = t_usb;
+
+    while (t_codec < SIM_SECONDS) {
+        if (clk->step_at > 0 && t_usb >= clk->step_at) {
+            usb_ppm = clk->usb_ppm + clk->step_ppm;
+        }
+        if (t_usb <= t_codec) {
+            fill += CHUNK_FRAMES;
+            t_usb += clock_period(usb_ppm, CHUNK_FRAMES);
+            continue;
+        }
+        if (fill < CHUNK_FRAMES) {
+            res->underruns++;
+            t_codec = t_usb;
+            continue;
+        }
+        fill -= CHUNK_FRAMES;
+        drift_comp_update(drift, fill);
+        const size_t out = drift_comp_process(drift, chunk_in, CHUNK_FRAMES, chunk_out, RESAMPLE_CAPACITY);
+        track_fill(res, t_codec, fill);
+        track_drift(res, t_codec, drift);
+        t_codec += clock_period(clk->codec_ppm, out);
+    }
+    drift_comp_delete(drift);
+}
+
+/**
+ * Microphone: mic_task reads a chunk per codec millisecond, steers,
+ * resamples and enqueues, the UAC input callback takes a chunk per USB
+ * millisecond.
+ */
+static void simulate_microphone(const clocks_t *clk, sim_result_t *res)
+{
+    const drift_comp_config_t config = DRIFT_COMP_DEFAULT_CONFIG(CHANNELS, FIFO_TARGET_FRAMES);
+    drift_comp_handle_t drift = NULL;
+    double t_usb = 0, t_codec = 0;
+    double usb_ppm = clk->usb_ppm;
+    long fill = 0;
+
+    memset(res, 0, sizeof(*res));
+    res->fill_min = 1e9;
+    TEST_ASSERT_EQUAL(ESP_OK, drift_comp_create(&config, &drift));
+    /* The host starts reading once the FIFO reached its target */
+    while (fill < FIFO_TARGET_FRAMES) {
+        fill += drift_comp_process(drift, chunk_in, CHUNK_FRAMES, chunk_out, RESAMPLE_CAPACITY);
+        t_codec += clock_period(clk->codec_ppm, CHUNK_FRAMES);
+    }
+    t_usb = t_codec;
+
+    while (t_usb < SIM_SECONDS) {
+        if (clk->step_at > 0 && t_usb >= clk->step_at) {
+            usb_ppm = clk->usb_ppm + clk->step_ppm;
+        }
+        if (t_codec <= t_usb) {
+            drift_comp_update(drift, fill);
+            track_drift(res, t_codec, drift);
+            fill += drift_comp_process(drift, chunk_in, CHUNK_FRAMES, chunk_out, RESAMPLE_CAPACITY);
+            if (fill > 2048) {
+                res->overflows++;
+            }
+            t_codec += clock_period(clk->codec_ppm, CHUNK_FRAMES);
+            continue;
+        }
+        if (fill < CHUNK_FRAMES) {
+            res->underruns++;
+            fill = 0;
+        } else {
+            fill -= CHUNK_FRAMES;
+        }
+        track_fill(res, t_usb, fill);
+        t_usb += clock_period(usb_ppm, CHUNK_FRAMES);
+    }
+    drift_comp_delete(drift);
+}
+
+/* `offset` is the producer clock against the consumer clock at the end of the run */
+static void check_result(const char *name, double offset, const sim_result_t *res)
+{
+    /* Frames the FIFO may wander from its target once the loop settled, chunks come and go whole */
+    const double band = CHUNK_FRAMES * 3 / 2;
+    const double drift = res->drift_updates ? res->drift_sum / res->drift_updates : 0;
+
+    printf("  %s %+4.0f ppm: drift %6.1f ppm (last %6.1f), fill %.0f..%.0f (target %d)\n", name, offset,
+           drift, res->status.drift_ppm, res->fill_min, res->fill_max, FIFO_TARGET_FRAMES);
+    TEST_ASSERT_EQUAL(0, res->underruns);
+    TEST_ASSERT_EQUAL(0, res->overflows);
+    TEST_ASSERT_GREATER_OR_EQUAL(FIFO_TARGET_FRAMES - band, res->fill_min);
+    TEST_ASSERT_LESS_OR_EQUAL(FIFO_TARGET_FRAMES + band, res->fill_max);
+    /* The estimate is relative: a fast producer reads as positive drift. It rides the chunk ripple, average it */
+    TEST_ASSERT_FLOAT_WITHIN(5, offset, drift);
+}
+
+static const clocks_t cases[] = {
+    { .usb_ppm = 0, .codec_ppm = 0 },
+    { .usb_ppm = 300, .codec_ppm = 0 },
+    { .usb_ppm = -300, .codec_ppm = 0 },
+    { .usb_ppm = 150, .codec_ppm = -250 },
+    { .usb_ppm = -200, .codec_ppm = 200 },
+    /* Thermal drift: the host clock moves by 200 ppm in the middle of the session */
+    { .usb_ppm = 100, .codec_ppm = 0, .step_at = SIM_SECONDS / 2, .step_ppm = -200 },
+};
+
+static void test_speaker_tracks_drift(void)
+{
+    sim_result_t res;
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        simulate_speaker(&cases[i], &res);
+        check_result("spk", cases[i].usb_ppm + cases[i].step_ppm - cases[i].codec_ppm, &res);
+    }
+}
+
+static void test_microphone_tracks_drift(void)
+{
+    sim_result_t res;
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        simulate_microphone(&cases[i], &res);
+        /* The microphone FIFO is filled on the codec side: the codec is its producer */
+        check_result("mic", cases[i].codec_ppm - cases[i].usb_ppm - cases[i].step_ppm, &res);
+    }
+}
+
+static void test_unity_ratio_is_a_delay(void)
+{
+    const drift_comp_config_t config = DRIFT_COMP_DEFAULT_CONFIG(CHANNELS, FIFO_TARGET_FRAMES);
+    drift_comp_handle_t drift = NULL;
+    int16_t in[CHUNK_FRAMES * CHANNELS];
+    int16_t out[RESAMPLE_CAPACITY * CHANNELS];
+    int16_t prev[CHUNK_FRAMES * CHANNELS];
+    uint32_t seed = 3;
+
+    TEST_ASSERT_EQUAL(ESP_OK, drift_comp_create(&config, &drift));
+    memset(prev, 0, sizeof(prev));
+    for (int block = 0; block < 20; block++) {
+        for (int i = 0; i < CHUNK_FRAMES * CHANNELS; i++) {
+            in[i] = (int16_t)host_rand(&seed);
+        }
+        /* Without an update the ratio stays 1: every frame comes out, two frames late, untouched */
+        TEST_ASSERT_EQUAL(CHUNK_FRAMES, drift_comp_process(drift, in, CHUNK_FRAMES, out, RESAMPLE_CAPACITY));
+        for (int f = 0; f < CHUNK_FRAMES; f++) {
+            for (int ch = 0; ch < CHANNELS; ch++) {
+                const int src = f - 2;
+                const int16_t expect = src < 0 ? prev[(CHUNK_FRAMES + src) * CHANNELS + ch] : in[src * CHANNELS + ch];
+                if (out[f * CHANNELS + ch] != expect) {
+                    drift_comp_delete(drift);
+                    HOST_TEST_FAIL("block %d frame %d channel %d: %d instead of %d", block, f, ch,
+                                   out[f * CHANNELS + ch], expect);
+                }
+            }
+        }
+        memcpy(prev, in, sizeof(in));
+    }
+    drift_comp_delete(drift);
+}
+
+static void test_resampled_sine_stays_clean(void)
+{
+    const drift_comp_config_t config = DRIFT_COMP_DEFAULT_CONFIG(1, FIFO_TARGET_FRAMES);
+    drift_comp_handle_t drift = NULL;
+    const double freq = 1000.0;
+    const double ratio_ppm = 2000;
+    int16_t in[CHUNK_FRAMES];
+    int16_t out[RESAMPLE_CAPACITY];
+    double pos = -2;                        /* Input position of the next output frame, two frames of history */
+    double err = 0, sig = 0;
+    size_t in_frames = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, drift_comp_create(&config, &drift));
+    /* A FIFO far above target drives the correction to its limit, a reset restarts from the drift estimate */
+    for (int i = 0; i < 2000; i++) {
+        drift_comp_update(drift, FIFO_TARGET_FRAMES * 10);
+    }
+    drift_comp_reset(drift);
+    drift_comp_status_t status;
+    drift_comp_get_status(drift, &status);
+    TEST_ASSERT_FLOAT_WITHIN(1e-9, 1.0 + ratio_ppm * 1e-6, status.ratio);
+
+    for (int block = 0; block < 200; block++) {
+        for (int i = 0; i < CHUNK_FRAMES; i++) {
+            in[i] = (int16_t)lrint(16000 * sin(2 * M_PI * freq * (in_frames + i) / RATE));
+        }
+        in_frames += CHUNK_FRAMES;
+        const size_t n = drift_comp_process(drift, in, CHUNK_FRAMES, out, RESAMPLE_CAPACITY);
+        for (size_t k = 0; k < n; k++) {
+            if (pos > 2) {
+                const double ideal = 16000 * sin(2 * M_PI * freq * pos / RATE);
+                err += (out[k] - ideal) * (out[k] - ideal);
+                sig += ideal * ideal;
+            }
+            pos += status.ratio;
+        }
+    }
+    drift_comp_delete(drift);
+    const double snr = 10 * log10(sig / err);
+    printf("  1 kHz at %+.0f ppm: SNR %.1f dB\n", ratio_ppm, snr);
+    TEST_ASSERT_GREATER_OR_EQUAL(60, snr);
+}
+
+static void test_invalid_arguments(void)
+{
+    drift_comp_config_t config = DRIFT_COMP_DEFAULT_CONFIG(CHANNELS, FIFO_TARGET_FRAMES);
+    drift_comp_handle_t drift = NULL;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, drift_comp_create(NULL, &drift));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, drift_comp_create(&config, NULL));
+    config.channels = DRIFT_COMP_MAX_CHANNELS + 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, drift_comp_create(&config, &drift));
+    config.channels = CHANNELS;
+    config.target_fill = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, drift_comp_create(&config, &drift));
+}
+
+int main(void)
+{
+    RUN_TEST(test_unity_ratio_is_a_delay);
+    RUN_TEST(test_resampled_sine_stays_clean);
+    RUN_TEST(test_speaker_tracks_drift);
+    RUN_TEST(test_microphone_tracks_drift);
+    RUN_TEST(test_invalid_arguments);
+    return HOST_TEST_END();
+}
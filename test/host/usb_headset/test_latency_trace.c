@@ -0,0 +1,264 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * latency_trace on a mock microsecond clock: histogram percentiles against
+ * the exact order statistics, the FIFO tag queue across counter wrap and
+ * the event ring.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "latency_trace.h"
+
+static uint64_t mock_now_us;
+
+static uint64_t mock_clock(void)
+{
+    return mock_now_us;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Same rank rule as the summary: the smallest value with at least p % of the samples at or below it */
+static uint32_t exact_percentile(const uint32_t *sorted, uint32_t count, int p)
+{
+    const uint32_t rank = (count * p + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+/* The bucket of `exact` may only round it up, by less than an eighth of an octave */
+static int percentile_ok(uint32_t exact, uint32_t reported)
+{
+    return reported >= exact && (uint64_t)reported <= (uint64_t)exact + (exact >> 3);
+}
+
+static void check_distribution(const uint32_t *values, uint32_t count)
+{
+    static uint32_t sorted[100000];
+    latency_summary_t summary;
+    static const int ps[3] = {50, 90, 99};
+
+    latency_trace_reset();
+    for (uint32_t i = 0; i < count; i++) {
+        latency_trace_record(LATENCY_STAGE_I2S_WRITE, values[i]);
+    }
+    memcpy(sorted, values, count * sizeof(uint32_t));
+    qsort(sorted, count, sizeof(uint32_t), cmp_u32);
+    latency_trace_get_summary(LATENCY_STAGE_I2S_WRITE, &summary);
+
+    TEST_ASSERT_EQUAL(count, summary.count);
+    TEST_ASSERT_EQUAL(sorted[0], summary.min_us);
+    TEST_ASSERT_EQUAL(sorted[count - 1], summary.max_us);
+    const uint32_t got[3] = {summary.p50_us, summary.p90_us, summary.p99_us};
+    for (int i = 0; i < 3; i++) {
+        const uint32_t exact = exact_percentile(sorted, count, ps[i]);
+        if (!percentile_ok(exact, got[i]) || got[i] > summary.max_us) {
+            HOST_TEST_FAIL("p%d of %" PRIu32 " samples: %" PRIu32 ", exact %" PRIu32, ps[i], count, got[i], exact);
+        }
+    }
+}
+
+static void test_small_values_are_exact(void)
+{
+    uint32_t values[15];
+    latency_summary_t summary;
+
+    for (int i = 0; i < 15; i++) {
+        values[i] = 15 - i;
+    }
+    check_distribution(values, 15);
+    latency_trace_get_summary(LATENCY_STAGE_I2S_WRITE, &summary);
+    /* Below 16 us each value has its own bucket */
+    TEST_ASSERT_EQUAL(8, summary.p50_us);
+    TEST_ASSERT_EQUAL(14, summary.p90_us);
+    TEST_ASSERT_EQUAL(15, summary.p99_us);
+}
+
+static void test_percentiles_of_hundred(void)
+{
+    uint32_t values[100];
+    latency_summary_t summary;
+
+    for (int i = 0; i < 100; i++) {
+        values[i] = 1000 + i * 10;
+    }
+    check_distribution(values, 100);
+
+    /* p99 of 100 samples is the 99th, a single outlier is only the maximum */
+    for (int i = 0; i < 100; i++) {
+        values[i] = i == 37 ? 15 : 3;
+    }
+    check_distribution(values, 100);
+    latency_trace_get_summary(LATENCY_STAGE_I2S_WRITE, &summary);
+    TEST_ASSERT_EQUAL(3, summary.p99_us);
+    TEST_ASSERT_EQUAL(15, summary.max_us);
+}
+
+static void test_random_distributions(void)
+{
+    static uint32_t values[100000];
+    uint32_t seed = 42;
+
+    /* A 1 ms period with jitter, like the USB and I2S intervals */
+    for (uint32_t i = 0; i < 100000; i++) {
+        values[i] = 1000 + host_rand(&seed) % 60 - 30;
+    }
+    check_distribution(values, 100000);
+
+    /* Long tailed: mostly short, a few stalls of several milliseconds */
+    for (uint32_t i = 0; i < 100000; i++) {
+        const uint32_t r = host_rand(&seed);
+        values[i] = (r % 100 == 0) ? 2000 + r % 50000 : 50 + r % 200;
+    }
+    check_distribution(values, 100000);
+
+    /* Every octave up to the top of the range */
+    for (uint32_t i = 0; i < 3200; i++) {
+        values[i] = host_rand(&seed) >> (i % 32);
+    }
+    check_distribution(values, 3200);
+}
+
+static void test_extremes(void)
+{
+    const uint32_t values[3] = {0, UINT32_MAX, UINT32_MAX - 1};
+    latency_summary_t summary;
+
+    check_distribution(values, 3);
+    latency_trace_reset();
+    latency_trace_get_summary(LATENCY_STAGE_I2S_READ, &summary);
+    TEST_ASSERT_EQUAL(0, summary.count);
+    TEST_ASSERT_EQUAL(0, summary.p99_us);
+}
+
+static void test_record_since_uses_clock(void)
+{
+    latency_summary_t summary;
+    latency_event_t events[4];
+
+    latency_trace_reset();
+    mock_now_us = 5000;
+    const uint64_t start = latency_trace_now();
+    mock_now_us += 1234;
+    latency_trace_record_since(LATENCY_STAGE_I2S_READ, start);
+    latency_trace_get_summary(LATENCY_STAGE_I2S_READ, &summary);
+    TEST_ASSERT_EQUAL(1, summary.count);
+    TEST_ASSERT_EQUAL(1234, summary.min_us);
+
+    /* Longer than 32 bits of microseconds saturates instead of wrapping */
+    mock_now_us = start + 0x100000005ULL;
+    latency_trace_record_since(LATENCY_STAGE_I2S_READ, start);
+    latency_trace_get_summary(LATENCY_STAGE_I2S_READ, &summary);
+    TEST_ASSERT_EQUAL(UINT32_MAX, summary.max_us);
+
+    TEST_ASSERT_EQUAL(2, latency_trace_get_events(events, 4));
+    TEST_ASSERT_EQUAL(6234, events[0].timestamp_us);
+    TEST_ASSERT_EQUAL(1234, events[0].latency_us);
+    TEST_ASSERT_EQUAL(LATENCY_STAGE_I2S_READ, events[0].stage);
+}
+
+static void test_tag_queue_measures_fifo_latency(void)
+{
+    static latency_tag_queue_t queue;
+    latency_summary_t summary;
+    /* Close to the wrap of the free-running sample counters */
+    uint32_t write_pos = UINT32_MAX - 200;
+    uint32_t read_pos = write_pos;
+
+    memset(&queue, 0, sizeof(queue));
+    latency_trace_reset();
+    mock_now_us = 1000000;
+    /* Blocks of 96 samples every millisecond, read 4 ms later */
+    for (int ms = 0; ms < 1000; ms++) {
+        write_pos += 96;
+        latency_tag_push(&queue, write_pos);
+        if (ms >= 4) {
+            read_pos += 96;
+            latency_tag_consume(&queue, read_pos, LATENCY_STAGE_SPK_USB_TO_I2S);
+        }
+        mock_now_us += 1000;
+    }
+    latency_trace_get_summary(LATENCY_STAGE_SPK_USB_TO_I2S, &summary);
+    TEST_ASSERT_EQUAL(996, summary.count);
+    TEST_ASSERT_EQUAL(4000, summary.min_us);
+    TEST_ASSERT_EQUAL(4000, summary.max_us);
+
+    /* A read that ends inside a block does not complete it */
+    latency_tag_consume(&queue, read_pos + 95, LATENCY_STAGE_SPK_USB_TO_I2S);
+    latency_trace_get_summary(LATENCY_STAGE_SPK_USB_TO_I2S, &summary);
+    TEST_ASSERT_EQUAL(996, summary.count);
+    /* A skip past several blocks completes all of them */
+    latency_tag_consume(&queue, write_pos, LATENCY_STAGE_SPK_USB_TO_I2S);
+    latency_trace_get_summary(LATENCY_STAGE_SPK_USB_TO_I2S, &summary);
+    TEST_ASSERT_EQUAL(1000, summary.count);
+    TEST_ASSERT_EQUAL(4000, summary.max_us);
+}
+
+static void test_tag_queue_full_drops_tags(void)
+{
+    static latency_tag_queue_t queue;
+    latency_summary_t summary;
+
+    memset(&queue, 0, sizeof(queue));
+    latency_trace_reset();
+    mock_now_us = 0;
+    /* The consumer stalled: only the first LATENCY_TAG_QUEUE_LEN blocks are tagged */
+    for (uint32_t i = 1; i <= LATENCY_TAG_QUEUE_LEN * 2; i++) {
+        latency_tag_push(&queue, i * 10);
+        mock_now_us += 100;
+    }
+    latency_tag_consume(&queue, LATENCY_TAG_QUEUE_LEN * 20, LATENCY_STAGE_MIC_I2S_TO_USB);
+    latency_trace_get_summary(LATENCY_STAGE_MIC_I2S_TO_USB, &summary);
+    TEST_ASSERT_EQUAL(LATENCY_TAG_QUEUE_LEN, summary.count);
+    TEST_ASSERT_EQUAL(LATENCY_TAG_QUEUE_LEN * 200 - (LATENCY_TAG_QUEUE_LEN - 1) * 100, summary.min_us);
+    TEST_ASSERT_EQUAL(LATENCY_TAG_QUEUE_LEN * 200, summary.max_us);
+}
+
+static void test_event_ring_keeps_latest(void)
+{
+    static latency_event_t events[LATENCY_TRACE_EVENTS + 8];
+
+    latency_trace_reset();
+    for (uint32_t i = 0; i < LATENCY_TRACE_EVENTS + 100; i++) {
+        mock_now_us = i;
+        latency_trace_record(LATENCY_STAGE_USB_IN_INTERVAL, i);
+    }
+    TEST_ASSERT_EQUAL(LATENCY_TRACE_EVENTS, latency_trace_get_events(events, LATENCY_TRACE_EVENTS + 8));
+    for (int i = 0; i < LATENCY_TRACE_EVENTS; i++) {
+        TEST_ASSERT_EQUAL(100 + i, events[i].latency_us);
+    }
+    /* A short copy gets the newest events, still oldest first */
+    TEST_ASSERT_EQUAL(8, latency_trace_get_events(events, 8));
+    TEST_ASSERT_EQUAL(LATENCY_TRACE_EVENTS + 92, events[0].latency_us);
+    TEST_ASSERT_EQUAL(LATENCY_TRACE_EVENTS + 99, events[7].latency_us);
+}
+
+static void test_stage_names(void)
+{
+    TEST_ASSERT(strcmp(latency_trace_stage_name(LATENCY_STAGE_I2S_WRITE), "i2s_write") == 0);
+    TEST_ASSERT(strcmp(latency_trace_stage_name(LATENCY_STAGE_MAX), "unknown") == 0);
+}
+
+int main(void)
+{
+    latency_trace_init(mock_clock);
+    RUN_TEST(test_small_values_are_exact);
+    RUN_TEST(test_percentiles_of_hundred);
+    RUN_TEST(test_random_distributions);
+    RUN_TEST(test_extremes);
+    RUN_TEST(test_record_since_uses_clock);
+    RUN_TEST(test_tag_queue_measures_fifo_latency);
+    RUN_TEST(test_tag_queue_full_drops_tags);
+    RUN_TEST(test_event_ring_keeps_latest);
+    RUN_TEST(test_stage_names);
+    return HOST_TEST_END();
+}
@@ -0,0 +1,337 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * mic_dsp on 1 ms blocks of 48 kHz stereo, like mic_task feeds it: the
+ * bypass is bit-exact and only changes between blocks, also when another
+ * thread requests it, then DC removal, the limiter ceiling, the noise gate
+ * and the cycle budget.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "host_audio.h"
+#include "mic_dsp.h"
+
+#define RATE            (48000)
+#define CHANNELS        (2)
+#define BLOCK_FRAMES    (RATE / 1000)
+#define BLOCK_SAMPLES   (BLOCK_FRAMES * CHANNELS)
+
+static void fill_music(int16_t *block, size_t pos)
+{
+    for (int f = 0; f < BLOCK_FRAMES; f++) {
+        const int16_t v = host_audio_music_sample(pos + f, RATE);
+        block[f * CHANNELS] = v;
+        block[f * CHANNELS + 1] = v / 2;
+    }
+}
+
+static void fill_sine(int16_t *block, size_t pos, double amplitude, int16_t dc)
+{
+    for (int f = 0; f < BLOCK_FRAMES; f++) {
+        const int16_t v = (int16_t)lrint(dc + amplitude * sin(2 * M_PI * 1000.0 * (pos + f) / RATE));
+        block[f * CHANNELS] = v;
+        block[f * CHANNELS + 1] = v;
+    }
+}
+
+static int32_t block_peak(const int16_t *block)
+{
+    int32_t peak = 0;
+    for (int i = 0; i < BLOCK_SAMPLES; i++) {
+        peak = abs(block[i]) > peak ? abs(block[i]) : peak;
+    }
+    return peak;
+}
+
+static void test_bypass_is_bit_exact(void)
+{
+    const mic_dsp_config_t config = MIC_DSP_DEFAULT_CONFIG(RATE, CHANNELS);
+    mic_dsp_handle_t dsp = NULL;
+    int16_t in[BLOCK_SAMPLES], out[BLOCK_SAMPLES];
+    mic_dsp_stats_t stats;
+
+    TEST_ASSERT_EQUAL(ESP_OK, mic_dsp_create(&config, &dsp));
+    mic_dsp_set_bypass(dsp, true);
+    for (size_t pos = 0; pos < RATE; pos += BLOCK_FRAMES) {
+        fill_music(in, pos);
+        memcpy(out, in, sizeof(in));
+        mic_dsp_process(dsp, out, BLOCK_FRAMES);
+        if (memcmp(in, out, sizeof(in)) != 0) {
+            mic_dsp_delete(dsp);
+            HOST_TEST_FAIL("bypassed block at frame %zu changed", pos);
+        }
+    }
+    mic_dsp_get_stats(dsp, &stats);
+    TEST_ASSERT_EQUAL(RATE / BLOCK_FRAMES, stats.blocks);
+    mic_dsp_delete(dsp);
+}
+
+static void test_bypass_off_restarts_clean(void)
+{
+    mic_dsp_config_t config = MIC_DSP_DEFAULT_CONFIG(RATE, CHANNELS);
+    mic_dsp_handle_t dsp = NULL, fresh = NULL;
+    int16_t in[BLOCK_SAMPLES], a[BLOCK_SAMPLES], b[BLOCK_SAMPLES];
+
+    /* Without the AGC no state survives a reset, a restarted chain matches a new one */
+    config.agc = false;
+    TEST_ASSERT_EQUAL(ESP_OK, mic_dsp_create(&config, &dsp));
+    TEST_ASSERT_EQUAL(ESP_OK, mic_dsp_create(&config, &fresh));
+    for (size_t pos = 0; pos < 100 * BLOCK_FRAMES; pos += BLOCK_FRAMES) {
+        fill_sine(a, pos, 20000, 3000);
+        mic_dsp_process(dsp, a, BLOCK_FRAMES);
+    }
+
+    /* Requested between blocks: nothing happens until the next one */
+    mic_dsp_set_bypass(dsp, true);
+    fill_sine(in, 0, 20000, 3000);
+    memcpy(a, in, sizeof(in));
+    mic_dsp_process(dsp, a, BLOCK_FRAMES);
+    TEST_ASSERT(memcmp(a, in, sizeof(in)) == 0);
+
+    mic_dsp_set_bypass(dsp, false);
+    for (size_t pos = 0; pos < 10 * BLOCK_FRAMES; pos += BLOCK_FRAMES) {
+        fill_sine(in, pos, 20000, 3000);
+        memcpy(a, in, sizeof(in));
+        memcpy(b, in, sizeof(in));
+        mic_dsp_process(dsp, a, BLOCK_FRAMES);
+        mic_dsp_process(fresh, b, BLOCK_FRAMES);
+        if (memcmp(a, b, sizeof(a)) != 0) {
+            mic_dsp_delete(dsp);
+            mic_dsp_delete(fresh);
+            HOST_TEST_FAIL("block at frame %zu differs from a new chain", pos);
+        }
+    }
+    mic_dsp_delete(dsp);
+    mic_dsp_delete(fresh);
+}
+
+typedef struct {
+    mic_dsp_handle_t dsp;
+    atomic_bool done;
+} toggle_arg_t;
+
+static void *toggle_thread(void *arg)
+{
+    toggle_arg_t *t = arg;
+    uint32_t seed = 7;
+    bool bypass = false;
+
+    while (!atomic_load(&t->done)) {
+        bypass = !bypass;
+        mic_dsp_set_bypass(t->dsp, bypass);
+        for (uint32_t spin = host_rand(&seed) % 2000; spin > 0; spin--) {
+            __asm__ volatile("");
+        }
+    }
+    return NULL;
+}
+
+static void test_bypass_from_another_thread(void)
+{
+    mic_dsp_config_t config = MIC_DSP_DEFAULT_CONFIG(RATE, CHANNELS);
+    toggle_arg_t arg = { 0 };
+    pthread_t thread;
+    int16_t in[BLOCK_SAMPLES], out[BLOCK_SAMPLES];
+    int bypassed = 0, processed = 0, torn = 0;
+
+    config.agc = false;
+    config.hpf_cutoff_hz = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, mic_dsp_create(&config, &arg.dsp));
+    /* A constant input: a processed block always ends well below it, a bypassed one is untouched */
+    for (int i = 0; i < BLOCK_SAMPLES; i++) {
+        in[i] = 10000;
+    }
+    pthread_create(&thread, NULL, toggle_thread, &arg);
+    /* Until both kinds of blocks have been seen plenty of times */
+    int n = 0;
+    for (; n < 10000000 && (bypassed < 1000 || processed < 1000); n++) {
+        memcpy(out, in, sizeof(in));
+        mic_dsp_process(arg.dsp, out, BLOCK_FRAMES);
+        const bool untouched_end = out[BLOCK_SAMPLES - 1] == in[BLOCK_SAMPLES - 1];
+        const bool untouched = memcmp(out, in, sizeof(in)) == 0;
+        if (untouched_end && !untouched) {
+            torn++;
+        }
+        bypassed += untouched;
+        processed += !untouched_end;
+    }
+    atomic_store(&arg.done, true);
+    pthread_join(thread, NULL);
+    mic_dsp_delete(arg.dsp);
+
+    TEST_ASSERT_EQUAL(0, torn);
+    TEST_ASSERT_EQUAL(n, bypassed + processed);
+    TEST_ASSERT_GREATER_OR_EQUAL(1000, bypassed);
+    TEST_ASSERT_GREATER_OR_EQUAL(1000, processed);
+}
+
+static void test_dc_removal(void)
+{
+    mic_dsp_config_t config = MIC_DSP_DEFAULT_CONFIG(RATE, CHANNELS);
+    mic_dsp_handle_t dsp = NULL;
+    int16_t block[BLOCK_SAMPLES];
+    int64_t sum = 0;
+    int count = 0;
+
+    config.agc = false;
+    TEST_ASSERT_EQUAL(ESP_OK, mic_dsp_create(&config, &dsp));
+    for (size_t pos = 0; pos < 2 * RATE; pos += BLOCK_FRAMES) {
+        fill_sine(block, pos, 8000, 6000);
+        mic_dsp_process(dsp, block, BLOCK_FRAMES);
+        if (pos >= RATE) {
+            for (int i = 0; i < BLOCK_SAMPLES; i++) {
+                sum += block[i];
+            }
+            count += BLOCK_SAMPLES;
+        }
+    }
+    mic_dsp_delete(dsp);
+    /* The offset is gone, the 1 kHz tone passes at full level */
+    TEST_ASSERT_INT_WITHIN(20, 0, sum / count);
+    TEST_ASSERT_INT_WITHIN(400, 8000, block_peak(block));
+}
+
+static void test_limiter_ceiling(void)
+{
+    mic_dsp_config_t config = MIC_DSP_DEFAULT_CONFIG(RATE, CHANNELS);
+    mic_dsp_handle_t dsp = NULL;
+    int16_t block[BLOCK_SAMPLES];
+    const int32_t ceiling = (int32_t)(INT16_MAX * pow(10.0, config.limiter_dbfs / 20.0));
+
+    /* A quiet start drives the AGC to its maximum gain, then a full scale burst hits it */
+    TEST_ASSERT_EQUAL(ESP_OK, mic_dsp_create(&config, &dsp));
+    for (size_t pos = 0; pos < 3 * RATE; pos += BLOCK_FRAMES) {
+        fill_sine(block, pos, pos < 2 * RATE ? 100 : 32000, 0);
+        mic_dsp_process(dsp, block, BLOCK_FRAMES);
+        if (block_peak(block) > ceiling + 1) {
+            mic_dsp_delete(dsp);
+            HOST_TEST_FAIL("peak %" PRId32 " above the %" PRId32 " ceiling at frame %zu", block_peak(block), ceiling, pos);
+        }
+    }
+    mic_dsp_delete(dsp);
+}
+
+static void test_noise_gate(void)
+{
+    mic_dsp_config_t config = MIC_DSP_DEFAULT_CONFIG(RATE, CHANNELS);
+    mic_dsp_handle_t dsp = NULL;
+    int16_t block[BLOCK_SAMPLES];
+    mic_dsp_stats_t stats;
+    const double floor_gain = pow(10.0, -config.gate_floor_db / 20.0);
+
+    config.agc = false;
+    config.dc_remove = false;
+    config.hpf_cutoff_hz = 0;
+    config.noise_gate = true;
+    TEST_ASSERT_EQUAL(ESP_OK, mic_dsp_create(&config, &dsp));
+
+    /* -70 dBFS is below the -60 dBFS threshold: the gate closes after the hold time */
+    for (size_t pos = 0; pos < RATE; pos += BLOCK_FRAMES) {
+        fill_sine(block, pos, 10, 0);
+        mic_dsp_process(dsp, block, BLOCK_FRAMES);
+    }
+    mic_dsp_get_stats(dsp, &stats);
+    TEST_ASSERT_FALSE(stats.gate_open);
+    fill_sine(block, 0, 3000, 0);
+    for (int i = 0; i < BLOCK_SAMPLES; i++) {
+        block[i] /= 300;    /* Still -70 dBFS, but large enough to measure the attenuation */
+    }
+    const int32_t quiet = block_peak(block);
+    mic_dsp_process(dsp, block, BLOCK_FRAMES);
+    TEST_ASSERT_LESS_OR_EQUAL((int32_t)lrint(quiet * floor_gain) + 1, block_peak(block));
+
+    /* Speech level opens it within the ramp time */
+    for (size_t pos = 0; pos < 10 * BLOCK_FRAMES; pos += BLOCK_FRAMES) {
+        fill_sine(block, pos, 8000, 0);
+        mic_dsp_process(dsp, block, BLOCK_FRAMES);
+    }
+    mic_dsp_get_stats(dsp, &stats);
+    TEST_ASSERT_TRUE(stats.gate_open);
+    TEST_ASSERT_INT_WITHIN(2, 8000, block_peak(block));
+    mic_dsp_delete(dsp);
+}
+
+static uint32_t mock_cycles;
+static uint32_t mock_cycles_per_call;
+
+static uint32_t mock_get_cycles(void)
+{
+    mock_cycles += mock_cycles_per_call;
+    return mock_cycles;
+}
+
+static void test_cycle_budget_sheds_and_recovers(void)
+{
+    mic_dsp_config_t config = MIC_DSP_DEFAULT_CONFIG(RATE, CHANNELS);
+    mic_dsp_handle_t dsp = NULL;
+    int16_t block[BLOCK_SAMPLES];
+    mic_dsp_stats_t stats;
+
+    config.noise_gate = true;
+    config.cycle_budget = 1000;
+    config.get_cycles = mock_get_cycles;
+    TEST_ASSERT_EQUAL(ESP_OK, mic_dsp_create(&config, &dsp));
+
+    /* Every block over budget: the gate, then the high-pass, go */
+    mock_cycles_per_call = 2000;
+    for (int n = 0; n < 5; n++) {
+        fill_sine(block, n * BLOCK_FRAMES, 8000, 0);
+        mic_dsp_process(dsp, block, BLOCK_FRAMES);
+    }
+    mic_dsp_get_stats(dsp, &stats);
+    TEST_ASSERT_EQUAL(5, stats.over_budget);
+    TEST_ASSERT_EQUAL(2, stats.shed_stages);
+    TEST_ASSERT_EQUAL(2000, stats.cycles_max);
+
+    /* Well within budget for long enough: one stage back at a time */
+    mock_cycles_per_call = 100;
+    for (int n = 0; n < 256; n++) {
+        mic_dsp_process(dsp, block, BLOCK_FRAMES);
+    }
+    mic_dsp_get_stats(dsp, &stats);
+    TEST_ASSERT_EQUAL(1, stats.shed_stages);
+    for (int n = 0; n < 256; n++) {
+        mic_dsp_process(dsp, block, BLOCK_FRAMES);
+    }
+    mic_dsp_get_stats(dsp, &stats);
+    TEST_ASSERT_EQUAL(0, stats.shed_stages);
+    TEST_ASSERT_EQUAL(100, stats.cycles_last);
+    mic_dsp_delete(dsp);
+}
+
+static void test_invalid_config(void)
+{
+    mic_dsp_config_t config = MIC_DSP_DEFAULT_CONFIG(RATE, 3);
+    mic_dsp_handle_t dsp = NULL;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_dsp_create(&config, &dsp));
+    config.channels = CHANNELS;
+    config.cycle_budget = 1000;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_dsp_create(&config, &dsp));
+    config.cycle_budget = 0;
+    config.hpf_cutoff_hz = RATE / 4;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_dsp_create(&config, &dsp));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_dsp_create(NULL, &dsp));
+    TEST_ASSERT_NULL(dsp);
+}
+
+int main(void)
+{
+    RUN_TEST(test_bypass_is_bit_exact);
+    RUN_TEST(test_bypass_off_restarts_clean);
+    RUN_TEST(test_bypass_from_another_thread);
+    RUN_TEST(test_dc_removal);
+    RUN_TEST(test_limiter_ceiling);
+    RUN_TEST(test_noise_gate);
+    RUN_TEST(test_cycle_budget_sheds_and_recovers);
+    RUN_TEST(test_invalid_config);
+    return HOST_TEST_END();
+}
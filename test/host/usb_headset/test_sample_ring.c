@@ -0,0 +1,252 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * sample_ring with a producer thread and a consumer thread, the way the UAC
+ * callback and the FFT task use it. Samples carry a running counter so the
+ * consumer can check that nothing is lost, duplicated or reordered.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+
+#include "host_test.h"
+#include "sample_ring.h"
+
+#define CAPACITY        (1024)
+#define FRAME           (256)
+#define TOTAL_SAMPLES   (4 * 1000 * 1000)
+
+typedef struct {
+    sample_ring_handle_t ring;
+    bool retry;                     /* Producer retries what did not fit instead of dropping it */
+    atomic_bool done;
+    uint32_t produced;
+    uint32_t accepted;
+    uint32_t short_writes;          /* Writes that dropped samples, each may leave one gap */
+    /* Consumer wake-up, stands in for the task notification */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notified;
+    /* Consumer results */
+    uint32_t consumed;
+    uint32_t errors;
+    uint32_t gaps;
+    uint32_t lost_wakeups;
+    uint32_t wakeups;
+} stress_t;
+
+static void *producer(void *arg)
+{
+    stress_t *st = arg;
+    int16_t chunk[CAPACITY];
+    uint32_t seq = 0;
+    uint32_t seed = 0x1234;
+
+    while (seq < TOTAL_SAMPLES) {
+        /* USB packets of uneven size, sometimes bursts, sometimes a pause */
+        size_t n = 1 + host_rand(&seed) % 96;
+        if (n > TOTAL_SAMPLES - seq) {
+            n = TOTAL_SAMPLES - seq;
+        }
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = (int16_t)(seq + i);
+        }
+        size_t off = 0;
+        do {
+            bool frame_ready = false;
+            const size_t w = sample_ring_write(st->ring, chunk + off, n - off, &frame_ready);
+            st->accepted += w;
+            off += w;
+            if (off < n) {
+                st->short_writes++;
+            }
+            if (frame_ready) {
+                pthread_mutex_lock(&st->lock);
+                st->notified++;
+                pthread_cond_signal(&st->cond);
+                pthread_mutex_unlock(&st->lock);
+            }
+            if (off < n && st->retry) {
+                sched_yield();
+            }
+        } while (off < n && st->retry);
+        seq += n;
+        st->produced = seq;
+        if (host_rand(&seed) % 64 == 0) {
+            sched_yield();
+        }
+    }
+    atomic_store(&st->done, true);
+    pthread_mutex_lock(&st->lock);
+    pthread_cond_signal(&st->cond);
+    pthread_mutex_unlock(&st->lock);
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    stress_t *st = arg;
+    int16_t frame[FRAME];
+    uint32_t expect = 0;
+    uint32_t seen = 0;
+
+    while (true) {
+        pthread_mutex_lock(&st->lock);
+        if (st->notified == seen && !atomic_load(&st->done)) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 1;
+            if (pthread_cond_timedwait(&st->cond, &st->lock, &ts) != 0
+                    && sample_ring_available(st->ring) >= FRAME) {
+                /* A full frame sat in the ring without a notification */
+                st->lost_wakeups++;
+            }
+        }
+        seen = st->notified;
+        pthread_mutex_unlock(&st->lock);
+        st->wakeups++;
+
+        /* Drain like fft_convert_task: only ask for what is there */
+        while (sample_ring_available(st->ring) >= FRAME) {
+            if (!sample_ring_read(st->ring, frame, FRAME)) {
+                st->errors++;
+                break;
+            }
+            for (int i = 0; i < FRAME; i++) {
+                const int16_t got = frame[i];
+                if (got != (int16_t)expect) {
+                    st->gaps++;
+                }
+                expect = (uint16_t)got + 1;
+            }
+            st->consumed += FRAME;
+        }
+        if (atomic_load(&st->done) && sample_ring_available(st->ring) < FRAME) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void run_stress(bool retry, stress_t *st)
+{
+    pthread_t p, c;
+
+    memset(st, 0, sizeof(*st));
+    st->retry = retry;
+    pthread_mutex_init(&st->lock, NULL);
+    pthread_cond_init(&st->cond, NULL);
+    atomic_init(&st->done, false);
+    TEST_ASSERT_EQUAL(ESP_OK, sample_ring_create(CAPACITY, FRAME, &st->ring));
+
+    pthread_create(&c, NULL, consumer, st);
+    pthread_create(&p, NULL, producer, st);
+    pthread_join(p, NULL);
+    pthread_join(c, NULL);
+    pthread_cond_destroy(&st->cond);
+    pthread_mutex_destroy(&st->lock);
+}
+
+static void test_stress_lossless(void)
+{
+    static stress_t st;
+    sample_ring_stats_t stats;
+
+    run_stress(true, &st);
+    sample_ring_get_stats(st.ring, &stats);
+    printf("  %" PRIu32 " samples, %" PRIu32 " wake-ups, overrun %" PRIu32 "\n", st.consumed, st.wakeups, stats.overrun);
+    TEST_ASSERT_EQUAL(0, st.errors);
+    TEST_ASSERT_EQUAL(0, st.gaps);
+    TEST_ASSERT_EQUAL(0, st.lost_wakeups);
+    TEST_ASSERT_EQUAL(TOTAL_SAMPLES, stats.written);
+    TEST_ASSERT_EQUAL(stats.written, stats.read + sample_ring_available(st.ring));
+    TEST_ASSERT_EQUAL(TOTAL_SAMPLES - TOTAL_SAMPLES % FRAME, st.consumed);
+    /* The consumer only asked for what it saw, so no read came back short */
+    TEST_ASSERT_EQUAL(0, stats.underrun);
+    sample_ring_delete(st.ring);
+}
+
+static void test_stress_dropping_producer(void)
+{
+    static stress_t st;
+    sample_ring_stats_t stats;
+
+    run_stress(false, &st);
+    sample_ring_get_stats(st.ring, &stats);
+    printf("  %" PRIu32 " samples, overrun %" PRIu32 ", %" PRIu32 " gaps\n", st.consumed, stats.overrun, st.gaps);
+    /* Every gap in the sequence comes from a write that did not fit, nothing else breaks it */
+    TEST_ASSERT_EQUAL(0, st.errors);
+    TEST_ASSERT_LESS_OR_EQUAL(st.short_writes, st.gaps);
+    TEST_ASSERT_EQUAL(0, st.lost_wakeups);
+    TEST_ASSERT_EQUAL(TOTAL_SAMPLES, stats.written + stats.overrun);
+    TEST_ASSERT_EQUAL(st.accepted, stats.written);
+    TEST_ASSERT_EQUAL(0, stats.underrun);
+    sample_ring_delete(st.ring);
+}
+
+static void test_counters_single_thread(void)
+{
+    sample_ring_handle_t ring = NULL;
+    int16_t in[CAPACITY + 10];
+    int16_t out[CAPACITY];
+    sample_ring_stats_t stats;
+    bool frame_ready = true;
+
+    for (int i = 0; i < CAPACITY + 10; i++) {
+        in[i] = (int16_t)i;
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, sample_ring_create(CAPACITY, FRAME, &ring));
+    TEST_ASSERT_FALSE(sample_ring_read(ring, out, 1));
+
+    TEST_ASSERT_EQUAL(FRAME - 1, sample_ring_write(ring, in, FRAME - 1, &frame_ready));
+    TEST_ASSERT_FALSE(frame_ready);
+    TEST_ASSERT_EQUAL(1, sample_ring_write(ring, in + FRAME - 1, 1, &frame_ready));
+    TEST_ASSERT_TRUE(frame_ready);
+    /* Already above a frame: no second notification */
+    TEST_ASSERT_EQUAL(1, sample_ring_write(ring, in + FRAME, 1, &frame_ready));
+    TEST_ASSERT_FALSE(frame_ready);
+
+    /* Fill to the brim, the rest is dropped */
+    TEST_ASSERT_EQUAL(CAPACITY - FRAME - 1, sample_ring_write(ring, in + FRAME + 1, CAPACITY - FRAME + 9, NULL));
+    TEST_ASSERT_EQUAL(CAPACITY, sample_ring_available(ring));
+    TEST_ASSERT_EQUAL(100, sample_ring_skip(ring, 100));
+    TEST_ASSERT_TRUE(sample_ring_read(ring, out, CAPACITY - 100));
+    for (int i = 0; i < CAPACITY - 100; i++) {
+        TEST_ASSERT_EQUAL(100 + i, out[i]);
+    }
+    TEST_ASSERT_EQUAL(0, sample_ring_skip(ring, 5));
+
+    sample_ring_get_stats(ring, &stats);
+    TEST_ASSERT_EQUAL(CAPACITY, stats.written);
+    TEST_ASSERT_EQUAL(CAPACITY, stats.read);
+    TEST_ASSERT_EQUAL(10, stats.overrun);
+    TEST_ASSERT_EQUAL(1, stats.underrun);
+    sample_ring_delete(ring);
+}
+
+static void test_invalid_arguments(void)
+{
+    sample_ring_handle_t ring = NULL;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sample_ring_create(1000, 100, &ring));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sample_ring_create(1024, 2048, &ring));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sample_ring_create(1024, 0, &ring));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sample_ring_create(1024, 256, NULL));
+    sample_ring_delete(NULL);
+}
+
+int main(void)
+{
+    RUN_TEST(test_counters_single_thread);
+    RUN_TEST(test_invalid_arguments);
+    RUN_TEST(test_stress_lossless);
+    RUN_TEST(test_stress_dropping_producer);
+    return HOST_TEST_END();
+}
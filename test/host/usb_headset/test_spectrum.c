@@ -0,0 +1,194 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Checks spectrum_process bin by bin against a double precision DFT of the
+ * same definition, on the synthetic clip and on frames of a recorded prompt
+ * given as the first argument.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "host_audio.h"
+#include "spectrum.h"
+
+#define FFT_SIZE        (2048)
+#define BINS            (FFT_SIZE / 2)
+
+static double ref_window(spectrum_window_t window, int i, int n)
+{
+    const double phase = 2.0 * M_PI * i / n;
+    switch (window) {
+    case SPECTRUM_WINDOW_HANN:
+        return 0.5 - 0.5 * cos(phase);
+    case SPECTRUM_WINDOW_BLACKMAN_HARRIS:
+        return 0.35875 - 0.48829 * cos(phase) + 0.14128 * cos(2 * phase) - 0.01168 * cos(3 * phase);
+    default:
+        return 1.0;
+    }
+}
+
+/* The documented output: 10 * log10(|X[k]|^2) + SPECTRUM_DB_OFFSET in Q6, X normalised by the window sum and full scale */
+static void ref_spectrum(const int16_t *x, int n, spectrum_window_t window, int16_t *out, double *power)
+{
+    double w[FFT_SIZE];
+    double gain = 0;
+
+    for (int i = 0; i < n; i++) {
+        w[i] = ref_window(window, i, n);
+        gain += w[i];
+    }
+    for (int k = 0; k < n / 2; k++) {
+        double re = 0, im = 0;
+        for (int i = 0; i < n; i++) {
+            const double v = x[i] * w[i] / (gain * INT16_MAX);
+            const double a = 2.0 * M_PI * (double)k * i / n;
+            re += v * cos(a);
+            im -= v * sin(a);
+        }
+        double p = re * re + im * im;
+        power[k] = p;
+        if (p < 1e-13) {
+            p = 1e-13;
+        }
+        long db = lrint((10 * log10(p) + SPECTRUM_DB_OFFSET) * (1 << SPECTRUM_DB_FRAC_BITS));
+        out[k] = db < 0 ? 0 : db > INT16_MAX ? INT16_MAX : (int16_t)db;
+    }
+}
+
+static const char *s_recording;
+static int16_t samples[FFT_SIZE];
+static int16_t out_db[BINS];
+static int16_t ref_db[BINS];
+static double ref_power[BINS];
+
+/* Compare every bin, tighter where the bin is well above the float noise floor */
+static void check_against_reference(spectrum_window_t window)
+{
+    spectrum_handle_t handle = NULL;
+    const spectrum_config_t config = { .fft_size = FFT_SIZE, .window = window };
+    int worst = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, spectrum_create(&config, &handle));
+    TEST_ASSERT_EQUAL(BINS, spectrum_get_bins(handle));
+    TEST_ASSERT_EQUAL(ESP_OK, spectrum_process(handle, samples, out_db));
+    spectrum_delete(handle);
+    ref_spectrum(samples, FFT_SIZE, window, ref_db, ref_power);
+
+    for (int k = 0; k < BINS; k++) {
+        const int err = abs(out_db[k] - ref_db[k]);
+        /* 1e-9 is -90 dBFS, below it the single precision transform itself dominates */
+        const int limit = ref_power[k] > 1e-9 ? 2 : 1 << SPECTRUM_DB_FRAC_BITS;
+        if (err > limit) {
+            HOST_TEST_FAIL("window %d bin %d: got %d, reference %d", window, k, out_db[k], ref_db[k]);
+        }
+        if (ref_power[k] > 1e-9 && err > worst) {
+            worst = err;
+        }
+    }
+    printf("  window %d: worst error %d LSB (%.4f dB)\n", window, worst, (double)worst / (1 << SPECTRUM_DB_FRAC_BITS));
+}
+
+static void test_music_matches_reference(void)
+{
+    host_audio_music(samples, FFT_SIZE, 32000, 12345);
+    check_against_reference(SPECTRUM_WINDOW_RECT);
+    check_against_reference(SPECTRUM_WINDOW_HANN);
+    check_against_reference(SPECTRUM_WINDOW_BLACKMAN_HARRIS);
+}
+
+static void test_recording_matches_reference(void)
+{
+    size_t count = 0, checked = 0;
+    uint32_t rate = 0;
+    int16_t *clip = s_recording ? host_audio_load_wav(s_recording, &count, &rate) : NULL;
+
+    if (clip == NULL || count < FFT_SIZE) {
+        free(clip);
+        HOST_TEST_FAIL("cannot read the recording %s", s_recording ? s_recording : "(none given)");
+    }
+    printf("  %s: %zu samples at %" PRIu32 " Hz\n", s_recording, count, rate);
+    /* Eight frames spread over the clip, those with speech in them */
+    for (size_t f = 0; f < 8; f++) {
+        const size_t start = (count - FFT_SIZE) * f / 7;
+        int32_t peak = 0;
+
+        memcpy(samples, clip + start, sizeof(samples));
+        for (int i = 0; i < FFT_SIZE; i++) {
+            peak = abs(samples[i]) > peak ? abs(samples[i]) : peak;
+        }
+        if (peak < 256) {
+            continue;
+        }
+        check_against_reference(f % 2 ? SPECTRUM_WINDOW_HANN : SPECTRUM_WINDOW_BLACKMAN_HARRIS);
+        checked++;
+    }
+    free(clip);
+    TEST_ASSERT_GREATER_OR_EQUAL(4, checked);
+}
+
+static void test_sine_lands_in_its_bin(void)
+{
+    spectrum_handle_t handle = NULL;
+    const spectrum_config_t config = { .fft_size = FFT_SIZE, .window = SPECTRUM_WINDOW_RECT };
+    const int bin = 100;
+
+    for (int i = 0; i < FFT_SIZE; i++) {
+        samples[i] = (int16_t)lrint(INT16_MAX * sin(2 * M_PI * bin * i / FFT_SIZE));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, spectrum_create(&config, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, spectrum_process(handle, samples, out_db));
+    spectrum_delete(handle);
+
+    /* A full scale sine is 0.5 after normalisation: -6.02 dB */
+    TEST_ASSERT_INT_WITHIN(2, lrint((SPECTRUM_DB_OFFSET - 6.0206) * (1 << SPECTRUM_DB_FRAC_BITS)), out_db[bin]);
+    for (int k = 0; k < BINS; k++) {
+        if (k != bin) {
+            TEST_ASSERT_LESS_OR_EQUAL(out_db[bin] - (60 << SPECTRUM_DB_FRAC_BITS), out_db[k]);
+        }
+    }
+}
+
+static void test_silence_reads_floor(void)
+{
+    spectrum_handle_t handle = NULL;
+    const spectrum_config_t config = { .fft_size = 64, .window = SPECTRUM_WINDOW_HANN };
+
+    memset(samples, 0, sizeof(samples));
+    TEST_ASSERT_EQUAL(ESP_OK, spectrum_create(&config, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, spectrum_process(handle, samples, out_db));
+    spectrum_delete(handle);
+    /* The floor is 0, give or take the log2 approximation */
+    for (int k = 0; k < 32; k++) {
+        TEST_ASSERT_LESS_OR_EQUAL(1, out_db[k]);
+    }
+}
+
+static void test_invalid_arguments(void)
+{
+    spectrum_handle_t handle = NULL;
+    spectrum_config_t config = { .fft_size = 1000, .window = SPECTRUM_WINDOW_HANN };
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, spectrum_create(&config, &handle));
+    config.fft_size = 2;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, spectrum_create(&config, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, spectrum_create(NULL, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, spectrum_process(NULL, samples, out_db));
+    TEST_ASSERT_EQUAL(0, spectrum_get_bins(NULL));
+    spectrum_delete(NULL);
+}
+
+int main(int argc, char **argv)
+{
+    s_recording = argc > 1 ? argv[1] : NULL;
+    RUN_TEST(test_music_matches_reference);
+    RUN_TEST(test_recording_matches_reference);
+    RUN_TEST(test_sine_lands_in_its_bin);
+    RUN_TEST(test_silence_reads_floor);
+    RUN_TEST(test_invalid_arguments);
+    return HOST_TEST_END();
+}